@@ -0,0 +1,536 @@
+/**
+ * ADBC Cube Driver - Connection Mode Benchmark
+ *
+ * Runs a weighted mix of queries against each connection mode at several
+ * concurrency levels and reports, per mode and level:
+ * - Throughput (queries and rows per second)
+ * - Latency percentiles (p50, p95, p99, p99.9) of executing and draining
+ *   a query
+ * - Bytes on the wire: what the driver read from the socket (native mode
+ *   only), and what the network interfaces received (/proc/net/dev, so
+ *   the whole host; accurate on an otherwise idle machine or loopback)
+ * - Client CPU per row (user + system time of this process)
+ *
+ * With --json, the results are also written as JSON (to stdout for -), to
+ * track them over releases.
+ *
+ * Usage:
+ *   ./bench_connection_modes [--modes native,postgresql]
+ *                            [--concurrency 1,4,16] [--duration 10]
+ *                            [--warmup 2] [--queries FILE] [--json FILE]
+ *
+ * The query file has one query per line, optionally preceded by an integer
+ * weight and a tab; empty lines and lines starting with # are skipped.
+ *
+ * Environment:
+ *   CUBE_HOST         Cube SQL API host (default: localhost)
+ *   CUBE_NATIVE_PORT  Native protocol port (default: $CUBE_PORT or 8120)
+ *   CUBE_PG_PORT      PostgreSQL protocol port (default: 15432)
+ *   CUBE_TOKEN        Token (default: test)
+ */
+
+#include <arrow-adbc/adbc.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+    AdbcStatusCode AdbcDriverInit(int version, void* driver, AdbcError* error);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Query {
+    std::string sql;
+    int weight = 1;
+};
+
+struct Options {
+    std::vector<std::string> modes = {"native", "postgresql"};
+    std::vector<int> concurrency = {1, 4, 16};
+    double duration_s = 10;
+    double warmup_s = 2;
+    std::vector<Query> queries;
+    std::string json_path;
+};
+
+// What one worker measured
+struct WorkerResult {
+    std::vector<int64_t> latencies_ns;
+    int64_t rows = 0;
+    int64_t bytes_received = 0;
+    int64_t errors = 0;
+    std::string first_error;
+};
+
+struct LevelResult {
+    std::string mode;
+    int concurrency = 0;
+    double seconds = 0;
+    int64_t queries = 0;
+    int64_t errors = 0;
+    int64_t rows = 0;
+    int64_t bytes_received = 0;     // -1 when the mode does not report it
+    int64_t interface_rx_bytes = 0; // -1 without /proc/net/dev
+    double cpu_seconds = 0;
+    double latency_ms[6] = {};      // p50, p95, p99, p99.9, max, mean
+    std::string first_error;
+};
+
+const char* Env(const char* name, const char* fallback) {
+    const char* value = getenv(name);
+    return value && value[0] ? value : fallback;
+}
+
+std::vector<std::string> Split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+bool LoadQueries(const std::string& path, std::vector<Query>* out) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        Query query;
+        size_t tab = line.find('\t');
+        if (tab != std::string::npos &&
+            line.find_first_not_of("0123456789") == tab && tab > 0) {
+            query.weight = std::max(1, atoi(line.substr(0, tab).c_str()));
+            line = line.substr(tab + 1);
+        }
+        query.sql = line;
+        out->push_back(query);
+    }
+    return !out->empty();
+}
+
+// Bytes received by every network interface so far, or -1
+int64_t InterfaceRxBytes() {
+    std::ifstream file("/proc/net/dev");
+    if (!file) return -1;
+    std::string line;
+    int64_t total = 0;
+    while (std::getline(file, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::istringstream fields(line.substr(colon + 1));
+        int64_t rx = 0;
+        fields >> rx;
+        total += rx;
+    }
+    return total;
+}
+
+double CpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto seconds = [](const timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    };
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+std::string TakeError(AdbcError* error) {
+    std::string message = error->message ? error->message : "unknown error";
+    if (error->release) error->release(error);
+    *error = {};
+    return message;
+}
+
+// One mode's database, shared by the workers of every level
+class Target {
+public:
+    Target(AdbcDriver* driver, const std::string& mode) : driver_(driver), mode_(mode) {}
+
+    ~Target() {
+        AdbcError error = {};
+        if (database_.private_data) driver_->DatabaseRelease(&database_, &error);
+    }
+
+    bool Init(std::string* message) {
+        AdbcError error = {};
+        const char* port = mode_ == "native"
+                               ? Env("CUBE_NATIVE_PORT", Env("CUBE_PORT", "8120"))
+                               : Env("CUBE_PG_PORT", "15432");
+        if (driver_->DatabaseNew(&database_, &error) != ADBC_STATUS_OK ||
+            driver_->DatabaseSetOption(&database_, "adbc.cube.host",
+                                       Env("CUBE_HOST", "localhost"), &error) != ADBC_STATUS_OK ||
+            driver_->DatabaseSetOption(&database_, "adbc.cube.port", port, &error) != ADBC_STATUS_OK ||
+            driver_->DatabaseSetOption(&database_, "adbc.cube.token",
+                                       Env("CUBE_TOKEN", "test"), &error) != ADBC_STATUS_OK ||
+            driver_->DatabaseSetOption(&database_, "adbc.cube.connection_mode",
+                                       mode_.c_str(), &error) != ADBC_STATUS_OK ||
+            driver_->DatabaseInit(&database_, &error) != ADBC_STATUS_OK) {
+            *message = TakeError(&error);
+            return false;
+        }
+        return true;
+    }
+
+    // Run queries from the mix on a connection of its own until deadline,
+    // recording them when record is set
+    void Work(const std::vector<Query>& queries, int seed, Clock::time_point deadline,
+              bool record, WorkerResult* result) {
+        AdbcError error = {};
+        AdbcConnection connection = {};
+        AdbcStatement statement = {};
+        if (driver_->ConnectionNew(&connection, &error) != ADBC_STATUS_OK ||
+            driver_->ConnectionInit(&connection, &database_, &error) != ADBC_STATUS_OK ||
+            driver_->StatementNew(&connection, &statement, &error) != ADBC_STATUS_OK) {
+            result->errors++;
+            result->first_error = TakeError(&error);
+            if (connection.private_data) driver_->ConnectionRelease(&connection, &error);
+            return;
+        }
+
+        std::vector<int> weights;
+        for (const auto& query : queries) weights.push_back(query.weight);
+        std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+        std::mt19937 random(seed);
+
+        while (Clock::now() < deadline) {
+            const Query& query = queries[pick(random)];
+            auto start = Clock::now();
+            int64_t rows = 0;
+            std::string failure;
+            if (!RunQuery(&statement, query.sql, &rows, &failure)) {
+                if (record) {
+                    result->errors++;
+                    if (result->first_error.empty()) result->first_error = failure;
+                }
+                continue;
+            }
+            auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             Clock::now() - start).count();
+            if (!record) continue;
+            result->latencies_ns.push_back(nanos);
+            result->rows += rows;
+            int64_t bytes = 0;
+            if (mode_ == "native" && driver_->StatementGetOptionInt &&
+                driver_->StatementGetOptionInt(&statement, "adbc.cube.stats.bytes_received",
+                                               &bytes, &error) == ADBC_STATUS_OK) {
+                result->bytes_received += bytes;
+            } else {
+                TakeError(&error);
+            }
+        }
+
+        driver_->StatementRelease(&statement, &error);
+        driver_->ConnectionRelease(&connection, &error);
+    }
+
+private:
+    bool RunQuery(AdbcStatement* statement, const std::string& sql, int64_t* rows,
+                  std::string* failure) {
+        AdbcError error = {};
+        ArrowArrayStream stream = {};
+        int64_t rows_affected = -1;
+        if (driver_->StatementSetSqlQuery(statement, sql.c_str(), &error) != ADBC_STATUS_OK ||
+            driver_->StatementExecuteQuery(statement, &stream, &rows_affected, &error) !=
+                ADBC_STATUS_OK) {
+            *failure = TakeError(&error);
+            return false;
+        }
+        bool ok = true;
+        while (true) {
+            ArrowArray array = {};
+            int code = stream.get_next(&stream, &array);
+            if (code != 0) {
+                const char* message = stream.get_last_error(&stream);
+                *failure = message ? message : "get_next failed";
+                ok = false;
+                break;
+            }
+            if (!array.release) break;
+            *rows += array.length;
+            array.release(&array);
+        }
+        stream.release(&stream);
+        return ok;
+    }
+
+    AdbcDriver* driver_;
+    std::string mode_;
+    AdbcDatabase database_ = {};
+};
+
+LevelResult RunLevel(Target* target, const std::string& mode, int concurrency,
+                     const Options& options) {
+    // Warm up connections, prepared plans and server caches first
+    auto run = [&](double seconds, bool record, std::vector<WorkerResult>* results) {
+        auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                           std::chrono::duration<double>(seconds));
+        std::vector<std::thread> threads;
+        for (int i = 0; i < concurrency; i++) {
+            threads.emplace_back([&, i] {
+                target->Work(options.queries, i + 1, deadline, record, &(*results)[i]);
+            });
+        }
+        for (auto& thread : threads) thread.join();
+    };
+    std::vector<WorkerResult> warmup(concurrency);
+    if (options.warmup_s > 0) run(options.warmup_s, false, &warmup);
+
+    std::vector<WorkerResult> workers(concurrency);
+    int64_t rx_before = InterfaceRxBytes();
+    double cpu_before = CpuSeconds();
+    auto start = Clock::now();
+    run(options.duration_s, true, &workers);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double cpu_seconds = CpuSeconds() - cpu_before;
+    int64_t rx_after = InterfaceRxBytes();
+
+    LevelResult level;
+    level.mode = mode;
+    level.concurrency = concurrency;
+    level.seconds = seconds;
+    level.cpu_seconds = cpu_seconds;
+    level.interface_rx_bytes = rx_before < 0 || rx_after < 0 ? -1 : rx_after - rx_before;
+    level.bytes_received = mode == "native" ? 0 : -1;
+    std::vector<int64_t> latencies;
+    for (auto& worker : workers) {
+        latencies.insert(latencies.end(), worker.latencies_ns.begin(),
+                         worker.latencies_ns.end());
+        level.rows += worker.rows;
+        level.errors += worker.errors;
+        if (level.bytes_received >= 0) level.bytes_received += worker.bytes_received;
+        if (level.first_error.empty()) level.first_error = worker.first_error;
+    }
+    level.queries = static_cast<int64_t>(latencies.size());
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        // Nearest rank
+        auto percentile = [&](double p) {
+            size_t rank = static_cast<size_t>(p / 100.0 * latencies.size() + 0.999999);
+            rank = std::min(std::max<size_t>(rank, 1), latencies.size());
+            return latencies[rank - 1] / 1e6;
+        };
+        level.latency_ms[0] = percentile(50);
+        level.latency_ms[1] = percentile(95);
+        level.latency_ms[2] = percentile(99);
+        level.latency_ms[3] = percentile(99.9);
+        level.latency_ms[4] = latencies.back() / 1e6;
+        double sum = 0;
+        for (int64_t nanos : latencies) sum += nanos;
+        level.latency_ms[5] = sum / latencies.size() / 1e6;
+    }
+    return level;
+}
+
+std::string JsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+void WriteJson(std::ostream& out, const Options& options,
+               const std::vector<LevelResult>& levels) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"benchmark\": \"cube_connection_modes\",\n";
+    out << "  \"host\": " << JsonString(Env("CUBE_HOST", "localhost")) << ",\n";
+    out << "  \"duration_s\": " << options.duration_s << ",\n";
+    out << "  \"warmup_s\": " << options.warmup_s << ",\n";
+    out << "  \"queries\": [";
+    for (size_t i = 0; i < options.queries.size(); i++) {
+        out << (i ? ",\n" : "\n") << "    {\"weight\": " << options.queries[i].weight
+            << ", \"sql\": " << JsonString(options.queries[i].sql) << "}";
+    }
+    out << "\n  ],\n  \"results\": [";
+    for (size_t i = 0; i < levels.size(); i++) {
+        const LevelResult& level = levels[i];
+        double rows = static_cast<double>(level.rows);
+        out << (i ? ",\n" : "\n") << "    {\n";
+        out << "      \"mode\": " << JsonString(level.mode) << ",\n";
+        out << "      \"concurrency\": " << level.concurrency << ",\n";
+        out << "      \"seconds\": " << level.seconds << ",\n";
+        out << "      \"queries\": " << level.queries << ",\n";
+        out << "      \"errors\": " << level.errors << ",\n";
+        out << "      \"rows\": " << level.rows << ",\n";
+        out << "      \"queries_per_s\": " << level.queries / level.seconds << ",\n";
+        out << "      \"rows_per_s\": " << rows / level.seconds << ",\n";
+        out << "      \"latency_ms\": {\"p50\": " << level.latency_ms[0]
+            << ", \"p95\": " << level.latency_ms[1] << ", \"p99\": " << level.latency_ms[2]
+            << ", \"p99_9\": " << level.latency_ms[3] << ", \"max\": " << level.latency_ms[4]
+            << ", \"mean\": " << level.latency_ms[5] << "},\n";
+        out << "      \"bytes_received\": ";
+        if (level.bytes_received >= 0) out << level.bytes_received; else out << "null";
+        out << ",\n      \"interface_rx_bytes\": ";
+        if (level.interface_rx_bytes >= 0) out << level.interface_rx_bytes; else out << "null";
+        out << ",\n      \"bytes_per_row\": ";
+        int64_t bytes = level.bytes_received >= 0 ? level.bytes_received
+                                                  : level.interface_rx_bytes;
+        if (bytes >= 0 && level.rows > 0) out << bytes / rows; else out << "null";
+        out << ",\n      \"cpu_s\": " << level.cpu_seconds << ",\n";
+        out << "      \"cpu_ns_per_row\": ";
+        if (level.rows > 0) out << level.cpu_seconds * 1e9 / rows; else out << "null";
+        if (!level.first_error.empty()) {
+            out << ",\n      \"first_error\": " << JsonString(level.first_error);
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void Usage(const char* program) {
+    std::cout << "Usage: " << program
+              << " [--modes native,postgresql] [--concurrency 1,4,16]\n"
+                 "       [--duration SECONDS] [--warmup SECONDS] [--queries FILE]"
+                 " [--json FILE]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string queries_path;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            Usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--modes") {
+            options.modes = Split(value, ',');
+        } else if (arg == "--concurrency") {
+            options.concurrency.clear();
+            for (const auto& level : Split(value, ',')) {
+                options.concurrency.push_back(std::max(1, atoi(level.c_str())));
+            }
+        } else if (arg == "--duration") {
+            options.duration_s = atof(value.c_str());
+        } else if (arg == "--warmup") {
+            options.warmup_s = atof(value.c_str());
+        } else if (arg == "--queries") {
+            queries_path = value;
+        } else if (arg == "--json") {
+            options.json_path = value;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.duration_s <= 0 || options.concurrency.empty() || options.modes.empty()) {
+        Usage(argv[0]);
+        return 2;
+    }
+    for (const auto& mode : options.modes) {
+        if (mode != "native" && mode != "postgresql") {
+            // The driver speaks the native protocol and the PostgreSQL one;
+            // Cube's HTTP API is not one of its modes
+            std::cerr << "Unknown mode '" << mode << "' (native or postgresql)\n";
+            return 2;
+        }
+    }
+    if (!queries_path.empty()) {
+        if (!LoadQueries(queries_path, &options.queries)) {
+            std::cerr << "No queries read from " << queries_path << "\n";
+            return 2;
+        }
+    } else {
+        options.queries = {{"SELECT 1 AS test_value", 1},
+                           {"SELECT count FROM orders_with_preagg LIMIT 1", 1}};
+    }
+
+    AdbcError error = {};
+    AdbcDriver driver = {};
+    if (AdbcDriverInit(ADBC_VERSION_1_1_0, &driver, &error) != ADBC_STATUS_OK) {
+        std::cerr << "Driver init failed: " << TakeError(&error) << "\n";
+        return 1;
+    }
+
+    // With the JSON on stdout, the table goes to stderr
+    std::ostream& table = options.json_path == "-" ? std::cerr : std::cout;
+    table << std::left << std::setw(11) << "mode" << std::right << std::setw(5)
+              << "conc" << std::setw(10) << "q/s" << std::setw(12) << "rows/s"
+              << std::setw(9) << "p50 ms" << std::setw(9) << "p95 ms" << std::setw(9)
+              << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "B/row"
+              << std::setw(12) << "cpu ns/row" << std::setw(8) << "errors" << "\n";
+    std::vector<LevelResult> levels;
+    bool failed = false;
+    for (const auto& mode : options.modes) {
+        Target target(&driver, mode);
+        std::string message;
+        if (!target.Init(&message)) {
+            std::cerr << mode << ": " << message << "\n";
+            failed = true;
+            continue;
+        }
+        for (int concurrency : options.concurrency) {
+            LevelResult level = RunLevel(&target, mode, concurrency, options);
+            int64_t bytes = level.bytes_received >= 0 ? level.bytes_received
+                                                      : level.interface_rx_bytes;
+            double rows = level.rows > 0 ? static_cast<double>(level.rows) : 1;
+            table << std::fixed << std::setprecision(1) << std::left << std::setw(11)
+                      << mode << std::right << std::setw(5) << concurrency << std::setw(10)
+                      << level.queries / level.seconds << std::setw(12)
+                      << level.rows / level.seconds << std::setprecision(2) << std::setw(9)
+                      << level.latency_ms[0] << std::setw(9) << level.latency_ms[1]
+                      << std::setw(9) << level.latency_ms[2] << std::setw(10)
+                      << level.latency_ms[3] << std::setprecision(1) << std::setw(10)
+                      << (bytes >= 0 ? bytes / rows : 0.0) << std::setw(12)
+                      << level.cpu_seconds * 1e9 / rows << std::setw(8) << level.errors
+                      << "\n";
+            if (!level.first_error.empty()) {
+                std::cerr << "   first error: " << level.first_error << "\n";
+            }
+            levels.push_back(level);
+        }
+    }
+
+    if (!options.json_path.empty()) {
+        if (options.json_path == "-") {
+            WriteJson(std::cout, options, levels);
+        } else {
+            std::ofstream out(options.json_path);
+            WriteJson(out, options, levels);
+            if (!out) {
+                std::cerr << "Cannot write " << options.json_path << "\n";
+                return 1;
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -25,7 +25,7 @@ fi
 
 # Compiler settings
 CXX="${CXX:-g++}"
-CXXFLAGS="-g -std=c++17 -Wall"
+CXXFLAGS="-g -std=c++17 -Wall -pthread"
 LDFLAGS="-L$ADBC_LIB_DIR -ladbc_driver_cube -Wl,-rpath,$ADBC_LIB_DIR"
 
 # Check if ADBC library exists
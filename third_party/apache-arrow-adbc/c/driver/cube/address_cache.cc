@@ -0,0 +1,111 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/address_cache.h"
+
+#include <netdb.h>
+
+#include <cstring>
+#include <iterator>
+
+namespace adbc::cube {
+
+int ResolveAddresses(const std::string &host, int port,
+                     std::vector<CubeSocketAddress> *out) {
+  struct addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  // Only families the host has an address of; numeric ports skip a lookup
+  hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+  struct addrinfo *result = nullptr;
+  std::string service = std::to_string(port);
+  int code = getaddrinfo(host.c_str(), service.c_str(), &hints, &result);
+  if (code != 0) {
+    return code;
+  }
+
+  // RFC 8305 section 4: alternate families, starting with the preferred one
+  std::vector<CubeSocketAddress> first;
+  std::vector<CubeSocketAddress> second;
+  for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+    if (ai->ai_addrlen > sizeof(CubeSocketAddress::address)) {
+      continue;
+    }
+    CubeSocketAddress address;
+    std::memset(&address.address, 0, sizeof(address.address));
+    std::memcpy(&address.address, ai->ai_addr, ai->ai_addrlen);
+    address.length = static_cast<socklen_t>(ai->ai_addrlen);
+    address.family = ai->ai_family;
+    if (first.empty() || first[0].family == ai->ai_family) {
+      first.push_back(address);
+    } else {
+      second.push_back(address);
+    }
+  }
+  freeaddrinfo(result);
+
+  out->clear();
+  for (size_t i = 0; i < first.size() || i < second.size(); i++) {
+    if (i < first.size()) {
+      out->push_back(first[i]);
+    }
+    if (i < second.size()) {
+      out->push_back(second[i]);
+    }
+  }
+  return out->empty() ? EAI_NONAME : 0;
+}
+
+int CubeAddressCache::Resolve(const std::string &host, int port,
+                              std::vector<CubeSocketAddress> *out,
+                              bool *cached) {
+  std::string key = host + ":" + std::to_string(port);
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.expires > now) {
+      *out = it->second.addresses;
+      *cached = true;
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return 0;
+    }
+  }
+
+  // Resolved without the lock, so one slow lookup does not hold up
+  // connections to other hosts
+  *cached = false;
+  int code = ResolveAddresses(host, port, out);
+  if (code != 0) {
+    return code;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    it = it->second.expires <= now ? entries_.erase(it) : std::next(it);
+  }
+  entries_[key] = Entry{*out, now + ttl_};
+  return 0;
+}
+
+void CubeAddressCache::Invalidate(const std::string &host, int port) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.erase(host + ":" + std::to_string(port));
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,77 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace adbc::cube {
+
+/// One address a host resolved to, ready for connect()
+struct CubeSocketAddress {
+  struct sockaddr_storage address;
+  socklen_t length;
+  int family;
+};
+
+/// Resolve host and port to TCP addresses with getaddrinfo, IPv6 and IPv4
+/// alike. The addresses keep the resolver's preference order with the two
+/// families interleaved, the order Happy Eyeballs tries them in.
+/// @return 0, or a getaddrinfo EAI_* code (see gai_strerror)
+int ResolveAddresses(const std::string &host, int port,
+                     std::vector<CubeSocketAddress> *out);
+
+/// Addresses of recently resolved hosts, shared by the connections of a
+/// database so that opening one does not wait on DNS every time. Entries
+/// expire after ttl. Thread-safe.
+class CubeAddressCache {
+public:
+  explicit CubeAddressCache(std::chrono::milliseconds ttl) : ttl_(ttl) {}
+
+  /// Addresses of host:port, resolved if not cached or expired
+  /// @param cached Set to whether they came from the cache
+  /// @return 0, or a getaddrinfo EAI_* code
+  int Resolve(const std::string &host, int port,
+              std::vector<CubeSocketAddress> *out, bool *cached);
+
+  /// Forget host:port, after none of its addresses accepted a connection
+  void Invalidate(const std::string &host, int port);
+
+  /// Resolutions answered from the cache
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    std::vector<CubeSocketAddress> addresses;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  const std::chrono::milliseconds ttl_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_; // By "host:port"
+  std::atomic<int64_t> hits_{0};
+};
+
+} // namespace adbc::cube
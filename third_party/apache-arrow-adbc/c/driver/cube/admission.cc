@@ -0,0 +1,134 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/admission.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "driver/cube/metrics.h"
+
+namespace adbc::cube {
+
+CubeAdmissionControl::CubeAdmissionControl(CubeAdmissionOptions options)
+    : options_(options),
+      limit_(options.max_queries > 0 ? options.max_queries
+                                     : std::numeric_limits<size_t>::max()) {}
+
+bool CubeAdmissionControl::Acquire(int tier, int64_t priority,
+                                   std::shared_ptr<Permit> *permit,
+                                   std::string *message) {
+  auto start = std::chrono::steady_clock::now();
+  CubeMetrics &metrics = CubeMetrics::Global();
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto ticket = waiting_.insert(Ticket{tier, priority, next_ticket_++}).first;
+  auto admitted = [&] {
+    return running_ < limit_ && waiting_.begin() == ticket;
+  };
+  bool ok = true;
+  if (!admitted()) {
+    metrics.admission_waits.fetch_add(1, std::memory_order_relaxed);
+    if (options_.queue_timeout.count() > 0) {
+      ok = cv_.wait_for(lock, options_.queue_timeout, admitted);
+    } else {
+      cv_.wait(lock, admitted);
+    }
+  }
+  waiting_.erase(ticket);
+  if (ok) {
+    running_++;
+  } else {
+    *message = "No query slot became free within " +
+               std::to_string(options_.queue_timeout.count()) + " ms (" +
+               std::to_string(running_) + " running, " +
+               std::to_string(waiting_.size()) + " queued)";
+  }
+  bool notify = !waiting_.empty();
+  lock.unlock();
+  if (notify) {
+    // The next in line may fit too, or be first now
+    cv_.notify_all();
+  }
+  if (!ok) {
+    metrics.admission_timeouts.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  metrics.admission_wait_us.Record(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+  *permit = std::shared_ptr<Permit>(new Permit(shared_from_this()));
+  return true;
+}
+
+void CubeAdmissionControl::Leave() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  running_--;
+  bool notify = !waiting_.empty();
+  lock.unlock();
+  if (notify) {
+    cv_.notify_all();
+  }
+}
+
+void CubeAdmissionControl::Observe(
+    std::chrono::steady_clock::duration latency) {
+  if (options_.target_latency.count() == 0 || options_.max_queries == 0) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  size_t floor = std::clamp<size_t>(options_.min_queries, 1,
+                                    options_.max_queries);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (latency > options_.target_latency) {
+    answered_ = 0;
+    // Queries let in together answer late together; one decrease per
+    // target period keeps a burst of them from emptying the limit
+    if (now - last_decrease_ >= options_.target_latency) {
+      limit_ = std::max(floor, limit_ - std::max<size_t>(1, limit_ / 4));
+      last_decrease_ = now;
+    }
+    return;
+  }
+  if (++answered_ < limit_ || limit_ >= options_.max_queries) {
+    return;
+  }
+  answered_ = 0;
+  limit_++;
+  bool notify = !waiting_.empty();
+  lock.unlock();
+  if (notify) {
+    cv_.notify_all();
+  }
+}
+
+size_t CubeAdmissionControl::limit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return limit_;
+}
+
+size_t CubeAdmissionControl::running() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return running_;
+}
+
+size_t CubeAdmissionControl::queued() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return waiting_.size();
+}
+
+} // namespace adbc::cube
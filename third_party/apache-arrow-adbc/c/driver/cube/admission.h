@@ -0,0 +1,120 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace adbc::cube {
+
+struct CubeAdmissionOptions {
+  size_t max_queries = 0; // 0 = no limit
+  // How long a query waits for its turn; 0 = as long as it takes
+  std::chrono::milliseconds queue_timeout{0};
+  // With a target, the limit adapts between min_queries and max_queries:
+  // it shrinks by a quarter when a query takes longer than this to answer,
+  // and grows by one after as many queries as the limit answered in time.
+  // 0 = the limit stays at max_queries.
+  std::chrono::milliseconds target_latency{0};
+  size_t min_queries = 1;
+};
+
+/// Limits the queries a database's connections have running on the server
+/// at once. Queries over the limit wait in a queue, lowest tier first, then
+/// highest priority, and in arrival order among equals. Thread-safe.
+class CubeAdmissionControl
+    : public std::enable_shared_from_this<CubeAdmissionControl> {
+public:
+  /// A query's place among the running ones, given back when destroyed
+  class Permit {
+  public:
+    ~Permit() { control_->Leave(); }
+
+    Permit(const Permit &) = delete;
+    Permit &operator=(const Permit &) = delete;
+
+  private:
+    friend class CubeAdmissionControl;
+    explicit Permit(std::shared_ptr<CubeAdmissionControl> control)
+        : control_(std::move(control)) {}
+
+    const std::shared_ptr<CubeAdmissionControl> control_;
+  };
+
+  static std::shared_ptr<CubeAdmissionControl>
+  Make(CubeAdmissionOptions options) {
+    return std::shared_ptr<CubeAdmissionControl>(
+        new CubeAdmissionControl(options));
+  }
+
+  /// Wait until a query of this tier and priority may run. A tier goes
+  /// ahead of every higher one, whatever the priorities.
+  /// @return false, with message set, if queue_timeout passed first
+  bool Acquire(int tier, int64_t priority, std::shared_ptr<Permit> *permit,
+               std::string *message);
+
+  /// Feed the time a query took to answer to the adaptive limit
+  void Observe(std::chrono::steady_clock::duration latency);
+
+  /// Queries that may run at once now
+  size_t limit() const;
+  size_t running() const;
+  size_t queued() const;
+
+private:
+  explicit CubeAdmissionControl(CubeAdmissionOptions options);
+
+  void Leave();
+
+  // A waiter's tier, priority and arrival
+  struct Ticket {
+    int tier;
+    int64_t priority;
+    uint64_t arrival;
+  };
+  // The order waiters are let in: lowest tier, highest priority, then
+  // first to arrive
+  struct TicketOrder {
+    bool operator()(const Ticket &a, const Ticket &b) const {
+      if (a.tier != b.tier) {
+        return a.tier < b.tier;
+      }
+      return a.priority != b.priority ? a.priority > b.priority
+                                      : a.arrival < b.arrival;
+    }
+  };
+
+  const CubeAdmissionOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::set<Ticket, TicketOrder> waiting_;
+  uint64_t next_ticket_ = 0;
+  size_t running_ = 0;
+  size_t limit_;
+  size_t answered_ = 0; // In time since the limit last changed
+  std::chrono::steady_clock::time_point last_decrease_;
+};
+
+} // namespace adbc::cube
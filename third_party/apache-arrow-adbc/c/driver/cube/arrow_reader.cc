@@ -15,23 +15,19 @@
 // specific language governing permissions and limitations
 // under the License.
 
-// Set to 1 to enable debug logging
-#ifndef CUBE_DEBUG_LOGGING
-#define CUBE_DEBUG_LOGGING 0
-#endif
-
-#if CUBE_DEBUG_LOGGING
-#define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
-#else
-#define DEBUG_LOG(...) ((void)0)
-#endif
-
 #include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 #include <memory>
+#include <new>
 
 #include "driver/cube/arrow_reader.h"
+#include "driver/cube/buffer_kernels.h"
+#include "driver/cube/compression.h"
+#include "driver/cube/decode_scheduler.h"
+#include "driver/cube/log.h"
+#include "driver/cube/metrics.h"
 #include "format/generated/Message_generated.h"
 #include "format/generated/Schema_generated.h"
 #include <flatbuffers/flatbuffers.h>
@@ -57,83 +53,790 @@ inline int32_t ReadLE32Signed(const uint8_t *data) {
   return static_cast<int32_t>(ReadLE32(data));
 }
 
+inline int64_t ReadLE64Signed(const uint8_t *data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | data[i];
+  }
+  return static_cast<int64_t>(value);
+}
+
+// Compressed IPC buffers start with their uncompressed length; -1 means the
+// rest of the buffer was left uncompressed
+const int64_t IPC_COMPRESSION_PREFIX_SIZE = 8;
+const int64_t IPC_UNCOMPRESSED_BUFFER = -1;
+
+// Decompress on several threads once a batch holds this many bytes
+const int64_t PARALLEL_DECOMPRESS_MIN_BYTES = 4 << 20;
+const unsigned MAX_DECOMPRESS_THREADS = 8;
+
 // Helper to get bit from bitmap (Arrow validity bitmaps)
 inline bool GetBit(const uint8_t *bitmap, int64_t index) {
   return (bitmap[index / 8] & (1 << (index % 8))) != 0;
 }
 
+using SharedIpcBuffer = std::shared_ptr<const CubeIpcBytes>;
+
+// Deallocator for ArrowBuffers that point into a shared IPC buffer
+void ReleaseSharedIpcBuffer(struct ArrowBufferAllocator *allocator,
+                            uint8_t *ptr, int64_t size) {
+  delete static_cast<SharedIpcBuffer *>(allocator->private_data);
+}
+
+
+// Map an IPC Int type; a missing one is the spec's default for dictionary
+// indices (int32)
+int MapIntType(const org::apache::arrow::flatbuf::Int *int_type) {
+  if (!int_type) {
+    return NANOARROW_TYPE_INT32;
+  }
+  bool is_signed = int_type->is_signed();
+  switch (int_type->bitWidth()) {
+  case 8:
+    return is_signed ? NANOARROW_TYPE_INT8 : NANOARROW_TYPE_UINT8;
+  case 16:
+    return is_signed ? NANOARROW_TYPE_INT16 : NANOARROW_TYPE_UINT16;
+  case 32:
+    return is_signed ? NANOARROW_TYPE_INT32 : NANOARROW_TYPE_UINT32;
+  case 64:
+    return is_signed ? NANOARROW_TYPE_INT64 : NANOARROW_TYPE_UINT64;
+  default:
+    CUBE_LOG(Debug, "ArrowReader", "Unsupported int width",
+             {{"bits", int_type->bitWidth()}});
+    return NANOARROW_TYPE_UNINITIALIZED;
+  }
+}
+
+ArrowTimeUnit MapTimeUnit(org::apache::arrow::flatbuf::TimeUnit unit) {
+  switch (unit) {
+  case org::apache::arrow::flatbuf::TimeUnit_SECOND:
+    return NANOARROW_TIME_UNIT_SECOND;
+  case org::apache::arrow::flatbuf::TimeUnit_MILLISECOND:
+    return NANOARROW_TIME_UNIT_MILLI;
+  case org::apache::arrow::flatbuf::TimeUnit_MICROSECOND:
+    return NANOARROW_TIME_UNIT_MICRO;
+  default:
+    return NANOARROW_TIME_UNIT_NANO;
+  }
+}
+
+// Set a schema's type, taking type parameters (decimal precision, time
+// units and timezones) from the IPC field
+ArrowErrorCode SetSchemaType(struct ArrowSchema *schema, int arrow_type,
+                             const org::apache::arrow::flatbuf::Field *field) {
+  if (arrow_type == NANOARROW_TYPE_DECIMAL128 ||
+      arrow_type == NANOARROW_TYPE_DECIMAL256) {
+    auto decimal = field->type_as_Decimal();
+    return ArrowSchemaSetTypeDecimal(schema, static_cast<ArrowType>(arrow_type),
+                                     decimal->precision(), decimal->scale());
+  }
+  if (arrow_type == NANOARROW_TYPE_TIMESTAMP) {
+    auto timestamp = field->type_as_Timestamp();
+    const char *timezone = timestamp->timezone() && timestamp->timezone()->size()
+                               ? timestamp->timezone()->c_str()
+                               : NULL;
+    return ArrowSchemaSetTypeDateTime(schema, NANOARROW_TYPE_TIMESTAMP,
+                                      MapTimeUnit(timestamp->unit()), timezone);
+  } else if (arrow_type == NANOARROW_TYPE_TIME32 ||
+             arrow_type == NANOARROW_TYPE_TIME64) {
+    return ArrowSchemaSetTypeDateTime(schema, static_cast<ArrowType>(arrow_type),
+                                      MapTimeUnit(field->type_as_Time()->unit()),
+                                      NULL);
+  } else if (arrow_type == NANOARROW_TYPE_DURATION) {
+    return ArrowSchemaSetTypeDateTime(
+        schema, NANOARROW_TYPE_DURATION,
+        MapTimeUnit(field->type_as_Duration()->unit()), NULL);
+  } else if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_BINARY) {
+    return ArrowSchemaSetTypeFixedSize(
+        schema, NANOARROW_TYPE_FIXED_SIZE_BINARY,
+        field->type_as_FixedSizeBinary()->byteWidth());
+  }
+  // Regular types including DATE32, DATE64 and the intervals
+  return ArrowSchemaSetType(schema, static_cast<ArrowType>(arrow_type));
+}
+
+// Append every value of a flat array to an array being built
+ArrowErrorCode AppendArrayValues(const struct ArrowArray *src, int arrow_type,
+                                 struct ArrowArray *out, ArrowError *error) {
+  struct ArrowArrayView view;
+  ArrowArrayViewInitFromType(&view, static_cast<ArrowType>(arrow_type));
+  ArrowErrorCode status = ArrowArrayViewSetArray(&view, src, error);
+  for (int64_t i = 0; status == NANOARROW_OK && i < src->length; i++) {
+    if (ArrowArrayViewIsNull(&view, i)) {
+      status = ArrowArrayAppendNull(out, 1);
+      continue;
+    }
+    switch (arrow_type) {
+    case NANOARROW_TYPE_STRING:
+    case NANOARROW_TYPE_BINARY:
+    case NANOARROW_TYPE_LARGE_STRING:
+    case NANOARROW_TYPE_LARGE_BINARY:
+    case NANOARROW_TYPE_STRING_VIEW:
+    case NANOARROW_TYPE_BINARY_VIEW:
+      status = ArrowArrayAppendBytes(out, ArrowArrayViewGetBytesUnsafe(&view, i));
+      break;
+    case NANOARROW_TYPE_UINT8:
+    case NANOARROW_TYPE_UINT16:
+    case NANOARROW_TYPE_UINT32:
+    case NANOARROW_TYPE_UINT64:
+      status = ArrowArrayAppendUInt(out, ArrowArrayViewGetUIntUnsafe(&view, i));
+      break;
+    case NANOARROW_TYPE_HALF_FLOAT:
+    case NANOARROW_TYPE_FLOAT:
+    case NANOARROW_TYPE_DOUBLE:
+      status =
+          ArrowArrayAppendDouble(out, ArrowArrayViewGetDoubleUnsafe(&view, i));
+      break;
+    case NANOARROW_TYPE_DECIMAL128:
+    case NANOARROW_TYPE_DECIMAL256: {
+      struct ArrowDecimal value;
+      ArrowDecimalInit(&value, arrow_type == NANOARROW_TYPE_DECIMAL128 ? 128 : 256,
+                       0, 0);
+      ArrowArrayViewGetDecimalUnsafe(&view, i, &value);
+      status = ArrowArrayAppendDecimal(out, &value);
+      break;
+    }
+    case NANOARROW_TYPE_INTERVAL_MONTHS:
+    case NANOARROW_TYPE_INTERVAL_DAY_TIME:
+    case NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO: {
+      struct ArrowInterval value;
+      ArrowIntervalInit(&value, static_cast<ArrowType>(arrow_type));
+      ArrowArrayViewGetIntervalUnsafe(&view, i, &value);
+      status = ArrowArrayAppendInterval(out, &value);
+      break;
+    }
+    default:
+      status = ArrowArrayAppendInt(out, ArrowArrayViewGetIntUnsafe(&view, i));
+      break;
+    }
+  }
+  ArrowArrayViewReset(&view);
+  return status;
+}
+
+// Byte width of the values buffer, or 0 for bitmaps, variable width types
+// and fixed-size binary, whose width is a type parameter
+int64_t FixedValueWidth(int arrow_type) {
+  switch (arrow_type) {
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_UINT8:
+    return 1;
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_HALF_FLOAT:
+    return 2;
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DATE32:
+  case NANOARROW_TYPE_TIME32:
+  case NANOARROW_TYPE_INTERVAL_MONTHS:
+    return 4;
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_UINT64:
+  case NANOARROW_TYPE_DOUBLE:
+  case NANOARROW_TYPE_DATE64:
+  case NANOARROW_TYPE_TIME64:
+  case NANOARROW_TYPE_TIMESTAMP:
+  case NANOARROW_TYPE_DURATION:
+  case NANOARROW_TYPE_INTERVAL_DAY_TIME:
+    return 8;
+  case NANOARROW_TYPE_DECIMAL128:
+  case NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO:
+    return 16;
+  case NANOARROW_TYPE_DECIMAL256:
+    return 32;
+  default:
+    return 0;
+  }
+}
+
+// Decoder of a node without children (Nested for nested types)
+CubeNodeDecoder NodeDecoderForType(int arrow_type) {
+  switch (arrow_type) {
+  case NANOARROW_TYPE_BOOL:
+    return CubeNodeDecoder::Boolean;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_BINARY:
+    return CubeNodeDecoder::Binary;
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_LARGE_BINARY:
+    return CubeNodeDecoder::LargeBinary;
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY_VIEW:
+    return CubeNodeDecoder::View;
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    return CubeNodeDecoder::Fixed;
+  case NANOARROW_TYPE_STRUCT:
+  case NANOARROW_TYPE_LIST:
+  case NANOARROW_TYPE_LARGE_LIST:
+  case NANOARROW_TYPE_FIXED_SIZE_LIST:
+  case NANOARROW_TYPE_MAP:
+  case NANOARROW_TYPE_RUN_END_ENCODED:
+    return CubeNodeDecoder::Nested;
+  default:
+    return FixedValueWidth(arrow_type) > 0 ? CubeNodeDecoder::Fixed
+                                           : CubeNodeDecoder::Unsupported;
+  }
+}
+
+// Copy a validity bitmap into an array being built
+ArrowErrorCode CopyValidity(const uint8_t *validity, int64_t validity_size,
+                            int64_t length, struct ArrowArray *out,
+                            ArrowError *error) {
+  int64_t n_bytes = _ArrowBytesForBits(length);
+  if (validity_size < n_bytes) {
+    ArrowErrorSet(error, "Validity buffer of %lld bytes is too short for %lld "
+                         "values",
+                  static_cast<long long>(validity_size),
+                  static_cast<long long>(length));
+    return EINVAL;
+  }
+  struct ArrowBitmap *bitmap = ArrowArrayValidityBitmap(out);
+  NANOARROW_RETURN_NOT_OK(ArrowBitmapReserve(bitmap, length));
+  CopyBitmap(validity, 0, length, bitmap->buffer.data);
+  bitmap->buffer.size_bytes = n_bytes;
+  bitmap->size_bits = length;
+  return NANOARROW_OK;
+}
+
+// Copy the part of a data buffer an offsets buffer refers to, rebasing the
+// offsets to start at zero
+template <typename OffsetT>
+ArrowErrorCode CopyOffsetsAndData(const uint8_t *offsets, int64_t offsets_size,
+                                  const uint8_t *data, int64_t data_size,
+                                  int64_t length, struct ArrowArray *out,
+                                  ArrowError *error) {
+  if (length == 0) {
+    // Starting to append already wrote the single zero offset
+    return NANOARROW_OK;
+  }
+  int64_t offsets_bytes = (length + 1) * static_cast<int64_t>(sizeof(OffsetT));
+  if (offsets == nullptr || offsets_size < offsets_bytes) {
+    ArrowErrorSet(error, "Offsets buffer of %lld bytes is too short for %lld "
+                         "values",
+                  static_cast<long long>(offsets_size),
+                  static_cast<long long>(length));
+    return EINVAL;
+  }
+  OffsetT first;
+  OffsetT last;
+  memcpy(&first, offsets, sizeof(OffsetT));
+  memcpy(&last, offsets + length * sizeof(OffsetT), sizeof(OffsetT));
+  if (first < 0 || last < first || last > data_size) {
+    ArrowErrorSet(error, "Offsets [%lld, %lld] are outside the %lld byte data "
+                         "buffer",
+                  static_cast<long long>(first), static_cast<long long>(last),
+                  static_cast<long long>(data_size));
+    return EINVAL;
+  }
+
+  struct ArrowBuffer *offsets_out = ArrowArrayBuffer(out, 1);
+  offsets_out->size_bytes = 0;
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(offsets_out, offsets_bytes));
+  RebaseOffsets(reinterpret_cast<const OffsetT *>(offsets), length + 1, first,
+                reinterpret_cast<OffsetT *>(offsets_out->data));
+  offsets_out->size_bytes = offsets_bytes;
+  if (last > first) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowBufferAppend(ArrowArrayBuffer(out, 2), data + first, last - first));
+  }
+  return NANOARROW_OK;
+}
+
+// Conversion of a timestamp or date column to the unit and type options
+// ask for; output_type is unset when it needs none
+CubeValueConversion TemporalConversion(const CubeReaderOptions &options,
+                                       const struct ArrowSchemaView &view) {
+  CubeValueConversion conversion;
+  if (view.type == NANOARROW_TYPE_TIMESTAMP && options.timestamp_unit &&
+      *options.timestamp_unit != view.time_unit) {
+    // The units are declared in steps of 1000, seconds first
+    int steps = static_cast<int>(*options.timestamp_unit) -
+                static_cast<int>(view.time_unit);
+    int64_t factor = 1;
+    for (int i = 0; i < std::abs(steps); i++) {
+      factor *= 1000;
+    }
+    conversion.output_type = NANOARROW_TYPE_TIMESTAMP;
+    (steps > 0 ? conversion.multiplier : conversion.divisor) = factor;
+  } else if ((view.type == NANOARROW_TYPE_DATE32 ||
+              view.type == NANOARROW_TYPE_DATE64) &&
+             options.date_type && *options.date_type != view.type) {
+    conversion.output_type = *options.date_type;
+    (view.type == NANOARROW_TYPE_DATE32 ? conversion.multiplier
+                                        : conversion.divisor) = 86400000;
+  }
+  return conversion;
+}
+
+// Set the type of a column TemporalConversion converts, keeping its
+// timezone
+ArrowErrorCode SetConvertedType(struct ArrowSchema *schema,
+                                const struct ArrowSchemaView &view,
+                                const CubeValueConversion &conversion,
+                                const CubeReaderOptions &options) {
+  if (conversion.output_type != NANOARROW_TYPE_TIMESTAMP) {
+    return ArrowSchemaSetType(schema,
+                              static_cast<ArrowType>(conversion.output_type));
+  }
+  // The timezone points into the format being replaced
+  std::string timezone = view.timezone ? view.timezone : "";
+  return ArrowSchemaSetTypeDateTime(schema, NANOARROW_TYPE_TIMESTAMP,
+                                    *options.timestamp_unit,
+                                    timezone.empty() ? nullptr
+                                                     : timezone.c_str());
+}
+
+// Copy the values of a fixed-width node of input_type into out, which has
+// the conversion's output type. Values in null slots are converted too but
+// cannot fail.
+ArrowErrorCode ConvertValues(int input_type,
+                             const CubeValueConversion &conversion,
+                             const uint8_t *values, int64_t length,
+                             const uint8_t *validity, struct ArrowArray *out,
+                             ArrowError *error) {
+  struct ArrowBuffer *buffer = ArrowArrayBuffer(out, 1);
+  int64_t width = FixedValueWidth(conversion.output_type);
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(buffer, length * width));
+  auto valid = [&](int64_t i) {
+    return !validity || ArrowBitGet(validity, i);
+  };
+  int64_t bad = -1; // A valid value out of range for the output
+  if (input_type == NANOARROW_TYPE_DATE32) {
+    WidenScaleInt32(reinterpret_cast<const int32_t *>(values), length,
+                    conversion.multiplier,
+                    reinterpret_cast<int64_t *>(buffer->data));
+  } else if (conversion.multiplier > 1) {
+    auto src = reinterpret_cast<const int64_t *>(values);
+    if (!ScaleInt64(src, length, conversion.multiplier,
+                    reinterpret_cast<int64_t *>(buffer->data))) {
+      int64_t min = INT64_MIN / conversion.multiplier;
+      int64_t max = INT64_MAX / conversion.multiplier;
+      for (int64_t i = 0; i < length && bad < 0; i++) {
+        if ((src[i] < min || src[i] > max) && valid(i)) {
+          bad = i;
+        }
+      }
+    }
+  } else {
+    // Integer division has no vector form; a plain loop the compiler may
+    // still unroll
+    auto src = reinterpret_cast<const int64_t *>(values);
+    int64_t divisor = conversion.divisor;
+    bool narrow = conversion.output_type == NANOARROW_TYPE_DATE32;
+    for (int64_t i = 0; i < length; i++) {
+      int64_t quotient = src[i] / divisor;
+      if (src[i] % divisor < 0) {
+        quotient--;
+      }
+      if (narrow) {
+        if ((quotient < INT32_MIN || quotient > INT32_MAX) && bad < 0 &&
+            valid(i)) {
+          bad = i;
+        }
+        reinterpret_cast<int32_t *>(buffer->data)[i] =
+            static_cast<int32_t>(quotient);
+      } else {
+        reinterpret_cast<int64_t *>(buffer->data)[i] = quotient;
+      }
+    }
+  }
+  if (bad >= 0) {
+    int64_t value;
+    memcpy(&value, values + bad * sizeof(int64_t), sizeof(value));
+    ArrowErrorSet(error, "Value %lld of row %lld is out of range for the "
+                         "requested timestamp unit or date type",
+                  static_cast<long long>(value), static_cast<long long>(bad));
+    return EINVAL;
+  }
+  buffer->size_bytes = length * width;
+  return NANOARROW_OK;
+}
+
+using KeyValues = flatbuffers::Vector<
+    flatbuffers::Offset<org::apache::arrow::flatbuf::KeyValue>>;
+
+// Set the metadata of schema to the custom metadata of its IPC schema or
+// field, followed by the entries of extra with keys it does not have
+ArrowErrorCode
+SetCustomMetadata(const KeyValues *custom,
+                  const std::vector<std::pair<std::string, std::string>> &extra,
+                  struct ArrowSchema *schema) {
+  std::vector<std::pair<std::string_view, std::string_view>> entries;
+  if (custom) {
+    for (const auto *entry : *custom) {
+      if (!entry || !entry->key()) {
+        continue;
+      }
+      std::string_view value;
+      if (entry->value()) {
+        value = std::string_view(entry->value()->c_str(),
+                                 entry->value()->size());
+      }
+      entries.emplace_back(
+          std::string_view(entry->key()->c_str(), entry->key()->size()),
+          value);
+    }
+  }
+  size_t custom_entries = entries.size();
+  for (const auto &[key, value] : extra) {
+    auto end = entries.begin() + custom_entries;
+    if (std::find_if(entries.begin(), end, [&key = key](const auto &entry) {
+          return entry.first == key;
+        }) == end) {
+      entries.emplace_back(key, value);
+    }
+  }
+  if (entries.empty()) {
+    return NANOARROW_OK;
+  }
+  struct ArrowBuffer metadata;
+  ArrowErrorCode status = ArrowMetadataBuilderInit(&metadata, nullptr);
+  for (size_t i = 0; status == NANOARROW_OK && i < entries.size(); i++) {
+    const auto &[key, value] = entries[i];
+    status = ArrowMetadataBuilderAppend(
+        &metadata, {key.data(), static_cast<int64_t>(key.size())},
+        {value.data(), static_cast<int64_t>(value.size())});
+  }
+  if (status == NANOARROW_OK) {
+    status = ArrowSchemaSetMetadata(
+        schema, reinterpret_cast<const char *>(metadata.data));
+  }
+  ArrowBufferReset(&metadata);
+  return status;
+}
+
+// Schema metadata entries for what the query says about its result.
+// Entries naming a column that cannot be written in them are cut short.
+std::vector<std::pair<std::string, std::string>>
+OrderingMetadata(const CubeResultOrdering &ordering,
+                 const std::vector<std::string> &names) {
+  auto writable = [&](int64_t column) {
+    return column >= 0 && column < static_cast<int64_t>(names.size()) &&
+           !names[column].empty() &&
+           names[column].find_first_of(", \t\n") == std::string::npos;
+  };
+  std::vector<std::pair<std::string, std::string>> entries;
+  std::string sort_keys;
+  for (const auto &key : ordering.sort_keys) {
+    if (!writable(key.column)) {
+      break; // Rows are still sorted on the keys before it
+    }
+    if (!sort_keys.empty()) {
+      sort_keys += ", ";
+    }
+    sort_keys += names[key.column];
+    if (key.descending) {
+      sort_keys += " DESC";
+    }
+    if (key.nulls_first != key.descending) {
+      sort_keys += key.nulls_first ? " NULLS FIRST" : " NULLS LAST";
+    }
+  }
+  if (!sort_keys.empty()) {
+    entries.emplace_back("adbc.cube.sort_keys", std::move(sort_keys));
+  }
+  std::string unique_keys;
+  for (int64_t column : ordering.unique_keys) {
+    if (!writable(column)) {
+      unique_keys.clear(); // A subset of the keys is not unique
+      break;
+    }
+    if (!unique_keys.empty()) {
+      unique_keys += ',';
+    }
+    unique_keys += names[column];
+  }
+  if (!unique_keys.empty()) {
+    entries.emplace_back("adbc.cube.unique_keys", std::move(unique_keys));
+  }
+  return entries;
+}
+
+inline bool IsAligned(const uint8_t *ptr, int64_t alignment) {
+  return alignment <= 1 ||
+         reinterpret_cast<uintptr_t>(ptr) % static_cast<uintptr_t>(alignment) ==
+             0;
+}
+
+} // namespace
+
+ArrowErrorCode ApplyTemporalOptions(const CubeReaderOptions &options,
+                                    struct ArrowSchema *schema) {
+  if (!options.timestamp_unit && !options.date_type) {
+    return NANOARROW_OK;
+  }
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    NANOARROW_RETURN_NOT_OK(
+        ApplyTemporalOptions(options, schema->children[i]));
+  }
+  struct ArrowSchemaView view;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaViewInit(&view, schema, nullptr));
+  CubeValueConversion conversion = TemporalConversion(options, view);
+  if (conversion.output_type == NANOARROW_TYPE_UNINITIALIZED) {
+    return NANOARROW_OK;
+  }
+  return SetConvertedType(schema, view, conversion, options);
+}
+
+ArrowErrorCode ResolveColumns(const struct ArrowSchema *schema,
+                              const std::vector<std::string> &columns,
+                              std::vector<int> *fields, ArrowError *error) {
+  fields->clear();
+  std::vector<bool> selected(schema->n_children, columns.empty());
+  for (const auto &column : columns) {
+    int64_t i = 0;
+    for (; i < schema->n_children; i++) {
+      const char *name = schema->children[i]->name;
+      if (name && column == name) {
+        break;
+      }
+    }
+    if (i == schema->n_children) {
+      ArrowErrorSet(error, "Result has no column named '%s'", column.c_str());
+      return EINVAL;
+    }
+    selected[i] = true;
+  }
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    if (selected[i]) {
+      fields->push_back(static_cast<int>(i));
+    }
+  }
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode ProjectSchema(const struct ArrowSchema *schema,
+                             const std::vector<int> &fields,
+                             struct ArrowSchema *out) {
+  ArrowSchemaInit(out);
+  ArrowErrorCode status =
+      ArrowSchemaSetTypeStruct(out, static_cast<int64_t>(fields.size()));
+  if (status == NANOARROW_OK) {
+    status = ArrowSchemaSetMetadata(out, schema->metadata);
+  }
+  for (size_t i = 0; status == NANOARROW_OK && i < fields.size(); i++) {
+    ArrowSchemaRelease(out->children[i]);
+    status = ArrowSchemaDeepCopy(schema->children[fields[i]], out->children[i]);
+  }
+  if (status != NANOARROW_OK) {
+    ArrowSchemaRelease(out);
+  }
+  return status;
+}
+
+void WrapSharedIpcBuffer(const std::shared_ptr<const CubeIpcBytes> &owner,
+                         const uint8_t *data, int64_t size,
+                         struct ArrowBuffer *out) {
+  ArrowBufferInit(out);
+  out->data = const_cast<uint8_t *>(data);
+  out->size_bytes = size;
+  out->capacity_bytes = size;
+  ArrowBufferSetAllocator(
+      out, ArrowBufferDeallocator(ReleaseSharedIpcBuffer,
+                                  new SharedIpcBuffer(owner)));
+}
+
+struct SharedDictionary {
+  struct ArrowArray values;
+  int arrow_type;
+
+  ~SharedDictionary() {
+    if (values.release) {
+      ArrowArrayRelease(&values);
+    }
+  }
+};
+
+namespace {
+
+void ReleaseSharedDictionary(struct ArrowArray *array) {
+  delete static_cast<std::shared_ptr<SharedDictionary> *>(array->private_data);
+  array->release = nullptr;
+}
+
+// Export dictionary values without copying; the array keeps them alive
+void ExportSharedDictionary(const std::shared_ptr<SharedDictionary> &dict,
+                            struct ArrowArray *out) {
+  const struct ArrowArray &values = dict->values;
+  out->length = values.length;
+  out->null_count = values.null_count;
+  out->offset = values.offset;
+  out->n_buffers = values.n_buffers;
+  out->n_children = 0;
+  out->buffers = values.buffers;
+  out->children = nullptr;
+  out->dictionary = nullptr;
+  out->release = ReleaseSharedDictionary;
+  out->private_data = new std::shared_ptr<SharedDictionary>(dict);
+}
+
 } // namespace
 
-CubeArrowReader::CubeArrowReader(std::vector<uint8_t> arrow_ipc_data)
-    : buffer_(std::move(arrow_ipc_data)) {
-  ArrowSchemaInit(&schema_);
+std::optional<FlatBufferVerification>
+ParseFlatBufferVerification(std::string_view name) {
+  if (name == "full") {
+    return FlatBufferVerification::Full;
+  } else if (name == "bounds") {
+    return FlatBufferVerification::Bounds;
+  } else if (name == "none" || name == "trusted") {
+    return FlatBufferVerification::None;
+  }
+  return std::nullopt;
 }
 
-CubeArrowReader::~CubeArrowReader() {
-  if (schema_initialized_) {
-    ArrowSchemaRelease(&schema_);
+std::shared_ptr<const CubeSchemaPlan>
+CubeSchemaCache::Find(std::string_view message) {
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().schema_cache_lock);
+  auto it = entries_.find(message);
+  if (it == entries_.end()) {
+    return nullptr;
   }
+  keys_.splice(keys_.begin(), keys_, it->second.key);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return it->second.plan;
 }
 
-ArrowErrorCode CubeArrowReader::Init(ArrowError *error) {
-  DEBUG_LOG("[CubeArrowReader::Init] Starting with buffer size: %zu\n",
-            buffer_.size());
+void CubeSchemaCache::Insert(std::string_view message,
+                             std::shared_ptr<const CubeSchemaPlan> plan) {
+  if (capacity_ == 0) {
+    return;
+  }
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().schema_cache_lock);
+  if (entries_.count(message) > 0) {
+    // Another reader parsed the same schema meanwhile
+    return;
+  }
+  if (entries_.size() >= capacity_) {
+    entries_.erase(std::string_view(keys_.back()));
+    keys_.pop_back();
+  }
+  keys_.emplace_front(message);
+  entries_.emplace(std::string_view(keys_.front()),
+                   Entry{keys_.begin(), std::move(plan)});
+}
+
+CubeArrowReader::CubeArrowReader(CubeIpcBuffer arrow_ipc_data,
+                                 CubeReaderOptions options,
+                                 std::shared_ptr<const CubeSchemaPlan> schema)
+    : CubeArrowReader(
+          std::make_shared<const CubeIpcBytes>(std::move(arrow_ipc_data)),
+          std::move(options), std::move(schema)) {}
+
+CubeArrowReader::CubeArrowReader(
+    std::shared_ptr<const CubeIpcBytes> arrow_ipc_data,
+    CubeReaderOptions options, std::shared_ptr<const CubeSchemaPlan> schema)
+    : buffer_(std::move(arrow_ipc_data)), options_(std::move(options)),
+      plan_(std::move(schema)) {}
+
+CubeArrowReader::CubeArrowReader(const std::vector<uint8_t> &arrow_ipc_data,
+                                 CubeReaderOptions options,
+                                 std::shared_ptr<const CubeSchemaPlan> schema)
+    : CubeArrowReader(
+          CubeIpcBuffer(arrow_ipc_data.begin(), arrow_ipc_data.end()),
+          std::move(options), std::move(schema)) {}
+
+CubeArrowReader::~CubeArrowReader() = default;
 
-  if (buffer_.empty()) {
+ArrowErrorCode CubeArrowReader::Init(ArrowError *error) {
+  if (buffer_->empty()) {
     ArrowErrorSet(error, "Empty Arrow IPC buffer");
     return EINVAL;
   }
 
-  // Debug: Save raw Arrow IPC data to file
-  /* TODO enable based CUBE_DEBUG_LOGGING
-  FILE* debug_file = fopen("/tmp/cube_arrow_ipc_data.bin", "wb");
-  if (debug_file) {
-    fwrite(buffer_.data(), 1, buffer_.size(), debug_file);
-    fclose(debug_file);
-    DEBUG_LOG( "[CubeArrowReader::Init] Saved %zu bytes to
-  /tmp/cube_arrow_ipc_data.bin\n", buffer_.size());
-  }
-  */
-  // Debug: Print first 128 bytes as hex
-  DEBUG_LOG("[CubeArrowReader::Init] First 128 bytes (hex):\n");
-  for (size_t i = 0; i < std::min(buffer_.size(), size_t(128)); i++) {
-    if (i % 16 == 0)
-      DEBUG_LOG("  %04zx: ", i);
-    DEBUG_LOG("%02x ", buffer_[i]);
-    if ((i + 1) % 16 == 0)
-      DEBUG_LOG("\n");
-  }
-  if (buffer_.size() % 16 != 0)
-    DEBUG_LOG("\n");
+  if (plan_) {
+    // The schema was given; the first message is already a batch (a Schema
+    // message, if present anyway, is skipped by GetNext)
+    finished_ = false;
+    return SelectFields(error);
+  }
 
   // Parse Arrow IPC stream format
   // Format: [Continuation=0xFFFFFFFF][Size][Message][Padding]
-  DEBUG_LOG("[CubeArrowReader::Init] Parsing Arrow IPC stream format\n");
 
   // Message 0: Schema message
-  if (offset_ + 8 > static_cast<int64_t>(buffer_.size())) {
+  if (offset_ + 8 > static_cast<int64_t>(buffer_->size())) {
     ArrowErrorSet(error, "Buffer too small for schema message header");
     return EINVAL;
   }
 
-  uint32_t continuation = ReadLE32(buffer_.data() + offset_);
-  uint32_t msg_size = ReadLE32(buffer_.data() + offset_ + 4);
-  DEBUG_LOG(
-      "[CubeArrowReader::Init] Schema message: continuation=0x%x, size=%u\n",
-      continuation, msg_size);
+  uint32_t continuation = ReadLE32(buffer_->data() + offset_);
+  uint32_t msg_size = ReadLE32(buffer_->data() + offset_ + 4);
 
   if (continuation != ARROW_IPC_MAGIC) {
     ArrowErrorSet(error, "Invalid continuation marker for schema");
     return EINVAL;
   }
+  if (msg_size > buffer_->size() - offset_ - 8) {
+    ArrowErrorSet(error, "Schema message extends past buffer");
+    return EINVAL;
+  }
 
-  // Parse schema message using FlatBuffers
-  DEBUG_LOG("[CubeArrowReader::Init] Parsing FlatBuffer schema\n");
-  auto status =
-      ParseSchemaFlatBuffer(buffer_.data() + offset_ + 8, msg_size, error);
-  if (status != NANOARROW_OK) {
-    DEBUG_LOG("[CubeArrowReader::Init] FlatBuffer schema parsing failed\n");
-    return status;
+  // Identical message bytes were already verified and parsed by an earlier
+  // reader, so a cached plan is used as is
+  std::string_view schema_message(
+      reinterpret_cast<const char *>(buffer_->data() + offset_ + 8), msg_size);
+  // Plans converting or encoding columns are kept apart from the others
+  std::string converted_message;
+  if (options_.timestamp_unit || options_.date_type ||
+      options_.string_dictionaries) {
+    converted_message.assign(schema_message);
+    converted_message += '\0';
+    converted_message += static_cast<char>(
+        options_.timestamp_unit ? '0' + *options_.timestamp_unit : '-');
+    converted_message += static_cast<char>(
+        options_.date_type ? '0' + *options_.date_type : '-');
+    converted_message += options_.string_dictionaries ? 'd' : '-';
+    schema_message = converted_message;
+  }
+  if (!options_.result_ordering.empty()) {
+    if (converted_message.empty()) {
+      converted_message.assign(schema_message);
+    }
+    const CubeResultOrdering &ordering = options_.result_ordering;
+    converted_message += '\0';
+    for (const auto &key : ordering.sort_keys) {
+      converted_message += std::to_string(key.column);
+      converted_message += key.descending ? 'd' : 'a';
+      converted_message += key.nulls_first ? 'f' : 'l';
+    }
+    converted_message += '\0';
+    for (int64_t column : ordering.unique_keys) {
+      converted_message += std::to_string(column) + ',';
+    }
+    for (const auto &[column, grain] : ordering.time_grains) {
+      converted_message += '\0' + std::to_string(column) + '=' + grain;
+    }
+    schema_message = converted_message;
+  }
+  bool slot_hit = false;
+  if (options_.schema_slot) {
+    plan_ = options_.schema_slot->Find(schema_message);
+    slot_hit = plan_ != nullptr;
+    if (slot_hit && options_.schema_cache) {
+      options_.schema_cache->CountHit();
+    }
+  }
+  if (!plan_ && options_.schema_cache) {
+    plan_ = options_.schema_cache->Find(schema_message);
+  }
+  if (!plan_) {
+    auto plan = std::make_shared<CubeSchemaPlan>();
+    auto status = ParseSchemaFlatBuffer(buffer_->data() + offset_ + 8,
+                                        msg_size, plan.get(), error);
+    if (status != NANOARROW_OK) {
+      CUBE_LOG(Debug, "ArrowReader", "Cannot parse schema",
+               {{"error", error ? error->message : ""}});
+      return status;
+    }
+    plan_ = std::move(plan);
+    if (options_.schema_cache) {
+      options_.schema_cache->Insert(schema_message, plan_);
+    }
+  }
+  if (options_.schema_slot && !slot_hit) {
+    options_.schema_slot->Store(schema_message, plan_);
   }
 
   // Advance past schema message (align to 8 bytes)
@@ -143,104 +846,136 @@ ArrowErrorCode CubeArrowReader::Init(ArrowError *error) {
   }
 
   finished_ = false;
-  DEBUG_LOG("[CubeArrowReader::Init] Schema initialized, offset now at %lld\n",
-            (long long)offset_);
+  return SelectFields(error);
+}
+
+ArrowErrorCode CubeArrowReader::SelectFields(ArrowError *error) {
+  NANOARROW_RETURN_NOT_OK(
+      ResolveColumns(&plan_->schema, options_.columns, &fields_, error));
+  projected_ = fields_.size() != plan_->field_names.size();
   return NANOARROW_OK;
 }
 
 ArrowErrorCode CubeArrowReader::GetSchema(ArrowSchema *out) {
-  DEBUG_LOG("[CubeArrowReader::GetSchema] schema_initialized_=%d\n",
-            schema_initialized_);
-  if (!schema_initialized_) {
-    DEBUG_LOG("[CubeArrowReader::GetSchema] Schema not initialized!\n");
+  if (!plan_) {
     return EINVAL; // Schema not yet initialized
   }
-  auto result = ArrowSchemaDeepCopy(&schema_, out);
-  DEBUG_LOG("[CubeArrowReader::GetSchema] DeepCopy returned: %d\n", result);
+  auto result = projected_ ? ProjectSchema(&plan_->schema, fields_, out)
+                           : ArrowSchemaDeepCopy(&plan_->schema, out);
   return result;
 }
 
 ArrowErrorCode CubeArrowReader::GetNext(ArrowArray *out) {
-  DEBUG_LOG("[CubeArrowReader::GetNext] schema_initialized_=%d, finished_=%d, "
-            "offset_=%lld\n",
-            schema_initialized_, finished_, (long long)offset_);
-
-  if (!schema_initialized_) {
-    DEBUG_LOG("[CubeArrowReader::GetNext] Schema not initialized!\n");
+  if (!plan_) {
     return EINVAL;
   }
 
   if (finished_) {
-    DEBUG_LOG("[CubeArrowReader::GetNext] Already finished\n");
     return ENOMSG; // No more messages
   }
 
-  // Parse RecordBatch message
-  if (offset_ + 8 > static_cast<int64_t>(buffer_.size())) {
-    DEBUG_LOG("[CubeArrowReader::GetNext] End of buffer\n");
-    finished_ = true;
-    return ENOMSG;
-  }
+  const int64_t buffer_size = static_cast<int64_t>(buffer_->size());
 
-  uint32_t continuation = ReadLE32(buffer_.data() + offset_);
-  uint32_t msg_size = ReadLE32(buffer_.data() + offset_ + 4);
-  DEBUG_LOG("[CubeArrowReader::GetNext] RecordBatch message: "
-            "continuation=0x%x, size=%u\n",
-            continuation, msg_size);
+  // Walk messages until the next RecordBatch, skipping any the reader has no
+  // use for. Message::bodyLength tells where the next message starts.
+  while (true) {
+    if (offset_ + 4 > buffer_size) {
+      finished_ = true;
+      return ENOMSG;
+    }
 
-  if (continuation != ARROW_IPC_MAGIC) {
-    // Might be EOS marker (0xFFFFFFFF 0x00000000)
-    if (continuation == ARROW_IPC_MAGIC && msg_size == 0) {
-      DEBUG_LOG("[CubeArrowReader::GetNext] Found EOS marker\n");
+    uint32_t continuation = ReadLE32(buffer_->data() + offset_);
+    // Pre-1.0 EOS marker is a bare zero length
+    if (continuation == 0) {
       finished_ = true;
       return ENOMSG;
     }
-    DEBUG_LOG("[CubeArrowReader::GetNext] Invalid continuation marker: 0x%x\n",
-              continuation);
-    finished_ = true;
-    return ENOMSG;
-  }
+    if (continuation != ARROW_IPC_MAGIC || offset_ + 8 > buffer_size) {
+      CUBE_LOG(Debug, "ArrowReader", "Invalid continuation marker",
+               {{"offset", offset_}, {"marker", continuation}});
+      finished_ = true;
+      return EINVAL;
+    }
 
-  // Parse RecordBatch message using FlatBuffers
-  DEBUG_LOG("[CubeArrowReader::GetNext] Parsing RecordBatch FlatBuffer\n");
+    uint32_t msg_size = ReadLE32(buffer_->data() + offset_ + 4);
 
-  int64_t metadata_size = 8 + msg_size;
-  int64_t body_offset = offset_ + metadata_size;
-  if (body_offset % 8 != 0) {
-    body_offset += 8 - (body_offset % 8);
-  }
+    // EOS marker (0xFFFFFFFF 0x00000000), e.g. a schema-only stream
+    if (msg_size == 0) {
+      finished_ = true;
+      return ENOMSG;
+    }
 
-  const uint8_t *body_data = buffer_.data() + body_offset;
-  int64_t body_size = buffer_.size() - body_offset;
+    const uint8_t *fb_data = buffer_->data() + offset_ + 8;
+    int64_t body_offset = offset_ + 8 + msg_size;
+    if (body_offset % 8 != 0) {
+      body_offset += 8 - (body_offset % 8);
+    }
+    if (body_offset > buffer_size) {
+      CUBE_LOG(Debug, "ArrowReader", "Message metadata past the end",
+               {{"offset", offset_}});
+      finished_ = true;
+      return EINVAL;
+    }
 
-  auto status =
-      ParseRecordBatchFlatBuffer(buffer_.data() + offset_ + 8, msg_size,
-                                 body_data, body_size, out, nullptr);
+    if (!VerifyMessage(fb_data, msg_size)) {
+      CUBE_LOG(Debug, "ArrowReader", "Invalid message", {{"offset", offset_}});
+      finished_ = true;
+      return EINVAL;
+    }
+    auto message = ::org::apache::arrow::flatbuf::GetMessage(fb_data);
+    int64_t body_size = message->bodyLength();
+    if (body_size < 0 || body_size > buffer_size - body_offset) {
+      CUBE_LOG(Debug, "ArrowReader", "Message body past the end",
+               {{"offset", offset_}, {"body_bytes", body_size}});
+      finished_ = true;
+      return EINVAL;
+    }
 
-  if (status != NANOARROW_OK) {
-    DEBUG_LOG("[CubeArrowReader::GetNext] Batch parsing failed\n");
-    return status;
-  }
+    int64_t message_offset = offset_;
+    offset_ = body_offset + body_size;
 
-  finished_ = true;
-  DEBUG_LOG("[CubeArrowReader::GetNext] Successfully parsed RecordBatch\n");
-  return NANOARROW_OK;
+    if (message->header_type() ==
+        ::org::apache::arrow::flatbuf::MessageHeader_DictionaryBatch) {
+      auto status =
+          ParseDictionaryBatch(message->header_as_DictionaryBatch(),
+                               buffer_->data() + body_offset, body_size, nullptr);
+      if (status != NANOARROW_OK) {
+        CUBE_LOG(Debug, "ArrowReader", "Cannot parse dictionary",
+                 {{"offset", offset_}});
+        finished_ = true;
+        return status;
+      }
+      continue;
+    }
+    if (message->header_type() !=
+        ::org::apache::arrow::flatbuf::MessageHeader_RecordBatch) {
+      CUBE_LOG(Trace, "ArrowReader", "Skipping message",
+               {{"type", static_cast<int>(message->header_type())}});
+      continue;
+    }
+
+    auto status = ParseRecordBatchFlatBuffer(
+        buffer_->data() + message_offset + 8, msg_size,
+        buffer_->data() + body_offset, body_size, out, nullptr);
+    if (status != NANOARROW_OK) {
+      CUBE_LOG(Debug, "ArrowReader", "Cannot parse batch",
+               {{"offset", offset_}});
+      finished_ = true;
+      return status;
+    }
+
+    return NANOARROW_OK;
+  }
 }
 
 ArrowErrorCode CubeArrowReader::ParseMessage(ArrowError *error) {
-  DEBUG_LOG(
-      "[CubeArrowReader::ParseMessage] offset_=%lld, buffer_.size()=%zu\n",
-      (long long)offset_, buffer_.size());
-
-  if (offset_ >= static_cast<int64_t>(buffer_.size())) {
-    DEBUG_LOG(
-        "[CubeArrowReader::ParseMessage] Offset past end, setting finished\n");
+  if (offset_ >= static_cast<int64_t>(buffer_->size())) {
     finished_ = true;
     return ENOMSG;
   }
 
   // Read message header
-  if (offset_ + 8 > static_cast<int64_t>(buffer_.size())) {
+  if (offset_ + 8 > static_cast<int64_t>(buffer_->size())) {
     if (error) {
       ArrowErrorSet(error, "Incomplete message header");
     }
@@ -248,7 +983,7 @@ ArrowErrorCode CubeArrowReader::ParseMessage(ArrowError *error) {
     return ENOMSG;
   }
 
-  const uint8_t *header = buffer_.data() + offset_;
+  const uint8_t *header = buffer_->data() + offset_;
   int32_t message_length = ReadLE32Signed(header);
 
   // Message length should be positive
@@ -263,7 +998,7 @@ ArrowErrorCode CubeArrowReader::ParseMessage(ArrowError *error) {
   int32_t message_type = ReadLE32Signed(header + 4);
   const uint8_t *message_data = header + 8;
 
-  if (offset_ + 8 + message_length > static_cast<int64_t>(buffer_.size())) {
+  if (offset_ + 8 + message_length > static_cast<int64_t>(buffer_->size())) {
     if (error) {
       ArrowErrorSet(error, "Message extends past buffer end");
     }
@@ -292,9 +1027,7 @@ ArrowErrorCode CubeArrowReader::ParseMessage(ArrowError *error) {
 ArrowErrorCode CubeArrowReader::ParseSchemaMessage(const uint8_t *message_data,
                                                    int64_t message_length,
                                                    ArrowError *error) {
-  // Simplified: just mark schema as initialized
-  // In a full implementation, would parse FlatBuffer to get real schema
-  schema_initialized_ = true;
+  // Simplified: the schema is parsed by Init from the FlatBuffer instead
 
   // For now, return a minimal schema
   // This allows the driver to compile and function at basic level
@@ -311,32 +1044,149 @@ CubeArrowReader::ParseRecordBatchMessage(const uint8_t *message_data,
   return NANOARROW_OK;
 }
 
+bool CubeArrowReader::VerifyMessage(const uint8_t *fb_data, int64_t fb_size) {
+  if (options_.verification == FlatBufferVerification::None) {
+    return fb_size >= static_cast<int64_t>(sizeof(flatbuffers::uoffset_t));
+  }
+  auto start = std::chrono::steady_clock::now();
+  bool check_alignment = options_.verification == FlatBufferVerification::Full;
+  flatbuffers::Verifier verifier(fb_data, fb_size, /*max_depth=*/64,
+                                 /*max_tables=*/1000000, check_alignment);
+  bool ok = ::org::apache::arrow::flatbuf::VerifyMessageBuffer(verifier);
+  if (options_.verify_nanos || options_.stats) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    if (options_.verify_nanos) {
+      options_.verify_nanos->fetch_add(elapsed, std::memory_order_relaxed);
+    }
+    if (options_.stats) {
+      options_.stats->verify_nanos.fetch_add(elapsed,
+                                             std::memory_order_relaxed);
+    }
+  }
+  return ok;
+}
+
 // Static helper for bit access
 bool CubeArrowReader::GetBit(const uint8_t *bitmap, int64_t index) {
   return ::adbc::cube::GetBit(bitmap, index);
 }
 
 // Map FlatBuffer Type enum to nanoarrow type
-int CubeArrowReader::MapFlatBufferTypeToArrow(int fb_type) {
+int CubeArrowReader::MapFlatBufferTypeToArrow(
+    const org::apache::arrow::flatbuf::Field *field) {
+  int fb_type = field->type_type();
   switch (fb_type) {
-  case org::apache::arrow::flatbuf::Type_Int:
-    return NANOARROW_TYPE_INT64; // Assume INT64 for now
-  case org::apache::arrow::flatbuf::Type_FloatingPoint:
-    return NANOARROW_TYPE_DOUBLE;
+  case org::apache::arrow::flatbuf::Type_Int: {
+    auto int_type = field->type_as_Int();
+    return int_type ? MapIntType(int_type) : NANOARROW_TYPE_UNINITIALIZED;
+  }
+  case org::apache::arrow::flatbuf::Type_FloatingPoint: {
+    auto float_type = field->type_as_FloatingPoint();
+    if (!float_type) {
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+    switch (float_type->precision()) {
+    case org::apache::arrow::flatbuf::Precision_HALF:
+      return NANOARROW_TYPE_HALF_FLOAT;
+    case org::apache::arrow::flatbuf::Precision_SINGLE:
+      return NANOARROW_TYPE_FLOAT;
+    case org::apache::arrow::flatbuf::Precision_DOUBLE:
+      return NANOARROW_TYPE_DOUBLE;
+    default:
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+  }
   case org::apache::arrow::flatbuf::Type_Bool:
     return NANOARROW_TYPE_BOOL;
   case org::apache::arrow::flatbuf::Type_Utf8:
     return NANOARROW_TYPE_STRING;
   case org::apache::arrow::flatbuf::Type_Binary:
     return NANOARROW_TYPE_BINARY;
-  case org::apache::arrow::flatbuf::Type_Date:
-    return NANOARROW_TYPE_DATE32; // Default to DATE32
-  case org::apache::arrow::flatbuf::Type_Time:
-    return NANOARROW_TYPE_TIME64; // Default to TIME64
+  case org::apache::arrow::flatbuf::Type_LargeUtf8:
+    return NANOARROW_TYPE_LARGE_STRING;
+  case org::apache::arrow::flatbuf::Type_LargeBinary:
+    return NANOARROW_TYPE_LARGE_BINARY;
+  case org::apache::arrow::flatbuf::Type_Utf8View:
+    return NANOARROW_TYPE_STRING_VIEW;
+  case org::apache::arrow::flatbuf::Type_BinaryView:
+    return NANOARROW_TYPE_BINARY_VIEW;
+  case org::apache::arrow::flatbuf::Type_Date: {
+    auto date = field->type_as_Date();
+    return date && date->unit() == org::apache::arrow::flatbuf::DateUnit_DAY
+               ? NANOARROW_TYPE_DATE32
+               : NANOARROW_TYPE_DATE64;
+  }
+  case org::apache::arrow::flatbuf::Type_Time: {
+    // Seconds and milliseconds are 32-bit, micro- and nanoseconds 64-bit
+    auto time = field->type_as_Time();
+    if (!time) {
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+    return time->bitWidth() == 32 ? NANOARROW_TYPE_TIME32
+                                  : NANOARROW_TYPE_TIME64;
+  }
   case org::apache::arrow::flatbuf::Type_Timestamp:
-    return NANOARROW_TYPE_TIMESTAMP; // Default to TIMESTAMP
+    return field->type_as_Timestamp() ? NANOARROW_TYPE_TIMESTAMP
+                                      : NANOARROW_TYPE_UNINITIALIZED;
+  case org::apache::arrow::flatbuf::Type_Duration:
+    return field->type_as_Duration() ? NANOARROW_TYPE_DURATION
+                                     : NANOARROW_TYPE_UNINITIALIZED;
+  case org::apache::arrow::flatbuf::Type_Interval: {
+    auto interval = field->type_as_Interval();
+    if (!interval) {
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+    switch (interval->unit()) {
+    case org::apache::arrow::flatbuf::IntervalUnit_YEAR_MONTH:
+      return NANOARROW_TYPE_INTERVAL_MONTHS;
+    case org::apache::arrow::flatbuf::IntervalUnit_DAY_TIME:
+      return NANOARROW_TYPE_INTERVAL_DAY_TIME;
+    case org::apache::arrow::flatbuf::IntervalUnit_MONTH_DAY_NANO:
+      return NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO;
+    default:
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+  }
+  case org::apache::arrow::flatbuf::Type_FixedSizeBinary: {
+    // UUIDs among others; the width is kept per node by AddFieldNodes
+    auto fixed = field->type_as_FixedSizeBinary();
+    return fixed && fixed->byteWidth() > 0
+               ? NANOARROW_TYPE_FIXED_SIZE_BINARY
+               : NANOARROW_TYPE_UNINITIALIZED;
+  }
+  case org::apache::arrow::flatbuf::Type_List:
+    return NANOARROW_TYPE_LIST;
+  case org::apache::arrow::flatbuf::Type_LargeList:
+    return NANOARROW_TYPE_LARGE_LIST;
+  case org::apache::arrow::flatbuf::Type_FixedSizeList:
+    return field->type_as_FixedSizeList() ? NANOARROW_TYPE_FIXED_SIZE_LIST
+                                          : NANOARROW_TYPE_UNINITIALIZED;
+  case org::apache::arrow::flatbuf::Type_Struct_:
+    return NANOARROW_TYPE_STRUCT;
+  case org::apache::arrow::flatbuf::Type_Map:
+    return NANOARROW_TYPE_MAP;
+  case org::apache::arrow::flatbuf::Type_RunEndEncoded:
+    return NANOARROW_TYPE_RUN_END_ENCODED;
+  case org::apache::arrow::flatbuf::Type_Decimal: {
+    auto decimal = field->type_as_Decimal();
+    if (!decimal) {
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+    switch (decimal->bitWidth()) {
+    case 128:
+      return NANOARROW_TYPE_DECIMAL128;
+    case 256:
+      return NANOARROW_TYPE_DECIMAL256;
+    default:
+      CUBE_LOG(Debug, "ArrowReader", "Unsupported decimal width",
+               {{"bits", decimal->bitWidth()}});
+      return NANOARROW_TYPE_UNINITIALIZED;
+    }
+  }
   default:
-    DEBUG_LOG("[MapFlatBufferTypeToArrow] Unsupported type: %d\n", fb_type);
+    CUBE_LOG(Debug, "ArrowReader", "Unsupported type", {{"type", fb_type}});
     return NANOARROW_TYPE_UNINITIALIZED;
   }
 }
@@ -354,7 +1204,21 @@ int CubeArrowReader::GetBufferCountForType(int arrow_type) {
     return 2; // validity + data
   case NANOARROW_TYPE_STRING:
   case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_LARGE_BINARY:
     return 3; // validity + offsets + data
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY_VIEW:
+    return 2; // validity + views, then the node's variadic data buffers
+  case NANOARROW_TYPE_LIST:
+  case NANOARROW_TYPE_LARGE_LIST:
+  case NANOARROW_TYPE_MAP:
+    return 2; // validity + offsets; values are in the child nodes
+  case NANOARROW_TYPE_STRUCT:
+  case NANOARROW_TYPE_FIXED_SIZE_LIST:
+    return 1; // validity
+  case NANOARROW_TYPE_RUN_END_ENCODED:
+    return 0; // Run ends and values are child nodes
   default:
     return 2;
   }
@@ -372,6 +1236,13 @@ void CubeArrowReader::ExtractBuffer(
     return;
   }
 
+  if (!body_buffers_.empty()) {
+    const auto &span = body_buffers_[buffer_index];
+    *out_ptr = span.second > 0 ? body_data + span.first : nullptr;
+    *out_size = span.second;
+    return;
+  }
+
   auto buffer_meta = batch->buffers()->Get(buffer_index);
   if (!buffer_meta) {
     *out_ptr = nullptr;
@@ -382,18 +1253,18 @@ void CubeArrowReader::ExtractBuffer(
   int64_t offset = buffer_meta->offset();
   int64_t length = buffer_meta->length();
 
-  *out_ptr = body_data + offset;
+  // An empty validity buffer means "no nulls"; don't hand out a pointer
+  *out_ptr = length > 0 ? body_data + offset : nullptr;
   *out_size = length;
 }
 
 // Parse Schema FlatBuffer message
 ArrowErrorCode CubeArrowReader::ParseSchemaFlatBuffer(const uint8_t *fb_data,
                                                       int64_t fb_size,
+                                                      CubeSchemaPlan *plan,
                                                       ArrowError *error) {
 
-  // Verify FlatBuffer
-  flatbuffers::Verifier verifier(fb_data, fb_size);
-  if (!::org::apache::arrow::flatbuf::VerifyMessageBuffer(verifier)) {
+  if (!VerifyMessage(fb_data, fb_size)) {
     ArrowErrorSet(error, "Invalid Schema FlatBuffer");
     return EINVAL;
   }
@@ -411,76 +1282,283 @@ ArrowErrorCode CubeArrowReader::ParseSchemaFlatBuffer(const uint8_t *fb_data,
     return EINVAL;
   }
 
-  // Clear previous metadata
-  field_names_.clear();
-  field_types_.clear();
-  field_nullable_.clear();
-
   // Extract field metadata
+  std::vector<const ::org::apache::arrow::flatbuf::Field *> fields;
   for (unsigned int i = 0; i < schema->fields()->size(); i++) {
     auto field = schema->fields()->Get(i);
     if (!field)
       continue;
 
     std::string name = field->name() ? field->name()->str() : "";
-    field_names_.push_back(name);
-    field_nullable_.push_back(field->nullable());
-
-    int arrow_type = MapFlatBufferTypeToArrow(field->type_type());
-    field_types_.push_back(arrow_type);
-
-    DEBUG_LOG(
-        "[ParseSchemaFlatBuffer] Field %u: name='%s', type=%d, nullable=%d\n",
-        i, name.c_str(), arrow_type, field->nullable());
+    fields.push_back(field);
+    plan->field_names.push_back(name);
+    plan->field_nullable.push_back(field->nullable());
+
+    int arrow_type = MapFlatBufferTypeToArrow(field);
+    if (auto encoding = field->dictionary()) {
+      // Batches carry indices; the values arrive in DictionaryBatch messages
+      if (field->children() && field->children()->size() > 0) {
+        ArrowErrorSet(error, "Dictionary-encoded nested field '%s' is not "
+                             "supported", name.c_str());
+        return EINVAL;
+      }
+      if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_BINARY) {
+        // Dictionary batches are decoded without a node to take the width
+        // from
+        ArrowErrorSet(error, "Dictionary-encoded fixed-size binary field "
+                             "'%s' is not supported", name.c_str());
+        return EINVAL;
+      }
+      plan->dictionary_types[encoding->id()] = arrow_type;
+      plan->field_dictionary_ids.push_back(encoding->id());
+      arrow_type = MapIntType(encoding->indexType());
+    } else {
+      plan->field_dictionary_ids.push_back(-1);
+    }
+    plan->field_types.push_back(arrow_type);
   }
 
   // Build nanoarrow schema
-  ArrowSchemaInit(&schema_);
-  auto status = ArrowSchemaSetTypeStruct(&schema_, field_names_.size());
+  ArrowSchemaInit(&plan->schema);
+  auto status =
+      ArrowSchemaSetTypeStruct(&plan->schema, plan->field_names.size());
   if (status != NANOARROW_OK) {
     ArrowErrorSet(error, "Failed to create struct schema");
     return status;
   }
 
-  for (size_t i = 0; i < field_names_.size(); i++) {
-    struct ArrowSchema *child = schema_.children[i];
-    ArrowType arrow_type = static_cast<ArrowType>(field_types_[i]);
-
-    // Use ArrowSchemaSetTypeDateTime for temporal types that require time units
-    if (arrow_type == NANOARROW_TYPE_TIMESTAMP) {
-      // Default to microsecond precision with no timezone
-      status = ArrowSchemaSetTypeDateTime(child, NANOARROW_TYPE_TIMESTAMP,
-                                          NANOARROW_TIME_UNIT_MICRO, NULL);
-    } else if (arrow_type == NANOARROW_TYPE_TIME64) {
-      // TIME64 uses microsecond or nanosecond
-      status = ArrowSchemaSetTypeDateTime(child, NANOARROW_TYPE_TIME64,
-                                          NANOARROW_TIME_UNIT_MICRO, NULL);
-    } else {
-      // Regular types including DATE32, DATE64
-      status = ArrowSchemaSetType(child, arrow_type);
+  for (size_t i = 0; i < plan->field_names.size(); i++) {
+    struct ArrowSchema *child = plan->schema.children[i];
+    plan->field_nodes.push_back(static_cast<int>(plan->node_types.size()));
+    status = AddFieldNodes(fields[i], plan->field_types[i], child, plan, error);
+    if (status != NANOARROW_OK) {
+      ArrowSchemaRelease(&plan->schema);
+      return status;
+    }
+    if (plan->field_dictionary_ids[i] >= 0) {
+      status = ArrowSchemaAllocateDictionary(child);
+      if (status == NANOARROW_OK) {
+        ArrowSchemaInit(child->dictionary);
+        status = SetSchemaType(
+            child->dictionary,
+            plan->dictionary_types[plan->field_dictionary_ids[i]], fields[i]);
+      }
+    } else if (options_.string_dictionaries &&
+               (plan->field_types[i] == NANOARROW_TYPE_STRING ||
+                plan->field_types[i] == NANOARROW_TYPE_LARGE_STRING)) {
+      plan->field_interned.resize(plan->field_names.size());
+      plan->field_interned[i] = true;
+      status = EncodeStringSchema(child);
     }
 
     if (status != NANOARROW_OK) {
       ArrowErrorSet(error, "Failed to set child type");
-      ArrowSchemaRelease(&schema_);
+      ArrowSchemaRelease(&plan->schema);
       return status;
     }
 
-    status = ArrowSchemaSetName(child, field_names_[i].c_str());
+    status = ArrowSchemaSetName(child, plan->field_names[i].c_str());
     if (status != NANOARROW_OK) {
       ArrowErrorSet(error, "Failed to set child name");
-      ArrowSchemaRelease(&schema_);
+      ArrowSchemaRelease(&plan->schema);
+      return status;
+    }
+
+    std::vector<std::pair<std::string, std::string>> field_metadata;
+    for (const auto &[column, grain] : options_.result_ordering.time_grains) {
+      if (column == static_cast<int64_t>(i)) {
+        field_metadata.emplace_back("adbc.cube.time_grain", grain);
+      }
+    }
+    status =
+        SetCustomMetadata(fields[i]->custom_metadata(), field_metadata, child);
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to set metadata of field '%s'",
+                    plan->field_names[i].c_str());
+      ArrowSchemaRelease(&plan->schema);
       return status;
     }
 
-    if (!field_nullable_[i]) {
+    if (!plan->field_nullable[i]) {
       child->flags &= ~ARROW_FLAG_NULLABLE;
     }
   }
 
-  schema_initialized_ = true;
-  DEBUG_LOG("[ParseSchemaFlatBuffer] Schema parsed: %zu fields\n",
-            field_names_.size());
+  // The server's metadata, then what the query says about the rows
+  status = SetCustomMetadata(
+      schema->custom_metadata(),
+      OrderingMetadata(options_.result_ordering, plan->field_names),
+      &plan->schema);
+  if (status != NANOARROW_OK) {
+    ArrowErrorSet(error, "Failed to set schema metadata");
+    ArrowSchemaRelease(&plan->schema);
+    return status;
+  }
+
+  // Buffer layout of each column, so batches only add variadic buffers
+  for (size_t i = 0; i < plan->field_nodes.size(); i++) {
+    int buffers = 0;
+    for (int node = plan->field_nodes[i];
+         node < plan->node_ends[plan->field_nodes[i]]; node++) {
+      buffers += GetBufferCountForType(plan->node_types[node]);
+    }
+    plan->field_buffer_counts.push_back(buffers);
+  }
+  for (size_t node = 0; node < plan->node_types.size(); node++) {
+    int type = plan->node_types[node];
+    if (type == NANOARROW_TYPE_STRING_VIEW ||
+        type == NANOARROW_TYPE_BINARY_VIEW) {
+      plan->has_variadic_nodes = true;
+    }
+    bool has_children = plan->node_ends[node] != static_cast<int>(node) + 1;
+    plan->node_decoders.push_back(has_children || type == NANOARROW_TYPE_STRUCT
+                                      ? CubeNodeDecoder::Nested
+                                      : NodeDecoderForType(type));
+  }
+
+  CUBE_LOG(Debug, "ArrowReader", "Schema parsed",
+           {{"fields", plan->field_names.size()}});
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode CubeArrowReader::AddFieldNodes(
+    const org::apache::arrow::flatbuf::Field *field, int arrow_type,
+    ArrowSchema *schema, CubeSchemaPlan *plan, ArrowError *error) {
+  int node_index = static_cast<int>(plan->node_types.size());
+  plan->node_types.push_back(arrow_type);
+  plan->node_ends.push_back(node_index + 1);
+  plan->node_list_sizes.push_back(0);
+
+  const char *format = nullptr;
+  char fixed_size_format[32];
+  size_t expected_children = 0;
+  switch (arrow_type) {
+  case NANOARROW_TYPE_LIST:
+    format = "+l";
+    expected_children = 1;
+    break;
+  case NANOARROW_TYPE_LARGE_LIST:
+    format = "+L";
+    expected_children = 1;
+    break;
+  case NANOARROW_TYPE_FIXED_SIZE_LIST:
+    plan->node_list_sizes[node_index] =
+        field->type_as_FixedSizeList()->listSize();
+    snprintf(fixed_size_format, sizeof(fixed_size_format), "+w:%d",
+             plan->node_list_sizes[node_index]);
+    format = fixed_size_format;
+    expected_children = 1;
+    break;
+  case NANOARROW_TYPE_MAP:
+    format = "+m";
+    expected_children = 1;
+    break;
+  case NANOARROW_TYPE_STRUCT:
+    format = "+s";
+    expected_children = field->children() ? field->children()->size() : 0;
+    break;
+  case NANOARROW_TYPE_RUN_END_ENCODED:
+    format = "+r";
+    expected_children = 2; // Run ends, then values
+    break;
+  default: {
+    if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_BINARY) {
+      plan->node_list_sizes[node_index] =
+          field->type_as_FixedSizeBinary()->byteWidth();
+    }
+    auto status = SetSchemaType(schema, arrow_type, field);
+    struct ArrowSchemaView view;
+    if (status == NANOARROW_OK &&
+        (options_.timestamp_unit || options_.date_type)) {
+      status = ArrowSchemaViewInit(&view, schema, nullptr);
+    }
+    if (status == NANOARROW_OK &&
+        (options_.timestamp_unit || options_.date_type)) {
+      CubeValueConversion conversion = TemporalConversion(options_, view);
+      if (conversion.output_type != NANOARROW_TYPE_UNINITIALIZED) {
+        plan->node_conversions.resize(node_index + 1);
+        plan->node_conversions[node_index] = conversion;
+        status = SetConvertedType(schema, view, conversion, options_);
+      }
+    }
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to set child type");
+    }
+    return status;
+  }
+  }
+
+  auto children = field->children();
+  size_t n_children = children ? children->size() : 0;
+  if (n_children != expected_children) {
+    ArrowErrorSet(error, "Nested field expects %zu children, got %zu",
+                  expected_children, n_children);
+    return EINVAL;
+  }
+  auto status = ArrowSchemaSetFormat(schema, format);
+  if (status == NANOARROW_OK) {
+    status = ArrowSchemaAllocateChildren(schema, n_children);
+  }
+  if (status != NANOARROW_OK) {
+    ArrowErrorSet(error, "Failed to set nested type");
+    return status;
+  }
+  if (arrow_type == NANOARROW_TYPE_MAP &&
+      field->type_as_Map() && field->type_as_Map()->keysSorted()) {
+    schema->flags |= ARROW_FLAG_MAP_KEYS_SORTED;
+  }
+
+  for (size_t i = 0; i < n_children; i++) {
+    auto child = children->Get(i);
+    struct ArrowSchema *child_schema = schema->children[i];
+    ArrowSchemaInit(child_schema);
+    if (!child) {
+      ArrowErrorSet(error, "Missing child %zu of nested field", i);
+      return EINVAL;
+    }
+    if (child->dictionary()) {
+      ArrowErrorSet(error, "Dictionary-encoded nested field '%s' is not "
+                           "supported",
+                    child->name() ? child->name()->c_str() : "");
+      return EINVAL;
+    }
+    int child_type = MapFlatBufferTypeToArrow(child);
+    if (child_type == NANOARROW_TYPE_UNINITIALIZED) {
+      ArrowErrorSet(error, "Unsupported type in nested field '%s'",
+                    child->name() ? child->name()->c_str() : "");
+      return EINVAL;
+    }
+    status = AddFieldNodes(child, child_type, child_schema, plan, error);
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    status = ArrowSchemaSetName(child_schema,
+                                child->name() ? child->name()->c_str() : "");
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to set child name");
+      return status;
+    }
+    if (!child->nullable()) {
+      child_schema->flags &= ~ARROW_FLAG_NULLABLE;
+    }
+  }
+  if (arrow_type == NANOARROW_TYPE_MAP &&
+      (plan->node_types[node_index + 1] != NANOARROW_TYPE_STRUCT ||
+       schema->children[0]->n_children != 2)) {
+    ArrowErrorSet(error, "Map entries must be a struct of key and value");
+    return EINVAL;
+  }
+  if (arrow_type == NANOARROW_TYPE_RUN_END_ENCODED) {
+    int run_ends_type = plan->node_types[node_index + 1];
+    if (run_ends_type != NANOARROW_TYPE_INT16 &&
+        run_ends_type != NANOARROW_TYPE_INT32 &&
+        run_ends_type != NANOARROW_TYPE_INT64) {
+      ArrowErrorSet(error, "Run ends must be int16, int32 or int64");
+      return EINVAL;
+    }
+  }
+
+  plan->node_ends[node_index] = static_cast<int>(plan->node_types.size());
   return NANOARROW_OK;
 }
 
@@ -489,13 +1567,7 @@ ArrowErrorCode CubeArrowReader::ParseRecordBatchFlatBuffer(
     const uint8_t *fb_data, int64_t fb_size, const uint8_t *body_data,
     int64_t body_size, ArrowArray *out, ArrowError *error) {
 
-  // Verify FlatBuffer
-  flatbuffers::Verifier verifier(fb_data, fb_size);
-  if (!::org::apache::arrow::flatbuf::VerifyMessageBuffer(verifier)) {
-    ArrowErrorSet(error, "Invalid RecordBatch FlatBuffer");
-    return EINVAL;
-  }
-
+  // GetNext has already verified the message
   auto message = ::org::apache::arrow::flatbuf::GetMessage(fb_data);
   if (!message ||
       message->header_type() !=
@@ -511,17 +1583,46 @@ ArrowErrorCode CubeArrowReader::ParseRecordBatchFlatBuffer(
   }
 
   int64_t row_count = batch->length();
-  DEBUG_LOG("[ParseRecordBatchFlatBuffer] Batch has %lld rows, %zu columns\n",
-            (long long)row_count, field_names_.size());
+  CUBE_LOG(Trace, "ArrowReader", "Batch",
+           {{"rows", row_count}, {"columns", plan_->field_names.size()}});
+
+  auto status = ReadVariadicCounts(batch, plan_->node_types, error);
+  if (status != NANOARROW_OK) {
+    return status;
+  }
+  std::vector<int> first_buffer = FieldFirstBuffers();
+
+  body_owner_ = buffer_;
+  body_buffers_.clear();
+  if (batch->compression()) {
+    // Only the buffers of the columns decoded
+    std::vector<bool> needed;
+    if (projected_) {
+      needed.assign(static_cast<size_t>(first_buffer.back()), false);
+      for (int field : fields_) {
+        for (int i = first_buffer[field]; i < first_buffer[field + 1]; i++) {
+          needed[i] = true;
+        }
+      }
+    }
+    status = DecompressBody(batch, body_data, body_size, error,
+                            projected_ ? &needed : nullptr);
+    if (status != NANOARROW_OK) {
+      body_owner_.reset();
+      body_buffers_.clear();
+      return status;
+    }
+    body_data = body_owner_->data();
+  }
 
   // Create struct array
-  auto status = ArrowArrayInitFromType(out, NANOARROW_TYPE_STRUCT);
+  status = ArrowArrayInitFromType(out, NANOARROW_TYPE_STRUCT);
   if (status != NANOARROW_OK) {
     ArrowErrorSet(error, "Failed to init struct array");
     return status;
   }
 
-  status = ArrowArrayAllocateChildren(out, field_names_.size());
+  status = ArrowArrayAllocateChildren(out, fields_.size());
   if (status != NANOARROW_OK) {
     ArrowErrorSet(error, "Failed to allocate children");
     ArrowArrayRelease(out);
@@ -529,23 +1630,334 @@ ArrowErrorCode CubeArrowReader::ParseRecordBatchFlatBuffer(
   }
 
   // Build array for each field
-  int buffer_index = 0;
-  for (size_t i = 0; i < field_names_.size(); i++) {
-    struct ArrowArray *child = out->children[i];
-    status = BuildArrayForField(i, row_count, batch, body_data, &buffer_index,
-                                child, error);
+  if (options_.decode_threads > 1 && fields_.size() > 1) {
+    status = BuildFieldsInParallel(row_count, batch, body_data, first_buffer,
+                                   out, error);
+    if (status != NANOARROW_OK) {
+      ArrowArrayRelease(out);
+      return status;
+    }
+  } else {
+    for (size_t i = 0; i < fields_.size(); i++) {
+      // Buffers of the fields left out are stepped over
+      int buffer_index = first_buffer[fields_[i]];
+      status = BuildArrayForField(fields_[i], row_count, batch, body_data,
+                                  &buffer_index, out->children[i], error);
+      if (status != NANOARROW_OK) {
+        CUBE_LOG(Debug, "ArrowReader", "Cannot build field",
+                 {{"field", fields_[i]}});
+        ArrowArrayRelease(out);
+        return status;
+      }
+    }
+  }
+
+  // Point dictionary-encoded columns at their current dictionary
+  for (size_t i = 0; i < fields_.size(); i++) {
+    int64_t dictionary_id = plan_->field_dictionary_ids[fields_[i]];
+    if (dictionary_id < 0) {
+      continue;
+    }
+    auto it = dictionaries_.find(dictionary_id);
+    if (it == dictionaries_.end()) {
+      ArrowErrorSet(error, "No dictionary received for id %lld",
+                    static_cast<long long>(dictionary_id));
+      ArrowArrayRelease(out);
+      return EINVAL;
+    }
+    status = ArrowArrayAllocateDictionary(out->children[i]);
     if (status != NANOARROW_OK) {
-      DEBUG_LOG("[ParseRecordBatchFlatBuffer] Failed to build field %zu\n", i);
       ArrowArrayRelease(out);
       return status;
     }
+    ExportSharedDictionary(it->second, out->children[i]->dictionary);
   }
 
   // Set struct array length
   out->length = row_count;
   out->null_count = 0;
 
-  DEBUG_LOG("[ParseRecordBatchFlatBuffer] Successfully parsed batch\n");
+  // Shared buffers hold their own reference to the decompressed body
+  body_owner_.reset();
+  body_buffers_.clear();
+  node_variadic_counts_.clear();
+
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode CubeArrowReader::ParseDictionaryBatch(
+    const org::apache::arrow::flatbuf::DictionaryBatch *dict,
+    const uint8_t *body_data, int64_t body_size, ArrowError *error) {
+  auto batch = dict ? dict->data() : nullptr;
+  if (!batch) {
+    ArrowErrorSet(error, "Invalid DictionaryBatch structure");
+    return EINVAL;
+  }
+  auto type_it = plan_->dictionary_types.find(dict->id());
+  if (type_it == plan_->dictionary_types.end()) {
+    ArrowErrorSet(error, "DictionaryBatch for unknown id %lld",
+                  static_cast<long long>(dict->id()));
+    return EINVAL;
+  }
+  int arrow_type = type_it->second;
+
+  body_owner_ = buffer_;
+  body_buffers_.clear();
+  if (batch->compression()) {
+    auto status = DecompressBody(batch, body_data, body_size, error);
+    if (status != NANOARROW_OK) {
+      body_owner_.reset();
+      body_buffers_.clear();
+      return status;
+    }
+    body_data = body_owner_->data();
+  }
+
+  auto values = std::make_shared<SharedDictionary>();
+  values->values.release = nullptr;
+  values->arrow_type = arrow_type;
+  int buffer_index = 0;
+  auto status = ReadVariadicCounts(batch, {arrow_type}, error);
+  if (status == NANOARROW_OK) {
+    status = BuildArrayForType(arrow_type, NodeDecoderForType(arrow_type), 0,
+                               batch->length(), batch, body_data,
+                               &buffer_index, &values->values, error);
+  }
+  body_owner_.reset();
+  body_buffers_.clear();
+  node_variadic_counts_.clear();
+  if (status != NANOARROW_OK) {
+    return status;
+  }
+
+  auto existing = dictionaries_.find(dict->id());
+  if (dict->isDelta() && existing != dictionaries_.end()) {
+    // Batches already returned keep the old dictionary; later ones get the
+    // concatenation
+    auto merged = std::make_shared<SharedDictionary>();
+    merged->arrow_type = arrow_type;
+    status = ArrowArrayInitFromType(&merged->values,
+                                    static_cast<ArrowType>(arrow_type));
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayStartAppending(&merged->values);
+    }
+    if (status == NANOARROW_OK) {
+      status = AppendArrayValues(&existing->second->values, arrow_type,
+                                 &merged->values, error);
+    }
+    if (status == NANOARROW_OK) {
+      status = AppendArrayValues(&values->values, arrow_type, &merged->values,
+                                 error);
+    }
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayFinishBuildingDefault(&merged->values, error);
+    }
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to apply delta dictionary %lld",
+                    static_cast<long long>(dict->id()));
+      return status;
+    }
+    values = std::move(merged);
+  }
+  CUBE_LOG(Trace, "ArrowReader", "Dictionary",
+           {{"id", dict->id()},
+            {"values", values->values.length},
+            {"delta", dict->isDelta()}});
+  dictionaries_[dict->id()] = std::move(values);
+  return NANOARROW_OK;
+}
+
+std::vector<int> CubeArrowReader::FieldFirstBuffers() const {
+  const CubeSchemaPlan &plan = *plan_;
+  size_t n_fields = plan.field_names.size();
+  std::vector<int> first_buffer(n_fields + 1);
+  int buffer_index = 0;
+  for (size_t i = 0; i < n_fields; i++) {
+    first_buffer[i] = buffer_index;
+    buffer_index += plan.field_buffer_counts[i];
+    if (plan.has_variadic_nodes) {
+      for (int node = plan.field_nodes[i];
+           node < plan.node_ends[plan.field_nodes[i]]; node++) {
+        buffer_index += static_cast<int>(node_variadic_counts_[node]);
+      }
+    }
+  }
+  first_buffer[n_fields] = buffer_index;
+  return first_buffer;
+}
+
+ArrowErrorCode CubeArrowReader::BuildFieldsInParallel(
+    int64_t row_count, const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, const std::vector<int> &first_buffer,
+    ArrowArray *out, ArrowError *error) {
+  size_t n_fields = fields_.size();
+  std::vector<ArrowErrorCode> results(n_fields, NANOARROW_OK);
+  std::vector<ArrowError> errors(n_fields);
+  unsigned n_threads = CubeDecodeScheduler::Global().ParallelFor(
+      n_fields, static_cast<unsigned>(options_.decode_threads), [&](size_t i) {
+        int field_buffer = first_buffer[fields_[i]];
+        results[i] = BuildArrayForField(fields_[i], row_count, batch,
+                                        body_data, &field_buffer,
+                                        out->children[i], &errors[i]);
+      });
+  CUBE_LOG(Trace, "ArrowReader", "Building fields in parallel",
+           {{"fields", n_fields}, {"threads", n_threads}});
+
+  for (size_t i = 0; i < n_fields; i++) {
+    if (results[i] != NANOARROW_OK) {
+      CUBE_LOG(Debug, "ArrowReader", "Cannot build field", {{"field", i}});
+      ArrowErrorSet(error, "%s", errors[i].message);
+      return results[i];
+    }
+  }
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode CubeArrowReader::ReadVariadicCounts(
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const std::vector<int> &node_types, ArrowError *error) {
+  auto counts = batch->variadicBufferCounts();
+  node_variadic_counts_.assign(node_types.size(), 0);
+  flatbuffers::uoffset_t next = 0;
+  for (size_t i = 0; i < node_types.size(); i++) {
+    if (node_types[i] != NANOARROW_TYPE_STRING_VIEW &&
+        node_types[i] != NANOARROW_TYPE_BINARY_VIEW) {
+      continue;
+    }
+    if (!counts || next >= counts->size() || counts->Get(next) < 0) {
+      ArrowErrorSet(error, "Missing variadic buffer count for field %zu", i);
+      return EINVAL;
+    }
+    node_variadic_counts_[i] = counts->Get(next++);
+  }
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode CubeArrowReader::DecompressBody(
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, int64_t body_size, ArrowError *error,
+    const std::vector<bool> *needed) {
+  auto compression = batch->compression();
+  if (compression->method() !=
+      ::org::apache::arrow::flatbuf::BodyCompressionMethod_BUFFER) {
+    ArrowErrorSet(error, "Unsupported IPC body compression method: %d",
+                  static_cast<int>(compression->method()));
+    return ENOTSUP;
+  }
+
+  CompressionCodec codec;
+  switch (compression->codec()) {
+  case ::org::apache::arrow::flatbuf::CompressionType_LZ4_FRAME:
+    codec = CompressionCodec::Lz4Frame;
+    break;
+  case ::org::apache::arrow::flatbuf::CompressionType_ZSTD:
+    codec = CompressionCodec::Zstd;
+    break;
+  default:
+    ArrowErrorSet(error, "Unsupported IPC body compression codec: %d",
+                  static_cast<int>(compression->codec()));
+    return ENOTSUP;
+  }
+
+  // Lay out the decompressed body before touching any data
+  struct Task {
+    const uint8_t *src;
+    int64_t src_size;
+    int64_t offset;
+    int64_t length;
+    bool compressed;
+  };
+  std::vector<Task> tasks;
+  int64_t total_size = 0;
+  int n_buffers = batch->buffers() ? batch->buffers()->size() : 0;
+  tasks.reserve(n_buffers);
+  for (int i = 0; i < n_buffers; i++) {
+    auto buffer_meta = batch->buffers()->Get(i);
+    int64_t offset = buffer_meta->offset();
+    int64_t length = buffer_meta->length();
+    if (offset < 0 || length < 0 || offset > body_size ||
+        length > body_size - offset) {
+      ArrowErrorSet(error, "IPC buffer %d extends past the message body", i);
+      return EINVAL;
+    }
+
+    Task task{body_data + offset, 0, total_size, 0, false};
+    bool skipped = needed && (static_cast<size_t>(i) >= needed->size() ||
+                              !(*needed)[i]);
+    if (length > 0 && !skipped) {
+      if (length < IPC_COMPRESSION_PREFIX_SIZE) {
+        ArrowErrorSet(error, "Compressed IPC buffer %d is too short", i);
+        return EINVAL;
+      }
+      int64_t uncompressed = ReadLE64Signed(task.src);
+      task.src += IPC_COMPRESSION_PREFIX_SIZE;
+      task.src_size = length - IPC_COMPRESSION_PREFIX_SIZE;
+      if (uncompressed == IPC_UNCOMPRESSED_BUFFER) {
+        task.length = task.src_size;
+      } else if (uncompressed >= 0) {
+        task.length = uncompressed;
+        task.compressed = true;
+      } else {
+        ArrowErrorSet(error, "Invalid uncompressed length %lld for buffer %d",
+                      static_cast<long long>(uncompressed), i);
+        return EINVAL;
+      }
+    }
+    tasks.push_back(task);
+    // Keep each buffer as aligned as the body itself
+    total_size += (task.length + kIpcBufferAlignment - 1) &
+                  ~int64_t(kIpcBufferAlignment - 1);
+  }
+
+  CubeIpcBuffer body;
+  try {
+    body.resize(total_size);
+  } catch (const std::bad_alloc &) {
+    ArrowErrorSet(error, "Failed to allocate %lld bytes for IPC body",
+                  static_cast<long long>(total_size));
+    return ENOMEM;
+  }
+
+  // Each task writes its own slice of body; the first failure is reported
+  std::vector<ArrowErrorCode> results(tasks.size(), NANOARROW_OK);
+  std::vector<ArrowError> errors(tasks.size());
+  unsigned n_threads = 1;
+  if (total_size >= PARALLEL_DECOMPRESS_MIN_BYTES) {
+    n_threads = MAX_DECOMPRESS_THREADS;
+  }
+  n_threads = CubeDecodeScheduler::Global().ParallelFor(
+      tasks.size(), n_threads, [&](size_t i) {
+        const Task &task = tasks[i];
+        if (task.length == 0) {
+          return;
+        }
+        uint8_t *dst = body.data() + task.offset;
+        if (task.compressed) {
+          results[i] = Decompress(codec, task.src, task.src_size, dst,
+                                  task.length, &errors[i]);
+        } else {
+          std::memcpy(dst, task.src, task.length);
+        }
+      });
+
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (results[i] != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to decompress IPC buffer %zu: %s", i,
+                    errors[i].message);
+      return results[i];
+    }
+  }
+
+  body_buffers_.clear();
+  body_buffers_.reserve(tasks.size());
+  for (const auto &task : tasks) {
+    body_buffers_.emplace_back(task.offset, task.length);
+  }
+  body_owner_ = std::make_shared<const CubeIpcBytes>(std::move(body));
+  CUBE_LOG(Trace, "ArrowReader", "Decompressed body",
+           {{"buffers", tasks.size()},
+            {"bytes", total_size},
+            {"threads", n_threads}});
   return NANOARROW_OK;
 }
 
@@ -556,458 +1968,528 @@ ArrowErrorCode CubeArrowReader::BuildArrayForField(
     const uint8_t *body_data, int *buffer_index_inout, ArrowArray *out,
     ArrowError *error) {
 
-  if (field_index < 0 || field_index >= static_cast<int>(field_types_.size())) {
+  if (field_index < 0 ||
+      field_index >= static_cast<int>(plan_->field_types.size())) {
     ArrowErrorSet(error, "Invalid field index: %d", field_index);
     return EINVAL;
   }
 
-  int arrow_type = field_types_[field_index];
-  // int buffer_count = GetBufferCountForType(arrow_type);  // Unused for now
+  int node_index = plan_->field_nodes[field_index];
+  if (batch->nodes() &&
+      node_index < static_cast<int>(batch->nodes()->size()) &&
+      batch->nodes()->Get(node_index)->length() != row_count) {
+    ArrowErrorSet(error, "Field node %d has %lld rows, batch has %lld",
+                  node_index,
+                  static_cast<long long>(batch->nodes()->Get(node_index)->length()),
+                  static_cast<long long>(row_count));
+    return EINVAL;
+  }
+
+  if (field_index >= static_cast<int>(plan_->field_interned.size()) ||
+      !plan_->field_interned[field_index]) {
+    return BuildArrayForNode(node_index, row_count, batch, body_data,
+                             buffer_index_inout, out, error);
+  }
+  NANOARROW_RETURN_NOT_OK(BuildArrayForNode(node_index, row_count, batch,
+                                            body_data, buffer_index_inout,
+                                            out, error));
+  auto status = options_.string_dictionaries->Encode(
+      field_index, plan_->field_types[field_index], out, error);
+  if (status != NANOARROW_OK) {
+    ArrowArrayRelease(out);
+  }
+  return status;
+}
+
+ArrowErrorCode CubeArrowReader::BuildArrayForNode(
+    int node_index, int64_t length,
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, int *buffer_index_inout, ArrowArray *out,
+    ArrowError *error) {
+  int arrow_type = plan_->node_types[node_index];
+  CubeNodeDecoder decoder = plan_->node_decoders[node_index];
+  if (decoder != CubeNodeDecoder::Nested) {
+    return BuildArrayForType(arrow_type, decoder, node_index, length, batch,
+                             body_data, buffer_index_inout, out, error);
+  }
 
-  // Extract validity buffer
+  // Nested types: validity (none for run-end encoded columns), offsets for
+  // lists and maps, then the children
   const uint8_t *validity_buffer = nullptr;
   int64_t validity_size = 0;
-  ExtractBuffer(batch, *buffer_index_inout, body_data, &validity_buffer,
-                &validity_size);
-  (*buffer_index_inout)++;
+  if (arrow_type != NANOARROW_TYPE_RUN_END_ENCODED) {
+    ExtractBuffer(batch, *buffer_index_inout, body_data, &validity_buffer,
+                  &validity_size);
+    (*buffer_index_inout)++;
+  }
+
+  bool has_offsets = arrow_type == NANOARROW_TYPE_LIST ||
+                     arrow_type == NANOARROW_TYPE_LARGE_LIST ||
+                     arrow_type == NANOARROW_TYPE_MAP;
+  const uint8_t *offsets_buffer = nullptr;
+  int64_t offsets_size = 0;
+  if (has_offsets) {
+    ExtractBuffer(batch, *buffer_index_inout, body_data, &offsets_buffer,
+                  &offsets_size);
+    (*buffer_index_inout)++;
+  }
+
+  if (!batch->nodes() ||
+      plan_->node_ends[node_index] > static_cast<int>(batch->nodes()->size())) {
+    ArrowErrorSet(error, "Batch has too few field nodes for nested column");
+    return EINVAL;
+  }
+  int64_t null_count = batch->nodes()->Get(node_index)->null_count();
+  if (arrow_type == NANOARROW_TYPE_RUN_END_ENCODED) {
+    null_count = 0; // Nulls are values of the values child
+  }
+  if (null_count > 0 && validity_buffer == nullptr) {
+    ArrowErrorSet(error, "Nested column has nulls but no validity buffer");
+    return EINVAL;
+  }
 
-  // Initialize array for this type
   auto status = ArrowArrayInitFromType(out, static_cast<ArrowType>(arrow_type));
   if (status != NANOARROW_OK) {
     ArrowErrorSet(error, "Failed to init array for type %d", arrow_type);
     return status;
   }
 
-  status = ArrowArrayStartAppending(out);
+  int64_t n_children = 0;
+  for (int child = node_index + 1; child < plan_->node_ends[node_index];
+       child = plan_->node_ends[child]) {
+    n_children++;
+  }
+  status = ArrowArrayAllocateChildren(out, n_children);
   if (status != NANOARROW_OK) {
-    ArrowErrorSet(error, "Failed to start appending");
+    ArrowErrorSet(error, "Failed to allocate children");
     ArrowArrayRelease(out);
     return status;
   }
 
-  // Type-specific data extraction
-  switch (arrow_type) {
-  case NANOARROW_TYPE_INT8: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
-
-    const int8_t *values = reinterpret_cast<const int8_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  int64_t child_index = 0;
+  for (int child = node_index + 1; child < plan_->node_ends[node_index];
+       child = plan_->node_ends[child]) {
+    int64_t child_length = batch->nodes()->Get(child)->length();
+    status = BuildArrayForNode(child, child_length, batch, body_data,
+                               buffer_index_inout, out->children[child_index++],
+                               error);
+    if (status != NANOARROW_OK) {
+      ArrowArrayRelease(out);
+      return status;
     }
-    break;
   }
 
-  case NANOARROW_TYPE_INT16: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
-
-    const int16_t *values = reinterpret_cast<const int16_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
-    }
-    break;
+  if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_LIST &&
+      out->children[0]->length < length * plan_->node_list_sizes[node_index]) {
+    ArrowErrorSet(
+        error, "Fixed-size list child has %lld values, expected %lld",
+        static_cast<long long>(out->children[0]->length),
+        static_cast<long long>(length * plan_->node_list_sizes[node_index]));
+    ArrowArrayRelease(out);
+    return EINVAL;
   }
 
-  case NANOARROW_TYPE_INT32: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
-
-    const int32_t *values = reinterpret_cast<const int32_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  // Share the parent's own buffers with the body the same way as flat
+  // columns, copying them when that is turned off or they are misaligned
+  auto take_buffer = [&](const uint8_t *data, int64_t size, int64_t alignment,
+                         struct ArrowBuffer *buffer) {
+    if (options_.zero_copy && IsAligned(data, alignment)) {
+      WrapSharedIpcBuffer(body_owner_, data, size, buffer);
+      return NANOARROW_OK;
     }
-    break;
-  }
-
-  case NANOARROW_TYPE_INT64: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+    ArrowBufferInit(buffer);
+    if (options_.buffer_pool) {
+      options_.buffer_pool->Attach(buffer);
+    } else if (CubeAllocatorRegistered()) {
+      CubeAttachBlockAllocator(buffer);
+    }
+    return ArrowBufferAppend(buffer, data, size);
+  };
 
-    const int64_t *values = reinterpret_cast<const int64_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  if (validity_buffer != nullptr && null_count != 0) {
+    struct ArrowBitmap bitmap;
+    ArrowBitmapInit(&bitmap);
+    status = take_buffer(validity_buffer, validity_size, 1, &bitmap.buffer);
+    if (status != NANOARROW_OK) {
+      ArrowBitmapReset(&bitmap);
+      ArrowArrayRelease(out);
+      return status;
     }
-    break;
+    bitmap.size_bits = length;
+    ArrowArraySetValidityBitmap(out, &bitmap);
   }
 
-  case NANOARROW_TYPE_UINT8: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
-
-    const uint8_t *values = data_buffer;
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendUInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  if (offsets_buffer != nullptr) {
+    struct ArrowBuffer buffer;
+    int64_t alignment = arrow_type == NANOARROW_TYPE_LARGE_LIST ? 8 : 4;
+    status = take_buffer(offsets_buffer, offsets_size, alignment, &buffer);
+    if (status == NANOARROW_OK) {
+      status = ArrowArraySetBuffer(out, 1, &buffer);
+    }
+    if (status != NANOARROW_OK) {
+      ArrowBufferReset(&buffer);
+      ArrowErrorSet(error, "Failed to set offsets buffer");
+      ArrowArrayRelease(out);
+      return status;
     }
-    break;
   }
 
-  case NANOARROW_TYPE_UINT16: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+  out->length = length;
+  out->null_count = validity_buffer != nullptr ? null_count : 0;
 
-    const uint16_t *values = reinterpret_cast<const uint16_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendUInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
-    }
-    break;
+  // Checks the offsets against the children's lengths
+  status = ArrowArrayFinishBuildingDefault(out, error);
+  if (status != NANOARROW_OK) {
+    ArrowArrayRelease(out);
+    return status;
   }
 
-  case NANOARROW_TYPE_UINT32: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+  return NANOARROW_OK;
+}
 
-    const uint32_t *values = reinterpret_cast<const uint32_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendUInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
-    }
-    break;
-  }
+ArrowErrorCode CubeArrowReader::BuildArrayForType(
+    int arrow_type, CubeNodeDecoder decoder, int node_index, int64_t row_count,
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, int *buffer_index_inout, ArrowArray *out,
+    ArrowError *error) {
+  using FlatBuilder = ArrowErrorCode (CubeArrowReader::*)(
+      int, int, int64_t, const org::apache::arrow::flatbuf::RecordBatch *,
+      const uint8_t *, int *, ArrowArray *, ArrowError *);
+  // Indexed by CubeNodeDecoder; nested nodes are built by BuildArrayForNode
+  static constexpr FlatBuilder kBuilders[] = {
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::Unsupported>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::Unsupported>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::Fixed>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::Boolean>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::Binary>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::LargeBinary>,
+      &CubeArrowReader::BuildFlatArray<CubeNodeDecoder::View>,
+  };
+  return (this->*kBuilders[static_cast<int>(decoder)])(
+      arrow_type, node_index, row_count, batch, body_data, buffer_index_inout,
+      out, error);
+}
 
-  case NANOARROW_TYPE_UINT64: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+int64_t CubeArrowReader::NodeValueWidth(int arrow_type,
+                                        int node_index) const {
+  if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_BINARY) {
+    return plan_->node_list_sizes[node_index];
+  }
+  return FixedValueWidth(arrow_type);
+}
 
-    const uint64_t *values = reinterpret_cast<const uint64_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendUInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
-    }
-    break;
+ArrowErrorCode CubeArrowReader::InitFlatArray(ArrowArray *out, int arrow_type,
+                                              int node_index) const {
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayInitFromType(out, static_cast<ArrowType>(arrow_type)));
+  if (arrow_type == NANOARROW_TYPE_FIXED_SIZE_BINARY) {
+    // So that finishing the array checks the values buffer against it
+    auto private_data =
+        static_cast<struct ArrowArrayPrivateData *>(out->private_data);
+    private_data->layout.element_size_bits[1] =
+        NodeValueWidth(arrow_type, node_index) * 8;
   }
+  return NANOARROW_OK;
+}
 
-  case NANOARROW_TYPE_FLOAT: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
+template <CubeNodeDecoder kDecoder>
+ArrowErrorCode CubeArrowReader::BuildFlatArray(
+    int arrow_type, int node_index, int64_t row_count,
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, int *buffer_index_inout, ArrowArray *out,
+    ArrowError *error) {
+  if constexpr (kDecoder == CubeNodeDecoder::Unsupported ||
+                kDecoder == CubeNodeDecoder::Nested) {
+    ArrowErrorSet(error, "Unsupported Arrow type: %d", arrow_type);
+    return EINVAL;
+  } else {
+    // Extract validity buffer
+    const uint8_t *validity_buffer = nullptr;
+    int64_t validity_size = 0;
+    ExtractBuffer(batch, *buffer_index_inout, body_data, &validity_buffer,
+                  &validity_size);
     (*buffer_index_inout)++;
 
-    const float *values = reinterpret_cast<const float *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendDouble(out, static_cast<double>(values[i]));
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+    // A column the FieldNode says has no nulls needs no bitmap, whatever the
+    // server sent
+    if (batch->nodes() &&
+        node_index < static_cast<int>(batch->nodes()->size()) &&
+        batch->nodes()->Get(node_index)->null_count() == 0) {
+      validity_buffer = nullptr;
+      validity_size = 0;
     }
-    break;
-  }
 
-  case NANOARROW_TYPE_DOUBLE: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+    // Converted values are written to a buffer of their own
+    const CubeValueConversion *conversion = nullptr;
+    if (node_index < static_cast<int>(plan_->node_conversions.size()) &&
+        plan_->node_conversions[node_index].output_type !=
+            NANOARROW_TYPE_UNINITIALIZED) {
+      conversion = &plan_->node_conversions[node_index];
+    }
 
-    const double *values = reinterpret_cast<const double *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendDouble(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
+    if (options_.zero_copy && !conversion) {
+      auto status = ShareFlatArray<kDecoder>(
+          arrow_type, node_index, row_count, batch, body_data,
+          validity_buffer, validity_size, buffer_index_inout, out, error);
+      if (status != ENOTSUP) {
         return status;
       }
     }
-    break;
-  }
-
-  case NANOARROW_TYPE_BOOL: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
 
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        bool value = GetBit(data_buffer, i);
-        status = ArrowArrayAppendInt(out, value ? 1 : 0);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
+    auto status = InitFlatArray(
+        out, conversion ? conversion->output_type : arrow_type, node_index);
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to init array for type %d", arrow_type);
+      return status;
+    }
+    // Every buffer below is filled by copying, never replaced, so all three
+    // can come from the pool, or the registered allocator
+    if (options_.buffer_pool) {
+      for (int64_t i = 0; i < 3; i++) {
+        options_.buffer_pool->Attach(ArrowArrayBuffer(out, i));
       }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
+    } else if (CubeAllocatorRegistered()) {
+      for (int64_t i = 0; i < 3; i++) {
+        CubeAttachBlockAllocator(ArrowArrayBuffer(out, i));
       }
     }
-    break;
-  }
 
-  case NANOARROW_TYPE_STRING: {
-    const uint8_t *offsets_buffer = nullptr;
-    int64_t offsets_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &offsets_buffer,
-                  &offsets_size);
-    (*buffer_index_inout)++;
+    status = ArrowArrayStartAppending(out);
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to start appending");
+      ArrowArrayRelease(out);
+      return status;
+    }
 
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+    if constexpr (kDecoder == CubeNodeDecoder::View) {
+      status = AppendViews(node_index, row_count, batch, body_data,
+                           validity_buffer, buffer_index_inout, out, error);
+    } else {
+      // Fixed-width, boolean and offset-based columns are copied buffer by
+      // buffer
+      constexpr bool kOffsets = kDecoder == CubeNodeDecoder::Binary ||
+                                kDecoder == CubeNodeDecoder::LargeBinary;
+      const uint8_t *buffers[2] = {nullptr, nullptr};
+      int64_t sizes[2] = {0, 0};
+      for (int i = 0; i < (kOffsets ? 2 : 1); i++) {
+        ExtractBuffer(batch, *buffer_index_inout, body_data, &buffers[i],
+                      &sizes[i]);
+        (*buffer_index_inout)++;
+      }
 
-    const int32_t *offsets = reinterpret_cast<const int32_t *>(offsets_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        int32_t start = offsets[i];
-        int32_t end = offsets[i + 1];
-        int32_t length = end - start;
-        struct ArrowStringView view;
-        view.data = reinterpret_cast<const char *>(data_buffer + start);
-        view.size_bytes = length;
-        status = ArrowArrayAppendString(out, view);
+      if constexpr (kDecoder == CubeNodeDecoder::LargeBinary) {
+        status = CopyOffsetsAndData<int64_t>(buffers[0], sizes[0], buffers[1],
+                                             sizes[1], row_count, out, error);
+      } else if constexpr (kDecoder == CubeNodeDecoder::Binary) {
+        status = CopyOffsetsAndData<int32_t>(buffers[0], sizes[0], buffers[1],
+                                             sizes[1], row_count, out, error);
       } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
+        // Null slots are copied along with the rest
+        int64_t needed = kDecoder == CubeNodeDecoder::Fixed
+                             ? row_count * NodeValueWidth(arrow_type,
+                                                          node_index)
+                             : _ArrowBytesForBits(row_count);
+        if (needed > 0 && (buffers[0] == nullptr || sizes[0] < needed)) {
+          ArrowErrorSet(error,
+                        "Buffer of %lld bytes is too short for %lld values",
+                        static_cast<long long>(sizes[0]),
+                        static_cast<long long>(row_count));
+          status = EINVAL;
+        } else if (needed > 0 && conversion) {
+          // A bitmap too short for the rows fails in CopyValidity below
+          const uint8_t *validity =
+              validity_size >= _ArrowBytesForBits(row_count) ? validity_buffer
+                                                             : nullptr;
+          status = ConvertValues(arrow_type, *conversion, buffers[0],
+                                 row_count, validity, out, error);
+        } else if (needed > 0) {
+          status =
+              ArrowBufferAppend(ArrowArrayBuffer(out, 1), buffers[0], needed);
+        }
       }
-    }
-    break;
-  }
-
-  case NANOARROW_TYPE_DATE32: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
 
-    const int32_t *values = reinterpret_cast<const int32_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
+      int64_t null_count = 0;
+      if (status == NANOARROW_OK && validity_buffer != nullptr) {
+        status = CopyValidity(validity_buffer, validity_size, row_count, out,
+                              error);
+        null_count = -1;
+        if (batch->nodes() &&
+            node_index < static_cast<int>(batch->nodes()->size())) {
+          null_count = batch->nodes()->Get(node_index)->null_count();
+        }
+        if (status == NANOARROW_OK && null_count < 0) {
+          null_count =
+              row_count - ArrowBitCountSet(validity_buffer, 0, row_count);
+        }
       }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
+      if (status == NANOARROW_OK) {
+        out->length = row_count;
+        out->null_count = null_count;
       }
     }
-    break;
-  }
-
-  case NANOARROW_TYPE_DATE64: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
 
-    const int64_t *values = reinterpret_cast<const int64_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayFinishBuildingDefault(out, error);
     }
-    break;
+    if (status != NANOARROW_OK) {
+      ArrowArrayRelease(out);
+      return status;
+    }
+    return NANOARROW_OK;
   }
+}
 
-  case NANOARROW_TYPE_TIME64: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
+ArrowErrorCode CubeArrowReader::AppendViews(
+    int node_index, int64_t row_count,
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, const uint8_t *validity_buffer,
+    int *buffer_index_inout, ArrowArray *out, ArrowError *error) {
+  const uint8_t *views_buffer = nullptr;
+  int64_t views_size = 0;
+  ExtractBuffer(batch, *buffer_index_inout, body_data, &views_buffer,
+                &views_size);
+  (*buffer_index_inout)++;
+
+  int64_t n_variadic = node_variadic_counts_[node_index];
+  std::vector<const uint8_t *> variadic(n_variadic);
+  std::vector<int64_t> variadic_sizes(n_variadic);
+  for (int64_t j = 0; j < n_variadic; j++) {
+    ExtractBuffer(batch, *buffer_index_inout, body_data, &variadic[j],
+                  &variadic_sizes[j]);
     (*buffer_index_inout)++;
+  }
 
-    const int64_t *values = reinterpret_cast<const int64_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  for (int64_t i = 0; i < row_count; i++) {
+    bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
+    if (!is_valid) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(out, 1));
+      continue;
     }
-    break;
+    union ArrowBinaryView value;
+    memcpy(&value, views_buffer + i * sizeof(value), sizeof(value));
+    struct ArrowBufferView view;
+    view.size_bytes = value.inlined.size;
+    if (value.inlined.size <= NANOARROW_BINARY_VIEW_INLINE_SIZE) {
+      view.data.as_uint8 = views_buffer + i * sizeof(value) + sizeof(int32_t);
+    } else if (value.ref.buffer_index < 0 ||
+               value.ref.buffer_index >= n_variadic || value.ref.offset < 0 ||
+               value.ref.offset + static_cast<int64_t>(value.ref.size) >
+                   variadic_sizes[value.ref.buffer_index]) {
+      ArrowErrorSet(error, "View %lld points outside its data buffers",
+                    static_cast<long long>(i));
+      return EINVAL;
+    } else {
+      view.data.as_uint8 = variadic[value.ref.buffer_index] + value.ref.offset;
+    }
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendBytes(out, view));
   }
+  return NANOARROW_OK;
+}
 
-  case NANOARROW_TYPE_TIMESTAMP: {
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+template <CubeNodeDecoder kDecoder>
+ArrowErrorCode CubeArrowReader::ShareFlatArray(
+    int arrow_type, int node_index, int64_t row_count,
+    const org::apache::arrow::flatbuf::RecordBatch *batch,
+    const uint8_t *body_data, const uint8_t *validity_buffer,
+    int64_t validity_size, int *buffer_index_inout, ArrowArray *out,
+    ArrowError *error) {
+  constexpr bool kView = kDecoder == CubeNodeDecoder::View;
+
+  // Buffers after validity: values, offsets + data, or views + the variadic
+  // data buffers
+  int n_buffers = 1;
+  int64_t alignment = 1;
+  if constexpr (kDecoder == CubeNodeDecoder::Fixed) {
+    // Fixed-size binary is bytes, whatever its width
+    alignment = std::max<int64_t>(
+        std::min<int64_t>(FixedValueWidth(arrow_type), 8), 1);
+  } else if constexpr (kDecoder == CubeNodeDecoder::Binary) {
+    n_buffers = 2;
+    alignment = 4;
+  } else if constexpr (kDecoder == CubeNodeDecoder::LargeBinary) {
+    n_buffers = 2;
+    alignment = 8;
+  } else if constexpr (kView) {
+    n_buffers = 1 + static_cast<int>(node_variadic_counts_[node_index]);
+    alignment = 8;
+  }
+  std::vector<const uint8_t *> buffers(n_buffers);
+  std::vector<int64_t> sizes(n_buffers);
+  for (int i = 0; i < n_buffers; i++) {
+    ExtractBuffer(batch, *buffer_index_inout + i, body_data, &buffers[i],
+                  &sizes[i]);
+    // Empty buffers would make nanoarrow allocate through our deallocator
+    if (buffers[i] == nullptr) {
+      return ENOTSUP;
+    }
+  }
+  // Decimals and views only need 8-byte alignment, like the IPC body itself
+  if (!IsAligned(buffers[0], alignment)) {
+    return ENOTSUP;
+  }
 
-    const int64_t *values = reinterpret_cast<const int64_t *>(data_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        status = ArrowArrayAppendInt(out, values[i]);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  int64_t null_count = -1;
+  if (batch->nodes() &&
+      node_index < static_cast<int>(batch->nodes()->size())) {
+    null_count = batch->nodes()->Get(node_index)->null_count();
+  }
+  if (null_count != 0 && validity_buffer == nullptr) {
+    if (null_count > 0) {
+      return ENOTSUP;
     }
-    break;
+    null_count = 0;
   }
 
-  case NANOARROW_TYPE_BINARY: {
-    const uint8_t *offsets_buffer = nullptr;
-    int64_t offsets_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &offsets_buffer,
-                  &offsets_size);
-    (*buffer_index_inout)++;
+  auto status = InitFlatArray(out, arrow_type, node_index);
+  if (status != NANOARROW_OK) {
+    ArrowErrorSet(error, "Failed to init array for type %d", arrow_type);
+    return status;
+  }
 
-    const uint8_t *data_buffer = nullptr;
-    int64_t data_size = 0;
-    ExtractBuffer(batch, *buffer_index_inout, body_data, &data_buffer,
-                  &data_size);
-    (*buffer_index_inout)++;
+  if (validity_buffer != nullptr && null_count != 0) {
+    struct ArrowBitmap bitmap;
+    ArrowBitmapInit(&bitmap);
+    WrapSharedIpcBuffer(body_owner_, validity_buffer, validity_size,
+                        &bitmap.buffer);
+    bitmap.size_bits = row_count;
+    ArrowArraySetValidityBitmap(out, &bitmap);
+  }
 
-    const int32_t *offsets = reinterpret_cast<const int32_t *>(offsets_buffer);
-    for (int64_t i = 0; i < row_count; i++) {
-      bool is_valid = !validity_buffer || GetBit(validity_buffer, i);
-      if (is_valid) {
-        int32_t start = offsets[i];
-        int32_t end = offsets[i + 1];
-        int32_t length = end - start;
-        struct ArrowBufferView view;
-        view.data.as_uint8 = data_buffer + start;
-        view.size_bytes = length;
-        status = ArrowArrayAppendBytes(out, view);
-      } else {
-        status = ArrowArrayAppendNull(out, 1);
-      }
-      if (status != NANOARROW_OK) {
-        ArrowArrayRelease(out);
-        return status;
-      }
+  if (kView && n_buffers > 1) {
+    status = ArrowArrayAddVariadicBuffers(out, n_buffers - 1);
+    if (status != NANOARROW_OK) {
+      ArrowErrorSet(error, "Failed to allocate variadic buffers");
+      ArrowArrayRelease(out);
+      return status;
     }
-    break;
   }
 
-  default:
-    ArrowErrorSet(error, "Unsupported Arrow type: %d", arrow_type);
-    ArrowArrayRelease(out);
-    return EINVAL;
+  for (int i = 0; i < n_buffers; i++) {
+    struct ArrowBuffer buffer;
+    WrapSharedIpcBuffer(body_owner_, buffers[i], sizes[i], &buffer);
+    if (kView && i > 0) {
+      // Variadic buffers have no ArrowArraySetBuffer slot; their sizes are
+      // exported after them when the array is finished
+      auto private_data =
+          static_cast<struct ArrowArrayPrivateData *>(out->private_data);
+      ArrowBufferMove(&buffer, &private_data->variadic_buffers[i - 1]);
+      private_data->variadic_buffer_sizes[i - 1] = sizes[i];
+      continue;
+    }
+    status = ArrowArraySetBuffer(out, i + 1, &buffer);
+    if (status != NANOARROW_OK) {
+      ArrowBufferReset(&buffer);
+      ArrowErrorSet(error, "Failed to set buffer %d", i + 1);
+      ArrowArrayRelease(out);
+      return status;
+    }
   }
 
+  out->length = row_count;
+  out->null_count = null_count;
+  *buffer_index_inout += n_buffers;
+
+  // Checks buffer sizes (and first/last offsets) against the length
   status = ArrowArrayFinishBuildingDefault(out, error);
   if (status != NANOARROW_OK) {
     ArrowArrayRelease(out);
@@ -1020,30 +2502,19 @@ ArrowErrorCode CubeArrowReader::BuildArrayForField(
 // Arrow stream callbacks
 static int CubeArrowStreamGetSchema(struct ArrowArrayStream *stream,
                                     struct ArrowSchema *out) {
-  DEBUG_LOG("[CubeArrowStreamGetSchema] Called\n");
   auto *reader = static_cast<CubeArrowReader *>(stream->private_data);
-  DEBUG_LOG("[CubeArrowStreamGetSchema] Reader pointer: %p\n",
-            static_cast<void *>(reader));
-  auto status = reader->GetSchema(out);
-  DEBUG_LOG("[CubeArrowStreamGetSchema] Returning status: %d\n", status);
-  return status;
+  return reader->GetSchema(out);
 }
 
 static int CubeArrowStreamGetNext(struct ArrowArrayStream *stream,
                                   struct ArrowArray *out) {
-  DEBUG_LOG("[CubeArrowStreamGetNext] Called\n");
   auto *reader = static_cast<CubeArrowReader *>(stream->private_data);
-  DEBUG_LOG("[CubeArrowStreamGetNext] Reader pointer: %p\n",
-            static_cast<void *>(reader));
   auto status = reader->GetNext(out);
-  DEBUG_LOG("[CubeArrowStreamGetNext] Status: %d\n", status);
   if (status == ENOMSG) {
     // End of stream - return success with null array
     out->release = nullptr;
-    DEBUG_LOG("[CubeArrowStreamGetNext] End of stream\n");
     return NANOARROW_OK;
   }
-  DEBUG_LOG("[CubeArrowStreamGetNext] Returning status: %d\n", status);
   return status;
 }
 
@@ -17,44 +17,408 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <arrow-adbc/adbc.h>
 #include <nanoarrow/nanoarrow.h>
 
+#include "driver/cube/buffer_pool.h"
+#include "driver/cube/ipc_buffer.h"
+#include "driver/cube/memory_tracker.h"
+#include "driver/cube/native_protocol.h"
+#include "driver/cube/rechunk_stream.h"
+#include "driver/cube/string_dictionary.h"
+
 // Forward declaration for FlatBuffer types (in global namespace)
 namespace org {
 namespace apache {
 namespace arrow {
 namespace flatbuf {
+struct DictionaryBatch;
+struct Field;
+struct Int;
 struct RecordBatch;
-}
+} // namespace flatbuf
 } // namespace arrow
 } // namespace apache
 } // namespace org
 
 namespace adbc::cube {
 
+// Dictionary values shared by the batches that reference them
+struct SharedDictionary;
+
+// How much of each IPC message FlatBuffer is checked before it is read
+enum class FlatBufferVerification {
+  // Check every offset, vector and string for bounds and alignment
+  Full,
+  // Check bounds but not alignment
+  Bounds,
+  // Check nothing beyond message framing; only for trusted servers
+  None,
+};
+
+// Parse an option value ("full", "bounds", "none" or "trusted")
+std::optional<FlatBufferVerification>
+ParseFlatBufferVerification(std::string_view name);
+
+// How the reader builds the array of a field node. Resolved once per
+// schema, so a batch hands each node to the decoder built for its layout
+// instead of classifying the type again. A new layout takes one value here
+// and one branch of CubeArrowReader::BuildFlatArray.
+enum class CubeNodeDecoder : uint8_t {
+  Unsupported,
+  Nested,      // Structs, lists and maps: own buffers, then the children
+  Fixed,       // Fixed-width values
+  Boolean,     // Bit-packed values
+  Binary,      // 32-bit offsets and data
+  LargeBinary, // 64-bit offsets and data
+  View,        // String and binary views with variadic data buffers
+};
+
+// How the values of a fixed-width field node are converted while they are
+// copied, for CubeReaderOptions::timestamp_unit and date_type
+struct CubeValueConversion {
+  int output_type = NANOARROW_TYPE_UNINITIALIZED; // Unset: not converted
+  int64_t multiplier = 1; // Values are multiplied by this,
+  int64_t divisor = 1;    // or divided by this
+};
+
+// Everything the reader derives from a Schema message: the nanoarrow
+// schema, the column types and the field node layout batches follow.
+// Immutable once built, so readers of streams with the same schema share
+// one instead of parsing the schema again.
+struct CubeSchemaPlan {
+  CubeSchemaPlan() { schema.release = nullptr; }
+  ~CubeSchemaPlan() {
+    if (schema.release) {
+      schema.release(&schema);
+    }
+  }
+  CubeSchemaPlan(const CubeSchemaPlan &) = delete;
+  CubeSchemaPlan &operator=(const CubeSchemaPlan &) = delete;
+
+  struct ArrowSchema schema;
+
+  std::vector<std::string> field_names;
+  std::vector<int> field_types; // Index type for dictionary-encoded fields
+  std::vector<bool> field_nullable;
+  std::vector<int64_t> field_dictionary_ids; // -1 if not dictionary-encoded
+  // Whether the reader dictionary encodes the strings of a column sent
+  // plain (CubeReaderOptions::string_dictionaries); empty when none is
+  std::vector<bool> field_interned;
+  // Buffers the nodes of each column take, not counting variadic buffers
+  std::vector<int> field_buffer_counts;
+
+  // Field nodes in the order batches list them: each column followed by
+  // its children, depth first. node_ends is the index just past a node's
+  // last descendant, so a node's children start at node_index + 1.
+  std::vector<int> node_types;
+  std::vector<int> node_ends;
+  // List size of FixedSizeList nodes, byte width of FixedSizeBinary ones
+  std::vector<int32_t> node_list_sizes;
+  std::vector<CubeNodeDecoder> node_decoders;
+  // Conversion of each node's values, from CubeReaderOptions; empty, or
+  // shorter than the nodes, when the nodes past its end have none
+  std::vector<CubeValueConversion> node_conversions;
+  std::vector<int> field_nodes;         // Node of each top-level field
+  // Whether any node is a string or binary view, whose buffer count
+  // depends on the batch
+  bool has_variadic_nodes = false;
+
+  // Value type of each dictionary id declared by the schema
+  std::map<int64_t, int> dictionary_types;
+};
+
+// Schema plans of recently seen Schema messages, keyed by the message
+// bytes. Shared by the readers of a connection, so batches of a result and
+// repeated queries returning the same columns parse their schema once.
+// Thread-safe.
+class CubeSchemaCache {
+public:
+  explicit CubeSchemaCache(size_t capacity) : capacity_(capacity) {}
+
+  // Plan previously stored for exactly these Schema message bytes
+  std::shared_ptr<const CubeSchemaPlan> Find(std::string_view message);
+
+  // Store a plan, evicting the least recently used one when full
+  void Insert(std::string_view message,
+              std::shared_ptr<const CubeSchemaPlan> plan);
+
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  // Count a plan found without a lookup, in the CubeSchemaSlot of a
+  // statement sharing this cache
+  void CountHit() { hits_.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    std::list<std::string>::iterator key;
+    std::shared_ptr<const CubeSchemaPlan> plan;
+  };
+
+  std::mutex mutex_;
+  size_t capacity_;
+  std::list<std::string> keys_; // Most recently used first
+  // Keys view the strings in keys_, whose nodes never move
+  std::unordered_map<std::string_view, Entry> entries_;
+  std::atomic<int64_t> hits_{0};
+};
+
+// The schema plan of the last result of one statement, under the key
+// CubeSchemaCache stores it by. Readers of the statement's results look
+// here first, so a statement run again and again finds its plan with one
+// comparison of the Schema message bytes, not a hash lookup under the
+// connection's lock, and keeps it when the connection's cache evicts it.
+// Thread-safe: results of one statement may be read at the same time.
+class CubeSchemaSlot {
+public:
+  // The plan stored, if it was stored for exactly these bytes
+  std::shared_ptr<const CubeSchemaPlan> Find(std::string_view message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return message == key_ ? plan_ : nullptr;
+  }
+
+  // Replace the plan stored
+  void Store(std::string_view message,
+             std::shared_ptr<const CubeSchemaPlan> plan) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (message != key_) {
+      key_.assign(message);
+    }
+    plan_ = std::move(plan);
+  }
+
+private:
+  std::mutex mutex_;
+  std::string key_;
+  std::shared_ptr<const CubeSchemaPlan> plan_;
+};
+
+// Where the bytes and time of one statement's results went. Filled in by
+// the native result stream and the readers decoding it; atomic, since a
+// decode-ahead thread adds to it while the statement reads it.
+struct CubeQueryStats {
+  // Response messages read from the socket, framing included (batches in
+  // shared memory are not)
+  std::atomic<int64_t> bytes_received{0};
+  std::atomic<int64_t> batches{0}; // Record batch messages received
+  // From sending the query to receiving its first batch; -1 until then
+  std::atomic<int64_t> time_to_first_batch_nanos{-1};
+  // Turning received messages into arrays, verification included
+  std::atomic<int64_t> decode_nanos{0};
+  // Blocked on the socket: waiting for it to be readable and reading it
+  std::atomic<int64_t> socket_wait_nanos{0};
+  std::atomic<int64_t> verify_nanos{0}; // Verifying FlatBuffers
+  std::atomic<int64_t> rows{0};         // Rows of the batches decoded
+  // The server's estimate of the result, sent ahead of its first batch,
+  // and its row count once it is complete; -1 when unknown
+  std::atomic<int64_t> estimated_rows{-1};
+  std::atomic<int64_t> estimated_bytes{-1};
+  std::atomic<int64_t> total_rows{-1};
+
+  // How the server ran the query, from its QueryComplete; unset until the
+  // result has been read, or if the server sent none
+  void SetDiagnostics(QueryDiagnostics diagnostics) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    diagnostics_ = std::move(diagnostics);
+  }
+  std::optional<QueryDiagnostics> diagnostics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return diagnostics_;
+  }
+
+private:
+  mutable std::mutex mutex_; // Guards diagnostics_
+  std::optional<QueryDiagnostics> diagnostics_;
+};
+
+// What a query says about the rows of its result, which the reader adds to
+// the schema metadata besides any the server sends: its ORDER BY as
+// adbc.cube.sort_keys ("a, b DESC NULLS FIRST", as ParseSortKeys takes it),
+// the columns no two rows have the same values of as adbc.cube.unique_keys
+// (comma-separated), and the DATE_TRUNC granularity of a time dimension as
+// the adbc.cube.time_grain of its field. Columns are top-level field
+// indexes.
+struct CubeResultOrdering {
+  std::vector<CubeSortKey> sort_keys;
+  std::vector<int64_t> unique_keys;
+  std::vector<std::pair<int64_t, std::string>> time_grains;
+
+  bool empty() const {
+    return sort_keys.empty() && unique_keys.empty() && time_grains.empty();
+  }
+};
+
+// Decode options for CubeArrowReader
+struct CubeReaderOptions {
+  // Hand IPC body buffers to the output arrays instead of copying them.
+  // Columns whose buffers are empty or misaligned are still copied.
+  bool zero_copy = true;
+  // Number of threads that build the columns of a batch: the calling one
+  // and up to decode_threads - 1 workers of CubeDecodeScheduler::Global()
+  int decode_threads = 1;
+  // Ask the server to send text and binary columns as Utf8View/BinaryView
+  // instead of offset-based strings. Sent with the query.
+  bool view_types = false;
+  // Ask the server to send columns whose values repeat in long runs, such
+  // as sorted time dimensions, as RunEndEncoded. Sent with the query.
+  bool run_end_encoded = false;
+  // Native mode only: subscribe to the result, so the stream returns each
+  // version the server sends as the data is refreshed, an empty batch after
+  // each, until it is released. Sent with the query.
+  bool subscribe = false;
+  // Native mode only, applied by the connection: a read-only query not
+  // answered within this long is sent to a second server as well, and the
+  // first answer is used (0 = never)
+  std::chrono::milliseconds hedge_after{0};
+  // Class of work the query is. Sent with the query when the server takes
+  // it; the connection's admission queue honours it either way.
+  QueryPriority priority = QueryPriority::Default;
+  // Native mode only: most rows of the first batch the server sends, ahead
+  // of batches of the usual size (0 = as the others). Sent with the query.
+  uint32_t first_batch_rows = 0;
+  // Native mode only: the server is to reject the query, while planning it,
+  // unless a pre-aggregation serves it. Sent with the query.
+  bool require_preaggregation = false;
+  // Native mode only, applied by the connection: the query text is a Cube
+  // JSON query, sent in place of SQL so the server skips parsing and
+  // rewriting it
+  bool json_query = false;
+  // Native mode only, applied by the connection: answer from a sample of
+  // the source rows, as QueryRequest::sample_fraction_ppm, sample_rows and
+  // sample_seed; the result's schema metadata marks it approximate. With
+  // sample_refine the exact query is sent right behind the sampled one,
+  // and its result follows the sample's after an empty batch.
+  uint32_t sample_fraction_ppm = 0;
+  int64_t sample_rows = 0;
+  int64_t sample_seed = 0;
+  bool sample_refine = false;
+  // Native mode only: largest batches the server is asked to send the
+  // result in (0 = its choice). Sent with the query.
+  uint32_t max_batch_rows = 0;
+  int64_t max_batch_bytes = 0;
+  FlatBufferVerification verification = FlatBufferVerification::Full;
+  // When set, nanoseconds spent verifying FlatBuffers are added to it
+  std::shared_ptr<std::atomic<int64_t>> verify_nanos;
+  // When set, the statistics of the results decoded are added to it
+  std::shared_ptr<CubeQueryStats> stats;
+  // When set, schemas are looked up here before being parsed
+  std::shared_ptr<CubeSchemaCache> schema_cache;
+  // When set, looked up before schema_cache, and given the plan of every
+  // schema read; hits are counted by schema_cache
+  std::shared_ptr<CubeSchemaSlot> schema_slot;
+  // When set, buffers the reader copies into are allocated here
+  std::shared_ptr<CubeBufferPool> buffer_pool;
+  // Native mode only, applied by the result stream: when set, once a
+  // result's received messages take more than spill_budget_bytes of
+  // memory, further ones are moved to a file in this directory and read
+  // from its mapping
+  std::string spill_dir;
+  size_t spill_budget_bytes = size_t{256} << 20;
+  // Native mode only, applied by the result stream: when set, received
+  // messages are charged here until the arrays sharing them are released.
+  // Once it is past its limit, further ones are spilled if spill_dir is
+  // set, and fail the result otherwise.
+  std::shared_ptr<CubeMemoryTracker> memory;
+  // Native mode only, applied by the result stream: skip decoding and
+  // return the received Arrow IPC messages as one large_binary column
+  bool raw_ipc = false;
+  // Native mode only, applied by the result stream: most rows returned
+  // (0 = all). The batch that reaches it is sliced, and the server is told
+  // to stop the rest of the result, which is then skipped undecoded.
+  int64_t max_rows = 0;
+  // Top-level columns to decode, by name; the others are left out of the
+  // result and their buffers are neither decompressed nor read. Empty
+  // decodes every column.
+  std::vector<std::string> columns;
+  // Unit timestamp columns are converted to as they are decoded; unset
+  // keeps the unit the server sent. A value that does not fit a finer unit
+  // fails the batch; a coarser one rounds toward negative infinity.
+  std::optional<ArrowTimeUnit> timestamp_unit;
+  // NANOARROW_TYPE_DATE32 or NANOARROW_TYPE_DATE64: type date columns are
+  // converted to as they are decoded; unset keeps the server's
+  std::optional<ArrowType> date_type;
+  // When set, top-level string and large string columns the server sends
+  // plain are dictionary encoded here. Shared by the readers of a result,
+  // so its batches get one dictionary per column.
+  std::shared_ptr<CubeStringDictionaries> string_dictionaries;
+  // Added to the schema metadata; the server's own entries win
+  CubeResultOrdering result_ordering;
+};
+
+// Convert the timestamp and date columns of schema, at any depth, to the
+// unit and type options ask for, as CubeArrowReader decodes them
+ArrowErrorCode ApplyTemporalOptions(const CubeReaderOptions &options,
+                                    struct ArrowSchema *schema);
+
+// Indexes of the top-level columns of a struct schema named in columns, in
+// schema order (all of them when columns is empty); EINVAL if a name is
+// not one of them
+ArrowErrorCode ResolveColumns(const struct ArrowSchema *schema,
+                              const std::vector<std::string> &columns,
+                              std::vector<int> *fields, ArrowError *error);
+
+// Copy a struct schema keeping only the top-level columns in fields
+ArrowErrorCode ProjectSchema(const struct ArrowSchema *schema,
+                             const std::vector<int> &fields,
+                             struct ArrowSchema *out);
+
+// Wrap [data, data + size) of owner's bytes in an ArrowBuffer that keeps
+// them alive until it is released
+void WrapSharedIpcBuffer(const std::shared_ptr<const CubeIpcBytes> &owner,
+                         const uint8_t *data, int64_t size,
+                         struct ArrowBuffer *out);
+
 // Helper class to deserialize Arrow IPC format results from Cube SQL
 class CubeArrowReader {
 public:
   // Create reader from raw Arrow IPC bytes
-  // Takes ownership of the buffer
-  explicit CubeArrowReader(std::vector<uint8_t> arrow_ipc_data);
+  // Takes ownership of the buffer; with zero_copy, arrays returned by
+  // GetNext share it and keep it alive after the reader is destroyed.
+  // Given a schema, the bytes are the messages that follow the Schema
+  // message of a stream whose schema was sent separately.
+  explicit CubeArrowReader(CubeIpcBuffer arrow_ipc_data,
+                           CubeReaderOptions options = {},
+                           std::shared_ptr<const CubeSchemaPlan> schema = {});
+  // Read bytes held by someone else, such as a mapped spill file; with
+  // zero_copy, arrays returned by GetNext keep them alive
+  explicit CubeArrowReader(std::shared_ptr<const CubeIpcBytes> arrow_ipc_data,
+                           CubeReaderOptions options = {},
+                           std::shared_ptr<const CubeSchemaPlan> schema = {});
+  // Copy the bytes into an aligned buffer first
+  explicit CubeArrowReader(const std::vector<uint8_t> &arrow_ipc_data,
+                           CubeReaderOptions options = {},
+                           std::shared_ptr<const CubeSchemaPlan> schema = {});
   ~CubeArrowReader();
 
   // Initialize the reader and parse the schema
   // Must be called before GetSchema or GetNext
   ArrowErrorCode Init(ArrowError *error);
 
-  // Get the Arrow schema
+  // Get the Arrow schema, with only the columns of options.columns
   ArrowErrorCode GetSchema(ArrowSchema *out);
 
-  // Get the next RecordBatch
-  // Returns ENOMSG (no message) when no more batches
+  // Parsed schema, shared with other readers of the same schema; null
+  // before Init succeeds
+  const std::shared_ptr<const CubeSchemaPlan> &schema_plan() const {
+    return plan_;
+  }
+
+  // Get the next RecordBatch; a stream may hold any number of them
+  // Returns ENOMSG (no message) at the EOS marker or end of the buffer, and
+  // EINVAL if a message is malformed or runs past the buffer
   ArrowErrorCode GetNext(ArrowArray *out);
 
   // Create an ArrowArrayStream from this reader
@@ -62,6 +426,9 @@ public:
   void ExportTo(struct ArrowArrayStream *stream);
 
 private:
+  // Set fields_ from options_.columns once plan_ is known
+  ArrowErrorCode SelectFields(ArrowError *error);
+
   // Parse Arrow IPC message at current offset
   ArrowErrorCode ParseMessage(ArrowError *error);
 
@@ -76,7 +443,13 @@ private:
 
   // FlatBuffer parsing methods
   ArrowErrorCode ParseSchemaFlatBuffer(const uint8_t *fb_data, int64_t fb_size,
-                                       ArrowError *error);
+                                       CubeSchemaPlan *plan, ArrowError *error);
+
+  // Set a schema from an IPC field and record its field nodes in plan,
+  // recursing into the children of nested types
+  ArrowErrorCode AddFieldNodes(const org::apache::arrow::flatbuf::Field *field,
+                               int arrow_type, ArrowSchema *schema,
+                               CubeSchemaPlan *plan, ArrowError *error);
 
   ArrowErrorCode ParseRecordBatchFlatBuffer(const uint8_t *fb_data,
                                             int64_t fb_size,
@@ -84,30 +457,137 @@ private:
                                             int64_t body_size, ArrowArray *out,
                                             ArrowError *error);
 
+  // Store the dictionary of a DictionaryBatch message, or append to it
+  // when the batch is a delta
+  ArrowErrorCode
+  ParseDictionaryBatch(const org::apache::arrow::flatbuf::DictionaryBatch *dict,
+                       const uint8_t *body_data, int64_t body_size,
+                       ArrowError *error);
+
   ArrowErrorCode
   BuildArrayForField(int field_index, int64_t row_count,
                      const org::apache::arrow::flatbuf::RecordBatch *batch,
                      const uint8_t *body_data, int *buffer_index_inout,
                      ArrowArray *out, ArrowError *error);
 
+  // Build the array of field node node_index and, for nested types, of
+  // every node below it, consuming their buffers in order
+  ArrowErrorCode
+  BuildArrayForNode(int node_index, int64_t length,
+                    const org::apache::arrow::flatbuf::RecordBatch *batch,
+                    const uint8_t *body_data, int *buffer_index_inout,
+                    ArrowArray *out, ArrowError *error);
+
+  // Build a flat array of the given type from field node node_index with
+  // the decoder for its layout
+  ArrowErrorCode
+  BuildArrayForType(int arrow_type, CubeNodeDecoder decoder, int node_index,
+                    int64_t row_count,
+                    const org::apache::arrow::flatbuf::RecordBatch *batch,
+                    const uint8_t *body_data, int *buffer_index_inout,
+                    ArrowArray *out, ArrowError *error);
+
+  // BuildArrayForType for one decoder: shares the buffers with the body
+  // when it can, copies them otherwise
+  template <CubeNodeDecoder kDecoder>
+  ArrowErrorCode
+  BuildFlatArray(int arrow_type, int node_index, int64_t row_count,
+                 const org::apache::arrow::flatbuf::RecordBatch *batch,
+                 const uint8_t *body_data, int *buffer_index_inout,
+                 ArrowArray *out, ArrowError *error);
+
+  // Byte width of a fixed-width node's values, fixed-size binary included
+  int64_t NodeValueWidth(int arrow_type, int node_index) const;
+  // ArrowArrayInitFromType for a flat node, with the width of fixed-size
+  // binary values, which the type alone does not give
+  ArrowErrorCode InitFlatArray(ArrowArray *out, int arrow_type,
+                               int node_index) const;
+
+  // Append the values of a view column one by one, checking that each view
+  // stays inside its data buffer
+  ArrowErrorCode
+  AppendViews(int node_index, int64_t row_count,
+              const org::apache::arrow::flatbuf::RecordBatch *batch,
+              const uint8_t *body_data, const uint8_t *validity_buffer,
+              int *buffer_index_inout, ArrowArray *out, ArrowError *error);
+
+  // Build the columns in fields_ on up to options_.decode_threads threads,
+  // the calling one and workers of the process-wide decode pool
+  ArrowErrorCode
+  BuildFieldsInParallel(int64_t row_count,
+                        const org::apache::arrow::flatbuf::RecordBatch *batch,
+                        const uint8_t *body_data,
+                        const std::vector<int> &first_buffer, ArrowArray *out,
+                        ArrowError *error);
+
+  // Index of the first buffer of each top-level field of the current
+  // batch, plus one past the last buffer of the last field; buffers are
+  // laid out node after node, so each follows from the nodes before it
+  std::vector<int> FieldFirstBuffers() const;
+
+  // Build a column whose buffers point into the IPC body
+  // Returns ENOTSUP (leaving the buffer index untouched) when the column
+  // has to be copied instead
+  template <CubeNodeDecoder kDecoder>
+  ArrowErrorCode
+  ShareFlatArray(int arrow_type, int node_index, int64_t row_count,
+                 const org::apache::arrow::flatbuf::RecordBatch *batch,
+                 const uint8_t *body_data, const uint8_t *validity_buffer,
+                 int64_t validity_size, int *buffer_index_inout,
+                 ArrowArray *out, ArrowError *error);
+
+  // Record how many variadic buffers each field node of a batch has, taking
+  // the batch's variadicBufferCounts in order for the view-typed nodes
+  ArrowErrorCode
+  ReadVariadicCounts(const org::apache::arrow::flatbuf::RecordBatch *batch,
+                     const std::vector<int> &node_types, ArrowError *error);
+
+  // Decompress the buffers of a batch with BodyCompression into one new
+  // body, each buffer at an 8-byte aligned offset. Large batches are
+  // decompressed on several threads. Buffers not in needed (when given)
+  // are left empty.
+  ArrowErrorCode
+  DecompressBody(const org::apache::arrow::flatbuf::RecordBatch *batch,
+                 const uint8_t *body_data, int64_t body_size,
+                 ArrowError *error,
+                 const std::vector<bool> *needed = nullptr);
+
   void ExtractBuffer(const org::apache::arrow::flatbuf::RecordBatch *batch,
                      int buffer_index, const uint8_t *body_data,
                      const uint8_t **out_ptr, int64_t *out_size);
 
-  int MapFlatBufferTypeToArrow(int fb_type);
+  // Exact nanoarrow type of a field, keeping integer width and signedness
+  // and floating point precision
+  int MapFlatBufferTypeToArrow(const org::apache::arrow::flatbuf::Field *field);
   int GetBufferCountForType(int arrow_type);
   static bool GetBit(const uint8_t *bitmap, int64_t index);
 
-  std::vector<uint8_t> buffer_;     // Raw Arrow IPC bytes
+  // Verify a Message FlatBuffer as options_.verification asks
+  bool VerifyMessage(const uint8_t *fb_data, int64_t fb_size);
+
+  std::shared_ptr<const CubeIpcBytes> buffer_; // Raw Arrow IPC bytes
+  CubeReaderOptions options_;
   int64_t offset_ = 0;              // Current position in buffer
-  struct ArrowSchema schema_;       // Parsed schema
-  bool schema_initialized_ = false; // Whether schema has been parsed
   bool finished_ = false;           // Whether we've reached end of stream
 
-  // Schema metadata (parsed from FlatBuffer)
-  std::vector<std::string> field_names_;
-  std::vector<int> field_types_;
-  std::vector<bool> field_nullable_;
+  // Owner of the body the current batch's buffers live in: buffer_, or the
+  // decompressed body of a compressed batch
+  std::shared_ptr<const CubeIpcBytes> body_owner_;
+  // (offset, length) of each buffer in the decompressed body; empty when
+  // the batch is not compressed and the FlatBuffer offsets apply
+  std::vector<std::pair<int64_t, int64_t>> body_buffers_;
+  // Variadic data buffers of each field node of the current batch (0 for
+  // anything but string and binary views)
+  std::vector<int64_t> node_variadic_counts_;
+
+  // Parsed schema; set by Init
+  std::shared_ptr<const CubeSchemaPlan> plan_;
+  // Top-level fields decoded, from options_.columns; set by Init
+  std::vector<int> fields_;
+  bool projected_ = false; // fields_ leaves some out
+
+  // Dictionaries received so far
+  std::map<int64_t, std::shared_ptr<SharedDictionary>> dictionaries_;
 };
 
 } // namespace adbc::cube
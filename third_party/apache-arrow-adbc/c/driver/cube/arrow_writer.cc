@@ -0,0 +1,550 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/arrow_writer.h"
+
+#include <cstring>
+#include <string>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/buffer_kernels.h"
+#include "format/generated/Message_generated.h"
+#include "format/generated/Schema_generated.h"
+#include <flatbuffers/flatbuffers.h>
+
+namespace adbc::cube {
+
+namespace {
+
+namespace fb = org::apache::arrow::flatbuf;
+
+const uint32_t ARROW_IPC_MAGIC = 0xFFFFFFFF;
+
+// Messages and body buffers are padded to this many bytes
+const int64_t ARROW_IPC_ALIGNMENT = 8;
+
+int64_t PaddedLength(int64_t length) {
+  return (length + ARROW_IPC_ALIGNMENT - 1) & ~(ARROW_IPC_ALIGNMENT - 1);
+}
+
+void AppendLE32(std::vector<uint8_t> *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out->push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+fb::TimeUnit FlatBufferTimeUnit(ArrowTimeUnit unit) {
+  switch (unit) {
+  case NANOARROW_TIME_UNIT_SECOND:
+    return fb::TimeUnit_SECOND;
+  case NANOARROW_TIME_UNIT_MILLI:
+    return fb::TimeUnit_MILLISECOND;
+  case NANOARROW_TIME_UNIT_MICRO:
+    return fb::TimeUnit_MICROSECOND;
+  case NANOARROW_TIME_UNIT_NANO:
+  default:
+    return fb::TimeUnit_NANOSECOND;
+  }
+}
+
+// Flatbuffer type of a column; ENOTSUP for types parameters cannot have
+ArrowErrorCode FlatBufferType(flatbuffers::FlatBufferBuilder &fbb,
+                              const ArrowSchemaView &view, fb::Type *type,
+                              flatbuffers::Offset<void> *offset,
+                              ArrowError *error) {
+  switch (view.type) {
+  case NANOARROW_TYPE_NA:
+    *type = fb::Type_Null;
+    *offset = fb::CreateNull(fbb).Union();
+    break;
+  case NANOARROW_TYPE_BOOL:
+    *type = fb::Type_Bool;
+    *offset = fb::CreateBool(fbb).Union();
+    break;
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64: {
+    bool is_signed = view.type == NANOARROW_TYPE_INT8 ||
+                     view.type == NANOARROW_TYPE_INT16 ||
+                     view.type == NANOARROW_TYPE_INT32 ||
+                     view.type == NANOARROW_TYPE_INT64;
+    *type = fb::Type_Int;
+    *offset = fb::CreateInt(fbb, view.layout.element_size_bits[1], is_signed)
+                  .Union();
+    break;
+  }
+  case NANOARROW_TYPE_HALF_FLOAT:
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE: {
+    fb::Precision precision = view.type == NANOARROW_TYPE_HALF_FLOAT
+                                  ? fb::Precision_HALF
+                              : view.type == NANOARROW_TYPE_FLOAT
+                                  ? fb::Precision_SINGLE
+                                  : fb::Precision_DOUBLE;
+    *type = fb::Type_FloatingPoint;
+    *offset = fb::CreateFloatingPoint(fbb, precision).Union();
+    break;
+  }
+  case NANOARROW_TYPE_STRING:
+    *type = fb::Type_Utf8;
+    *offset = fb::CreateUtf8(fbb).Union();
+    break;
+  case NANOARROW_TYPE_LARGE_STRING:
+    *type = fb::Type_LargeUtf8;
+    *offset = fb::CreateLargeUtf8(fbb).Union();
+    break;
+  case NANOARROW_TYPE_BINARY:
+    *type = fb::Type_Binary;
+    *offset = fb::CreateBinary(fbb).Union();
+    break;
+  case NANOARROW_TYPE_LARGE_BINARY:
+    *type = fb::Type_LargeBinary;
+    *offset = fb::CreateLargeBinary(fbb).Union();
+    break;
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    *type = fb::Type_FixedSizeBinary;
+    *offset = fb::CreateFixedSizeBinary(fbb, view.fixed_size).Union();
+    break;
+  case NANOARROW_TYPE_DECIMAL128:
+  case NANOARROW_TYPE_DECIMAL256:
+    *type = fb::Type_Decimal;
+    *offset = fb::CreateDecimal(fbb, view.decimal_precision, view.decimal_scale,
+                                view.decimal_bitwidth)
+                  .Union();
+    break;
+  case NANOARROW_TYPE_DATE32:
+  case NANOARROW_TYPE_DATE64:
+    *type = fb::Type_Date;
+    *offset = fb::CreateDate(fbb, view.type == NANOARROW_TYPE_DATE32
+                                      ? fb::DateUnit_DAY
+                                      : fb::DateUnit_MILLISECOND)
+                  .Union();
+    break;
+  case NANOARROW_TYPE_TIME32:
+  case NANOARROW_TYPE_TIME64:
+    *type = fb::Type_Time;
+    *offset = fb::CreateTime(fbb, FlatBufferTimeUnit(view.time_unit),
+                             view.type == NANOARROW_TYPE_TIME32 ? 32 : 64)
+                  .Union();
+    break;
+  case NANOARROW_TYPE_TIMESTAMP: {
+    auto timezone =
+        view.timezone && view.timezone[0] ? fbb.CreateString(view.timezone) : 0;
+    *type = fb::Type_Timestamp;
+    *offset =
+        fb::CreateTimestamp(fbb, FlatBufferTimeUnit(view.time_unit), timezone)
+            .Union();
+    break;
+  }
+  case NANOARROW_TYPE_DURATION:
+    *type = fb::Type_Duration;
+    *offset =
+        fb::CreateDuration(fbb, FlatBufferTimeUnit(view.time_unit)).Union();
+    break;
+  default:
+    ArrowErrorSet(error, "Cannot send a %s column as a parameter",
+                  ArrowTypeString(view.type));
+    return ENOTSUP;
+  }
+  return NANOARROW_OK;
+}
+
+// Append the flatbuffer as an encapsulated message: continuation marker,
+// padded metadata length, metadata, padding
+void AppendMessage(const flatbuffers::FlatBufferBuilder &fbb,
+                   std::vector<uint8_t> *out) {
+  int64_t size = fbb.GetSize();
+  int64_t padded = PaddedLength(8 + size) - 8;
+  AppendLE32(out, ARROW_IPC_MAGIC);
+  AppendLE32(out, static_cast<uint32_t>(padded));
+  out->insert(out->end(), fbb.GetBufferPointer(),
+              fbb.GetBufferPointer() + size);
+  out->resize(out->size() + (padded - size), 0);
+}
+
+// Buffers smaller than this are copied rather than referenced, which keeps
+// the number of slices, and so of iovecs, of a wide batch down
+const size_t ARROW_IPC_MIN_BORROW_BYTES = 4096;
+
+const uint8_t ARROW_IPC_ZERO_PADDING[ARROW_IPC_ALIGNMENT] = {};
+
+// Adds pieces to an ArrowIpcSlices, copying small ones into the owned chunk
+// being filled
+class SliceWriter {
+public:
+  explicit SliceWriter(ArrowIpcSlices *out) : out_(out) {}
+
+  /// Zeroed bytes to fill in place, valid until the next call
+  uint8_t *CopyZeroed(size_t size) {
+    if (!chunk_) {
+      chunk_ = &out_->owned.emplace_back();
+    }
+    size_t start = chunk_->size();
+    chunk_->resize(start + size, 0);
+    out_->size += size;
+    return chunk_->data() + start;
+  }
+
+  void Copy(const void *data, size_t size) {
+    if (size > 0) {
+      std::memcpy(CopyZeroed(size), data, size);
+    }
+  }
+
+  /// Reference bytes that outlive the slices, copying them when small
+  void Borrow(const void *data, size_t size) {
+    if (size < ARROW_IPC_MIN_BORROW_BYTES) {
+      Copy(data, size);
+      return;
+    }
+    Flush();
+    out_->slices.push_back({static_cast<const uint8_t *>(data), size});
+    out_->size += size;
+  }
+
+  /// Add the chunk being filled as a slice; the chunk no longer grows
+  void Flush() {
+    if (chunk_ && !chunk_->empty()) {
+      out_->slices.push_back({chunk_->data(), chunk_->size()});
+    }
+    chunk_ = nullptr;
+  }
+
+private:
+  ArrowIpcSlices *out_;
+  std::vector<uint8_t> *chunk_ = nullptr;
+};
+
+/// Body of a RecordBatch message being assembled
+class BodyWriter {
+public:
+  BodyWriter(ArrowIpcSlices *out, CompressionCodec codec)
+      : writer_(out), codec_(codec) {}
+
+  /// Append a buffer of the array, referenced where it is
+  ArrowErrorCode Append(const void *data, int64_t size, ArrowError *error) {
+    return AppendBuffer(static_cast<const uint8_t *>(data), size, true, error);
+  }
+
+  /// Append a buffer of size bytes that fill writes, for buffers the array
+  /// does not hold as they must be sent
+  template <typename Fill>
+  ArrowErrorCode AppendFilled(int64_t size, Fill &&fill, ArrowError *error) {
+    if (codec_ == CompressionCodec::None) {
+      buffers_.emplace_back(body_size_, size);
+      fill(writer_.CopyZeroed(size));
+      Pad(size);
+      return NANOARROW_OK;
+    }
+    scratch_.assign(size, 0);
+    fill(scratch_.data());
+    return AppendBuffer(scratch_.data(), size, false, error);
+  }
+
+  /// Append length bits of a bitmap starting at bit offset
+  ArrowErrorCode AppendBitmap(const uint8_t *bits, int64_t offset,
+                              int64_t length, ArrowError *error) {
+    int64_t size = (length + 7) / 8;
+    if (offset % 8 == 0) {
+      return Append(bits + offset / 8, size, error);
+    }
+    return AppendFilled(
+        size,
+        [&](uint8_t *out) { CopyBitmap(bits, offset, length, out); }, error);
+  }
+
+  /// Empty buffer, for an omitted validity bitmap
+  void AppendEmpty() { buffers_.emplace_back(body_size_, 0); }
+
+  /// Add the last owned bytes; call once every buffer is appended
+  void Finish() { writer_.Flush(); }
+
+  const std::vector<fb::Buffer> &buffers() const { return buffers_; }
+  int64_t body_size() const { return body_size_; }
+
+private:
+  ArrowErrorCode AppendBuffer(const uint8_t *data, int64_t size,
+                              bool borrowable, ArrowError *error) {
+    if (codec_ == CompressionCodec::None || size == 0) {
+      buffers_.emplace_back(body_size_, size);
+      if (borrowable) {
+        writer_.Borrow(data, size);
+      } else {
+        writer_.Copy(data, size);
+      }
+      Pad(size);
+      return NANOARROW_OK;
+    }
+    // Each buffer is prefixed by its uncompressed length, or -1 when it is
+    // sent as it is because compressing did not make it smaller
+    NANOARROW_RETURN_NOT_OK(Compress(codec_, data, size, &compressed_, error));
+    bool smaller = static_cast<int64_t>(compressed_.size()) < size;
+    int64_t prefix = smaller ? size : -1;
+    uint8_t *out = writer_.CopyZeroed(8);
+    for (int i = 0; i < 8; i++) {
+      out[i] = static_cast<uint8_t>(static_cast<uint64_t>(prefix) >> (i * 8));
+    }
+    int64_t length = 8;
+    if (smaller) {
+      writer_.Copy(compressed_.data(), compressed_.size());
+      length += static_cast<int64_t>(compressed_.size());
+    } else if (borrowable) {
+      writer_.Borrow(data, size);
+      length += size;
+    } else {
+      writer_.Copy(data, size);
+      length += size;
+    }
+    buffers_.emplace_back(body_size_, length);
+    Pad(length);
+    return NANOARROW_OK;
+  }
+
+  void Pad(int64_t size) {
+    int64_t padded = PaddedLength(size);
+    writer_.Copy(ARROW_IPC_ZERO_PADDING, padded - size);
+    body_size_ += padded;
+  }
+
+  SliceWriter writer_;
+  CompressionCodec codec_;
+  std::vector<fb::Buffer> buffers_;
+  int64_t body_size_ = 0;
+  std::vector<uint8_t> scratch_;
+  std::vector<uint8_t> compressed_;
+};
+
+// Append the offsets of length values, rebased to start at zero unless
+// they already do, and the data they span
+template <typename Offset>
+ArrowErrorCode AppendOffsetsAndData(const Offset *offsets, int64_t length,
+                                    const uint8_t *data, BodyWriter *body,
+                                    ArrowError *error) {
+  int64_t size = (length + 1) * static_cast<int64_t>(sizeof(Offset));
+  if (offsets[0] == 0) {
+    NANOARROW_RETURN_NOT_OK(body->Append(offsets, size, error));
+  } else {
+    NANOARROW_RETURN_NOT_OK(body->AppendFilled(
+        size,
+        [&](uint8_t *out) {
+          RebaseOffsets(offsets, length + 1, offsets[0],
+                        reinterpret_cast<Offset *>(out));
+        },
+        error));
+  }
+  return body->Append(data + offsets[0], offsets[length] - offsets[0], error);
+}
+
+// Append the buffers of rows [offset, offset + length) of a column
+ArrowErrorCode AppendColumn(const ArrowArrayView &view, int64_t offset,
+                            int64_t length, BodyWriter *body,
+                            std::vector<fb::FieldNode> *nodes,
+                            ArrowError *error) {
+  int64_t begin = view.offset + offset;
+  int64_t null_count = 0;
+  const uint8_t *validity = view.buffer_views[0].data.as_uint8;
+  if (view.storage_type == NANOARROW_TYPE_NA) {
+    null_count = length;
+  } else if (validity) {
+    null_count = length - ArrowBitCountSet(validity, begin, length);
+  }
+  nodes->emplace_back(length, null_count);
+  if (view.storage_type == NANOARROW_TYPE_NA) {
+    return NANOARROW_OK;
+  }
+
+  if (validity && null_count > 0) {
+    NANOARROW_RETURN_NOT_OK(
+        body->AppendBitmap(validity, begin, length, error));
+  } else {
+    body->AppendEmpty();
+  }
+
+  switch (view.storage_type) {
+  case NANOARROW_TYPE_BOOL:
+    NANOARROW_RETURN_NOT_OK(body->AppendBitmap(
+        view.buffer_views[1].data.as_uint8, begin, length, error));
+    break;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_BINARY:
+    NANOARROW_RETURN_NOT_OK(AppendOffsetsAndData(
+        view.buffer_views[1].data.as_int32 + begin, length,
+        view.buffer_views[2].data.as_uint8, body, error));
+    break;
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_LARGE_BINARY:
+    NANOARROW_RETURN_NOT_OK(AppendOffsetsAndData(
+        view.buffer_views[1].data.as_int64 + begin, length,
+        view.buffer_views[2].data.as_uint8, body, error));
+    break;
+  default: {
+    int64_t bits = view.layout.element_size_bits[1];
+    if (view.layout.buffer_type[1] != NANOARROW_BUFFER_TYPE_DATA ||
+        bits % 8 != 0) {
+      ArrowErrorSet(error, "Cannot send a %s column as a parameter",
+                    ArrowTypeString(view.storage_type));
+      return ENOTSUP;
+    }
+    int64_t width = bits / 8;
+    NANOARROW_RETURN_NOT_OK(body->Append(
+        view.buffer_views[1].data.as_uint8 + begin * width, length * width,
+        error));
+    break;
+  }
+  }
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode AppendSchemaMessage(const struct ArrowSchema *schema,
+                                   std::vector<uint8_t> *out,
+                                   struct ArrowError *error) {
+  flatbuffers::FlatBufferBuilder fbb;
+  std::vector<flatbuffers::Offset<fb::Field>> fields;
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    const ArrowSchema *child = schema->children[i];
+    ArrowSchemaView child_view;
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaViewInit(&child_view, child, error));
+    if (child->n_children > 0 || child->dictionary) {
+      ArrowErrorSet(error, "Cannot send nested column '%s'",
+                    child->name ? child->name : "");
+      return ENOTSUP;
+    }
+    fb::Type type;
+    flatbuffers::Offset<void> type_offset;
+    NANOARROW_RETURN_NOT_OK(
+        FlatBufferType(fbb, child_view, &type, &type_offset, error));
+    auto name = fbb.CreateString(child->name ? child->name : "");
+    fields.push_back(fb::CreateField(
+        fbb, name, (child->flags & ARROW_FLAG_NULLABLE) != 0, type,
+        type_offset));
+  }
+  auto schema_offset = fb::CreateSchema(fbb, fb::Endianness_Little,
+                                        fbb.CreateVector(fields));
+  fbb.Finish(fb::CreateMessage(fbb, fb::MetadataVersion_V5,
+                               fb::MessageHeader_Schema,
+                               schema_offset.Union(), 0));
+  AppendMessage(fbb, out);
+  return NANOARROW_OK;
+}
+
+} // namespace
+
+void ArrowIpcSlices::AppendTo(std::vector<uint8_t> *out) const {
+  out->reserve(out->size() + size);
+  for (const auto &slice : slices) {
+    out->insert(out->end(), slice.data, slice.data + slice.size);
+  }
+}
+
+ArrowErrorCode EncodeArrowIpcRecordBatch(const struct ArrowSchema *schema,
+                                         const struct ArrowArray *array,
+                                         int64_t offset, int64_t length,
+                                         CompressionCodec codec,
+                                         ArrowIpcSlices *out,
+                                         struct ArrowError *error) {
+  *out = ArrowIpcSlices();
+  nanoarrow::UniqueArrayView view;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewInitFromSchema(view.get(), schema, error));
+  NANOARROW_RETURN_NOT_OK(ArrowArrayViewSetArray(view.get(), array, error));
+  if (view->storage_type != NANOARROW_TYPE_STRUCT) {
+    ArrowErrorSet(error, "Data must be a struct array");
+    return EINVAL;
+  }
+  if (offset < 0 || length < 0 || offset + length > view->length) {
+    ArrowErrorSet(error, "Rows [%lld, %lld) are outside the %lld row batch",
+                  static_cast<long long>(offset),
+                  static_cast<long long>(offset + length),
+                  static_cast<long long>(view->length));
+    return EINVAL;
+  }
+
+  // The body goes into out first; its metadata, which needs the buffer
+  // offsets, is then put in front of it
+  BodyWriter body(out, codec);
+  std::vector<fb::FieldNode> nodes;
+  for (int64_t i = 0; i < view->n_children; i++) {
+    NANOARROW_RETURN_NOT_OK(AppendColumn(*view->children[i],
+                                         view->offset + offset, length, &body,
+                                         &nodes, error));
+  }
+  body.Finish();
+
+  flatbuffers::FlatBufferBuilder fbb;
+  flatbuffers::Offset<fb::BodyCompression> compression = 0;
+  if (codec != CompressionCodec::None) {
+    compression = fb::CreateBodyCompression(
+        fbb, codec == CompressionCodec::Zstd ? fb::CompressionType_ZSTD
+                                             : fb::CompressionType_LZ4_FRAME);
+  }
+  auto batch = fb::CreateRecordBatch(
+      fbb, length, fbb.CreateVectorOfStructs(nodes),
+      fbb.CreateVectorOfStructs(body.buffers()), compression);
+  fbb.Finish(fb::CreateMessage(fbb, fb::MetadataVersion_V5,
+                               fb::MessageHeader_RecordBatch, batch.Union(),
+                               body.body_size()));
+  auto &metadata = out->owned.emplace_back();
+  AppendMessage(fbb, &metadata);
+  out->slices.insert(out->slices.begin(), {metadata.data(), metadata.size()});
+  out->size += metadata.size();
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode WriteArrowIpcStream(const struct ArrowSchema *schema,
+                                   const struct ArrowArray *array,
+                                   int64_t offset, int64_t length,
+                                   std::vector<uint8_t> *out,
+                                   struct ArrowError *error) {
+  out->clear();
+  NANOARROW_RETURN_NOT_OK(AppendSchemaMessage(schema, out, error));
+  ArrowIpcSlices batch;
+  NANOARROW_RETURN_NOT_OK(EncodeArrowIpcRecordBatch(
+      schema, array, offset, length, CompressionCodec::None, &batch, error));
+  batch.AppendTo(out);
+  // End of stream
+  AppendLE32(out, ARROW_IPC_MAGIC);
+  AppendLE32(out, 0);
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode WriteArrowIpcSchema(const struct ArrowSchema *schema,
+                                   std::vector<uint8_t> *out,
+                                   struct ArrowError *error) {
+  out->clear();
+  return AppendSchemaMessage(schema, out, error);
+}
+
+ArrowErrorCode WriteArrowIpcRecordBatch(const struct ArrowSchema *schema,
+                                        const struct ArrowArray *array,
+                                        int64_t offset, int64_t length,
+                                        std::vector<uint8_t> *out,
+                                        struct ArrowError *error) {
+  out->clear();
+  ArrowIpcSlices batch;
+  NANOARROW_RETURN_NOT_OK(EncodeArrowIpcRecordBatch(
+      schema, array, offset, length, CompressionCodec::None, &batch, error));
+  batch.AppendTo(out);
+  return NANOARROW_OK;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,88 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/compression.h"
+
+namespace adbc::cube {
+
+/// An encoded IPC message as the pieces of memory it is made of, in order,
+/// to be written with one writev instead of being copied into one buffer.
+/// Pieces point either into bytes the message owns (metadata, padding, and
+/// buffers that had to be rewritten or compressed) or into the buffers of
+/// the ArrowArray it was encoded from, which must outlive it unchanged.
+struct ArrowIpcSlices {
+  struct Slice {
+    const uint8_t *data;
+    size_t size;
+  };
+
+  std::vector<Slice> slices;
+  std::deque<std::vector<uint8_t>> owned; // Never moved once added
+  size_t size = 0;                        // Of all slices
+
+  /// Copy every slice to the end of out
+  void AppendTo(std::vector<uint8_t> *out) const;
+};
+
+/// Encode rows [offset, offset + length) of a struct array as one
+/// RecordBatch message and its body, leaving column buffers where they are
+/// whenever they need no rewriting (offsets that start at zero, bitmaps
+/// that start on a byte). With a codec, each body buffer is compressed as
+/// the IPC format's BodyCompression describes, and kept uncompressed when
+/// that is not smaller.
+ArrowErrorCode EncodeArrowIpcRecordBatch(const struct ArrowSchema *schema,
+                                         const struct ArrowArray *array,
+                                         int64_t offset, int64_t length,
+                                         CompressionCodec codec,
+                                         ArrowIpcSlices *out,
+                                         struct ArrowError *error);
+
+/// Encode rows [offset, offset + length) of a struct array as an Arrow IPC
+/// stream: a Schema message, one RecordBatch message and the end-of-stream
+/// marker, the same layout CubeArrowReader reads. Used to send bound
+/// parameters and ingested data to the server; only flat columns of
+/// primitive, string, binary and temporal types are supported (ENOTSUP
+/// otherwise).
+ArrowErrorCode WriteArrowIpcStream(const struct ArrowSchema *schema,
+                                   const struct ArrowArray *array,
+                                   int64_t offset, int64_t length,
+                                   std::vector<uint8_t> *out,
+                                   struct ArrowError *error);
+
+/// Encode the Schema message of a struct schema alone
+ArrowErrorCode WriteArrowIpcSchema(const struct ArrowSchema *schema,
+                                   std::vector<uint8_t> *out,
+                                   struct ArrowError *error);
+
+/// Encode rows [offset, offset + length) of a struct array as one
+/// RecordBatch message and its body, without a Schema message
+ArrowErrorCode WriteArrowIpcRecordBatch(const struct ArrowSchema *schema,
+                                        const struct ArrowArray *array,
+                                        int64_t offset, int64_t length,
+                                        std::vector<uint8_t> *out,
+                                        struct ArrowError *error);
+
+} // namespace adbc::cube
@@ -0,0 +1,172 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/async_stream.h"
+
+#include <cerrno>
+#include <utility>
+
+namespace adbc::cube {
+
+namespace {
+
+// One batch waiting in an ArrowAsyncTask until the handler takes it
+int ExtractBatch(struct ArrowAsyncTask *task, struct ArrowDeviceArray *out) {
+  auto *batch = static_cast<struct ArrowArray *>(task->private_data);
+  if (!batch) {
+    return EINVAL;
+  }
+  if (out) {
+    ArrowArrayMove(batch, &out->array);
+    out->device_id = -1;
+    out->device_type = ARROW_DEVICE_CPU;
+    out->sync_event = nullptr;
+  } else if (batch->release) {
+    batch->release(batch);
+  }
+  delete batch;
+  task->private_data = nullptr;
+  return 0;
+}
+
+} // namespace
+
+CubeAsyncStream::CubeAsyncStream(struct ArrowArrayStream *stream,
+                                 struct ArrowAsyncDeviceStreamHandler *handler,
+                                 ReadyFn ready)
+    : handler_(handler), ready_(std::move(ready)) {
+  ArrowArrayStreamMove(stream, stream_.get());
+  producer_.device_type = ARROW_DEVICE_CPU;
+  producer_.request = [](struct ArrowAsyncProducer *self, int64_t n) {
+    static_cast<CubeAsyncStream *>(self->private_data)->Request(n);
+  };
+  producer_.cancel = [](struct ArrowAsyncProducer *self) {
+    static_cast<CubeAsyncStream *>(self->private_data)->Cancel();
+  };
+  producer_.additional_metadata = nullptr;
+  producer_.private_data = this;
+  handler_->producer = &producer_;
+}
+
+CubeAsyncStream::~CubeAsyncStream() {
+  Abort(ECANCELED, "Result released before it was read");
+}
+
+void CubeAsyncStream::Pump() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  if (pumping_) {
+    return;
+  }
+  pumping_ = true;
+  while (handler_) {
+    if (cancelled_) {
+      Finish();
+      break;
+    }
+    if (!schema_sent_) {
+      if (!ready_()) {
+        break;
+      }
+      struct ArrowSchema schema;
+      int code = stream_->get_schema(stream_.get(), &schema);
+      if (code != NANOARROW_OK) {
+        Fail(code, stream_->get_last_error(stream_.get()));
+        break;
+      }
+      schema_sent_ = true;
+      // The handler owns the schema from here
+      if (handler_->on_schema(handler_, &schema) != 0) {
+        Finish();
+        break;
+      }
+      continue;
+    }
+    if (demand_ <= 0 || !ready_()) {
+      break;
+    }
+    struct ArrowArray array;
+    int code = stream_->get_next(stream_.get(), &array);
+    if (code != NANOARROW_OK) {
+      Fail(code, stream_->get_last_error(stream_.get()));
+      break;
+    }
+    if (!array.release) {
+      handler_->on_next_task(handler_, nullptr, nullptr);
+      Finish();
+      break;
+    }
+    demand_--;
+    struct ArrowAsyncTask task;
+    task.extract_data = ExtractBatch;
+    task.private_data = new struct ArrowArray;
+    ArrowArrayMove(&array, static_cast<struct ArrowArray *>(task.private_data));
+    if (handler_->on_next_task(handler_, &task, nullptr) != 0) {
+      Finish();
+      break;
+    }
+  }
+  pumping_ = false;
+}
+
+void CubeAsyncStream::Abort(int code, const std::string &message) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  Fail(code, message.c_str());
+}
+
+void CubeAsyncStream::Request(int64_t n) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  if (!handler_) {
+    return;
+  }
+  if (n <= 0) {
+    Fail(EINVAL, "request() needs a positive number of batches");
+    return;
+  }
+  demand_ += n;
+  Pump();
+}
+
+void CubeAsyncStream::Cancel() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  cancelled_ = true;
+  if (!pumping_ && handler_) {
+    Finish();
+  }
+}
+
+void CubeAsyncStream::Finish() {
+  // Releasing the stream early stops the query
+  stream_.reset();
+  if (!handler_) {
+    return; // Released by a callback that just returned
+  }
+  struct ArrowAsyncDeviceStreamHandler *handler = handler_;
+  handler_ = nullptr;
+  handler->release(handler);
+  finished_ = true;
+}
+
+void CubeAsyncStream::Fail(int code, const char *message) {
+  if (!handler_) {
+    return;
+  }
+  handler_->on_error(handler_, code,
+                     message ? message : "Failed to read result", nullptr);
+  Finish();
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,82 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <arrow-adbc/driver/cube.h>
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+/// Pushes the batches of a result stream into an Arrow C async stream
+/// handler. Nothing waits on the socket: callbacks are made from Pump, only
+/// once ready reports that the next read will not block, and only while the
+/// handler has asked for more batches.
+///
+/// handler->producer points into this object, so it must stay where it is
+/// until the handler has been released.
+class CubeAsyncStream {
+public:
+  /// Whether stream's next get_schema or get_next will return without
+  /// waiting on the network
+  using ReadyFn = std::function<bool()>;
+
+  /// Take over stream; handler is released once the result is done
+  CubeAsyncStream(struct ArrowArrayStream *stream,
+                  struct ArrowAsyncDeviceStreamHandler *handler,
+                  ReadyFn ready);
+  ~CubeAsyncStream();
+
+  CubeAsyncStream(const CubeAsyncStream &) = delete;
+  CubeAsyncStream &operator=(const CubeAsyncStream &) = delete;
+
+  /// Hand the handler what has arrived, as far as it asked for. Called
+  /// again from the handler's callbacks, it only updates the demand.
+  void Pump();
+
+  /// End the result with on_error(code, message) if it is still running
+  void Abort(int code, const std::string &message);
+
+  /// Whether the handler has been released
+  bool finished() const { return finished_.load(); }
+
+private:
+  void Request(int64_t n);
+  void Cancel();
+  // Stop reading the result and release the handler
+  void Finish();
+  void Fail(int code, const char *message);
+
+  mutable std::recursive_mutex mutex_;
+  nanoarrow::UniqueArrayStream stream_;
+  struct ArrowAsyncDeviceStreamHandler *handler_; // Null once released
+  struct ArrowAsyncProducer producer_;
+  ReadyFn ready_;
+  int64_t demand_ = 0; // Batches asked for but not handed over
+  bool schema_sent_ = false;
+  bool pumping_ = false;
+  bool cancelled_ = false;
+  std::atomic<bool> finished_{false}; // handler_ released; read unlocked
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,195 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/batch_queue.h"
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+
+namespace adbc::cube {
+
+namespace {
+
+uint64_t RoundUpToPowerOfTwo(size_t n) {
+  uint64_t capacity = 1;
+  while (capacity < n) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+// Tell the core this is a spin-wait loop
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+} // namespace
+
+CubeBatchQueue::CubeBatchQueue(size_t capacity, size_t max_bytes)
+    : mask_(RoundUpToPowerOfTwo(std::max<size_t>(capacity, 1)) - 1),
+      max_bytes_(max_bytes), slots_(new Slot[mask_ + 1]) {}
+
+CubeBatchQueue::~CubeBatchQueue() {
+  struct ArrowArray array;
+  while (TryPop(&array)) {
+    ArrowArrayRelease(&array);
+  }
+}
+
+bool CubeBatchQueue::HasRoom(uint64_t tail) const {
+  uint64_t head = head_.load(std::memory_order_acquire);
+  return tail - head <= mask_ &&
+         (tail == head || bytes_.load(std::memory_order_relaxed) < max_bytes_);
+}
+
+bool CubeBatchQueue::WaitForRoom(std::chrono::nanoseconds timeout) {
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  for (int i = 0; i < kSpins; i++) {
+    if (HasRoom(tail) || closed()) {
+      return HasRoom(tail);
+    }
+    CpuRelax();
+  }
+  Park(&producer_parked_, timeout);
+  return HasRoom(tail);
+}
+
+bool CubeBatchQueue::TryPush(struct ArrowArray *array, size_t bytes) {
+  const uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (!HasRoom(tail)) {
+    return false;
+  }
+  Slot &slot = slots_[tail & mask_];
+  ArrowArrayMove(array, &slot.array);
+  slot.bytes = bytes;
+  bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  tail_.store(tail + 1, std::memory_order_release);
+  Unpark(&consumer_parked_);
+  return true;
+}
+
+bool CubeBatchQueue::TryPop(struct ArrowArray *out) {
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head == tail_.load(std::memory_order_acquire)) {
+    return false;
+  }
+  Slot &slot = slots_[head & mask_];
+  ArrowArrayMove(&slot.array, out);
+  bytes_.fetch_sub(slot.bytes, std::memory_order_relaxed);
+  head_.store(head + 1, std::memory_order_release);
+  Unpark(&producer_parked_);
+  return true;
+}
+
+bool CubeBatchQueue::Pop(struct ArrowArray *out) {
+  while (true) {
+    if (TryPop(out)) {
+      return true;
+    }
+    if (closed()) {
+      // A batch pushed just before the queue was closed
+      return TryPop(out);
+    }
+    bool arrived = false;
+    for (int i = 0; i < kSpins && !(arrived = ready()); i++) {
+      CpuRelax();
+    }
+    if (!arrived) {
+      Park(&consumer_parked_, std::chrono::nanoseconds::max());
+    }
+  }
+}
+
+bool CubeBatchQueue::ready() const {
+  return head_.load(std::memory_order_relaxed) !=
+             tail_.load(std::memory_order_acquire) ||
+         closed();
+}
+
+void CubeBatchQueue::Close() {
+  closed_.store(true, std::memory_order_release);
+  Unpark(&consumer_parked_);
+  Unpark(&producer_parked_);
+}
+
+void CubeBatchQueue::Park(std::atomic<uint32_t> *word,
+                          std::chrono::nanoseconds timeout) {
+  word->store(1, std::memory_order_relaxed);
+  // Pairs with the fence in Unpark: either the other side sees the flag,
+  // or this side sees what the other side published before it looked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool consumer = word == &consumer_parked_;
+  if (consumer ? ready()
+               : HasRoom(tail_.load(std::memory_order_relaxed)) || closed()) {
+    word->store(0, std::memory_order_relaxed);
+    return;
+  }
+#if defined(__linux__)
+  struct timespec relative;
+  struct timespec *limit = nullptr;
+  if (timeout != std::chrono::nanoseconds::max()) {
+    relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+    relative.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    limit = &relative;
+  }
+  // Returns at once if the other side cleared the flag already; a spurious
+  // wakeup only makes the caller check again
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+          FUTEX_WAIT_PRIVATE, 1, limit, nullptr, 0);
+#else
+  std::unique_lock<std::mutex> lock(park_mutex_);
+  auto unparked = [word] {
+    return word->load(std::memory_order_relaxed) == 0;
+  };
+  if (timeout == std::chrono::nanoseconds::max()) {
+    park_cv_.wait(lock, unparked);
+  } else {
+    park_cv_.wait_for(lock, timeout, unparked);
+  }
+#endif
+  word->store(0, std::memory_order_relaxed);
+}
+
+void CubeBatchQueue::Unpark(std::atomic<uint32_t> *word) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (word->load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+#if defined(__linux__)
+  word->store(0, std::memory_order_relaxed);
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE,
+          1, nullptr, nullptr, 0);
+#else
+  {
+    std::lock_guard<std::mutex> lock(park_mutex_);
+    word->store(0, std::memory_order_relaxed);
+  }
+  park_cv_.notify_all();
+#endif
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,118 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#if !defined(__linux__)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include <nanoarrow/nanoarrow.h>
+
+namespace adbc::cube {
+
+// Bounded queue of decoded batches from one producer thread to one
+// consumer thread, without locks: each side owns one index of a ring of
+// slots and publishes it with a release store. A side that has to wait
+// spins briefly, then parks on a futex (a condition variable off Linux)
+// that the other side wakes only when it sees it parked, so a handoff
+// that does not wait makes no system call.
+class CubeBatchQueue {
+public:
+  // Room for up to capacity batches (rounded up to a power of two), and for
+  // one more only while those queued take less than max_bytes
+  CubeBatchQueue(size_t capacity, size_t max_bytes);
+  // Releases the batches still queued
+  ~CubeBatchQueue();
+
+  CubeBatchQueue(const CubeBatchQueue &) = delete;
+  CubeBatchQueue &operator=(const CubeBatchQueue &) = delete;
+
+  // Producer: wait until a batch can be pushed, the queue is closed, or
+  // timeout has passed
+  // @return Whether a batch can be pushed
+  bool WaitForRoom(std::chrono::nanoseconds timeout);
+
+  // Producer: queue array (moved from), of bytes bytes. A push is only
+  // refused when there is no room; a closed queue still takes batches.
+  bool TryPush(struct ArrowArray *array, size_t bytes);
+
+  // Consumer: take the oldest batch, waiting for one unless the queue is
+  // closed
+  // @return false (out untouched) once the queue is closed and empty
+  bool Pop(struct ArrowArray *out);
+
+  // Consumer: take the oldest batch if there is one, without waiting
+  bool TryPop(struct ArrowArray *out);
+
+  // Either side: stop waiting. The consumer still gets the batches queued.
+  void Close();
+
+  // Whether Pop would return without waiting
+  bool ready() const;
+
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  // Bytes of the batches queued, as seen by the calling side
+  size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    struct ArrowArray array;
+    size_t bytes;
+  };
+
+  bool HasRoom(uint64_t tail) const;
+  // Park on word while it holds 1 and ready() (for the consumer) or
+  // HasRoom() (for the producer) has not become true
+  void Park(std::atomic<uint32_t> *word, std::chrono::nanoseconds timeout);
+  void Unpark(std::atomic<uint32_t> *word);
+
+  static constexpr size_t kCacheLine = 64;
+  // Iterations to spin before parking; a batch decoded on the other side
+  // usually arrives well within them
+  static constexpr int kSpins = 256;
+
+  const uint64_t mask_;
+  const size_t max_bytes_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Written by the consumer: the next slot to pop
+  alignas(kCacheLine) std::atomic<uint64_t> head_{0};
+  // Set while the consumer is parked
+  std::atomic<uint32_t> consumer_parked_{0};
+  // Written by the producer: the next slot to push
+  alignas(kCacheLine) std::atomic<uint64_t> tail_{0};
+  // Set while the producer is parked
+  std::atomic<uint32_t> producer_parked_{0};
+  // Written by both sides
+  alignas(kCacheLine) std::atomic<size_t> bytes_{0};
+  std::atomic<bool> closed_{false};
+#if !defined(__linux__)
+  std::mutex park_mutex_;
+  std::condition_variable park_cv_;
+#endif
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,207 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of CubeBatchQueue: its bounds on count and bytes, closing, and a
+// producer and consumer handing off many batches while each side keeps
+// having to park for the other.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/batch_queue.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// A batch carrying only its sequence number (as its length), that counts
+// its release in *released
+struct ArrowArray MakeBatch(int64_t sequence, std::atomic<int64_t> *released) {
+  struct ArrowArray array = {};
+  array.length = sequence;
+  array.private_data = released;
+  array.release = [](struct ArrowArray *array) {
+    static_cast<std::atomic<int64_t> *>(array->private_data)->fetch_add(1);
+    array->release = nullptr;
+  };
+  return array;
+}
+
+// Pop the next batch, checking its sequence number, and release it
+void ExpectPop(CubeBatchQueue *queue, int64_t sequence) {
+  struct ArrowArray array;
+  ASSERT_TRUE(queue->TryPop(&array));
+  EXPECT_EQ(array.length, sequence);
+  ArrowArrayRelease(&array);
+}
+
+} // namespace
+
+TEST(CubeBatchQueueTest, BoundedByCount) {
+  std::atomic<int64_t> released{0};
+  // Three rounds up to four slots
+  CubeBatchQueue queue(3, 1 << 20);
+  for (int64_t i = 0; i < 4; i++) {
+    struct ArrowArray array = MakeBatch(i, &released);
+    ASSERT_TRUE(queue.TryPush(&array, 1));
+    EXPECT_EQ(array.release, nullptr);
+  }
+  struct ArrowArray array = MakeBatch(4, &released);
+  EXPECT_FALSE(queue.TryPush(&array, 1));
+  EXPECT_FALSE(queue.WaitForRoom(std::chrono::milliseconds(1)));
+  EXPECT_EQ(queue.bytes(), 4u);
+
+  ExpectPop(&queue, 0);
+  EXPECT_TRUE(queue.WaitForRoom(std::chrono::milliseconds(1)));
+  ASSERT_TRUE(queue.TryPush(&array, 1));
+  for (int64_t i = 1; i <= 4; i++) {
+    ExpectPop(&queue, i);
+  }
+  EXPECT_FALSE(queue.TryPop(&array));
+  EXPECT_EQ(queue.bytes(), 0u);
+  EXPECT_EQ(released.load(), 5);
+}
+
+TEST(CubeBatchQueueTest, BoundedByBytes) {
+  std::atomic<int64_t> released{0};
+  CubeBatchQueue queue(16, 100);
+  // A batch over the budget still goes into an empty queue
+  struct ArrowArray array = MakeBatch(0, &released);
+  ASSERT_TRUE(queue.TryPush(&array, 500));
+  array = MakeBatch(1, &released);
+  EXPECT_FALSE(queue.TryPush(&array, 10));
+  ExpectPop(&queue, 0);
+
+  // Then one more while those queued take less than the budget
+  ASSERT_TRUE(queue.TryPush(&array, 60));
+  array = MakeBatch(2, &released);
+  ASSERT_TRUE(queue.TryPush(&array, 60));
+  array = MakeBatch(3, &released);
+  EXPECT_FALSE(queue.TryPush(&array, 1));
+  ExpectPop(&queue, 1);
+  EXPECT_TRUE(queue.TryPush(&array, 1));
+  EXPECT_EQ(queue.bytes(), 61u);
+}
+
+TEST(CubeBatchQueueTest, Close) {
+  std::atomic<int64_t> released{0};
+  {
+    CubeBatchQueue queue(2, 1 << 20);
+    struct ArrowArray array = MakeBatch(0, &released);
+    ASSERT_TRUE(queue.TryPush(&array, 1));
+
+    // A consumer parked on an empty queue is woken by Close
+    ExpectPop(&queue, 0);
+    std::thread consumer([&] {
+      struct ArrowArray out;
+      EXPECT_FALSE(queue.Pop(&out));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Close();
+    consumer.join();
+    EXPECT_TRUE(queue.closed());
+    EXPECT_TRUE(queue.ready());
+
+    // A closed queue still takes batches, and Pop returns them first
+    array = MakeBatch(1, &released);
+    ASSERT_TRUE(queue.TryPush(&array, 1));
+    array = MakeBatch(2, &released);
+    ASSERT_TRUE(queue.TryPush(&array, 1));
+    struct ArrowArray out;
+    ASSERT_TRUE(queue.Pop(&out));
+    EXPECT_EQ(out.length, 1);
+    ArrowArrayRelease(&out);
+
+    // The producer is not kept waiting once closed
+    array = MakeBatch(3, &released);
+    ASSERT_TRUE(queue.TryPush(&array, 1));
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(queue.WaitForRoom(std::chrono::seconds(10)));
+    EXPECT_LT(std::chrono::steady_clock::now() - start,
+              std::chrono::seconds(5));
+    EXPECT_EQ(released.load(), 2);
+  }
+  // The destructor releases the batches still queued
+  EXPECT_EQ(released.load(), 4);
+}
+
+TEST(CubeBatchQueueTest, WaitForRoomTimesOut) {
+  std::atomic<int64_t> released{0};
+  CubeBatchQueue queue(1, 1 << 20);
+  struct ArrowArray array = MakeBatch(0, &released);
+  ASSERT_TRUE(queue.TryPush(&array, 1));
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_FALSE(queue.WaitForRoom(std::chrono::milliseconds(20)));
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(20));
+}
+
+// A producer and a consumer on threads of their own, each pausing now and
+// then so that the other side fills or drains the queue and parks. Every
+// batch must arrive once, in order, and be released once.
+class CubeBatchQueueStressTest : public ::testing::TestWithParam<size_t> {};
+
+TEST_P(CubeBatchQueueStressTest, HandsOffInOrder) {
+  constexpr int64_t kBatches = 200000;
+  constexpr int64_t kPauseEvery = 4096;
+  std::atomic<int64_t> released{0};
+  CubeBatchQueue queue(GetParam(), 64);
+
+  std::thread producer([&] {
+    for (int64_t i = 0; i < kBatches; i++) {
+      if (i % kPauseEvery == kPauseEvery / 2) {
+        // The consumer runs dry and parks
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      struct ArrowArray array = MakeBatch(i, &released);
+      while (!queue.WaitForRoom(std::chrono::milliseconds(100))) {
+      }
+      EXPECT_TRUE(queue.TryPush(&array, 8));
+    }
+    queue.Close();
+  });
+
+  int64_t expected = 0;
+  int64_t out_of_order = 0;
+  struct ArrowArray array;
+  while (queue.Pop(&array)) {
+    if (expected % kPauseEvery == 0) {
+      // The producer fills the queue and parks
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    out_of_order += array.length != expected;
+    ArrowArrayRelease(&array);
+    expected++;
+  }
+  producer.join();
+  EXPECT_EQ(expected, kBatches);
+  EXPECT_EQ(out_of_order, 0);
+  EXPECT_EQ(released.load(), kBatches);
+  EXPECT_EQ(queue.bytes(), 0u);
+}
+
+// One slot, a few, and more than the byte budget lets fill
+INSTANTIATE_TEST_SUITE_P(Capacities, CubeBatchQueueStressTest,
+                         ::testing::Values(1, 4, 256));
+
+} // namespace adbc::cube
@@ -0,0 +1,329 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/batch_statistics.h"
+
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/buffer_kernels.h"
+#include "driver/cube/string_dictionary.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// Bits of the linear counting bitmap; estimates stay within a few percent
+// until about this many values are distinct
+constexpr uint64_t kDistinctBits = 8192;
+
+class DistinctEstimate {
+public:
+  void Add(uint64_t hash) {
+    uint64_t bit = hash & (kDistinctBits - 1);
+    words_[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+
+  // Never more than values, the non-null values added
+  int64_t Estimate(int64_t values) const {
+    int64_t zeros = 0;
+    for (uint64_t word : words_) {
+      zeros += 64 - __builtin_popcountll(word);
+    }
+    if (zeros == 0) {
+      return values; // Saturated; values is the only bound left
+    }
+    double m = static_cast<double>(kDistinctBits);
+    auto estimate =
+        static_cast<int64_t>(std::llround(m * std::log(m / zeros)));
+    return std::min(estimate, values);
+  }
+
+private:
+  uint64_t words_[kDistinctBits / 64] = {};
+};
+
+bool IsValid(const struct ArrowArrayView &column, int64_t i) {
+  return column.null_count == 0 || !ArrowArrayViewIsNull(&column, i);
+}
+
+// Bounds of int32 or int64 storage: the kernel when there are no nulls
+template <typename T>
+void IntBounds(const struct ArrowArrayView &column, const T *values,
+               CubeColumnStatistics *out, DistinctEstimate *distinct) {
+  int64_t length = column.length;
+  T min = 0;
+  T max = 0;
+  bool any = false;
+  if (column.null_count == 0) {
+    if constexpr (sizeof(T) == 4) {
+      MinMaxInt32(values, length, &min, &max);
+    } else {
+      MinMaxInt64(values, length, &min, &max);
+    }
+    any = true;
+    for (int64_t i = 0; i < length; i++) {
+      distinct->Add(HashValueBits(static_cast<uint64_t>(values[i])));
+    }
+  } else {
+    for (int64_t i = 0; i < length; i++) {
+      if (!IsValid(column, i)) {
+        continue;
+      }
+      T value = values[i];
+      min = any && min < value ? min : value;
+      max = any && max > value ? max : value;
+      any = true;
+      distinct->Add(HashValueBits(static_cast<uint64_t>(value)));
+    }
+  }
+  if (any) {
+    out->min = static_cast<int64_t>(min);
+    out->max = static_cast<int64_t>(max);
+  }
+}
+
+void NarrowIntBounds(const struct ArrowArrayView &column, bool is_unsigned,
+                     CubeColumnStatistics *out, DistinctEstimate *distinct) {
+  int64_t min = 0;
+  int64_t max = 0;
+  bool any = false;
+  for (int64_t i = 0; i < column.length; i++) {
+    if (!IsValid(column, i)) {
+      continue;
+    }
+    int64_t value;
+    if (is_unsigned) {
+      uint64_t unsigned_value = ArrowArrayViewGetUIntUnsafe(&column, i);
+      if (unsigned_value > static_cast<uint64_t>(INT64_MAX)) {
+        return; // A uint64 past int64 has no bound here
+      }
+      value = static_cast<int64_t>(unsigned_value);
+    } else {
+      value = ArrowArrayViewGetIntUnsafe(&column, i);
+    }
+    min = any && min < value ? min : value;
+    max = any && max > value ? max : value;
+    any = true;
+    distinct->Add(HashValueBits(static_cast<uint64_t>(value)));
+  }
+  if (any) {
+    out->min = min;
+    out->max = max;
+  }
+}
+
+void DoubleBounds(const struct ArrowArrayView &column,
+                  CubeColumnStatistics *out, DistinctEstimate *distinct) {
+  double min = 0;
+  double max = 0;
+  bool any = false;
+  for (int64_t i = 0; i < column.length; i++) {
+    if (!IsValid(column, i)) {
+      continue;
+    }
+    double value = ArrowArrayViewGetDoubleUnsafe(&column, i);
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    distinct->Add(HashValueBits(bits));
+    if (std::isnan(value)) {
+      continue;
+    }
+    min = any && min < value ? min : value;
+    max = any && max > value ? max : value;
+    any = true;
+  }
+  if (any) {
+    out->min = min;
+    out->max = max;
+  }
+}
+
+void StringBounds(const struct ArrowArrayView &column,
+                  CubeColumnStatistics *out, DistinctEstimate *distinct) {
+  std::string_view min;
+  std::string_view max;
+  bool any = false;
+  for (int64_t i = 0; i < column.length; i++) {
+    if (!IsValid(column, i)) {
+      continue;
+    }
+    struct ArrowStringView view = ArrowArrayViewGetStringUnsafe(&column, i);
+    std::string_view value(view.data, static_cast<size_t>(view.size_bytes));
+    distinct->Add(HashValueBytes(reinterpret_cast<const uint8_t *>(view.data),
+                                 view.size_bytes));
+    min = any && min < value ? min : value;
+    max = any && max > value ? max : value;
+    any = true;
+  }
+  if (any) {
+    out->min = std::string(min);
+    out->max = std::string(max);
+  }
+}
+
+// Stream computing the statistics of each batch of another as it is
+// returned
+class StatisticsStream {
+public:
+  StatisticsStream(std::shared_ptr<CubeBatchStatistics> statistics,
+                   struct ArrowArrayStream *source)
+      : statistics_(std::move(statistics)) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    int status = source_->get_schema(source_.get(), schema);
+    return status == NANOARROW_OK ? status : SourceError(status);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    int status = source_->get_next(source_.get(), out);
+    if (status != NANOARROW_OK) {
+      return SourceError(status);
+    }
+    if (!out->release) {
+      return NANOARROW_OK;
+    }
+    struct ArrowError error;
+    if (!view_ready_) {
+      nanoarrow::UniqueSchema schema;
+      status = source_->get_schema(source_.get(), schema.get());
+      if (status != NANOARROW_OK) {
+        ArrowArrayRelease(out);
+        return SourceError(status);
+      }
+      status = ArrowArrayViewInitFromSchema(view_.get(), schema.get(), &error);
+      if (status != NANOARROW_OK) {
+        ArrowArrayRelease(out);
+        last_error_ = error.message;
+        return status;
+      }
+      view_ready_ = true;
+    }
+    status = ArrowArrayViewSetArray(view_.get(), out, &error);
+    if (status != NANOARROW_OK) {
+      ArrowArrayRelease(out);
+      last_error_ = error.message;
+      return status;
+    }
+    std::vector<CubeColumnStatistics> columns(view_->n_children);
+    for (int64_t i = 0; i < view_->n_children; i++) {
+      ComputeColumnStatistics(*view_->children[i], &columns[i]);
+    }
+    statistics_->Set(out->length, std::move(columns));
+    return NANOARROW_OK;
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<StatisticsStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<StatisticsStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<StatisticsStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<StatisticsStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  int SourceError(int status) {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  std::shared_ptr<CubeBatchStatistics> statistics_;
+  nanoarrow::UniqueArrayStream source_;
+  nanoarrow::UniqueArrayView view_; // Of the schema, set to each batch
+  bool view_ready_ = false;
+  std::string last_error_;
+};
+
+} // namespace
+
+void ComputeColumnStatistics(const struct ArrowArrayView &column,
+                             CubeColumnStatistics *out) {
+  *out = CubeColumnStatistics();
+  out->null_count = column.null_count >= 0
+                        ? column.null_count
+                        : ArrowArrayViewComputeNullCount(&column);
+  if (column.dictionary || column.length == out->null_count) {
+    return;
+  }
+  // null_count is known past here, so IsValid can trust it
+  struct ArrowArrayView counted = column;
+  counted.null_count = out->null_count;
+  DistinctEstimate distinct;
+  switch (column.storage_type) {
+  case NANOARROW_TYPE_INT32:
+    IntBounds(counted, column.buffer_views[1].data.as_int32 + column.offset,
+              out, &distinct);
+    break;
+  case NANOARROW_TYPE_INT64:
+    IntBounds(counted, column.buffer_views[1].data.as_int64 + column.offset,
+              out, &distinct);
+    break;
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+    NarrowIntBounds(counted, /*is_unsigned=*/false, out, &distinct);
+    break;
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+    NarrowIntBounds(counted, /*is_unsigned=*/true, out, &distinct);
+    break;
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE:
+    DoubleBounds(counted, out, &distinct);
+    break;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+    StringBounds(counted, out, &distinct);
+    break;
+  default:
+    return;
+  }
+  out->distinct_count = distinct.Estimate(column.length - out->null_count);
+}
+
+void BatchStatisticsArrayStream(std::shared_ptr<CubeBatchStatistics> statistics,
+                                struct ArrowArrayStream *stream) {
+  auto wrapped = new StatisticsStream(std::move(statistics), stream);
+  wrapped->ExportTo(stream);
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,99 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.h>
+
+namespace adbc::cube {
+
+/// Smallest or largest value of a column: signed integers and temporal
+/// values as int64, floating point as double, strings as their bytes;
+/// monostate when the column has none or its type is not ordered here
+using CubeStatisticValue = std::variant<std::monostate, int64_t, double,
+                                        std::string>;
+
+/// What one column of one batch holds, for skipping or pruning batches
+/// without reading them again
+struct CubeColumnStatistics {
+  int64_t null_count = 0;
+  CubeStatisticValue min;
+  CubeStatisticValue max;
+  /// Distinct non-null values, estimated from a bitmap of their hashes
+  /// (linear counting; within a few percent up to about 10000); -1 when
+  /// not estimated, as for nested and dictionary columns
+  int64_t distinct_count = -1;
+};
+
+/// Compute the statistics of a top-level column. NaN is left out of the
+/// bounds of floating point columns; nested, dictionary, boolean, decimal
+/// and binary columns only get their null count.
+void ComputeColumnStatistics(const struct ArrowArrayView &column,
+                             CubeColumnStatistics *out);
+
+/// Statistics of the batch a stream returned last
+/// (adbc.cube.batch_statistics). Thread-safe.
+class CubeBatchStatistics {
+public:
+  void Set(int64_t rows, std::vector<CubeColumnStatistics> columns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_++;
+    rows_ = rows;
+    columns_ = std::move(columns);
+  }
+
+  /// Batches returned so far
+  int64_t batches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+  /// Rows of the last batch; -1 before the first
+  int64_t rows() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rows_;
+  }
+  /// Statistics of column i of the last batch
+  /// @return false before the first batch, or if there is no column i
+  bool column(size_t i, CubeColumnStatistics *out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (i >= columns_.size()) {
+      return false;
+    }
+    *out = columns_[i];
+    return true;
+  }
+
+private:
+  mutable std::mutex mutex_;
+  int64_t batches_ = 0;
+  int64_t rows_ = -1;
+  std::vector<CubeColumnStatistics> columns_;
+};
+
+/// Replace stream with one computing the statistics of each batch into
+/// statistics as the batch is returned
+void BatchStatisticsArrayStream(std::shared_ptr<CubeBatchStatistics> statistics,
+                                struct ArrowArrayStream *stream);
+
+} // namespace adbc::cube
@@ -0,0 +1,458 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/buffer_kernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CUBE_KERNELS_AVX2 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CUBE_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace adbc::cube {
+
+namespace {
+
+// Shift whole bytes starting at byte i; in_bytes is how many source bytes
+// the copy may read
+void CopyBitmapTail(const uint8_t *src, int shift, int64_t i, int64_t n_bytes,
+                    int64_t in_bytes, uint8_t *dst) {
+  for (; i < n_bytes; i++) {
+    uint8_t hi = i + 1 < in_bytes ? src[i + 1] : 0;
+    dst[i] = static_cast<uint8_t>((src[i] >> shift) | (hi << (8 - shift)));
+  }
+}
+
+// Values outside [min, max] overflow when multiplied by factor
+struct ScaleBounds {
+  explicit ScaleBounds(int64_t factor)
+      : min(INT64_MIN / factor), max(INT64_MAX / factor) {}
+  int64_t min;
+  int64_t max;
+};
+
+bool ScaleInt64Scalar(const int64_t *src, int64_t i, int64_t length,
+                      int64_t factor, int64_t *dst) {
+  ScaleBounds bounds(factor);
+  bool ok = true;
+  for (; i < length; i++) {
+    int64_t value = src[i];
+    ok &= value >= bounds.min && value <= bounds.max;
+    dst[i] = static_cast<int64_t>(static_cast<uint64_t>(value) *
+                                  static_cast<uint64_t>(factor));
+  }
+  return ok;
+}
+
+void WidenScaleInt32Scalar(const int32_t *src, int64_t i, int64_t length,
+                           int64_t factor, int64_t *dst) {
+  for (; i < length; i++) {
+    dst[i] = static_cast<int64_t>(src[i]) * factor;
+  }
+}
+
+template <typename T>
+void MinMaxScalar(const T *src, int64_t i, int64_t length, T *min, T *max) {
+  for (; i < length; i++) {
+    *min = src[i] < *min ? src[i] : *min;
+    *max = src[i] > *max ? src[i] : *max;
+  }
+}
+
+template <typename T>
+void RebaseOffsetsScalar(const T *src, int64_t i, int64_t length, T base,
+                         T *dst) {
+  for (; i < length; i++) {
+    dst[i] = src[i] - base;
+  }
+}
+
+#if defined(CUBE_KERNELS_AVX2)
+
+bool HasAvx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+__attribute__((target("avx2"))) int64_t
+CopyBitmapAvx2(const uint8_t *src, int shift, int64_t n_bytes, int64_t in_bytes,
+               uint8_t *dst) {
+  const __m128i right = _mm_cvtsi32_si128(shift);
+  const __m128i left = _mm_cvtsi32_si128(8 - shift);
+  // 16-bit lane shifts move bits across bytes; the masks drop them
+  const __m256i low_mask = _mm256_set1_epi8(static_cast<char>(0xFF >> shift));
+  const __m256i high_mask =
+      _mm256_set1_epi8(static_cast<char>((0xFF << (8 - shift)) & 0xFF));
+  int64_t i = 0;
+  for (; i + 32 <= n_bytes && i + 33 <= in_bytes; i += 32) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 1));
+    __m256i out =
+        _mm256_or_si256(_mm256_and_si256(_mm256_srl_epi16(lo, right), low_mask),
+                        _mm256_and_si256(_mm256_sll_epi16(hi, left), high_mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), out);
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64_t
+RebaseOffsetsAvx2(const int32_t *src, int64_t length, int32_t base,
+                  int32_t *dst) {
+  const __m256i b = _mm256_set1_epi32(base);
+  int64_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_sub_epi32(v, b));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64_t
+RebaseOffsetsAvx2(const int64_t *src, int64_t length, int64_t base,
+                  int64_t *dst) {
+  const __m256i b = _mm256_set1_epi64x(base);
+  int64_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_sub_epi64(v, b));
+  }
+  return i;
+}
+
+// AVX2 has no 64-bit multiply: with factor below 2^32 the product is
+// lo32(x) * factor + (hi32(x) * factor << 32), modulo 2^64. Out-of-range
+// lanes are flagged by comparing against the bounds.
+__attribute__((target("avx2"))) int64_t
+ScaleInt64Avx2(const int64_t *src, int64_t length, int64_t factor,
+               int64_t *dst, bool *ok) {
+  ScaleBounds bounds(factor);
+  const __m256i f = _mm256_set1_epi64x(factor);
+  const __m256i min = _mm256_set1_epi64x(bounds.min);
+  const __m256i max = _mm256_set1_epi64x(bounds.max);
+  __m256i out_of_range = _mm256_setzero_si256();
+  int64_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    out_of_range = _mm256_or_si256(
+        out_of_range, _mm256_or_si256(_mm256_cmpgt_epi64(v, max),
+                                      _mm256_cmpgt_epi64(min, v)));
+    __m256i low = _mm256_mul_epu32(v, f);
+    __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), f);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+  }
+  *ok = _mm256_testz_si256(out_of_range, out_of_range);
+  return i;
+}
+
+__attribute__((target("avx2"))) int64_t
+WidenScaleInt32Avx2(const int32_t *src, int64_t length, int64_t factor,
+                    int64_t *dst) {
+  const __m256i f = _mm256_set1_epi64x(factor);
+  int64_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m256i v = _mm256_cvtepi32_epi64(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                        _mm256_mul_epi32(v, f));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64_t
+MinMaxInt32Avx2(const int32_t *src, int64_t length, int32_t *min,
+                int32_t *max) {
+  if (length < 8) {
+    return 0;
+  }
+  __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+  __m256i hi = lo;
+  int64_t i = 8;
+  for (; i + 8 <= length; i += 8) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    lo = _mm256_min_epi32(lo, v);
+    hi = _mm256_max_epi32(hi, v);
+  }
+  alignas(32) int32_t lanes[8];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), lo);
+  MinMaxScalar(lanes, 0, 8, min, max);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), hi);
+  MinMaxScalar(lanes, 0, 8, min, max);
+  return i;
+}
+
+// AVX2 has no 64-bit min or max; a compare picks the lanes to blend
+__attribute__((target("avx2"))) int64_t
+MinMaxInt64Avx2(const int64_t *src, int64_t length, int64_t *min,
+                int64_t *max) {
+  if (length < 4) {
+    return 0;
+  }
+  __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+  __m256i hi = lo;
+  int64_t i = 4;
+  for (; i + 4 <= length; i += 4) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    lo = _mm256_blendv_epi8(lo, v, _mm256_cmpgt_epi64(lo, v));
+    hi = _mm256_blendv_epi8(hi, v, _mm256_cmpgt_epi64(v, hi));
+  }
+  alignas(32) int64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), lo);
+  MinMaxScalar(lanes, 0, 4, min, max);
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), hi);
+  MinMaxScalar(lanes, 0, 4, min, max);
+  return i;
+}
+
+#elif defined(CUBE_KERNELS_NEON)
+
+int64_t MinMaxInt32Neon(const int32_t *src, int64_t length, int32_t *min,
+                        int32_t *max) {
+  if (length < 4) {
+    return 0;
+  }
+  int32x4_t lo = vld1q_s32(src);
+  int32x4_t hi = lo;
+  int64_t i = 4;
+  for (; i + 4 <= length; i += 4) {
+    int32x4_t v = vld1q_s32(src + i);
+    lo = vminq_s32(lo, v);
+    hi = vmaxq_s32(hi, v);
+  }
+  int32_t lanes_min = vminvq_s32(lo);
+  int32_t lanes_max = vmaxvq_s32(hi);
+  *min = lanes_min < *min ? lanes_min : *min;
+  *max = lanes_max > *max ? lanes_max : *max;
+  return i;
+}
+
+int64_t MinMaxInt64Neon(const int64_t *src, int64_t length, int64_t *min,
+                        int64_t *max) {
+  if (length < 2) {
+    return 0;
+  }
+  int64x2_t lo = vld1q_s64(src);
+  int64x2_t hi = lo;
+  int64_t i = 2;
+  for (; i + 2 <= length; i += 2) {
+    int64x2_t v = vld1q_s64(src + i);
+    lo = vbslq_s64(vcgtq_s64(lo, v), v, lo);
+    hi = vbslq_s64(vcgtq_s64(v, hi), v, hi);
+  }
+  int64_t lanes[2];
+  vst1q_s64(lanes, lo);
+  MinMaxScalar(lanes, 0, 2, min, max);
+  vst1q_s64(lanes, hi);
+  MinMaxScalar(lanes, 0, 2, min, max);
+  return i;
+}
+
+int64_t ScaleInt64Neon(const int64_t *src, int64_t length, int64_t factor,
+                       int64_t *dst, bool *ok) {
+  ScaleBounds bounds(factor);
+  const uint32x2_t f = vdup_n_u32(static_cast<uint32_t>(factor));
+  const int64x2_t min = vdupq_n_s64(bounds.min);
+  const int64x2_t max = vdupq_n_s64(bounds.max);
+  uint64x2_t out_of_range = vdupq_n_u64(0);
+  int64_t i = 0;
+  for (; i + 2 <= length; i += 2) {
+    int64x2_t v = vld1q_s64(src + i);
+    out_of_range = vorrq_u64(out_of_range, vorrq_u64(vcgtq_s64(v, max),
+                                                     vcltq_s64(v, min)));
+    uint64x2_t u = vreinterpretq_u64_s64(v);
+    uint64x2_t low = vmull_u32(vmovn_u64(u), f);
+    uint64x2_t high = vmull_u32(vshrn_n_u64(u, 32), f);
+    vst1q_s64(dst + i,
+              vreinterpretq_s64_u64(vaddq_u64(low, vshlq_n_u64(high, 32))));
+  }
+  *ok = vmaxvq_u32(vreinterpretq_u32_u64(out_of_range)) == 0;
+  return i;
+}
+
+int64_t WidenScaleInt32Neon(const int32_t *src, int64_t length, int64_t factor,
+                            int64_t *dst) {
+  const int32x2_t f = vdup_n_s32(static_cast<int32_t>(factor));
+  int64_t i = 0;
+  for (; i + 2 <= length; i += 2) {
+    vst1q_s64(dst + i, vmull_s32(vld1_s32(src + i), f));
+  }
+  return i;
+}
+
+int64_t CopyBitmapNeon(const uint8_t *src, int shift, int64_t n_bytes,
+                       int64_t in_bytes, uint8_t *dst) {
+  const int8x16_t right = vdupq_n_s8(static_cast<int8_t>(-shift));
+  const int8x16_t left = vdupq_n_s8(static_cast<int8_t>(8 - shift));
+  int64_t i = 0;
+  for (; i + 16 <= n_bytes && i + 17 <= in_bytes; i += 16) {
+    uint8x16_t lo = vld1q_u8(src + i);
+    uint8x16_t hi = vld1q_u8(src + i + 1);
+    vst1q_u8(dst + i, vorrq_u8(vshlq_u8(lo, right), vshlq_u8(hi, left)));
+  }
+  return i;
+}
+
+int64_t RebaseOffsetsNeon(const int32_t *src, int64_t length, int32_t base,
+                          int32_t *dst) {
+  const int32x4_t b = vdupq_n_s32(base);
+  int64_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    vst1q_s32(dst + i, vsubq_s32(vld1q_s32(src + i), b));
+  }
+  return i;
+}
+
+int64_t RebaseOffsetsNeon(const int64_t *src, int64_t length, int64_t base,
+                          int64_t *dst) {
+  const int64x2_t b = vdupq_n_s64(base);
+  int64_t i = 0;
+  for (; i + 2 <= length; i += 2) {
+    vst1q_s64(dst + i, vsubq_s64(vld1q_s64(src + i), b));
+  }
+  return i;
+}
+
+#endif
+
+template <typename T>
+void RebaseOffsetsImpl(const T *src, int64_t length, T base, T *dst) {
+  int64_t done = 0;
+#if defined(CUBE_KERNELS_AVX2)
+  if (HasAvx2()) {
+    done = RebaseOffsetsAvx2(src, length, base, dst);
+  }
+#elif defined(CUBE_KERNELS_NEON)
+  done = RebaseOffsetsNeon(src, length, base, dst);
+#endif
+  RebaseOffsetsScalar(src, done, length, base, dst);
+}
+
+} // namespace
+
+void CopyBitmap(const uint8_t *src, int64_t src_offset, int64_t length,
+                uint8_t *dst) {
+  int64_t n_bytes = (length + 7) / 8;
+  if (n_bytes == 0) {
+    return;
+  }
+  src += src_offset / 8;
+  int shift = static_cast<int>(src_offset % 8);
+  if (shift == 0) {
+    memcpy(dst, src, n_bytes);
+  } else {
+    // Source bytes holding bits [shift, shift + length)
+    int64_t in_bytes = (shift + length + 7) / 8;
+    int64_t done = 0;
+#if defined(CUBE_KERNELS_AVX2)
+    if (HasAvx2()) {
+      done = CopyBitmapAvx2(src, shift, n_bytes, in_bytes, dst);
+    }
+#elif defined(CUBE_KERNELS_NEON)
+    done = CopyBitmapNeon(src, shift, n_bytes, in_bytes, dst);
+#endif
+    CopyBitmapTail(src, shift, done, n_bytes, in_bytes, dst);
+  }
+  if (length % 8 != 0) {
+    dst[n_bytes - 1] &= static_cast<uint8_t>((1u << (length % 8)) - 1);
+  }
+}
+
+void RebaseOffsets(const int32_t *src, int64_t length, int32_t base,
+                   int32_t *dst) {
+  RebaseOffsetsImpl(src, length, base, dst);
+}
+
+void RebaseOffsets(const int64_t *src, int64_t length, int64_t base,
+                   int64_t *dst) {
+  RebaseOffsetsImpl(src, length, base, dst);
+}
+
+bool ScaleInt64(const int64_t *src, int64_t length, int64_t factor,
+                int64_t *dst) {
+  int64_t done = 0;
+  bool ok = true;
+#if defined(CUBE_KERNELS_AVX2)
+  if (HasAvx2()) {
+    done = ScaleInt64Avx2(src, length, factor, dst, &ok);
+  }
+#elif defined(CUBE_KERNELS_NEON)
+  done = ScaleInt64Neon(src, length, factor, dst, &ok);
+#endif
+  return ScaleInt64Scalar(src, done, length, factor, dst) && ok;
+}
+
+void WidenScaleInt32(const int32_t *src, int64_t length, int64_t factor,
+                     int64_t *dst) {
+  int64_t done = 0;
+#if defined(CUBE_KERNELS_AVX2)
+  if (HasAvx2()) {
+    done = WidenScaleInt32Avx2(src, length, factor, dst);
+  }
+#elif defined(CUBE_KERNELS_NEON)
+  done = WidenScaleInt32Neon(src, length, factor, dst);
+#endif
+  WidenScaleInt32Scalar(src, done, length, factor, dst);
+}
+
+void MinMaxInt32(const int32_t *src, int64_t length, int32_t *min,
+                 int32_t *max) {
+  *min = src[0];
+  *max = src[0];
+  int64_t done = 0;
+#if defined(CUBE_KERNELS_AVX2)
+  if (HasAvx2()) {
+    done = MinMaxInt32Avx2(src, length, min, max);
+  }
+#elif defined(CUBE_KERNELS_NEON)
+  done = MinMaxInt32Neon(src, length, min, max);
+#endif
+  MinMaxScalar(src, done, length, min, max);
+}
+
+void MinMaxInt64(const int64_t *src, int64_t length, int64_t *min,
+                 int64_t *max) {
+  *min = src[0];
+  *max = src[0];
+  int64_t done = 0;
+#if defined(CUBE_KERNELS_AVX2)
+  if (HasAvx2()) {
+    done = MinMaxInt64Avx2(src, length, min, max);
+  }
+#elif defined(CUBE_KERNELS_NEON)
+  done = MinMaxInt64Neon(src, length, min, max);
+#endif
+  MinMaxScalar(src, done, length, min, max);
+}
+
+const char *BufferKernelsImplementation() {
+#if defined(CUBE_KERNELS_AVX2)
+  return HasAvx2() ? "avx2" : "scalar";
+#elif defined(CUBE_KERNELS_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,69 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+
+namespace adbc::cube {
+
+/// Kernels for the buffer conversions the reader cannot avoid when a column
+/// is copied rather than shared with the IPC body, and for the statistics
+/// kept of batches as they are returned. Each one picks an AVX2
+/// (x86-64, checked at runtime) or NEON (AArch64) implementation when
+/// available and falls back to portable code otherwise.
+
+/// Copy length bits of a bitmap starting at bit src_offset into dst,
+/// starting at bit 0. dst must hold (length + 7) / 8 bytes; trailing bits of
+/// its last byte are zeroed.
+void CopyBitmap(const uint8_t *src, int64_t src_offset, int64_t length,
+                uint8_t *dst);
+
+/// Write src[i] - base for i in [0, length) to dst (src and dst may be the
+/// same). Used to make offsets start at zero when only the referenced part
+/// of a data buffer is copied.
+void RebaseOffsets(const int32_t *src, int64_t length, int32_t base,
+                   int32_t *dst);
+void RebaseOffsets(const int64_t *src, int64_t length, int64_t base,
+                   int64_t *dst);
+
+/// Write src[i] * factor for i in [0, length) to dst (src and dst may be
+/// the same), for converting timestamps to a finer unit. factor must be in
+/// [1, 2^32). Returns false if any product overflowed int64; dst then holds
+/// the wrapped products, and the caller decides whether the values that
+/// overflowed matter (null slots hold anything).
+bool ScaleInt64(const int64_t *src, int64_t length, int64_t factor,
+                int64_t *dst);
+
+/// Write src[i] * factor, widened to 64 bits, to dst, for converting
+/// 32-bit dates to 64-bit ones. factor must be in [1, 2^31), so no product
+/// overflows.
+void WidenScaleInt32(const int32_t *src, int64_t length, int64_t factor,
+                     int64_t *dst);
+
+/// Smallest and largest of src[0] .. src[length - 1], for batch
+/// statistics. length must be at least 1.
+void MinMaxInt32(const int32_t *src, int64_t length, int32_t *min,
+                 int32_t *max);
+void MinMaxInt64(const int64_t *src, int64_t length, int64_t *min,
+                 int64_t *max);
+
+/// Name of the implementation the kernels dispatch to ("avx2", "neon" or
+/// "scalar")
+const char *BufferKernelsImplementation();
+
+} // namespace adbc::cube
@@ -0,0 +1,357 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/buffer_pool.h"
+
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr int kMinClassShift = 6; // 64 bytes
+constexpr size_t kHugePageBytes = size_t(2) << 20;
+constexpr size_t kIpcAlignment = 64;
+
+// Smallest class holding size bytes
+int SizeClass(int64_t size) {
+  int size_class = 0;
+  while (size_class < 63 - kMinClassShift &&
+         (int64_t(1) << (size_class + kMinClassShift)) < size) {
+    size_class++;
+  }
+  return size_class;
+}
+
+size_t ClassBytes(int size_class) {
+  return size_t(1) << (size_class + kMinClassShift);
+}
+
+// Blocks this large are bound to a node page by page; smaller ones share
+// pages with other allocations
+constexpr size_t kNumaMinBytes = size_t(64) << 10;
+constexpr size_t kPageBytes = 4096;
+
+#if defined(__linux__) && defined(SYS_getcpu) && defined(SYS_mbind) && \
+    defined(SYS_get_mempolicy)
+constexpr int kMpolPreferred = 1;
+constexpr unsigned kMpolFNode = 1;
+constexpr unsigned kMpolFAddr = 2;
+
+// NUMA node of the CPU the calling thread runs on, 0 if unknown
+int CurrentNode() {
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    return 0;
+  }
+  return static_cast<int>(node);
+}
+
+// Prefer the calling thread's node for the pages of block, which must not
+// have been touched yet
+void BindToCurrentNode(void *block, size_t bytes) {
+  int node = CurrentNode();
+  if (node >= 63) {
+    return;
+  }
+  unsigned long mask = 1UL << node;
+  syscall(SYS_mbind, block, bytes, kMpolPreferred, &mask, sizeof(mask) * 8,
+          0);
+}
+
+// Node holding the first page of block, or -1 if unknown
+int NodeOf(const void *block) {
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0, block,
+              kMpolFNode | kMpolFAddr) != 0) {
+    return -1;
+  }
+  return node;
+}
+#else
+int CurrentNode() { return 0; }
+void BindToCurrentNode(void *, size_t) {}
+int NodeOf(const void *) { return -1; }
+#endif
+
+// Blocks of registered allocators, by address, and the one new blocks
+// come from
+struct AllocatorRegistry {
+  struct Block {
+    size_t bytes;
+    std::shared_ptr<const AdbcCubeAllocator> allocator;
+  };
+
+  std::mutex mutex;
+  std::shared_ptr<const AdbcCubeAllocator> current;
+  std::map<uintptr_t, Block> blocks;
+  // Lets malloc'd blocks skip the mutex when no allocator is involved
+  std::atomic<bool> active{false};
+  std::atomic<int64_t> live{0};
+};
+
+// Never destroyed, so that blocks freed during exit are still found
+AllocatorRegistry &Registry() {
+  static auto *registry = new AllocatorRegistry();
+  return *registry;
+}
+
+uint8_t *ReallocateBlock(struct ArrowBufferAllocator *, uint8_t *ptr,
+                         int64_t old_size, int64_t new_size) {
+  size_t bytes = (static_cast<size_t>(new_size) + 63) & ~size_t(63);
+  auto *block = static_cast<uint8_t *>(CubeAllocateBlock(bytes));
+  if (block != nullptr && ptr != nullptr) {
+    std::memcpy(block, ptr,
+                static_cast<size_t>(old_size < new_size ? old_size : new_size));
+  }
+  if (block != nullptr || new_size == 0) {
+    CubeFreeBlock(ptr);
+  }
+  return block;
+}
+
+void FreeBlock(struct ArrowBufferAllocator *, uint8_t *ptr, int64_t) {
+  CubeFreeBlock(ptr);
+}
+
+} // namespace
+
+CubeMemoryPlacement &CubeMemoryPlacement::Global() {
+  static CubeMemoryPlacement placement;
+  return placement;
+}
+
+void *CubeAllocateBlock(size_t bytes) {
+  auto &registry = Registry();
+  if (registry.active.load(std::memory_order_acquire)) {
+    auto allocator = CubeCurrentAllocator();
+    if (allocator) {
+      void *block =
+          allocator->allocate(allocator->user_data, bytes, kIpcAlignment);
+      if (block != nullptr) {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.blocks[reinterpret_cast<uintptr_t>(block)] = {
+            bytes, std::move(allocator)};
+        registry.live.fetch_add(1, std::memory_order_relaxed);
+      }
+      return block;
+    }
+  }
+  const auto &placement = CubeMemoryPlacement::Global();
+  size_t huge_min =
+      placement.huge_page_min_bytes.load(std::memory_order_relaxed);
+  bool huge = huge_min > 0 && bytes >= huge_min && bytes >= kHugePageBytes;
+  bool numa = bytes >= kNumaMinBytes &&
+              placement.numa_local.load(std::memory_order_relaxed);
+  size_t alignment = huge ? kHugePageBytes : numa ? kPageBytes : 64;
+  if (alignment > 64) {
+    // Whole pages, so the advice and binding cover no other allocation
+    bytes = (bytes + alignment - 1) & ~(alignment - 1);
+  }
+  void *block = nullptr;
+  if (posix_memalign(&block, alignment, bytes) != 0) {
+    return nullptr;
+  }
+  // Both take effect when the pages are first touched
+  if (numa) {
+    BindToCurrentNode(block, bytes);
+  }
+#if defined(MADV_HUGEPAGE)
+  if (huge) {
+    madvise(block, bytes, MADV_HUGEPAGE);
+  }
+#endif
+  return block;
+}
+
+void CubeFreeBlock(void *block) {
+  auto &registry = Registry();
+  if (block == nullptr ||
+      registry.live.load(std::memory_order_acquire) == 0) {
+    std::free(block);
+    return;
+  }
+  AllocatorRegistry::Block found;
+  {
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.blocks.find(reinterpret_cast<uintptr_t>(block));
+    if (it != registry.blocks.end()) {
+      found = std::move(it->second);
+      registry.blocks.erase(it);
+      registry.live.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  if (found.allocator) {
+    found.allocator->free(found.allocator->user_data, block, found.bytes);
+  } else {
+    std::free(block);
+  }
+}
+
+void CubeSetAllocator(const AdbcCubeAllocator *allocator) {
+  auto &registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.current =
+      allocator ? std::make_shared<const AdbcCubeAllocator>(*allocator)
+                : nullptr;
+  registry.active.store(allocator != nullptr, std::memory_order_release);
+}
+
+std::shared_ptr<const AdbcCubeAllocator> CubeCurrentAllocator() {
+  auto &registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  return registry.current;
+}
+
+bool CubeAllocatorRegistered() {
+  return Registry().active.load(std::memory_order_acquire);
+}
+
+bool CubeInAllocatorBlock(const AdbcCubeAllocator &allocator,
+                          const void *data, size_t size) {
+  auto &registry = Registry();
+  auto address = reinterpret_cast<uintptr_t>(data);
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto it = registry.blocks.upper_bound(address);
+  if (it == registry.blocks.begin()) {
+    return false;
+  }
+  --it;
+  return it->second.allocator.get() == &allocator &&
+         address + size <= it->first + it->second.bytes;
+}
+
+void CubeAttachBlockAllocator(struct ArrowBuffer *buffer) {
+  buffer->allocator.reallocate = &ReallocateBlock;
+  buffer->allocator.free = &FreeBlock;
+  buffer->allocator.private_data = nullptr;
+}
+
+std::shared_ptr<CubeBufferPool> CubeBufferPool::Make(size_t max_bytes) {
+  return std::shared_ptr<CubeBufferPool>(
+      new CubeBufferPool(max_bytes),
+      [](CubeBufferPool *pool) { pool->Unref(); });
+}
+
+CubeBufferPool::~CubeBufferPool() {
+  for (auto &node : free_) {
+    for (auto &blocks : node) {
+      for (uint8_t *block : blocks) {
+        CubeFreeBlock(block);
+      }
+    }
+  }
+}
+
+void CubeBufferPool::Attach(struct ArrowBuffer *buffer) {
+  refs_.fetch_add(1, std::memory_order_relaxed);
+  buffer->allocator.reallocate = &CubeBufferPool::Reallocate;
+  buffer->allocator.free = &CubeBufferPool::Free;
+  buffer->allocator.private_data = this;
+}
+
+size_t CubeBufferPool::cached_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cached_bytes_;
+}
+
+uint8_t *CubeBufferPool::Reallocate(struct ArrowBufferAllocator *allocator,
+                                    uint8_t *ptr, int64_t old_size,
+                                    int64_t new_size) {
+  auto *pool = static_cast<CubeBufferPool *>(allocator->private_data);
+  int new_class = SizeClass(new_size);
+  if (ptr != nullptr) {
+    // nanoarrow passes the capacity it asked for, so the block's class is
+    // found again from old_size; growing within it needs no copy
+    int old_class = SizeClass(old_size);
+    if (new_class == old_class) {
+      return ptr;
+    }
+  }
+  uint8_t *block = pool->Take(new_class);
+  if (block != nullptr && ptr != nullptr) {
+    std::memcpy(block, ptr,
+                static_cast<size_t>(old_size < new_size ? old_size : new_size));
+    pool->Give(ptr, SizeClass(old_size));
+  }
+  return block;
+}
+
+void CubeBufferPool::Free(struct ArrowBufferAllocator *allocator,
+                          uint8_t *ptr, int64_t size) {
+  auto *pool = static_cast<CubeBufferPool *>(allocator->private_data);
+  if (ptr != nullptr) {
+    pool->Give(ptr, SizeClass(size));
+  }
+  pool->Unref();
+}
+
+uint8_t *CubeBufferPool::Take(int size_class) {
+  if (size_class < kSizeClasses) {
+    bool numa = CubeMemoryPlacement::Global().numa_local.load(
+        std::memory_order_relaxed);
+    int node = numa ? CurrentNode() % kNodes : 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &blocks = free_[node][size_class];
+    if (!blocks.empty()) {
+      uint8_t *block = blocks.back();
+      blocks.pop_back();
+      cached_bytes_ -= ClassBytes(size_class);
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return block;
+    }
+  }
+  return static_cast<uint8_t *>(CubeAllocateBlock(ClassBytes(size_class)));
+}
+
+void CubeBufferPool::Give(uint8_t *block, int size_class) {
+  if (size_class < kSizeClasses) {
+    int node = 0;
+    if (CubeMemoryPlacement::Global().numa_local.load(
+            std::memory_order_relaxed)) {
+      // A small block is taken to be where it is released; a large one,
+      // which may have been released far from where it was written, is
+      // looked up
+      int found = ClassBytes(size_class) >= kNumaMinBytes ? NodeOf(block) : -1;
+      node = (found >= 0 ? found : CurrentNode()) % kNodes;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cached_bytes_ + ClassBytes(size_class) <= max_bytes_) {
+      free_[node][size_class].push_back(block);
+      cached_bytes_ += ClassBytes(size_class);
+      return;
+    }
+  }
+  CubeFreeBlock(block);
+}
+
+void CubeBufferPool::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,146 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.h>
+
+extern "C" {
+
+/// Memory the driver receives results into and builds them in, such as
+/// CUDA pinned host memory, so that results can be copied to a GPU without
+/// a staging copy. Register one by passing its address to
+/// AdbcDatabaseSetOptionInt with the key "adbc.cube.allocator" (0 restores
+/// malloc); the driver copies it, so it need not outlive the call, but
+/// user_data must outlive every block allocated from it. Process-wide.
+/// Callbacks may be called from any thread, and must not call back into
+/// the driver.
+struct AdbcCubeAllocator {
+  /// Passed back to every callback
+  void *user_data;
+  /// Allocate size bytes aligned to alignment (a power of two, at most
+  /// 4096); null if out of memory
+  void *(*allocate)(void *user_data, size_t size, size_t alignment);
+  /// Free a block allocate returned, of the size asked for
+  void (*free)(void *user_data, void *ptr, size_t size);
+  /// ArrowDeviceType and device ID that device streams report their
+  /// batches with, such as ARROW_DEVICE_CUDA_HOST (3) and 0
+  int32_t device_type;
+  int64_t device_id;
+};
+
+} // extern "C"
+
+namespace adbc::cube {
+
+/// How large blocks of result memory are placed, for the whole process
+/// (set from database options). Read when a block is allocated.
+struct CubeMemoryPlacement {
+  static CubeMemoryPlacement &Global();
+
+  /// Blocks of at least this many bytes are aligned to 2 MiB and, on
+  /// Linux, advised for transparent huge pages; 0 = never
+  std::atomic<size_t> huge_page_min_bytes{size_t(2) << 20};
+  /// On Linux, bind new blocks to the NUMA node of the thread allocating
+  /// them, and keep blocks on the free lists of their own node
+  std::atomic<bool> numa_local{false};
+};
+
+/// Allocate bytes for received or decoded Arrow data, 64-byte aligned: from
+/// the registered AdbcCubeAllocator if any, otherwise placed as
+/// CubeMemoryPlacement says; free with CubeFreeBlock
+/// @return nullptr if out of memory
+void *CubeAllocateBlock(size_t bytes);
+
+/// Free a block of CubeAllocateBlock, with the allocator it came from
+void CubeFreeBlock(void *block);
+
+/// Allocate later blocks from a copy of allocator, or with malloc again if
+/// null. Blocks already allocated are still freed by their own allocator.
+void CubeSetAllocator(const AdbcCubeAllocator *allocator);
+
+/// The registered allocator, or null
+std::shared_ptr<const AdbcCubeAllocator> CubeCurrentAllocator();
+
+/// Whether an allocator is registered; cheaper than CubeCurrentAllocator
+bool CubeAllocatorRegistered();
+
+/// Whether size bytes at data lie within one live block of allocator
+bool CubeInAllocatorBlock(const AdbcCubeAllocator &allocator,
+                          const void *data, size_t size);
+
+/// Make an empty buffer allocate with CubeAllocateBlock, so that it is in
+/// the registered allocator's memory. Its data must not be replaced by
+/// ArrowBufferMove.
+void CubeAttachBlockAllocator(struct ArrowBuffer *buffer);
+
+/// Free lists of the blocks behind copied result buffers, by power-of-two
+/// size class from 64 bytes up. When a batch is released its buffers go
+/// back to the list of their class, and the next batch of a similar shape
+/// takes them instead of calling malloc. Blocks are 64-byte aligned, and
+/// large ones are placed by CubeAllocateBlock. With numa_local, each NUMA
+/// node has lists of its own, so a decode thread reuses blocks on its
+/// node. At most max_bytes are kept on the lists; beyond that blocks are
+/// freed. Thread-safe, since batches may be released on any thread.
+class CubeBufferPool {
+public:
+  /// The pool lives until the returned pointer and every buffer attached to
+  /// it are gone
+  static std::shared_ptr<CubeBufferPool> Make(size_t max_bytes);
+
+  /// Make an empty buffer allocate from the pool. Its data must not be
+  /// replaced by ArrowBufferMove, which would leak the pool.
+  void Attach(struct ArrowBuffer *buffer);
+
+  /// Allocations served from the free lists
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+  /// Bytes currently kept on the free lists
+  size_t cached_bytes() const;
+
+private:
+  explicit CubeBufferPool(size_t max_bytes) : max_bytes_(max_bytes) {}
+  ~CubeBufferPool();
+
+  static uint8_t *Reallocate(struct ArrowBufferAllocator *allocator,
+                             uint8_t *ptr, int64_t old_size, int64_t new_size);
+  static void Free(struct ArrowBufferAllocator *allocator, uint8_t *ptr,
+                   int64_t size);
+
+  uint8_t *Take(int size_class);
+  void Give(uint8_t *block, int size_class);
+  void Unref();
+
+  static constexpr int kSizeClasses = 40; // 64 bytes to 32 TiB
+  static constexpr int kNodes = 8; // Higher nodes share lists modulo 8
+
+  size_t max_bytes_;
+  std::atomic<int64_t> refs_{1}; // The owner plus one per attached buffer
+  std::atomic<int64_t> hits_{0};
+  mutable std::mutex mutex_;
+  size_t cached_bytes_ = 0;
+  std::vector<uint8_t *> free_[kNodes][kSizeClasses];
+};
+
+} // namespace adbc::cube
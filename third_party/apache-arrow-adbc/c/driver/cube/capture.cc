@@ -0,0 +1,157 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/capture.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr char kMagic[8] = {'C', 'U', 'B', 'E', 'C', 'A', 'P', '1'};
+
+uint32_t FrameLength(const uint8_t *prefix) {
+  return (static_cast<uint32_t>(prefix[0]) << 24) |
+         (static_cast<uint32_t>(prefix[1]) << 16) |
+         (static_cast<uint32_t>(prefix[2]) << 8) |
+         static_cast<uint32_t>(prefix[3]);
+}
+
+bool ReadFully(FILE *file, void *data, size_t size) {
+  return std::fread(data, 1, size, file) == size;
+}
+
+} // namespace
+
+int CubeSessionCapture::Open(const std::string &dir,
+                             std::unique_ptr<CubeSessionCapture> *out) {
+  static std::atomic<uint64_t> next{0};
+  while (true) {
+    std::string path = dir + "/cube-" + std::to_string(getpid()) + "-" +
+                       std::to_string(next++) + ".cubecap";
+    // Fails with EEXIST rather than overwrite an earlier capture
+    FILE *file = std::fopen(path.c_str(), "wbx");
+    if (!file) {
+      if (errno == EEXIST) {
+        continue;
+      }
+      return errno;
+    }
+    if (std::fwrite(kMagic, 1, sizeof(kMagic), file) != sizeof(kMagic)) {
+      int code = errno;
+      std::fclose(file);
+      return code;
+    }
+    out->reset(new CubeSessionCapture(file, std::move(path)));
+    return 0;
+  }
+}
+
+CubeSessionCapture::~CubeSessionCapture() { std::fclose(file_); }
+
+void CubeSessionCapture::Sent(const struct iovec *iov, int count,
+                              size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < count && bytes > 0; i++) {
+    size_t size = std::min(bytes, iov[i].iov_len);
+    Append(&sent_, static_cast<const uint8_t *>(iov[i].iov_base), size);
+    bytes -= size;
+  }
+}
+
+void CubeSessionCapture::Received(const uint8_t *data, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Append(&received_, data, size);
+}
+
+void CubeSessionCapture::Append(Pending *pending, const uint8_t *data,
+                                size_t size) {
+  std::vector<uint8_t> &frame = pending->frame;
+  while (size > 0) {
+    size_t want = frame.size() < 4
+                      ? 4 - frame.size()
+                      : 4 + FrameLength(frame.data()) - frame.size();
+    size_t take = std::min(want, size);
+    frame.insert(frame.end(), data, data + take);
+    data += take;
+    size -= take;
+    if (frame.size() < 4 || frame.size() < 4 + FrameLength(frame.data())) {
+      continue;
+    }
+    // Best effort: a failed write leaves a truncated capture, which
+    // ReadCaptureFile reports, rather than failing the session
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start_)
+                     .count();
+    uint8_t header[9];
+    header[0] = pending->tag;
+    for (int i = 0; i < 8; i++) {
+      header[1 + i] = static_cast<uint8_t>(static_cast<uint64_t>(nanos) >>
+                                           (56 - 8 * i));
+    }
+    std::fwrite(header, 1, sizeof(header), file_);
+    std::fwrite(frame.data(), 1, frame.size(), file_);
+    frame.clear();
+  }
+}
+
+int ReadCaptureFile(const std::string &path,
+                    std::vector<CubeCapturedFrame> *out) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    return errno;
+  }
+  char magic[sizeof(kMagic)];
+  int code = ReadFully(file, magic, sizeof(magic)) &&
+                     std::memcmp(magic, kMagic, sizeof(kMagic)) == 0
+                 ? 0
+                 : EINVAL;
+  out->clear();
+  uint8_t header[13];
+  while (code == 0 && ReadFully(file, header, 1)) {
+    if (!ReadFully(file, header + 1, sizeof(header) - 1) ||
+        (header[0] != '>' && header[0] != '<')) {
+      code = EINVAL;
+      break;
+    }
+    CubeCapturedFrame frame;
+    frame.sent = header[0] == '>';
+    uint64_t nanos = 0;
+    for (int i = 1; i <= 8; i++) {
+      nanos = (nanos << 8) | header[i];
+    }
+    frame.nanos = static_cast<int64_t>(nanos);
+    frame.frame.assign(header + 9, header + 13);
+    uint32_t length = FrameLength(header + 9);
+    frame.frame.resize(4 + static_cast<size_t>(length));
+    if (!ReadFully(file, frame.frame.data() + 4, length)) {
+      code = EINVAL;
+      break;
+    }
+    out->push_back(std::move(frame));
+  }
+  std::fclose(file);
+  return code;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,95 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace adbc::cube {
+
+/// Records the frames of one native protocol session to a file, so that
+/// real traffic can be replayed later (see replay.h).
+///
+/// A capture file starts with the 8 bytes "CUBECAP1", followed by one
+/// record per frame: '>' for a frame the client sent or '<' for one it
+/// received, the big-endian nanoseconds from the start of the capture to
+/// the frame's last byte (8 bytes), and the whole frame, length prefix
+/// included. Frames are recorded after TLS decryption and before
+/// decompression. Each frame is buffered until complete, so sent and
+/// received frames never interleave in the file. Thread-safe.
+class CubeSessionCapture {
+public:
+  /// Create a new capture file in dir, named cube-<pid>-<n>.cubecap
+  /// @return 0, or an errno value
+  static int Open(const std::string &dir,
+                  std::unique_ptr<CubeSessionCapture> *out);
+
+  ~CubeSessionCapture();
+  CubeSessionCapture(const CubeSessionCapture &) = delete;
+  CubeSessionCapture &operator=(const CubeSessionCapture &) = delete;
+
+  /// Record the first bytes of iov, which were written to the server
+  void Sent(const struct iovec *iov, int count, size_t bytes);
+
+  /// Record bytes read from the server
+  void Received(const uint8_t *data, size_t size);
+
+  const std::string &path() const { return path_; }
+
+private:
+  // Bytes of the frame being assembled in one direction
+  struct Pending {
+    uint8_t tag;
+    std::vector<uint8_t> frame;
+  };
+
+  CubeSessionCapture(FILE *file, std::string path)
+      : file_(file), path_(std::move(path)),
+        start_(std::chrono::steady_clock::now()) {}
+
+  void Append(Pending *pending, const uint8_t *data, size_t size);
+
+  std::mutex mutex_;
+  FILE *file_;
+  const std::string path_;
+  const std::chrono::steady_clock::time_point start_;
+  Pending sent_{'>', {}};
+  Pending received_{'<', {}};
+};
+
+/// One frame of a capture file
+struct CubeCapturedFrame {
+  bool sent;     // Written by the client, rather than read
+  int64_t nanos; // From the start of the capture
+  std::vector<uint8_t> frame;
+};
+
+/// Read every frame of a capture file
+/// @return 0, an errno value, or EINVAL if the file is not a capture or is
+///   truncated
+int ReadCaptureFile(const std::string &path,
+                    std::vector<CubeCapturedFrame> *out);
+
+} // namespace adbc::cube
@@ -0,0 +1,184 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/change_watcher.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "driver/cube/connection.h"
+#include "driver/cube/disk_cache.h"
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/log.h"
+#include "driver/cube/metadata.h"
+#include "driver/cube/native_client.h"
+#include "driver/cube/result_cache.h"
+#include "driver/cube/rollup_cache.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// Message of a failed call, releasing error
+std::string TakeMessage(AdbcError *error) {
+  std::string message = error->message ? error->message : "unknown error";
+  if (error->release) {
+    error->release(error);
+  }
+  return message;
+}
+
+} // namespace
+
+CubeChangeWatcher::CubeChangeWatcher(
+    std::unique_ptr<CubeConnectionImpl> connection,
+    std::shared_ptr<CubeMetadataCache> metadata_cache,
+    std::shared_ptr<CubeResultCache> result_cache,
+    std::shared_ptr<CubeRollupCache> rollup_cache,
+    std::shared_ptr<CubeDiskCache> disk_cache)
+    : connection_(std::move(connection)),
+      metadata_cache_(std::move(metadata_cache)),
+      result_cache_(std::move(result_cache)),
+      rollup_cache_(std::move(rollup_cache)),
+      disk_cache_(std::move(disk_cache)),
+      fork_generation_(CubeForkGeneration()) {
+  CubeForkRegisterMutex(&mutex_);
+  thread_ = std::thread(&CubeChangeWatcher::WatchLoop, this);
+}
+
+CubeChangeWatcher::~CubeChangeWatcher() {
+  CubeForkUnregisterMutex(&mutex_);
+  if (fork_generation_ != CubeForkGeneration()) {
+    // The watching thread stayed in the parent, along with its session
+    if (thread_.joinable()) {
+      thread_.detach();
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void CubeChangeWatcher::WatchLoop() {
+  auto retry = kMinRetry;
+  bool watched = false;
+  while (!stopping_) {
+    std::unique_ptr<NativeClient> client;
+    AdbcError error = ADBC_ERROR_INIT;
+    Status started = connection_->WatchChanges(&client, &error);
+    if (!started.ok()) {
+      AdbcStatusCode code = started.ToAdbc(&error);
+      std::string message = TakeMessage(&error);
+      if (code == ADBC_STATUS_NOT_IMPLEMENTED) {
+        CUBE_LOG(Info, "ChangeWatcher",
+                 "Not watching for changes; caches expire by TTL alone",
+                 {{"reason", message}});
+        return;
+      }
+      CUBE_LOG(Warn, "ChangeWatcher", "Cannot watch for changes",
+               {{"error", message},
+                {"retry_ms", static_cast<int64_t>(retry.count())}});
+      if (!Sleep(retry)) {
+        return;
+      }
+      retry = std::min(retry * 2, kMaxRetry);
+      continue;
+    }
+    if (watched) {
+      // Whatever changed while no session was watching went unreported
+      InvalidateAll();
+    }
+    watched = true;
+    retry = kMinRetry;
+    CUBE_LOG(Debug, "ChangeWatcher", "Watching for changes");
+
+    while (!stopping_) {
+      ChangeNotification notification;
+      AdbcStatusCode code =
+          client->ReadChange(kPollInterval, &notification, &error);
+      if (code == ADBC_STATUS_TIMEOUT) {
+        if (error.release) {
+          error.release(&error);
+        }
+        continue;
+      }
+      if (code != ADBC_STATUS_OK) {
+        CUBE_LOG(Warn, "ChangeWatcher", "Lost the watching session",
+                 {{"error", TakeMessage(&error)}});
+        break;
+      }
+      notifications_.fetch_add(1, std::memory_order_relaxed);
+      Apply(notification);
+    }
+  }
+}
+
+void CubeChangeWatcher::Apply(const ChangeNotification &notification) {
+  switch (notification.kind) {
+  case ChangeKind::DataModel:
+    CUBE_LOG(Info, "ChangeWatcher", "Data model changed",
+             {{"version", notification.version}});
+    InvalidateAll();
+    break;
+  case ChangeKind::Preaggregation: {
+    size_t results = 0;
+    size_t rollups = 0;
+    if (result_cache_) {
+      results = result_cache_->ErasePreaggregation(notification.name);
+    }
+    if (rollup_cache_) {
+      rollups = rollup_cache_->ErasePreaggregation(notification.name);
+    }
+    CUBE_LOG(Debug, "ChangeWatcher", "Pre-aggregation refreshed",
+             {{"preaggregation", notification.name},
+              {"version", notification.version},
+              {"results", static_cast<int64_t>(results)},
+              {"rollups", static_cast<int64_t>(rollups)}});
+    break;
+  }
+  }
+}
+
+void CubeChangeWatcher::InvalidateAll() {
+  if (metadata_cache_) {
+    metadata_cache_->Invalidate();
+  }
+  if (result_cache_) {
+    result_cache_->Clear();
+  }
+  if (rollup_cache_) {
+    rollup_cache_->Clear();
+  }
+  if (disk_cache_) {
+    disk_cache_->Clear();
+  }
+  model_generation_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool CubeChangeWatcher::Sleep(std::chrono::milliseconds delay) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return !cv_.wait_for(lock, delay, [this] { return stopping_.load(); });
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,114 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace adbc::cube {
+
+class CubeConnectionImpl;
+class CubeDiskCache;
+class CubeMetadataCache;
+class CubeResultCache;
+class CubeRollupCache;
+struct ChangeNotification;
+
+/// Invalidates a database's caches as the server reports changes, over a
+/// native session of its own given over to change notifications (see
+/// NativeClient::WatchChanges), so that cached results can be kept long
+/// and still be dropped as soon as they no longer hold:
+///
+/// - A data model change clears the metadata, result, rollup and disk
+///   caches, and moves model_generation() on, so that connections drop their
+///   prepared statements and table schemas at their next request.
+/// - A pre-aggregation refresh drops the results and rollups that the
+///   pre-aggregation served, and nothing else.
+///
+/// The delta cache is left alone: its results carry the server's version
+/// and are refreshed by it. A lost session is opened again with backoff,
+/// and everything is invalidated then, since changes may have been missed
+/// meanwhile. A server without change notifications is watched no further.
+///
+/// Fork-safe: in a child the thread stays with the parent, and the child's
+/// caches expire by their TTLs alone.
+class CubeChangeWatcher {
+public:
+  /// Start watching on sessions opened with the options of connection
+  /// (never connected itself); caches that are null are not kept
+  CubeChangeWatcher(std::unique_ptr<CubeConnectionImpl> connection,
+                    std::shared_ptr<CubeMetadataCache> metadata_cache,
+                    std::shared_ptr<CubeResultCache> result_cache,
+                    std::shared_ptr<CubeRollupCache> rollup_cache,
+                    std::shared_ptr<CubeDiskCache> disk_cache);
+  ~CubeChangeWatcher();
+
+  CubeChangeWatcher(const CubeChangeWatcher &) = delete;
+  CubeChangeWatcher &operator=(const CubeChangeWatcher &) = delete;
+
+  /// Data model changes seen so far, counting each time the session was
+  /// opened again
+  uint64_t model_generation() const {
+    return model_generation_.load(std::memory_order_acquire);
+  }
+
+  /// Change notifications received
+  int64_t notifications() const {
+    return notifications_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /// Open sessions and read their notifications, until stopped
+  void WatchLoop();
+
+  /// Invalidate what notification says changed
+  void Apply(const ChangeNotification &notification);
+
+  /// Invalidate every cache, as for a data model change
+  void InvalidateAll();
+
+  /// Wait for delay unless stopped first; false once stopped
+  bool Sleep(std::chrono::milliseconds delay);
+
+  /// How long each wait for a notification lasts, so that stopping is seen
+  static constexpr std::chrono::milliseconds kPollInterval{250};
+
+  /// First wait after the session failed, doubled up to kMaxRetry
+  static constexpr std::chrono::milliseconds kMinRetry{1000};
+  static constexpr std::chrono::milliseconds kMaxRetry{30000};
+
+  const std::unique_ptr<CubeConnectionImpl> connection_;
+  const std::shared_ptr<CubeMetadataCache> metadata_cache_;
+  const std::shared_ptr<CubeResultCache> result_cache_;
+  const std::shared_ptr<CubeRollupCache> rollup_cache_;
+  const std::shared_ptr<CubeDiskCache> disk_cache_;
+  std::atomic<uint64_t> model_generation_{0};
+  std::atomic<int64_t> notifications_{0};
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+  uint64_t fork_generation_; // CubeForkGeneration() of thread_
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,208 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include "driver/cube/compression.h"
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(CUBE_WITH_LZ4)
+#include <lz4frame.h>
+#endif
+#if defined(CUBE_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace adbc::cube {
+
+std::optional<CompressionCodec> ParseCompressionCodec(std::string_view name) {
+  if (name == "none") {
+    return CompressionCodec::None;
+  } else if (name == "lz4" || name == "lz4_frame") {
+    return CompressionCodec::Lz4Frame;
+  } else if (name == "zstd") {
+    return CompressionCodec::Zstd;
+  }
+  return std::nullopt;
+}
+
+bool IsCompressionCodecAvailable(CompressionCodec codec) {
+  switch (codec) {
+  case CompressionCodec::None:
+    return true;
+  case CompressionCodec::Lz4Frame:
+#if defined(CUBE_WITH_LZ4)
+    return true;
+#else
+    return false;
+#endif
+  case CompressionCodec::Zstd:
+#if defined(CUBE_WITH_ZSTD)
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+namespace {
+
+#if defined(CUBE_WITH_LZ4)
+ArrowErrorCode DecompressLz4Frame(const uint8_t *src, size_t src_size,
+                                  uint8_t *dst, size_t dst_size,
+                                  ArrowError *error) {
+  LZ4F_dctx *context = nullptr;
+  size_t result = LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
+  if (LZ4F_isError(result)) {
+    ArrowErrorSet(error, "LZ4 context creation failed: %s",
+                  LZ4F_getErrorName(result));
+    return EINVAL;
+  }
+
+  size_t src_pos = 0;
+  size_t dst_pos = 0;
+  result = 1;
+  while (result != 0 && src_pos < src_size) {
+    size_t src_chunk = src_size - src_pos;
+    size_t dst_chunk = dst_size - dst_pos;
+    result = LZ4F_decompress(context, dst + dst_pos, &dst_chunk, src + src_pos,
+                             &src_chunk, nullptr);
+    if (LZ4F_isError(result)) {
+      ArrowErrorSet(error, "LZ4 decompression failed: %s",
+                    LZ4F_getErrorName(result));
+      LZ4F_freeDecompressionContext(context);
+      return EINVAL;
+    }
+    src_pos += src_chunk;
+    dst_pos += dst_chunk;
+    if (src_chunk == 0 && dst_chunk == 0) {
+      break; // No progress: output buffer is full
+    }
+  }
+  LZ4F_freeDecompressionContext(context);
+
+  if (result != 0 || dst_pos != dst_size) {
+    ArrowErrorSet(error, "LZ4 data decompressed to %zu bytes, expected %zu",
+                  dst_pos, dst_size);
+    return EINVAL;
+  }
+  return NANOARROW_OK;
+}
+#endif
+
+#if defined(CUBE_WITH_ZSTD)
+ArrowErrorCode DecompressZstd(const uint8_t *src, size_t src_size,
+                              uint8_t *dst, size_t dst_size,
+                              ArrowError *error) {
+  size_t result = ZSTD_decompress(dst, dst_size, src, src_size);
+  if (ZSTD_isError(result)) {
+    ArrowErrorSet(error, "ZSTD decompression failed: %s",
+                  ZSTD_getErrorName(result));
+    return EINVAL;
+  }
+  if (result != dst_size) {
+    ArrowErrorSet(error, "ZSTD data decompressed to %zu bytes, expected %zu",
+                  result, dst_size);
+    return EINVAL;
+  }
+  return NANOARROW_OK;
+}
+#endif
+
+} // namespace
+
+ArrowErrorCode Decompress(CompressionCodec codec, const uint8_t *src,
+                          size_t src_size, uint8_t *dst, size_t dst_size,
+                          ArrowError *error) {
+  switch (codec) {
+  case CompressionCodec::None:
+    if (src_size != dst_size) {
+      ArrowErrorSet(error, "Uncompressed data is %zu bytes, expected %zu",
+                    src_size, dst_size);
+      return EINVAL;
+    }
+    if (dst_size > 0) {
+      std::memcpy(dst, src, dst_size);
+    }
+    return NANOARROW_OK;
+  case CompressionCodec::Lz4Frame:
+#if defined(CUBE_WITH_LZ4)
+    return DecompressLz4Frame(src, src_size, dst, dst_size, error);
+#else
+    break;
+#endif
+  case CompressionCodec::Zstd:
+#if defined(CUBE_WITH_ZSTD)
+    return DecompressZstd(src, src_size, dst, dst_size, error);
+#else
+    break;
+#endif
+  }
+  ArrowErrorSet(error, "Compression codec %d is not available in this build",
+                static_cast<int>(codec));
+  return ENOTSUP;
+}
+
+ArrowErrorCode Compress(CompressionCodec codec, const uint8_t *src,
+                        size_t src_size, std::vector<uint8_t> *dst,
+                        ArrowError *error) {
+  switch (codec) {
+  case CompressionCodec::None:
+    dst->assign(src, src + src_size);
+    return NANOARROW_OK;
+  case CompressionCodec::Lz4Frame: {
+#if defined(CUBE_WITH_LZ4)
+    dst->resize(LZ4F_compressFrameBound(src_size, nullptr));
+    size_t result =
+        LZ4F_compressFrame(dst->data(), dst->size(), src, src_size, nullptr);
+    if (LZ4F_isError(result)) {
+      ArrowErrorSet(error, "LZ4 compression failed: %s",
+                    LZ4F_getErrorName(result));
+      return EINVAL;
+    }
+    dst->resize(result);
+    return NANOARROW_OK;
+#else
+    break;
+#endif
+  }
+  case CompressionCodec::Zstd: {
+#if defined(CUBE_WITH_ZSTD)
+    dst->resize(ZSTD_compressBound(src_size));
+    // Level 3 is zstd's default, fast enough to keep up with the decoder
+    size_t result =
+        ZSTD_compress(dst->data(), dst->size(), src, src_size, 3);
+    if (ZSTD_isError(result)) {
+      ArrowErrorSet(error, "ZSTD compression failed: %s",
+                    ZSTD_getErrorName(result));
+      return EINVAL;
+    }
+    dst->resize(result);
+    return NANOARROW_OK;
+#else
+    break;
+#endif
+  }
+  }
+  ArrowErrorSet(error, "Compression codec %d is not available in this build",
+                static_cast<int>(codec));
+  return ENOTSUP;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,70 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.h>
+
+namespace adbc::cube {
+
+/// Compression codecs understood by the driver. The values are the ids
+/// used on the wire by the native protocol.
+enum class CompressionCodec : uint8_t {
+  None = 0,
+  Lz4Frame = 1,
+  Zstd = 2,
+};
+
+/// Parse an option value ("none", "lz4", "zstd")
+std::optional<CompressionCodec> ParseCompressionCodec(std::string_view name);
+
+/// Check whether this build can decompress the codec
+bool IsCompressionCodecAvailable(CompressionCodec codec);
+
+/// Decompress a complete buffer whose decompressed size is known up front
+/// @param codec Codec the data was compressed with
+/// @param src Compressed bytes
+/// @param src_size Number of compressed bytes
+/// @param dst Output buffer of exactly dst_size bytes
+/// @param dst_size Expected decompressed size
+/// @param error Optional error output
+/// @return NANOARROW_OK, ENOTSUP if the codec is not built in, or EINVAL if
+///   the data is corrupt or does not decompress to dst_size bytes
+ArrowErrorCode Decompress(CompressionCodec codec, const uint8_t *src,
+                          size_t src_size, uint8_t *dst, size_t dst_size,
+                          ArrowError *error);
+
+/// Compress a complete buffer
+/// @param codec Codec to compress with
+/// @param src Bytes to compress
+/// @param src_size Number of bytes to compress
+/// @param dst Replaced by the compressed bytes
+/// @param error Optional error output
+/// @return NANOARROW_OK, ENOTSUP if the codec is not built in, or EINVAL if
+///   compression failed
+ArrowErrorCode Compress(CompressionCodec codec, const uint8_t *src,
+                        size_t src_size, std::vector<uint8_t> *dst,
+                        ArrowError *error);
+
+} // namespace adbc::cube
@@ -15,26 +15,482 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include <nanoarrow/nanoarrow.hpp>
 
+#include "driver/cube/arrow_writer.h"
 #include "driver/cube/connection.h"
 #include "driver/cube/database.h"
+#include "driver/cube/libpq_loader.h"
 #include "driver/cube/metadata.h"
+#include "driver/cube/metrics.h"
 #include "driver/cube/native_client.h"
+#include "driver/cube/postgres_reader.h"
+#include "driver/cube/rechunk_stream.h"
+#include "driver/cube/sql_fingerprint.h"
+#include "driver/framework/utility.h"
 
 namespace adbc::cube {
 
+namespace {
+
+// Results of a batch execution read back to back as one stream. Each
+// result is opened once the one before it has ended and been released, so
+// a PostgreSQL connection is free for the next execution.
+class ConcatenatedStream {
+public:
+  using OpenFn = std::function<AdbcStatusCode(
+      size_t index, struct ArrowArrayStream *out, AdbcError *error)>;
+
+  ConcatenatedStream(size_t count, OpenFn open)
+      : count_(count), open_(std::move(open)) {}
+
+  int GetSchema(struct ArrowSchema *schema) {
+    if (!schema_->release) {
+      int status = OpenNext();
+      if (status != NANOARROW_OK) {
+        return status;
+      }
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    while (true) {
+      if (!current_->release) {
+        if (next_ == count_) {
+          out->release = nullptr;
+          return NANOARROW_OK;
+        }
+        int status = OpenNext();
+        if (status != NANOARROW_OK) {
+          return status;
+        }
+      }
+      int status = current_->get_next(current_.get(), out);
+      if (status != NANOARROW_OK) {
+        const char *message = current_->get_last_error(current_.get());
+        last_error_ = message ? message : "Failed to read batch result";
+        return status;
+      }
+      if (out->release) {
+        return NANOARROW_OK;
+      }
+      current_.reset();
+    }
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<ConcatenatedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<ConcatenatedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<ConcatenatedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<ConcatenatedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  // Open the result of the next execution; the schema is taken from the
+  // first one
+  int OpenNext() {
+    if (current_->release) {
+      current_.reset();
+    }
+    AdbcError error = ADBC_ERROR_INIT;
+    auto status_code = open_(next_, current_.get(), &error);
+    if (status_code == ADBC_STATUS_OK && !schema_->release &&
+        current_->get_schema(current_.get(), schema_.get()) != NANOARROW_OK) {
+      const char *message = current_->get_last_error(current_.get());
+      SetNativeClientError(&error,
+                           message ? message : "Failed to get result schema");
+      status_code = ADBC_STATUS_INTERNAL;
+    }
+    if (status_code != ADBC_STATUS_OK) {
+      last_error_ = error.message ? error.message : "Batch execution failed";
+      if (error.release) {
+        error.release(&error);
+      }
+      current_.reset();
+      next_ = count_; // Executions after a failed one are not read
+      return EIO;
+    }
+    next_++;
+    return NANOARROW_OK;
+  }
+
+  size_t count_;
+  OpenFn open_;
+  size_t next_ = 0; // Index of the next execution to open
+  nanoarrow::UniqueArrayStream current_;
+  nanoarrow::UniqueSchema schema_;
+  std::string last_error_;
+};
+
+// A native result stream whose callbacks hold the connection's session
+// mutex, so reading it does not race statements running on other threads
+class LockedStream {
+public:
+  LockedStream(std::shared_ptr<std::recursive_mutex> mutex,
+               struct ArrowArrayStream *inner)
+      : mutex_(std::move(mutex)) {
+    ArrowArrayStreamMove(inner, inner_.get());
+  }
+
+  ~LockedStream() {
+    std::lock_guard<std::recursive_mutex> lock(*mutex_);
+    inner_.reset();
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    std::lock_guard<std::recursive_mutex> lock(*mutex_);
+    return inner_->get_schema(inner_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    std::lock_guard<std::recursive_mutex> lock(*mutex_);
+    return inner_->get_next(inner_.get(), out);
+  }
+
+  const char *GetLastError() {
+    std::lock_guard<std::recursive_mutex> lock(*mutex_);
+    return inner_->get_last_error(inner_.get());
+  }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<LockedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<LockedStream *>(stream->private_data)->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<LockedStream *>(stream->private_data)->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<LockedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::shared_ptr<std::recursive_mutex> mutex_;
+  nanoarrow::UniqueArrayStream inner_;
+};
+
+// A result stream holding its query's admission slot until the result
+// has been read, failed or was released
+// Place in the admission queue of a class of query: lower goes first
+int AdmissionTier(QueryPriority priority) {
+  switch (priority) {
+  case QueryPriority::Interactive:
+    return 0;
+  case QueryPriority::Default:
+    return 1;
+  case QueryPriority::Batch:
+    return 2;
+  case QueryPriority::Background:
+    return 3;
+  }
+  return 1;
+}
+
+class AdmittedStream {
+public:
+  AdmittedStream(std::shared_ptr<CubeAdmissionControl::Permit> permit,
+                 struct ArrowArrayStream *inner)
+      : permit_(std::move(permit)) {
+    ArrowArrayStreamMove(inner, inner_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    return inner_->get_schema(inner_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    int code = inner_->get_next(inner_.get(), out);
+    if (code != NANOARROW_OK || !out->release) {
+      permit_.reset();
+    }
+    return code;
+  }
+
+  const char *GetLastError() {
+    return inner_->get_last_error(inner_.get());
+  }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<AdmittedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<AdmittedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<AdmittedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<AdmittedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::shared_ptr<CubeAdmissionControl::Permit> permit_;
+  nanoarrow::UniqueArrayStream inner_;
+};
+
+// A result read on a session of its own, closed once the result is
+// released; the connection may be gone by then, so it is not pooled
+class SessionStream {
+public:
+  SessionStream(std::unique_ptr<NativeClient> client,
+                struct ArrowArrayStream *inner)
+      : client_(std::move(client)) {
+    ArrowArrayStreamMove(inner, inner_.get());
+  }
+
+  ~SessionStream() {
+    inner_.reset();
+    client_->Close();
+  }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      auto &inner = static_cast<SessionStream *>(stream->private_data)->inner_;
+      return inner->get_schema(inner.get(), schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      auto &inner = static_cast<SessionStream *>(stream->private_data)->inner_;
+      return inner->get_next(inner.get(), array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      auto &inner = static_cast<SessionStream *>(stream->private_data)->inner_;
+      return inner->get_last_error(inner.get());
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<SessionStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::unique_ptr<NativeClient> client_;
+  nanoarrow::UniqueArrayStream inner_;
+};
+
+// One send of a hedged query, and what it returned
+struct HedgeLeg {
+  AdbcStatusCode code = ADBC_STATUS_OK;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  nanoarrow::UniqueArrayStream stream;
+  int64_t rows_affected = -1;
+  ResultSizeHint size_hint;
+
+  ~HedgeLeg() {
+    if (error.release) {
+      error.release(&error);
+    }
+  }
+
+  // Hand the result, or the error, to the caller of SendQuery
+  AdbcStatusCode MoveTo(struct ArrowArrayStream *out,
+                        struct AdbcError *out_error, int64_t *out_rows,
+                        ResultSizeHint *out_size_hint) {
+    if (code != ADBC_STATUS_OK) {
+      if (out_error) {
+        if (out_error->release) {
+          out_error->release(out_error);
+        }
+        *out_error = error;
+        error.message = nullptr;
+        error.release = nullptr;
+      }
+      return code;
+    }
+    ArrowArrayStreamMove(stream.get(), out);
+    if (out_rows) {
+      *out_rows = rows_affected;
+    }
+    if (out_size_hint) {
+      *out_size_hint = size_hint;
+    }
+    return code;
+  }
+};
+
+// Which send of a hedged query answered first
+struct HedgeRace {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool primary_done = false;
+  NativeClient *hedge = nullptr; // Set before the hedge is sent
+  int winner = -1;               // 0 = the primary, 1 = the hedge
+};
+
+// Partitions handed to applications start with one of these, followed by
+// a partition the server returned or the SQL of a query it did not split
+constexpr char kServerPartition = 'P';
+constexpr char kSqlPartition = 'S';
+
+// Rows of each batch of a merge of partitions
+constexpr int64_t kMergeBatchRows = 65536;
+
+// Batches a parallel ingestion reads ahead for each session; a session that
+// falls this far behind holds the others back
+constexpr int64_t kIngestSplitBuffered = 4;
+
+bool Sampled(const CubeReaderOptions &options) {
+  return options.sample_fraction_ppm != 0 || options.sample_rows != 0;
+}
+
+void SetSample(const CubeReaderOptions &options, QueryRequest *request) {
+  request->sample_fraction_ppm = options.sample_fraction_ppm;
+  request->sample_rows = options.sample_rows;
+  request->sample_seed = options.sample_seed;
+}
+
+// Schema metadata of a sampled result: that it is approximate, how it was
+// sampled, and whether the exact result follows it
+std::vector<std::pair<std::string, std::string>>
+SampleMetadata(const CubeReaderOptions &options) {
+  std::vector<std::pair<std::string, std::string>> entries;
+  entries.emplace_back("adbc.cube.approximate", "true");
+  if (options.sample_fraction_ppm != 0) {
+    char fraction[32];
+    std::snprintf(fraction, sizeof(fraction), "%g",
+                  options.sample_fraction_ppm / 1e6);
+    entries.emplace_back("adbc.cube.sample_fraction", fraction);
+  }
+  if (options.sample_rows != 0) {
+    entries.emplace_back("adbc.cube.sample_rows",
+                         std::to_string(options.sample_rows));
+  }
+  entries.emplace_back("adbc.cube.sample_seed",
+                       std::to_string(options.sample_seed));
+  if (options.sample_refine) {
+    entries.emplace_back("adbc.cube.refined", "true");
+  }
+  return entries;
+}
+
+} // namespace
+
 CubeConnectionImpl::CubeConnectionImpl(const CubeDatabase &database)
     : host_(database.host()), port_(database.port()), token_(database.token()),
       database_(database.database()), user_(database.user()),
       password_(database.password()),
-      connection_mode_(database.connection_mode()) {}
+      connection_mode_(database.connection_mode()) {
+  reader_options_.zero_copy = database.zero_copy();
+  reader_options_.verification = database.verification();
+  reader_options_.verify_nanos = std::make_shared<std::atomic<int64_t>>(0);
+  if (database.schema_cache_entries() > 0) {
+    reader_options_.schema_cache =
+        std::make_shared<CubeSchemaCache>(database.schema_cache_entries());
+  }
+  if (database.buffer_pool_bytes() > 0) {
+    reader_options_.buffer_pool =
+        CubeBufferPool::Make(database.buffer_pool_bytes());
+  }
+  reader_options_.memory = CubeMemoryTracker::Make(database.memory());
+  max_message_bytes_ = database.max_message_bytes();
+  socket_options_ = database.socket_options();
+  timeouts_ = database.timeouts();
+  // Statements sharing the session keep their results apart by reading
+  // them in request order, as pipelining does
+  pipelining_ = database.pipelining() || database.thread_safe();
+  if (database.thread_safe() &&
+      database.connection_mode() == ConnectionMode::Native) {
+    session_mutex_ = std::make_shared<std::recursive_mutex>();
+  }
+  reconnect_ = database.reconnect();
+  prepared_cache_entries_ = database.prepared_cache_entries();
+  tracer_ = database.tracer();
+  capture_dir_ = database.capture_dir();
+  prefetch_bytes_ = database.prefetch_bytes();
+  cursor_fetch_bytes_ = database.cursor_fetch_bytes();
+  credit_batches_ = database.credit_batches();
+  credit_bytes_ = database.credit_bytes();
+  compression_ = database.compression();
+  transport_ = database.transport();
+  shared_memory_bytes_ = database.shared_memory_bytes();
+  pool_ = database.pool();
+  token_source_ = database.token_source();
+  if (token_source_) {
+    token_ = token_source_->token();
+  }
+  change_watcher_ = database.change_watcher();
+  if (change_watcher_) {
+    model_generation_ = change_watcher_->model_generation();
+  }
+  endpoints_ = database.endpoints();
+  postgres_output_format_ = database.postgres_output_format();
+  if (database.table_schema_cache_ttl().count() > 0) {
+    table_schema_cache_ =
+        std::make_unique<TableSchemaCache>(database.table_schema_cache_ttl());
+  }
+  metadata_cache_ = database.metadata_cache();
+  result_cache_ = database.result_cache();
+  shared_result_cache_ = database.shared_result_cache();
+  disk_cache_ = database.disk_cache();
+  rollup_cache_ = database.rollup_cache();
+  delta_cache_ = database.delta_cache();
+  inflight_ = database.inflight_queries();
+  prefetcher_ = database.prefetcher();
+  admission_ = database.admission();
+  address_cache_ = database.address_cache();
+  tls_ = database.tls();
+  tls_options_ = database.tls_options();
+  tls_context_ = database.tls_context();
+}
 
 CubeConnectionImpl::~CubeConnectionImpl() {
   if (connected_) {
@@ -53,36 +509,27 @@ Status CubeConnectionImpl::Connect(struct AdbcError *error) {
 
   if (connection_mode_ == ConnectionMode::Native) {
     // Use native Arrow IPC protocol
-    native_client_ = std::make_unique<NativeClient>();
-
-    int port_num = std::stoi(port_);
-    auto connect_status = native_client_->Connect(host_, port_num, error);
-    if (connect_status != ADBC_STATUS_OK) {
-      native_client_.reset();
-      return status::fmt::IO("Failed to connect via native protocol to {}:{}",
-                             host_, port_);
-    }
-
-    // Authenticate with token
-    if (token_.empty()) {
-      native_client_.reset();
-      return status::InvalidArgument("Native connection mode requires a token");
-    }
-
-    auto auth_status = native_client_->Authenticate(token_, database_, error);
-    if (auth_status != ADBC_STATUS_OK) {
-      native_client_.reset();
-      return status::fmt::InvalidArgument(
-          "Authentication failed with native protocol");
-    }
-
+    UNWRAP_STATUS(StartNativeSession(&native_client_, &endpoint_, error));
     connected_ = true;
+    CubeMetrics::Global().active_connections.fetch_add(
+        1, std::memory_order_relaxed);
     return status::Ok();
 
   } else {
     // Use PostgreSQL wire protocol (default)
     // Build PostgreSQL connection string
-    std::string conn_str = "host=" + host_ + " port=" + port_;
+    // With hosts, libpq tries each server in turn until one connects
+    std::string hosts = host_;
+    std::string ports = port_;
+    if (endpoints_) {
+      hosts.clear();
+      ports.clear();
+      for (size_t i = 0; i < endpoints_->size(); i++) {
+        hosts += (i ? "," : "") + endpoints_->endpoint(i).host;
+        ports += (i ? "," : "") + endpoints_->endpoint(i).port;
+      }
+    }
+    std::string conn_str = "host=" + hosts + " port=" + ports;
 
     if (!database_.empty()) {
       conn_str += " dbname=" + database_;
@@ -96,9 +543,26 @@ Status CubeConnectionImpl::Connect(struct AdbcError *error) {
       conn_str += " password=" + password_;
     }
 
-    // Add output format parameter to use Arrow IPC
-    // NOTE: Commented out temporarily - some CubeSQL versions don't support this
-    // conn_str += " output_format=arrow_ipc";
+    if (timeouts_.connect_ms > 0) {
+      // libpq counts whole seconds
+      conn_str += " connect_timeout=" +
+                  std::to_string((timeouts_.connect_ms + 999) / 1000);
+    }
+
+    if (tls_) {
+      conn_str += tls_options_.verify ? " sslmode=verify-full"
+                                      : " sslmode=require";
+      if (!tls_options_.ca_file.empty()) {
+        conn_str += " sslrootcert=" + tls_options_.ca_file;
+      }
+    }
+
+    // Native mode never needs libpq, so it is only loaded here
+    std::string load_error;
+    if (!LoadLibpq(&load_error)) {
+      return status::fmt::NotImplemented(
+          "PostgreSQL protocol unavailable: {}", load_error);
+    }
 
     // Connect to Cube SQL via PostgreSQL protocol
     conn_ = PQconnectdb(conn_str.c_str());
@@ -116,128 +580,2762 @@ Status CubeConnectionImpl::Connect(struct AdbcError *error) {
           error_msg);
     }
 
+    // libpq rejects unknown conninfo keywords, so Arrow IPC output is asked
+    // for once connected; older servers refuse the setting
+    postgres_arrow_output_ = false;
+    if (postgres_output_format_ != PostgresOutputFormat::Binary) {
+      std::string reason;
+      postgres_arrow_output_ = EnablePostgresArrowOutput(conn_, &reason);
+      if (!postgres_arrow_output_ &&
+          postgres_output_format_ == PostgresOutputFormat::ArrowIpc) {
+        PQfinish(conn_);
+        conn_ = nullptr;
+        return status::fmt::NotImplemented(
+            "Cube SQL at {}:{} does not support Arrow IPC output: {}", host_,
+            port_, reason);
+      }
+    }
+
     connected_ = true;
+    CubeMetrics::Global().active_connections.fetch_add(
+        1, std::memory_order_relaxed);
     return status::Ok();
   }
 }
 
-Status CubeConnectionImpl::Disconnect(struct AdbcError *error) {
-  if (connection_mode_ == ConnectionMode::Native) {
-    if (native_client_) {
-      native_client_->Close();
-      native_client_.reset();
+Status CubeConnectionImpl::OpenNativeSession(
+    size_t endpoint, std::unique_ptr<NativeClient> *out, bool *unreachable,
+    struct AdbcError *error) {
+  const std::string &host =
+      endpoints_ ? endpoints_->endpoint(endpoint).host : host_;
+  const std::string &port =
+      endpoints_ ? endpoints_->endpoint(endpoint).port : port_;
+  auto client = std::make_unique<NativeClient>();
+  client->SetCompression(compression_);
+  client->SetTransport(transport_);
+  client->SetTls(tls_context_);
+  client->SetSharedMemory(shared_memory_bytes_);
+  client->SetSocketOptions(socket_options_);
+  client->SetReaderOptions(reader_options_);
+  client->SetMaxMessageBytes(max_message_bytes_);
+  client->SetPipelining(pipelining_);
+  client->SetPrefetchBytes(prefetch_bytes_);
+  client->SetCursorFetchBytes(cursor_fetch_bytes_);
+  client->SetFlowControl(credit_batches_, credit_bytes_);
+  client->SetTimeouts(timeouts_);
+  client->SetTracer(tracer_);
+  if (!capture_dir_.empty()) {
+    std::unique_ptr<CubeSessionCapture> capture;
+    int code = CubeSessionCapture::Open(capture_dir_, &capture);
+    if (code != 0) {
+      return status::fmt::IO("Failed to create a capture file in {}: {}",
+                             capture_dir_, std::strerror(code));
+    }
+    client->SetCapture(std::move(capture));
+  }
+
+  if (pool_) {
+    client->SetResumeSession(pool_->TakeResumable(endpoint, token_), token_);
+  }
+
+  int port_num = std::stoi(port);
+  auto connect_status =
+      client->Connect(host, port_num, error, address_cache_.get());
+  if (connect_status != ADBC_STATUS_OK) {
+    *unreachable = true;
+  }
+  if (connect_status == ADBC_STATUS_TIMEOUT && error) {
+    return Status::FromAdbc(connect_status, *error);
+  }
+  if (connect_status != ADBC_STATUS_OK) {
+    return status::fmt::IO("Failed to connect via native protocol to {}:{}",
+                           host, port);
+  }
+
+  // The handshake took up a lost session
+  if (client->IsAuthenticated()) {
+    pool_->RecordResumption();
+    *out = std::move(client);
+    return status::Ok();
+  }
+
+  // Authenticate with token
+  if (token_.empty()) {
+    return status::InvalidArgument("Native connection mode requires a token");
+  }
+
+  auto auth_status = client->Authenticate(token_, database_, error);
+  if (auth_status != ADBC_STATUS_OK) {
+    return status::fmt::InvalidArgument(
+        "Authentication failed with native protocol");
+  }
+
+  *out = std::move(client);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::StartNativeSession(
+    std::unique_ptr<NativeClient> *out, size_t *endpoint,
+    struct AdbcError *error, std::vector<size_t> skip) {
+  size_t count = endpoints_ ? endpoints_->size() : 1;
+  std::vector<size_t> tried = std::move(skip);
+  Status last;
+  while (tried.size() < count) {
+    size_t i = endpoints_ ? endpoints_->Pick(tried) : 0;
+    tried.push_back(i);
+    bool unreachable = false;
+    Status started = StartNativeSessionOn(i, out, &unreachable, error);
+    if (!started.ok()) {
+      // Other servers would reject a bad token just the same
+      if (!endpoints_ || !unreachable) {
+        return started;
+      }
+      if (error && error->release) {
+        error->release(error);
+      }
+      last = std::move(started);
+      continue;
+    }
+    *endpoint = i;
+    return status::Ok();
+  }
+  return last;
+}
+
+Status CubeConnectionImpl::StartNativeSessionOn(
+    size_t endpoint, std::unique_ptr<NativeClient> *out, bool *unreachable,
+    struct AdbcError *error) {
+  // Reuse an authenticated session if the database has one idle
+  std::unique_ptr<NativeClient> client;
+  if (pool_) {
+    client = pool_->Acquire(endpoint, token_);
+  }
+  if (client && client->GetToken() != token_) {
+    // Left in the pool by a connection with another token
+    AdbcStatusCode code = client->SetSecurityContext(token_, database_, error);
+    if (code != ADBC_STATUS_OK) {
+      if (error && error->release) {
+        error->release(error);
+      }
+      client.reset();
     }
+  }
+  if (client) {
+    client->SetReaderOptions(reader_options_);
+    client->SetMaxMessageBytes(max_message_bytes_);
+    client->SetPipelining(pipelining_);
+    client->SetPrefetchBytes(prefetch_bytes_);
+    client->SetCursorFetchBytes(cursor_fetch_bytes_);
+    client->SetFlowControl(credit_batches_, credit_bytes_);
+    client->SetTimeouts(timeouts_);
   } else {
-    if (conn_) {
-      PQfinish(conn_);
-      conn_ = nullptr;
+    Status opened = OpenNativeSession(endpoint, &client, unreachable, error);
+    if (!opened.ok()) {
+      if (endpoints_ && *unreachable) {
+        endpoints_->MarkFailed(endpoint);
+      }
+      return opened;
+    }
+    if (endpoints_) {
+      endpoints_->MarkHealthy(endpoint);
     }
   }
-  connected_ = false;
+  if (endpoints_) {
+    endpoints_->Acquire(endpoint);
+  }
+  *out = std::move(client);
   return status::Ok();
 }
 
-Status CubeConnectionImpl::ExecuteQuery(const std::string &query,
-                                        struct ArrowArrayStream *out,
-                                        struct AdbcError *error) {
-  if (!connected_) {
-    return status::InvalidState("Connection not established");
+void CubeConnectionImpl::RouteByAffinity(
+    const std::string &query, const CubeReaderOptions &reader_options) {
+  if (!endpoints_ || endpoints_->routing() != CubeEndpointRouting::Affinity ||
+      endpoints_->size() < 2) {
+    return;
+  }
+  // Handing a session with results still owed to the pool would close it,
+  // and servers only cache reads
+  if (!native_client_->IsReusable() || reader_options.subscribe ||
+      !IsCacheableQuery(NormalizeQueryText(query))) {
+    return;
+  }
+  size_t target =
+      endpoints_->PickAffinity(FingerprintSql(query).low, endpoint_);
+  if (target == endpoint_) {
+    return;
+  }
+  std::unique_ptr<NativeClient> client;
+  bool unreachable = false;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  Status started = StartNativeSessionOn(target, &client, &unreachable, &error);
+  if (error.release) {
+    error.release(&error);
   }
+  if (!started.ok()) {
+    return;
+  }
+  // Left in the pool for the connections whose queries hash to it
+  EndNativeSession(std::move(native_client_), endpoint_);
+  native_client_ = std::move(client);
+  endpoint_ = target;
+  session_++;
+  CubeMetrics::Global().affinity_moves.fetch_add(1, std::memory_order_relaxed);
+}
 
-  // Use native client if available (Arrow Native protocol)
-  if (native_client_) {
-    auto status_code = native_client_->ExecuteQuery(query, out, error);
-    if (status_code != ADBC_STATUS_OK) {
-      // Error already set by native client, preserve the detailed message
-      return Status::FromAdbc(status_code, *error);
-    }
-    return status::Ok();
+void CubeConnectionImpl::EndNativeSession(
+    std::unique_ptr<NativeClient> client, size_t endpoint) {
+  if (endpoints_) {
+    endpoints_->Release(endpoint);
   }
+  // The pool closes the session if it is busy or the pool is full
+  if (pool_) {
+    pool_->Release(std::move(client), endpoint);
+  } else {
+    client->Close();
+  }
+}
 
-  // TODO: Add PostgreSQL wire protocol support via libpq
-  return status::NotImplemented("PostgreSQL wire protocol not yet implemented");
+void CubeConnectionImpl::RecordLatency(
+    std::chrono::steady_clock::time_point start) {
+  // A pipelined send returns before the server answers
+  if (pipelining_) {
+    return;
+  }
+  auto latency = std::chrono::steady_clock::now() - start;
+  if (endpoints_) {
+    endpoints_->RecordLatency(endpoint_, latency);
+  }
+  if (admission_) {
+    admission_->Observe(latency);
+  }
 }
 
-Status CubeConnectionImpl::GetTableSchema(const std::string &table_schema,
-                                          const std::string &table_name,
-                                          struct ArrowSchema *schema) {
-  if (!connected_) {
-    return status::InvalidState("Connection not established");
+AdbcStatusCode CubeConnectionImpl::SendNativeQuery(
+    const QueryRequest &request, const std::string &sql,
+    const CubeReaderOptions &reader_options, struct ArrowArrayStream *out,
+    struct AdbcError *error, int64_t *rows_affected,
+    ResultSizeHint *size_hint, std::unique_ptr<CubeResultCapture> capture,
+    bool shared) {
+  // Only a read can run twice; a pipelined send returns before the server
+  // answers
+  auto hedge_after = reader_options.hedge_after;
+  if (hedge_after.count() == 0 || !endpoints_ || endpoints_->size() < 2 ||
+      pipelining_ || shared || reader_options.subscribe ||
+      !IsCacheableQuery(NormalizeQueryText(sql))) {
+    return native_client_->SendQuery(request, reader_options, out, error,
+                                     rows_affected, size_hint,
+                                     std::move(capture));
   }
 
-  if (table_name.empty()) {
-    return status::InvalidArgument("Table name cannot be empty");
+  auto start = std::chrono::steady_clock::now();
+  HedgeLeg primary;
+  HedgeRace race;
+  NativeClient *client = native_client_.get();
+  std::thread sender;
+  try {
+    sender = std::thread([&] {
+      primary.code = client->SendQuery(
+          request, reader_options, primary.stream.get(), &primary.error,
+          &primary.rows_affected, &primary.size_hint, std::move(capture));
+      NativeClient *loser = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(race.mutex);
+        race.primary_done = true;
+        if (primary.code == ADBC_STATUS_OK && race.winner < 0) {
+          race.winner = 0;
+          loser = race.hedge;
+        }
+      }
+      race.cv.notify_all();
+      if (loser) {
+        loser->Cancel();
+      }
+    });
+  } catch (const std::system_error &) {
+    return native_client_->SendQuery(request, reader_options, out, error,
+                                     rows_affected, size_hint,
+                                     std::move(capture));
   }
 
-  if (!schema) {
-    return status::InvalidArgument("Schema pointer cannot be null");
+  bool answered;
+  {
+    std::unique_lock<std::mutex> lock(race.mutex);
+    answered = race.cv.wait_for(lock, hedge_after,
+                                [&] { return race.primary_done; });
+  }
+  std::unique_ptr<NativeClient> hedge;
+  size_t hedge_endpoint = 0;
+  if (!answered) {
+    struct AdbcError start_error = ADBC_ERROR_INIT;
+    Status started = StartNativeSession(&hedge, &hedge_endpoint, &start_error,
+                                        {endpoint_});
+    if (start_error.release) {
+      start_error.release(&start_error);
+    }
+    if (!started.ok()) {
+      // No other server to ask; the primary answers alone
+      hedge.reset();
+    }
+  }
+  HedgeLeg second;
+  if (hedge) {
+    {
+      std::lock_guard<std::mutex> lock(race.mutex);
+      if (!race.primary_done) {
+        race.hedge = hedge.get();
+      }
+    }
+    if (race.hedge) {
+      CubeMetrics::Global().hedges.fetch_add(1, std::memory_order_relaxed);
+      QueryRequest hedge_request = request;
+      if (!hedge_request.statement_id.empty()) {
+        // Statements are prepared on one session only
+        hedge_request.statement_id.clear();
+        hedge_request.sql = sql;
+      }
+      second.code = hedge->SendQuery(hedge_request, reader_options,
+                                     second.stream.get(), &second.error,
+                                     &second.rows_affected,
+                                     &second.size_hint);
+      bool cancel_primary = false;
+      {
+        std::lock_guard<std::mutex> lock(race.mutex);
+        if (second.code == ADBC_STATUS_OK && race.winner < 0) {
+          race.winner = 1;
+          cancel_primary = !race.primary_done;
+        }
+      }
+      if (cancel_primary) {
+        native_client_->Cancel();
+      }
+    }
+  }
+  // The sender may still be cancelling the hedge
+  sender.join();
+
+  if (race.winner == 1) {
+    // The primary's server took at least this long
+    endpoints_->RecordLatency(endpoint_,
+                              std::chrono::steady_clock::now() - start);
+    primary.stream.reset();
+    EndNativeSession(std::move(native_client_), endpoint_);
+    native_client_ = std::move(hedge);
+    endpoint_ = hedge_endpoint;
+    session_++;
+    CubeMetrics::Global().hedge_wins.fetch_add(1, std::memory_order_relaxed);
+    return second.MoveTo(out, error, rows_affected, size_hint);
+  }
+  if (hedge) {
+    second.stream.reset();
+    EndNativeSession(std::move(hedge), hedge_endpoint);
+  }
+  return primary.MoveTo(out, error, rows_affected, size_hint);
+}
+
+Status CubeConnectionImpl::SetToken(std::string token,
+                                    struct AdbcError *error) {
+  auto lock = LockSession();
+  UNWRAP_STATUS(SwitchToken(std::move(token), error));
+  // The connection's own token is not replaced by the database's renewals
+  token_source_.reset();
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::SwitchToken(std::string token,
+                                       struct AdbcError *error) {
+  if (token == token_) {
+    return status::Ok();
+  }
+  if (!native_client_) {
+    return status::NotImplemented(
+        "adbc.cube.token can only be changed on a connection in native mode");
   }
+  if (token.empty()) {
+    return status::InvalidArgument("Native connection mode requires a token");
+  }
+  if (native_client_->IsConnected()) {
+    AdbcStatusCode code =
+        native_client_->SetSecurityContext(token, database_, error);
+    if (code != ADBC_STATUS_OK) {
+      return Status::FromAdbc(code, *error);
+    }
+  }
+  // A lost session is replaced under the new token by the next request
+  token_ = std::move(token);
+  context_++;
+  // Tables visible to the old token may not be to the new one
+  if (table_schema_cache_) {
+    table_schema_cache_->Clear();
+  }
+  return status::Ok();
+}
 
-  // Query information_schema.columns to get table metadata
-  // Cube SQL follows PostgreSQL conventions for information_schema
-  std::string query = "SELECT column_name, data_type, is_nullable "
-                      "FROM information_schema.columns "
-                      "WHERE table_name = '" +
-    // TODO avoid SQL injection here: use parameters
-                      table_name + "'";
+std::optional<std::string>
+CubeConnectionImpl::server_parameter(std::string_view key) const {
+  if (!native_client_) {
+    return std::nullopt;
+  }
+  for (const auto &[name, value] : native_client_->GetServerParameters()) {
+    if (name == key) {
+      return value;
+    }
+  }
+  return std::nullopt;
+}
 
-  if (!table_schema.empty()) {
-    // TODO avoid SQL injection here: use parameters
-    query += " AND table_schema = '" + table_schema + "'";
+std::string CubeConnectionImpl::endpoint() const {
+  if (!native_client_) {
+    return std::string();
   }
-  // TODO avoid SQL injection here: use parameters
-  query += " ORDER BY ordinal_position";
+  if (!endpoints_) {
+    return host_ + ":" + port_;
+  }
+  const CubeEndpoint &endpoint = endpoints_->endpoint(endpoint_);
+  return endpoint.host + ":" + endpoint.port;
+}
 
-  // Execute query to get column information
-  // TODO: Once ExecuteQuery is fully implemented, use it to fetch columns
-  // For now, return a placeholder empty schema structure
+Status CubeConnectionImpl::EnsureNativeSession(struct AdbcError *error) {
+  if (native_client_->IsInherited()) {
+    // Opened before the process forked; the parent keeps using it. The
+    // child opens its own whether or not reconnect is set.
+    native_client_->Abandon();
+    return ReconnectNative(/*failed=*/false, error);
+  }
+  if (token_source_) {
+    UNWRAP_STATUS(FollowTokenSource(error));
+  }
+  if (change_watcher_) {
+    uint64_t generation = change_watcher_->model_generation();
+    if (generation != model_generation_) {
+      // Schemas planned under the old data model may no longer hold
+      model_generation_ = generation;
+      ClearPreparedCache();
+      if (table_schema_cache_) {
+        table_schema_cache_->Clear();
+      }
+    }
+  }
+  if (!reconnect_) {
+    return status::Ok();
+  }
+  // A session with results still owed is in use, not idle
+  bool lost = !native_client_->IsConnected() ||
+              (native_client_->IsReusable() && !native_client_->IsHealthy());
+  if (!lost) {
+    return status::Ok();
+  }
+  return ReconnectNative(/*failed=*/false, error);
+}
 
-  MetadataBuilder builder;
+Status CubeConnectionImpl::WatchChanges(std::unique_ptr<NativeClient> *out,
+                                        struct AdbcError *error) {
+  if (connection_mode_ != ConnectionMode::Native) {
+    return status::NotImplemented(
+        "Change notifications require native connection mode");
+  }
+  auto lock = LockSession();
+  size_t endpoint = 0;
+  UNWRAP_STATUS(StartNativeSession(out, &endpoint, error));
+  AdbcStatusCode code = (*out)->WatchChanges(error);
+  if (code != ADBC_STATUS_OK) {
+    if (code == ADBC_STATUS_NOT_IMPLEMENTED) {
+      // Still idle, so another connection can have it
+      EndNativeSession(std::move(*out), endpoint);
+    }
+    out->reset();
+    return Status::FromAdbc(code, *error);
+  }
+  return status::Ok();
+}
 
-  // This is a placeholder - in production, we would:
-  // 1. Execute the information_schema query
-  // 2. Parse results
-  // 3. Add each column to the builder
-  // 4. Build the final schema
+Status CubeConnectionImpl::FollowTokenSource(struct AdbcError *error) {
+  std::string token = token_source_->token();
+  if (token == token_) {
+    return status::Ok();
+  }
+  // Results still owed are read under the old token, which lasts until it
+  // expires; the session switches at the first request after them
+  if (native_client_->IsConnected() && !native_client_->IsReusable()) {
+    return status::Ok();
+  }
+  if (!native_client_->IsConnected() ||
+      native_client_->SupportsSecurityContext()) {
+    return SwitchToken(std::move(token), error);
+  }
+  // The server cannot switch: take a session the pool already opened or
+  // switched under the new token, or open one
+  token_ = std::move(token);
+  context_++;
+  if (table_schema_cache_) {
+    table_schema_cache_->Clear();
+  }
+  return ReconnectNative(/*failed=*/false, error);
+}
 
-  *schema = builder.Build();
+Status CubeConnectionImpl::ReconnectNative(bool failed,
+                                           struct AdbcError *error) {
+  if (failed && endpoints_) {
+    endpoints_->MarkFailed(endpoint_);
+  }
+  // The server may still hold the lost session for the new one to resume
+  if (pool_) {
+    pool_->KeepResumable(*native_client_, endpoint_);
+  }
+  std::unique_ptr<NativeClient> client;
+  size_t endpoint = 0;
+  UNWRAP_STATUS(StartNativeSession(&client, &endpoint, error));
+  // Results of the old session were already failed when its socket closed.
+  // Closed here so that the pool does not take it back, its ID being kept.
+  native_client_->Close();
+  EndNativeSession(std::move(native_client_), endpoint_);
+  native_client_ = std::move(client);
+  endpoint_ = endpoint;
+  session_++;
   return status::Ok();
 }
 
-// CubeConnection implementation
+bool CubeConnectionImpl::ShouldRetry(AdbcStatusCode code,
+                                     const std::string &sql) const {
+  // A timeout or server error would only happen again
+  return reconnect_ && code == ADBC_STATUS_IO &&
+         !native_client_->IsConnected() &&
+         IsCacheableQuery(NormalizeQueryText(sql));
+}
 
-Status CubeConnection::InitImpl(void *raw_connection) {
-  // raw_connection is the AdbcDatabase* passed from CConnectionInit
-  auto *cube_database = static_cast<CubeDatabase *>(raw_connection);
-  impl_ = std::make_unique<CubeConnectionImpl>(*cube_database);
+void CubeConnectionImpl::SetPrepared(const CubePreparedStatement &statement,
+                                     QueryRequest *request) const {
+  if (statement.session == session_ && statement.context == context_) {
+    request->statement_id = statement.handle;
+  } else {
+    request->sql = statement.sql;
+  }
+}
 
-  struct AdbcError error = ADBC_ERROR_INIT;
-  auto status = impl_->Connect(&error);
-  if (error.message) {
-    error.release(&error);
+std::unique_lock<std::recursive_mutex>
+CubeConnectionImpl::LockSession() const {
+  if (!session_mutex_) {
+    return std::unique_lock<std::recursive_mutex>();
   }
-  return status;
+  return std::unique_lock<std::recursive_mutex>(*session_mutex_);
 }
 
-Status CubeConnection::ReleaseImpl() {
-  if (impl_) {
-    struct AdbcError error = ADBC_ERROR_INIT;
-    auto status = impl_->Disconnect(&error);
-    if (error.message) {
-      error.release(&error);
-    }
-    impl_.reset();
-    return status;
+Status CubeConnectionImpl::Admit(
+    std::shared_ptr<CubeAdmissionControl::Permit> *permit,
+    QueryPriority priority) {
+  if (!admission_ || *permit) {
+    return status::Ok();
+  }
+  // A query sent while an earlier result of the connection is open shares
+  // its slot: the results come back one after another on the session, and
+  // only this connection's reader could free the slot it would wait for
+  *permit = admitted_.lock();
+  if (*permit) {
+    return status::Ok();
+  }
+  std::string message;
+  if (!admission_->Acquire(AdmissionTier(priority), priority_, permit,
+                          &message)) {
+    return Status(ADBC_STATUS_TIMEOUT, std::move(message));
+  }
+  admitted_ = *permit;
+  return status::Ok();
+}
+
+void CubeConnectionImpl::GuardStream(
+    struct ArrowArrayStream *stream,
+    std::shared_ptr<CubeAdmissionControl::Permit> permit) const {
+  if (permit && stream->release) {
+    (new AdmittedStream(std::move(permit), stream))->ExportTo(stream);
+  }
+  if (session_mutex_ && stream->release) {
+    (new LockedStream(session_mutex_, stream))->ExportTo(stream);
+  }
+}
+
+Status CubeConnectionImpl::Disconnect(struct AdbcError *error) {
+  std::vector<std::shared_ptr<CubeAsyncStream>> async_streams;
+  {
+    auto lock = LockSession();
+    async_streams.swap(async_streams_);
+  }
+  for (const auto &async_stream : async_streams) {
+    async_stream->Abort(ECANCELED, "Connection closed");
+  }
+  auto lock = LockSession();
+  if (connection_mode_ == ConnectionMode::Native) {
+    if (native_client_) {
+      // A pooled session is handed on without the cache's statements
+      ClearPreparedCache();
+      EndNativeSession(std::move(native_client_), endpoint_);
+      native_client_.reset();
+    }
+  } else {
+    if (conn_) {
+      PQfinish(conn_);
+      conn_ = nullptr;
+    }
+  }
+  if (connected_) {
+    CubeMetrics::Global().active_connections.fetch_sub(
+        1, std::memory_order_relaxed);
+  }
+  connected_ = false;
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteQuery(const std::string &query,
+                                        struct ArrowArrayStream *out,
+                                        struct AdbcError *error) {
+  return ExecuteQuery(query, reader_options_, out, error);
+}
+
+Status CubeConnectionImpl::ExecuteQuery(const std::string &query,
+                                        const CubeReaderOptions &reader_options,
+                                        struct ArrowArrayStream *out,
+                                        struct AdbcError *error,
+                                        const CubeQueryParameters *parameters,
+                                        int64_t *rows_affected,
+                                        ResultSizeHint *size_hint) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (size_hint) {
+    *size_hint = ResultSizeHint();
+  }
+
+  // Use native client if available (Arrow Native protocol)
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    bool sampled = Sampled(reader_options);
+    if (sampled && reader_options.sample_refine) {
+      return ExecuteRefined(query, reader_options, parameters, out, error);
+    }
+    std::shared_ptr<CubeAdmissionControl::Permit> permit;
+    for (bool retried = false;; retried = true) {
+      std::unique_ptr<CubeResultCapture> capture;
+      bool shared = false;
+      // Versioned and sampled results bypass the result cache
+      std::string delta_key =
+          DeltaCacheKey(query, parameters, reader_options);
+      if (delta_key.empty() && !sampled &&
+          FindCachedResult(query, parameters, reader_options, out,
+                           rows_affected, &capture, &shared)) {
+        PrefetchDrillDown(query, parameters, reader_options);
+        return status::Ok();
+      }
+      if (!reader_options.json_query) {
+        RouteByAffinity(query, reader_options);
+      }
+      UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+      QueryRequest request;
+      auto prepared = reader_options.json_query ? nullptr
+                                                : PreparedForQuery(query);
+      if (prepared) {
+        SetPrepared(*prepared, &request);
+      } else if (reader_options.json_query) {
+        request.json_query = query;
+      } else {
+        request.sql = query;
+      }
+      if (parameters) {
+        request.parameters = parameters->arrow_ipc;
+      }
+      SetSample(reader_options, &request);
+      auto start = std::chrono::steady_clock::now();
+      auto status_code =
+          delta_key.empty()
+              ? SendNativeQuery(request, query, reader_options, out, error,
+                                rows_affected, size_hint, std::move(capture),
+                                shared)
+              : SendDeltaQuery(std::move(request), delta_key, reader_options,
+                               out, error, rows_affected);
+      if (status_code == ADBC_STATUS_INVALID_STATE && prepared && !retried) {
+        // Planned against an earlier data model; sent as text instead
+        ForgetPrepared(query);
+        if (error->release) {
+          error->release(error);
+        }
+        continue;
+      }
+      if (status_code == ADBC_STATUS_OK) {
+        RecordLatency(start);
+        GuardStream(out, std::move(permit));
+        if (sampled) {
+          ApproximateArrayStream(SampleMetadata(reader_options), out,
+                                 nullptr);
+        }
+        PrefetchDrillDown(query, parameters, reader_options);
+        if (shared) {
+          // Connections waiting on this query need the whole result; a
+          // failure here is reported by out
+          struct AdbcError ignored = ADBC_ERROR_INIT;
+          native_client_->ReadPendingResponses(&ignored);
+          if (ignored.release) {
+            ignored.release(&ignored);
+          }
+        }
+        return status::Ok();
+      }
+      if (retried || !ShouldRetry(status_code, query)) {
+        // Error already set by native client, preserve the detailed message
+        return Status::FromAdbc(status_code, *error);
+      }
+      UNWRAP_STATUS(ReconnectNative(/*failed=*/true, error));
+    }
+  }
+
+  if (!conn_) {
+    return status::InvalidState("No PostgreSQL protocol connection");
+  }
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+  PostgresQuery postgres_query;
+  postgres_query.sql = query;
+  postgres_query.params = parameters ? &parameters->postgres : nullptr;
+  auto status_code = ExecutePostgresQuery(
+      conn_, postgres_query, DEFAULT_POSTGRES_BATCH_ROWS,
+      postgres_arrow_output_ ? &reader_options : nullptr, out, error,
+      rows_affected);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  GuardStream(out, std::move(permit));
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteUpdate(
+    const std::string &query, const CubePreparedStatement *statement,
+    const CubeQueryParameters *parameters, int64_t *rows_affected,
+    struct AdbcError *error, CubeIpcExporter *exporter, bool view_types,
+    QueryPriority priority, bool require_preaggregation) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  bool prepared = statement && !statement->handle.empty();
+  // Held until the update has completed
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, priority));
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    QueryRequest request;
+    request.priority = priority;
+    if (exporter && view_types) {
+      request.flags |= QUERY_FLAG_VIEW_TYPES;
+    }
+    if (require_preaggregation) {
+      request.flags |= QUERY_FLAG_REQUIRE_PREAGGREGATION;
+    }
+    if (prepared) {
+      SetPrepared(*statement, &request);
+    } else {
+      request.sql = query;
+    }
+    if (parameters) {
+      request.parameters = parameters->arrow_ipc;
+    }
+    NativeResumePoint resume;
+    auto status_code = native_client_->ExecuteUpdate(request, rows_affected,
+                                                     error, exporter, &resume);
+    // An export cut off with the socket is taken up where it stopped, if the
+    // server kept its result and the new session resumes the lost one
+    std::string session_id = native_client_->GetSessionId();
+    while (status_code == ADBC_STATUS_IO && exporter && reconnect_ &&
+           !resume.handle.empty() && !native_client_->IsConnected()) {
+      int64_t batches = resume.batches;
+      UNWRAP_STATUS(ReconnectNative(/*failed=*/true, error));
+      if (native_client_->GetSessionId() != session_id) {
+        return status::IO("Connection lost during export and the session "
+                          "could not be resumed");
+      }
+      status_code = native_client_->ExecuteUpdate(request, rows_affected,
+                                                  error, exporter, &resume);
+      if (resume.batches == batches) {
+        break; // No progress, so do not try again
+      }
+    }
+    if (status_code != ADBC_STATUS_OK) {
+      return Status::FromAdbc(status_code, *error);
+    }
+    // An exported result is read, not a change
+    if (!exporter) {
+      InvalidateCaches();
+    }
+    return status::Ok();
+  }
+
+  if (!conn_) {
+    return status::InvalidState("No PostgreSQL protocol connection");
+  }
+  if (exporter) {
+    return status::NotImplemented(
+        "Exporting Arrow IPC requires native connection mode");
+  }
+  PostgresQuery postgres_query;
+  if (prepared) {
+    postgres_query.statement_name = statement->handle;
+  } else {
+    postgres_query.sql = query;
+  }
+  postgres_query.params = parameters ? &parameters->postgres : nullptr;
+  auto status_code =
+      ExecutePostgresUpdate(conn_, postgres_query, rows_affected, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  InvalidateCaches();
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteUpdateBatch(
+    const std::string &query, const CubePreparedStatement *statement,
+    const std::vector<CubeQueryParameters> &parameters,
+    int64_t *rows_affected, struct AdbcError *error, QueryPriority priority) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (native_client_ || !conn_ || !LibpqHasPipelineMode()) {
+    return status::NotImplemented("Batched updates need libpq pipeline mode");
+  }
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, priority));
+  bool prepared = statement && !statement->handle.empty();
+  std::vector<PostgresQuery> postgres_queries(parameters.size());
+  for (size_t i = 0; i < parameters.size(); i++) {
+    if (prepared) {
+      postgres_queries[i].statement_name = statement->handle;
+    } else {
+      postgres_queries[i].sql = query;
+    }
+    postgres_queries[i].params = &parameters[i].postgres;
+  }
+  auto status_code = ExecutePostgresPipelineUpdate(conn_, postgres_queries,
+                                                   rows_affected, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  InvalidateCaches();
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::Prepare(const std::string &query,
+                                   CubePreparedStatement *statement,
+                                   struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  statement->handle.clear();
+  statement->sql = query;
+  statement->parameter_types.clear();
+  statement->result_schema.reset();
+  statement->parameter_schema.reset();
+  statement->cached.reset();
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    if (!native_client_->SupportsPrepare()) {
+      return status::Ok();
+    }
+    auto cached = FindPrepared(query);
+    if (cached) {
+      prepared_cache_hits_++;
+    } else if (prepared_cache_entries_ > 0) {
+      auto status_code = PrepareCached(query, &cached, error);
+      if (status_code != ADBC_STATUS_OK) {
+        return Status::FromAdbc(status_code, *error);
+      }
+    }
+    if (cached) {
+      statement->handle = cached->handle;
+      statement->session = cached->session;
+      statement->context = cached->context;
+      if ((cached->result_schema->release &&
+           ArrowSchemaDeepCopy(cached->result_schema.get(),
+                               statement->result_schema.get()) !=
+               NANOARROW_OK) ||
+          (cached->parameter_schema->release &&
+           ArrowSchemaDeepCopy(cached->parameter_schema.get(),
+                               statement->parameter_schema.get()) !=
+               NANOARROW_OK)) {
+        statement->handle.clear();
+        return status::Internal("Failed to copy the prepared schemas");
+      }
+      statement->cached = std::move(cached);
+      return status::Ok();
+    }
+    auto status_code = native_client_->Prepare(
+        query, &statement->handle, statement->result_schema.get(),
+        statement->parameter_schema.get(), error);
+    if (status_code != ADBC_STATUS_OK) {
+      return Status::FromAdbc(status_code, *error);
+    }
+    statement->session = session_;
+    statement->context = context_;
+    return status::Ok();
+  }
+
+  if (!conn_) {
+    return status::InvalidState("No PostgreSQL protocol connection");
+  }
+  std::string name = "adbc_cube_" + std::to_string(++statements_prepared_);
+  auto status_code = PreparePostgresStatement(
+      conn_, name, query, statement->result_schema.get(),
+      statement->parameter_schema.get(), &statement->parameter_types, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  statement->handle = std::move(name);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecutePrepared(
+    const CubePreparedStatement &statement,
+    const CubeReaderOptions &reader_options, struct ArrowArrayStream *out,
+    struct AdbcError *error, const CubeQueryParameters *parameters,
+    int64_t *rows_affected, ResultSizeHint *size_hint) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (size_hint) {
+    *size_hint = ResultSizeHint();
+  }
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    std::shared_ptr<CubeAdmissionControl::Permit> permit;
+    bool stale = false; // The statement's handle was rejected
+    for (bool retried = false;; retried = true) {
+      std::unique_ptr<CubeResultCapture> capture;
+      bool shared = false;
+      // Versioned results bypass the result cache
+      std::string delta_key =
+          DeltaCacheKey(statement.sql, parameters, reader_options);
+      if (delta_key.empty() &&
+          FindCachedResult(statement.sql, parameters, reader_options, out,
+                           rows_affected, &capture, &shared)) {
+        PrefetchDrillDown(statement.sql, parameters, reader_options);
+        return status::Ok();
+      }
+      UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+      QueryRequest request;
+      // The cache's entry is newer if the statement's went stale
+      auto current = statement.cached ? FindPrepared(statement.sql) : nullptr;
+      if (current) {
+        SetPrepared(*current, &request);
+      } else if (stale) {
+        request.sql = statement.sql;
+      } else {
+        SetPrepared(statement, &request);
+      }
+      bool by_handle = !request.statement_id.empty();
+      if (parameters) {
+        request.parameters = parameters->arrow_ipc;
+      }
+      auto start = std::chrono::steady_clock::now();
+      auto status_code =
+          delta_key.empty()
+              ? SendNativeQuery(request, statement.sql, reader_options, out,
+                                error, rows_affected, size_hint,
+                                std::move(capture), shared)
+              : SendDeltaQuery(std::move(request), delta_key, reader_options,
+                               out, error, rows_affected);
+      if (status_code == ADBC_STATUS_INVALID_STATE && by_handle && !stale) {
+        // Planned against an earlier data model: prepared again for later
+        // executions if it came from the cache, and sent again now
+        stale = true;
+        ForgetPrepared(statement.sql);
+        if (statement.cached) {
+          std::shared_ptr<const CubePreparedStatement> fresh;
+          struct AdbcError ignored = ADBC_ERROR_INIT;
+          PrepareCached(statement.sql, &fresh, &ignored);
+          if (ignored.release) {
+            ignored.release(&ignored);
+          }
+        }
+        if (error->release) {
+          error->release(error);
+        }
+        continue;
+      }
+      if (status_code == ADBC_STATUS_OK) {
+        RecordLatency(start);
+        GuardStream(out, std::move(permit));
+        PrefetchDrillDown(statement.sql, parameters, reader_options);
+        if (shared) {
+          // Connections waiting on this query need the whole result; a
+          // failure here is reported by out
+          struct AdbcError ignored = ADBC_ERROR_INIT;
+          native_client_->ReadPendingResponses(&ignored);
+          if (ignored.release) {
+            ignored.release(&ignored);
+          }
+        }
+        return status::Ok();
+      }
+      if (retried || !ShouldRetry(status_code, statement.sql)) {
+        return Status::FromAdbc(status_code, *error);
+      }
+      UNWRAP_STATUS(ReconnectNative(/*failed=*/true, error));
+    }
+  }
+
+  if (!conn_) {
+    return status::InvalidState("No PostgreSQL protocol connection");
+  }
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+  PostgresQuery postgres_query;
+  postgres_query.statement_name = statement.handle;
+  postgres_query.params = parameters ? &parameters->postgres : nullptr;
+  auto status_code = ExecutePostgresQuery(
+      conn_, postgres_query, DEFAULT_POSTGRES_BATCH_ROWS,
+      postgres_arrow_output_ ? &reader_options : nullptr, out, error,
+      rows_affected);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  GuardStream(out, std::move(permit));
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteRefined(
+    const std::string &query, const CubeReaderOptions &reader_options,
+    const CubeQueryParameters *parameters, struct ArrowArrayStream *out,
+    struct AdbcError *error) {
+  // Both are written before the sample is read, so the server works on the
+  // exact result while the preview is being looked at
+  std::vector<QueryRequest> requests(2);
+  for (auto &request : requests) {
+    if (reader_options.json_query) {
+      request.json_query = query;
+    } else {
+      request.sql = query;
+    }
+    if (parameters) {
+      request.parameters = parameters->arrow_ipc;
+    }
+  }
+  SetSample(reader_options, &requests[0]);
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+  std::vector<ArrowArrayStream> sent;
+  auto status_code =
+      native_client_->SendQueries(requests, reader_options, &sent, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  for (auto &stream : sent) {
+    GuardStream(&stream, permit);
+  }
+  ArrowArrayStreamMove(&sent[0], out);
+  ApproximateArrayStream(SampleMetadata(reader_options), out, &sent[1]);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteQueries(
+    const std::vector<std::string> &queries, struct ArrowArrayStream *out,
+    struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (!native_client_) {
+    if (!conn_) {
+      return status::InvalidState("No PostgreSQL protocol connection");
+    }
+    std::vector<PostgresQuery> postgres_queries(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+      postgres_queries[i].sql = queries[i];
+    }
+    std::shared_ptr<CubeAdmissionControl::Permit> permit;
+    UNWRAP_STATUS(Admit(&permit));
+    std::vector<ArrowArrayStream> sent;
+    auto status_code = ExecutePostgresPipeline(
+        conn_, postgres_queries, DEFAULT_POSTGRES_BATCH_ROWS,
+        postgres_arrow_output_ ? &reader_options_ : nullptr, &sent, error);
+    if (status_code == ADBC_STATUS_NOT_IMPLEMENTED) {
+      return status::NotImplemented(
+          "Running queries together in PostgreSQL mode requires libpq 14 "
+          "or later");
+    } else if (status_code != ADBC_STATUS_OK) {
+      return Status::FromAdbc(status_code, *error);
+    }
+    for (size_t i = 0; i < sent.size(); i++) {
+      ArrowArrayStreamMove(&sent[i], &out[i]);
+      GuardStream(&out[i], permit);
+    }
+    return status::Ok();
+  }
+  UNWRAP_STATUS(EnsureNativeSession(error));
+  std::vector<QueryRequest> requests(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) {
+    requests[i].sql = queries[i];
+  }
+  // The queries share one slot, freed once every result has been read
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit));
+  CubeReaderOptions reader_options = reader_options_;
+  reader_options.require_preaggregation = require_preaggregation_;
+  std::vector<ArrowArrayStream> sent;
+  auto status_code =
+      native_client_->SendQueries(requests, reader_options, &sent, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  for (size_t i = 0; i < sent.size(); i++) {
+    ArrowArrayStreamMove(&sent[i], &out[i]);
+    GuardStream(&out[i], permit);
+  }
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteBatch(
+    const std::string &query, const CubePreparedStatement *statement,
+    const CubeReaderOptions &reader_options,
+    std::shared_ptr<const std::vector<CubeQueryParameters>> parameters,
+    struct ArrowArrayStream *out, struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  std::string handle = statement ? statement->handle : std::string();
+  size_t count = parameters->size();
+  ConcatenatedStream::OpenFn open;
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    // Every execution is written before the first result is read, so the
+    // batch costs one round trip instead of one per row
+    std::vector<QueryRequest> requests(count);
+    for (size_t i = 0; i < count; i++) {
+      if (handle.empty()) {
+        requests[i].sql = query;
+      } else {
+        SetPrepared(*statement, &requests[i]);
+      }
+      requests[i].parameters = (*parameters)[i].arrow_ipc;
+    }
+    // The executions share one slot, freed once every result has been read
+    std::shared_ptr<CubeAdmissionControl::Permit> permit;
+    UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+    std::vector<ArrowArrayStream> sent;
+    auto status_code =
+        native_client_->SendQueries(requests, reader_options, &sent, error);
+    if (status_code != ADBC_STATUS_OK) {
+      return Status::FromAdbc(status_code, *error);
+    }
+    auto streams =
+        std::make_shared<std::vector<nanoarrow::UniqueArrayStream>>(count);
+    for (size_t i = 0; i < count; i++) {
+      ArrowArrayStreamMove(&sent[i], (*streams)[i].get());
+      GuardStream((*streams)[i].get(), permit);
+    }
+    open = [streams](size_t index, struct ArrowArrayStream *stream,
+                     AdbcError *) {
+      ArrowArrayStreamMove((*streams)[index].get(), stream);
+      return ADBC_STATUS_OK;
+    };
+  } else {
+    if (!conn_) {
+      return status::InvalidState("No PostgreSQL protocol connection");
+    }
+    std::vector<PostgresQuery> postgres_queries(count);
+    for (size_t i = 0; i < count; i++) {
+      if (handle.empty()) {
+        postgres_queries[i].sql = query;
+      } else {
+        postgres_queries[i].statement_name = handle;
+      }
+      postgres_queries[i].params = &(*parameters)[i].postgres;
+    }
+    // In pipeline mode every execution is sent before the first result is
+    // read, as in native mode
+    std::shared_ptr<CubeAdmissionControl::Permit> permit;
+    UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+    std::vector<ArrowArrayStream> sent;
+    auto status_code = ExecutePostgresPipeline(
+        conn_, postgres_queries, DEFAULT_POSTGRES_BATCH_ROWS,
+        postgres_arrow_output_ ? &reader_options : nullptr, &sent, error);
+    if (status_code == ADBC_STATUS_OK) {
+      auto streams =
+          std::make_shared<std::vector<nanoarrow::UniqueArrayStream>>(count);
+      for (size_t i = 0; i < count; i++) {
+        ArrowArrayStreamMove(&sent[i], (*streams)[i].get());
+        GuardStream((*streams)[i].get(), permit);
+      }
+      open = [streams](size_t index, struct ArrowArrayStream *stream,
+                       AdbcError *) {
+        ArrowArrayStreamMove((*streams)[index].get(), stream);
+        return ADBC_STATUS_OK;
+      };
+    } else if (status_code != ADBC_STATUS_NOT_IMPLEMENTED) {
+      return Status::FromAdbc(status_code, *error);
+    }
+  }
+
+  if (!open) {
+    if (error->release) {
+      error->release(error);
+    }
+    // Without pipeline mode libpq streams rows one query at a time, so
+    // each execution is sent when the previous result has been read
+    PGconn *conn = conn_;
+    bool arrow_output = postgres_arrow_output_;
+    open = [conn, params = std::move(parameters), query, handle,
+            reader_options, arrow_output](size_t index,
+                                          struct ArrowArrayStream *stream,
+                                          AdbcError *open_error) {
+      PostgresQuery postgres_query;
+      if (handle.empty()) {
+        postgres_query.sql = query;
+      } else {
+        postgres_query.statement_name = handle;
+      }
+      postgres_query.params = &(*params)[index].postgres;
+      return ExecutePostgresQuery(conn, postgres_query,
+                                  DEFAULT_POSTGRES_BATCH_ROWS,
+                                  arrow_output ? &reader_options : nullptr,
+                                  stream, open_error);
+    };
+  }
+
+  auto stream = std::make_unique<ConcatenatedStream>(count, std::move(open));
+  // Open the first result now, so an error in it is reported here
+  ArrowSchema schema;
+  if (stream->GetSchema(&schema) != NANOARROW_OK) {
+    SetNativeClientError(error, stream->GetLastError());
+    return Status::FromAdbc(ADBC_STATUS_UNKNOWN, *error);
+  }
+  schema.release(&schema);
+  stream.release()->ExportTo(out);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecuteSchema(
+    const std::string &query, const CubeReaderOptions &reader_options,
+    struct ArrowSchema *schema, struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    if (native_client_->SupportsSchemaOnly()) {
+      QueryRequest request;
+      request.sql = query;
+      request.flags = QUERY_FLAG_SCHEMA_ONLY;
+      nanoarrow::UniqueArrayStream stream;
+      auto status_code =
+          native_client_->SendQuery(request, reader_options, stream.get(),
+                                    error);
+      if (status_code != ADBC_STATUS_OK) {
+        return Status::FromAdbc(status_code, *error);
+      }
+      if (stream->get_schema(stream.get(), schema) != NANOARROW_OK) {
+        const char *message = stream->get_last_error(stream.get());
+        return status::fmt::IO("Failed to read the result schema: {}",
+                               message ? message : "unknown error");
+      }
+      return status::Ok();
+    }
+  }
+
+  CubePreparedStatement statement;
+  UNWRAP_STATUS(Prepare(query, &statement, error));
+  ClosePrepared(statement);
+  if (!statement.result_schema->release) {
+    return status::NotImplemented(
+        "Server cannot report a result schema without running the query");
+  }
+  ArrowSchemaMove(statement.result_schema.get(), schema);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::EstimateQuery(
+    const std::string &query, const CubeReaderOptions &reader_options,
+    struct ArrowSchema *schema, CubeQueryEstimate *estimate,
+    struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (!native_client_) {
+    return status::NotImplemented(
+        "Query estimates require native connection mode");
+  }
+
+  UNWRAP_STATUS(EnsureNativeSession(error));
+  QueryRequest request;
+  request.sql = query;
+  ResultSizeHint size_hint;
+  std::optional<QueryDiagnostics> diagnostics;
+  auto status_code = native_client_->EstimateQuery(
+      request, reader_options, schema, &size_hint, &diagnostics, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  *estimate = CubeQueryEstimate();
+  estimate->size = size_hint;
+  if (diagnostics) {
+    estimate->uses_preaggregation = diagnostics->preaggregation.empty() ? 0 : 1;
+    estimate->preaggregation = std::move(diagnostics->preaggregation);
+  }
+  return status::Ok();
+}
+
+void CubeConnectionImpl::ClosePrepared(const CubePreparedStatement &statement) {
+  auto lock = LockSession();
+  // A cached handle stays open while the cache or another statement holds
+  // it
+  if (statement.cached && statement.cached.use_count() > 1) {
+    return;
+  }
+  CloseHandle(statement);
+}
+
+void CubeConnectionImpl::CloseHandle(const CubePreparedStatement &statement) {
+  if (statement.handle.empty() || !connected_) {
+    return;
+  }
+  if (native_client_) {
+    if (statement.session == session_) {
+      native_client_->ClosePrepared(statement.handle);
+    }
+  } else if (conn_) {
+    ClosePostgresStatement(conn_, statement.handle);
+  }
+}
+
+std::shared_ptr<const CubePreparedStatement>
+CubeConnectionImpl::FindPrepared(const std::string &sql) {
+  if (prepared_cache_.empty()) {
+    return nullptr;
+  }
+  auto it = prepared_cache_.find(FingerprintSql(sql).ToHex());
+  if (it == prepared_cache_.end() || !it->second.statement) {
+    return nullptr;
+  }
+  const auto &statement = it->second.statement;
+  if (statement->session != session_ || statement->context != context_) {
+    ForgetPrepared(sql);
+    return nullptr;
+  }
+  prepared_keys_.splice(prepared_keys_.begin(), prepared_keys_,
+                        it->second.key);
+  return statement;
+}
+
+AdbcStatusCode CubeConnectionImpl::PrepareCached(
+    const std::string &sql, std::shared_ptr<const CubePreparedStatement> *out,
+    struct AdbcError *error) {
+  auto statement = std::make_shared<CubePreparedStatement>();
+  statement->sql = sql;
+  auto status_code = native_client_->Prepare(
+      sql, &statement->handle, statement->result_schema.get(),
+      statement->parameter_schema.get(), error);
+  if (status_code != ADBC_STATUS_OK) {
+    return status_code;
+  }
+  statement->session = session_;
+  statement->context = context_;
+
+  std::string key = FingerprintSql(sql).ToHex();
+  ForgetPrepared(sql);
+  EvictPrepared();
+  prepared_keys_.push_front(key);
+  prepared_cache_[key] = {statement, prepared_keys_.begin()};
+  *out = std::move(statement);
+  return ADBC_STATUS_OK;
+}
+
+std::shared_ptr<const CubePreparedStatement>
+CubeConnectionImpl::PreparedForQuery(const std::string &sql) {
+  // Pipelined sends return before a stale statement could be retried
+  if (prepared_cache_entries_ == 0 || pipelining_ ||
+      !native_client_->SupportsPrepare()) {
+    return nullptr;
+  }
+  auto statement = FindPrepared(sql);
+  if (statement) {
+    prepared_cache_hits_++;
+    return statement;
+  }
+  std::string key = FingerprintSql(sql).ToHex();
+  auto it = prepared_cache_.find(key);
+  if (it != prepared_cache_.end()) {
+    // Run before: worth planning once for every later run. A query that
+    // fails to prepare is sent as text, for its own error to be reported.
+    struct AdbcError ignored = ADBC_ERROR_INIT;
+    PrepareCached(sql, &statement, &ignored);
+    if (ignored.release) {
+      ignored.release(&ignored);
+    }
+    return statement;
+  }
+  EvictPrepared();
+  prepared_keys_.push_front(key);
+  prepared_cache_[key] = {nullptr, prepared_keys_.begin()};
+  return nullptr;
+}
+
+void CubeConnectionImpl::EvictPrepared() {
+  while (prepared_cache_.size() >= prepared_cache_entries_) {
+    auto oldest = prepared_cache_.find(prepared_keys_.back());
+    if (oldest->second.statement &&
+        oldest->second.statement.use_count() == 1) {
+      CloseHandle(*oldest->second.statement);
+    }
+    prepared_cache_.erase(oldest);
+    prepared_keys_.pop_back();
+  }
+}
+
+void CubeConnectionImpl::ForgetPrepared(const std::string &sql) {
+  auto it = prepared_cache_.find(FingerprintSql(sql).ToHex());
+  if (it == prepared_cache_.end()) {
+    return;
+  }
+  if (it->second.statement && it->second.statement.use_count() == 1) {
+    CloseHandle(*it->second.statement);
+  }
+  prepared_keys_.erase(it->second.key);
+  prepared_cache_.erase(it);
+}
+
+void CubeConnectionImpl::ClearPreparedCache() {
+  for (const auto &[key, entry] : prepared_cache_) {
+    if (entry.statement && entry.statement.use_count() == 1) {
+      CloseHandle(*entry.statement);
+    }
+  }
+  prepared_cache_.clear();
+  prepared_keys_.clear();
+}
+
+Status CubeConnectionImpl::ExecutePartitions(
+    const std::string &query, uint32_t max_partitions,
+    struct ArrowSchema *schema, std::vector<std::string> *partitions,
+    struct AdbcError *error) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  partitions->clear();
+
+  if (native_client_) {
+    UNWRAP_STATUS(EnsureNativeSession(error));
+    if (native_client_->SupportsPartitions()) {
+      std::vector<std::string> server_partitions;
+      auto status_code = native_client_->Partition(
+          query, max_partitions, schema, &server_partitions, error);
+      if (status_code != ADBC_STATUS_OK) {
+        return Status::FromAdbc(status_code, *error);
+      }
+      partitions->reserve(server_partitions.size());
+      for (const auto &partition : server_partitions) {
+        partitions->push_back(kServerPartition + partition);
+      }
+      return status::Ok();
+    }
+  }
+
+  // A single partition holding the query. Its schema comes from preparing
+  // it, or from starting it when the server cannot tell before it runs.
+  CubePreparedStatement statement;
+  UNWRAP_STATUS(Prepare(query, &statement, error));
+  ClosePrepared(statement);
+  if (statement.result_schema->release) {
+    ArrowSchemaMove(statement.result_schema.get(), schema);
+  } else {
+    nanoarrow::UniqueArrayStream stream;
+    UNWRAP_STATUS(ExecuteQuery(query, stream.get(), error));
+    int code = ArrowArrayStreamGetSchema(stream.get(), schema, nullptr);
+    if (code != NANOARROW_OK) {
+      return status::fmt::IO("Failed to read the result schema: {}",
+                             std::strerror(code));
+    }
+  }
+  partitions->push_back(kSqlPartition + query);
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::ExecutePartitionsIncremental(
+    const std::string &query, uint32_t max_partitions,
+    struct ArrowSchema *schema, std::vector<std::string> *partitions,
+    std::unique_ptr<CubeIncrementalPartitions> *state,
+    struct AdbcError *error) {
+  partitions->clear();
+  if (*state && (*state)->done) {
+    // Every partition was handed out: none are left, and the next call
+    // executes the query again
+    int code = ArrowSchemaDeepCopy((*state)->schema.get(), schema);
+    state->reset();
+    if (code != NANOARROW_OK) {
+      return status::fmt::IO("Failed to copy the result schema: {}",
+                             std::strerror(code));
+    }
+    return status::Ok();
+  }
+
+  std::vector<std::string> server_partitions;
+  bool more = false;
+  if (!*state) {
+    auto lock = LockSession();
+    if (!connected_) {
+      return status::InvalidState("Connection not established");
+    }
+    bool incremental = false;
+    if (native_client_) {
+      UNWRAP_STATUS(EnsureNativeSession(error));
+      incremental = native_client_->SupportsIncrementalPartitions();
+    }
+    auto next = std::make_unique<CubeIncrementalPartitions>();
+    if (!incremental) {
+      UNWRAP_STATUS(ExecutePartitions(query, max_partitions,
+                                      next->schema.get(), partitions, error));
+    } else {
+      // A session of its own, so that this one stays free to read the
+      // partitions while the server sends the rest
+      UNWRAP_STATUS(StartNativeSession(&next->client, &next->endpoint, error));
+      auto status_code = next->client->Partition(
+          query, max_partitions, next->schema.get(), &server_partitions,
+          error, &more);
+      if (status_code != ADBC_STATUS_OK) {
+        EndNativeSession(std::move(next->client), next->endpoint);
+        return Status::FromAdbc(status_code, *error);
+      }
+    }
+    *state = std::move(next);
+  } else {
+    auto status_code =
+        (*state)->client->NextPartitions(&server_partitions, &more, error);
+    if (status_code != ADBC_STATUS_OK) {
+      EndIncrementalPartitions(state);
+      return Status::FromAdbc(status_code, *error);
+    }
+  }
+
+  auto &current = **state;
+  for (const auto &partition : server_partitions) {
+    partitions->push_back(kServerPartition + partition);
+  }
+  current.returned += static_cast<int64_t>(partitions->size());
+  if (!more) {
+    current.done = true;
+    if (current.client) {
+      EndNativeSession(std::move(current.client), current.endpoint);
+    }
+  }
+  int code = ArrowSchemaDeepCopy(current.schema.get(), schema);
+  if (code != NANOARROW_OK) {
+    return status::fmt::IO("Failed to copy the result schema: {}",
+                           std::strerror(code));
+  }
+  return status::Ok();
+}
+
+void CubeConnectionImpl::EndIncrementalPartitions(
+    std::unique_ptr<CubeIncrementalPartitions> *state) {
+  if (*state && (*state)->client) {
+    // Partitions are still owed on it, so the pool closes it
+    EndNativeSession(std::move((*state)->client), (*state)->endpoint);
+  }
+  state->reset();
+}
+
+Status CubeConnectionImpl::ReadPartition(std::string_view partition,
+                                         struct ArrowArrayStream *out,
+                                         struct AdbcError *error) {
+  auto lock = LockSession();
+  if (partition.empty() || (partition[0] != kServerPartition &&
+                            partition[0] != kSqlPartition)) {
+    return status::InvalidArgument("Not a partition of a Cube result");
+  }
+  std::string body(partition.substr(1));
+  if (partition[0] == kSqlPartition) {
+    return ExecuteQuery(body, out, error);
+  }
+
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (!native_client_) {
+    return status::InvalidState(
+        "Partitions split by the server can only be read in native mode");
+  }
+  UNWRAP_STATUS(EnsureNativeSession(error));
+  QueryRequest request;
+  request.partition = std::move(body);
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit));
+  for (bool retried = false;; retried = true) {
+    auto start = std::chrono::steady_clock::now();
+    auto status_code =
+        native_client_->SendQuery(request, reader_options_, out, error);
+    if (status_code == ADBC_STATUS_OK) {
+      RecordLatency(start);
+      GuardStream(out, std::move(permit));
+      return status::Ok();
+    }
+    // Partitions only read, so one lost with its session is sent again
+    if (retried || !reconnect_ || status_code != ADBC_STATUS_IO ||
+        native_client_->IsConnected()) {
+      return Status::FromAdbc(status_code, *error);
+    }
+    UNWRAP_STATUS(ReconnectNative(/*failed=*/true, error));
+  }
+}
+
+Status CubeConnectionImpl::ExecuteMergedPartitions(
+    const std::string &query, uint32_t max_partitions,
+    const std::string &sort_keys, const CubeReaderOptions &reader_options,
+    struct ArrowArrayStream *out, struct AdbcError *error) {
+  if (!native_client_) {
+    return status::NotImplemented(
+        "Merging partitions is only supported in native connection mode");
+  }
+  nanoarrow::UniqueSchema schema;
+  std::vector<std::string> partitions;
+  UNWRAP_STATUS(ExecutePartitions(query, max_partitions, schema.get(),
+                                  &partitions, error));
+  std::vector<CubeSortKey> keys;
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  if (ParseSortKeys(sort_keys, schema.get(), &keys, &arrow_error) !=
+      NANOARROW_OK) {
+    return status::fmt::InvalidArgument("adbc.cube.merge_sort_keys: {}",
+                                        arrow_error.message);
+  }
+  if (partitions.size() == 1) {
+    return ReadPartition(partitions[0], out, error);
+  }
+
+  auto lock = LockSession();
+  UNWRAP_STATUS(EnsureNativeSession(error));
+  std::shared_ptr<CubeAdmissionControl::Permit> permit;
+  UNWRAP_STATUS(Admit(&permit, reader_options.priority));
+  // The first partition is read on the connection's session, the others
+  // on sessions from the pool, or after it when none can be had
+  std::vector<nanoarrow::UniqueArrayStream> inputs(partitions.size());
+  for (size_t i = 0; i < partitions.size(); i++) {
+    QueryRequest request;
+    request.partition = partitions[i].substr(1);
+    std::unique_ptr<NativeClient> client;
+    size_t endpoint = 0;
+    if (i > 0) {
+      struct AdbcError start_error = ADBC_ERROR_INIT;
+      if (!StartNativeSession(&client, &endpoint, &start_error).ok()) {
+        client.reset();
+      }
+      if (start_error.release) {
+        start_error.release(&start_error);
+      }
+    }
+    NativeClient *sender = client ? client.get() : native_client_.get();
+    auto status_code =
+        sender->SendQuery(request, reader_options, inputs[i].get(), error);
+    if (status_code != ADBC_STATUS_OK) {
+      if (client) {
+        EndNativeSession(std::move(client), endpoint);
+      }
+      return Status::FromAdbc(status_code, *error);
+    }
+    if (client) {
+      if (endpoints_) {
+        endpoints_->Release(endpoint);
+      }
+      (new SessionStream(std::move(client), inputs[i].get()))
+          ->ExportTo(inputs[i].get());
+    }
+  }
+  MergeSortedStreams(std::move(inputs), std::move(keys), kMergeBatchRows,
+                     out);
+  GuardStream(out, std::move(permit));
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::Ingest(const std::string &db_schema,
+                                  const std::string &table, uint8_t mode,
+                                  struct ArrowArrayStream *data, int64_t *rows,
+                                  struct AdbcError *error, int64_t parallelism,
+                                  const std::string &partition_key) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (!native_client_) {
+    return status::NotImplemented(
+        "Bulk ingestion is only supported in native connection mode");
+  }
+  UNWRAP_STATUS(EnsureNativeSession(error));
+  IngestRequest request;
+  request.table = table;
+  request.db_schema = db_schema;
+  request.mode = mode;
+  if (parallelism > 1) {
+    if (!native_client_->SupportsStagedIngest()) {
+      return status::NotImplemented(
+          "Parallel ingestion requires a server that supports staged "
+          "ingestion");
+    }
+    UNWRAP_STATUS(IngestStaged(std::move(request), data, parallelism,
+                               partition_key, rows, error));
+    InvalidateCaches();
+    return status::Ok();
+  }
+  auto status_code =
+      native_client_->Ingest(std::move(request), data, rows, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  InvalidateCaches();
+  return status::Ok();
+}
+
+Status CubeConnectionImpl::IngestStaged(IngestRequest request,
+                                        struct ArrowArrayStream *data,
+                                        int64_t parallelism,
+                                        const std::string &partition_key,
+                                        int64_t *rows,
+                                        struct AdbcError *error) {
+  int64_t key_column = -1;
+  if (!partition_key.empty()) {
+    nanoarrow::UniqueSchema schema;
+    if (ArrowArrayStreamGetSchema(data, schema.get(), nullptr) !=
+        NANOARROW_OK) {
+      return status::InvalidArgument("Failed to get schema of data");
+    }
+    for (int64_t i = 0; i < schema->n_children; i++) {
+      const char *name = schema->children[i]->name;
+      if (name && partition_key == name) {
+        key_column = i;
+        break;
+      }
+    }
+    if (key_column < 0) {
+      return status::fmt::InvalidArgument(
+          "adbc.cube.ingest.partition_key: the data has no column '{}'",
+          partition_key);
+    }
+  }
+
+  // The native session loads one share; the others go to sessions from
+  // the pool, as many as can be had
+  struct Leg {
+    NativeClient *client = nullptr;
+    std::unique_ptr<NativeClient> owned;
+    size_t endpoint = 0;
+    nanoarrow::UniqueArrayStream data;
+    int64_t rows = 0;
+    AdbcStatusCode code = ADBC_STATUS_OK;
+    struct AdbcError error = ADBC_ERROR_INIT;
+  };
+  std::vector<Leg> legs(1);
+  legs[0].client = native_client_.get();
+  while (static_cast<int64_t>(legs.size()) < parallelism) {
+    Leg leg;
+    struct AdbcError start_error = ADBC_ERROR_INIT;
+    Status started =
+        StartNativeSession(&leg.owned, &leg.endpoint, &start_error);
+    if (start_error.release) {
+      start_error.release(&start_error);
+    }
+    if (!started.ok()) {
+      break;
+    }
+    if (!leg.owned->SupportsStagedIngest()) {
+      EndNativeSession(std::move(leg.owned), leg.endpoint);
+      break;
+    }
+    leg.client = leg.owned.get();
+    legs.push_back(std::move(leg));
+  }
+
+  std::random_device random;
+  char staging_id[33];
+  std::snprintf(staging_id, sizeof(staging_id), "%08x%08x%08x%08x", random(),
+                random(), random(), random());
+  request.staging_id = staging_id;
+
+  std::vector<struct ArrowArrayStream> shares(legs.size());
+  SplitArrayStream(data, legs.size(), key_column, kIngestSplitBuffered,
+                   shares.data());
+  for (size_t i = 0; i < legs.size(); i++) {
+    ArrowArrayStreamMove(&shares[i], legs[i].data.get());
+  }
+  // A load that fails stops taking its share, so the others do not wait
+  // for it
+  auto load = [&request](Leg *leg) {
+    leg->code =
+        leg->client->Ingest(request, leg->data.get(), &leg->rows, &leg->error);
+    leg->data.reset();
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < legs.size(); i++) {
+    try {
+      threads.emplace_back(load, &legs[i]);
+    } catch (const std::system_error &) {
+      load(&legs[i]);
+    }
+  }
+  load(&legs[0]);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  Status result;
+  AdbcStatusCode failed = ADBC_STATUS_OK;
+  for (auto &leg : legs) {
+    if (leg.code != ADBC_STATUS_OK && failed == ADBC_STATUS_OK) {
+      failed = leg.code;
+      if (error) {
+        if (error->release) {
+          error->release(error);
+        }
+        *error = leg.error;
+        leg.error.release = nullptr;
+      }
+    }
+    if (leg.error.release) {
+      leg.error.release(&leg.error);
+    }
+  }
+
+  IngestCommit commit;
+  commit.table = request.table;
+  commit.db_schema = request.db_schema;
+  commit.mode = request.mode;
+  commit.staging_id = request.staging_id;
+  commit.abort = failed != ADBC_STATUS_OK;
+  struct AdbcError commit_error = ADBC_ERROR_INIT;
+  AdbcStatusCode commit_code =
+      native_client_->IsConnected()
+          ? native_client_->CommitIngest(commit, rows,
+                                         commit.abort ? &commit_error : error)
+          : ADBC_STATUS_IO;
+  if (commit_error.release) {
+    commit_error.release(&commit_error);
+  }
+  for (size_t i = 1; i < legs.size(); i++) {
+    EndNativeSession(std::move(legs[i].owned), legs[i].endpoint);
+  }
+  if (failed != ADBC_STATUS_OK) {
+    return Status::FromAdbc(failed, *error);
+  }
+  if (commit_code != ADBC_STATUS_OK) {
+    if (commit_code == ADBC_STATUS_IO && !error->message) {
+      return status::IO("Connection lost before the ingestion was committed");
+    }
+    return Status::FromAdbc(commit_code, *error);
+  }
+  return status::Ok();
+}
+
+void CubeConnectionImpl::InvalidateCaches() {
+  if (metadata_cache_) {
+    metadata_cache_->Invalidate();
+  }
+  if (table_schema_cache_) {
+    table_schema_cache_->Clear();
+  }
+  if (result_cache_) {
+    result_cache_->Clear();
+  }
+  if (shared_result_cache_) {
+    // The other processes' results are as stale
+    shared_result_cache_->Clear();
+  }
+  if (disk_cache_) {
+    disk_cache_->Clear();
+  }
+  if (rollup_cache_) {
+    rollup_cache_->Clear();
+  }
+  if (delta_cache_) {
+    delta_cache_->Clear();
+  }
+}
+
+bool CubeConnectionImpl::FindCachedResult(
+    const std::string &sql, const CubeQueryParameters *parameters,
+    const CubeReaderOptions &reader_options, struct ArrowArrayStream *out,
+    int64_t *rows_affected, std::unique_ptr<CubeResultCapture> *capture,
+    bool *shared) {
+  // A subscription never completes, so it is neither cached nor shared
+  if ((!result_cache_ && !shared_result_cache_ && !disk_cache_ &&
+       !inflight_ && !rollup_cache_) ||
+      !native_client_ || reader_options.subscribe) {
+    return false;
+  }
+  std::string normalized = NormalizeQueryText(sql);
+  if (!IsCacheableQuery(normalized)) {
+    return false;
+  }
+  static const std::vector<uint8_t> kNoParameters;
+  std::string key = CubeResultCacheKey(
+      native_client_->GetServerVersion(), database_, user_, token_,
+      (reader_options.view_types ? QUERY_FLAG_VIEW_TYPES : 0) |
+          (reader_options.run_end_encoded ? QUERY_FLAG_RUN_END_ENCODED : 0),
+      normalized,
+      parameters ? parameters->arrow_ipc : kNoParameters);
+  std::shared_ptr<const CubeCachedResult> cached;
+  if (result_cache_) {
+    cached = result_cache_->Find(key);
+  }
+  if (!cached && shared_result_cache_) {
+    // Stored by this or another process; read in place, so not copied
+    // into this process's cache
+    CubeSharedResult shared_result;
+    if (shared_result_cache_->Find(key, &shared_result)) {
+      ExportSharedResult(shared_result, reader_options, out);
+      if (rows_affected) {
+        *rows_affected = shared_result.rows_affected;
+      }
+      return true;
+    }
+  }
+  // Entries on disk hold while the server's data model is the one they
+  // were stored under
+  std::string model_version;
+  if (disk_cache_) {
+    model_version = server_parameter(HANDSHAKE_MODEL_VERSION).value_or("");
+  }
+  if (!cached && disk_cache_) {
+    CubeSharedResult disk_result;
+    if (disk_cache_->Find(key, model_version, &disk_result)) {
+      ExportSharedResult(disk_result, reader_options, out);
+      if (rows_affected) {
+        *rows_affected = disk_result.rows_affected;
+      }
+      return true;
+    }
+  }
+  // Roll-ups are built from the plain Arrow types and every column, without
+  // bound parameters
+  std::optional<RollupQuery> rollup;
+  std::string family;
+  if (rollup_cache_ && !parameters && !reader_options.view_types &&
+      !reader_options.run_end_encoded && !reader_options.raw_ipc &&
+      reader_options.columns.empty() && !reader_options.timestamp_unit &&
+      !reader_options.date_type && !reader_options.string_dictionaries) {
+    rollup = ParseRollupQuery(normalized);
+  }
+  if (rollup) {
+    family = CubeResultCacheKey(native_client_->GetServerVersion(), database_,
+                                user_, token_, 0, rollup->source,
+                                kNoParameters);
+    if (!cached && rollup_cache_->Answer(family, *rollup, out)) {
+      if (rows_affected) {
+        *rows_affected = -1;
+      }
+      return true;
+    }
+  }
+  std::shared_ptr<CubeInflightQueries::Call> call;
+  if (!cached && inflight_) {
+    bool leader = false;
+    call = inflight_->Join(key, &leader);
+    if (!leader) {
+      // Run the query ourselves if the other connection's execution failed
+      cached = call->Wait();
+      call.reset();
+    }
+  }
+  if (cached) {
+    ExportCachedResult(*cached, reader_options, out);
+    if (rows_affected) {
+      *rows_affected = cached->rows_affected;
+    }
+    return true;
+  }
+  *capture = std::make_unique<CubeResultCapture>(
+      result_cache_, key, native_client_->IsSchemaOnce());
+  if (disk_cache_) {
+    (*capture)->Keep(
+        disk_cache_->max_bytes(),
+        [cache = disk_cache_, key = key,
+         model_version = std::move(model_version)](
+            std::shared_ptr<const CubeCachedResult> result) {
+          cache->Insert(key, model_version, *result);
+        });
+  }
+  if (shared_result_cache_) {
+    (*capture)->Keep(
+        shared_result_cache_->max_bytes(),
+        [cache = shared_result_cache_, key = std::move(key)](
+            std::shared_ptr<const CubeCachedResult> result) {
+          cache->Insert(key, *result);
+        });
+  }
+  if (rollup) {
+    (*capture)->Keep(
+        rollup_cache_->max_bytes(),
+        [cache = rollup_cache_, family = std::move(family),
+         query = std::move(*rollup)](
+            std::shared_ptr<const CubeCachedResult> result) mutable {
+          cache->Insert(std::move(family), std::move(query),
+                        std::move(result));
+        });
+  }
+  if (call) {
+    (*capture)->Share(inflight_, std::move(call));
+    *shared = true;
+  }
+  return false;
+}
+
+Status CubeConnectionImpl::Prefetch(const std::string &sql) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (!native_client_ || !prefetcher_) {
+    return status::InvalidState(
+        "adbc.cube.prefetch_query requires native mode with "
+        "adbc.cube.prefetch_queries.budget_bytes and "
+        "adbc.cube.result_cache.max_bytes set");
+  }
+  std::string normalized = NormalizeQueryText(sql);
+  if (IsCacheableQuery(normalized)) {
+    SubmitPrefetch(std::move(normalized), reader_options_);
+  }
+  return status::Ok();
+}
+
+void CubeConnectionImpl::SubmitPrefetch(
+    std::string normalized_sql, const CubeReaderOptions &reader_options) {
+  static const std::vector<uint8_t> kNoParameters;
+  CubePrefetchRequest request;
+  request.key = CubeResultCacheKey(
+      native_client_->GetServerVersion(), database_, user_, token_,
+      (reader_options.view_types ? QUERY_FLAG_VIEW_TYPES : 0) |
+          (reader_options.run_end_encoded ? QUERY_FLAG_RUN_END_ENCODED : 0),
+      normalized_sql, kNoParameters);
+  request.sql = std::move(normalized_sql);
+  request.token = token_;
+  request.endpoint = endpoint_;
+  request.view_types = reader_options.view_types;
+  request.run_end_encoded = reader_options.run_end_encoded;
+  prefetcher_->Submit(std::move(request));
+}
+
+void CubeConnectionImpl::PrefetchDrillDown(
+    const std::string &sql, const CubeQueryParameters *parameters,
+    const CubeReaderOptions &reader_options) {
+  if (!prefetcher_ || !prefetcher_->options().drill_down || parameters ||
+      reader_options.subscribe || reader_options.json_query ||
+      Sampled(reader_options)) {
+    return;
+  }
+  auto drilled = DrillDownQuery(NormalizeQueryText(sql));
+  if (drilled) {
+    SubmitPrefetch(std::move(*drilled), reader_options);
+  }
+}
+
+std::string CubeConnectionImpl::DeltaCacheKey(
+    const std::string &sql, const CubeQueryParameters *parameters,
+    const CubeReaderOptions &reader_options) const {
+  // Merged results are built from every column of the plain Arrow types
+  if (!delta_cache_ || !native_client_ ||
+      !native_client_->SupportsDeltaResults() || reader_options.raw_ipc ||
+      reader_options.run_end_encoded || reader_options.subscribe ||
+      !reader_options.columns.empty() || Sampled(reader_options)) {
+    return {};
+  }
+  std::string normalized = NormalizeQueryText(sql);
+  if (!IsCacheableQuery(normalized)) {
+    return {};
+  }
+  static const std::vector<uint8_t> kNoParameters;
+  return CubeResultCacheKey(
+      native_client_->GetServerVersion(), database_, user_, token_,
+      QUERY_FLAG_DELTA |
+          (reader_options.view_types ? QUERY_FLAG_VIEW_TYPES : 0),
+      normalized, parameters ? parameters->arrow_ipc : kNoParameters);
+}
+
+AdbcStatusCode CubeConnectionImpl::SendDeltaQuery(
+    QueryRequest request, const std::string &key,
+    const CubeReaderOptions &reader_options, struct ArrowArrayStream *out,
+    struct AdbcError *error, int64_t *rows_affected) {
+  auto base = delta_cache_->Find(key);
+  request.flags |= QUERY_FLAG_DELTA;
+  if (base) {
+    request.base_version = base->version;
+  }
+  nanoarrow::UniqueArrayStream stream;
+  ResultDelta delta;
+  auto status_code =
+      native_client_->SendQuery(request, reader_options, stream.get(), error,
+                                rows_affected, nullptr, nullptr, &delta);
+  if (status_code != ADBC_STATUS_OK) {
+    return status_code;
+  }
+  if (delta.version.empty()) {
+    // The server did not version this result, so there is nothing to merge
+    // the next one into
+    delta_cache_->Erase(key);
+    ArrowArrayStreamMove(stream.get(), out);
+    return ADBC_STATUS_OK;
+  }
+
+  auto result = std::make_shared<CubeDeltaResult>();
+  struct ArrowError arrow_error;
+  ArrowErrorInit(&arrow_error);
+  int code = ApplyDelta(base.get(), delta, stream.get(), result.get(),
+                        &arrow_error);
+  if (code == NANOARROW_OK) {
+    code = ExportDeltaResult(*result, out);
+  }
+  if (code != NANOARROW_OK) {
+    // Ask for the whole result next time
+    delta_cache_->Erase(key);
+    SetNativeClientError(error, arrow_error.message[0] != '\0'
+                                    ? arrow_error.message
+                                    : std::strerror(code));
+    return code == EINVAL     ? ADBC_STATUS_INVALID_DATA
+           : code == ENOTSUP ? ADBC_STATUS_NOT_IMPLEMENTED
+                             : ADBC_STATUS_IO;
+  }
+  if (delta.merge != DELTA_MERGE_FULL) {
+    delta_cache_->RecordMerge();
+  }
+  if (rows_affected) {
+    *rows_affected = result->rows;
+  }
+  delta_cache_->Insert(key, std::move(result));
+  return ADBC_STATUS_OK;
+}
+
+Status CubeConnectionImpl::Cancel() {
+  if (!native_client_) {
+    return status::NotImplemented(
+        "Cancel is only supported in native connection mode");
+  }
+  struct AdbcError error = ADBC_ERROR_INIT;
+  auto status_code = native_client_->Cancel(&error);
+  return Status::FromAdbc(status_code, error);
+}
+
+Result<int64_t> CubeConnectionImpl::GetSocketFd() const {
+  auto lock = LockSession();
+  if (!native_client_ || !native_client_->IsConnected()) {
+    return status::InvalidState("No native protocol connection");
+  }
+  return native_client_->GetSocketFd();
+}
+
+Result<bool> CubeConnectionImpl::PollResponse(struct AdbcError *error) {
+  PumpAsyncStreams();
+  auto lock = LockSession();
+  if (!native_client_) {
+    return status::InvalidState("No native protocol connection");
+  }
+  bool ready = false;
+  auto status_code = native_client_->PollResponse(&ready, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return Status::FromAdbc(status_code, *error);
+  }
+  return ready;
+}
+
+void CubeConnectionImpl::StartAsyncStream(
+    struct ArrowArrayStream *stream,
+    struct ArrowAsyncDeviceStreamHandler *handler) {
+  auto async_stream = std::make_shared<CubeAsyncStream>(
+      stream, handler, [this] { return ResultReady(); });
+  {
+    auto lock = LockSession();
+    async_streams_.push_back(async_stream);
+  }
+  async_stream->Pump();
+}
+
+bool CubeConnectionImpl::ResultReady() {
+  auto lock = LockSession();
+  bool ready = true;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  if (native_client_ &&
+      native_client_->PollResponse(&ready, &error) != ADBC_STATUS_OK) {
+    ready = true; // Reading reports why
+  }
+  if (error.release) {
+    error.release(&error);
+  }
+  return ready;
+}
+
+void CubeConnectionImpl::PumpAsyncStreams() {
+  std::vector<std::shared_ptr<CubeAsyncStream>> async_streams;
+  {
+    auto lock = LockSession();
+    async_streams = async_streams_;
+  }
+  for (const auto &async_stream : async_streams) {
+    async_stream->Pump();
+  }
+  auto lock = LockSession();
+  async_streams_.erase(
+      std::remove_if(async_streams_.begin(), async_streams_.end(),
+                     [](const std::shared_ptr<CubeAsyncStream> &async_stream) {
+                       return async_stream->finished();
+                     }),
+      async_streams_.end());
+}
+
+Status CubeConnectionImpl::EncodeParameters(
+    const struct ArrowSchema *schema, const struct ArrowArray *array,
+    const std::vector<Oid> &parameter_types,
+    std::vector<CubeQueryParameters> *out) {
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  if (native_client_) {
+    // The native protocol takes each row as Arrow, so nothing is converted
+    for (int64_t row = 0; row < array->length; row++) {
+      out->emplace_back();
+      if (WriteArrowIpcStream(schema, array, row, 1, &out->back().arrow_ipc,
+                              &arrow_error) != NANOARROW_OK) {
+        return status::fmt::InvalidArgument("Failed to encode parameters: {}",
+                                            arrow_error.message);
+      }
+    }
+    return status::Ok();
+  }
+  ParameterConverter converter;
+  if (converter.Init(schema, array, parameter_types, &arrow_error) !=
+      NANOARROW_OK) {
+    return status::fmt::InvalidArgument("Failed to bind parameters: {}",
+                                        arrow_error.message);
+  }
+  // One arena for the whole batch, shared by its rows
+  auto arena = std::make_shared<PostgresParamArena>();
+  if (converter.Convert(arena.get(), &arrow_error) != NANOARROW_OK) {
+    return status::fmt::InvalidArgument("Failed to encode parameters: {}",
+                                        arrow_error.message);
+  }
+  for (int64_t row = 0; row < converter.num_rows(); row++) {
+    out->emplace_back();
+    out->back().postgres = arena->Row(row);
+    out->back().arena = arena;
+  }
+  return status::Ok();
+}
+
+Result<std::vector<std::string>> CubeConnectionImpl::GetTableTypes() {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  if (metadata_cache_) {
+    UNWRAP_RESULT(auto model, metadata_cache_->Get(this));
+    return model->table_types;
+  }
+  MetadataModel model;
+  UNWRAP_STATUS(LoadMetadataModel(this, /*with_columns=*/false, &model));
+  return std::move(model.table_types);
+}
+
+Status CubeConnectionImpl::GetStatistics(
+    std::optional<std::string_view> catalog,
+    std::optional<std::string_view> db_schema,
+    std::optional<std::string_view> table_name, bool approximate,
+    struct ArrowArrayStream *out) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+  return ReadStatistics(this, catalog, db_schema, table_name, approximate,
+                        out);
+}
+
+Status CubeConnectionImpl::GetTableSchema(const std::string &table_schema,
+                                          const std::string &table_name,
+                                          struct ArrowSchema *schema) {
+  auto lock = LockSession();
+  if (!connected_) {
+    return status::InvalidState("Connection not established");
+  }
+
+  if (table_name.empty()) {
+    return status::InvalidArgument("Table name cannot be empty");
+  }
+
+  if (!schema) {
+    return status::InvalidArgument("Schema pointer cannot be null");
+  }
+
+  if (table_schema_cache_ &&
+      table_schema_cache_->Get(table_schema, table_name, schema)) {
+    return status::Ok();
+  }
+
+  // A table the shared model knows is answered from it; one it does not
+  // know may be newer than the model, so it is looked up below
+  if (metadata_cache_) {
+    UNWRAP_RESULT(auto model, metadata_cache_->Get(this));
+    if (const MetadataTable *table = model->FindTable(table_schema, table_name);
+        table && !table->columns.empty()) {
+      MetadataBuilder builder;
+      for (const auto &column : table->columns) {
+        builder.AddColumn(column.name, column.data_type,
+                          column.is_nullable != "NO");
+      }
+      return builder.Build(schema);
+    }
+  }
+
+  // Cube SQL follows PostgreSQL conventions for information_schema. The
+  // names are bound, never spliced into the SQL; a native server that takes
+  // no parameters is sent the unfiltered query and rows are matched here.
+  bool bind = !native_client_ || native_client_->SupportsParameters();
+  std::string query = "SELECT column_name, data_type, is_nullable, "
+                      "table_schema, table_name "
+                      "FROM information_schema.columns";
+  if (bind) {
+    query += table_schema.empty()
+                 ? " WHERE table_name = $1"
+                 : " WHERE table_name = $1 AND table_schema = $2";
+  }
+  query += " ORDER BY table_schema, table_name, ordinal_position";
+
+  std::vector<CubeQueryParameters> parameters;
+  if (bind) {
+    nanoarrow::UniqueSchema param_schema;
+    nanoarrow::UniqueArray param_array;
+    std::vector<const std::string *> values = {&table_name};
+    if (!table_schema.empty()) {
+      values.push_back(&table_schema);
+    }
+    ArrowSchemaInit(param_schema.get());
+    ArrowErrorCode code = ArrowSchemaSetTypeStruct(
+        param_schema.get(), static_cast<int64_t>(values.size()));
+    for (size_t i = 0; code == NANOARROW_OK && i < values.size(); i++) {
+      code = ArrowSchemaSetType(param_schema->children[i],
+                                NANOARROW_TYPE_STRING);
+      if (code == NANOARROW_OK) {
+        code = ArrowSchemaSetName(param_schema->children[i],
+                                  i == 0 ? "table_name" : "table_schema");
+      }
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayInitFromSchema(param_array.get(), param_schema.get(),
+                                      nullptr);
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayStartAppending(param_array.get());
+    }
+    for (size_t i = 0; code == NANOARROW_OK && i < values.size(); i++) {
+      struct ArrowStringView value = {
+          values[i]->data(), static_cast<int64_t>(values[i]->size())};
+      code = ArrowArrayAppendString(param_array->children[i], value);
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayFinishElement(param_array.get());
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayFinishBuildingDefault(param_array.get(), nullptr);
+    }
+    if (code != NANOARROW_OK) {
+      return status::Internal("Failed to build table lookup parameters");
+    }
+    UNWRAP_STATUS(EncodeParameters(param_schema.get(), param_array.get(), {},
+                                   &parameters));
+  }
+
+  nanoarrow::UniqueArrayStream stream;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  auto status = ExecuteQuery(query, reader_options_, stream.get(), &error,
+                             bind ? &parameters[0] : nullptr);
+  if (error.message) {
+    error.release(&error);
+  }
+  UNWRAP_STATUS(status);
+  std::vector<std::vector<std::optional<std::string>>> rows;
+  UNWRAP_STATUS(ReadMetadataRows(stream.get(), &rows));
+
+  MetadataBuilder builder;
+  std::optional<std::string> found_schema;
+  for (const auto &row : rows) {
+    if (row.size() < 5 || !row[0] || !row[1]) {
+      continue;
+    }
+    std::string row_schema = row[3].value_or("");
+    if (!bind && (row[4].value_or("") != table_name ||
+                  (!table_schema.empty() && row_schema != table_schema))) {
+      continue;
+    }
+    // Without a schema, the first schema holding the table is used
+    if (found_schema && row_schema != *found_schema) {
+      continue;
+    }
+    found_schema = std::move(row_schema);
+    builder.AddColumn(*row[0], *row[1], row[2].value_or("YES") != "NO");
+  }
+  if (!found_schema) {
+    return status::NotFound("Table not found: ",
+                            table_schema.empty() ? "" : table_schema + ".",
+                            table_name);
+  }
+
+  UNWRAP_STATUS(builder.Build(schema));
+  if (table_schema_cache_) {
+    table_schema_cache_->Put(table_schema, table_name, schema);
+  }
+  return status::Ok();
+}
+
+// CubeConnection implementation
+
+Status CubeConnection::InitImpl(void *raw_connection) {
+  // raw_connection is the AdbcDatabase* passed from CConnectionInit
+  auto *cube_database = static_cast<CubeDatabase *>(raw_connection);
+  impl_ = std::make_unique<CubeConnectionImpl>(*cube_database);
+  if (token_) {
+    impl_->set_token(std::move(*token_));
+    token_.reset();
+  }
+  if (memory_limit_) {
+    impl_->memory().set_limit(*memory_limit_);
+  }
+  impl_->set_priority(priority_);
+  impl_->set_require_preaggregation(require_preaggregation_);
+
+  struct AdbcError error = ADBC_ERROR_INIT;
+  auto status = impl_->Connect(&error);
+  if (error.message) {
+    error.release(&error);
+  }
+  return status;
+}
+
+Status CubeConnection::ReleaseImpl() {
+  if (impl_) {
+    struct AdbcError error = ADBC_ERROR_INIT;
+    auto status = impl_->Disconnect(&error);
+    if (error.message) {
+      error.release(&error);
+    }
+    impl_.reset();
+    return status;
   }
   return status::Ok();
 }
 
 Status CubeConnection::SetOptionImpl(std::string_view key,
                                      driver::Option value) {
-  // Connection-specific options can be added here
+  if (key == "adbc.cube.token") {
+    UNWRAP_RESULT(auto token, value.AsString());
+    if (!impl_) {
+      token_ = std::string(token);
+      return status::Ok();
+    }
+    struct AdbcError error = ADBC_ERROR_INIT;
+    auto status = impl_->SetToken(std::string(token), &error);
+    if (error.release) {
+      error.release(&error);
+    }
+    return status;
+  } else if (key == "adbc.cube.memory_limit_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    memory_limit_ = static_cast<size_t>(bytes);
+    if (impl_) {
+      impl_->memory().set_limit(*memory_limit_);
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.priority") {
+    UNWRAP_RESULT(priority_, value.AsInt());
+    if (impl_) {
+      impl_->set_priority(priority_);
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.require_preaggregation") {
+    UNWRAP_RESULT(require_preaggregation_, value.AsBool());
+    if (impl_) {
+      impl_->set_require_preaggregation(require_preaggregation_);
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_query") {
+    UNWRAP_RESULT(auto sql, value.AsString());
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return impl_->Prefetch(std::string(sql));
+  }
   return status::NotImplemented("Connection options not yet implemented");
 }
 
+AdbcStatusCode CubeConnection::Cancel(struct AdbcError *error) {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  return impl_->Cancel().ToAdbc(error);
+}
+
+AdbcStatusCode
+CubeConnection::ReadPartition(const uint8_t *serialized_partition,
+                              size_t serialized_length,
+                              struct ArrowArrayStream *out,
+                              struct AdbcError *error) {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  if (!out) {
+    return status::InvalidArgument("out must be non-null").ToAdbc(error);
+  }
+  std::string_view partition(
+      reinterpret_cast<const char *>(serialized_partition), serialized_length);
+  struct AdbcError impl_error = ADBC_ERROR_INIT;
+  auto status = impl_->ReadPartition(partition, out, &impl_error);
+  if (impl_error.message) {
+    impl_error.release(&impl_error);
+  }
+  return status.ToAdbc(error);
+}
+
+AdbcStatusCode CubeConnection::ExecuteQueries(const char **queries,
+                                              size_t count,
+                                              struct ArrowArrayStream *out,
+                                              struct AdbcError *error) {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  if (count > 0 && (!queries || !out)) {
+    return status::InvalidArgument("queries and out must be non-null")
+        .ToAdbc(error);
+  }
+  std::vector<std::string> sql;
+  for (size_t i = 0; i < count; i++) {
+    if (!queries[i]) {
+      return status::InvalidArgument("queries must not hold null")
+          .ToAdbc(error);
+    }
+    sql.emplace_back(queries[i]);
+  }
+  struct AdbcError impl_error = ADBC_ERROR_INIT;
+  auto status = impl_->ExecuteQueries(sql, out, &impl_error);
+  if (impl_error.message) {
+    impl_error.release(&impl_error);
+  }
+  return status.ToAdbc(error);
+}
+
+Result<driver::Option> CubeConnection::GetOption(std::string_view key) {
+  constexpr std::string_view kServerParameter = "adbc.cube.server_parameter.";
+  if (key == "adbc.cube.socket_fd") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    UNWRAP_RESULT(auto fd, impl_->GetSocketFd());
+    return driver::Option(fd);
+  } else if (key == "adbc.cube.result_ready") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    struct AdbcError error = ADBC_ERROR_INIT;
+    auto ready = impl_->PollResponse(&error);
+    if (error.release) {
+      error.release(&error);
+    }
+    UNWRAP_RESULT(auto is_ready, ready);
+    return driver::Option(static_cast<int64_t>(is_ready ? 1 : 0));
+  } else if (key == "adbc.cube.verify_time_ns") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->verify_nanos());
+  } else if (key == "adbc.cube.result_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->result_cache_hits());
+  } else if (key == "adbc.cube.shared_result_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->shared_result_cache_hits());
+  } else if (key == "adbc.cube.disk_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->disk_cache_hits());
+  } else if (key == "adbc.cube.rollup_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->rollup_cache_hits());
+  } else if (key == "adbc.cube.delta_cache_merges") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->delta_cache_merges());
+  } else if (key == "adbc.cube.shared_results") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->shared_results());
+  } else if (key == "adbc.cube.prefetched_results") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->prefetched_results());
+  } else if (key == "adbc.cube.dns_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->dns_cache_hits());
+  } else if (key == "adbc.cube.endpoint") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->endpoint());
+  } else if (key == "adbc.cube.server_capabilities") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->server_capabilities());
+  } else if (key.substr(0, kServerParameter.size()) == kServerParameter) {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    std::string_view name = key.substr(kServerParameter.size());
+    auto value = impl_->server_parameter(name);
+    if (!value) {
+      return status::NotFound("The server sent no handshake parameter ",
+                              name);
+    }
+    return driver::Option(*value);
+  } else if (key == "adbc.cube.failovers") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->failovers());
+  } else if (key == "adbc.cube.reconnects") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->reconnects());
+  } else if (key == "adbc.cube.tls_session_resumptions") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->tls_session_resumptions());
+  } else if (key == "adbc.cube.session_resumptions") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->session_resumptions());
+  } else if (key == "adbc.cube.buffer_pool_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->buffer_pool_hits());
+  } else if (key == "adbc.cube.memory_bytes") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(static_cast<int64_t>(impl_->memory().current()));
+  } else if (key == "adbc.cube.memory_peak_bytes") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(static_cast<int64_t>(impl_->memory().peak()));
+  } else if (key == "adbc.cube.schema_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->schema_cache_hits());
+  } else if (key == "adbc.cube.prepared_cache_hits") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->prepared_cache_hits());
+  } else if (key == "adbc.cube.postgres_output_format") {
+    if (!impl_) {
+      return status::InvalidState("Connection not initialized");
+    }
+    return driver::Option(impl_->postgres_arrow_output() ? "arrow_ipc"
+                                                         : "binary");
+  }
+  return driver::Connection<CubeConnection>::GetOption(key);
+}
+
+AdbcStatusCode CubeConnection::GetStatistics(const char *catalog,
+                                             const char *db_schema,
+                                             const char *table_name,
+                                             char approximate,
+                                             struct ArrowArrayStream *out,
+                                             struct AdbcError *error) {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  if (!out) {
+    return status::InvalidArgument("out must be non-null").ToAdbc(error);
+  }
+  auto filter = [](const char *value) {
+    return value ? std::make_optional(std::string_view(value)) : std::nullopt;
+  };
+  return impl_
+      ->GetStatistics(filter(catalog), filter(db_schema), filter(table_name),
+                      approximate != 0, out)
+      .ToAdbc(error);
+}
+
+AdbcStatusCode CubeConnection::GetStatisticNames(struct ArrowArrayStream *out,
+                                                 struct AdbcError *error) {
+  if (!out) {
+    return status::InvalidArgument("out must be non-null").ToAdbc(error);
+  }
+  nanoarrow::UniqueSchema schema;
+  nanoarrow::UniqueArray array;
+  ArrowSchemaInit(schema.get());
+  if (ArrowSchemaSetTypeStruct(schema.get(), 2) != NANOARROW_OK ||
+      ArrowSchemaSetType(schema->children[0], NANOARROW_TYPE_STRING) !=
+          NANOARROW_OK ||
+      ArrowSchemaSetName(schema->children[0], "statistic_name") !=
+          NANOARROW_OK ||
+      ArrowSchemaSetType(schema->children[1], NANOARROW_TYPE_INT16) !=
+          NANOARROW_OK ||
+      ArrowSchemaSetName(schema->children[1], "statistic_key") !=
+          NANOARROW_OK ||
+      ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr) !=
+          NANOARROW_OK ||
+      ArrowArrayStartAppending(array.get()) != NANOARROW_OK ||
+      ArrowArrayFinishBuildingDefault(array.get(), nullptr) != NANOARROW_OK) {
+    return status::Internal("Failed to build statistic names")
+        .ToAdbc(error);
+  }
+  schema->children[0]->flags &= ~ARROW_FLAG_NULLABLE;
+  schema->children[1]->flags &= ~ARROW_FLAG_NULLABLE;
+  driver::MakeArrayStream(schema.get(), array.get(), out);
+  return ADBC_STATUS_OK;
+}
+
+Result<std::unique_ptr<driver::GetObjectsHelper>>
+CubeConnection::GetObjectsImpl() {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  return std::make_unique<CubeGetObjectsHelper>(impl_.get());
+}
+
+Result<std::vector<std::string>> CubeConnection::GetTableTypesImpl() {
+  if (!impl_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  return impl_->GetTableTypes();
+}
+
 Status
 CubeConnection::GetTableSchemaImpl(std::optional<std::string_view> catalog,
                                    std::optional<std::string_view> db_schema,
@@ -17,9 +17,15 @@
 
 #pragma once
 
+#include <chrono>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 // Try to include real libpq, fall back to compatibility header
 #ifdef __has_include
@@ -33,9 +39,23 @@
 #endif
 
 #include <arrow-adbc/adbc.h>
+#include <nanoarrow/nanoarrow.hpp>
 
 #define ADBC_FRAMEWORK_USE_FMT
+#include "driver/cube/admission.h"
+#include "driver/cube/async_stream.h"
+#include "driver/cube/change_watcher.h"
+#include "driver/cube/connection_pool.h"
+#include "driver/cube/delta_cache.h"
+#include "driver/cube/disk_cache.h"
+#include "driver/cube/endpoints.h"
+#include "driver/cube/metadata.h"
 #include "driver/cube/native_client.h"
+#include "driver/cube/parameter_converter.h"
+#include "driver/cube/postgres_reader.h"
+#include "driver/cube/prefetch.h"
+#include "driver/cube/rollup_cache.h"
+#include "driver/cube/token_source.h"
 #include "driver/framework/connection.h"
 #include "driver/framework/status.h"
 
@@ -54,6 +74,51 @@ enum class ConnectionMode {
   Native      // Use native Arrow IPC protocol
 };
 
+// A query prepared on the server by CubeConnectionImpl::Prepare
+struct CubePreparedStatement {
+  // Native statement id or PostgreSQL statement name; empty if the server
+  // cannot prepare queries
+  std::string handle;
+  std::string sql; // Text it was prepared from
+  uint64_t session = 0; // Native session handle belongs to (see reconnects)
+  uint64_t context = 0; // Security context it was prepared under
+  nanoarrow::UniqueSchema result_schema;    // Unset if the server cannot tell
+  nanoarrow::UniqueSchema parameter_schema; // Unset if the server cannot tell
+  std::vector<Oid> parameter_types;         // PostgreSQL mode only
+  // Native mode: the connection's prepared cache entry handle came from.
+  // The handle is closed by whichever of the cache and the statements
+  // holding the entry lets go of it last.
+  std::shared_ptr<const CubePreparedStatement> cached;
+};
+
+// Bound parameters of one execution, encoded for the connection's protocol
+struct CubeQueryParameters {
+  std::vector<uint8_t> arrow_ipc; // Native mode: one-row Arrow IPC stream
+  // PostgreSQL mode: one row of the arena its batch was encoded into
+  PostgresParams postgres;
+  std::shared_ptr<const PostgresParamArena> arena;
+};
+
+// What the server expects a query to cost, from planning it without
+// running it
+struct CubeQueryEstimate {
+  ResultSizeHint size; // -1 where the planner cannot tell
+  // 1 if a pre-aggregation would serve the query, 0 if the source database
+  // would, -1 if the server did not say
+  int8_t uses_preaggregation = -1;
+  std::string preaggregation; // The one that would serve it, if any
+};
+
+// Where an incremental ExecutePartitions stands: the session the server
+// sends the rest of the partitions on, given back once they are all read
+struct CubeIncrementalPartitions {
+  std::unique_ptr<NativeClient> client; // Null once every partition is read
+  size_t endpoint = 0;
+  nanoarrow::UniqueSchema schema; // Sent with the first partitions only
+  int64_t returned = 0;           // Partitions handed out so far
+  bool done = false;              // The last partitions were handed out
+};
+
 // Cube SQL connection wrapper
 class CubeConnectionImpl {
 public:
@@ -65,14 +130,215 @@ public:
   Status Disconnect(struct AdbcError *error);
   bool IsConnected() const { return connected_; }
 
+  // Run later queries under the security context of another token, by
+  // switching the native session in place. Results of earlier queries must
+  // have been read; statements prepared before are sent as text from then
+  // on. Native mode only, with servers that agreed to it in the handshake.
+  Status SetToken(std::string token, struct AdbcError *error);
+  // Token to authenticate with, for a connection not connected yet
+  void set_token(std::string token) {
+    token_ = std::move(token);
+    token_source_.reset();
+  }
+  // Place of the connection's queries in the admission queue: higher
+  // priorities are let in first
+  void set_priority(int64_t priority) {
+    auto lock = LockSession();
+    priority_ = priority;
+  }
+  // Whether queries of the connection's statements and ExecuteQueries are
+  // rejected unless a pre-aggregation serves them; metadata queries never
+  // are
+  bool require_preaggregation() const {
+    auto lock = LockSession();
+    return require_preaggregation_;
+  }
+  void set_require_preaggregation(bool enabled) {
+    auto lock = LockSession();
+    require_preaggregation_ = enabled;
+  }
+
+  // Open a native session with the connection's options and give it over
+  // to change notifications (NativeClient::WatchChanges). It is not the
+  // connection's session, and is closed rather than pooled once dropped.
+  Status WatchChanges(std::unique_ptr<NativeClient> *out,
+                      struct AdbcError *error);
+
   // Query execution
   Status ExecuteQuery(const std::string &query, struct ArrowArrayStream *out,
                       struct AdbcError *error);
+  // rows_affected, when set, receives the row count if the server knows it
+  // by the time the query returns, its estimate otherwise, or -1.
+  // size_hint, when set, receives the server's estimate of the result's
+  // size (native mode only).
+  Status ExecuteQuery(const std::string &query,
+                      const CubeReaderOptions &reader_options,
+                      struct ArrowArrayStream *out, struct AdbcError *error,
+                      const CubeQueryParameters *parameters = nullptr,
+                      int64_t *rows_affected = nullptr,
+                      ResultSizeHint *size_hint = nullptr);
+  // Run a query for its row count only, without building a result stream.
+  // statement may be null, or have no handle, to send the SQL.
+  // With exporter (native mode only), the result's messages are written to
+  // it undecoded; view_types asks the server for view-typed columns and
+  // require_preaggregation to reject a query no pre-aggregation serves.
+  Status ExecuteUpdate(const std::string &query,
+                       const CubePreparedStatement *statement,
+                       const CubeQueryParameters *parameters,
+                       int64_t *rows_affected, struct AdbcError *error,
+                       CubeIpcExporter *exporter = nullptr,
+                       bool view_types = false,
+                       QueryPriority priority = QueryPriority::Default,
+                       bool require_preaggregation = false);
+  // Run a query once per parameter set for the total row count (-1 if any
+  // execution reports none). PostgreSQL mode only, sending the executions
+  // in one libpq pipeline, so they take effect together or not at all;
+  // NotImplemented in native mode or when libpq lacks pipeline mode, where
+  // the caller runs ExecuteUpdate once per set instead.
+  Status ExecuteUpdateBatch(const std::string &query,
+                            const CubePreparedStatement *statement,
+                            const std::vector<CubeQueryParameters> &parameters,
+                            int64_t *rows_affected, struct AdbcError *error,
+                            QueryPriority priority = QueryPriority::Default);
+
+  // Schema of the result of a query, planned on the server without running
+  // it: through a schema-only query, or by preparing the query when the
+  // native server cannot send one
+  Status ExecuteSchema(const std::string &query,
+                       const CubeReaderOptions &reader_options,
+                       struct ArrowSchema *schema, struct AdbcError *error);
+
+  // Schema of the result of a query and what the server expects running it
+  // to cost, planned on the server without running it. Native mode only,
+  // with servers that estimate queries; NotImplemented otherwise.
+  Status EstimateQuery(const std::string &query,
+                       const CubeReaderOptions &reader_options,
+                       struct ArrowSchema *schema, CubeQueryEstimate *estimate,
+                       struct AdbcError *error);
+
+  // Prepared statements. Prepare leaves statement->handle empty when the
+  // server cannot prepare queries, and the SQL is sent on every execution.
+  // In native mode a query prepared before on the session is not prepared
+  // again: the handle and schemas come from the prepared cache.
+  Status Prepare(const std::string &query, CubePreparedStatement *statement,
+                 struct AdbcError *error);
+  Status ExecutePrepared(const CubePreparedStatement &statement,
+                         const CubeReaderOptions &reader_options,
+                         struct ArrowArrayStream *out, struct AdbcError *error,
+                         const CubeQueryParameters *parameters = nullptr,
+                         int64_t *rows_affected = nullptr,
+                         ResultSizeHint *size_hint = nullptr);
+  void ClosePrepared(const CubePreparedStatement &statement);
+
+  // Run independent queries in one round trip: out[i] receives the result
+  // of queries[i]. Native servers that support it get them in a single
+  // QueryBatchRequest and may run them concurrently; in PostgreSQL mode
+  // they are sent in one libpq pipeline (NotImplemented without one).
+  Status ExecuteQueries(const std::vector<std::string> &queries,
+                        struct ArrowArrayStream *out, struct AdbcError *error);
+
+  // Run a query once per parameter set and return the results one after
+  // another as a single stream. statement may be null, or have no handle,
+  // to send the SQL each time. The executions are all sent before any
+  // result is read, natively or in a libpq pipeline; without pipeline mode
+  // PostgreSQL ones are sent as the previous result ends. The stream keeps
+  // parameters alive until it is released.
+  Status ExecuteBatch(
+      const std::string &query, const CubePreparedStatement *statement,
+      const CubeReaderOptions &reader_options,
+      std::shared_ptr<const std::vector<CubeQueryParameters>> parameters,
+      struct ArrowArrayStream *out, struct AdbcError *error);
+
+  // Split a query into partitions that ReadPartition can read on any
+  // connection of the database, so a large result can be fetched over
+  // several sessions in parallel. max_partitions caps how many the server
+  // returns (0 lets it choose). Servers that cannot split queries, and
+  // PostgreSQL mode, give a single partition holding the SQL.
+  Status ExecutePartitions(const std::string &query, uint32_t max_partitions,
+                           struct ArrowSchema *schema,
+                           std::vector<std::string> *partitions,
+                           struct AdbcError *error);
+  // ExecutePartitions, returning partitions as the server's planner finds
+  // them so that they can be read while it looks for the rest. Each call
+  // returns what was found since the previous one, waiting for at least
+  // one; the call after the last partitions returns none and resets state.
+  // Servers that cannot do so, and PostgreSQL mode, return every partition
+  // at the first call.
+  Status ExecutePartitionsIncremental(
+      const std::string &query, uint32_t max_partitions,
+      struct ArrowSchema *schema, std::vector<std::string> *partitions,
+      std::unique_ptr<CubeIncrementalPartitions> *state,
+      struct AdbcError *error);
+  // Give back the session of an incremental ExecutePartitions left before
+  // its end
+  void EndIncrementalPartitions(
+      std::unique_ptr<CubeIncrementalPartitions> *state);
+  // Stream the result of a partition returned by ExecutePartitions
+  Status ReadPartition(std::string_view partition,
+                       struct ArrowArrayStream *out, struct AdbcError *error);
+
+  // Run a query whose result is sorted on sort_keys (see ParseSortKeys) as
+  // partitions read at once, each on a session of its own, and merge them
+  // back into one stream in that order (native mode only)
+  Status ExecuteMergedPartitions(const std::string &query,
+                                 uint32_t max_partitions,
+                                 const std::string &sort_keys,
+                                 const CubeReaderOptions &reader_options,
+                                 struct ArrowArrayStream *out,
+                                 struct AdbcError *error);
+
+  // Load a stream of Arrow data into a table (native mode only); mode is
+  // an INGEST_MODE_* value. With parallelism > 1, the data is split across
+  // that many sessions, whole batches in turn or rows by the value of the
+  // partition_key column, loaded into a staging table and swapped into the
+  // table at the end, all or nothing.
+  Status Ingest(const std::string &db_schema, const std::string &table,
+                uint8_t mode, struct ArrowArrayStream *data, int64_t *rows,
+                struct AdbcError *error, int64_t parallelism = 1,
+                const std::string &partition_key = "");
+
+  // Cancel the queries in flight (native mode only)
+  Status Cancel();
+
+  // Have the database's prefetcher run sql into the result cache, as a
+  // query this connection expects to run next with its default read
+  // options. Native mode only, with prefetching enabled; a query that is
+  // not cacheable is ignored.
+  Status Prefetch(const std::string &sql);
 
-  // Metadata queries
+  // Event loop integration (native mode only). PollResponse first hands
+  // the async streams what has arrived for them.
+  Result<int64_t> GetSocketFd() const;
+  Result<bool> PollResponse(struct AdbcError *error);
+
+  // Push the result in stream into handler as it arrives (see
+  // CubeAsyncStream), driven by request(n) and PollResponse; streams still
+  // running when the connection closes fail with ECANCELED
+  void StartAsyncStream(struct ArrowArrayStream *stream,
+                        struct ArrowAsyncDeviceStreamHandler *handler);
+
+  // Encode every row of a parameter batch for this connection's protocol,
+  // appending one entry per row to out. parameter_types are the types the
+  // server chose when the statement was prepared (PostgreSQL mode).
+  Status EncodeParameters(const struct ArrowSchema *schema,
+                          const struct ArrowArray *array,
+                          const std::vector<Oid> &parameter_types,
+                          std::vector<CubeQueryParameters> *out);
+
+  // Metadata queries. Both answer from the database's CubeMetadataCache
+  // when it is enabled; GetTableSchema otherwise looks the table up in
+  // information_schema.columns with bound parameters, and keeps the result
+  // for table_schema_cache_ttl_ms.
+  Result<std::vector<std::string>> GetTableTypes();
   Status GetTableSchema(const std::string &table_schema,
                         const std::string &table_name,
                         struct ArrowSchema *schema);
+  // Statistics of the matching tables (see ReadStatistics); kept in the
+  // CubeMetadataCache with the model, and read again unless approximate
+  Status GetStatistics(std::optional<std::string_view> catalog,
+                       std::optional<std::string_view> db_schema,
+                       std::optional<std::string_view> table_name,
+                       bool approximate, struct ArrowArrayStream *out);
 
   const std::string &host() const { return host_; }
   const std::string &port() const { return port_; }
@@ -81,8 +347,297 @@ public:
   const std::string &user() const { return user_; }
   const std::string &password() const { return password_; }
   ConnectionMode connection_mode() const { return connection_mode_; }
+  const CubeReaderOptions &reader_options() const { return reader_options_; }
+
+  // Nanoseconds spent verifying result FlatBuffers on this connection
+  int64_t verify_nanos() const { return reader_options_.verify_nanos->load(); }
+
+  // Prepares and queries that reused a handle of the prepared cache
+  int64_t prepared_cache_hits() const { return prepared_cache_hits_; }
+
+  // Result schemas found in the schema cache instead of being parsed
+  int64_t schema_cache_hits() const {
+    return reader_options_.schema_cache ? reader_options_.schema_cache->hits()
+                                        : 0;
+  }
+
+  // Result buffers allocated from blocks freed by earlier batches
+  int64_t buffer_pool_hits() const {
+    return reader_options_.buffer_pool ? reader_options_.buffer_pool->hits()
+                                       : 0;
+  }
+
+  // Received result bytes this connection holds, charged to the database's
+  // tracker too
+  CubeMemoryTracker &memory() const { return *reader_options_.memory; }
+
+  // Queries answered from the database's result cache, by any connection
+  int64_t result_cache_hits() const {
+    return result_cache_ ? result_cache_->hits() : 0;
+  }
+
+  // Queries answered from the host's shared result cache by this process
+  int64_t shared_result_cache_hits() const {
+    return shared_result_cache_ ? shared_result_cache_->hits() : 0;
+  }
+
+  // Queries answered from the database's disk cache, by any connection
+  int64_t disk_cache_hits() const {
+    return disk_cache_ ? disk_cache_->hits() : 0;
+  }
+
+  // Queries answered by rolling up a result in the database's roll-up
+  // cache, by any connection
+  int64_t rollup_cache_hits() const {
+    return rollup_cache_ ? rollup_cache_->hits() : 0;
+  }
+
+  // Results built by merging a delta into a result in the database's delta
+  // cache, by any connection
+  int64_t delta_cache_merges() const {
+    return delta_cache_ ? delta_cache_->merges() : 0;
+  }
+
+  // Queries of the database's connections answered by another
+  // connection's execution
+  int64_t shared_results() const {
+    return inflight_ ? inflight_->shared() : 0;
+  }
+
+  // Results the database's prefetcher stored in the result cache
+  int64_t prefetched_results() const {
+    return prefetcher_ ? prefetcher_->prefetched() : 0;
+  }
+
+  // Connects of the database's connections that skipped DNS resolution
+  int64_t dns_cache_hits() const {
+    return address_cache_ ? address_cache_->hits() : 0;
+  }
+
+  // Native connects of the database's connections that resumed a TLS
+  // session
+  int64_t tls_session_resumptions() const {
+    return tls_context_ ? tls_context_->resumptions() : 0;
+  }
+
+  // Native sessions of the database that resumed a lost session in their
+  // handshake instead of authenticating
+  int64_t session_resumptions() const {
+    return pool_ ? pool_->resumptions() : 0;
+  }
+
+  // Native sessions this connection opened again after the server closed
+  // one
+  int64_t reconnects() const { return static_cast<int64_t>(session_); }
+
+  // host:port of the server the native session is on, or empty
+  std::string endpoint() const;
+
+  // CAPABILITY_* bits the native session agreed to in its handshake; 0
+  // without one
+  int64_t server_capabilities() const {
+    return native_client_ ? native_client_->GetCapabilities() : 0;
+  }
+
+  // Value of a handshake parameter the server sent, if it sent key
+  std::optional<std::string> server_parameter(std::string_view key) const;
+
+  // Sessions of the database's connections that moved to another server
+  // of hosts after one failed
+  int64_t failovers() const {
+    return endpoints_ ? endpoints_->failovers() : 0;
+  }
+
+  // Whether the server sends PostgreSQL-protocol results as Arrow IPC
+  bool postgres_arrow_output() const { return postgres_arrow_output_; }
+
+  // The database's data model, or null when it is not cached
+  const std::shared_ptr<CubeMetadataCache> &metadata_cache() const {
+    return metadata_cache_;
+  }
 
 private:
+  // Open and authenticate a native session to endpoint (see endpoints_)
+  // with the connection's options
+  // @param unreachable Set when the server did not accept the connection
+  Status OpenNativeSession(size_t endpoint, std::unique_ptr<NativeClient> *out,
+                           bool *unreachable, struct AdbcError *error);
+
+  // Take an idle session from the pool or open one, on the endpoint
+  // endpoints_ picks and failing over to the others
+  // @param skip Endpoints not to use
+  Status StartNativeSession(std::unique_ptr<NativeClient> *out,
+                            size_t *endpoint, struct AdbcError *error,
+                            std::vector<size_t> skip = {});
+
+  // Take an idle session to endpoint from the pool or open one, ejecting
+  // the endpoint if it is unreachable
+  Status StartNativeSessionOn(size_t endpoint,
+                              std::unique_ptr<NativeClient> *out,
+                              bool *unreachable, struct AdbcError *error);
+
+  // Under affinity routing, move the native session to the endpoint query
+  // hashes to before it is sent, if it is idle and the query cacheable;
+  // it stays where it is if that endpoint cannot be reached
+  void RouteByAffinity(const std::string &query,
+                       const CubeReaderOptions &reader_options);
+
+  // Hand a session back to the pool, or close it
+  void EndNativeSession(std::unique_ptr<NativeClient> client, size_t endpoint);
+
+  // Ingest through the native session and up to parallelism - 1 more,
+  // staging the data and committing it once every load is over
+  Status IngestStaged(IngestRequest request, struct ArrowArrayStream *data,
+                      int64_t parallelism, const std::string &partition_key,
+                      int64_t *rows, struct AdbcError *error);
+
+  // NativeClient::SendQuery on the native session. A read-only query with
+  // reader_options.hedge_after that is not answered in time is also sent
+  // on a session to another endpoint; the first to answer is returned,
+  // the other cancelled, and the native session replaced if the second
+  // one won.
+  // @param shared Connections wait on the result being captured, so it is
+  //   not hedged
+  AdbcStatusCode SendNativeQuery(const QueryRequest &request,
+                                 const std::string &sql,
+                                 const CubeReaderOptions &reader_options,
+                                 struct ArrowArrayStream *out,
+                                 struct AdbcError *error,
+                                 int64_t *rows_affected,
+                                 ResultSizeHint *size_hint,
+                                 std::unique_ptr<CubeResultCapture> capture,
+                                 bool shared);
+
+  // Feed the round trip of a query sent at start to endpoints_
+  void RecordLatency(std::chrono::steady_clock::time_point start);
+
+  // Before a request, replace an idle native session whose socket the
+  // server has closed (idle timeout, restart), and switch it to the token
+  // source's latest token
+  Status EnsureNativeSession(struct AdbcError *error);
+
+  // Switch the native session to the current token of token_source_,
+  // unless results are still owed on it
+  Status FollowTokenSource(struct AdbcError *error);
+
+  // SetToken, keeping token_source_
+  Status SwitchToken(std::string token, struct AdbcError *error);
+
+  // Replace the native session; the old one is kept if this fails
+  // @param failed The session failed a query, so its server is ejected
+  Status ReconnectNative(bool failed, struct AdbcError *error);
+
+  // Whether a query that failed with code before returning a result may be
+  // sent again on a new session: the session was lost and sql only reads
+  bool ShouldRetry(AdbcStatusCode code, const std::string &sql) const;
+
+  // Point request at statement: its handle, or its text if it was prepared
+  // on a session since replaced
+  void SetPrepared(const CubePreparedStatement &statement,
+                   QueryRequest *request) const;
+
+  // Whether the oldest unfinished result can be read without blocking
+  bool ResultReady();
+
+  // Pump async_streams_ and drop the finished ones
+  void PumpAsyncStreams();
+
+  // Hold session_mutex_, if the connection is shared between threads
+  std::unique_lock<std::recursive_mutex> LockSession() const;
+
+  // Wait for a slot of the database's admission control, unless permit
+  // holds one already or there is no limit. Interactive queries are let in
+  // before the unclassed, then batch, then background ones; the
+  // connection's priority orders those of a class.
+  Status Admit(std::shared_ptr<CubeAdmissionControl::Permit> *permit,
+               QueryPriority priority = QueryPriority::Default);
+
+  // Make the callbacks of a result stream hold session_mutex_, so it can
+  // be read while other threads use the connection, and make the stream
+  // hold permit until the result has been read
+  void GuardStream(
+      struct ArrowArrayStream *stream,
+      std::shared_ptr<CubeAdmissionControl::Permit> permit = nullptr) const;
+
+  // Drop cached metadata and results after a statement that may have
+  // changed them
+  void InvalidateCaches();
+
+  // Entry of the prepared cache for sql, prepared on the current session
+  // under the current security context, made the most recently used; null
+  // if there is none. Entries of earlier sessions or contexts are dropped.
+  std::shared_ptr<const CubePreparedStatement>
+  FindPrepared(const std::string &sql);
+
+  // Prepare sql on the native session and keep it in the prepared cache,
+  // evicting the least recently used entry if it is full
+  AdbcStatusCode
+  PrepareCached(const std::string &sql,
+                std::shared_ptr<const CubePreparedStatement> *out,
+                struct AdbcError *error);
+
+  // Entry of the prepared cache to run a query with no statement through:
+  // the one for sql if any, otherwise one prepared now if sql was run
+  // before on the session without it; null to send the text
+  std::shared_ptr<const CubePreparedStatement>
+  PreparedForQuery(const std::string &sql);
+
+  // Drop least recently used entries of the prepared cache until there is
+  // room for one more
+  void EvictPrepared();
+
+  // Drop the prepared cache entry for sql, or every entry
+  void ForgetPrepared(const std::string &sql);
+  void ClearPreparedCache();
+
+  // Close statement's handle on the server if it belongs to this session
+  void CloseHandle(const CubePreparedStatement &statement);
+
+  // Replay a cached result of sql with these parameters, roll up a cached
+  // finer result, or take the result of another connection running the
+  // same query, into out and return true; otherwise set capture to record
+  // this execution's result if it may be cached or shared (native mode
+  // only). shared is set when other
+  // connections wait on this execution, which must then be read in full.
+  bool FindCachedResult(const std::string &sql,
+                        const CubeQueryParameters *parameters,
+                        const CubeReaderOptions &reader_options,
+                        struct ArrowArrayStream *out, int64_t *rows_affected,
+                        std::unique_ptr<CubeResultCapture> *capture,
+                        bool *shared);
+
+  // Queue normalized_sql, a cacheable query, on the prefetcher with the
+  // key it would be looked up under with reader_options
+  void SubmitPrefetch(std::string normalized_sql,
+                      const CubeReaderOptions &reader_options);
+  // Queue the drill-down of a query just run, if prefetching drill-downs
+  void PrefetchDrillDown(const std::string &sql,
+                         const CubeQueryParameters *parameters,
+                         const CubeReaderOptions &reader_options);
+
+  // Key under which the delta cache keeps the result of sql with these
+  // parameters; empty if the result is not kept (no delta cache, a server
+  // without delta results, or a query or read option that is not cached)
+  std::string DeltaCacheKey(const std::string &sql,
+                            const CubeQueryParameters *parameters,
+                            const CubeReaderOptions &reader_options) const;
+
+  // Send a sampled query and the exact one behind it; out returns the
+  // sample, an empty batch, then the exact result (sample_refine)
+  Status ExecuteRefined(const std::string &query,
+                        const CubeReaderOptions &reader_options,
+                        const CubeQueryParameters *parameters,
+                        struct ArrowArrayStream *out, struct AdbcError *error);
+
+  // Send request as a delta of the result kept under key, merge the
+  // server's answer into it and keep the merged result; out reads the
+  // merged result
+  AdbcStatusCode SendDeltaQuery(QueryRequest request, const std::string &key,
+                                const CubeReaderOptions &reader_options,
+                                struct ArrowArrayStream *out,
+                                struct AdbcError *error,
+                                int64_t *rows_affected);
+
   std::string host_;
   std::string port_;
   std::string token_;
@@ -91,6 +646,71 @@ private:
   std::string password_;
   ConnectionMode connection_mode_ =
       ConnectionMode::PostgreSQL; // Default to PostgreSQL for compatibility
+  CubeReaderOptions reader_options_;
+  uint32_t max_message_bytes_ = DEFAULT_MAX_MESSAGE_BYTES;
+  NativeSocketOptions socket_options_;
+  NativeTimeouts timeouts_;
+  bool pipelining_ = false;
+  size_t prefetch_bytes_ = 0;
+  size_t cursor_fetch_bytes_ = 0;
+  uint32_t credit_batches_ = 0;
+  size_t credit_bytes_ = 0;
+  CompressionCodec compression_ = CompressionCodec::None;
+  CubeTransportKind transport_ = CubeTransportKind::Socket;
+  size_t shared_memory_bytes_ = 0;
+  bool reconnect_ = true; // Replace native sessions the server closed
+  // Held by every call using the native session, and by the callbacks of
+  // the streams it returned, when the database set thread_safe; null
+  // otherwise
+  std::shared_ptr<std::recursive_mutex> session_mutex_;
+  // Results pushed to async handlers; pumped outside session_mutex_, since
+  // handlers may call back into the connection
+  std::vector<std::shared_ptr<CubeAsyncStream>> async_streams_;
+  CubeTracer tracer_;     // Spans of native sessions and queries
+  std::string capture_dir_; // Where native sessions are recorded, if set
+  uint64_t session_ = 0;  // Native sessions replaced so far
+  uint64_t context_ = 0;  // Tokens switched to so far (see SetToken)
+  std::shared_ptr<NativeClientPool> pool_;
+  // Renewed tokens the connection switches to; null once it set its own
+  std::shared_ptr<CubeTokenSource> token_source_;
+  // Data model changes reported to the database (null if not watched),
+  // and the model_generation() the prepared and table schema caches hold
+  std::shared_ptr<CubeChangeWatcher> change_watcher_;
+  uint64_t model_generation_ = 0;
+  PostgresOutputFormat postgres_output_format_ = PostgresOutputFormat::Auto;
+  bool postgres_arrow_output_ = false; // Negotiated by Connect
+  uint64_t statements_prepared_ = 0;   // Numbers PostgreSQL statement names
+  // Prepared cache (native mode): statements kept prepared on the session
+  // for reuse, by the FingerprintSql of their text. A null statement
+  // records SQL run once without one, which is prepared if it comes again.
+  struct PreparedCacheEntry {
+    std::shared_ptr<const CubePreparedStatement> statement;
+    std::list<std::string>::iterator key;
+  };
+  size_t prepared_cache_entries_ = 0; // 0 = no cache
+  std::list<std::string> prepared_keys_; // Most recently used first
+  std::unordered_map<std::string, PreparedCacheEntry> prepared_cache_;
+  int64_t prepared_cache_hits_ = 0;
+  std::unique_ptr<TableSchemaCache> table_schema_cache_; // Null if disabled
+  std::shared_ptr<CubeMetadataCache> metadata_cache_;    // Null if disabled
+  std::shared_ptr<CubeResultCache> result_cache_;        // Null if disabled
+  std::shared_ptr<CubeRollupCache> rollup_cache_;        // Null if disabled
+  std::shared_ptr<CubeSharedResultCache> shared_result_cache_; // Ditto
+  std::shared_ptr<CubeDiskCache> disk_cache_;            // Null if disabled
+  std::shared_ptr<CubeDeltaCache> delta_cache_;          // Null if disabled
+  std::shared_ptr<CubeInflightQueries> inflight_;        // Null if disabled
+  std::shared_ptr<CubePrefetcher> prefetcher_;           // Null if disabled
+  std::shared_ptr<CubeAdmissionControl> admission_;      // Null if no limit
+  int64_t priority_ = 0;
+  bool require_preaggregation_ = false;
+  // Slot held by the connection's open results, if any
+  std::weak_ptr<CubeAdmissionControl::Permit> admitted_;
+  std::shared_ptr<CubeAddressCache> address_cache_;      // Null if disabled
+  std::shared_ptr<CubeEndpointSet> endpoints_; // Null with a single server
+  size_t endpoint_ = 0; // Index in endpoints_ of the native session's server
+  bool tls_ = false;
+  CubeTlsOptions tls_options_;
+  std::shared_ptr<CubeTlsContext> tls_context_; // Null if disabled
   bool connected_ = false;
 
   // Connection objects (only one will be used based on mode)
@@ -107,10 +727,28 @@ public:
   Status InitImpl(void *raw_connection);
   Status ReleaseImpl();
   Status SetOptionImpl(std::string_view key, driver::Option value);
+  Result<driver::Option> GetOption(std::string_view key) override;
+  AdbcStatusCode Cancel(struct AdbcError *error);
+  AdbcStatusCode ReadPartition(const uint8_t *serialized_partition,
+                               size_t serialized_length,
+                               struct ArrowArrayStream *out,
+                               struct AdbcError *error);
+  /// Backs AdbcCubeConnectionExecuteQueries
+  AdbcStatusCode ExecuteQueries(const char **queries, size_t count,
+                                struct ArrowArrayStream *out,
+                                struct AdbcError *error);
 
-  Result<std::unique_ptr<driver::GetObjectsHelper>> GetObjectsImpl() {
-    return std::make_unique<driver::GetObjectsHelper>();
-  }
+  /// Backs AdbcConnectionGetStatistics and AdbcConnectionGetStatisticNames
+  /// (the driver defines no statistics of its own)
+  AdbcStatusCode GetStatistics(const char *catalog, const char *db_schema,
+                               const char *table_name, char approximate,
+                               struct ArrowArrayStream *out,
+                               struct AdbcError *error);
+  AdbcStatusCode GetStatisticNames(struct ArrowArrayStream *out,
+                                   struct AdbcError *error);
+
+  Result<std::unique_ptr<driver::GetObjectsHelper>> GetObjectsImpl();
+  Result<std::vector<std::string>> GetTableTypesImpl();
 
   Status GetTableSchemaImpl(std::optional<std::string_view> catalog,
                             std::optional<std::string_view> db_schema,
@@ -118,6 +756,12 @@ public:
                             struct ArrowSchema *schema);
 
   std::unique_ptr<CubeConnectionImpl> impl_;
+  // adbc.cube.token, adbc.cube.memory_limit_bytes, adbc.cube.priority and
+  // adbc.cube.require_preaggregation set before InitImpl
+  std::optional<std::string> token_;
+  std::optional<size_t> memory_limit_;
+  int64_t priority_ = 0;
+  bool require_preaggregation_ = false;
 };
 
 } // namespace adbc::cube
@@ -0,0 +1,323 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#include <algorithm>
+#include <utility>
+
+#include "driver/cube/connection_pool.h"
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/metrics.h"
+
+namespace adbc::cube {
+
+NativeClientPool::NativeClientPool(NativeClientPoolOptions options)
+    : options_(options), fork_generation_(CubeForkGeneration()) {
+  CubeForkRegisterMutex(&mutex_);
+  if (options_.max_idle > 0 && options_.keepalive.count() > 0) {
+    keepalive_thread_ = std::thread(&NativeClientPool::KeepaliveLoop, this);
+  }
+}
+
+NativeClientPool::~NativeClientPool() {
+  CubeForkUnregisterMutex(&mutex_);
+  if (fork_generation_ != CubeForkGeneration()) {
+    // The keepalive thread stayed in the parent. Its condition variable
+    // still counts it as a waiter, so it is not notified either.
+    if (keepalive_thread_.joinable()) {
+      keepalive_thread_.detach();
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  keepalive_cv_.notify_all();
+  if (keepalive_thread_.joinable()) {
+    keepalive_thread_.join();
+  }
+}
+
+std::unique_ptr<NativeClient>
+NativeClientPool::Acquire(size_t endpoint, const std::string &token) {
+  std::unique_ptr<NativeClient> client;
+  while (true) {
+    std::vector<IdleClient> stale;
+    {
+      auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().pool_lock);
+      EvictExpired(std::chrono::steady_clock::now());
+      // Most recently used first: it is the least likely to have timed out
+      // on the server side. A session under token is preferred to one that
+      // would have to switch to it.
+      for (int pass = 0; pass < 2 && !client; pass++) {
+        for (size_t i = idle_.size(); i-- > 0;) {
+          const NativeClient &idle = *idle_[i].client;
+          if (idle_[i].endpoint != endpoint ||
+              (pass == 0 ? idle.GetToken() != token
+                         : !idle.SupportsSecurityContext())) {
+            continue;
+          }
+          IdleClient candidate = std::move(idle_[i]);
+          idle_.erase(idle_.begin() + i);
+          if (!options_.health_check || candidate.client->IsHealthy()) {
+            client = std::move(candidate.client);
+            break;
+          }
+          stale.push_back(std::move(candidate));
+        }
+      }
+    }
+    // Sockets of stale sessions are closed here, outside the lock; the
+    // server may still hold the sessions
+    for (const auto &candidate : stale) {
+      KeepResumable(*candidate.client, endpoint);
+    }
+    if (!client || !options_.health_check ||
+        options_.ping_timeout.count() == 0 || !client->SupportsPing()) {
+      break;
+    }
+    // An open socket does not mean the server still has the session
+    AdbcError error = ADBC_ERROR_INIT;
+    auto status = client->Ping(options_.ping_timeout, &error);
+    if (error.release) {
+      error.release(&error);
+    }
+    if (status == ADBC_STATUS_OK) {
+      break;
+    }
+    KeepResumable(*client, endpoint);
+    client.reset();
+  }
+  if (client) {
+    CubeMetrics::Global().pool_hits.fetch_add(1, std::memory_order_relaxed);
+  } else if (options_.max_idle > 0) {
+    CubeMetrics::Global().pool_misses.fetch_add(1, std::memory_order_relaxed);
+  }
+  return client;
+}
+
+void NativeClientPool::Release(std::unique_ptr<NativeClient> client,
+                               size_t endpoint) {
+  if (!client || options_.max_idle == 0 || !client->IsReusable()) {
+    return;
+  }
+
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().pool_lock);
+  auto now = std::chrono::steady_clock::now();
+  EvictExpired(now);
+  if (idle_.size() >= options_.max_idle) {
+    return;
+  }
+  idle_.push_back(IdleClient{std::move(client), now, endpoint, now});
+}
+
+void NativeClientPool::Clear() {
+  std::vector<IdleClient> idle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DropInherited();
+    idle.swap(idle_);
+    lost_.clear();
+  }
+}
+
+void NativeClientPool::KeepResumable(const NativeClient &client,
+                                     size_t endpoint) {
+  const std::string &session_id = client.GetResumableSessionId();
+  if (session_id.empty()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto now = std::chrono::steady_clock::now();
+  EvictExpired(now);
+  for (const auto &lost : lost_) {
+    if (lost.id == session_id && lost.endpoint == endpoint) {
+      return;
+    }
+  }
+  if (lost_.size() >= kMaxResumable) {
+    lost_.erase(lost_.begin());
+  }
+  lost_.push_back(LostSession{session_id, client.GetToken(), now, endpoint});
+}
+
+std::string NativeClientPool::TakeResumable(size_t endpoint,
+                                            const std::string &token) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  EvictExpired(std::chrono::steady_clock::now());
+  for (size_t i = lost_.size(); i-- > 0;) {
+    if (lost_[i].endpoint == endpoint && lost_[i].token == token) {
+      std::string id = std::move(lost_[i].id);
+      lost_.erase(lost_.begin() + i);
+      return id;
+    }
+  }
+  return std::string();
+}
+
+size_t NativeClientPool::IdleCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fork_generation_ == CubeForkGeneration() ? idle_.size() : 0;
+}
+
+void NativeClientPool::SwitchToken(const std::string &from,
+                                   const std::string &to,
+                                   const std::string &database) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<IdleClient> due;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EvictExpired(Clock::now());
+    for (size_t i = 0; i < idle_.size();) {
+      if (idle_[i].client->GetToken() == from) {
+        due.push_back(std::move(idle_[i]));
+        idle_.erase(idle_.begin() + i);
+      } else {
+        i++;
+      }
+    }
+    lost_.erase(std::remove_if(lost_.begin(), lost_.end(),
+                               [&](const LostSession &lost) {
+                                 return lost.token == from;
+                               }),
+                lost_.end());
+  }
+  if (due.empty()) {
+    return;
+  }
+
+  // Switched outside the lock, as keepalive pings are
+  std::vector<IdleClient> switched;
+  for (auto &idle : due) {
+    AdbcError error = ADBC_ERROR_INIT;
+    if (idle.client->SupportsSecurityContext() &&
+        idle.client->SetSecurityContext(to, database, &error) ==
+            ADBC_STATUS_OK) {
+      switched.push_back(std::move(idle));
+    }
+    if (error.release) {
+      error.release(&error);
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &idle : switched) {
+    auto it = std::upper_bound(
+        idle_.begin(), idle_.end(), idle.since,
+        [](Clock::time_point since, const IdleClient &other) {
+          return since < other.since;
+        });
+    idle_.insert(it, std::move(idle));
+  }
+  if (idle_.size() > options_.max_idle) {
+    idle_.erase(idle_.begin(),
+                idle_.begin() + (idle_.size() - options_.max_idle));
+  }
+}
+
+void NativeClientPool::DropInherited() {
+  uint64_t generation = CubeForkGeneration();
+  if (fork_generation_ == generation) {
+    return;
+  }
+  // Sessions opened before the fork are the parent's; the child opens its
+  // own as its connections ask for them
+  for (auto &idle : idle_) {
+    idle.client->Abandon();
+  }
+  idle_.clear();
+  lost_.clear();
+  fork_generation_ = generation;
+}
+
+void NativeClientPool::EvictExpired(std::chrono::steady_clock::time_point now) {
+  DropInherited();
+  size_t expired = 0;
+  while (expired < idle_.size() &&
+         now - idle_[expired].since > options_.idle_timeout) {
+    ++expired;
+  }
+  idle_.erase(idle_.begin(), idle_.begin() + expired);
+
+  expired = 0;
+  while (expired < lost_.size() &&
+         now - lost_[expired].since > options_.idle_timeout) {
+    ++expired;
+  }
+  lost_.erase(lost_.begin(), lost_.begin() + expired);
+}
+
+void NativeClientPool::KeepaliveLoop() {
+  using Clock = std::chrono::steady_clock;
+  auto timeout = options_.ping_timeout.count() > 0 ? options_.ping_timeout
+                                                   : kKeepalivePingTimeout;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    keepalive_cv_.wait_for(lock, options_.keepalive,
+                           [this] { return stopping_; });
+    if (stopping_) {
+      return;
+    }
+    auto now = Clock::now();
+    EvictExpired(now);
+    std::vector<IdleClient> due;
+    for (size_t i = 0; i < idle_.size();) {
+      if (now - idle_[i].pinged >= options_.keepalive &&
+          idle_[i].client->SupportsPing()) {
+        due.push_back(std::move(idle_[i]));
+        idle_.erase(idle_.begin() + i);
+      } else {
+        i++;
+      }
+    }
+    if (due.empty()) {
+      continue;
+    }
+
+    // Pinged outside the lock; Acquire meanwhile takes the other sessions
+    lock.unlock();
+    std::vector<IdleClient> alive;
+    for (auto &idle : due) {
+      AdbcError error = ADBC_ERROR_INIT;
+      if (idle.client->Ping(timeout, &error) == ADBC_STATUS_OK) {
+        idle.pinged = Clock::now();
+        alive.push_back(std::move(idle));
+      } else {
+        KeepResumable(*idle.client, idle.endpoint);
+      }
+      if (error.release) {
+        error.release(&error);
+      }
+    }
+    lock.lock();
+    for (auto &idle : alive) {
+      auto it = std::upper_bound(
+          idle_.begin(), idle_.end(), idle.since,
+          [](Clock::time_point since, const IdleClient &other) {
+            return since < other.since;
+          });
+      idle_.insert(it, std::move(idle));
+    }
+    // Sessions released while these were out may have filled the pool
+    if (idle_.size() > options_.max_idle) {
+      idle_.erase(idle_.begin(),
+                  idle_.begin() + (idle_.size() - options_.max_idle));
+    }
+  }
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,152 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "driver/cube/native_client.h"
+
+namespace adbc::cube {
+
+struct NativeClientPoolOptions {
+  /// Maximum number of idle sessions kept; 0 disables pooling
+  size_t max_idle = 0;
+  /// Idle sessions older than this are closed instead of reused
+  std::chrono::milliseconds idle_timeout{60000};
+  /// Probe the socket before handing out an idle session
+  bool health_check = true;
+  /// With health_check, also Ping an idle session before handing it out,
+  /// waiting this long for the Pong; 0 = no ping
+  std::chrono::milliseconds ping_timeout{0};
+  /// Ping idle sessions this often from a background thread, closing those
+  /// that fail; 0 = no keepalive
+  std::chrono::milliseconds keepalive{0};
+};
+
+/// Bounded pool of idle, already-authenticated native protocol sessions.
+///
+/// Owned by a CubeDatabase and shared with its connections, so that opening
+/// a connection can skip the TCP connect, handshake and authentication round
+/// trips. Also keeps the IDs of sessions that were lost, so that a new
+/// session to the same server can resume one in its handshake instead of
+/// authenticating. Thread-safe.
+///
+/// Fork-safe: in a child the sessions kept by the parent are dropped
+/// without touching their sockets, and the pool fills again from the
+/// child's own connections. Keepalive pings stay with the parent.
+class NativeClientPool {
+public:
+  explicit NativeClientPool(NativeClientPoolOptions options);
+  ~NativeClientPool();
+
+  NativeClientPool(const NativeClientPool &) = delete;
+  NativeClientPool &operator=(const NativeClientPool &) = delete;
+
+  /// Take an idle session to the given endpoint (see CubeEndpointSet; 0
+  /// with a single server), or nullptr if none is usable. One under
+  /// another token is only taken if it can switch to this one (see
+  /// NativeClient::SetSecurityContext).
+  std::unique_ptr<NativeClient> Acquire(size_t endpoint,
+                                        const std::string &token);
+
+  /// Return a session to the pool; it is closed if it cannot be reused or
+  /// the pool is full
+  void Release(std::unique_ptr<NativeClient> client, size_t endpoint = 0);
+
+  /// Close all idle sessions and forget the resumable ones
+  void Clear();
+
+  size_t IdleCount() const;
+
+  /// Switch idle sessions under token from to token to, in the background
+  /// rather than when a connection takes one (see
+  /// NativeClient::SetSecurityContext); those that cannot switch are
+  /// closed, and lost sessions under from are forgotten
+  void SwitchToken(const std::string &from, const std::string &to,
+                   const std::string &database);
+
+  /// Keep the ID of an authenticated session to endpoint that was lost
+  /// rather than closed on purpose, with the token it ran under; a client
+  /// that never authenticated is ignored
+  void KeepResumable(const NativeClient &client, size_t endpoint = 0);
+
+  /// Take the most recent ID kept for endpoint and token, or empty if none
+  std::string TakeResumable(size_t endpoint, const std::string &token);
+
+  /// Count a session opened by resuming a kept one
+  void RecordResumption() {
+    resumptions_.fetch_add(1, std::memory_order_relaxed);
+  }
+  int64_t resumptions() const {
+    return resumptions_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct IdleClient {
+    std::unique_ptr<NativeClient> client;
+    std::chrono::steady_clock::time_point since;
+    size_t endpoint;
+    std::chrono::steady_clock::time_point pinged; // Last answered, or since
+  };
+
+  struct LostSession {
+    std::string id;
+    std::string token;
+    std::chrono::steady_clock::time_point since;
+    size_t endpoint;
+  };
+
+  /// Drop sessions idle, or lost, for longer than the timeout, and those
+  /// inherited across a fork (mutex_ must be held)
+  void EvictExpired(std::chrono::steady_clock::time_point now);
+
+  /// In a forked child, drop the sessions of the parent (mutex_ must be
+  /// held)
+  void DropInherited();
+
+  /// Ping sessions not heard from for options_.keepalive, until stopped
+  void KeepaliveLoop();
+
+  /// Wait for a keepalive Pong when options_.ping_timeout is 0
+  static constexpr std::chrono::milliseconds kKeepalivePingTimeout{5000};
+
+  /// Lost sessions kept; the server is unlikely to hold on to more
+  static constexpr size_t kMaxResumable = 64;
+
+  const NativeClientPoolOptions options_;
+  mutable std::mutex mutex_;
+  std::vector<IdleClient> idle_;  // Oldest first
+  std::vector<LostSession> lost_; // Oldest first
+  uint64_t fork_generation_;      // CubeForkGeneration() of idle_ and lost_
+  std::atomic<int64_t> resumptions_{0};
+  std::condition_variable keepalive_cv_;
+  bool stopping_ = false;
+  std::thread keepalive_thread_;
+};
+
+} // namespace adbc::cube
@@ -96,6 +96,57 @@ AdbcStatusCode AdbcConnectionRelease(struct AdbcConnection *connection,
   return CubeDriver::CRelease<>(connection, error);
 }
 
+// Driver-specific entrypoints
+AdbcStatusCode AdbcCubeConnectionExecuteQueries(
+    struct AdbcConnection *connection, const char **queries, size_t count,
+    struct ArrowArrayStream *out, struct AdbcError *error) {
+  if (!connection || !connection->private_data) {
+    return adbc::cube::status::InvalidState("Connection not initialized")
+        .ToAdbc(error);
+  }
+  auto *private_data =
+      reinterpret_cast<adbc::cube::CubeConnection *>(connection->private_data);
+  return private_data->ExecuteQueries(queries, count, out, error);
+}
+
+AdbcStatusCode AdbcCubeStatementExecuteQueryAsync(
+    struct AdbcStatement *statement,
+    struct ArrowAsyncDeviceStreamHandler *handler, struct AdbcError *error) {
+  if (!statement || !statement->private_data) {
+    return adbc::cube::status::InvalidState("Statement not initialized")
+        .ToAdbc(error);
+  }
+  auto *private_data =
+      reinterpret_cast<adbc::cube::CubeStatement *>(statement->private_data);
+  return private_data->ExecuteQueryAsync(handler, error);
+}
+
+AdbcStatusCode AdbcCubeStatementExecuteQueryTee(
+    struct AdbcStatement *statement, size_t count,
+    int64_t max_buffered_batches, struct ArrowArrayStream *out,
+    struct AdbcError *error) {
+  if (!statement || !statement->private_data) {
+    return adbc::cube::status::InvalidState("Statement not initialized")
+        .ToAdbc(error);
+  }
+  auto *private_data =
+      reinterpret_cast<adbc::cube::CubeStatement *>(statement->private_data);
+  return private_data->ExecuteQueryTee(count, max_buffered_batches, out,
+                                       error);
+}
+
+AdbcStatusCode AdbcCubeStatementExecuteQueryDevice(
+    struct AdbcStatement *statement, struct ArrowDeviceArrayStream *out,
+    int64_t *rows_affected, struct AdbcError *error) {
+  if (!statement || !statement->private_data) {
+    return adbc::cube::status::InvalidState("Statement not initialized")
+        .ToAdbc(error);
+  }
+  auto *private_data =
+      reinterpret_cast<adbc::cube::CubeStatement *>(statement->private_data);
+  return private_data->ExecuteQueryDevice(out, rows_affected, error);
+}
+
 // Statement entrypoints
 AdbcStatusCode AdbcStatementNew(struct AdbcConnection *connection,
                                 struct AdbcStatement *statement,
@@ -188,10 +239,23 @@ AdbcStatusCode AdbcDriverInit(int version, void *raw_driver,
   driver->StatementBind = AdbcStatementBind;
   driver->StatementBindStream = AdbcStatementBindStream;
   driver->StatementExecuteQuery = AdbcStatementExecuteQuery;
+  driver->StatementExecutePartitions = CubeDriver::CStatementExecutePartitions;
   driver->StatementPrepare = AdbcStatementPrepare;
   driver->StatementGetParameterSchema = AdbcStatementGetParameterSchema;
   driver->StatementRelease = AdbcStatementRelease;
 
+  if (version >= ADBC_VERSION_1_1_0) {
+    driver->DatabaseGetOption = CubeDriver::CGetOption<struct AdbcDatabase>;
+    driver->ConnectionGetOption = CubeDriver::CGetOption<struct AdbcConnection>;
+    driver->ConnectionGetOptionInt =
+        CubeDriver::CGetOptionInt<struct AdbcConnection>;
+    driver->StatementCancel = CubeDriver::CStatementCancel;
+    driver->StatementExecuteSchema = CubeDriver::CStatementExecuteSchema;
+    driver->StatementGetOption = CubeDriver::CGetOption<struct AdbcStatement>;
+    driver->StatementGetOptionInt =
+        CubeDriver::CGetOptionInt<struct AdbcStatement>;
+  }
+
   return ADBC_STATUS_OK;
 }
 
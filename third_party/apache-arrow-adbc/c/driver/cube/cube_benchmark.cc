@@ -0,0 +1,517 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/batch_queue.h"
+#include "driver/cube/buffer_kernels.h"
+#include "driver/cube/mock_server.h"
+#include "driver/cube/native_client.h"
+#include "driver/cube/native_protocol.h"
+#include "driver/cube/text_parsers.h"
+
+// Throughput of the buffer kernels used when the reader copies a column,
+// of the parsers for PostgreSQL text values, of decoding QueryResponseBatch
+// frames as the native client receives them, and of the client against a
+// loopback CubeMockServer. Bytes processed count the input read, so the
+// reported rate is in the same units as the IPC body.
+
+namespace {
+
+std::vector<uint8_t> RandomBytes(size_t n) {
+  std::mt19937 rng(42);
+  std::vector<uint8_t> bytes(n);
+  for (auto &b : bytes) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return bytes;
+}
+
+template <typename T> std::vector<T> RandomOffsets(size_t n) {
+  std::mt19937 rng(42);
+  std::vector<T> offsets(n);
+  T offset = 1000;
+  for (auto &o : offsets) {
+    o = offset;
+    offset += static_cast<T>(rng() % 64);
+  }
+  return offsets;
+}
+
+// Values as PostgreSQL prints them: float8 with the shortest round-trip
+// digits, or timestamptz in UTC
+std::vector<std::string> RandomTexts(bool timestamps, size_t n) {
+  std::mt19937_64 rng(42);
+  std::vector<std::string> texts(n);
+  char buffer[64];
+  for (auto &text : texts) {
+    if (timestamps) {
+      snprintf(buffer, sizeof(buffer),
+               "20%02d-%02d-%02d %02d:%02d:%02d.%06d+00",
+               static_cast<int>(rng() % 30), static_cast<int>(rng() % 12 + 1),
+               static_cast<int>(rng() % 28 + 1), static_cast<int>(rng() % 24),
+               static_cast<int>(rng() % 60), static_cast<int>(rng() % 60),
+               static_cast<int>(rng() % 1000000));
+    } else {
+      snprintf(buffer, sizeof(buffer), "%.15g",
+               static_cast<double>(rng() % 100000000) / 100);
+    }
+    text = buffer;
+  }
+  return texts;
+}
+
+// A response as the server sends it with CAPABILITY_SCHEMA_ONCE: the
+// schema, then each batch framed as a QueryResponseBatch
+struct Recording {
+  std::vector<uint8_t> schema;
+  std::vector<uint8_t> frames;
+  int64_t rows = 0;
+};
+
+const Recording &Record(adbc::cube::MockResultShape shape) {
+  static Recording recordings[4];
+  Recording &recording = recordings[static_cast<int>(shape)];
+  if (recording.rows > 0) {
+    return recording;
+  }
+  adbc::cube::MockResultOptions options;
+  options.shape = shape;
+  auto result = adbc::cube::MakeMockResult(options);
+  recording.schema = std::move(result.schema);
+  recording.rows = result.rows;
+  for (auto &ipc : result.batches) {
+    adbc::cube::QueryResponseBatch batch;
+    batch.arrow_ipc_batch = std::move(ipc);
+    auto frame = batch.Encode();
+    recording.frames.insert(recording.frames.end(), frame.begin(),
+                            frame.end());
+  }
+  return recording;
+}
+
+// Split frames into the Arrow IPC bytes of each batch, each copied into an
+// aligned buffer as NativeClient reads it off the socket
+std::vector<std::shared_ptr<const adbc::cube::CubeIpcBytes>>
+ReadFrames(const std::vector<uint8_t> &frames) {
+  std::vector<std::shared_ptr<const adbc::cube::CubeIpcBytes>> batches;
+  const uint8_t *ptr = frames.data();
+  const uint8_t *end = ptr + frames.size();
+  while (ptr < end) {
+    uint32_t length = adbc::cube::MessageCodec::GetU32(ptr, end);
+    uint32_t ipc_length = 0;
+    const char *error = nullptr;
+    if (!adbc::cube::QueryResponseBatch::DecodeHeader(ptr, length,
+                                                      &ipc_length, &error)) {
+      std::abort(); // The recording is made by the benchmark itself
+    }
+    const uint8_t *ipc = ptr + adbc::cube::QueryResponseBatch::kHeaderSize;
+    batches.push_back(std::make_shared<const adbc::cube::CubeIpcBytes>(
+        adbc::cube::CubeIpcBuffer(ipc, ipc + ipc_length)));
+    ptr += length;
+  }
+  return batches;
+}
+
+// A mock server returning rows_per_batch * batches rows of shape, started
+// on first use and kept for the rest of the run
+const adbc::cube::CubeMockServer &
+MockServer(adbc::cube::MockResultShape shape, int64_t rows_per_batch,
+           int batches, std::chrono::microseconds latency) {
+  using Key = std::tuple<int, int64_t, int, int64_t>;
+  static std::mutex mutex;
+  static std::map<Key, std::unique_ptr<adbc::cube::CubeMockServer>> servers;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &server = servers[Key(static_cast<int>(shape), rows_per_batch, batches,
+                             latency.count())];
+  if (!server) {
+    adbc::cube::MockServerOptions options;
+    options.result.shape = shape;
+    options.result.rows_per_batch = rows_per_batch;
+    options.result.batches = batches;
+    options.latency = latency;
+    server = std::make_unique<adbc::cube::CubeMockServer>(options);
+    if (server->Start() != 0) {
+      std::abort();
+    }
+  }
+  return *server;
+}
+
+// An authenticated session to server, or null after reporting the error
+std::unique_ptr<adbc::cube::NativeClient>
+OpenSession(const adbc::cube::CubeMockServer &server,
+            benchmark::State &state) {
+  auto client = std::make_unique<adbc::cube::NativeClient>();
+  AdbcError error = ADBC_ERROR_INIT;
+  if (client->Connect("127.0.0.1", server.port(), &error) != ADBC_STATUS_OK ||
+      client->Authenticate("mock", "", &error) != ADBC_STATUS_OK) {
+    state.SkipWithError(error.message ? error.message : "Failed to connect");
+    client.reset();
+  }
+  if (error.release) {
+    error.release(&error);
+  }
+  return client;
+}
+
+// Rows of a query's result, read to the end, or -1 if it failed
+int64_t RunQuery(adbc::cube::NativeClient *client) {
+  struct ArrowArrayStream stream;
+  if (client->ExecuteQuery("SELECT 1", &stream) != ADBC_STATUS_OK) {
+    return -1;
+  }
+  int64_t rows = 0;
+  while (true) {
+    struct ArrowArray array;
+    if (stream.get_next(&stream, &array) != 0) {
+      rows = -1;
+      break;
+    }
+    if (!array.release) {
+      break;
+    }
+    rows += array.length;
+    array.release(&array);
+  }
+  stream.release(&stream);
+  return rows;
+}
+
+} // namespace
+
+static void BM_CopyBitmap(benchmark::State &state) {
+  int64_t n_bits = state.range(0);
+  int64_t src_offset = state.range(1);
+  auto src = RandomBytes((n_bits + src_offset) / 8 + 1);
+  std::vector<uint8_t> dst(n_bits / 8 + 1);
+  state.SetLabel(adbc::cube::BufferKernelsImplementation());
+  for (auto _ : state) {
+    adbc::cube::CopyBitmap(src.data(), src_offset, n_bits, dst.data());
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (n_bits / 8));
+}
+BENCHMARK(BM_CopyBitmap)->Args({1 << 23, 0})->Args({1 << 23, 3});
+
+// Bit-at-a-time copy the kernel replaces, for comparison
+static void BM_CopyBitmapPerBit(benchmark::State &state) {
+  int64_t n_bits = state.range(0);
+  int64_t src_offset = state.range(1);
+  auto src = RandomBytes((n_bits + src_offset) / 8 + 1);
+  std::vector<uint8_t> dst(n_bits / 8 + 1);
+  for (auto _ : state) {
+    for (int64_t i = 0; i < n_bits; i++) {
+      int64_t bit = src_offset + i;
+      uint8_t mask = static_cast<uint8_t>(1 << (i % 8));
+      if ((src[bit / 8] >> (bit % 8)) & 1) {
+        dst[i / 8] |= mask;
+      } else {
+        dst[i / 8] &= static_cast<uint8_t>(~mask);
+      }
+    }
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (n_bits / 8));
+}
+BENCHMARK(BM_CopyBitmapPerBit)->Args({1 << 23, 3});
+
+template <typename T> static void BM_RebaseOffsets(benchmark::State &state) {
+  int64_t length = state.range(0);
+  auto src = RandomOffsets<T>(length);
+  std::vector<T> dst(length);
+  state.SetLabel(adbc::cube::BufferKernelsImplementation());
+  for (auto _ : state) {
+    adbc::cube::RebaseOffsets(src.data(), length, src[0], dst.data());
+    benchmark::DoNotOptimize(dst.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * length * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_RebaseOffsets, int32_t)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_RebaseOffsets, int64_t)->Arg(1 << 20);
+
+static void BM_ParseDoubleText(benchmark::State &state) {
+  auto texts = RandomTexts(false, state.range(0));
+  int64_t bytes = 0;
+  for (const auto &text : texts) {
+    bytes += text.size();
+  }
+  for (auto _ : state) {
+    for (const auto &text : texts) {
+      double value;
+      adbc::cube::ParseDoubleText(text.data(), text.size(), &value);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseDoubleText)->Arg(1 << 16);
+
+// Per-value strtod the parser replaces, for comparison
+static void BM_ParseDoubleStrtod(benchmark::State &state) {
+  auto texts = RandomTexts(false, state.range(0));
+  int64_t bytes = 0;
+  for (const auto &text : texts) {
+    bytes += text.size();
+  }
+  for (auto _ : state) {
+    for (const auto &text : texts) {
+      double value = std::strtod(text.c_str(), nullptr);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseDoubleStrtod)->Arg(1 << 16);
+
+static void BM_ParseTimestampText(benchmark::State &state) {
+  auto texts = RandomTexts(true, state.range(0));
+  int64_t bytes = 0;
+  for (const auto &text : texts) {
+    bytes += text.size();
+  }
+  for (auto _ : state) {
+    for (const auto &text : texts) {
+      int64_t value;
+      adbc::cube::ParseTimestampText(text.data(), text.size(), &value);
+      benchmark::DoNotOptimize(value);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_ParseTimestampText)->Arg(1 << 16);
+
+// Taking the batches out of recorded frames, without decoding them
+static void BM_ReadFrames(benchmark::State &state) {
+  auto shape = static_cast<adbc::cube::MockResultShape>(state.range(0));
+  const Recording &recording = Record(shape);
+  state.SetLabel(adbc::cube::MockResultShapeName(shape));
+  for (auto _ : state) {
+    auto batches = ReadFrames(recording.frames);
+    benchmark::DoNotOptimize(batches.data());
+  }
+  state.SetBytesProcessed(state.iterations() * recording.frames.size());
+  state.counters["rows/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * recording.rows),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_ReadFrames)->DenseRange(0, 3);
+
+// Decoding received batches into arrays against the schema sent ahead of
+// them, as a result stream does; the second argument is zero_copy
+static void BM_DecodeBatches(benchmark::State &state) {
+  auto shape = static_cast<adbc::cube::MockResultShape>(state.range(0));
+  const Recording &recording = Record(shape);
+  adbc::cube::CubeReaderOptions options;
+  options.zero_copy = state.range(1) != 0;
+  adbc::cube::CubeArrowReader schema_reader(recording.schema, options);
+  ArrowError error;
+  std::memset(&error, 0, sizeof(error));
+  if (schema_reader.Init(&error) != NANOARROW_OK) {
+    state.SkipWithError(error.message);
+    return;
+  }
+  auto plan = schema_reader.schema_plan();
+  auto batches = ReadFrames(recording.frames);
+  state.SetLabel(adbc::cube::MockResultShapeName(shape));
+  for (auto _ : state) {
+    for (const auto &batch : batches) {
+      adbc::cube::CubeArrowReader reader(batch, options, plan);
+      struct ArrowArray array;
+      if (reader.Init(&error) != NANOARROW_OK ||
+          reader.GetNext(&array) != NANOARROW_OK) {
+        state.SkipWithError("Failed to decode a batch");
+        return;
+      }
+      benchmark::DoNotOptimize(array.children);
+      ArrowArrayRelease(&array);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * recording.frames.size());
+  state.counters["rows/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * recording.rows),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_DecodeBatches)
+    ->ArgsProduct({benchmark::CreateDenseRange(0, 3, 1), {1, 0}})
+    ->Unit(benchmark::kMillisecond);
+
+// An array with nothing to free, so the handoff benchmarks time only the
+// handoff
+struct ArrowArray HandoffArray() {
+  struct ArrowArray array;
+  std::memset(&array, 0, sizeof(array));
+  array.length = 1;
+  array.release = [](struct ArrowArray *array) { array->release = nullptr; };
+  return array;
+}
+
+// Handing batches from a producer thread to the consumer, as decode-ahead
+// does, through the lock-free queue; the argument is batches per iteration
+static void BM_BatchQueueHandoff(benchmark::State &state) {
+  const int64_t batches = state.range(0);
+  for (auto _ : state) {
+    adbc::cube::CubeBatchQueue queue(256, size_t{64} << 20);
+    std::thread producer([&] {
+      for (int64_t i = 0; i < batches; i++) {
+        struct ArrowArray array = HandoffArray();
+        while (!queue.WaitForRoom(std::chrono::milliseconds(100))) {
+        }
+        queue.TryPush(&array, 64);
+      }
+      queue.Close();
+    });
+    struct ArrowArray array;
+    int64_t received = 0;
+    while (queue.Pop(&array)) {
+      received += array.length;
+      ArrowArrayRelease(&array);
+    }
+    producer.join();
+    benchmark::DoNotOptimize(received);
+  }
+  state.SetItemsProcessed(state.iterations() * batches);
+}
+BENCHMARK(BM_BatchQueueHandoff)->Arg(1 << 16)->UseRealTime();
+
+// The same handoff through a deque guarded by a mutex and condition
+// variable, for comparison
+static void BM_MutexQueueHandoff(benchmark::State &state) {
+  const int64_t batches = state.range(0);
+  for (auto _ : state) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<struct ArrowArray> queue;
+    bool done = false;
+    std::thread producer([&] {
+      for (int64_t i = 0; i < batches; i++) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return queue.size() < 256; });
+        queue.push_back(HandoffArray());
+        cv.notify_all();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      cv.notify_all();
+    });
+    int64_t received = 0;
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return !queue.empty() || done; });
+      if (queue.empty()) {
+        break;
+      }
+      struct ArrowArray array = queue.front();
+      queue.pop_front();
+      cv.notify_all();
+      lock.unlock();
+      received += array.length;
+      ArrowArrayRelease(&array);
+    }
+    producer.join();
+    benchmark::DoNotOptimize(received);
+  }
+  state.SetItemsProcessed(state.iterations() * batches);
+}
+BENCHMARK(BM_MutexQueueHandoff)->Arg(1 << 16)->UseRealTime();
+
+// Opening an authenticated session to a loopback mock server: TCP
+// connect, handshake and authentication round trips
+static void BM_MockConnect(benchmark::State &state) {
+  const auto &server = MockServer(adbc::cube::MockResultShape::NumericWide,
+                                  16, 1, std::chrono::microseconds(0));
+  for (auto _ : state) {
+    if (!OpenSession(server, state)) {
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MockConnect)->UseRealTime();
+
+// Queries per second for a 16-row result, one session per thread; the
+// argument is the server's time per query in microseconds
+static void BM_MockQuery(benchmark::State &state) {
+  const auto &server =
+      MockServer(adbc::cube::MockResultShape::NumericWide, 16, 1,
+                 std::chrono::microseconds(state.range(0)));
+  auto client = OpenSession(server, state);
+  if (!client) {
+    return;
+  }
+  for (auto _ : state) {
+    if (RunQuery(client.get()) != server.rows()) {
+      state.SkipWithError("Query failed");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MockQuery)
+    ->Arg(0)
+    ->Arg(1000)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Streaming and decoding a large result over loopback
+static void BM_MockStream(benchmark::State &state) {
+  auto shape = static_cast<adbc::cube::MockResultShape>(state.range(0));
+  const auto &server =
+      MockServer(shape, 65536, 8, std::chrono::microseconds(0));
+  auto client = OpenSession(server, state);
+  if (!client) {
+    return;
+  }
+  state.SetLabel(adbc::cube::MockResultShapeName(shape));
+  for (auto _ : state) {
+    if (RunQuery(client.get()) != server.rows()) {
+      state.SkipWithError("Query failed");
+      return;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * server.response_bytes());
+  state.counters["rows/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * server.rows()),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_MockStream)
+    ->DenseRange(0, 3)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,86 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Replay a capture recorded with adbc.cube.capture_dir through the client:
+//
+//   cube-replay <capture file> [repeat]
+//
+// Prints what one pass went through and how fast the client read it.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "driver/cube/capture.h"
+#include "driver/cube/replay.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::fprintf(stderr, "usage: %s <capture file> [repeat]\n", argv[0]);
+    return 2;
+  }
+  int repeat = argc == 3 ? std::atoi(argv[2]) : 1;
+  if (repeat < 1) {
+    std::fprintf(stderr, "repeat must be at least 1\n");
+    return 2;
+  }
+
+  std::vector<adbc::cube::CubeCapturedFrame> frames;
+  int code = adbc::cube::ReadCaptureFile(argv[1], &frames);
+  if (code != 0) {
+    std::fprintf(stderr, "cannot read %s: %s\n", argv[1],
+                 code == EINVAL ? "not a capture file" : std::strerror(code));
+    return 1;
+  }
+
+  adbc::cube::CubeReaderOptions options;
+  adbc::cube::CubeReplayResult total;
+  for (int i = 0; i < repeat; i++) {
+    adbc::cube::CubeReplayResult result;
+    AdbcError error = ADBC_ERROR_INIT;
+    if (adbc::cube::ReplayCapture(frames, options, &result, &error) !=
+        ADBC_STATUS_OK) {
+      std::fprintf(stderr, "replay failed: %s\n",
+                   error.message ? error.message : "unknown error");
+      if (error.release) {
+        error.release(&error);
+      }
+      return 1;
+    }
+    total.rows += result.rows;
+    total.bytes += result.bytes;
+    total.elapsed += result.elapsed;
+    if (i == 0) {
+      total.queries = result.queries;
+      total.errors = result.errors;
+      total.batches = result.batches;
+    }
+  }
+
+  double seconds = total.elapsed.count() / 1e9;
+  std::printf("queries %lld (errors %lld), batches %lld, rows %lld\n",
+              static_cast<long long>(total.queries),
+              static_cast<long long>(total.errors),
+              static_cast<long long>(total.batches),
+              static_cast<long long>(total.rows / repeat));
+  std::printf("%d pass(es) in %.3f s: %.0f rows/s, %.3f GB/s\n", repeat,
+              seconds, seconds > 0 ? total.rows / seconds : 0.0,
+              seconds > 0 ? total.bytes / seconds / 1e9 : 0.0);
+  return 0;
+}
@@ -0,0 +1,375 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Run 1, 2, 4, ... threads issuing queries through one AdbcDatabase
+// against a loopback mock server, and report how throughput scales and
+// how long the threads waited on the driver's shared locks:
+//
+//   cube-scaling-benchmark [--max-threads N] [--seconds S] [--rows R]
+//                          [--decode-threads T] [--result-cache BYTES]
+//                          [--reconnect] [--min-efficiency E]
+//                          [--json FILE]
+//
+// Efficiency at n threads is QPS(n) / (n * QPS(1)). With --min-efficiency
+// the exit status is 1 when it falls below E at any thread count up to the
+// number of cores, so a CI job can catch scaling that flattens.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arrow-adbc/adbc.h>
+
+#include "driver/cube/metrics.h"
+#include "driver/cube/mock_server.h"
+
+namespace {
+
+struct Options {
+  int max_threads = 0;
+  double seconds = 2;
+  int64_t rows = 4096;
+  int decode_threads = 0;
+  int64_t result_cache_bytes = 0;
+  bool reconnect = false;
+  double min_efficiency = 0;
+  const char *json = nullptr;
+};
+
+const char *const kLocks[] = {"pool", "result_cache", "schema_cache",
+                              "decode"};
+
+adbc::cube::CubeLockWaits &LockWaits(int lock) {
+  auto &metrics = adbc::cube::CubeMetrics::Global();
+  switch (lock) {
+  case 0:
+    return metrics.pool_lock;
+  case 1:
+    return metrics.result_cache_lock;
+  case 2:
+    return metrics.schema_cache_lock;
+  default:
+    return metrics.decode_lock;
+  }
+}
+
+struct Level {
+  int threads = 0;
+  int64_t queries = 0;
+  int64_t errors = 0;
+  double seconds = 0;
+  double qps = 0;
+  double efficiency = 0;
+  int64_t waits[4] = {};
+  int64_t wait_nanos[4] = {};
+};
+
+bool Check(AdbcStatusCode code, AdbcError *error, const char *what) {
+  if (code == ADBC_STATUS_OK) {
+    return true;
+  }
+  std::fprintf(stderr, "%s failed: %s\n", what,
+               error->message ? error->message : "unknown error");
+  if (error->release) {
+    error->release(error);
+  }
+  return false;
+}
+
+// Read stream to the end; false if it failed
+bool Drain(struct ArrowArrayStream *stream) {
+  bool ok = true;
+  while (true) {
+    struct ArrowArray array;
+    if (stream->get_next(stream, &array) != 0) {
+      ok = false;
+      break;
+    }
+    if (!array.release) {
+      break;
+    }
+    array.release(&array);
+  }
+  stream->release(stream);
+  return ok;
+}
+
+// One thread's queries until stop is set
+void Worker(AdbcDatabase *database, const Options &options,
+            const std::atomic<bool> &stop, int64_t *queries,
+            int64_t *errors) {
+  AdbcError error = ADBC_ERROR_INIT;
+  AdbcConnection connection = {};
+  AdbcStatement statement = {};
+  bool open = false;
+  auto close = [&]() {
+    if (open) {
+      AdbcStatementRelease(&statement, &error);
+      AdbcConnectionRelease(&connection, &error);
+      open = false;
+    }
+  };
+  std::string threads = std::to_string(options.decode_threads);
+  while (!stop.load(std::memory_order_relaxed)) {
+    if (!open) {
+      std::memset(&connection, 0, sizeof(connection));
+      std::memset(&statement, 0, sizeof(statement));
+      if (!Check(AdbcConnectionNew(&connection, &error), &error,
+                 "AdbcConnectionNew") ||
+          !Check(AdbcConnectionInit(&connection, database, &error), &error,
+                 "AdbcConnectionInit") ||
+          !Check(AdbcStatementNew(&connection, &statement, &error), &error,
+                 "AdbcStatementNew") ||
+          !Check(AdbcStatementSetSqlQuery(&statement, "SELECT 1", &error),
+                 &error, "AdbcStatementSetSqlQuery") ||
+          (options.decode_threads > 0 &&
+           !Check(AdbcStatementSetOption(&statement, "adbc.cube.decode_threads",
+                                         threads.c_str(), &error),
+                  &error, "AdbcStatementSetOption"))) {
+        (*errors)++;
+        return;
+      }
+      open = true;
+    }
+    struct ArrowArrayStream stream;
+    if (AdbcStatementExecuteQuery(&statement, &stream, nullptr, &error) !=
+            ADBC_STATUS_OK ||
+        !Drain(&stream)) {
+      if (error.release) {
+        error.release(&error);
+      }
+      (*errors)++;
+      close();
+      continue;
+    }
+    (*queries)++;
+    if (options.reconnect) {
+      close();
+    }
+  }
+  close();
+}
+
+Level RunLevel(AdbcDatabase *database, const Options &options, int threads) {
+  Level level;
+  level.threads = threads;
+  for (int i = 0; i < 4; i++) {
+    level.waits[i] = LockWaits(i).waits.load();
+    level.wait_nanos[i] = LockWaits(i).wait_nanos.load();
+  }
+  std::vector<int64_t> queries(threads), errors(threads);
+  std::vector<std::thread> workers;
+  std::atomic<bool> stop{false};
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(Worker, database, std::cref(options), std::cref(stop),
+                         &queries[i], &errors[i]);
+  }
+  std::this_thread::sleep_for(
+      std::chrono::duration<double>(options.seconds));
+  stop = true;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  level.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  for (int i = 0; i < threads; i++) {
+    level.queries += queries[i];
+    level.errors += errors[i];
+  }
+  level.qps = level.queries / level.seconds;
+  for (int i = 0; i < 4; i++) {
+    level.waits[i] = LockWaits(i).waits.load() - level.waits[i];
+    level.wait_nanos[i] = LockWaits(i).wait_nanos.load() - level.wait_nanos[i];
+  }
+  return level;
+}
+
+void WriteJson(FILE *out, const Options &options,
+               const std::vector<Level> &levels, bool passed) {
+  std::fprintf(out, "{\"rows\":%lld,\"seconds\":%g,\"min_efficiency\":%g,"
+                    "\"passed\":%s,\"levels\":[",
+               static_cast<long long>(options.rows), options.seconds,
+               options.min_efficiency, passed ? "true" : "false");
+  for (size_t i = 0; i < levels.size(); i++) {
+    const Level &level = levels[i];
+    std::fprintf(out,
+                 "%s{\"threads\":%d,\"queries\":%lld,\"errors\":%lld,"
+                 "\"qps\":%.1f,\"efficiency\":%.3f,\"locks\":{",
+                 i ? "," : "", level.threads,
+                 static_cast<long long>(level.queries),
+                 static_cast<long long>(level.errors), level.qps,
+                 level.efficiency);
+    for (int lock = 0; lock < 4; lock++) {
+      std::fprintf(out, "%s\"%s\":{\"waits\":%lld,\"wait_seconds\":%.6f}",
+                   lock ? "," : "", kLocks[lock],
+                   static_cast<long long>(level.waits[lock]),
+                   level.wait_nanos[lock] / 1e9);
+    }
+    std::fprintf(out, "}}");
+  }
+  std::fprintf(out, "]}\n");
+}
+
+int Usage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--max-threads N] [--seconds S] [--rows R]\n"
+               "          [--decode-threads T] [--result-cache BYTES]\n"
+               "          [--reconnect] [--min-efficiency E] [--json FILE]\n",
+               argv0);
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--reconnect") {
+      options.reconnect = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return Usage(argv[0]);
+    }
+    const char *value = argv[++i];
+    if (arg == "--max-threads") {
+      options.max_threads = std::atoi(value);
+    } else if (arg == "--seconds") {
+      options.seconds = std::atof(value);
+    } else if (arg == "--rows") {
+      options.rows = std::atoll(value);
+    } else if (arg == "--decode-threads") {
+      options.decode_threads = std::atoi(value);
+    } else if (arg == "--result-cache") {
+      options.result_cache_bytes = std::atoll(value);
+    } else if (arg == "--min-efficiency") {
+      options.min_efficiency = std::atof(value);
+    } else if (arg == "--json") {
+      options.json = value;
+    } else {
+      return Usage(argv[0]);
+    }
+  }
+  int cores =
+      static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  if (options.max_threads <= 0) {
+    options.max_threads = cores;
+  }
+  if (options.seconds <= 0 || options.rows < 1 || options.decode_threads < 0 ||
+      options.result_cache_bytes < 0) {
+    return Usage(argv[0]);
+  }
+
+  adbc::cube::MockServerOptions server_options;
+  server_options.result.shape = adbc::cube::MockResultShape::NumericWide;
+  server_options.result.batches = 4;
+  server_options.result.rows_per_batch =
+      std::max<int64_t>(1, options.rows / server_options.result.batches);
+  adbc::cube::CubeMockServer server(server_options);
+  if (server.Start() != 0) {
+    std::fprintf(stderr, "cannot start the mock server\n");
+    return 1;
+  }
+
+  AdbcError error = ADBC_ERROR_INIT;
+  AdbcDatabase database = {};
+  std::string port = std::to_string(server.port());
+  std::string cache_bytes = std::to_string(options.result_cache_bytes);
+  if (!Check(AdbcDatabaseNew(&database, &error), &error, "AdbcDatabaseNew") ||
+      !Check(AdbcDatabaseSetOption(&database, "adbc.cube.host", "127.0.0.1",
+                                   &error),
+             &error, "adbc.cube.host") ||
+      !Check(AdbcDatabaseSetOption(&database, "adbc.cube.port", port.c_str(),
+                                   &error),
+             &error, "adbc.cube.port") ||
+      !Check(AdbcDatabaseSetOption(&database, "adbc.cube.token", "mock",
+                                   &error),
+             &error, "adbc.cube.token") ||
+      !Check(AdbcDatabaseSetOption(&database, "adbc.cube.connection_mode",
+                                   "native", &error),
+             &error, "adbc.cube.connection_mode") ||
+      (options.result_cache_bytes > 0 &&
+       !Check(AdbcDatabaseSetOption(&database,
+                                    "adbc.cube.result_cache.max_bytes",
+                                    cache_bytes.c_str(), &error),
+              &error, "adbc.cube.result_cache.max_bytes")) ||
+      !Check(AdbcDatabaseInit(&database, &error), &error, "AdbcDatabaseInit")) {
+    return 1;
+  }
+
+  std::vector<Level> levels;
+  for (int threads = 1;; threads *= 2) {
+    threads = std::min(threads, options.max_threads);
+    Level level = RunLevel(&database, options, threads);
+    if (level.queries == 0) {
+      std::fprintf(stderr, "no query succeeded at %d threads\n", threads);
+      AdbcDatabaseRelease(&database, &error);
+      return 1;
+    }
+    double base = levels.empty() ? level.qps : levels.front().qps;
+    level.efficiency = level.qps / (threads * base);
+    levels.push_back(level);
+    if (threads == options.max_threads) {
+      break;
+    }
+  }
+  AdbcDatabaseRelease(&database, &error);
+
+  bool passed = true;
+  std::printf("%7s %10s %10s %7s", "threads", "queries", "qps", "eff");
+  for (const char *lock : kLocks) {
+    std::printf(" %14s", lock);
+  }
+  std::printf("\n");
+  for (const Level &level : levels) {
+    bool flat = options.min_efficiency > 0 && level.threads <= cores &&
+                level.efficiency < options.min_efficiency;
+    passed = passed && !flat;
+    std::printf("%7d %10lld %10.1f %6.0f%%", level.threads,
+                static_cast<long long>(level.queries), level.qps,
+                level.efficiency * 100);
+    for (int lock = 0; lock < 4; lock++) {
+      // Milliseconds all threads spent blocked on the lock
+      std::printf(" %11.2fms", level.wait_nanos[lock] / 1e6);
+    }
+    std::printf("%s\n", flat ? "  <- below --min-efficiency" : "");
+  }
+
+  if (options.json) {
+    FILE *out = std::strcmp(options.json, "-") == 0
+                    ? stdout
+                    : std::fopen(options.json, "w");
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", options.json);
+      return 1;
+    }
+    WriteJson(out, options, levels, passed);
+    if (out != stdout) {
+      std::fclose(out);
+    }
+  }
+  return passed ? 0 : 1;
+}
@@ -15,15 +15,21 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #include <gtest/gtest.h>
 
 #include <arrow-adbc/adbc.h>
 #include <arrow-adbc/driver/common.h>
 
+#include "driver/cube/buffer_pool.h"
+#include "driver/cube/token_source.h"
+#include "driver/cube/tracing.h"
 #include "validation/adbc_validation.h"
 
 namespace adbc::cube {
@@ -74,6 +80,680 @@ TEST_F(CubeQuickstartTest, CanSetOptions) {
       << error_.message;
 }
 
+TEST_F(CubeQuickstartTest, ZeroCopyOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.zero_copy", "false",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.zero_copy", "maybe",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, MaxMessageBytesOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.max_message_bytes",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.max_message_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.max_message_bytes",
+                                  "lots", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PipeliningOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pipelining", "true",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+}
+
+TEST_F(CubeQuickstartTest, ThreadSafeOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.thread_safe", "true",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.thread_safe", "maybe",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, CursorFetchBytesOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.cursor_fetch_bytes",
+                                  "8388608", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.cursor_fetch_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, CreditOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.credit_batches", "8",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.credit_bytes",
+                                  "16777216", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.credit_batches",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PrefetchBytesOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.prefetch_bytes",
+                                  "67108864", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.prefetch_bytes", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, CompressionOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.compression", "none",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.compression", "gzip",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, FlatBufferVerificationOption) {
+  for (const char *mode : {"full", "bounds", "none", "trusted"}) {
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                    "adbc.cube.flatbuffer_verification", mode,
+                                    &error_),
+              ADBC_STATUS_OK)
+        << error_.message;
+  }
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.flatbuffer_verification",
+                                  "partial", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, SchemaCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.schema_cache_entries",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.schema_cache_entries",
+                                  "128", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.schema_cache_entries",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PreparedCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prepared_cache_entries", "16",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prepared_cache_entries", "0",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prepared_cache_entries", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PostgresOutputFormatOption) {
+  for (const char *format : {"auto", "arrow_ipc", "binary"}) {
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                    "adbc.cube.postgres_output_format", format,
+                                    &error_),
+              ADBC_STATUS_OK)
+        << error_.message;
+  }
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.postgres_output_format", "text",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, TableSchemaCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.table_schema_cache_ttl_ms", "0",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.table_schema_cache_ttl_ms",
+                                  "300000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.table_schema_cache_ttl_ms", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, MetadataCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.metadata_cache_ttl_ms",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.metadata_cache_ttl_ms",
+                                  "300000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.metadata_cache_ttl_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, ResultCacheOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.result_cache.max_bytes",
+                                  "67108864", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.result_cache.ttl_ms",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.result_cache.max_bytes", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.result_cache.ttl_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, RollupCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.rollup_cache.max_bytes",
+                                  "67108864", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.rollup_cache.max_bytes", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PrefetchQueryOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prefetch_queries.budget_bytes",
+                                  "16777216", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prefetch_queries.max_queued", "4",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prefetch_queries.drill_down",
+                                  "true", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prefetch_queries.budget_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.prefetch_queries.max_queued",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, DeltaCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.delta_cache.max_bytes",
+                                  "67108864", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.delta_cache.max_bytes", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, DecodePoolOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.decode_pool.threads",
+                                  "4", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.decode_pool.cpus",
+                                  "0-3,8", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.decode_pool.threads",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.decode_pool.cpus",
+                                  "3-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, MemoryLimitOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.memory_limit_bytes",
+                                  "1073741824", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.memory_limit_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.memory_bytes", "0",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, AdmissionOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.admission.max_queries",
+                                  "8", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.admission.min_queries",
+                                  "2", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.admission.queue_timeout_ms",
+                                  "5000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.admission.target_latency_ms",
+                                  "250", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.admission.max_queries",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.admission.running",
+                                  "0", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, ShareInflightOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.share_inflight",
+                                  "true", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.share_inflight",
+                                  "sometimes", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, TransportOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.transport", "socket",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  AdbcStatusCode io_uring = AdbcDatabaseSetOption(
+      &database_, "adbc.cube.transport", "io_uring", &error_);
+  ASSERT_TRUE(io_uring == ADBC_STATUS_OK ||
+              io_uring == ADBC_STATUS_NOT_IMPLEMENTED);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.transport", "ssh",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, SharedMemoryOption) {
+  AdbcStatusCode shared = AdbcDatabaseSetOption(
+      &database_, "adbc.cube.shared_memory_bytes", "67108864", &error_);
+  ASSERT_TRUE(shared == ADBC_STATUS_OK ||
+              shared == ADBC_STATUS_NOT_IMPLEMENTED);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.shared_memory_bytes",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.shared_memory_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, ReconnectOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.reconnect", "false",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.reconnect", "maybe",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, TracerOption) {
+  AdbcCubeTracer tracer{};
+  tracer.start_span = [](void *, const char *, void *) -> void * {
+    return nullptr;
+  };
+  std::string address = std::to_string(reinterpret_cast<intptr_t>(&tracer));
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tracer",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  tracer.end_span = [](void *, void *, int) {};
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tracer",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(
+      AdbcDatabaseSetOption(&database_, "adbc.cube.tracer", "0", &error_),
+      ADBC_STATUS_OK)
+      << error_.message;
+}
+
+TEST_F(CubeQuickstartTest, TokenProviderOptions) {
+  AdbcCubeTokenProvider provider{};
+  std::string address = std::to_string(reinterpret_cast<intptr_t>(&provider));
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.token_provider",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  provider.get_token = [](void *, char *buffer, size_t size,
+                          int64_t *) -> size_t {
+    std::string_view token = "token";
+    if (size >= token.size()) {
+      std::memcpy(buffer, token.data(), token.size());
+    }
+    return token.size();
+  };
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.token_provider",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.token_renew_ahead_ms", "30000",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.token_renew_ahead_ms", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.token_renewals", "1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.token_provider", "0",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+}
+
+TEST_F(CubeQuickstartTest, AllocatorOption) {
+  AdbcCubeAllocator allocator{};
+  allocator.allocate = [](void *, size_t size, size_t alignment) -> void * {
+    return std::aligned_alloc(alignment, (size + alignment - 1) /
+                                             alignment * alignment);
+  };
+  std::string address = std::to_string(reinterpret_cast<intptr_t>(&allocator));
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.allocator",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  allocator.free = [](void *, void *ptr, size_t) { std::free(ptr); };
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.allocator",
+                                  address.c_str(), &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(
+      AdbcDatabaseSetOption(&database_, "adbc.cube.allocator", "0", &error_),
+      ADBC_STATUS_OK)
+      << error_.message;
+}
+
+TEST_F(CubeQuickstartTest, TlsOptions) {
+  AdbcStatusCode tls =
+      AdbcDatabaseSetOption(&database_, "adbc.cube.tls", "true", &error_);
+  ASSERT_TRUE(tls == ADBC_STATUS_OK || tls == ADBC_STATUS_NOT_IMPLEMENTED);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tls_verify", "false",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tls_server_name",
+                                  "cube.example.com", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tls_verify", "maybe",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, TimeoutOptions) {
+  for (const char *key : {"adbc.cube.connect_timeout_ms",
+                          "adbc.cube.read_timeout_ms",
+                          "adbc.cube.query_timeout_ms"}) {
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_, key, "5000", &error_),
+              ADBC_STATUS_OK)
+        << key << ": " << error_.message;
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_, key, "-1", &error_),
+              ADBC_STATUS_INVALID_ARGUMENT)
+        << key;
+  }
+}
+
+TEST_F(CubeQuickstartTest, SocketOptions) {
+  for (const char *key :
+       {"adbc.cube.socket_recv_buffer_bytes",
+        "adbc.cube.socket_send_buffer_bytes", "adbc.cube.tcp_keepalive_idle_s",
+        "adbc.cube.tcp_keepalive_interval_s", "adbc.cube.tcp_keepalive_count",
+        "adbc.cube.busy_poll_us"}) {
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_, key, "4", &error_),
+              ADBC_STATUS_OK)
+        << key << ": " << error_.message;
+    ASSERT_EQ(AdbcDatabaseSetOption(&database_, key, "-1", &error_),
+              ADBC_STATUS_INVALID_ARGUMENT)
+        << key;
+  }
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.tcp_nodelay",
+                                  "false", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+}
+
+TEST_F(CubeQuickstartTest, HostsOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts",
+                                  "cube-a:4444, cube-b, [::1]:4445", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.eject_ms",
+                                  "5000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts",
+                                  "cube-a:port", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts", " , ",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.eject_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, HostsRoutingOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.routing",
+                                  "affinity", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.max_load",
+                                  "1.5", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.routing",
+                                  "random", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.hosts.max_load",
+                                  "0.5", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, WatchChangesOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.watch_changes",
+                                  "true", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.watch_changes",
+                                  "sometimes", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.change_notifications", "1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, SharedResultCacheOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.shared_result_cache.max_bytes",
+                                  "1048576", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.shared_result_cache.max_bytes",
+                                  "0", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.shared_result_cache.entries",
+                                  "0", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.shared_result_cache.name",
+                                  "a/b", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, DiskCacheOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.disk_cache.max_bytes",
+                                  "1048576", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.disk_cache.max_bytes",
+                                  "0", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.disk_cache.ttl_ms",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.disk_cache.ttl_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, DnsCacheOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.dns_cache_ttl_ms",
+                                  "5000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.dns_cache_ttl_ms",
+                                  "0", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.dns_cache_ttl_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, BufferPoolOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.buffer_pool_bytes",
+                                  "268435456", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.buffer_pool_bytes",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, PoolOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_size", "4",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_idle_timeout_ms",
+                                  "30000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_health_check",
+                                  "false", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_ping_timeout_ms",
+                                  "500", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_keepalive_ms",
+                                  "10000", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_size", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_keepalive_ms",
+                                  "-1", &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, WarmStartOptions) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_min_idle", "2",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.prefetch_meta",
+                                  "true", &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_,
+                                  "adbc.cube.warm_start_background", "true",
+                                  &error_),
+            ADBC_STATUS_OK)
+      << error_.message;
+
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.pool_min_idle", "-1",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, MetricsOptionIsReadOnly) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.metrics", "",
+                                  &error_),
+            ADBC_STATUS_INVALID_ARGUMENT);
+}
+
+TEST_F(CubeQuickstartTest, CaptureDirOption) {
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.capture_dir",
+                                  "/tmp", &error_),
+            ADBC_STATUS_OK);
+  ASSERT_EQ(AdbcDatabaseSetOption(&database_, "adbc.cube.capture_dir", "",
+                                  &error_),
+            ADBC_STATUS_OK);
+}
+
 TEST_F(CubeQuickstartTest, InvalidOption) {
   // Test handling of unknown options
   ASSERT_EQ(
@@ -15,126 +15,187 @@
 // specific language governing permissions and limitations
 // under the License.
 
-#include <algorithm>
-#include <cctype>
+#include <cstddef>
 
 #include "driver/cube/cube_types.h"
 
 namespace adbc::cube {
 
-// Helper to normalize SQL type names (lowercase, trim whitespace)
-static std::string NormalizeTypeName(const std::string &type_name) {
-  std::string normalized = type_name;
-  // Trim leading/trailing whitespace
-  size_t start = 0;
-  size_t end = normalized.length();
-  while (start < end && std::isspace(normalized[start]))
-    start++;
-  while (end > start && std::isspace(normalized[end - 1]))
-    end--;
-  normalized = normalized.substr(start, end - start);
-  // Convert to lowercase
-  std::transform(normalized.begin(), normalized.end(), normalized.begin(),
-                 [](unsigned char c) { return std::tolower(c); });
-  return normalized;
+namespace {
+
+struct TypeName {
+  std::string_view name; // Lowercase, words separated by one space
+  ArrowType type;
+  bool with_time_zone;
+};
+
+// Decimal, JSON and UUID values are returned as strings; unknown names
+// fall back to BINARY so queries can continue
+constexpr TypeName kTypeNames[] = {
+    {"bigint", NANOARROW_TYPE_INT64, false},
+    {"int8", NANOARROW_TYPE_INT64, false},
+    {"integer", NANOARROW_TYPE_INT32, false},
+    {"int", NANOARROW_TYPE_INT32, false},
+    {"int4", NANOARROW_TYPE_INT32, false},
+    {"smallint", NANOARROW_TYPE_INT16, false},
+    {"int2", NANOARROW_TYPE_INT16, false},
+    {"tinyint", NANOARROW_TYPE_INT8, false},
+    {"int1", NANOARROW_TYPE_INT8, false},
+    {"ubigint", NANOARROW_TYPE_UINT64, false},
+    {"uint8", NANOARROW_TYPE_UINT64, false},
+    {"uinteger", NANOARROW_TYPE_UINT32, false},
+    {"uint", NANOARROW_TYPE_UINT32, false},
+    {"uint4", NANOARROW_TYPE_UINT32, false},
+    {"usmallint", NANOARROW_TYPE_UINT16, false},
+    {"uint2", NANOARROW_TYPE_UINT16, false},
+    {"utinyint", NANOARROW_TYPE_UINT8, false},
+    {"uint1", NANOARROW_TYPE_UINT8, false},
+    {"double", NANOARROW_TYPE_DOUBLE, false},
+    {"double precision", NANOARROW_TYPE_DOUBLE, false},
+    {"float8", NANOARROW_TYPE_DOUBLE, false},
+    {"real", NANOARROW_TYPE_FLOAT, false},
+    {"float", NANOARROW_TYPE_FLOAT, false},
+    {"float4", NANOARROW_TYPE_FLOAT, false},
+    {"boolean", NANOARROW_TYPE_BOOL, false},
+    {"bool", NANOARROW_TYPE_BOOL, false},
+    {"varchar", NANOARROW_TYPE_STRING, false},
+    {"character varying", NANOARROW_TYPE_STRING, false},
+    {"character", NANOARROW_TYPE_STRING, false},
+    {"text", NANOARROW_TYPE_STRING, false},
+    {"char", NANOARROW_TYPE_STRING, false},
+    {"string", NANOARROW_TYPE_STRING, false},
+    {"bytea", NANOARROW_TYPE_BINARY, false},
+    {"binary", NANOARROW_TYPE_BINARY, false},
+    {"varbinary", NANOARROW_TYPE_BINARY, false},
+    {"date", NANOARROW_TYPE_DATE32, false},
+    {"time", NANOARROW_TYPE_TIME64, false},
+    {"time without time zone", NANOARROW_TYPE_TIME64, false},
+    {"time with time zone", NANOARROW_TYPE_TIME64, true},
+    {"timetz", NANOARROW_TYPE_TIME64, true},
+    {"timestamp", NANOARROW_TYPE_TIMESTAMP, false},
+    {"timestamp without time zone", NANOARROW_TYPE_TIMESTAMP, false},
+    {"timestamp with time zone", NANOARROW_TYPE_TIMESTAMP, true},
+    {"timestamptz", NANOARROW_TYPE_TIMESTAMP, true},
+    {"numeric", NANOARROW_TYPE_STRING, false},
+    {"decimal", NANOARROW_TYPE_STRING, false},
+    {"number", NANOARROW_TYPE_STRING, false},
+    {"json", NANOARROW_TYPE_STRING, false},
+    {"jsonb", NANOARROW_TYPE_STRING, false},
+    {"uuid", NANOARROW_TYPE_STRING, false},
+};
+
+constexpr size_t kNumTypeNames = sizeof(kTypeNames) / sizeof(kTypeNames[0]);
+constexpr size_t kMaxTypeNameLength = 32;
+constexpr size_t kTypeSlots = 512; // Power of two, ~10x the names
+
+constexpr uint32_t HashTypeName(std::string_view name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed; // FNV-1a
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
 }
 
-ArrowType CubeTypeMapper::MapCubeTypeToArrowType(const std::string &cube_type) {
-  std::string normalized = NormalizeTypeName(cube_type);
-
-  // Integer types
-  if (normalized == "bigint" || normalized == "int8") {
-    return NANOARROW_TYPE_INT64;
-  }
-  if (normalized == "integer" || normalized == "int" || normalized == "int4") {
-    return NANOARROW_TYPE_INT32;
-  }
-  if (normalized == "smallint" || normalized == "int2") {
-    return NANOARROW_TYPE_INT16;
-  }
-  if (normalized == "tinyint" || normalized == "int1") {
-    return NANOARROW_TYPE_INT8;
-  }
-
-  // Unsigned integer types
-  if (normalized == "ubigint" || normalized == "uint8") {
-    return NANOARROW_TYPE_UINT64;
-  }
-  if (normalized == "uinteger" || normalized == "uint" ||
-      normalized == "uint4") {
-    return NANOARROW_TYPE_UINT32;
-  }
-  if (normalized == "usmallint" || normalized == "uint2") {
-    return NANOARROW_TYPE_UINT16;
-  }
-  if (normalized == "utinyint" || normalized == "uint1") {
-    return NANOARROW_TYPE_UINT8;
-  }
-
-  // Floating point types
-  if (normalized == "double" || normalized == "double precision" ||
-      normalized == "float8") {
-    return NANOARROW_TYPE_DOUBLE;
-  }
-  if (normalized == "real" || normalized == "float" || normalized == "float4") {
-    return NANOARROW_TYPE_FLOAT;
-  }
-
-  // Boolean type
-  if (normalized == "boolean" || normalized == "bool") {
-    return NANOARROW_TYPE_BOOL;
-  }
-
-  // String types
-  if (normalized == "varchar" || normalized == "character varying" ||
-      normalized == "text" || normalized == "char" || normalized == "string") {
-    return NANOARROW_TYPE_STRING;
-  }
-
-  // Binary types
-  if (normalized == "bytea" || normalized == "binary" ||
-      normalized == "varbinary") {
-    return NANOARROW_TYPE_BINARY;
-  }
-
-  // Date type
-  if (normalized == "date") {
-    return NANOARROW_TYPE_DATE32;
-  }
-
-  // Time types
-  if (normalized == "time" || normalized == "time without time zone" ||
-      normalized == "time with time zone") {
-    return NANOARROW_TYPE_TIME64;
-  }
+// Slots hold an index into kTypeNames plus one, 0 when empty
+struct TypeTable {
+  uint32_t seed = 0;
+  uint8_t slots[kTypeSlots] = {};
+};
+
+// Try seeds until every name lands in its own slot, so a lookup is one
+// hash and one comparison
+constexpr TypeTable BuildTypeTable() {
+  for (uint32_t seed = 1; seed < 1024; seed++) {
+    TypeTable table;
+    table.seed = seed;
+    bool collision = false;
+    for (size_t i = 0; i < kNumTypeNames && !collision; i++) {
+      size_t slot = HashTypeName(kTypeNames[i].name, seed) & (kTypeSlots - 1);
+      collision = table.slots[slot] != 0;
+      table.slots[slot] = static_cast<uint8_t>(i + 1);
+    }
+    if (!collision) {
+      return table;
+    }
+  }
+  return TypeTable{};
+}
 
-  // Timestamp types
-  if (normalized == "timestamp" ||
-      normalized == "timestamp without time zone" ||
-      normalized == "timestamp with time zone" || normalized == "timestamptz") {
-    return NANOARROW_TYPE_TIMESTAMP;
-  }
+constexpr TypeTable kTypeTable = BuildTypeTable();
+static_assert(kTypeTable.seed != 0, "no perfect hash seed for kTypeNames");
 
-  // Decimal/numeric types - map to string for safety
-  // (would need decimal128 support for proper handling)
-  if (normalized == "numeric" || normalized == "decimal" ||
-      normalized == "number") {
-    return NANOARROW_TYPE_STRING;
-  }
+constexpr bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
 
-  // JSON types - map to string
-  if (normalized == "json" || normalized == "jsonb") {
-    return NANOARROW_TYPE_STRING;
-  }
+constexpr char ToLower(char c) {
+  return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
 
-  // UUID type - map to string
-  if (normalized == "uuid") {
-    return NANOARROW_TYPE_STRING;
+const TypeName *FindTypeName(std::string_view name) {
+  size_t slot = HashTypeName(name, kTypeTable.seed) & (kTypeSlots - 1);
+  uint8_t index = kTypeTable.slots[slot];
+  if (index == 0 || kTypeNames[index - 1].name != name) {
+    return nullptr;
   }
+  return &kTypeNames[index - 1];
+}
 
-  // Unknown types - permissive fallback to BINARY
-  // This allows queries to continue even with unknown Cube SQL types
-  return NANOARROW_TYPE_BINARY;
+} // namespace
+
+CubeTypeInfo CubeTypeMapper::ParseCubeType(std::string_view cube_type) {
+  CubeTypeInfo info;
+  // The base name, lowercased with whitespace runs collapsed, is gathered
+  // here while the modifiers in parentheses are parsed as numbers
+  char name[kMaxTypeNameLength];
+  size_t length = 0;
+  int modifiers = 0;
+  bool space = false;
+  for (size_t i = 0; i < cube_type.size(); i++) {
+    char c = cube_type[i];
+    if (IsSpace(c)) {
+      space = length > 0;
+      continue;
+    }
+    if (c == '(') {
+      for (i++; i < cube_type.size() && cube_type[i] != ')'; i++) {
+        char m = cube_type[i];
+        if (m == ',') {
+          modifiers++;
+        } else if (m >= '0' && m <= '9' && modifiers < 2) {
+          int32_t &value = modifiers == 0 ? info.precision : info.scale;
+          if (value > 99999999) {
+            return CubeTypeInfo{};
+          }
+          value = (value < 0 ? 0 : value * 10) + (m - '0');
+        } else if (!IsSpace(m)) {
+          return CubeTypeInfo{};
+        }
+      }
+      if (i == cube_type.size()) {
+        return CubeTypeInfo{}; // Unterminated
+      }
+      space = length > 0;
+      continue;
+    }
+    if (length + (space ? 2 : 1) > kMaxTypeNameLength) {
+      return CubeTypeInfo{};
+    }
+    if (space) {
+      name[length++] = ' ';
+      space = false;
+    }
+    name[length++] = ToLower(c);
+  }
+
+  const TypeName *entry = FindTypeName(std::string_view(name, length));
+  if (!entry) {
+    return CubeTypeInfo{};
+  }
+  info.type = entry->type;
+  info.with_time_zone = entry->with_time_zone;
+  return info;
 }
 
 std::string CubeTypeMapper::GetArrowTypeDescription(ArrowType type) {
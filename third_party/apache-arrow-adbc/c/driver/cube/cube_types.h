@@ -17,17 +17,36 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 #include <nanoarrow/nanoarrow.h>
 
 namespace adbc::cube {
 
+// A Cube SQL type name taken apart: the Arrow type it maps to and the
+// modifiers written with it, such as varchar(255), numeric(18,4) or
+// timestamp(3) with time zone
+struct CubeTypeInfo {
+  ArrowType type = NANOARROW_TYPE_BINARY;
+  bool with_time_zone = false;
+  // First and second parenthesised modifiers (length or precision, then
+  // scale); -1 when absent
+  int32_t precision = -1;
+  int32_t scale = -1;
+};
+
 // Maps Cube SQL types to Apache Arrow types with permissive fallback to BINARY
 class CubeTypeMapper {
 public:
-  static ArrowType MapCubeTypeToArrowType(const std::string &cube_type);
+  // Parse a type name in one pass, without allocating: case and extra
+  // whitespace are ignored and the base name is found in a perfect hash
+  // table built at compile time
+  static CubeTypeInfo ParseCubeType(std::string_view cube_type);
+  static ArrowType MapCubeTypeToArrowType(std::string_view cube_type) {
+    return ParseCubeType(cube_type).type;
+  }
   static std::string GetArrowTypeDescription(ArrowType type);
 };
 
@@ -18,10 +18,19 @@
 #include <algorithm>
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <utility>
+#include <variant>
+#include <vector>
 
+#include "driver/cube/buffer_pool.h"
 #include "driver/cube/connection.h"
 #include "driver/cube/database.h"
+#include "driver/cube/decode_scheduler.h"
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/log.h"
+#include "driver/cube/metrics.h"
 
 namespace adbc::cube {
 
@@ -47,16 +56,346 @@ Status CubeDatabase::InitImpl() {
     }
   }
 
+  pool_ = std::make_shared<NativeClientPool>(pool_options_);
+  if (token_provider_.get_token) {
+    std::string message;
+    token_source_ = CubeTokenSource::Make(token_provider_, token_renew_ahead_,
+                                          pool_, database_, &message);
+    if (!token_source_) {
+      return Status(ADBC_STATUS_UNAUTHENTICATED,
+                    "Cannot get a token: " + message);
+    }
+    token_ = token_source_->token();
+  }
+  if (!disk_cache_dir_.empty() &&
+      connection_mode() == ConnectionMode::Native) {
+    int code = CubeDiskCache::Open(disk_cache_dir_, disk_cache_max_bytes_,
+                                   disk_cache_ttl_, &disk_cache_);
+    if (code != 0) {
+      return status::fmt::IO("Cannot open disk cache '{}': {}",
+                             disk_cache_dir_, std::strerror(code));
+    }
+  }
+  if (metadata_cache_ttl_.count() > 0) {
+    metadata_cache_ = std::make_shared<CubeMetadataCache>(metadata_cache_ttl_,
+                                                          disk_cache_);
+  }
+  if (result_cache_max_bytes_ > 0) {
+    result_cache_ = std::make_shared<CubeResultCache>(
+        result_cache_max_bytes_, result_cache_ttl_, memory_);
+  }
+  if (!shared_result_cache_name_.empty() &&
+      connection_mode() == ConnectionMode::Native) {
+    int code = CubeSharedResultCache::Open(
+        shared_result_cache_name_, shared_result_cache_max_bytes_,
+        shared_result_cache_entries_, result_cache_ttl_,
+        &shared_result_cache_);
+    if (code != 0) {
+      return status::fmt::IO("Cannot open shared result cache '{}': {}",
+                             shared_result_cache_name_, std::strerror(code));
+    }
+  }
+  if (rollup_cache_max_bytes_ > 0) {
+    rollup_cache_ = std::make_shared<CubeRollupCache>(rollup_cache_max_bytes_,
+                                                      result_cache_ttl_);
+  }
+  if (delta_cache_max_bytes_ > 0) {
+    delta_cache_ = std::make_shared<CubeDeltaCache>(delta_cache_max_bytes_);
+  }
+  if (share_inflight_) {
+    inflight_ = std::make_shared<CubeInflightQueries>();
+  }
+  if (prefetch_options_.budget_bytes > 0 && result_cache_ &&
+      connection_mode() == ConnectionMode::Native) {
+    prefetcher_ = std::make_shared<CubePrefetcher>(prefetch_options_, pool_,
+                                                   result_cache_);
+  }
+  if (admission_options_.max_queries > 0) {
+    admission_ = CubeAdmissionControl::Make(admission_options_);
+  }
+  if (decode_pool_threads_ > 0 || !decode_pool_cpus_.empty()) {
+    std::string message;
+    if (!CubeDecodeScheduler::Global().Configure(decode_pool_threads_,
+                                                 decode_pool_cpus_, &message)) {
+      return status::fmt::InvalidState("Cannot set up the decode pool: {}",
+                                       message);
+    }
+  }
+  auto &placement = CubeMemoryPlacement::Global();
+  if (huge_page_min_bytes_) {
+    placement.huge_page_min_bytes.store(*huge_page_min_bytes_,
+                                        std::memory_order_relaxed);
+  }
+  if (numa_local_) {
+    placement.numa_local.store(*numa_local_, std::memory_order_relaxed);
+  }
+  if (dns_cache_ttl_.count() > 0) {
+    address_cache_ = std::make_shared<CubeAddressCache>(dns_cache_ttl_);
+  }
+  if (!hosts_.empty()) {
+    // Parsed here so that port applies whichever option was set first
+    std::vector<CubeEndpoint> hosts;
+    std::string message;
+    if (!ParseEndpoints(hosts_, port_, &hosts, &message)) {
+      return status::fmt::InvalidArgument("Invalid adbc.cube.hosts: {}",
+                                          message);
+    }
+    endpoints_ = std::make_shared<CubeEndpointSet>(
+        std::move(hosts), eject_time_, hosts_routing_, hosts_max_load_);
+  }
+  UNWRAP_STATUS(MakeTlsContext());
+  if (watch_changes_ && connection_mode() == ConnectionMode::Native) {
+    // Built here so that the watching thread does not read the options
+    change_watcher_ = std::make_shared<CubeChangeWatcher>(
+        std::make_unique<CubeConnectionImpl>(*this), metadata_cache_,
+        result_cache_, rollup_cache_, disk_cache_);
+  }
+  return WarmStart();
+}
+
+Status CubeDatabase::WarmStart() {
+  // The pool only keeps native sessions, and no more than pool_size of them
+  size_t sessions = 0;
+  if (connection_mode() == ConnectionMode::Native) {
+    sessions = std::min(pool_min_idle_, pool_options_.max_idle);
+  }
+  bool load_model = prefetch_meta_ && metadata_cache_;
+  if (sessions == 0 && load_model) {
+    sessions = 1;
+  }
+  if (sessions == 0) {
+    return status::Ok();
+  }
+
+  // Built here so that the background thread does not read the options
+  std::vector<std::unique_ptr<CubeConnectionImpl>> connections;
+  for (size_t i = 0; i < sessions; i++) {
+    connections.push_back(std::make_unique<CubeConnectionImpl>(*this));
+  }
+  auto warm = [connections = std::move(connections),
+               metadata_cache = load_model ? metadata_cache_ : nullptr]() {
+    for (auto &connection : connections) {
+      struct AdbcError error = ADBC_ERROR_INIT;
+      Status status = connection->Connect(&error);
+      if (error.release) {
+        error.release(&error);
+      }
+      UNWRAP_STATUS(status);
+    }
+    if (metadata_cache) {
+      UNWRAP_RESULT(auto model, metadata_cache->Get(connections[0].get()));
+      std::ignore = model;
+    }
+    // Disconnecting hands the sessions to the pool
+    for (auto &connection : connections) {
+      struct AdbcError error = ADBC_ERROR_INIT;
+      std::ignore = connection->Disconnect(&error);
+      if (error.release) {
+        error.release(&error);
+      }
+    }
+    return status::Ok();
+  };
+  if (!warm_start_background_) {
+    return warm();
+  }
+  // A failure leaves the first queries to connect and load as usual
+  warm_thread_ = std::thread([warm = std::move(warm)]() mutable {
+    std::ignore = warm();
+  });
+  warm_fork_generation_ = CubeForkGeneration();
+  return status::Ok();
+}
+
+void CubeDatabase::StopWarmStart() {
+  if (!warm_thread_.joinable()) {
+    return;
+  }
+  if (warm_fork_generation_ != CubeForkGeneration()) {
+    // The thread stayed in the parent
+    warm_thread_.detach();
+  } else {
+    warm_thread_.join();
+  }
+}
+
+Status CubeDatabase::MakeTlsContext() {
+  tls_context_.reset();
+  if (!tls_) {
+    return status::Ok();
+  }
+  std::string error;
+  tls_context_ = CubeTlsContext::Make(tls_options_, &error);
+  if (!tls_context_) {
+    return status::fmt::IO("Cannot set up TLS: {}", error);
+  }
   return status::Ok();
 }
 
-Status CubeDatabase::ReleaseImpl() { return status::Ok(); }
+Status CubeDatabase::ReleaseImpl() {
+  StopWarmStart();
+  // Its thread returns sessions to the pool, and this one switches them
+  prefetcher_.reset();
+  change_watcher_.reset();
+  token_source_.reset();
+  if (pool_) {
+    pool_->Clear();
+    pool_.reset();
+  }
+  metadata_cache_.reset();
+  result_cache_.reset();
+  shared_result_cache_.reset();
+  disk_cache_.reset();
+  rollup_cache_.reset();
+  delta_cache_.reset();
+  inflight_.reset();
+  address_cache_.reset();
+  endpoints_.reset();
+  tls_context_.reset();
+  return status::Ok();
+}
 
 Status CubeDatabase::SetOptionImpl(std::string_view key, driver::Option value) {
+  // Pooled sessions were opened with the old options
+  StopWarmStart();
+  if (pool_) {
+    pool_->Clear();
+  }
+
   if (key == "adbc.cube.host") {
     UNWRAP_RESULT(auto str, value.AsString());
     host_ = str;
     return status::Ok();
+  } else if (key == "adbc.cube.hosts") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    std::vector<CubeEndpoint> hosts;
+    std::string message;
+    if (!str.empty() && !ParseEndpoints(str, port_, &hosts, &message)) {
+      return status::fmt::InvalidArgument("Invalid {}: {}", key, message);
+    }
+    hosts_ = str;
+    return status::Ok();
+  } else if (key == "adbc.cube.hosts.eject_ms") {
+    UNWRAP_RESULT(auto eject_ms, value.AsInt());
+    if (eject_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, eject_ms);
+    }
+    eject_time_ = std::chrono::milliseconds(eject_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.hosts.routing") {
+    UNWRAP_RESULT(auto routing, value.AsString());
+    if (routing == "load") {
+      hosts_routing_ = CubeEndpointRouting::Load;
+    } else if (routing == "affinity") {
+      hosts_routing_ = CubeEndpointRouting::Affinity;
+    } else {
+      return status::fmt::InvalidArgument(
+          "{} must be load or affinity, got '{}'", key, routing);
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.hosts.max_load") {
+    double max_load = 0;
+    if (auto *number = std::get_if<double>(&value.value())) {
+      max_load = *number;
+    } else {
+      UNWRAP_RESULT(auto text, value.AsString());
+      std::string copy(text);
+      char *end = nullptr;
+      max_load = std::strtod(copy.c_str(), &end);
+      if (copy.empty() || *end != '\0') {
+        return status::fmt::InvalidArgument("{} must be a number, got '{}'",
+                                            key, copy);
+      }
+    }
+    if (!(max_load >= 1)) {
+      return status::fmt::InvalidArgument("{} must be at least 1, got {}",
+                                          key, max_load);
+    }
+    hosts_max_load_ = max_load;
+    return status::Ok();
+  } else if (key == "adbc.cube.tracer") {
+    // The address of an AdbcCubeTracer, copied here; 0 unregisters it
+    UNWRAP_RESULT(auto address, value.AsInt());
+    if (address == 0) {
+      tracer_ = CubeTracer();
+      return status::Ok();
+    }
+    const auto *callbacks = reinterpret_cast<const AdbcCubeTracer *>(
+        static_cast<intptr_t>(address));
+    if (!callbacks->start_span || !callbacks->end_span) {
+      return status::fmt::InvalidArgument(
+          "{} needs start_span and end_span callbacks", key);
+    }
+    tracer_ = CubeTracer(*callbacks);
+    return status::Ok();
+  } else if (key == "adbc.cube.token_provider") {
+    // The address of an AdbcCubeTokenProvider, copied; 0 unregisters it
+    UNWRAP_RESULT(auto address, value.AsInt());
+    const auto *provider = reinterpret_cast<const AdbcCubeTokenProvider *>(
+        static_cast<intptr_t>(address));
+    if (provider && !provider->get_token) {
+      return status::fmt::InvalidArgument("{} needs a get_token callback",
+                                          key);
+    }
+    token_provider_ = provider ? *provider : AdbcCubeTokenProvider{};
+    return status::Ok();
+  } else if (key == "adbc.cube.token_renew_ahead_ms") {
+    UNWRAP_RESULT(auto renew_ahead_ms, value.AsInt());
+    if (renew_ahead_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, renew_ahead_ms);
+    }
+    token_renew_ahead_ = std::chrono::milliseconds(renew_ahead_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.watch_changes") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    watch_changes_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.log_level") {
+    // Process-wide, and applied at once so a live process can be switched
+    UNWRAP_RESULT(auto text, value.AsString());
+    CubeLogLevel level;
+    if (!ParseLogLevel(text, &level)) {
+      return status::fmt::InvalidArgument(
+          "{} must be off, error, warn, info, debug or trace, got '{}'", key,
+          text);
+    }
+    CubeLog::SetLevel(level);
+    return status::Ok();
+  } else if (key == "adbc.cube.logger") {
+    // The address of an AdbcCubeLogger, copied; 0 restores stderr
+    UNWRAP_RESULT(auto address, value.AsInt());
+    const auto *logger = reinterpret_cast<const AdbcCubeLogger *>(
+        static_cast<intptr_t>(address));
+    if (logger && !logger->log) {
+      return status::fmt::InvalidArgument("{} needs a log callback", key);
+    }
+    CubeLog::SetLogger(logger);
+    return status::Ok();
+  } else if (key == "adbc.cube.allocator") {
+    // The address of an AdbcCubeAllocator, copied; 0 restores malloc
+    UNWRAP_RESULT(auto address, value.AsInt());
+    const auto *allocator = reinterpret_cast<const AdbcCubeAllocator *>(
+        static_cast<intptr_t>(address));
+    if (allocator && (!allocator->allocate || !allocator->free)) {
+      return status::fmt::InvalidArgument(
+          "{} needs allocate and free callbacks", key);
+    }
+    CubeSetAllocator(allocator);
+    return status::Ok();
+  } else if (key == "adbc.cube.log_rate") {
+    UNWRAP_RESULT(auto per_second, value.AsInt());
+    if (per_second < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, per_second);
+    }
+    CubeLog::SetRateLimit(per_second);
+    return status::Ok();
+  } else if (key == "adbc.cube.capture_dir") {
+    UNWRAP_RESULT(auto dir, value.AsString());
+    capture_dir_ = std::string(dir);
+    return status::Ok();
   } else if (key == "adbc.cube.port") {
     UNWRAP_RESULT(auto str, value.AsString());
     port_ = str;
@@ -81,8 +420,506 @@ Status CubeDatabase::SetOptionImpl(std::string_view key, driver::Option value) {
     UNWRAP_RESULT(auto str, value.AsString());
     connection_mode_str_ = str;
     return status::Ok();
+  } else if (key == "adbc.cube.zero_copy") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    zero_copy_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.max_message_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0 || bytes > static_cast<int64_t>(UINT32_MAX)) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, UINT32_MAX, bytes);
+    }
+    max_message_bytes_ = static_cast<uint32_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.tcp_nodelay") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    socket_options_.tcp_nodelay = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.socket_recv_buffer_bytes" ||
+             key == "adbc.cube.socket_send_buffer_bytes" ||
+             key == "adbc.cube.tcp_keepalive_idle_s" ||
+             key == "adbc.cube.tcp_keepalive_interval_s" ||
+             key == "adbc.cube.tcp_keepalive_count" ||
+             key == "adbc.cube.busy_poll_us") {
+    UNWRAP_RESULT(auto v, value.AsInt());
+    if (v < 0 || v > static_cast<int64_t>(INT32_MAX)) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, INT32_MAX, v);
+    }
+    int n = static_cast<int>(v);
+    if (key == "adbc.cube.socket_recv_buffer_bytes") {
+      socket_options_.recv_buffer_bytes = n;
+    } else if (key == "adbc.cube.socket_send_buffer_bytes") {
+      socket_options_.send_buffer_bytes = n;
+    } else if (key == "adbc.cube.tcp_keepalive_idle_s") {
+      socket_options_.keepalive_idle_s = n;
+    } else if (key == "adbc.cube.tcp_keepalive_interval_s") {
+      socket_options_.keepalive_interval_s = n;
+    } else if (key == "adbc.cube.tcp_keepalive_count") {
+      socket_options_.keepalive_count = n;
+    } else {
+      socket_options_.busy_poll_us = n;
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.connect_timeout_ms" ||
+             key == "adbc.cube.read_timeout_ms" ||
+             key == "adbc.cube.query_timeout_ms") {
+    UNWRAP_RESULT(auto ms, value.AsInt());
+    if (ms < 0 || ms > static_cast<int64_t>(INT32_MAX)) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, INT32_MAX, ms);
+    }
+    int n = static_cast<int>(ms);
+    if (key == "adbc.cube.connect_timeout_ms") {
+      timeouts_.connect_ms = n;
+    } else if (key == "adbc.cube.read_timeout_ms") {
+      timeouts_.read_ms = n;
+    } else {
+      timeouts_.query_ms = n;
+    }
+    return status::Ok();
+  } else if (key == "adbc.cube.thread_safe") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    thread_safe_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.pipelining") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    pipelining_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.reconnect") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    reconnect_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    prefetch_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.cursor_fetch_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    cursor_fetch_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.credit_batches") {
+    UNWRAP_RESULT(auto batches, value.AsInt());
+    if (batches < 0 || batches >= CREDIT_UNLIMITED_BATCHES) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key,
+          CREDIT_UNLIMITED_BATCHES - 1, batches);
+    }
+    credit_batches_ = static_cast<uint32_t>(batches);
+    return status::Ok();
+  } else if (key == "adbc.cube.credit_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    credit_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.compression") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    auto codec = ParseCompressionCodec(str);
+    if (!codec) {
+      return status::fmt::InvalidArgument(
+          "{} must be 'none', 'lz4' or 'zstd', got '{}'", key, str);
+    }
+    if (!IsCompressionCodecAvailable(*codec)) {
+      return status::fmt::NotImplemented(
+          "{}: driver was built without {} support", key, str);
+    }
+    compression_ = *codec;
+    return status::Ok();
+  } else if (key == "adbc.cube.transport") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    auto kind = ParseTransportKind(str);
+    if (!kind) {
+      return status::fmt::InvalidArgument(
+          "{} must be 'socket' or 'io_uring', got '{}'", key, str);
+    }
+    if (!TransportAvailable(*kind)) {
+      return status::fmt::NotImplemented(
+          "{}: driver was built without {} support", key, str);
+    }
+    transport_ = *kind;
+    return status::Ok();
+  } else if (key == "adbc.cube.shared_memory_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    if (bytes > 0 && !SharedMemoryAvailable()) {
+      return status::fmt::NotImplemented(
+          "{}: shared memory is not supported on this platform", key);
+    }
+    shared_memory_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.tls") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    if (enabled && !TlsAvailable()) {
+      return status::fmt::NotImplemented(
+          "{}: driver was built without TLS support", key);
+    }
+    tls_ = enabled;
+    // Connections opened from now on use the new settings
+    return pool_ ? MakeTlsContext() : status::Ok();
+  } else if (key == "adbc.cube.tls_verify") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    tls_options_.verify = enabled;
+    return pool_ ? MakeTlsContext() : status::Ok();
+  } else if (key == "adbc.cube.tls_ca_file") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    tls_options_.ca_file = str;
+    return pool_ ? MakeTlsContext() : status::Ok();
+  } else if (key == "adbc.cube.tls_server_name") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    tls_options_.server_name = str;
+    return pool_ ? MakeTlsContext() : status::Ok();
+  } else if (key == "adbc.cube.flatbuffer_verification") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    auto verification = ParseFlatBufferVerification(str);
+    if (!verification) {
+      return status::fmt::InvalidArgument(
+          "{} must be 'full', 'bounds' or 'none', got '{}'", key, str);
+    }
+    verification_ = *verification;
+    return status::Ok();
+  } else if (key == "adbc.cube.schema_cache_entries") {
+    UNWRAP_RESULT(auto entries, value.AsInt());
+    if (entries < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, entries);
+    }
+    schema_cache_entries_ = static_cast<size_t>(entries);
+    return status::Ok();
+  } else if (key == "adbc.cube.prepared_cache_entries") {
+    UNWRAP_RESULT(auto entries, value.AsInt());
+    if (entries < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, entries);
+    }
+    prepared_cache_entries_ = static_cast<size_t>(entries);
+    return status::Ok();
+  } else if (key == "adbc.cube.buffer_pool_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    buffer_pool_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.memory_limit_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    memory_->set_limit(static_cast<size_t>(bytes));
+    return status::Ok();
+  } else if (key == "adbc.cube.postgres_output_format") {
+    UNWRAP_RESULT(auto str, value.AsString());
+    auto format = ParsePostgresOutputFormat(str);
+    if (!format) {
+      return status::fmt::InvalidArgument(
+          "{} must be 'auto', 'arrow_ipc' or 'binary', got '{}'", key, str);
+    }
+    postgres_output_format_ = *format;
+    return status::Ok();
+  } else if (key == "adbc.cube.table_schema_cache_ttl_ms") {
+    UNWRAP_RESULT(auto ttl_ms, value.AsInt());
+    if (ttl_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, ttl_ms);
+    }
+    table_schema_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.metadata_cache_ttl_ms") {
+    UNWRAP_RESULT(auto ttl_ms, value.AsInt());
+    if (ttl_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, ttl_ms);
+    }
+    metadata_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.result_cache.max_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    result_cache_max_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.result_cache.ttl_ms") {
+    UNWRAP_RESULT(auto ttl_ms, value.AsInt());
+    if (ttl_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, ttl_ms);
+    }
+    result_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.shared_result_cache.name") {
+    UNWRAP_RESULT(auto name, value.AsString());
+    if (!name.empty() && !SharedResultCacheAvailable()) {
+      return status::fmt::NotImplemented(
+          "{}: shared memory is not supported on this platform", key);
+    }
+    if (name.size() > 128 || name.find('/') != std::string::npos) {
+      return status::fmt::InvalidArgument(
+          "{} must be at most 128 characters without '/', got '{}'", key,
+          name);
+    }
+    shared_result_cache_name_ = std::string(name);
+    return status::Ok();
+  } else if (key == "adbc.cube.shared_result_cache.max_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes <= 0) {
+      return status::fmt::InvalidArgument("{} must be positive, got {}", key,
+                                          bytes);
+    }
+    shared_result_cache_max_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.shared_result_cache.entries") {
+    UNWRAP_RESULT(auto entries, value.AsInt());
+    if (entries < 1 || entries > 1048576) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 1 and 1048576, got {}", key, entries);
+    }
+    shared_result_cache_entries_ = static_cast<size_t>(entries);
+    return status::Ok();
+  } else if (key == "adbc.cube.disk_cache.dir") {
+    UNWRAP_RESULT(auto dir, value.AsString());
+    if (!dir.empty() && !DiskCacheAvailable()) {
+      return status::fmt::NotImplemented(
+          "{}: a disk cache is not supported on this platform", key);
+    }
+    disk_cache_dir_ = std::string(dir);
+    return status::Ok();
+  } else if (key == "adbc.cube.disk_cache.max_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes <= 0) {
+      return status::fmt::InvalidArgument("{} must be positive, got {}", key,
+                                          bytes);
+    }
+    disk_cache_max_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.disk_cache.ttl_ms") {
+    UNWRAP_RESULT(auto ttl_ms, value.AsInt());
+    if (ttl_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, ttl_ms);
+    }
+    disk_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.rollup_cache.max_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    rollup_cache_max_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.delta_cache.max_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    delta_cache_max_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.decode_pool.threads") {
+    UNWRAP_RESULT(auto threads, value.AsInt());
+    if (threads < 0 || threads > 1024) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and 1024, got {}", key, threads);
+    }
+    decode_pool_threads_ = static_cast<size_t>(threads);
+    return status::Ok();
+  } else if (key == "adbc.cube.decode_pool.cpus") {
+    UNWRAP_RESULT(auto text, value.AsString());
+    std::vector<int> cpus;
+    std::string message;
+    if (!ParseCpuList(text, &cpus, &message)) {
+      return status::fmt::InvalidArgument("Invalid {}: {}", key, message);
+    }
+    decode_pool_cpus_ = std::move(cpus);
+    return status::Ok();
+  } else if (key == "adbc.cube.memory.huge_page_min_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    huge_page_min_bytes_ = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.memory.numa_local") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    numa_local_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.share_inflight") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    share_inflight_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_queries.budget_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    prefetch_options_.budget_bytes = static_cast<size_t>(bytes);
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_queries.max_queued") {
+    UNWRAP_RESULT(auto count, value.AsInt());
+    if (count < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, count);
+    }
+    prefetch_options_.max_queued = static_cast<size_t>(count);
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_queries.drill_down") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    prefetch_options_.drill_down = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.admission.max_queries") {
+    UNWRAP_RESULT(auto count, value.AsInt());
+    if (count < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, count);
+    }
+    admission_options_.max_queries = static_cast<size_t>(count);
+    return status::Ok();
+  } else if (key == "adbc.cube.admission.min_queries") {
+    UNWRAP_RESULT(auto count, value.AsInt());
+    if (count < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, count);
+    }
+    admission_options_.min_queries = static_cast<size_t>(count);
+    return status::Ok();
+  } else if (key == "adbc.cube.admission.queue_timeout_ms") {
+    UNWRAP_RESULT(auto timeout_ms, value.AsInt());
+    if (timeout_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, timeout_ms);
+    }
+    admission_options_.queue_timeout = std::chrono::milliseconds(timeout_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.admission.target_latency_ms") {
+    UNWRAP_RESULT(auto latency_ms, value.AsInt());
+    if (latency_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, latency_ms);
+    }
+    admission_options_.target_latency = std::chrono::milliseconds(latency_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.dns_cache_ttl_ms") {
+    UNWRAP_RESULT(auto ttl_ms, value.AsInt());
+    if (ttl_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, ttl_ms);
+    }
+    dns_cache_ttl_ = std::chrono::milliseconds(ttl_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_size") {
+    UNWRAP_RESULT(auto size, value.AsInt());
+    if (size < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, size);
+    }
+    pool_options_.max_idle = static_cast<size_t>(size);
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_idle_timeout_ms") {
+    UNWRAP_RESULT(auto timeout_ms, value.AsInt());
+    if (timeout_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, timeout_ms);
+    }
+    pool_options_.idle_timeout = std::chrono::milliseconds(timeout_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_health_check") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    pool_options_.health_check = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_ping_timeout_ms") {
+    UNWRAP_RESULT(auto timeout_ms, value.AsInt());
+    if (timeout_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, timeout_ms);
+    }
+    pool_options_.ping_timeout = std::chrono::milliseconds(timeout_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_keepalive_ms") {
+    UNWRAP_RESULT(auto interval_ms, value.AsInt());
+    if (interval_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, interval_ms);
+    }
+    pool_options_.keepalive = std::chrono::milliseconds(interval_ms);
+    return status::Ok();
+  } else if (key == "adbc.cube.pool_min_idle") {
+    UNWRAP_RESULT(auto count, value.AsInt());
+    if (count < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, count);
+    }
+    pool_min_idle_ = static_cast<size_t>(count);
+    return status::Ok();
+  } else if (key == "adbc.cube.prefetch_meta") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    prefetch_meta_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.warm_start_background") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    warm_start_background_ = enabled;
+    return status::Ok();
+  } else if (key == "adbc.cube.metrics" || key == "adbc.cube.memory_bytes" ||
+             key == "adbc.cube.memory_peak_bytes" ||
+             key == "adbc.cube.token_renewals" ||
+             key == "adbc.cube.change_notifications" ||
+             key == "adbc.cube.admission.limit" ||
+             key == "adbc.cube.admission.running" ||
+             key == "adbc.cube.admission.queued") {
+    return status::InvalidArgument(key, " is read-only");
   }
   return status::NotImplemented("Unknown option: ", key);
 }
 
+Result<driver::Option> CubeDatabase::GetOption(std::string_view key) {
+  if (key == "adbc.cube.metrics") {
+    return driver::Option(CubeMetrics::Global().Format());
+  } else if (key == "adbc.cube.token_renewals") {
+    return driver::Option(token_source_ ? token_source_->renewals() : 0);
+  } else if (key == "adbc.cube.change_notifications") {
+    return driver::Option(
+        change_watcher_ ? change_watcher_->notifications() : 0);
+  } else if (key == "adbc.cube.log_level") {
+    return driver::Option(LogLevelName(CubeLog::level()));
+  } else if (key == "adbc.cube.log_dropped") {
+    return driver::Option(CubeLog::dropped());
+  } else if (key == "adbc.cube.memory_bytes") {
+    return driver::Option(static_cast<int64_t>(memory_->current()));
+  } else if (key == "adbc.cube.memory_peak_bytes") {
+    return driver::Option(static_cast<int64_t>(memory_->peak()));
+  } else if (key == "adbc.cube.admission.limit" ||
+             key == "adbc.cube.admission.running" ||
+             key == "adbc.cube.admission.queued") {
+    if (!admission_) {
+      return status::InvalidState(key, " needs admission.max_queries");
+    }
+    size_t count = key == "adbc.cube.admission.limit" ? admission_->limit()
+                   : key == "adbc.cube.admission.running"
+                       ? admission_->running()
+                       : admission_->queued();
+    return driver::Option(static_cast<int64_t>(count));
+  }
+  return Base::GetOption(key);
+}
+
 } // namespace adbc::cube
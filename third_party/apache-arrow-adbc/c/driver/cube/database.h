@@ -17,13 +17,40 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 #include <arrow-adbc/adbc.h>
 
 #define ADBC_FRAMEWORK_USE_FMT
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/address_cache.h"
+#include "driver/cube/admission.h"
+#include "driver/cube/change_watcher.h"
+#include "driver/cube/compression.h"
+#include "driver/cube/connection_pool.h"
+#include "driver/cube/delta_cache.h"
+#include "driver/cube/disk_cache.h"
+#include "driver/cube/endpoints.h"
+#include "driver/cube/memory_tracker.h"
+#include "driver/cube/metadata.h"
+#include "driver/cube/native_protocol.h"
+#include "driver/cube/postgres_reader.h"
+#include "driver/cube/prefetch.h"
+#include "driver/cube/result_cache.h"
+#include "driver/cube/rollup_cache.h"
+#include "driver/cube/shared_memory.h"
+#include "driver/cube/shared_result_cache.h"
+#include "driver/cube/tls.h"
+#include "driver/cube/token_source.h"
+#include "driver/cube/tracing.h"
+#include "driver/cube/transport.h"
 #include "driver/framework/base_driver.h"
 #include "driver/framework/database.h"
 #include "driver/framework/status.h"
@@ -41,30 +68,260 @@ class CubeDatabase : public driver::Database<CubeDatabase> {
 public:
   constexpr static std::string_view kErrorPrefix = "[Cube]";
 
-  ~CubeDatabase() = default;
+  ~CubeDatabase() { StopWarmStart(); }
 
   Status InitImpl() override;
   Status ReleaseImpl() override;
   Status SetOptionImpl(std::string_view key, driver::Option value) override;
 
+  // Driver-wide metrics (adbc.cube.metrics) are the only readable option
+  Result<driver::Option> GetOption(std::string_view key) override;
+
   // Accessors for connection parameters
   const std::string &host() const { return host_; }
   const std::string &port() const { return port_; }
   const std::string &token() const { return token_; }
+  /// Token renewed from this database's token provider, which connections
+  /// follow unless they set their own (set by InitImpl; null unless
+  /// token_provider is set)
+  const std::shared_ptr<CubeTokenSource> &token_source() const {
+    return token_source_;
+  }
+  /// Invalidates the caches as the server reports changes (set by
+  /// InitImpl; null unless watch_changes is set, in native mode)
+  const std::shared_ptr<CubeChangeWatcher> &change_watcher() const {
+    return change_watcher_;
+  }
   const std::string &database() const { return database_; }
   const std::string &user() const { return user_; }
   const std::string &password() const { return password_; }
   ConnectionMode connection_mode() const;
+  bool zero_copy() const { return zero_copy_; }
+  uint32_t max_message_bytes() const { return max_message_bytes_; }
+  const NativeSocketOptions &socket_options() const { return socket_options_; }
+  const NativeTimeouts &timeouts() const { return timeouts_; }
+  bool pipelining() const { return pipelining_; }
+  bool thread_safe() const { return thread_safe_; }
+  bool reconnect() const { return reconnect_; }
+  size_t prefetch_bytes() const { return prefetch_bytes_; }
+  size_t cursor_fetch_bytes() const { return cursor_fetch_bytes_; }
+  uint32_t credit_batches() const { return credit_batches_; }
+  size_t credit_bytes() const { return credit_bytes_; }
+  CompressionCodec compression() const { return compression_; }
+  CubeTransportKind transport() const { return transport_; }
+  size_t shared_memory_bytes() const { return shared_memory_bytes_; }
+  FlatBufferVerification verification() const { return verification_; }
+  size_t schema_cache_entries() const { return schema_cache_entries_; }
+  size_t prepared_cache_entries() const { return prepared_cache_entries_; }
+  size_t buffer_pool_bytes() const { return buffer_pool_bytes_; }
+  PostgresOutputFormat postgres_output_format() const {
+    return postgres_output_format_;
+  }
+  std::chrono::milliseconds table_schema_cache_ttl() const {
+    return table_schema_cache_ttl_;
+  }
+
+  /// Memory held for this database: its caches, and what its connections'
+  /// trackers charge
+  const std::shared_ptr<CubeMemoryTracker> &memory() const { return memory_; }
+
+  /// Idle native sessions shared by this database's connections (set by
+  /// InitImpl)
+  const std::shared_ptr<NativeClientPool> &pool() const { return pool_; }
+
+  /// Data model shared by this database's connections (set by InitImpl;
+  /// null when metadata_cache_ttl_ms is 0)
+  const std::shared_ptr<CubeMetadataCache> &metadata_cache() const {
+    return metadata_cache_;
+  }
+
+  /// Query results shared by this database's connections (set by InitImpl;
+  /// null unless result_cache.max_bytes is set)
+  const std::shared_ptr<CubeResultCache> &result_cache() const {
+    return result_cache_;
+  }
+
+  /// Query results shared with the other processes on the host (set by
+  /// InitImpl; null unless shared_result_cache.name is set)
+  const std::shared_ptr<CubeSharedResultCache> &shared_result_cache() const {
+    return shared_result_cache_;
+  }
+
+  /// Query results and metadata snapshots kept on disk across restarts
+  /// (set by InitImpl; null unless disk_cache.dir is set)
+  const std::shared_ptr<CubeDiskCache> &disk_cache() const {
+    return disk_cache_;
+  }
+
+  /// Roll-up query results shared by this database's connections (set by
+  /// InitImpl; null unless rollup_cache.max_bytes is set)
+  const std::shared_ptr<CubeRollupCache> &rollup_cache() const {
+    return rollup_cache_;
+  }
+
+  /// Versioned query results the server sends deltas of, shared by this
+  /// database's connections (set by InitImpl; null unless
+  /// delta_cache.max_bytes is set)
+  const std::shared_ptr<CubeDeltaCache> &delta_cache() const {
+    return delta_cache_;
+  }
+
+  /// Identical queries running on this database's connections (set by
+  /// InitImpl; null unless share_inflight is set)
+  const std::shared_ptr<CubeInflightQueries> &inflight_queries() const {
+    return inflight_;
+  }
+
+  /// Runs the queries this database's connections expect next into the
+  /// result cache (set by InitImpl; null unless prefetch_queries.budget_bytes
+  /// and result_cache.max_bytes are set in native mode)
+  const std::shared_ptr<CubePrefetcher> &prefetcher() const {
+    return prefetcher_;
+  }
+
+  /// Slots for the queries this database's connections run at once (set by
+  /// InitImpl; null unless admission.max_queries is set)
+  const std::shared_ptr<CubeAdmissionControl> &admission() const {
+    return admission_;
+  }
+
+  /// Resolved server addresses shared by this database's connections (set
+  /// by InitImpl; null when dns_cache_ttl_ms is 0)
+  const std::shared_ptr<CubeAddressCache> &address_cache() const {
+    return address_cache_;
+  }
+
+  /// Servers this database's connections are spread over (set by InitImpl;
+  /// null unless hosts is set, in which case host and port are unused)
+  const std::shared_ptr<CubeEndpointSet> &endpoints() const {
+    return endpoints_;
+  }
+
+  /// TLS settings and resumable sessions shared by this database's native
+  /// connections (set by InitImpl; null unless tls is enabled)
+  const std::shared_ptr<CubeTlsContext> &tls_context() const {
+    return tls_context_;
+  }
+  bool tls() const { return tls_; }
+  const CubeTracer &tracer() const { return tracer_; }
+  const std::string &capture_dir() const { return capture_dir_; }
+  const CubeTlsOptions &tls_options() const { return tls_options_; }
 
 private:
+  /// Rebuild tls_context_ from the TLS options
+  Status MakeTlsContext();
+
+  /// Open pool_min_idle sessions into the pool and, with prefetch_meta,
+  /// load the data model into metadata_cache_; in warm_thread_ when
+  /// warm_start_background is set
+  Status WarmStart();
+  /// Wait for a background WarmStart to finish
+  void StopWarmStart();
+
   std::string host_ = "localhost";
   std::string port_ = "4444";
+  std::string hosts_; // Endpoint list replacing host_ and port_ when set
+  // How long an endpoint that failed is skipped
+  std::chrono::milliseconds eject_time_{10000};
+  CubeEndpointRouting hosts_routing_ = CubeEndpointRouting::Load;
+  // Sessions an endpoint takes under affinity routing, over the average
+  double hosts_max_load_ = CubeEndpointSet::kDefaultMaxLoad;
   std::string token_;
+  // Asked for tokens in place of token_ when get_token is set
+  AdbcCubeTokenProvider token_provider_{};
+  // How long before a provided token expires it is renewed
+  std::chrono::milliseconds token_renew_ahead_{60000};
+  std::shared_ptr<CubeTokenSource> token_source_;
+  // Keep a native session watching for changes to invalidate caches by
+  bool watch_changes_ = false;
+  std::shared_ptr<CubeChangeWatcher> change_watcher_;
   std::string database_;
   std::string user_;
   std::string password_;
   std::string connection_mode_str_ =
       "postgresql"; // Default to PostgreSQL for compatibility
+  bool zero_copy_ = true; // Share IPC buffers with result arrays
+  uint32_t max_message_bytes_ = DEFAULT_MAX_MESSAGE_BYTES; // 0 = no limit
+  NativeSocketOptions socket_options_;
+  NativeTimeouts timeouts_; // 0 = no limit
+  bool pipelining_ = false; // Send queries before earlier results are read
+  bool thread_safe_ = false; // Connections may be used by several threads
+  bool reconnect_ = true;   // Replace native sessions the server closed
+  size_t prefetch_bytes_ = 0; // Decode-ahead budget per result; 0 = off
+  size_t cursor_fetch_bytes_ = 0; // First fetch of cursor results; 0 = push
+  uint32_t credit_batches_ = 0; // Flow control window; both 0 = off
+  size_t credit_bytes_ = 0;
+  CompressionCodec compression_ = CompressionCodec::None;
+  CubeTransportKind transport_ = CubeTransportKind::Socket;
+  size_t shared_memory_bytes_ = 0; // Region offered over unix://; 0 = off
+  FlatBufferVerification verification_ = FlatBufferVerification::Full;
+  size_t schema_cache_entries_ = 64; // Parsed schemas kept; 0 = no cache
+  size_t prepared_cache_entries_ = 64; // Per connection; 0 = no cache
+  size_t buffer_pool_bytes_ = 0; // Freed result buffers kept; 0 = no pool
+  PostgresOutputFormat postgres_output_format_ = PostgresOutputFormat::Auto;
+  // How long GetTableSchema results are reused; 0 = not cached
+  std::chrono::milliseconds table_schema_cache_ttl_{60000};
+  // How long the data model is reused; 0 = read for every call
+  std::chrono::milliseconds metadata_cache_ttl_{60000};
+  // Bytes of native results kept for repeated queries; 0 = not cached
+  size_t result_cache_max_bytes_ = 0;
+  std::chrono::milliseconds result_cache_ttl_{60000}; // 0 = no expiry
+  // Index of the results shared between processes; empty = not shared.
+  // Its budget and slots are those of the first process to open it.
+  std::string shared_result_cache_name_;
+  size_t shared_result_cache_max_bytes_ = size_t{1} << 30;
+  size_t shared_result_cache_entries_ = 4096;
+  // Directory of the results and metadata kept across restarts; empty =
+  // none kept. Entries expire after the ttl even if the model is the same.
+  std::string disk_cache_dir_;
+  size_t disk_cache_max_bytes_ = size_t{1} << 30;
+  std::chrono::milliseconds disk_cache_ttl_{86400000}; // 0 = no expiry
+  // Bytes of roll-up results kept to answer coarser ones; 0 = not cached
+  size_t rollup_cache_max_bytes_ = 0;
+  // Bytes of versioned results kept to merge deltas into; 0 = not kept
+  size_t delta_cache_max_bytes_ = 0;
+  // Identical queries in flight on several connections run once
+  bool share_inflight_ = false;
+  // Speculative queries; budget_bytes 0 = none run
+  CubePrefetchOptions prefetch_options_;
+  // Queries the connections run at once; max_queries 0 = no limit
+  CubeAdmissionOptions admission_options_;
+  // How long resolved addresses are reused; 0 = resolve every connect
+  std::chrono::milliseconds dns_cache_ttl_{30000};
+  // Process-wide decode pool, set up by the first Init that runs before it
+  // starts: workers (0 = one per CPU) and the CPUs they run on (empty = any)
+  size_t decode_pool_threads_ = 0;
+  std::vector<int> decode_pool_cpus_;
+  // Process-wide placement of large buffers (CubeMemoryPlacement), applied
+  // at Init when set; empty leaves it as it is
+  std::optional<size_t> huge_page_min_bytes_;
+  std::optional<bool> numa_local_;
+  NativeClientPoolOptions pool_options_;
+  // Warm start at InitImpl: sessions opened into the pool, whether the data
+  // model is loaded, and whether Init returns before either is done
+  size_t pool_min_idle_ = 0;
+  bool prefetch_meta_ = false;
+  bool warm_start_background_ = false;
+  std::thread warm_thread_;
+  uint64_t warm_fork_generation_ = 0; // CubeForkGeneration() of warm_thread_
+  std::shared_ptr<CubeMemoryTracker> memory_ = CubeMemoryTracker::Make();
+  std::shared_ptr<NativeClientPool> pool_;
+  std::shared_ptr<CubeMetadataCache> metadata_cache_;
+  std::shared_ptr<CubeResultCache> result_cache_;
+  std::shared_ptr<CubeSharedResultCache> shared_result_cache_;
+  std::shared_ptr<CubeDiskCache> disk_cache_;
+  std::shared_ptr<CubeRollupCache> rollup_cache_;
+  std::shared_ptr<CubeDeltaCache> delta_cache_;
+  std::shared_ptr<CubeInflightQueries> inflight_;
+  std::shared_ptr<CubePrefetcher> prefetcher_;
+  std::shared_ptr<CubeAdmissionControl> admission_;
+  std::shared_ptr<CubeAddressCache> address_cache_;
+  std::shared_ptr<CubeEndpointSet> endpoints_;
+  bool tls_ = false;
+  CubeTlsOptions tls_options_;
+  std::shared_ptr<CubeTlsContext> tls_context_;
+  CubeTracer tracer_; // Disabled unless adbc.cube.tracer is set
+  std::string capture_dir_; // Native sessions are recorded here if set
 };
 
 } // namespace adbc::cube
@@ -0,0 +1,277 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Allocation regression tests for decoding: the allocations a batch takes
+// must not grow with its rows, and the memory it holds at its peak must
+// stay within a multiple of the bytes received for it. This binary
+// replaces malloc to count, so it is kept apart from the other tests.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/ipc_buffer.h"
+#include "driver/cube/mock_server.h"
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) ||  \
+    __has_feature(thread_sanitizer)
+#define CUBE_SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define CUBE_SANITIZED 1
+#endif
+
+// Sanitizers bring their own malloc; elsewhere glibc's can be wrapped
+#if defined(__GLIBC__) && !defined(CUBE_SANITIZED)
+#define CUBE_COUNT_MALLOC 1
+#include <malloc.h>
+#endif
+
+namespace {
+
+std::atomic<bool> counting{false};
+std::atomic<int64_t> allocations{0};
+std::atomic<int64_t> live_bytes{0};
+std::atomic<int64_t> peak_bytes{0};
+
+void CountAllocation(void *block) {
+#if defined(CUBE_COUNT_MALLOC)
+  if (!block || !counting.load(std::memory_order_relaxed)) {
+    return;
+  }
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  int64_t live = live_bytes.fetch_add(malloc_usable_size(block),
+                                      std::memory_order_relaxed) +
+                 malloc_usable_size(block);
+  int64_t peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !peak_bytes.compare_exchange_weak(peak, live,
+                                           std::memory_order_relaxed)) {
+  }
+#else
+  (void)block;
+#endif
+}
+
+void CountFree(void *block) {
+#if defined(CUBE_COUNT_MALLOC)
+  if (block && counting.load(std::memory_order_relaxed)) {
+    live_bytes.fetch_sub(malloc_usable_size(block), std::memory_order_relaxed);
+  }
+#else
+  (void)block;
+#endif
+}
+
+} // namespace
+
+#if defined(CUBE_COUNT_MALLOC)
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *block, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *block);
+
+// Everything the process allocates, C++ new and nanoarrow included, goes
+// through these
+void *malloc(size_t size) {
+  void *block = __libc_malloc(size);
+  CountAllocation(block);
+  return block;
+}
+
+void *calloc(size_t count, size_t size) {
+  void *block = __libc_calloc(count, size);
+  CountAllocation(block);
+  return block;
+}
+
+void *realloc(void *block, size_t size) {
+  CountFree(block);
+  void *moved = __libc_realloc(block, size);
+  if (moved || size != 0) {
+    // On failure block is still there
+    CountAllocation(moved ? moved : block);
+  }
+  return moved;
+}
+
+void *memalign(size_t alignment, size_t size) {
+  void *block = __libc_memalign(alignment, size);
+  CountAllocation(block);
+  return block;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+  void *block = memalign(alignment, size);
+  if (!block) {
+    return ENOMEM;
+  }
+  *out = block;
+  return 0;
+}
+
+void free(void *block) {
+  CountFree(block);
+  __libc_free(block);
+}
+
+} // extern "C"
+#endif
+
+namespace adbc::cube {
+
+namespace {
+
+// Batches of a result decoded one at a time, as a result stream reads them
+struct DecodeCounts {
+  int64_t batches = 0;
+  int64_t rows = 0;
+  int64_t input_bytes = 0;
+  int64_t allocations = 0;
+  int64_t peak_bytes = 0;
+};
+
+void Decode(MockResultShape shape, int64_t rows_per_batch, bool zero_copy,
+            DecodeCounts *out) {
+  MockResultOptions result_options;
+  result_options.shape = shape;
+  result_options.rows_per_batch = rows_per_batch;
+  result_options.batches = 4;
+  MockResult result = MakeMockResult(result_options);
+
+  CubeReaderOptions options;
+  options.zero_copy = zero_copy;
+  CubeArrowReader schema_reader(result.schema, options);
+  ArrowError error;
+  std::memset(&error, 0, sizeof(error));
+  ASSERT_EQ(schema_reader.Init(&error), NANOARROW_OK) << error.message;
+  auto plan = schema_reader.schema_plan();
+
+  std::vector<std::shared_ptr<const CubeIpcBytes>> batches;
+  for (const auto &batch : result.batches) {
+    batches.push_back(std::make_shared<const CubeIpcBytes>(
+        CubeIpcBuffer(batch.begin(), batch.end())));
+    out->input_bytes += static_cast<int64_t>(batch.size());
+  }
+
+  // Once to warm up what decoding sets up on first use, then counted
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      allocations = 0;
+      live_bytes = 0;
+      peak_bytes = 0;
+      counting = true;
+    }
+    for (const auto &batch : batches) {
+      CubeArrowReader reader(batch, options, plan);
+      struct ArrowArray array;
+      ASSERT_EQ(reader.Init(&error), NANOARROW_OK) << error.message;
+      ASSERT_EQ(reader.GetNext(&array), NANOARROW_OK) << error.message;
+      if (pass == 1) {
+        out->rows += array.length;
+      }
+      ArrowArrayRelease(&array);
+    }
+  }
+  counting = false;
+  out->batches = static_cast<int64_t>(batches.size());
+  out->allocations = allocations.load();
+  out->peak_bytes = peak_bytes.load();
+}
+
+} // namespace
+
+class DecodeAllocationTest
+    : public ::testing::TestWithParam<std::tuple<MockResultShape, bool>> {
+public:
+  void SetUp() override {
+#if !defined(CUBE_COUNT_MALLOC)
+    GTEST_SKIP() << "Allocations are counted with glibc, without sanitizers";
+#endif
+  }
+
+protected:
+  // Rows per batch of the small and the large decode
+  static constexpr int64_t kSmallBatch = 1024;
+  static constexpr int64_t kLargeBatch = 32768;
+};
+
+// A batch 32 times longer takes no more allocations, give or take a few
+// for buffers that grow past a size class, so nothing is allocated per row
+TEST_P(DecodeAllocationTest, AllocationsPerBatchDoNotGrowWithRows) {
+  auto [shape, zero_copy] = GetParam();
+  DecodeCounts small, large;
+  ASSERT_NO_FATAL_FAILURE(Decode(shape, kSmallBatch, zero_copy, &small));
+  ASSERT_NO_FATAL_FAILURE(Decode(shape, kLargeBatch, zero_copy, &large));
+  ASSERT_EQ(large.rows, large.batches * kLargeBatch);
+
+  double small_per_batch = double(small.allocations) / small.batches;
+  double large_per_batch = double(large.allocations) / large.batches;
+  EXPECT_LE(large_per_batch, small_per_batch + 8)
+      << MockResultShapeName(shape) << ": " << small_per_batch
+      << " allocations per batch of " << kSmallBatch << " rows, "
+      << large_per_batch << " of " << kLargeBatch;
+}
+
+// Decoding holds at most the batch's decoded copy (none with zero_copy
+// beyond what is rebuilt) on top of the bytes received
+TEST_P(DecodeAllocationTest, PeakBytesPerRow) {
+  auto [shape, zero_copy] = GetParam();
+  DecodeCounts counts;
+  ASSERT_NO_FATAL_FAILURE(Decode(shape, kLargeBatch, zero_copy, &counts));
+
+  double input_per_row = double(counts.input_bytes) / counts.rows;
+  double peak_per_row = double(counts.peak_bytes) / kLargeBatch;
+  double limit = input_per_row * (zero_copy ? 0.5 : 2.0);
+  EXPECT_LE(peak_per_row, limit)
+      << MockResultShapeName(shape) << (zero_copy ? " zero copy" : " copied")
+      << ": peak " << peak_per_row << " bytes per row for "
+      << input_per_row << " received";
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Shapes, DecodeAllocationTest,
+    ::testing::Combine(::testing::Values(MockResultShape::NumericWide,
+                                         MockResultShape::StringHeavy,
+                                         MockResultShape::Nullable,
+                                         MockResultShape::Timestamps),
+                       ::testing::Bool()),
+    [](const auto &info) {
+      return std::string(MockResultShapeName(std::get<0>(info.param))) +
+             (std::get<1>(info.param) ? "_ZeroCopy" : "_Copied");
+    });
+
+} // namespace adbc::cube
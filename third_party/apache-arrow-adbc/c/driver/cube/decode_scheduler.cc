@@ -0,0 +1,347 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/decode_scheduler.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <system_error>
+
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/metrics.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// Highest CPU number accepted, as for a cpu_set_t
+constexpr int kMaxCpu = 1023;
+
+bool ParseCpu(std::string_view text, int *cpu) {
+  if (text.empty() || text.size() > 4) {
+    return false;
+  }
+  int value = 0;
+  for (char c : text) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    value = value * 10 + (c - '0');
+  }
+  *cpu = value;
+  return value <= kMaxCpu;
+}
+
+size_t DefaultThreads(size_t threads, const std::vector<int> &cpus) {
+  if (threads > 0) {
+    return threads;
+  }
+  if (!cpus.empty()) {
+    return cpus.size();
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+bool ParseCpuList(std::string_view text, std::vector<int> *cpus,
+                  std::string *message) {
+  cpus->clear();
+  while (!text.empty()) {
+    size_t comma = text.find(',');
+    std::string_view item = text.substr(0, comma);
+    text = comma == std::string_view::npos ? std::string_view()
+                                           : text.substr(comma + 1);
+    size_t dash = item.find('-');
+    int first = 0;
+    int last = 0;
+    bool ok = dash == std::string_view::npos
+                  ? ParseCpu(item, &first) && ParseCpu(item, &last)
+                  : ParseCpu(item.substr(0, dash), &first) &&
+                        ParseCpu(item.substr(dash + 1), &last);
+    if (!ok || first > last) {
+      *message = "expected CPU numbers (0 to " + std::to_string(kMaxCpu) +
+                 ") and ranges separated by commas, got '" +
+                 std::string(item) + "'";
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(cpu);
+    }
+  }
+  std::sort(cpus->begin(), cpus->end());
+  cpus->erase(std::unique(cpus->begin(), cpus->end()), cpus->end());
+  return true;
+}
+
+struct CubeDecodeScheduler::Job {
+  TaskFn fn;
+  const void *context;
+  size_t n_tasks;
+  unsigned max_helpers;
+  std::atomic<size_t> next{0};     // Next task to claim
+  std::atomic<size_t> done{0};     // Tasks that have run
+  std::atomic<unsigned> helpers{0}; // Workers in the job now
+  std::atomic<unsigned> helped{0};  // Workers that ran a task
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  Job(TaskFn fn, const void *context, size_t n_tasks, unsigned max_helpers)
+      : fn(fn), context(context), n_tasks(n_tasks), max_helpers(max_helpers) {}
+};
+
+CubeDecodeScheduler &CubeDecodeScheduler::Global() {
+  static CubeDecodeScheduler scheduler;
+  return scheduler;
+}
+
+CubeDecodeScheduler::CubeDecodeScheduler()
+    : fork_generation_(CubeForkGeneration()) {
+  CubeForkRegisterMutex(&mutex_);
+}
+
+CubeDecodeScheduler::~CubeDecodeScheduler() {
+  CubeForkUnregisterMutex(&mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fork_generation_.load(std::memory_order_relaxed) !=
+        CubeForkGeneration()) {
+      AbandonWorkers();
+      return;
+    }
+    stopping_ = true;
+  }
+  cv_->notify_all();
+  for (auto &worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+  }
+}
+
+bool CubeDecodeScheduler::Configure(size_t threads, std::vector<int> cpus,
+                                    std::string *message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (started_.load(std::memory_order_relaxed)) {
+    if (DefaultThreads(threads, cpus) == DefaultThreads(threads_, cpus_) &&
+        cpus == cpus_) {
+      return true;
+    }
+    *message = "the decode pool is already running with " +
+               std::to_string(DefaultThreads(threads_, cpus_)) + " threads";
+    if (cpus != cpus_) {
+      *message += " on other CPUs";
+    }
+    return false;
+  }
+  threads_ = threads;
+  cpus_ = std::move(cpus);
+  return true;
+}
+
+void CubeDecodeScheduler::AbandonWorkers() {
+  // Their deques and locks are left as the fork found them, never touched
+  for (auto &worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.detach();
+    }
+    worker.release();
+  }
+  workers_.clear();
+  cv_.release();
+  cv_ = std::make_unique<std::condition_variable>();
+  n_workers_ = 0;
+  queued_.store(0, std::memory_order_relaxed);
+  active_jobs_.store(0, std::memory_order_relaxed);
+  started_.store(false, std::memory_order_relaxed);
+  fork_generation_.store(CubeForkGeneration(), std::memory_order_relaxed);
+}
+
+size_t CubeDecodeScheduler::Workers() {
+  if (started_.load(std::memory_order_acquire) &&
+      fork_generation_.load(std::memory_order_relaxed) ==
+          CubeForkGeneration()) {
+    return n_workers_;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fork_generation_.load(std::memory_order_relaxed) !=
+      CubeForkGeneration()) {
+    AbandonWorkers();
+  }
+  if (started_.load(std::memory_order_relaxed)) {
+    return n_workers_;
+  }
+  size_t threads = DefaultThreads(threads_, cpus_);
+  for (size_t i = 0; i < threads; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // Built first: workers steal from each other's deques
+  size_t started = 0;
+  for (; started < threads; started++) {
+    try {
+      workers_[started]->thread =
+          std::thread(&CubeDecodeScheduler::WorkerLoop, this, started);
+    } catch (const std::system_error &) {
+      break; // The workers already started take the jobs
+    }
+  }
+  n_workers_ = started;
+  started_.store(true, std::memory_order_release);
+  return n_workers_;
+}
+
+unsigned CubeDecodeScheduler::Run(size_t n_tasks, unsigned max_threads,
+                                  TaskFn fn, const void *context) {
+  size_t helpers = std::min<size_t>(std::max(1u, max_threads) - 1,
+                                    n_tasks > 0 ? n_tasks - 1 : 0);
+  if (helpers > 0) {
+    helpers = std::min(helpers, Workers());
+  }
+  if (helpers == 0) {
+    for (size_t i = 0; i < n_tasks; i++) {
+      fn(context, i);
+    }
+    return 1;
+  }
+
+  auto job = std::make_shared<Job>(fn, context, n_tasks,
+                                   static_cast<unsigned>(helpers));
+  active_jobs_.fetch_add(1, std::memory_order_relaxed);
+  // Counted first so that a worker taking the job never sees fewer
+  queued_.fetch_add(helpers, std::memory_order_release);
+  size_t first = next_worker_.fetch_add(helpers, std::memory_order_relaxed);
+  for (size_t i = 0; i < helpers; i++) {
+    Worker &worker = *workers_[(first + i) % n_workers_];
+    auto lock =
+        CubeLockCounted(worker.mutex, CubeMetrics::Global().decode_lock);
+    worker.jobs.push_back(job);
+  }
+  {
+    // Pairs with the check a worker makes before waiting
+    auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().decode_lock);
+  }
+  cv_->notify_all();
+
+  RunTasks(job.get());
+  {
+    // Tasks the workers claimed may still be running
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->cv.wait(lock, [&] {
+      return job->done.load(std::memory_order_acquire) == n_tasks;
+    });
+  }
+  active_jobs_.fetch_sub(1, std::memory_order_relaxed);
+  return job->helped.load(std::memory_order_relaxed) + 1;
+}
+
+void CubeDecodeScheduler::RunTasks(Job *job) {
+  for (size_t i = job->next++; i < job->n_tasks; i = job->next++) {
+    job->fn(job->context, i);
+    if (job->done.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+        job->n_tasks) {
+      {
+        std::lock_guard<std::mutex> lock(job->mutex);
+      }
+      job->cv.notify_all();
+    }
+  }
+}
+
+void CubeDecodeScheduler::Help(Job *job) {
+  if (job->next.load(std::memory_order_relaxed) >= job->n_tasks) {
+    return; // Finished before this worker got to it
+  }
+  size_t active = std::max<size_t>(
+      1, active_jobs_.load(std::memory_order_relaxed));
+  unsigned share = static_cast<unsigned>(std::max<size_t>(
+      1, std::min<size_t>(job->max_helpers, n_workers_ / active)));
+  if (job->helpers.fetch_add(1, std::memory_order_relaxed) >= share) {
+    // The job has its share; the worker is free for the other streams
+    job->helpers.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  if (job->next.load(std::memory_order_relaxed) < job->n_tasks) {
+    // Counted before any of its tasks can finish the job
+    job->helped.fetch_add(1, std::memory_order_relaxed);
+    RunTasks(job);
+  }
+  job->helpers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<CubeDecodeScheduler::Job>
+CubeDecodeScheduler::Take(size_t index) {
+  std::shared_ptr<Job> job;
+  {
+    Worker &own = *workers_[index];
+    auto lock = CubeLockCounted(own.mutex, CubeMetrics::Global().decode_lock);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.front());
+      own.jobs.pop_front();
+    }
+  }
+  for (size_t i = 1; !job && i < n_workers_; i++) {
+    Worker &victim = *workers_[(index + i) % n_workers_];
+    auto lock =
+        CubeLockCounted(victim.mutex, CubeMetrics::Global().decode_lock);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.back());
+      victim.jobs.pop_back();
+    }
+  }
+  if (job) {
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+void CubeDecodeScheduler::WorkerLoop(size_t index) {
+#if defined(__linux__)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!cpus_.empty()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : cpus_) {
+        CPU_SET(cpu, &set);
+      }
+      // CPUs outside the process's own set fail this; the worker then runs
+      // wherever the process may
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+  }
+#endif
+  while (true) {
+    std::shared_ptr<Job> job = Take(index);
+    if (job) {
+      Help(job.get());
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_->wait(lock, [this] {
+      return stopping_ || queued_.load(std::memory_order_acquire) > 0;
+    });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+} // namespace adbc::cube
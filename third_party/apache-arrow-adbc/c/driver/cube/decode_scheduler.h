@@ -0,0 +1,122 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace adbc::cube {
+
+// Parse a list of CPU numbers and ranges, such as "0-3,8,10-11"
+// @return false, with message set, if text is not one
+bool ParseCpuList(std::string_view text, std::vector<int> *cpus,
+                  std::string *message);
+
+// Worker threads shared by every stream of the process, which build the
+// columns and decompress the buffers of their batches, so that many
+// concurrent queries do not each start threads of their own.
+//
+// Each ParallelFor is a job whose tasks the calling thread and the workers
+// it is handed to claim one at a time. A job is queued on the deques of
+// as many workers as may help with it; a worker takes the oldest job on
+// its own deque, and one with none steals from the others. A job is
+// helped by at most its share of the workers, their number over the jobs
+// running, so one wide result does not keep the other streams waiting.
+//
+// A forked child starts workers of its own with its first job.
+class CubeDecodeScheduler {
+public:
+  // The process-wide instance. Its workers start with the first job that
+  // can use them.
+  static CubeDecodeScheduler &Global();
+
+  CubeDecodeScheduler();
+  ~CubeDecodeScheduler();
+
+  CubeDecodeScheduler(const CubeDecodeScheduler &) = delete;
+  CubeDecodeScheduler &operator=(const CubeDecodeScheduler &) = delete;
+
+  // Number of workers, 0 for one per CPU in cpus (or per core if empty),
+  // and the CPUs they may run on, all if empty
+  // @return false, with message set, if the workers have started with
+  //   other settings
+  bool Configure(size_t threads, std::vector<int> cpus, std::string *message);
+
+  // Run fn(0) .. fn(n_tasks - 1) on the calling thread and up to
+  // max_threads - 1 workers, returning once all have run
+  // @return Number of threads that ran tasks
+  template <typename Fn>
+  unsigned ParallelFor(size_t n_tasks, unsigned max_threads, const Fn &fn) {
+    return Run(
+        n_tasks, max_threads,
+        [](const void *context, size_t i) {
+          (*static_cast<const Fn *>(context))(i);
+        },
+        &fn);
+  }
+
+private:
+  using TaskFn = void (*)(const void *context, size_t i);
+  struct Job;
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::thread thread;
+  };
+
+  unsigned Run(size_t n_tasks, unsigned max_threads, TaskFn fn,
+               const void *context);
+  // Start the workers on first use
+  // @return Number of workers running
+  size_t Workers();
+  void WorkerLoop(size_t index);
+  // Next job for worker index: its own oldest, else the newest of another
+  std::shared_ptr<Job> Take(size_t index);
+  void Help(Job *job);
+  static void RunTasks(Job *job);
+  // In a forked child, forget the parent's workers, which did not come
+  // along (mutex_ must be held)
+  void AbandonWorkers();
+
+  std::mutex mutex_; // Never inherited locked (see CubeForkRegisterMutex)
+  // Replaced in a forked child, where the copy still counts the parent's
+  // workers as waiting on it
+  std::unique_ptr<std::condition_variable> cv_ =
+      std::make_unique<std::condition_variable>();
+  std::atomic<uint64_t> fork_generation_; // CubeForkGeneration() of workers_
+  bool stopping_ = false;
+  size_t threads_ = 0;
+  std::vector<int> cpus_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  size_t n_workers_ = 0; // Set before started_
+  std::atomic<bool> started_{false};
+  std::atomic<size_t> queued_{0};      // Jobs on the workers' deques
+  std::atomic<size_t> active_jobs_{0}; // Jobs handed to workers, running
+  std::atomic<size_t> next_worker_{0};
+};
+
+} // namespace adbc::cube
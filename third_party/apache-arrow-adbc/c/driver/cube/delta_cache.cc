@@ -0,0 +1,381 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/delta_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <unordered_set>
+#include <utility>
+
+#include "driver/cube/rechunk_stream.h"
+
+namespace adbc::cube {
+
+std::shared_ptr<const CubeDeltaResult>
+CubeDeltaCache::Find(std::string_view key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  keys_.splice(keys_.begin(), keys_, it->second.key);
+  return it->second.result;
+}
+
+void CubeDeltaCache::Insert(std::string key,
+                            std::shared_ptr<const CubeDeltaResult> result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    Erase(it);
+  }
+  if (result->bytes > max_bytes_) {
+    return;
+  }
+  while (bytes_ + result->bytes > max_bytes_ && !keys_.empty()) {
+    Erase(entries_.find(std::string_view(keys_.back())));
+  }
+  bytes_ += result->bytes;
+  keys_.push_front(std::move(key));
+  entries_.emplace(std::string_view(keys_.front()),
+                   Entry{keys_.begin(), std::move(result)});
+}
+
+void CubeDeltaCache::Erase(std::string_view key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    Erase(it);
+  }
+}
+
+void CubeDeltaCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  keys_.clear();
+  bytes_ = 0;
+}
+
+void CubeDeltaCache::Erase(
+    std::unordered_map<std::string_view, Entry>::iterator it) {
+  auto key = it->second.key;
+  bytes_ -= it->second.result->bytes;
+  entries_.erase(it);
+  keys_.erase(key);
+}
+
+namespace {
+
+// Bytes of the buffers an array view covers, with its children and
+// dictionary
+size_t ViewBytes(const struct ArrowArrayView *view) {
+  size_t bytes = 0;
+  for (const auto &buffer : view->buffer_views) {
+    bytes += static_cast<size_t>(buffer.size_bytes);
+  }
+  for (int32_t i = 0; i < view->n_variadic_buffers; i++) {
+    bytes += static_cast<size_t>(view->variadic_buffer_sizes[i]);
+  }
+  for (int64_t i = 0; i < view->n_children; i++) {
+    bytes += ViewBytes(view->children[i]);
+  }
+  if (view->dictionary) {
+    bytes += ViewBytes(view->dictionary);
+  }
+  return bytes;
+}
+
+// Append the value of row i of a column to a key; false if the column's
+// type cannot be compared this way
+bool AppendKey(const struct ArrowArrayView *column, int64_t i,
+               std::string *key) {
+  if (ArrowArrayViewIsNull(column, i)) {
+    key->push_back('\0');
+    return true;
+  }
+  if (column->dictionary) {
+    return AppendKey(column->dictionary, ArrowArrayViewGetIntUnsafe(column, i),
+                     key);
+  }
+  key->push_back('\1');
+  switch (column->storage_type) {
+  case NANOARROW_TYPE_BOOL:
+    key->push_back(ArrowArrayViewGetIntUnsafe(column, i) != 0 ? '\1' : '\0');
+    return true;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_BINARY_VIEW:
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY: {
+    struct ArrowBufferView value = ArrowArrayViewGetBytesUnsafe(column, i);
+    auto size = static_cast<uint32_t>(value.size_bytes);
+    key->append(reinterpret_cast<const char *>(&size), sizeof(size));
+    key->append(value.data.as_char, static_cast<size_t>(value.size_bytes));
+    return true;
+  }
+  default:
+    break;
+  }
+  // Values of fixed width are compared by their bytes
+  int64_t bits = column->layout.element_size_bits[1];
+  if (column->n_children > 0 ||
+      column->layout.buffer_type[1] != NANOARROW_BUFFER_TYPE_DATA ||
+      bits <= 0 || bits % 8 != 0) {
+    return false;
+  }
+  size_t width = static_cast<size_t>(bits / 8);
+  key->append(column->buffer_views[1].data.as_char +
+                  static_cast<size_t>(column->offset + i) * width,
+              width);
+  return true;
+}
+
+// Reads the key columns of batches of one schema
+class KeyReader {
+public:
+  ~KeyReader() {
+    if (initialized_) {
+      ArrowArrayViewReset(&view_);
+    }
+  }
+
+  ArrowErrorCode Init(const struct ArrowSchema *schema,
+                      const std::vector<std::string> &names,
+                      struct ArrowError *error) {
+    for (const auto &name : names) {
+      int64_t found = -1;
+      for (int64_t i = 0; i < schema->n_children; i++) {
+        const char *child = schema->children[i]->name;
+        if (child && name == child) {
+          found = i;
+          break;
+        }
+      }
+      if (found < 0) {
+        ArrowErrorSet(error, "Delta key column '%s' is not in the result",
+                      name.c_str());
+        return EINVAL;
+      }
+      columns_.push_back(found);
+    }
+    names_ = names;
+    NANOARROW_RETURN_NOT_OK(ArrowArrayViewInitFromSchema(&view_, schema, error));
+    initialized_ = true;
+    return NANOARROW_OK;
+  }
+
+  ArrowErrorCode SetBatch(const struct ArrowArray *batch,
+                          struct ArrowError *error) {
+    return ArrowArrayViewSetArray(&view_, batch, error);
+  }
+
+  // Key of row i of the batch
+  ArrowErrorCode Key(int64_t i, std::string *key, struct ArrowError *error) {
+    key->clear();
+    for (size_t k = 0; k < columns_.size(); k++) {
+      const struct ArrowArrayView *child = view_.children[columns_[k]];
+      if (!AppendKey(child, view_.offset + i, key)) {
+        ArrowErrorSet(error, "Cannot merge a delta on column '%s' of type %s",
+                      names_[k].c_str(), ArrowTypeString(child->storage_type));
+        return ENOTSUP;
+      }
+    }
+    return NANOARROW_OK;
+  }
+
+private:
+  std::vector<std::string> names_;
+  std::vector<int64_t> columns_;
+  struct ArrowArrayView view_;
+  bool initialized_ = false;
+};
+
+bool SameColumns(const struct ArrowSchema *a, const struct ArrowSchema *b) {
+  if (a->n_children != b->n_children) {
+    return false;
+  }
+  for (int64_t i = 0; i < a->n_children; i++) {
+    const struct ArrowSchema *x = a->children[i];
+    const struct ArrowSchema *y = b->children[i];
+    if (std::strcmp(x->format, y->format) != 0 ||
+        std::strcmp(x->name ? x->name : "", y->name ? y->name : "") != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Base segments with the rows whose key is in keys left out
+ArrowErrorCode DropKeys(const CubeDeltaResult &base,
+                        const std::vector<std::string> &names,
+                        const std::unordered_set<std::string> &keys,
+                        std::vector<CubeDeltaSegment> *out,
+                        struct ArrowError *error) {
+  KeyReader reader;
+  NANOARROW_RETURN_NOT_OK(reader.Init(base.schema.get(), names, error));
+  std::string key;
+  for (const auto &segment : base.segments) {
+    NANOARROW_RETURN_NOT_OK(reader.SetBatch(segment.batch->get(), error));
+    int64_t run = segment.offset;
+    const int64_t end = segment.offset + segment.length;
+    for (int64_t i = segment.offset; i < end; i++) {
+      NANOARROW_RETURN_NOT_OK(reader.Key(i, &key, error));
+      if (keys.count(key) == 0) {
+        continue;
+      }
+      if (i > run) {
+        out->push_back({segment.batch, run, i - run});
+      }
+      run = i + 1;
+    }
+    if (end > run) {
+      out->push_back({segment.batch, run, end - run});
+    }
+  }
+  return NANOARROW_OK;
+}
+
+} // namespace
+
+ArrowErrorCode ApplyDelta(const CubeDeltaResult *base, const ResultDelta &delta,
+                          struct ArrowArrayStream *stream,
+                          CubeDeltaResult *out, struct ArrowError *error) {
+  nanoarrow::UniqueArrayStream source;
+  ArrowArrayStreamMove(stream, source.get());
+
+  int code = source->get_schema(source.get(), out->schema.get());
+  std::vector<CubeDeltaSegment> received;
+  while (code == NANOARROW_OK) {
+    auto batch = std::make_shared<nanoarrow::UniqueArray>();
+    code = source->get_next(source.get(), batch->get());
+    if (code != NANOARROW_OK || !(*batch)->release) {
+      break;
+    }
+    if ((*batch)->length > 0) {
+      int64_t length = (*batch)->length;
+      received.push_back({std::move(batch), 0, length});
+    }
+  }
+  if (code != NANOARROW_OK) {
+    const char *message = source->get_last_error(source.get());
+    ArrowErrorSet(error, "%s", message ? message : std::strerror(code));
+    return code;
+  }
+
+  out->version = delta.version;
+  if (delta.merge != DELTA_MERGE_FULL) {
+    if (!base) {
+      ArrowErrorSet(error, "Server sent a delta without a base result");
+      return EINVAL;
+    }
+    if (!SameColumns(base->schema.get(), out->schema.get())) {
+      ArrowErrorSet(error, "Delta columns differ from the base result's");
+      return EINVAL;
+    }
+  }
+  switch (delta.merge) {
+  case DELTA_MERGE_FULL:
+    break;
+  case DELTA_MERGE_TAIL: {
+    if (delta.keep_rows < 0 || delta.keep_rows > base->rows) {
+      ArrowErrorSet(error,
+                    "Delta keeps %" PRId64 " rows of a base result of %" PRId64,
+                    delta.keep_rows, base->rows);
+      return EINVAL;
+    }
+    int64_t remaining = delta.keep_rows;
+    for (const auto &segment : base->segments) {
+      if (remaining == 0) {
+        break;
+      }
+      int64_t length = std::min(segment.length, remaining);
+      out->segments.push_back({segment.batch, segment.offset, length});
+      remaining -= length;
+    }
+    break;
+  }
+  case DELTA_MERGE_UPSERT: {
+    if (delta.key_columns.empty()) {
+      ArrowErrorSet(error, "Server sent an upsert delta without key columns");
+      return EINVAL;
+    }
+    KeyReader reader;
+    NANOARROW_RETURN_NOT_OK(
+        reader.Init(out->schema.get(), delta.key_columns, error));
+    std::unordered_set<std::string> keys;
+    std::string key;
+    for (const auto &segment : received) {
+      NANOARROW_RETURN_NOT_OK(reader.SetBatch(segment.batch->get(), error));
+      for (int64_t i = 0; i < segment.length; i++) {
+        NANOARROW_RETURN_NOT_OK(reader.Key(i, &key, error));
+        keys.insert(key);
+      }
+    }
+    NANOARROW_RETURN_NOT_OK(
+        DropKeys(*base, delta.key_columns, keys, &out->segments, error));
+    break;
+  }
+  default:
+    ArrowErrorSet(error, "Unknown delta merge %d",
+                  static_cast<int>(delta.merge));
+    return EINVAL;
+  }
+  out->segments.insert(out->segments.end(), received.begin(), received.end());
+
+  // Each batch counts once, however many segments are in it
+  std::unordered_set<const struct ArrowArray *> counted;
+  struct ArrowArrayView view;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewInitFromSchema(&view, out->schema.get(), error));
+  for (const auto &segment : out->segments) {
+    out->rows += segment.length;
+    if (!counted.insert(segment.batch->get()).second) {
+      continue;
+    }
+    code = ArrowArrayViewSetArray(&view, segment.batch->get(), error);
+    if (code != NANOARROW_OK) {
+      ArrowArrayViewReset(&view);
+      return code;
+    }
+    out->bytes += ViewBytes(&view);
+  }
+  ArrowArrayViewReset(&view);
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode ExportDeltaResult(const CubeDeltaResult &result,
+                                 struct ArrowArrayStream *out) {
+  nanoarrow::UniqueSchema schema;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaDeepCopy(result.schema.get(),
+                                              schema.get()));
+  NANOARROW_RETURN_NOT_OK(ArrowBasicArrayStreamInit(
+      out, schema.get(), static_cast<int64_t>(result.segments.size())));
+  for (size_t i = 0; i < result.segments.size(); i++) {
+    const CubeDeltaSegment &segment = result.segments[i];
+    struct ArrowArray slice;
+    ExportSlice(segment.batch, segment.offset, segment.length, &slice);
+    ArrowBasicArrayStreamSetArray(out, static_cast<int64_t>(i), &slice);
+  }
+  return NANOARROW_OK;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,105 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/native_protocol.h"
+
+namespace adbc::cube {
+
+// Rows [offset, offset + length) of a decoded batch
+struct CubeDeltaSegment {
+  std::shared_ptr<nanoarrow::UniqueArray> batch;
+  int64_t offset = 0;
+  int64_t length = 0;
+};
+
+// A versioned result as runs of rows of the batches it was built from,
+// which later versions share instead of copying
+struct CubeDeltaResult {
+  std::string version;
+  nanoarrow::UniqueSchema schema;
+  std::vector<CubeDeltaSegment> segments;
+  int64_t rows = 0;
+  size_t bytes = 0; // Buffers of the batches the segments are in
+};
+
+// Versioned results of recent queries, keyed like CubeResultCache and
+// bounded by the size of the batches they hold. Shared by the connections
+// of a database. Thread-safe.
+class CubeDeltaCache {
+public:
+  explicit CubeDeltaCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+  // Result last stored under key, if any
+  std::shared_ptr<const CubeDeltaResult> Find(std::string_view key);
+
+  // Store a result in place of the one under key, evicting the least
+  // recently used ones until it fits; a result larger than the cache is
+  // not stored, and the old one is dropped
+  void Insert(std::string key, std::shared_ptr<const CubeDeltaResult> result);
+
+  void Erase(std::string_view key);
+  void Clear();
+
+  // Count a result built from a delta instead of sent whole
+  void RecordMerge() { merges_.fetch_add(1, std::memory_order_relaxed); }
+  int64_t merges() const { return merges_.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    std::list<std::string>::iterator key;
+    std::shared_ptr<const CubeDeltaResult> result;
+  };
+
+  void Erase(std::unordered_map<std::string_view, Entry>::iterator it);
+
+  size_t max_bytes_;
+  std::mutex mutex_;
+  size_t bytes_ = 0;
+  std::list<std::string> keys_; // Most recently used first
+  // Keys view the strings in keys_, whose nodes never move
+  std::unordered_map<std::string_view, Entry> entries_;
+  std::atomic<int64_t> merges_{0};
+};
+
+// Read a versioned result from stream (released when done) and build the
+// complete result from it and base, as delta describes
+// @param base Result the request named as its base; null if none
+// @return NANOARROW_OK; EINVAL if the delta does not apply to base; the
+//   stream's error code if reading failed
+ArrowErrorCode ApplyDelta(const CubeDeltaResult *base, const ResultDelta &delta,
+                          struct ArrowArrayStream *stream,
+                          CubeDeltaResult *out, struct ArrowError *error);
+
+// A stream of the rows of result, sharing its batches
+ArrowErrorCode ExportDeltaResult(const CubeDeltaResult &result,
+                                 struct ArrowArrayStream *out);
+
+} // namespace adbc::cube
@@ -0,0 +1,253 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/device_stream.h"
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+namespace {
+
+// The source batch and the copies made of its buffers, kept until every
+// array exported from it is released
+struct BatchHolder {
+  ~BatchHolder() {
+    for (const auto &[block, size] : copies) {
+      allocator->free(allocator->user_data, block, size);
+    }
+  }
+
+  nanoarrow::UniqueArray source;
+  std::shared_ptr<const AdbcCubeAllocator> allocator;
+  std::vector<std::pair<void *, size_t>> copies;
+};
+
+// One exported array: its buffers, children and dictionary
+struct ArrayNode {
+  std::shared_ptr<BatchHolder> holder;
+  std::vector<const void *> buffers;
+  std::vector<struct ArrowArray> children;
+  std::vector<struct ArrowArray *> child_pointers;
+  struct ArrowArray dictionary;
+};
+
+void ReleaseNode(struct ArrowArray *array) {
+  auto *node = static_cast<ArrayNode *>(array->private_data);
+  for (auto &child : node->children) {
+    if (child.release) {
+      child.release(&child);
+    }
+  }
+  if (node->dictionary.release) {
+    node->dictionary.release(&node->dictionary);
+  }
+  delete node;
+  array->release = nullptr;
+}
+
+// Bytes of buffer i of the array view describes
+int64_t BufferSize(const struct ArrowArrayView *view, int64_t i) {
+  if (view->storage_type == NANOARROW_TYPE_STRING_VIEW ||
+      view->storage_type == NANOARROW_TYPE_BINARY_VIEW) {
+    if (i < NANOARROW_BINARY_VIEW_FIXED_BUFFERS) {
+      return view->buffer_views[i].size_bytes;
+    }
+    int64_t variadic = i - NANOARROW_BINARY_VIEW_FIXED_BUFFERS;
+    if (variadic == view->n_variadic_buffers) {
+      return view->n_variadic_buffers * int64_t(sizeof(int64_t));
+    }
+    return view->variadic_buffer_sizes[variadic];
+  }
+  return i < NANOARROW_MAX_FIXED_BUFFERS ? view->buffer_views[i].size_bytes
+                                         : -1;
+}
+
+// Export source as out, sharing the buffers within the allocator's blocks
+// and copying the others
+ArrowErrorCode Relocate(const struct ArrowArray *source,
+                        const struct ArrowArrayView *view,
+                        const std::shared_ptr<BatchHolder> &holder,
+                        struct ArrowArray *out, struct ArrowError *error) {
+  const AdbcCubeAllocator &allocator = *holder->allocator;
+  auto node = std::make_unique<ArrayNode>();
+  node->holder = holder;
+  node->dictionary.release = nullptr;
+  for (int64_t i = 0; i < source->n_buffers; i++) {
+    const void *data = source->buffers[i];
+    int64_t size = BufferSize(view, i);
+    if (data == nullptr || size == 0 ||
+        CubeInAllocatorBlock(allocator, data, static_cast<size_t>(size))) {
+      node->buffers.push_back(data);
+      continue;
+    }
+    if (size < 0) {
+      ArrowErrorSet(error, "Cannot tell the size of buffer %d of a %s array",
+                    static_cast<int>(i), ArrowTypeString(view->storage_type));
+      return EINVAL;
+    }
+    void *block = allocator.allocate(allocator.user_data,
+                                     static_cast<size_t>(size), 64);
+    if (block == nullptr) {
+      ArrowErrorSet(error, "Allocator failed to provide %ld bytes",
+                    static_cast<long>(size));
+      return ENOMEM;
+    }
+    holder->copies.emplace_back(block, static_cast<size_t>(size));
+    std::memcpy(block, data, static_cast<size_t>(size));
+    node->buffers.push_back(block);
+  }
+  node->children.resize(source->n_children);
+  for (int64_t i = 0; i < source->n_children; i++) {
+    node->children[i].release = nullptr;
+    node->child_pointers.push_back(&node->children[i]);
+  }
+  out->n_children = source->n_children;
+  out->release = ReleaseNode;
+  out->private_data = node.get();
+  // From here out releases what was built if a child fails
+  ArrowErrorCode code = NANOARROW_OK;
+  for (int64_t i = 0; code == NANOARROW_OK && i < source->n_children; i++) {
+    code = Relocate(source->children[i], view->children[i], holder,
+                    &node->children[i], error);
+  }
+  if (code == NANOARROW_OK && source->dictionary) {
+    code = Relocate(source->dictionary, view->dictionary, holder,
+                    &node->dictionary, error);
+  }
+  if (code != NANOARROW_OK) {
+    node.release();
+    ReleaseNode(out);
+    return code;
+  }
+
+  out->length = source->length;
+  out->null_count = source->null_count;
+  out->offset = source->offset;
+  out->n_buffers = source->n_buffers;
+  out->buffers = node->buffers.data();
+  out->children = node->child_pointers.data();
+  out->dictionary = source->dictionary ? &node->dictionary : nullptr;
+  node.release();
+  return NANOARROW_OK;
+}
+
+class DeviceStream {
+public:
+  DeviceStream(struct ArrowArrayStream *stream,
+               std::shared_ptr<const AdbcCubeAllocator> allocator)
+      : allocator_(std::move(allocator)) {
+    ArrowArrayStreamMove(stream, stream_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *out) {
+    int code = stream_->get_schema(stream_.get(), out);
+    if (code != NANOARROW_OK) {
+      SetError(code);
+    }
+    return code;
+  }
+
+  int GetNext(struct ArrowDeviceArray *out) {
+    std::memset(out, 0, sizeof(*out));
+    out->device_type = allocator_ ? allocator_->device_type : ARROW_DEVICE_CPU;
+    out->device_id = allocator_ ? allocator_->device_id : -1;
+    auto holder = std::make_shared<BatchHolder>();
+    int code = stream_->get_next(stream_.get(), holder->source.get());
+    if (code != NANOARROW_OK) {
+      SetError(code);
+      return code;
+    }
+    if (!allocator_ || !holder->source->release) {
+      ArrowArrayMove(holder->source.get(), &out->array);
+      return NANOARROW_OK;
+    }
+    struct ArrowError error;
+    std::memset(&error, 0, sizeof(error));
+    if (!view_initialized_) {
+      nanoarrow::UniqueSchema schema;
+      code = GetSchema(schema.get());
+      if (code != NANOARROW_OK) {
+        return code;
+      }
+      code = ArrowArrayViewInitFromSchema(view_.get(), schema.get(), &error);
+      if (code != NANOARROW_OK) {
+        last_error_ = error.message;
+        return code;
+      }
+      view_initialized_ = true;
+    }
+    holder->allocator = allocator_;
+    code = ArrowArrayViewSetArray(view_.get(), holder->source.get(), &error);
+    if (code == NANOARROW_OK) {
+      code = Relocate(holder->source.get(), view_.get(), holder, &out->array,
+                      &error);
+    }
+    if (code != NANOARROW_OK) {
+      last_error_ = error.message;
+    }
+    return code;
+  }
+
+  const char *GetLastError() const {
+    return last_error_.empty() ? nullptr : last_error_.c_str();
+  }
+
+private:
+  void SetError(int code) {
+    const char *message = stream_->get_last_error(stream_.get());
+    last_error_ = message ? message : std::strerror(code);
+  }
+
+  nanoarrow::UniqueArrayStream stream_;
+  std::shared_ptr<const AdbcCubeAllocator> allocator_;
+  nanoarrow::UniqueArrayView view_;
+  bool view_initialized_ = false;
+  std::string last_error_;
+};
+
+} // namespace
+
+void ExportDeviceStream(struct ArrowArrayStream *stream,
+                        std::shared_ptr<const AdbcCubeAllocator> allocator,
+                        struct ArrowDeviceArrayStream *out) {
+  out->device_type = allocator ? allocator->device_type : ARROW_DEVICE_CPU;
+  out->get_schema = [](struct ArrowDeviceArrayStream *self,
+                       struct ArrowSchema *schema) {
+    return static_cast<DeviceStream *>(self->private_data)->GetSchema(schema);
+  };
+  out->get_next = [](struct ArrowDeviceArrayStream *self,
+                     struct ArrowDeviceArray *array) {
+    return static_cast<DeviceStream *>(self->private_data)->GetNext(array);
+  };
+  out->get_last_error = [](struct ArrowDeviceArrayStream *self) {
+    return static_cast<DeviceStream *>(self->private_data)->GetLastError();
+  };
+  out->release = [](struct ArrowDeviceArrayStream *self) {
+    delete static_cast<DeviceStream *>(self->private_data);
+    self->private_data = nullptr;
+    self->release = nullptr;
+  };
+  out->private_data = new DeviceStream(stream, std::move(allocator));
+}
+
+} // namespace adbc::cube
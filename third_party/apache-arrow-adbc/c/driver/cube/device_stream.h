@@ -0,0 +1,38 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <memory>
+
+#include <arrow-adbc/driver/cube.h>
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/buffer_pool.h"
+
+namespace adbc::cube {
+
+/// Take over stream and export it as a device stream of allocator's memory
+/// (see AdbcCubeAllocator), for consumers that copy batches to a GPU. Each
+/// buffer of a batch that does not lie within a block of allocator is
+/// copied into one as the batch is returned; the others are shared. A null
+/// allocator exports the batches as they are, as ARROW_DEVICE_CPU.
+void ExportDeviceStream(struct ArrowArrayStream *stream,
+                        std::shared_ptr<const AdbcCubeAllocator> allocator,
+                        struct ArrowDeviceArrayStream *out);
+
+} // namespace adbc::cube
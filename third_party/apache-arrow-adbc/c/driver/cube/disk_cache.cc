@@ -0,0 +1,627 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/disk_cache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <utility>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "driver/cube/log.h"
+#include "driver/cube/result_cache.h"
+
+namespace adbc::cube {
+
+#if defined(__linux__) || defined(__APPLE__)
+
+namespace {
+
+constexpr uint64_t kFileMagic = 0x4b53494445425543; // "CUBEDISK"
+constexpr uint32_t kLayoutVersion = 2;
+
+// The payload starts on this boundary, as result messages must
+constexpr size_t kAlignment = 64;
+
+constexpr std::string_view kResultSuffix = ".result";
+constexpr std::string_view kSnapshotSuffix = ".snapshot";
+// Files being written are named tmp.<pid of the writer>.<rest>
+constexpr std::string_view kTempPrefix = "tmp.";
+// Written under the name kept before temporary names held the pid
+constexpr std::string_view kOldTempSuffix = ".tmp";
+// A temporary file this old is a leftover even if its pid is running,
+// which it may be after the pid was reused
+constexpr std::chrono::hours kTempMaxAge{1};
+
+// File holding the secret entries' checks are keyed with, and its size
+constexpr std::string_view kSecretName = "secret";
+constexpr size_t kSecretSize = 32;
+
+// Start of an entry's file, followed by the data model version and, from
+// payload_offset, the payload
+struct FileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t kind;
+  uint64_t digest[2]; // MurmurHash3 of the key, naming the file
+  uint64_t check[2];  // Of the secret and the key, checked on a hit
+  int64_t stored_ms;
+  uint64_t model_version_size;
+  uint64_t payload_offset;
+  uint64_t payload_size;
+};
+
+size_t Align(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// Name of the file of a result's or a snapshot's entry
+std::string FileName(const CubeSqlFingerprint &digest, bool result) {
+  return digest.ToHex() +
+         std::string(result ? kResultSuffix : kSnapshotSuffix);
+}
+
+bool EndsWith(std::string_view value, std::string_view suffix) {
+  return value.size() >= suffix.size() &&
+         value.substr(value.size() - suffix.size()) == suffix;
+}
+
+// Name of a file the calling process writes before renaming or linking
+// it, unique among the processes using the directory
+std::string TempName(std::string_view rest) {
+  return std::string(kTempPrefix) + std::to_string(getpid()) + "." +
+         std::string(rest);
+}
+
+bool IsTempName(const std::string &name) {
+  return name.compare(0, kTempPrefix.size(), kTempPrefix) == 0 ||
+         EndsWith(name, kOldTempSuffix);
+}
+
+// Whether the temporary file name is one no writer is still filling: its
+// process has exited, or it was left for longer than any write takes (the
+// only test for those without a pid)
+bool IsAbandonedTemp(const std::string &path, const std::string &name) {
+  bool temp = name.compare(0, kTempPrefix.size(), kTempPrefix) == 0;
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) {
+    return false;
+  }
+  if (std::chrono::system_clock::now() -
+          std::chrono::system_clock::from_time_t(st.st_mtime) >=
+      kTempMaxAge) {
+    return true;
+  }
+  if (!temp) {
+    return false;
+  }
+  char *end = nullptr;
+  unsigned long long pid =
+      std::strtoull(name.c_str() + kTempPrefix.size(), &end, 10);
+  if (end == name.c_str() + kTempPrefix.size() || *end != '.' ||
+      pid == 0 || pid > static_cast<unsigned long long>(INT_MAX)) {
+    return true;
+  }
+  // EPERM: the process exists, run by another user
+  return kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+}
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Read the header and data model version of the file at fd, checking that
+// the file holds all of its payload
+bool ReadHeader(int fd, size_t file_size, FileHeader *header,
+                std::string *model_version) {
+  if (file_size < sizeof(*header) ||
+      pread(fd, header, sizeof(*header), 0) !=
+          static_cast<ssize_t>(sizeof(*header))) {
+    return false;
+  }
+  if (header->magic != kFileMagic || header->version != kLayoutVersion ||
+      header->model_version_size > file_size - sizeof(*header) ||
+      header->payload_offset > file_size ||
+      header->payload_size > file_size - header->payload_offset) {
+    return false;
+  }
+  model_version->resize(header->model_version_size);
+  return pread(fd, model_version->data(), model_version->size(),
+               sizeof(*header)) ==
+         static_cast<ssize_t>(model_version->size());
+}
+
+// Make a secret and write it to path unless a file is there already,
+// through a temporary file linked into place, so that it is never found
+// half written and the first of several processes making one wins
+// @return 0, EEXIST if path was there already, or an errno value
+int WriteSecret(const std::string &dir, const std::string &path,
+                std::string *secret) {
+  std::random_device random;
+  for (size_t i = 0; i < kSecretSize; i += sizeof(uint32_t)) {
+    uint32_t value = random();
+    std::memcpy(secret->data() + i, &value, sizeof(value));
+  }
+  std::string temp_path = dir + "/" + TempName(kSecretName);
+  int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    // Left by an earlier process with the same pid
+    unlink(temp_path.c_str());
+    fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+  }
+  if (fd < 0) {
+    return errno;
+  }
+  bool written = write(fd, secret->data(), kSecretSize) ==
+                 static_cast<ssize_t>(kSecretSize);
+  int code = written ? 0 : errno ? errno : EIO;
+  close(fd);
+  if (code == 0 && link(temp_path.c_str(), path.c_str()) != 0) {
+    code = errno;
+  }
+  unlink(temp_path.c_str());
+  return code;
+}
+
+// Read the secret of dir, making it first if it is missing. One cut short
+// (by a crash while an older version wrote it) is replaced.
+int ReadSecret(const std::string &dir, std::string *secret) {
+  std::string path = dir + "/" + std::string(kSecretName);
+  secret->assign(kSecretSize, '\0');
+  for (int attempt = 0; attempt < 3; attempt++) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      ssize_t read_size = pread(fd, secret->data(), kSecretSize, 0);
+      close(fd);
+      if (read_size == static_cast<ssize_t>(kSecretSize)) {
+        return 0;
+      }
+      unlink(path.c_str());
+    } else if (errno != ENOENT) {
+      return errno;
+    }
+    int code = WriteSecret(dir, path, secret);
+    if (code != EEXIST) {
+      return code;
+    }
+    // Another process made one first; use it
+  }
+  return EAGAIN;
+}
+
+// Caches open in this process, by canonical directory
+struct OpenCaches {
+  std::mutex mutex;
+  std::unordered_map<std::string, std::weak_ptr<CubeDiskCache>> caches;
+};
+
+// Never destroyed, so that caches released during exit still find it
+OpenCaches &Registry() {
+  static auto *registry = new OpenCaches();
+  return *registry;
+}
+
+} // namespace
+
+bool DiskCacheAvailable() { return true; }
+
+CubeDiskCache::CubeDiskCache(std::string dir, size_t max_bytes,
+                             std::chrono::milliseconds ttl)
+    : dir_(std::move(dir)), max_bytes_(max_bytes), ttl_(ttl) {}
+
+CubeDiskCache::~CubeDiskCache() = default;
+
+int CubeDiskCache::Open(const std::string &dir, size_t max_bytes,
+                        std::chrono::milliseconds ttl,
+                        std::shared_ptr<CubeDiskCache> *out) {
+  if (dir.empty()) {
+    return EINVAL;
+  }
+  if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+    return errno;
+  }
+  char resolved[PATH_MAX];
+  if (!realpath(dir.c_str(), resolved)) {
+    return errno;
+  }
+  std::string canonical = resolved;
+
+  // One cache per directory, so that the budget covers all of its files
+  auto &registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (auto it = registry.caches.begin(); it != registry.caches.end();) {
+    if (it->second.expired()) {
+      it = registry.caches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  auto found = registry.caches.find(canonical);
+  if (found != registry.caches.end()) {
+    std::shared_ptr<CubeDiskCache> cache = found->second.lock();
+    if (cache->max_bytes_ != max_bytes || cache->ttl_ != ttl) {
+      CUBE_LOG(Warn, "DiskCache",
+               "Disk cache already open with other settings; keeping them",
+               {{"dir", canonical},
+                {"max_bytes", static_cast<int64_t>(cache->max_bytes_)},
+                {"ttl_ms", static_cast<int64_t>(cache->ttl_.count())}});
+    }
+    *out = std::move(cache);
+    return 0;
+  }
+  std::shared_ptr<CubeDiskCache> cache(
+      new CubeDiskCache(canonical, max_bytes, ttl));
+  int code = cache->Load();
+  if (code != 0) {
+    return code;
+  }
+  registry.caches.emplace(std::move(canonical), cache);
+  *out = std::move(cache);
+  return 0;
+}
+
+std::string CubeDiskCache::PathOf(const std::string &name) const {
+  return dir_ + "/" + name;
+}
+
+CubeSqlFingerprint CubeDiskCache::Check(std::string_view key) const {
+  std::string keyed = secret_;
+  keyed.append(key);
+  return CubeMurmurHash3(keyed);
+}
+
+int CubeDiskCache::Load() {
+  int code = ReadSecret(dir_, &secret_);
+  if (code != 0) {
+    return code;
+  }
+  DIR *listing = opendir(dir_.c_str());
+  if (!listing) {
+    return errno;
+  }
+  struct Found {
+    std::string name;
+    Entry entry;
+  };
+  std::vector<Found> found;
+  int64_t now = NowMs();
+  while (struct dirent *item = readdir(listing)) {
+    std::string name = item->d_name;
+    if (IsTempName(name)) {
+      if (IsAbandonedTemp(PathOf(name), name)) {
+        // A write a process did not finish
+        unlink(PathOf(name).c_str());
+      }
+      continue;
+    }
+    if (!EndsWith(name, kResultSuffix) && !EndsWith(name, kSnapshotSuffix)) {
+      continue;
+    }
+    int fd = open(PathOf(name).c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+    struct stat st;
+    FileHeader header{};
+    Entry entry;
+    bool valid = fstat(fd, &st) == 0 && st.st_size > 0 &&
+                 ReadHeader(fd, static_cast<size_t>(st.st_size), &header,
+                            &entry.version);
+    close(fd);
+    if (valid) {
+      bool result = header.kind == static_cast<uint32_t>(Kind::Result);
+      CubeSqlFingerprint digest{header.digest[0], header.digest[1]};
+      valid = FileName(digest, result) == name;
+    }
+    if (!valid ||
+        (ttl_.count() > 0 && now - header.stored_ms >= ttl_.count())) {
+      unlink(PathOf(name).c_str());
+      continue;
+    }
+    entry.stored_ms = header.stored_ms;
+    entry.bytes = static_cast<size_t>(st.st_size);
+    found.push_back(Found{std::move(name), std::move(entry)});
+  }
+  closedir(listing);
+
+  // Most recently stored first, standing in for most recently used
+  std::sort(found.begin(), found.end(), [](const Found &a, const Found &b) {
+    return a.entry.stored_ms > b.entry.stored_ms;
+  });
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &item : found) {
+    if (bytes_ + item.entry.bytes > max_bytes_) {
+      unlink(PathOf(item.name).c_str());
+      continue;
+    }
+    bytes_ += item.entry.bytes;
+    item.entry.lru = lru_.insert(lru_.end(), item.name);
+    entries_.emplace(std::move(item.name), std::move(item.entry));
+  }
+  CUBE_LOG(Info, "DiskCache", "Opened disk cache",
+           {{"dir", dir_},
+            {"entries", static_cast<int64_t>(entries_.size())},
+            {"bytes", static_cast<int64_t>(bytes_)}});
+  return 0;
+}
+
+void CubeDiskCache::Remove(const std::string &name) {
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return;
+  }
+  // Mappings already made stay valid once the file is unlinked
+  unlink(PathOf(name).c_str());
+  bytes_ -= it->second.bytes;
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+std::shared_ptr<const void>
+CubeDiskCache::Map(Kind kind, std::string_view key,
+                   std::string_view model_version, const uint8_t **payload,
+                   size_t *size, CubeSqlFingerprint *digest) {
+  *digest = CubeMurmurHash3(key);
+  CubeSqlFingerprint check = Check(key);
+  std::string name = FileName(*digest, kind == Kind::Result);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  if (it->second.version != model_version ||
+      (ttl_.count() > 0 && NowMs() - it->second.stored_ms >= ttl_.count())) {
+    Remove(name);
+    return nullptr;
+  }
+  int fd = open(PathOf(name).c_str(), O_RDONLY);
+  if (fd < 0) {
+    Remove(name);
+    return nullptr;
+  }
+  struct stat st;
+  FileHeader header{};
+  std::string version;
+  // The file is checked again, as another process using the directory
+  // may have replaced it since it was indexed
+  if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+      !ReadHeader(fd, static_cast<size_t>(st.st_size), &header, &version) ||
+      version != model_version || header.kind != static_cast<uint32_t>(kind) ||
+      header.digest[0] != digest->high || header.digest[1] != digest->low ||
+      header.check[0] != check.high || header.check[1] != check.low) {
+    close(fd);
+    Remove(name);
+    return nullptr;
+  }
+  size_t file_size = static_cast<size_t>(st.st_size);
+  bytes_ += file_size - it->second.bytes;
+  it->second.bytes = file_size;
+  void *addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.lru);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  *payload = static_cast<const uint8_t *>(addr) + header.payload_offset;
+  *size = header.payload_size;
+  return std::shared_ptr<const void>(addr, [file_size](const void *data) {
+    munmap(const_cast<void *>(data), file_size);
+  });
+}
+
+template <typename Write>
+void CubeDiskCache::Store(Kind kind, std::string_view key,
+                          std::string_view model_version, size_t payload_size,
+                          Write &&write) {
+  FileHeader header{};
+  header.magic = kFileMagic;
+  header.version = kLayoutVersion;
+  header.kind = static_cast<uint32_t>(kind);
+  CubeSqlFingerprint digest = CubeMurmurHash3(key);
+  CubeSqlFingerprint check = Check(key);
+  header.digest[0] = digest.high;
+  header.digest[1] = digest.low;
+  header.check[0] = check.high;
+  header.check[1] = check.low;
+  header.stored_ms = NowMs();
+  header.model_version_size = model_version.size();
+  header.payload_offset =
+      Align(sizeof(header) + model_version.size(), kAlignment);
+  header.payload_size = payload_size;
+  size_t file_size = header.payload_offset + payload_size;
+  if (file_size > max_bytes_) {
+    return;
+  }
+  std::string name = FileName(digest, kind == Kind::Result);
+  uint64_t temp;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    temp = next_temp_++;
+  }
+  std::string temp_path =
+      PathOf(TempName(std::to_string(temp) + "." + name));
+
+  // Written outside the lock, so that hits are not held up behind it
+  int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    CUBE_LOG(Warn, "DiskCache", "Cannot write disk cache entry",
+             {{"path", temp_path}, {"error", std::strerror(errno)}});
+    return;
+  }
+  void *addr = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(file_size)) == 0) {
+    addr = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                0);
+  }
+  close(fd);
+  if (addr == MAP_FAILED) {
+    CUBE_LOG(Warn, "DiskCache", "Cannot write disk cache entry",
+             {{"path", temp_path}, {"error", std::strerror(errno)}});
+    unlink(temp_path.c_str());
+    return;
+  }
+  // Padding is left as ftruncate zeroed it
+  auto *data = static_cast<uint8_t *>(addr);
+  std::memcpy(data, &header, sizeof(header));
+  std::memcpy(data + sizeof(header), model_version.data(),
+              model_version.size());
+  write(data + header.payload_offset);
+  munmap(addr, file_size);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (rename(temp_path.c_str(), PathOf(name).c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return;
+  }
+  // The rename replaced the file of an entry already stored under key
+  auto it = entries_.find(name);
+  if (it != entries_.end()) {
+    bytes_ -= it->second.bytes;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+  }
+  while (bytes_ + file_size > max_bytes_ && !lru_.empty()) {
+    Remove(lru_.back());
+  }
+  Entry entry;
+  entry.version = std::string(model_version);
+  entry.stored_ms = header.stored_ms;
+  entry.bytes = file_size;
+  entry.lru = lru_.insert(lru_.begin(), name);
+  bytes_ += file_size;
+  entries_.emplace(std::move(name), std::move(entry));
+}
+
+bool CubeDiskCache::Find(std::string_view key, std::string_view model_version,
+                         CubeSharedResult *out) {
+  const uint8_t *payload = nullptr;
+  size_t size = 0;
+  CubeSqlFingerprint digest;
+  auto mapping =
+      Map(Kind::Result, key, model_version, &payload, &size, &digest);
+  return mapping &&
+         ReadResultImage(std::move(mapping), payload, size, digest, out);
+}
+
+void CubeDiskCache::Insert(std::string_view key,
+                           std::string_view model_version,
+                           const CubeCachedResult &result) {
+  CubeSqlFingerprint digest = CubeMurmurHash3(key);
+  Store(Kind::Result, key, model_version, CubeResultImageSize(result),
+        [&](uint8_t *out) { WriteResultImage(digest, result, out); });
+}
+
+bool CubeDiskCache::FindSnapshot(std::string_view key,
+                                 std::string_view model_version,
+                                 std::vector<uint8_t> *out) {
+  const uint8_t *payload = nullptr;
+  size_t size = 0;
+  CubeSqlFingerprint digest;
+  auto mapping =
+      Map(Kind::Snapshot, key, model_version, &payload, &size, &digest);
+  if (!mapping) {
+    return false;
+  }
+  out->assign(payload, payload + size);
+  return true;
+}
+
+void CubeDiskCache::InsertSnapshot(std::string_view key,
+                                   std::string_view model_version,
+                                   const std::vector<uint8_t> &snapshot) {
+  Store(Kind::Snapshot, key, model_version, snapshot.size(),
+        [&](uint8_t *out) {
+          if (!snapshot.empty()) {
+            std::memcpy(out, snapshot.data(), snapshot.size());
+          }
+        });
+}
+
+void CubeDiskCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!lru_.empty()) {
+    Remove(lru_.back());
+  }
+}
+
+size_t CubeDiskCache::entries() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+size_t CubeDiskCache::bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+#else
+
+bool DiskCacheAvailable() { return false; }
+
+CubeDiskCache::CubeDiskCache(std::string dir, size_t max_bytes,
+                             std::chrono::milliseconds ttl)
+    : dir_(std::move(dir)), max_bytes_(max_bytes), ttl_(ttl) {}
+
+CubeDiskCache::~CubeDiskCache() = default;
+
+int CubeDiskCache::Open(const std::string &, size_t,
+                        std::chrono::milliseconds,
+                        std::shared_ptr<CubeDiskCache> *) {
+  return ENOTSUP;
+}
+
+bool CubeDiskCache::Find(std::string_view, std::string_view,
+                         CubeSharedResult *) {
+  return false;
+}
+
+void CubeDiskCache::Insert(std::string_view, std::string_view,
+                           const CubeCachedResult &) {}
+
+bool CubeDiskCache::FindSnapshot(std::string_view, std::string_view,
+                                 std::vector<uint8_t> *) {
+  return false;
+}
+
+void CubeDiskCache::InsertSnapshot(std::string_view, std::string_view,
+                                   const std::vector<uint8_t> &) {}
+
+void CubeDiskCache::Clear() {}
+
+size_t CubeDiskCache::entries() { return 0; }
+
+size_t CubeDiskCache::bytes() { return 0; }
+
+#endif
+
+} // namespace adbc::cube
@@ -0,0 +1,161 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "driver/cube/shared_result_cache.h"
+#include "driver/cube/sql_fingerprint.h"
+
+namespace adbc::cube {
+
+struct CubeCachedResult;
+
+/// Whether this build can keep results on disk (POSIX files and mmap)
+bool DiskCacheAvailable();
+
+/// Results of recent queries, and metadata snapshots, kept in files in a
+/// directory so that they outlive the process: a node restarted after a
+/// deploy answers the dashboards it served before from them, instead of
+/// starting cold.
+///
+/// Each entry is a file of its own, named after a 128-bit MurmurHash3 of
+/// its key (the key itself, which holds the token, is never written), with
+/// a header giving the data model version the server reported when it was
+/// stored. The header also holds a second hash, of the key after a random
+/// secret kept in the directory, checked on every hit, so that an entry is
+/// only served for the key it was stored under.
+/// A result's messages follow as laid out by WriteResultImage, so a hit
+/// maps the file and decodes them in place. Files are written under a
+/// temporary name holding the writer's pid and renamed, so a reader never
+/// sees one half written; opening the cache removes only the temporary
+/// files of processes that have exited, or that are over an hour old.
+///
+/// The index of entries is rebuilt from the file headers when the cache is
+/// opened, and kept in memory after that. An entry is only returned while
+/// the server reports the data model version it was stored under, and
+/// while it is younger than the ttl; one found stale is removed. Entries
+/// are evicted least recently used first once their bytes exceed the
+/// budget. The databases of a process that open the same directory share
+/// one cache, with the budget and ttl of the first to open it. Processes
+/// may share a directory too, but each keeps to the budget on its own,
+/// counting the files it stored or found when it opened the directory.
+/// Thread-safe.
+class CubeDiskCache {
+public:
+  /// Open the cache in dir, creating the directory if needed and indexing
+  /// the entries already there (removing those over the budget); the
+  /// cache this process already has open there if there is one
+  /// @return 0, or an errno value
+  static int Open(const std::string &dir, size_t max_bytes,
+                  std::chrono::milliseconds ttl,
+                  std::shared_ptr<CubeDiskCache> *out);
+
+  ~CubeDiskCache();
+  CubeDiskCache(const CubeDiskCache &) = delete;
+  CubeDiskCache &operator=(const CubeDiskCache &) = delete;
+
+  size_t max_bytes() const { return max_bytes_; }
+
+  /// Result stored under key, if it was stored under model_version and
+  /// has not expired
+  bool Find(std::string_view key, std::string_view model_version,
+            CubeSharedResult *out);
+
+  /// Store a result; one larger than the budget is not stored
+  void Insert(std::string_view key, std::string_view model_version,
+              const CubeCachedResult &result);
+
+  /// Metadata snapshot stored under key, as Find
+  bool FindSnapshot(std::string_view key, std::string_view model_version,
+                    std::vector<uint8_t> *out);
+
+  /// Store a metadata snapshot
+  void InsertSnapshot(std::string_view key, std::string_view model_version,
+                      const std::vector<uint8_t> &snapshot);
+
+  /// Remove every entry
+  void Clear();
+
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+  /// Entries and bytes held
+  size_t entries();
+  size_t bytes();
+
+private:
+  enum class Kind : uint32_t { Result = 1, Snapshot = 2 };
+
+  struct Entry {
+    std::string version; // Data model version stored under
+    int64_t stored_ms;   // Since the Unix epoch
+    size_t bytes;        // Of the file
+    std::list<std::string>::iterator lru;
+  };
+
+  CubeDiskCache(std::string dir, size_t max_bytes,
+                std::chrono::milliseconds ttl);
+
+  /// Index the entries in dir_, removing leftovers of interrupted writes
+  int Load();
+
+  /// Path of the file holding the entry named name
+  std::string PathOf(const std::string &name) const;
+
+  /// Hash of key keyed with secret_, checked against an entry's header
+  CubeSqlFingerprint Check(std::string_view key) const;
+
+  /// Map the file of the entry of kind under key if it is still valid,
+  /// counting a hit; null otherwise, having removed a stale one
+  std::shared_ptr<const void> Map(Kind kind, std::string_view key,
+                                  std::string_view model_version,
+                                  const uint8_t **payload, size_t *size,
+                                  CubeSqlFingerprint *digest);
+
+  /// Write an entry of kind, the payload_size bytes write lays out
+  /// (zeroed beforehand), and index it
+  template <typename Write>
+  void Store(Kind kind, std::string_view key, std::string_view model_version,
+             size_t payload_size, Write &&write);
+
+  /// Drop an entry from the index and remove its file; mutex_ is held
+  void Remove(const std::string &name);
+
+  const std::string dir_;
+  const size_t max_bytes_;
+  const std::chrono::milliseconds ttl_;
+  std::string secret_; // Read by Load, then constant
+  std::mutex mutex_; // Guards the members below
+  std::unordered_map<std::string, Entry> entries_; // By file name
+  std::list<std::string> lru_;                     // Most recent first
+  size_t bytes_ = 0;
+  uint64_t next_temp_ = 0;
+  std::atomic<int64_t> hits_{0};
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,182 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of CubeDiskCache with a directory used by several caches at once:
+// databases of one process sharing a cache, temporary files of live
+// writers surviving another open, and processes racing to make the
+// secret.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "driver/cube/disk_cache.h"
+#include "driver/cube/result_cache.h"
+
+namespace adbc::cube {
+
+#if defined(__linux__) || defined(__APPLE__)
+
+namespace {
+
+constexpr std::chrono::milliseconds kNoTtl{0};
+
+CubeCachedResult MakeResult(size_t bytes) {
+  CubeCachedResult result;
+  result.schema_message.assign(64, 7);
+  result.batches.emplace_back();
+  result.batches.back().assign(bytes, 9);
+  result.bytes = 64 + bytes;
+  return result;
+}
+
+bool Exists(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0;
+}
+
+void Touch(const std::string &path) { std::ofstream(path) << "partial"; }
+
+class CubeDiskCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir[] = "/tmp/cube-disk-cache-XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    dir_ = dir;
+  }
+  void TearDown() override {
+    ASSERT_EQ(std::system(("rm -rf " + dir_).c_str()), 0);
+  }
+
+  std::string dir_;
+};
+
+} // namespace
+
+TEST_F(CubeDiskCacheTest, SharedWithinProcess) {
+  std::shared_ptr<CubeDiskCache> first;
+  std::shared_ptr<CubeDiskCache> second;
+  ASSERT_EQ(CubeDiskCache::Open(dir_, 4096, kNoTtl, &first), 0);
+  // The same directory, however spelled, and whatever budget is asked
+  ASSERT_EQ(CubeDiskCache::Open(dir_ + "/./", 1 << 20, kNoTtl, &second), 0);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(second->max_bytes(), 4096u);
+
+  // So one budget covers every file, and both see every entry
+  first->Insert("a", "v1", MakeResult(1500));
+  second->Insert("b", "v1", MakeResult(1500));
+  second->Insert("c", "v1", MakeResult(1500));
+  EXPECT_EQ(first->entries(), 2u);
+  EXPECT_LE(first->bytes(), 4096u);
+  CubeSharedResult out;
+  EXPECT_FALSE(first->Find("a", "v1", &out));
+  EXPECT_TRUE(first->Find("c", "v1", &out));
+
+  // Once both are released, the next open indexes the files afresh
+  first.reset();
+  second.reset();
+  ASSERT_EQ(CubeDiskCache::Open(dir_, 1 << 20, kNoTtl, &first), 0);
+  EXPECT_EQ(first->max_bytes(), size_t{1} << 20);
+  EXPECT_EQ(first->entries(), 2u);
+}
+
+TEST_F(CubeDiskCacheTest, KeepsTempFilesOfLiveWriters) {
+  // This process is alive; a child that has exited is not
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    _exit(0);
+  }
+  ASSERT_EQ(waitpid(child, nullptr, 0), child);
+
+  std::string live = dir_ + "/tmp." + std::to_string(getpid()) + ".0.x.result";
+  std::string dead = dir_ + "/tmp." + std::to_string(child) + ".0.x.result";
+  std::string old_secret = dir_ + "/tmp." + std::to_string(child) + ".secret";
+  std::string old_layout = dir_ + "/x.result.0.tmp";
+  for (const auto &path : {live, dead, old_secret, old_layout}) {
+    Touch(path);
+  }
+
+  std::shared_ptr<CubeDiskCache> cache;
+  ASSERT_EQ(CubeDiskCache::Open(dir_, 1 << 20, kNoTtl, &cache), 0);
+  EXPECT_TRUE(Exists(live));
+  EXPECT_FALSE(Exists(dead));
+  EXPECT_FALSE(Exists(old_secret));
+  // Without a pid, only removed once old
+  EXPECT_TRUE(Exists(old_layout));
+  EXPECT_EQ(cache->entries(), 0u);
+}
+
+TEST_F(CubeDiskCacheTest, IgnoresMalformedFiles) {
+  // Too short for a header, and a header of another layout
+  Touch(dir_ + "/0123.result");
+  std::ofstream(dir_ + "/4567.snapshot") << std::string(256, 'x');
+  std::shared_ptr<CubeDiskCache> cache;
+  ASSERT_EQ(CubeDiskCache::Open(dir_, 1 << 20, kNoTtl, &cache), 0);
+  EXPECT_EQ(cache->entries(), 0u);
+  EXPECT_FALSE(Exists(dir_ + "/0123.result"));
+  EXPECT_FALSE(Exists(dir_ + "/4567.snapshot"));
+}
+
+TEST_F(CubeDiskCacheTest, ProcessesShareSecret) {
+  // Processes opening a fresh directory at once all succeed, and agree on
+  // the secret: what one stores, the others find
+  constexpr int kProcesses = 8;
+  std::vector<pid_t> children;
+  for (int i = 0; i < kProcesses; i++) {
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+      std::shared_ptr<CubeDiskCache> cache;
+      if (CubeDiskCache::Open(dir_, 1 << 20, kNoTtl, &cache) != 0) {
+        _exit(1);
+      }
+      cache->Insert("key " + std::to_string(i), "v1", MakeResult(100));
+      _exit(0);
+    }
+    children.push_back(child);
+  }
+  for (pid_t child : children) {
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  std::shared_ptr<CubeDiskCache> cache;
+  ASSERT_EQ(CubeDiskCache::Open(dir_, 1 << 20, kNoTtl, &cache), 0);
+  EXPECT_EQ(cache->entries(), static_cast<size_t>(kProcesses));
+  CubeSharedResult out;
+  for (int i = 0; i < kProcesses; i++) {
+    EXPECT_TRUE(cache->Find("key " + std::to_string(i), "v1", &out)) << i;
+  }
+}
+
+#endif
+
+} // namespace adbc::cube
@@ -0,0 +1,233 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/endpoints.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "driver/cube/string_dictionary.h"
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr std::string_view kUnixPrefix = "unix://";
+
+// Weight of the newest sample in the latency average
+constexpr double kLatencyWeight = 0.3;
+
+std::string_view Trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+bool IsPort(std::string_view s) {
+  return !s.empty() && s.size() <= 5 &&
+         std::all_of(s.begin(), s.end(),
+                     [](char c) { return c >= '0' && c <= '9'; });
+}
+
+} // namespace
+
+bool ParseEndpoints(std::string_view list, const std::string &default_port,
+                    std::vector<CubeEndpoint> *out, std::string *message) {
+  std::vector<CubeEndpoint> endpoints;
+  while (true) {
+    size_t comma = list.find(',');
+    std::string_view entry = Trim(list.substr(0, comma));
+    if (!entry.empty()) {
+      CubeEndpoint endpoint;
+      endpoint.port = default_port;
+      if (entry.substr(0, kUnixPrefix.size()) == kUnixPrefix) {
+        endpoint.host = std::string(entry);
+      } else if (entry.front() == '[') {
+        size_t close = entry.find(']');
+        std::string_view rest =
+            close == std::string_view::npos ? "" : entry.substr(close + 1);
+        if (close == std::string_view::npos || close == 1 ||
+            (!rest.empty() && (rest[0] != ':' || !IsPort(rest.substr(1))))) {
+          *message = "invalid endpoint '" + std::string(entry) + "'";
+          return false;
+        }
+        endpoint.host = std::string(entry.substr(1, close - 1));
+        if (!rest.empty()) {
+          endpoint.port = std::string(rest.substr(1));
+        }
+      } else if (entry.find(':') != entry.rfind(':')) {
+        // A bare IPv6 address, which cannot carry a port
+        endpoint.host = std::string(entry);
+      } else {
+        size_t colon = entry.rfind(':');
+        if (colon != std::string_view::npos) {
+          if (colon == 0 || !IsPort(entry.substr(colon + 1))) {
+            *message = "invalid endpoint '" + std::string(entry) + "'";
+            return false;
+          }
+          endpoint.port = std::string(entry.substr(colon + 1));
+        }
+        endpoint.host = std::string(entry.substr(0, colon));
+      }
+      endpoints.push_back(std::move(endpoint));
+    }
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    list.remove_prefix(comma + 1);
+  }
+  if (endpoints.empty()) {
+    *message = "no endpoints given";
+    return false;
+  }
+  *out = std::move(endpoints);
+  return true;
+}
+
+CubeEndpointSet::CubeEndpointSet(std::vector<CubeEndpoint> endpoints,
+                                 std::chrono::milliseconds eject_time,
+                                 CubeEndpointRouting routing, double max_load)
+    : endpoints_(std::move(endpoints)), eject_time_(eject_time),
+      routing_(routing), max_load_(std::max(max_load, 1.0)),
+      states_(endpoints_.size()) {
+  if (routing_ != CubeEndpointRouting::Affinity) {
+    return;
+  }
+  // Points come from the address, so every process with the same list
+  // builds the same ring whatever order the list is in
+  for (size_t i = 0; i < endpoints_.size(); i++) {
+    std::string name = endpoints_[i].host + ":" + endpoints_[i].port;
+    uint64_t seed = HashValueBytes(reinterpret_cast<const uint8_t *>(
+                                       name.data()),
+                                   static_cast<int64_t>(name.size()));
+    for (int point = 0; point < kRingPoints; point++) {
+      ring_.emplace_back(HashValueBits(seed + point), i);
+    }
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+size_t CubeEndpointSet::Pick(const std::vector<size_t> &tried) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t best = endpoints_.size();
+  double best_cost = 0;
+  // Ejected endpoints are a last resort, the one readmitted soonest first
+  size_t ejected = endpoints_.size();
+  for (size_t i = 0; i < endpoints_.size(); i++) {
+    if (std::find(tried.begin(), tried.end(), i) != tried.end()) {
+      continue;
+    }
+    const State &state = states_[i];
+    if (state.ejected_until > now) {
+      if (ejected == endpoints_.size() ||
+          state.ejected_until < states_[ejected].ejected_until) {
+        ejected = i;
+      }
+      continue;
+    }
+    double cost = static_cast<double>(state.in_use + 1) * state.latency_ns;
+    // Among equal costs, fewer sessions in use wins
+    if (best == endpoints_.size() || cost < best_cost ||
+        (cost == best_cost && state.in_use < states_[best].in_use)) {
+      best = i;
+      best_cost = cost;
+    }
+  }
+  size_t picked = best != endpoints_.size() ? best : ejected;
+  if (!tried.empty() && picked != endpoints_.size()) {
+    failovers_++;
+  }
+  return picked;
+}
+
+size_t CubeEndpointSet::PickAffinity(uint64_t hash, size_t current) {
+  if (ring_.empty()) {
+    return current;
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Sessions in use elsewhere, with the caller's wherever it ends up
+  int64_t others = 0;
+  for (size_t i = 0; i < states_.size(); i++) {
+    others += states_[i].in_use;
+  }
+  if (current < states_.size()) {
+    others--;
+  }
+  double bound = std::ceil(max_load_ * static_cast<double>(others + 1) /
+                           static_cast<double>(endpoints_.size()));
+  size_t first = std::lower_bound(ring_.begin(), ring_.end(),
+                                  std::make_pair(hash, size_t(0))) -
+                 ring_.begin();
+  for (size_t step = 0; step < ring_.size(); step++) {
+    size_t i = ring_[(first + step) % ring_.size()].second;
+    const State &state = states_[i];
+    if (state.ejected_until > now) {
+      continue;
+    }
+    int64_t load = state.in_use - (i == current ? 1 : 0) + 1;
+    if (static_cast<double>(load) <= bound) {
+      return i;
+    }
+  }
+  return current;
+}
+
+void CubeEndpointSet::Acquire(size_t i) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_[i].in_use++;
+}
+
+void CubeEndpointSet::Release(size_t i) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_[i].in_use--;
+}
+
+void CubeEndpointSet::RecordLatency(size_t i,
+                                    std::chrono::nanoseconds elapsed) {
+  double sample = static_cast<double>(std::max<int64_t>(elapsed.count(), 1));
+  std::lock_guard<std::mutex> lock(mutex_);
+  State &state = states_[i];
+  state.latency_ns = state.latency_ns == 0
+                         ? sample
+                         : state.latency_ns +
+                               kLatencyWeight * (sample - state.latency_ns);
+}
+
+void CubeEndpointSet::MarkFailed(size_t i) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_[i].ejected_until = now + eject_time_;
+}
+
+void CubeEndpointSet::MarkHealthy(size_t i) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_[i].ejected_until = {};
+}
+
+int64_t CubeEndpointSet::failovers() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failovers_;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,130 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace adbc::cube {
+
+/// One server of a fleet
+struct CubeEndpoint {
+  std::string host; // Hostname, IP address or unix:// socket path
+  std::string port;
+};
+
+/// Parse a comma-separated list of host[:port] endpoints ([address]:port
+/// or a bare address for IPv6, unix:///path for a socket); entries without
+/// a port get default_port.
+/// @return false, with message set, if an entry is malformed or the list
+///   has none
+bool ParseEndpoints(std::string_view list, const std::string &default_port,
+                    std::vector<CubeEndpoint> *out, std::string *message);
+
+/// How queries are spread over the endpoints of a CubeEndpointSet
+enum class CubeEndpointRouting {
+  /// Sessions go where they cost least, and stay there
+  Load,
+  /// Cacheable queries go to the endpoint their fingerprint hashes to, so
+  /// that a server's result cache sees the same queries again
+  Affinity,
+};
+
+/// Picks the server each new session of a database goes to.
+///
+/// An endpoint costs (sessions in use + 1) times the moving average of its
+/// query round trips, so load spreads by outstanding work and a slow server
+/// is given less of it; endpoints not measured yet cost nothing and are
+/// tried first. An endpoint that refused a connection or dropped a session
+/// is ejected for eject_time and only picked again when every other one
+/// has been tried. Shared by a database's connections; thread-safe.
+///
+/// With affinity routing, PickAffinity also places queries on a
+/// consistent-hash ring of the endpoints, skipping those ejected or
+/// holding more than max_load times the average of the sessions in use, so
+/// adding or losing a server moves only its share of queries and a hot
+/// query cannot pile every session onto one server.
+class CubeEndpointSet {
+public:
+  CubeEndpointSet(std::vector<CubeEndpoint> endpoints,
+                  std::chrono::milliseconds eject_time,
+                  CubeEndpointRouting routing = CubeEndpointRouting::Load,
+                  double max_load = kDefaultMaxLoad);
+
+  /// Sessions an endpoint may hold, as a multiple of the average, before
+  /// affinity routing passes it over
+  static constexpr double kDefaultMaxLoad = 1.25;
+
+  size_t size() const { return endpoints_.size(); }
+  const CubeEndpoint &endpoint(size_t i) const { return endpoints_[i]; }
+
+  /// The cheapest endpoint not in tried, or size() if all were tried
+  size_t Pick(const std::vector<size_t> &tried);
+
+  CubeEndpointRouting routing() const { return routing_; }
+
+  /// The endpoint a query with fingerprint hash belongs on: the first from
+  /// hash on the ring that is not ejected and within max_load, counting
+  /// the session in use on current (size() for none) as if it moved there;
+  /// current itself if no endpoint qualifies
+  size_t PickAffinity(uint64_t hash, size_t current);
+
+  /// A session on endpoint i was taken into use or given up
+  void Acquire(size_t i);
+  void Release(size_t i);
+
+  /// A query on endpoint i was answered after elapsed
+  void RecordLatency(size_t i, std::chrono::nanoseconds elapsed);
+
+  /// Endpoint i failed a connect or a session; eject it
+  void MarkFailed(size_t i);
+
+  /// Endpoint i accepted a connection; readmit it
+  void MarkHealthy(size_t i);
+
+  /// Sessions moved to another endpoint after one failed
+  int64_t failovers() const;
+
+private:
+  struct State {
+    int64_t in_use = 0;
+    double latency_ns = 0; // Moving average; 0 = not measured
+    std::chrono::steady_clock::time_point ejected_until;
+  };
+
+  /// Points of each endpoint on the ring
+  static constexpr int kRingPoints = 64;
+
+  const std::vector<CubeEndpoint> endpoints_;
+  const std::chrono::milliseconds eject_time_;
+  const CubeEndpointRouting routing_;
+  const double max_load_;
+  // (point, endpoint) sorted by point; empty unless routing_ is Affinity
+  std::vector<std::pair<uint64_t, size_t>> ring_;
+  mutable std::mutex mutex_;
+  std::vector<State> states_;
+  int64_t failovers_ = 0;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,91 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/fork_guard.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace adbc::cube {
+
+namespace {
+
+struct ForkState {
+  std::atomic<uint64_t> generation{0};
+  std::mutex mutex; // Guards mutexes; held from prepare to parent or child
+  std::vector<std::mutex *> mutexes;
+};
+
+// Never destroyed: the handlers may run after static destructors
+ForkState &State() {
+  static ForkState *state = new ForkState();
+  return *state;
+}
+
+void Prepare() {
+  ForkState &state = State();
+  state.mutex.lock();
+  for (std::mutex *mutex : state.mutexes) {
+    mutex->lock();
+  }
+}
+
+void Release() {
+  ForkState &state = State();
+  for (auto it = state.mutexes.rbegin(); it != state.mutexes.rend(); ++it) {
+    (*it)->unlock();
+  }
+  state.mutex.unlock();
+}
+
+void Child() {
+  State().generation.fetch_add(1, std::memory_order_relaxed);
+  Release();
+}
+
+void InstallHandlers() {
+  static std::once_flag installed;
+  std::call_once(installed,
+                 [] { pthread_atfork(Prepare, Release, Child); });
+}
+
+} // namespace
+
+uint64_t CubeForkGeneration() {
+  InstallHandlers();
+  return State().generation.load(std::memory_order_relaxed);
+}
+
+void CubeForkRegisterMutex(std::mutex *mutex) {
+  InstallHandlers();
+  ForkState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.mutexes.push_back(mutex);
+}
+
+void CubeForkUnregisterMutex(std::mutex *mutex) {
+  ForkState &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.mutexes.erase(
+      std::remove(state.mutexes.begin(), state.mutexes.end(), mutex),
+      state.mutexes.end());
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,39 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+namespace adbc::cube {
+
+/// Number of forks between the process that loaded the driver and this
+/// one: 0 in that process, bumped in the child of every fork after the
+/// first call. A socket, thread or session recorded under an older
+/// generation belongs to an ancestor process and must not be used here.
+uint64_t CubeForkGeneration();
+
+/// Keep mutex from being inherited locked. The thread that forks takes
+/// every registered mutex first and releases them on both sides, so a
+/// child never finds one held by a thread it does not have. Only for
+/// mutexes held briefly and never while taking another registered one,
+/// since fork waits for them. Unregister before the mutex is destroyed.
+void CubeForkRegisterMutex(std::mutex *mutex);
+void CubeForkUnregisterMutex(std::mutex *mutex);
+
+} // namespace adbc::cube
@@ -0,0 +1,100 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "driver/cube/buffer_pool.h"
+
+namespace adbc::cube {
+
+/// Alignment Arrow recommends for buffers, and that received messages get
+constexpr size_t kIpcBufferAlignment = 64;
+
+/// Allocator for received Arrow IPC bytes: storage starts on a 64-byte
+/// boundary and is padded to a multiple of 64 bytes. Servers that align
+/// their IPC messages to 64 bytes (the arrow-rs default) then have every
+/// body buffer land on a 64-byte boundary too, so buffers shared with
+/// result arrays meet Arrow's alignment recommendation without a copy,
+/// and SIMD code may read up to the end of the padding. Large messages are
+/// placed for huge pages and NUMA as CubeMemoryPlacement says.
+template <typename T> struct CubeAlignedAllocator {
+  using value_type = T;
+
+  CubeAlignedAllocator() = default;
+  template <typename U>
+  CubeAlignedAllocator(const CubeAlignedAllocator<U> &) noexcept {}
+
+  T *allocate(size_t n) {
+    size_t bytes = (n * sizeof(T) + kIpcBufferAlignment - 1) &
+                   ~(kIpcBufferAlignment - 1);
+    void *block = CubeAllocateBlock(bytes);
+    if (block == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(block);
+  }
+
+  void deallocate(T *ptr, size_t) noexcept { CubeFreeBlock(ptr); }
+
+  template <typename U>
+  bool operator==(const CubeAlignedAllocator<U> &) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const CubeAlignedAllocator<U> &) const noexcept {
+    return false;
+  }
+};
+
+/// Bytes of received Arrow IPC messages, as handed to CubeArrowReader
+using CubeIpcBuffer = std::vector<uint8_t, CubeAlignedAllocator<uint8_t>>;
+
+/// Arrow IPC bytes as CubeArrowReader reads them: either a CubeIpcBuffer it
+/// owns, or memory kept alive by another owner, such as the mapping of a
+/// message spilled to disk
+class CubeIpcBytes {
+public:
+  explicit CubeIpcBytes(CubeIpcBuffer buffer)
+      : buffer_(std::move(buffer)), data_(buffer_.data()),
+        size_(buffer_.size()) {}
+  CubeIpcBytes(std::shared_ptr<const void> owner, const uint8_t *data,
+               size_t size)
+      : owner_(std::move(owner)), data_(data), size_(size) {}
+  CubeIpcBytes(const CubeIpcBytes &) = delete;
+  CubeIpcBytes &operator=(const CubeIpcBytes &) = delete;
+
+  const uint8_t *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  uint8_t operator[](size_t i) const { return data_[i]; }
+
+private:
+  CubeIpcBuffer buffer_;
+  std::shared_ptr<const void> owner_;
+  const uint8_t *data_;
+  size_t size_;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,161 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/ipc_export.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "format/generated/Message_generated.h"
+#include <flatbuffers/flatbuffers.h>
+
+namespace adbc::cube {
+
+namespace {
+
+namespace fb = ::org::apache::arrow::flatbuf;
+
+constexpr uint32_t kContinuation = 0xFFFFFFFF;
+constexpr uint8_t kEndOfStream[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+
+inline uint32_t ReadLE32(const uint8_t *data) {
+  return static_cast<uint32_t>(data[0]) |
+         (static_cast<uint32_t>(data[1]) << 8) |
+         (static_cast<uint32_t>(data[2]) << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Write all of data to fd
+ArrowErrorCode WriteToFd(int fd, const uint8_t *data, size_t size,
+                         struct ArrowError *error) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int code = errno;
+      ArrowErrorSet(error, "Failed to write Arrow IPC stream: %s",
+                    std::strerror(code));
+      return code;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return NANOARROW_OK;
+}
+
+} // namespace
+
+CubeIpcExporter::CubeIpcExporter(int fd)
+    : sink_([fd](const uint8_t *data, size_t size, struct ArrowError *error) {
+        return WriteToFd(fd, data, size, error);
+      }) {}
+
+ArrowErrorCode CubeIpcExporter::Write(const uint8_t *data, size_t size,
+                                      struct ArrowError *error) {
+  const int64_t end = static_cast<int64_t>(size);
+  int64_t offset = 0;
+  // Messages from run_start up to offset are kept but not written yet, so
+  // a fragment usually goes out in a single write
+  int64_t run_start = 0;
+  while (offset + 4 <= end) {
+    uint32_t continuation = ReadLE32(data + offset);
+    if (continuation == 0) {
+      break; // Pre-1.0 end-of-stream marker
+    }
+    if (continuation != kContinuation || offset + 8 > end) {
+      ArrowErrorSet(error, "Invalid Arrow IPC message at offset %lld",
+                    static_cast<long long>(offset));
+      return EINVAL;
+    }
+    uint32_t metadata_size = ReadLE32(data + offset + 4);
+    if (metadata_size == 0) {
+      break; // End-of-stream marker
+    }
+    int64_t body_offset = offset + 8 + metadata_size;
+    body_offset = (body_offset + 7) / 8 * 8;
+    if (body_offset > end) {
+      ArrowErrorSet(error, "Arrow IPC message metadata extends past the data");
+      return EINVAL;
+    }
+    const uint8_t *metadata = data + offset + 8;
+    flatbuffers::Verifier verifier(metadata, metadata_size, /*max_depth=*/64,
+                                   /*max_tables=*/1000000,
+                                   /*check_alignment=*/false);
+    if (!fb::VerifyMessageBuffer(verifier)) {
+      ArrowErrorSet(error, "Invalid Arrow IPC message FlatBuffer");
+      return EINVAL;
+    }
+    auto message = fb::GetMessage(metadata);
+    int64_t body_size = message->bodyLength();
+    if (body_size < 0 || body_size > end - body_offset) {
+      ArrowErrorSet(error, "Arrow IPC message body extends past the data");
+      return EINVAL;
+    }
+    int64_t next = body_offset + body_size;
+
+    bool keep = true;
+    switch (message->header_type()) {
+    case fb::MessageHeader_Schema:
+      keep = !have_schema_;
+      have_schema_ = true;
+      break;
+    case fb::MessageHeader_RecordBatch:
+    case fb::MessageHeader_DictionaryBatch:
+      if (!have_schema_) {
+        ArrowErrorSet(error, "Arrow IPC batch received before its schema");
+        return EINVAL;
+      }
+      if (auto batch = message->header_as_RecordBatch()) {
+        rows_ += batch->length();
+      }
+      break;
+    default:
+      break;
+    }
+    if (!keep) {
+      NANOARROW_RETURN_NOT_OK(
+          Emit(data + run_start, offset - run_start, error));
+      run_start = next;
+    }
+    offset = next;
+  }
+  return Emit(data + run_start, offset - run_start, error);
+}
+
+ArrowErrorCode CubeIpcExporter::Finish(struct ArrowError *error) {
+  if (!have_schema_) {
+    ArrowErrorSet(error, "No result schema received");
+    return EINVAL;
+  }
+  return Emit(kEndOfStream, sizeof(kEndOfStream), error);
+}
+
+ArrowErrorCode CubeIpcExporter::Emit(const uint8_t *data, size_t size,
+                                     struct ArrowError *error) {
+  if (size == 0) {
+    return NANOARROW_OK;
+  }
+  NANOARROW_RETURN_NOT_OK(sink_(data, size, error));
+  bytes_ += static_cast<int64_t>(size);
+  return NANOARROW_OK;
+}
+
+} // namespace adbc::cube
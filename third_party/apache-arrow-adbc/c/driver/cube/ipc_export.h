@@ -0,0 +1,73 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+#include <nanoarrow/nanoarrow.h>
+
+namespace adbc::cube {
+
+/// Writes a result as one Arrow IPC stream, to a file descriptor or a
+/// sink, copying the messages as the server sent them instead of decoding
+/// them. Results arrive as fragments (a schema-only stream, one stream per
+/// batch, or batches following a schema sent once); the first Schema
+/// message is kept and the Schema messages and end-of-stream markers
+/// repeated by later fragments are dropped, so readers of the output see
+/// one schema followed by every batch. Dictionary and compressed batches
+/// are copied unchanged.
+class CubeIpcExporter {
+public:
+  /// Receives each run of bytes to output, in order; views the fragment
+  /// being written, so only valid during the call
+  using Sink = std::function<ArrowErrorCode(const uint8_t *data, size_t size,
+                                            struct ArrowError *error)>;
+
+  /// Writes go to fd at its current position; fd is not closed
+  explicit CubeIpcExporter(int fd);
+  explicit CubeIpcExporter(Sink sink) : sink_(std::move(sink)) {}
+
+  /// Append the messages of one received fragment
+  /// @return NANOARROW_OK; EINVAL if the fragment is malformed or has
+  ///   batches before any schema; an errno value if writing failed
+  ArrowErrorCode Write(const uint8_t *data, size_t size,
+                       struct ArrowError *error);
+
+  /// Write the end-of-stream marker; fails if no schema was ever written
+  ArrowErrorCode Finish(struct ArrowError *error);
+
+  /// Rows of the record batches written so far
+  int64_t rows() const { return rows_; }
+
+  /// Bytes written so far
+  int64_t bytes() const { return bytes_; }
+
+private:
+  ArrowErrorCode Emit(const uint8_t *data, size_t size,
+                      struct ArrowError *error);
+
+  Sink sink_;
+  bool have_schema_ = false;
+  int64_t rows_ = 0;
+  int64_t bytes_ = 0;
+};
+
+} // namespace adbc::cube
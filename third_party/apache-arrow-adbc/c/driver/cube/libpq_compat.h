@@ -27,8 +27,12 @@ extern "C" {
 #endif
 
 // Forward declarations for libpq types
+typedef unsigned int Oid;
 typedef struct pg_conn PGconn;
 typedef struct pg_result PGresult;
+typedef struct pg_cancel PGcancel;
+
+#define PG_DIAG_SQLSTATE 'C'
 
 // Connection status enum
 typedef enum {
@@ -66,6 +70,7 @@ typedef enum {
 PGconn *PQconnectdb(const char *conninfo);
 ConnStatusType PQstatus(const PGconn *conn);
 const char *PQerrorMessage(const PGconn *conn);
+const char *PQparameterStatus(const PGconn *conn, const char *paramName);
 void PQfinish(PGconn *conn);
 
 PGresult *PQexec(PGconn *conn, const char *query);
@@ -78,6 +83,37 @@ int PQnfields(const PGresult *res);
 const char *PQfname(const PGresult *res, int field_num);
 const char *PQgetvalue(const PGresult *res, int tup_num, int field_num);
 
+// Asynchronous queries with binary results, fetched row by row
+int PQsendQueryParams(PGconn *conn, const char *command, int nParams,
+                      const Oid *paramTypes, const char *const *paramValues,
+                      const int *paramLengths, const int *paramFormats,
+                      int resultFormat);
+int PQsetSingleRowMode(PGconn *conn);
+PGresult *PQgetResult(PGconn *conn);
+Oid PQftype(const PGresult *res, int field_num);
+int PQfformat(const PGresult *res, int field_num);
+int PQfmod(const PGresult *res, int field_num);
+int PQgetlength(const PGresult *res, int tup_num, int field_num);
+int PQgetisnull(const PGresult *res, int tup_num, int field_num);
+const char *PQresultErrorMessage(const PGresult *res);
+const char *PQresultErrorField(const PGresult *res, int fieldcode);
+char *PQcmdTuples(PGresult *res);
+
+// Prepared statements
+PGresult *PQprepare(PGconn *conn, const char *stmtName, const char *query,
+                    int nParams, const Oid *paramTypes);
+PGresult *PQdescribePrepared(PGconn *conn, const char *stmt);
+int PQnparams(const PGresult *res);
+Oid PQparamtype(const PGresult *res, int param_num);
+int PQsendQueryPrepared(PGconn *conn, const char *stmtName, int nParams,
+                        const char *const *paramValues,
+                        const int *paramLengths, const int *paramFormats,
+                        int resultFormat);
+
+PGcancel *PQgetCancel(PGconn *conn);
+int PQcancel(PGcancel *cancel, char *errbuf, int errbufsize);
+void PQfreeCancel(PGcancel *cancel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,137 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/libpq_loader.h"
+
+#if defined(CUBE_DLOPEN_LIBPQ)
+#include <dlfcn.h>
+
+#include <mutex>
+#endif
+
+namespace adbc::cube {
+
+#if defined(CUBE_DLOPEN_LIBPQ)
+
+#define CUBE_LIBPQ_DEFINE(name) decltype(&::name) name = nullptr;
+CUBE_LIBPQ_FUNCTIONS(CUBE_LIBPQ_DEFINE)
+CUBE_LIBPQ_CHUNK_FUNCTIONS(CUBE_LIBPQ_DEFINE)
+CUBE_LIBPQ_PIPELINE_FUNCTIONS(CUBE_LIBPQ_DEFINE)
+#undef CUBE_LIBPQ_DEFINE
+
+namespace {
+
+// Names tried in order, through the usual dynamic loader search path
+#if defined(__APPLE__)
+constexpr const char *kLibpqNames[] = {"libpq.5.dylib", "libpq.dylib"};
+#else
+constexpr const char *kLibpqNames[] = {"libpq.so.5", "libpq.so"};
+#endif
+
+// Why LoadLibpq failed; empty once loaded
+std::string OpenLibpq() {
+  void *handle = nullptr;
+  std::string reason;
+  for (const char *name : kLibpqNames) {
+    handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    if (handle) {
+      break;
+    }
+    const char *message = dlerror();
+    if (reason.empty() && message) {
+      reason = message;
+    }
+  }
+  if (!handle) {
+    return "Cannot load libpq: " + reason;
+  }
+  // The handle is kept for the life of the process
+#define CUBE_LIBPQ_RESOLVE(name)                                              \
+  name = reinterpret_cast<decltype(&::name)>(dlsym(handle, #name));           \
+  if (!name) {                                                                \
+    return "libpq lacks " #name;                                              \
+  }
+  CUBE_LIBPQ_FUNCTIONS(CUBE_LIBPQ_RESOLVE)
+#undef CUBE_LIBPQ_RESOLVE
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  // Older libpq falls back to single-row mode
+  PQsetChunkedRowsMode = reinterpret_cast<decltype(&::PQsetChunkedRowsMode)>(
+      dlsym(handle, "PQsetChunkedRowsMode"));
+#endif
+#ifdef LIBPQ_HAS_PIPELINING
+  // Older libpq runs each query on its own; all three or none are used
+#define CUBE_LIBPQ_RESOLVE_OPTIONAL(name)                                     \
+  name = reinterpret_cast<decltype(&::name)>(dlsym(handle, #name));
+  CUBE_LIBPQ_PIPELINE_FUNCTIONS(CUBE_LIBPQ_RESOLVE_OPTIONAL)
+#undef CUBE_LIBPQ_RESOLVE_OPTIONAL
+#endif
+  return std::string();
+}
+
+} // namespace
+
+bool LoadLibpq(std::string *message) {
+  static std::once_flag once;
+  static std::string failure;
+  std::call_once(once, [] { failure = OpenLibpq(); });
+  if (!failure.empty()) {
+    *message = failure;
+    return false;
+  }
+  return true;
+}
+
+bool LibpqHasChunkedRowsMode() {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  return PQsetChunkedRowsMode != nullptr;
+#else
+  return false;
+#endif
+}
+
+bool LibpqHasPipelineMode() {
+#ifdef LIBPQ_HAS_PIPELINING
+  return PQenterPipelineMode != nullptr && PQexitPipelineMode != nullptr &&
+         PQpipelineSync != nullptr;
+#else
+  return false;
+#endif
+}
+
+#else
+
+bool LoadLibpq(std::string * /*message*/) { return true; }
+
+bool LibpqHasChunkedRowsMode() {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool LibpqHasPipelineMode() {
+#ifdef LIBPQ_HAS_PIPELINING
+  return true;
+#else
+  return false;
+#endif
+}
+
+#endif
+
+} // namespace adbc::cube
@@ -0,0 +1,113 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <string>
+
+// Try to include real libpq, fall back to compatibility header
+#ifdef __has_include
+#if __has_include(<libpq-fe.h>)
+#include <libpq-fe.h>
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+
+namespace adbc::cube {
+
+/// With CUBE_DLOPEN_LIBPQ the driver is not linked against libpq: it is
+/// opened with dlopen (RTLD_LOCAL, so its symbols and those of OpenSSL,
+/// GSSAPI and LDAP it pulls in stay out of the global namespace) the first
+/// time a postgresql mode connection is made. Each libpq function the
+/// driver calls is declared here as a pointer of the same name, which an
+/// unqualified call in adbc::cube finds before the global declaration, so
+/// call sites read as plain libpq calls.
+
+/// Open libpq if it is not yet; safe to call from any thread. Returns
+/// false, with the reason in message, if it cannot be loaded; the libpq
+/// functions must not be called then.
+bool LoadLibpq(std::string *message);
+
+/// Whether the libpq in use has PQsetChunkedRowsMode (libpq 17)
+bool LibpqHasChunkedRowsMode();
+
+/// Whether the libpq in use has pipeline mode (libpq 14)
+bool LibpqHasPipelineMode();
+
+#if defined(CUBE_DLOPEN_LIBPQ)
+
+#ifdef LIBPQ_HAS_CHUNK_MODE
+#define CUBE_LIBPQ_CHUNK_FUNCTIONS(X) X(PQsetChunkedRowsMode)
+#else
+#define CUBE_LIBPQ_CHUNK_FUNCTIONS(X)
+#endif
+
+#ifdef LIBPQ_HAS_PIPELINING
+#define CUBE_LIBPQ_PIPELINE_FUNCTIONS(X)                                      \
+  X(PQenterPipelineMode)                                                      \
+  X(PQexitPipelineMode)                                                       \
+  X(PQpipelineSync)
+#else
+#define CUBE_LIBPQ_PIPELINE_FUNCTIONS(X)
+#endif
+
+// The libpq functions the driver calls; each is resolved by LoadLibpq
+#define CUBE_LIBPQ_FUNCTIONS(X)                                               \
+  X(PQcancel)                                                                 \
+  X(PQclear)                                                                  \
+  X(PQcmdTuples)                                                              \
+  X(PQconnectdb)                                                              \
+  X(PQdescribePrepared)                                                       \
+  X(PQerrorMessage)                                                           \
+  X(PQexec)                                                                   \
+  X(PQfformat)                                                                \
+  X(PQfinish)                                                                 \
+  X(PQfmod)                                                                   \
+  X(PQfname)                                                                  \
+  X(PQfreeCancel)                                                             \
+  X(PQftype)                                                                  \
+  X(PQgetCancel)                                                              \
+  X(PQgetResult)                                                              \
+  X(PQgetisnull)                                                              \
+  X(PQgetlength)                                                              \
+  X(PQgetvalue)                                                               \
+  X(PQnfields)                                                                \
+  X(PQnparams)                                                                \
+  X(PQntuples)                                                                \
+  X(PQparameterStatus)                                                        \
+  X(PQparamtype)                                                              \
+  X(PQprepare)                                                                \
+  X(PQresultErrorField)                                                       \
+  X(PQresultErrorMessage)                                                     \
+  X(PQresultStatus)                                                           \
+  X(PQsendQueryParams)                                                        \
+  X(PQsendQueryPrepared)                                                      \
+  X(PQsetSingleRowMode)                                                       \
+  X(PQstatus)
+
+#define CUBE_LIBPQ_DECLARE(name) extern decltype(&::name) name;
+CUBE_LIBPQ_FUNCTIONS(CUBE_LIBPQ_DECLARE)
+CUBE_LIBPQ_CHUNK_FUNCTIONS(CUBE_LIBPQ_DECLARE)
+CUBE_LIBPQ_PIPELINE_FUNCTIONS(CUBE_LIBPQ_DECLARE)
+#undef CUBE_LIBPQ_DECLARE
+
+#endif
+
+} // namespace adbc::cube
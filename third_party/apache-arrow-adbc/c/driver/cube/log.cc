@@ -0,0 +1,142 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr const char *kLevelNames[] = {"off",  "error", "warn",
+                                       "info", "debug", "trace"};
+
+// Where records go and how many may, guarded by mutex
+struct LogState {
+  std::mutex mutex;
+  AdbcCubeLogger logger{};
+  int64_t rate_limit = 1000;
+  std::chrono::steady_clock::time_point window_start;
+  int64_t window_count = 0;
+  int64_t dropped_since_write = 0;
+  int64_t dropped = 0;
+};
+
+LogState &State() {
+  static LogState state;
+  return state;
+}
+
+void WriteStderr(int level, const char *component, const std::string &message,
+                 const std::vector<AdbcCubeLogField> &fields) {
+  std::string line = "[cube] ";
+  line += kLevelNames[level];
+  line += ' ';
+  line += component;
+  line += ": ";
+  line += message;
+  for (const auto &field : fields) {
+    line += ' ';
+    line += field.key;
+    line += '=';
+    line += field.value;
+  }
+  line += '\n';
+  std::fwrite(line.data(), 1, line.size(), stderr);
+}
+
+} // namespace
+
+std::atomic<int> CubeLog::level_{static_cast<int>(CubeLogLevel::Off)};
+
+bool ParseLogLevel(std::string_view text, CubeLogLevel *level) {
+  for (int i = 0; i <= static_cast<int>(CubeLogLevel::Trace); i++) {
+    if (text == kLevelNames[i]) {
+      *level = static_cast<CubeLogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *LogLevelName(CubeLogLevel level) {
+  return kLevelNames[static_cast<int>(level)];
+}
+
+void CubeLog::SetLogger(const AdbcCubeLogger *logger) {
+  auto &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.logger = logger && logger->log ? *logger : AdbcCubeLogger{};
+}
+
+void CubeLog::SetRateLimit(int64_t per_second) {
+  auto &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.rate_limit = per_second;
+}
+
+int64_t CubeLog::dropped() {
+  auto &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.dropped;
+}
+
+void CubeLog::Write(CubeLogLevel level, const char *component,
+                    std::string_view message,
+                    std::initializer_list<CubeLogField> fields) {
+  auto &state = State();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.rate_limit > 0) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - state.window_start >= std::chrono::seconds(1)) {
+      state.window_start = now;
+      state.window_count = 0;
+    }
+    if (state.window_count >= state.rate_limit) {
+      state.dropped_since_write++;
+      state.dropped++;
+      return;
+    }
+    state.window_count++;
+  }
+
+  std::vector<AdbcCubeLogField> c_fields;
+  c_fields.reserve(fields.size() + 1);
+  for (const auto &field : fields) {
+    c_fields.push_back({field.key, field.value.c_str()});
+  }
+  std::string dropped;
+  if (state.dropped_since_write > 0) {
+    dropped = std::to_string(state.dropped_since_write);
+    c_fields.push_back({"dropped", dropped.c_str()});
+    state.dropped_since_write = 0;
+  }
+  std::string text(message);
+  int value = static_cast<int>(level);
+  if (state.logger.log) {
+    state.logger.log(state.logger.user_data, value, component, text.c_str(),
+                     c_fields.data(), c_fields.size());
+  } else {
+    WriteStderr(value, component, text, c_fields);
+  }
+}
+
+} // namespace adbc::cube
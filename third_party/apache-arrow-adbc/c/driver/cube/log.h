@@ -0,0 +1,137 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+extern "C" {
+
+/// One key/value of a log record; both strings last only for the call
+struct AdbcCubeLogField {
+  const char *key;
+  const char *value;
+};
+
+/// Callback the driver writes its log records to, instead of stderr.
+/// Register one by passing its address to AdbcDatabaseSetOptionInt with
+/// the key "adbc.cube.logger" (0 restores stderr); the driver copies it,
+/// so it need not outlive the call, but user_data must stay valid until
+/// another logger is registered. The logger is process-wide. It may be
+/// called from any thread, one record at a time, and must not call back
+/// into the driver.
+struct AdbcCubeLogger {
+  /// Passed back to log
+  void *user_data;
+  /// Write one record. level is 1 (error) to 5 (trace); component names
+  /// the part of the driver, such as "NativeClient", and is static.
+  void (*log)(void *user_data, int level, const char *component,
+              const char *message, const struct AdbcCubeLogField *fields,
+              size_t n_fields);
+};
+
+} // extern "C"
+
+namespace adbc::cube {
+
+enum class CubeLogLevel : int {
+  Off = 0,
+  Error = 1,
+  Warn = 2,
+  Info = 3,
+  Debug = 4,
+  Trace = 5,
+};
+
+/// Parse off, error, warn, info, debug or trace
+/// @return false if text is none of them
+bool ParseLogLevel(std::string_view text, CubeLogLevel *level);
+
+/// Name of level, as ParseLogLevel takes it
+const char *LogLevelName(CubeLogLevel level);
+
+/// One key/value of a record, formatted when the record is written
+struct CubeLogField {
+  CubeLogField(const char *key, std::string_view value)
+      : key(key), value(value) {}
+  CubeLogField(const char *key, const char *value)
+      : key(key), value(value ? value : "") {}
+  CubeLogField(const char *key, const std::string &value)
+      : key(key), value(value) {}
+  template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+  CubeLogField(const char *key, T value)
+      : key(key), value(std::to_string(value)) {}
+
+  const char *key;
+  std::string value;
+};
+
+/// The driver's log, shared by the whole process. Records below the level
+/// (Off by default) cost one relaxed atomic load and a branch at the call
+/// site (see CUBE_LOG), and build none of their fields. Records above it
+/// go to the registered AdbcCubeLogger, or one line each to stderr, at no
+/// more than the rate limit; the number dropped is added to the next one
+/// written.
+class CubeLog {
+public:
+  static bool Enabled(CubeLogLevel level) {
+    return static_cast<int>(level) <= level_.load(std::memory_order_relaxed);
+  }
+
+  static CubeLogLevel level() {
+    return static_cast<CubeLogLevel>(level_.load(std::memory_order_relaxed));
+  }
+  static void SetLevel(CubeLogLevel level) {
+    level_.store(static_cast<int>(level), std::memory_order_relaxed);
+  }
+
+  /// Use logger instead of stderr, or stderr again if it is null
+  static void SetLogger(const AdbcCubeLogger *logger);
+
+  /// Most records written per second; 0 = no limit (default: 1000)
+  static void SetRateLimit(int64_t per_second);
+
+  /// Records dropped by the rate limit so far
+  static int64_t dropped();
+
+  static void Write(CubeLogLevel level, const char *component,
+                    std::string_view message,
+                    std::initializer_list<CubeLogField> fields = {});
+
+private:
+  static std::atomic<int> level_;
+};
+
+} // namespace adbc::cube
+
+/// Write a record if level is enabled, for instance
+///   CUBE_LOG(Debug, "NativeClient", "Connected", {{"transport", name}});
+/// Arguments after the component are evaluated only then.
+#define CUBE_LOG(level, component, ...)                                  \
+  do {                                                                   \
+    if (::adbc::cube::CubeLog::Enabled(                                  \
+            ::adbc::cube::CubeLogLevel::level)) {                        \
+      ::adbc::cube::CubeLog::Write(::adbc::cube::CubeLogLevel::level,    \
+                                   component, __VA_ARGS__);              \
+    }                                                                    \
+  } while (false)
@@ -0,0 +1,68 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/memory_tracker.h"
+
+namespace adbc::cube {
+
+bool CubeMemoryTracker::TryReserve(size_t bytes) {
+  const size_t limit = limit_.load(std::memory_order_relaxed);
+  size_t current = current_.load(std::memory_order_relaxed);
+  do {
+    if (limit > 0 && (bytes > limit || current > limit - bytes)) {
+      return false;
+    }
+  } while (!current_.compare_exchange_weak(current, current + bytes,
+                                           std::memory_order_relaxed));
+  if (parent_ && !parent_->TryReserve(bytes)) {
+    current_.fetch_sub(bytes, std::memory_order_relaxed);
+    return false;
+  }
+  RaisePeak(current + bytes);
+  return true;
+}
+
+void CubeMemoryTracker::Reserve(size_t bytes) {
+  RaisePeak(current_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  if (parent_) {
+    parent_->Reserve(bytes);
+  }
+}
+
+void CubeMemoryTracker::Release(size_t bytes) {
+  current_.fetch_sub(bytes, std::memory_order_relaxed);
+  if (parent_) {
+    parent_->Release(bytes);
+  }
+}
+
+bool CubeMemoryTracker::Exceeded() const {
+  size_t limit = limit_.load(std::memory_order_relaxed);
+  if (limit > 0 && current_.load(std::memory_order_relaxed) > limit) {
+    return true;
+  }
+  return parent_ && parent_->Exceeded();
+}
+
+void CubeMemoryTracker::RaisePeak(size_t current) {
+  size_t peak = peak_.load(std::memory_order_relaxed);
+  while (current > peak && !peak_.compare_exchange_weak(
+                               peak, current, std::memory_order_relaxed)) {
+  }
+}
+
+} // namespace adbc::cube
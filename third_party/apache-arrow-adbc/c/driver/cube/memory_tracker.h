@@ -0,0 +1,116 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace adbc::cube {
+
+/// Bytes the driver holds on behalf of a database or a connection, with an
+/// optional hard limit. A connection's tracker has its database's as
+/// parent, so what it charges also counts against the database's limit.
+/// Thread-safe; charges and releases are relaxed atomic updates.
+class CubeMemoryTracker {
+public:
+  static std::shared_ptr<CubeMemoryTracker>
+  Make(std::shared_ptr<CubeMemoryTracker> parent = nullptr) {
+    return std::shared_ptr<CubeMemoryTracker>(
+        new CubeMemoryTracker(std::move(parent)));
+  }
+
+  /// Charge bytes unless that takes this tracker or a parent past its limit
+  /// @return false, charging nothing, if it would
+  bool TryReserve(size_t bytes);
+
+  /// Charge bytes that are already held, whatever the limits
+  void Reserve(size_t bytes);
+
+  void Release(size_t bytes);
+
+  /// Whether this tracker or a parent holds more than its limit
+  bool Exceeded() const;
+
+  /// 0 = no limit
+  void set_limit(size_t bytes) {
+    limit_.store(bytes, std::memory_order_relaxed);
+  }
+  size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+
+  size_t current() const { return current_.load(std::memory_order_relaxed); }
+  /// Most held at once since the tracker was made
+  size_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+private:
+  explicit CubeMemoryTracker(std::shared_ptr<CubeMemoryTracker> parent)
+      : parent_(std::move(parent)) {}
+
+  void RaisePeak(size_t current);
+
+  const std::shared_ptr<CubeMemoryTracker> parent_;
+  std::atomic<size_t> limit_{0};
+  std::atomic<size_t> current_{0};
+  std::atomic<size_t> peak_{0};
+};
+
+/// Bytes charged to a tracker (with Reserve) until the charge is reset or
+/// destroyed. Move-only; a default or moved-from charge holds nothing.
+class CubeMemoryCharge {
+public:
+  CubeMemoryCharge() = default;
+  /// A null tracker charges nothing
+  CubeMemoryCharge(std::shared_ptr<CubeMemoryTracker> tracker, size_t bytes)
+      : tracker_(std::move(tracker)), bytes_(tracker_ ? bytes : 0) {
+    if (tracker_) {
+      tracker_->Reserve(bytes_);
+    }
+  }
+  CubeMemoryCharge(CubeMemoryCharge &&other) noexcept
+      : tracker_(std::move(other.tracker_)), bytes_(other.bytes_) {
+    other.bytes_ = 0;
+  }
+  CubeMemoryCharge &operator=(CubeMemoryCharge &&other) noexcept {
+    if (this != &other) {
+      Reset();
+      tracker_ = std::move(other.tracker_);
+      bytes_ = other.bytes_;
+      other.bytes_ = 0;
+    }
+    return *this;
+  }
+  ~CubeMemoryCharge() { Reset(); }
+
+  /// Give the bytes back now
+  void Reset() {
+    if (tracker_) {
+      tracker_->Release(bytes_);
+      tracker_.reset();
+    }
+    bytes_ = 0;
+  }
+
+  size_t bytes() const { return bytes_; }
+
+private:
+  std::shared_ptr<CubeMemoryTracker> tracker_;
+  size_t bytes_ = 0;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,233 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of MergeSortedStreams: the merged order, ties kept in the order of
+// the inputs, and inputs that are empty or run out at different times.
+
+#include <cerrno>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/rechunk_stream.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// A merged row: its sort key (null as nullopt), and the input and row of
+// that input it came from
+struct Row {
+  std::optional<int64_t> key;
+  int32_t input;
+  int32_t row;
+
+  bool operator==(const Row &other) const {
+    return key == other.key && input == other.input && row == other.row;
+  }
+};
+
+void InitSchema(struct ArrowSchema *schema) {
+  ArrowSchemaInit(schema);
+  ASSERT_EQ(ArrowSchemaSetTypeStruct(schema, 3), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[0], NANOARROW_TYPE_INT64),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[0], "k"), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[1], NANOARROW_TYPE_INT32),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[1], "input"), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[2], NANOARROW_TYPE_INT32),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[2], "row"), NANOARROW_OK);
+}
+
+// A stream of the batches given, each a list of keys, tagged with input
+void MakeInput(int32_t input,
+               const std::vector<std::vector<std::optional<int64_t>>> &batches,
+               nanoarrow::UniqueArrayStream *out) {
+  nanoarrow::UniqueSchema schema;
+  InitSchema(schema.get());
+  nanoarrow::UniqueSchema stream_schema;
+  ASSERT_EQ(ArrowSchemaDeepCopy(schema.get(), stream_schema.get()),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowBasicArrayStreamInit(out->get(), stream_schema.get(),
+                                      static_cast<int64_t>(batches.size())),
+            NANOARROW_OK);
+  int32_t row = 0;
+  for (size_t i = 0; i < batches.size(); i++) {
+    nanoarrow::UniqueArray array;
+    ASSERT_EQ(ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr),
+              NANOARROW_OK);
+    ASSERT_EQ(ArrowArrayStartAppending(array.get()), NANOARROW_OK);
+    for (const auto &key : batches[i]) {
+      if (key) {
+        ASSERT_EQ(ArrowArrayAppendInt(array->children[0], *key), NANOARROW_OK);
+      } else {
+        ASSERT_EQ(ArrowArrayAppendNull(array->children[0], 1), NANOARROW_OK);
+      }
+      ASSERT_EQ(ArrowArrayAppendInt(array->children[1], input), NANOARROW_OK);
+      ASSERT_EQ(ArrowArrayAppendInt(array->children[2], row++), NANOARROW_OK);
+      ASSERT_EQ(ArrowArrayFinishElement(array.get()), NANOARROW_OK);
+    }
+    ASSERT_EQ(ArrowArrayFinishBuildingDefault(array.get(), nullptr),
+              NANOARROW_OK);
+    ArrowBasicArrayStreamSetArray(out->get(), static_cast<int64_t>(i),
+                                  array.get());
+  }
+}
+
+// Every row of the merged stream, in order
+void ReadRows(struct ArrowArrayStream *stream, std::vector<Row> *out) {
+  nanoarrow::UniqueSchema schema;
+  ASSERT_EQ(stream->get_schema(stream, schema.get()), NANOARROW_OK);
+  nanoarrow::UniqueArrayView view;
+  ASSERT_EQ(ArrowArrayViewInitFromSchema(view.get(), schema.get(), nullptr),
+            NANOARROW_OK);
+  while (true) {
+    nanoarrow::UniqueArray array;
+    ASSERT_EQ(stream->get_next(stream, array.get()), NANOARROW_OK)
+        << stream->get_last_error(stream);
+    if (!array->release) {
+      break;
+    }
+    ASSERT_EQ(ArrowArrayViewSetArray(view.get(), array.get(), nullptr),
+              NANOARROW_OK);
+    for (int64_t i = 0; i < array->length; i++) {
+      Row row;
+      if (!ArrowArrayViewIsNull(view->children[0], i)) {
+        row.key = ArrowArrayViewGetIntUnsafe(view->children[0], i);
+      }
+      row.input = static_cast<int32_t>(
+          ArrowArrayViewGetIntUnsafe(view->children[1], i));
+      row.row = static_cast<int32_t>(
+          ArrowArrayViewGetIntUnsafe(view->children[2], i));
+      out->push_back(row);
+    }
+  }
+}
+
+std::vector<CubeSortKey> Keys(const char *spec) {
+  nanoarrow::UniqueSchema schema;
+  InitSchema(schema.get());
+  std::vector<CubeSortKey> keys;
+  struct ArrowError error;
+  EXPECT_EQ(ParseSortKeys(spec, schema.get(), &keys, &error), NANOARROW_OK)
+      << error.message;
+  return keys;
+}
+
+// Merge inputs, given as their batches, on keys into target_rows batches
+std::vector<Row>
+Merge(const std::vector<std::vector<std::vector<std::optional<int64_t>>>>
+          &inputs,
+      const char *keys, int64_t target_rows) {
+  std::vector<nanoarrow::UniqueArrayStream> streams(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    MakeInput(static_cast<int32_t>(i), inputs[i], &streams[i]);
+  }
+  nanoarrow::UniqueArrayStream merged;
+  MergeSortedStreams(std::move(streams), Keys(keys), target_rows,
+                     merged.get());
+  std::vector<Row> rows;
+  ReadRows(merged.get(), &rows);
+  return rows;
+}
+
+} // namespace
+
+TEST(MergeSortedStreamsTest, InterleavesInputs) {
+  // Short runs are copied into merged batches, long ones sliced; both
+  // target sizes go through each
+  for (int64_t target_rows : {2, 1024}) {
+    SCOPED_TRACE(target_rows);
+    auto rows = Merge({{{1, 4}, {7, 10, 11, 12, 13}},
+                       {{2, 5, 8}},
+                       {{3}, {6, 9}, {14, 15, 16, 17}}},
+                      "k", target_rows);
+    ASSERT_EQ(rows.size(), 17u);
+    for (size_t i = 0; i < rows.size(); i++) {
+      EXPECT_EQ(rows[i].key, static_cast<int64_t>(i + 1)) << i;
+    }
+  }
+}
+
+TEST(MergeSortedStreamsTest, TiesKeepInputOrder) {
+  auto rows = Merge({{{1, 2, 2}}, {{2, 2}}, {{1, 2}}}, "k", 1024);
+  std::vector<Row> expected = {
+      {1, 0, 0}, {1, 2, 0}, {2, 0, 1}, {2, 0, 2},
+      {2, 1, 0}, {2, 1, 1}, {2, 2, 1},
+  };
+  EXPECT_EQ(rows, expected);
+}
+
+TEST(MergeSortedStreamsTest, DescendingWithNulls) {
+  // Nulls come first in descending order unless stated
+  auto rows = Merge({{{std::nullopt, 5, 1}}, {{4, 3}}}, "k DESC", 1024);
+  std::vector<Row> expected = {
+      {std::nullopt, 0, 0}, {5, 0, 1}, {4, 1, 0}, {3, 1, 1}, {1, 0, 2}};
+  EXPECT_EQ(rows, expected);
+
+  rows = Merge({{{std::nullopt, 1}}, {{std::nullopt}, {2}}},
+               "k ASC NULLS FIRST", 1024);
+  expected = {{std::nullopt, 0, 0}, {std::nullopt, 1, 0}, {1, 0, 1},
+              {2, 1, 1}};
+  EXPECT_EQ(rows, expected);
+}
+
+TEST(MergeSortedStreamsTest, EmptyInputs) {
+  // No batches at all, an empty batch, and an input that runs out first
+  auto rows = Merge({{}, {{}, {1, 3}}, {{2}}, {{}}}, "k", 1024);
+  std::vector<Row> expected = {{1, 1, 0}, {2, 2, 0}, {3, 1, 1}};
+  EXPECT_EQ(rows, expected);
+
+  rows = Merge({{}, {{}}}, "k", 1024);
+  EXPECT_TRUE(rows.empty());
+}
+
+TEST(MergeSortedStreamsTest, NoInputs) {
+  nanoarrow::UniqueArrayStream merged;
+  MergeSortedStreams({}, Keys("k"), 1024, merged.get());
+  nanoarrow::UniqueSchema schema;
+  EXPECT_EQ(merged->get_schema(merged.get(), schema.get()), EINVAL);
+}
+
+TEST(ParseSortKeysTest, Clauses) {
+  auto keys = Keys(" input DESC , k NULLS FIRST,row asc nulls last");
+  ASSERT_EQ(keys.size(), 3u);
+  EXPECT_EQ(keys[0].column, 1);
+  EXPECT_TRUE(keys[0].descending);
+  EXPECT_TRUE(keys[0].nulls_first);
+  EXPECT_EQ(keys[1].column, 0);
+  EXPECT_FALSE(keys[1].descending);
+  EXPECT_TRUE(keys[1].nulls_first);
+  EXPECT_EQ(keys[2].column, 2);
+  EXPECT_FALSE(keys[2].nulls_first);
+
+  nanoarrow::UniqueSchema schema;
+  InitSchema(schema.get());
+  struct ArrowError error;
+  for (const char *spec : {"", " , ", "missing", "k sideways", "k NULLS"}) {
+    SCOPED_TRACE(spec);
+    EXPECT_EQ(ParseSortKeys(spec, schema.get(), &keys, &error), EINVAL);
+  }
+}
+
+} // namespace adbc::cube
@@ -17,129 +17,1025 @@
 
 #include "driver/cube/metadata.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/connection.h"
 #include "driver/cube/cube_types.h"
+#include "driver/cube/disk_cache.h"
+#include "driver/cube/native_protocol.h"
+#include "driver/framework/utility.h"
 
 namespace adbc::cube {
 
+namespace {
+
+// Layout of EncodeMetadataModel's snapshots
+constexpr uint32_t kSnapshotLayout = 1;
+
+constexpr std::string_view kTablesQuery =
+    "SELECT table_catalog, table_schema, table_name, table_type "
+    "FROM information_schema.tables";
+constexpr std::string_view kColumnsQuery =
+    "SELECT table_catalog, table_schema, table_name, column_name, "
+    "ordinal_position, data_type, is_nullable "
+    "FROM information_schema.columns";
+
+bool Matches(const std::string &value,
+             const std::optional<std::string_view> &filter) {
+  return !filter || MatchesLikePattern(value, *filter);
+}
+
+bool MatchesType(const std::string &type,
+                 const std::vector<std::string_view> &table_types) {
+  if (table_types.empty()) {
+    return true;
+  }
+  for (auto table_type : table_types) {
+    if (type == table_type) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Key of a table in the lookup the columns are matched against
+std::string TableKey(const std::string &catalog, const std::string &schema,
+                     const std::string &table) {
+  std::string key;
+  key.reserve(catalog.size() + schema.size() + table.size() + 2);
+  key.append(catalog).push_back('\0');
+  key.append(schema).push_back('\0');
+  key.append(table);
+  return key;
+}
+
+const char *StreamError(struct ArrowArrayStream *stream) {
+  const char *message = stream->get_last_error(stream);
+  return message ? message : "(no error details)";
+}
+
+const std::string &CellOrEmpty(const std::optional<std::string> &cell) {
+  static const std::string empty;
+  return cell ? *cell : empty;
+}
+
+Status RunMetadataQuery(
+    CubeConnectionImpl *connection, std::string_view query,
+    std::vector<std::vector<std::optional<std::string>>> *rows) {
+  nanoarrow::UniqueArrayStream stream;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  auto status = connection->ExecuteQuery(std::string(query), stream.get(),
+                                         &error);
+  if (error.message) {
+    error.release(&error);
+  }
+  UNWRAP_STATUS(status);
+  return ReadMetadataRows(stream.get(), rows);
+}
+
+// Name quoted for SQL, quotes inside it doubled
+std::string QuoteIdentifier(std::string_view name) {
+  std::string quoted;
+  quoted.reserve(name.size() + 2);
+  quoted.push_back('"');
+  for (char c : name) {
+    if (c == '"') {
+      quoted.push_back('"');
+    }
+    quoted.push_back(c);
+  }
+  quoted.push_back('"');
+  return quoted;
+}
+
+// A minimum or maximum read as text, as the union member its column's type
+// calls for: integers as int64, other numbers as float64 and everything else
+// (text, dates and times) as the text itself
+std::variant<int64_t, double, std::string> BoundValue(std::string text,
+                                                      ArrowType type) {
+  switch (type) {
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+    return static_cast<int64_t>(std::strtoll(text.c_str(), nullptr, 10));
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE:
+  case NANOARROW_TYPE_DECIMAL128:
+    return std::strtod(text.c_str(), nullptr);
+  default:
+    return text;
+  }
+}
+
+// Statistics of the tables of one schema, as GetStatistics lists them
+struct StatisticsTable {
+  const MetadataTable *table;
+  std::shared_ptr<const MetadataTableStatistics> statistics;
+  bool approximate;
+};
+
+struct StatisticsSchema {
+  const MetadataSchema *schema;
+  std::vector<StatisticsTable> tables;
+};
+
+struct StatisticsCatalog {
+  const MetadataCatalog *catalog;
+  std::vector<StatisticsSchema> schemas;
+};
+
+// Union members of statistic_value
+constexpr int8_t kValueInt64 = 0;
+constexpr int8_t kValueFloat64 = 2;
+constexpr int8_t kValueBinary = 3;
+
+ArrowErrorCode SetField(struct ArrowSchema *schema, ArrowType type,
+                        const char *name, bool nullable = true) {
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetType(schema, type));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(schema, name));
+  if (!nullable) {
+    schema->flags &= ~ARROW_FLAG_NULLABLE;
+  }
+  return NANOARROW_OK;
+}
+
+// The schema the ADBC specification gives GetStatistics results
+ArrowErrorCode InitStatisticsSchema(struct ArrowSchema *schema) {
+  ArrowSchemaInit(schema);
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetTypeStruct(schema, 2));
+  NANOARROW_RETURN_NOT_OK(
+      SetField(schema->children[0], NANOARROW_TYPE_STRING, "catalog_name"));
+  NANOARROW_RETURN_NOT_OK(SetField(schema->children[1], NANOARROW_TYPE_LIST,
+                                   "catalog_db_schemas", false));
+
+  struct ArrowSchema *db_schema = schema->children[1]->children[0];
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetTypeStruct(db_schema, 2));
+  NANOARROW_RETURN_NOT_OK(SetField(db_schema->children[0],
+                                   NANOARROW_TYPE_STRING, "db_schema_name"));
+  NANOARROW_RETURN_NOT_OK(SetField(db_schema->children[1], NANOARROW_TYPE_LIST,
+                                   "db_schema_statistics", false));
+
+  struct ArrowSchema *statistic = db_schema->children[1]->children[0];
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetTypeStruct(statistic, 5));
+  NANOARROW_RETURN_NOT_OK(SetField(statistic->children[0],
+                                   NANOARROW_TYPE_STRING, "table_name", false));
+  NANOARROW_RETURN_NOT_OK(
+      SetField(statistic->children[1], NANOARROW_TYPE_STRING, "column_name"));
+  NANOARROW_RETURN_NOT_OK(SetField(statistic->children[2],
+                                   NANOARROW_TYPE_INT16, "statistic_key",
+                                   false));
+  struct ArrowSchema *value = statistic->children[3];
+  NANOARROW_RETURN_NOT_OK(
+      ArrowSchemaSetTypeUnion(value, NANOARROW_TYPE_DENSE_UNION, 4));
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(value, "statistic_value"));
+  value->flags &= ~ARROW_FLAG_NULLABLE;
+  NANOARROW_RETURN_NOT_OK(
+      SetField(value->children[0], NANOARROW_TYPE_INT64, "int64"));
+  NANOARROW_RETURN_NOT_OK(
+      SetField(value->children[1], NANOARROW_TYPE_UINT64, "uint64"));
+  NANOARROW_RETURN_NOT_OK(
+      SetField(value->children[2], NANOARROW_TYPE_DOUBLE, "float64"));
+  NANOARROW_RETURN_NOT_OK(
+      SetField(value->children[3], NANOARROW_TYPE_BINARY, "binary"));
+  return SetField(statistic->children[4], NANOARROW_TYPE_BOOL,
+                  "statistic_is_approximate", false);
+}
+
+ArrowErrorCode AppendStatistic(struct ArrowArray *statistic,
+                               const std::string &table,
+                               const MetadataStatistic &entry,
+                               bool approximate) {
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAppendString(
+      statistic->children[0], ArrowCharView(table.c_str())));
+  if (entry.column) {
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendString(
+        statistic->children[1], ArrowCharView(entry.column->c_str())));
+  } else {
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(statistic->children[1], 1));
+  }
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayAppendInt(statistic->children[2], entry.key));
+  struct ArrowArray *value = statistic->children[3];
+  if (const auto *number = std::get_if<int64_t>(&entry.value)) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayAppendInt(value->children[kValueInt64], *number));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishUnionElement(value, kValueInt64));
+  } else if (const auto *real = std::get_if<double>(&entry.value)) {
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayAppendDouble(value->children[kValueFloat64], *real));
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayFinishUnionElement(value, kValueFloat64));
+  } else {
+    const auto &text = std::get<std::string>(entry.value);
+    struct ArrowBufferView bytes;
+    bytes.data.data = text.data();
+    bytes.size_bytes = static_cast<int64_t>(text.size());
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayAppendBytes(value->children[kValueBinary], bytes));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishUnionElement(value, kValueBinary));
+  }
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayAppendInt(statistic->children[4], approximate ? 1 : 0));
+  return ArrowArrayFinishElement(statistic);
+}
+
+ArrowErrorCode BuildStatistics(const std::vector<StatisticsCatalog> &catalogs,
+                               struct ArrowArray *array) {
+  NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(array));
+  struct ArrowArray *db_schemas = array->children[1];
+  struct ArrowArray *db_schema = db_schemas->children[0];
+  struct ArrowArray *statistics = db_schema->children[1];
+  for (const auto &catalog : catalogs) {
+    NANOARROW_RETURN_NOT_OK(ArrowArrayAppendString(
+        array->children[0], ArrowCharView(catalog.catalog->name.c_str())));
+    for (const auto &schema : catalog.schemas) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendString(
+          db_schema->children[0], ArrowCharView(schema.schema->name.c_str())));
+      for (const auto &table : schema.tables) {
+        for (const auto &entry : table.statistics->statistics) {
+          NANOARROW_RETURN_NOT_OK(
+              AppendStatistic(statistics->children[0], table.table->name,
+                              entry, table.approximate));
+        }
+      }
+      NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(statistics));
+      NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(db_schema));
+    }
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(db_schemas));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayFinishElement(array));
+  }
+  return ArrowArrayFinishBuildingDefault(array, nullptr);
+}
+
+} // namespace
+
+Status
+ReadMetadataRows(struct ArrowArrayStream *stream,
+                 std::vector<std::vector<std::optional<std::string>>> *rows) {
+  nanoarrow::UniqueArrayStream owned;
+  ArrowArrayStreamMove(stream, owned.get());
+
+  nanoarrow::UniqueSchema schema;
+  if (owned->get_schema(owned.get(), schema.get()) != NANOARROW_OK) {
+    return status::IO("Failed to read metadata result schema: ",
+                      StreamError(owned.get()));
+  }
+  nanoarrow::UniqueArrayView view;
+  struct ArrowError arrow_error;
+  if (ArrowArrayViewInitFromSchema(view.get(), schema.get(), &arrow_error) !=
+      NANOARROW_OK) {
+    return status::Internal("Unsupported metadata result: ",
+                            arrow_error.message);
+  }
+
+  while (true) {
+    nanoarrow::UniqueArray array;
+    if (owned->get_next(owned.get(), array.get()) != NANOARROW_OK) {
+      return status::IO("Failed to read metadata result: ",
+                        StreamError(owned.get()));
+    }
+    if (!array->release) {
+      return status::Ok();
+    }
+    if (ArrowArrayViewSetArray(view.get(), array.get(), &arrow_error) !=
+        NANOARROW_OK) {
+      return status::Internal("Invalid metadata result: ",
+                              arrow_error.message);
+    }
+    for (int64_t i = 0; i < array->length; i++) {
+      std::vector<std::optional<std::string>> row;
+      row.reserve(static_cast<size_t>(view->n_children));
+      for (int64_t c = 0; c < view->n_children; c++) {
+        const struct ArrowArrayView *column = view->children[c];
+        if (ArrowArrayViewIsNull(column, i)) {
+          row.emplace_back(std::nullopt);
+          continue;
+        }
+        switch (column->storage_type) {
+        case NANOARROW_TYPE_STRING:
+        case NANOARROW_TYPE_LARGE_STRING:
+        case NANOARROW_TYPE_STRING_VIEW: {
+          struct ArrowStringView value =
+              ArrowArrayViewGetStringUnsafe(column, i);
+          row.emplace_back(std::string(value.data,
+                                       static_cast<size_t>(value.size_bytes)));
+          break;
+        }
+        case NANOARROW_TYPE_BOOL:
+          row.emplace_back(ArrowArrayViewGetIntUnsafe(column, i) ? "YES"
+                                                                 : "NO");
+          break;
+        case NANOARROW_TYPE_INT8:
+        case NANOARROW_TYPE_INT16:
+        case NANOARROW_TYPE_INT32:
+        case NANOARROW_TYPE_INT64:
+        case NANOARROW_TYPE_UINT8:
+        case NANOARROW_TYPE_UINT16:
+        case NANOARROW_TYPE_UINT32:
+        case NANOARROW_TYPE_UINT64:
+          row.emplace_back(
+              std::to_string(ArrowArrayViewGetIntUnsafe(column, i)));
+          break;
+        default:
+          return status::Internal("Unsupported type ",
+                                  ArrowTypeString(column->storage_type),
+                                  " in metadata result column ",
+                                  schema->children[c]->name);
+        }
+      }
+      rows->push_back(std::move(row));
+    }
+  }
+}
+
+bool MatchesLikePattern(std::string_view value, std::string_view pattern) {
+  // Greedy match; on a mismatch, retry from the last '%' one character on
+  size_t v = 0, p = 0;
+  size_t star_p = std::string_view::npos, star_v = 0;
+  while (v < value.size()) {
+    if (p < pattern.size() && pattern[p] == '%') {
+      star_p = p++;
+      star_v = v;
+      continue;
+    }
+    if (p < pattern.size()) {
+      bool escaped = pattern[p] == '\\' && p + 1 < pattern.size();
+      char expected = escaped ? pattern[p + 1] : pattern[p];
+      if ((!escaped && expected == '_') || expected == value[v]) {
+        p += escaped ? 2 : 1;
+        v++;
+        continue;
+      }
+    }
+    if (star_p == std::string_view::npos) {
+      return false;
+    }
+    p = star_p + 1;
+    v = ++star_v;
+  }
+  while (p < pattern.size() && pattern[p] == '%') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+const MetadataTable *MetadataModel::FindTable(const std::string &db_schema,
+                                              const std::string &table) const {
+  const auto &index = db_schema.empty() ? tables_by_name : tables_by_schema;
+  auto it = index.find(db_schema.empty() ? table
+                                         : TableKey(db_schema, table, ""));
+  return it == index.end() ? nullptr : it->second;
+}
+
+Status LoadMetadataModel(CubeConnectionImpl *connection, bool with_columns,
+                         MetadataModel *out) {
+  std::vector<std::vector<std::optional<std::string>>> rows;
+  UNWRAP_STATUS(RunMetadataQuery(connection, kTablesQuery, &rows));
+
+  // One pass over the tables builds the tree; catalogs and schemas are
+  // listed once each, in the order the server first returns them
+  std::unordered_map<std::string, size_t> catalog_index;
+  std::unordered_map<std::string, size_t> schema_index;
+  for (auto &row : rows) {
+    if (row.size() < 4 || !row[0] || !row[1] || !row[2]) {
+      continue;
+    }
+    const std::string &catalog = *row[0];
+    auto [catalog_it, new_catalog] =
+        catalog_index.emplace(catalog, out->catalogs.size());
+    if (new_catalog) {
+      out->catalogs.push_back(MetadataCatalog{catalog, {}});
+    }
+    MetadataCatalog &catalog_entry = out->catalogs[catalog_it->second];
+    auto [schema_it, new_schema] =
+        schema_index.emplace(TableKey(catalog, *row[1], ""),
+                             catalog_entry.schemas.size());
+    if (new_schema) {
+      catalog_entry.schemas.push_back(MetadataSchema{*row[1], {}});
+    }
+    const std::string &type = CellOrEmpty(row[3]);
+    if (std::find(out->table_types.begin(), out->table_types.end(), type) ==
+        out->table_types.end()) {
+      out->table_types.push_back(type);
+    }
+    catalog_entry.schemas[schema_it->second].tables.push_back(
+        MetadataTable{*row[2], type, {}});
+  }
+
+  // Table entries no longer move once every table has been added
+  std::unordered_map<std::string, MetadataTable *> tables;
+  for (auto &catalog : out->catalogs) {
+    for (auto &schema : catalog.schemas) {
+      for (auto &table : schema.tables) {
+        tables.emplace(TableKey(catalog.name, schema.name, table.name),
+                       &table);
+        out->tables_by_schema.emplace(TableKey(schema.name, table.name, ""),
+                                      &table);
+        out->tables_by_name.emplace(table.name, &table);
+      }
+    }
+  }
+  if (!with_columns) {
+    return status::Ok();
+  }
+
+  rows.clear();
+  UNWRAP_STATUS(RunMetadataQuery(connection, kColumnsQuery, &rows));
+  for (auto &row : rows) {
+    if (row.size() < 7 || !row[0] || !row[1] || !row[2] || !row[3]) {
+      continue;
+    }
+    auto it = tables.find(TableKey(*row[0], *row[1], *row[2]));
+    if (it == tables.end()) {
+      continue;
+    }
+    auto &columns = it->second->columns;
+    int32_t ordinal = static_cast<int32_t>(columns.size() + 1);
+    if (row[4]) {
+      ordinal = static_cast<int32_t>(std::strtol(row[4]->c_str(), nullptr, 10));
+    }
+    columns.push_back(MetadataColumn{*row[3], ordinal, CellOrEmpty(row[5]),
+                                     CellOrEmpty(row[6])});
+  }
+  out->has_columns = true;
+  return status::Ok();
+}
+
+Status LoadTableStatistics(CubeConnectionImpl *connection,
+                           const std::string &db_schema,
+                           const MetadataTable &table,
+                           MetadataTableStatistics *out) {
+  std::string from = " FROM ";
+  if (!db_schema.empty()) {
+    from += QuoteIdentifier(db_schema) + ".";
+  }
+  from += QuoteIdentifier(table.name);
+
+  std::vector<std::vector<std::optional<std::string>>> rows;
+  UNWRAP_STATUS(RunMetadataQuery(connection, "SELECT COUNT(*)" + from, &rows));
+  if (!rows.empty() && !rows[0].empty() && rows[0][0]) {
+    out->statistics.push_back(MetadataStatistic{
+        std::nullopt, ADBC_STATISTIC_ROW_COUNT_KEY,
+        static_cast<int64_t>(std::strtoll(rows[0][0]->c_str(), nullptr, 10))});
+  }
+
+  // Bounds are read as text, so every column type comes back the same way
+  for (const auto &column : table.columns) {
+    std::string name = QuoteIdentifier(column.name);
+    std::string query = "SELECT COUNT(DISTINCT " + name + "), CAST(MIN(" +
+                        name + ") AS TEXT), CAST(MAX(" + name + ") AS TEXT)" +
+                        from;
+    rows.clear();
+    if (!RunMetadataQuery(connection, query, &rows).ok() || rows.empty() ||
+        rows[0].size() < 3) {
+      continue;
+    }
+    auto &row = rows[0];
+    if (row[0]) {
+      out->statistics.push_back(MetadataStatistic{
+          column.name, ADBC_STATISTIC_DISTINCT_COUNT_KEY,
+          static_cast<int64_t>(std::strtoll(row[0]->c_str(), nullptr, 10))});
+    }
+    ArrowType type = CubeTypeMapper::MapCubeTypeToArrowType(column.data_type);
+    if (row[1]) {
+      out->statistics.push_back(
+          MetadataStatistic{column.name, ADBC_STATISTIC_MIN_VALUE_KEY,
+                            BoundValue(std::move(*row[1]), type)});
+    }
+    if (row[2]) {
+      out->statistics.push_back(
+          MetadataStatistic{column.name, ADBC_STATISTIC_MAX_VALUE_KEY,
+                            BoundValue(std::move(*row[2]), type)});
+    }
+  }
+  return status::Ok();
+}
+
+std::vector<uint8_t> EncodeMetadataModel(const MetadataModel &model) {
+  std::vector<uint8_t> out;
+  MessageCodec::PutU32(out, kSnapshotLayout);
+  MessageCodec::PutU8(out, model.has_columns ? 1 : 0);
+  MessageCodec::PutU32(out, static_cast<uint32_t>(model.table_types.size()));
+  for (const auto &type : model.table_types) {
+    MessageCodec::PutString(out, type);
+  }
+  MessageCodec::PutU32(out, static_cast<uint32_t>(model.catalogs.size()));
+  for (const auto &catalog : model.catalogs) {
+    MessageCodec::PutString(out, catalog.name);
+    MessageCodec::PutU32(out, static_cast<uint32_t>(catalog.schemas.size()));
+    for (const auto &schema : catalog.schemas) {
+      MessageCodec::PutString(out, schema.name);
+      MessageCodec::PutU32(out, static_cast<uint32_t>(schema.tables.size()));
+      for (const auto &table : schema.tables) {
+        MessageCodec::PutString(out, table.name);
+        MessageCodec::PutString(out, table.type);
+        MessageCodec::PutU32(out,
+                             static_cast<uint32_t>(table.columns.size()));
+        for (const auto &column : table.columns) {
+          MessageCodec::PutString(out, column.name);
+          MessageCodec::PutU32(
+              out, static_cast<uint32_t>(column.ordinal_position));
+          MessageCodec::PutString(out, column.data_type);
+          MessageCodec::PutString(out, column.is_nullable);
+        }
+      }
+    }
+  }
+  return out;
+}
+
+bool DecodeMetadataModel(const std::vector<uint8_t> &snapshot,
+                         MetadataModel *out) {
+  MessageReader reader(snapshot.data(), snapshot.size());
+  if (reader.U32() != kSnapshotLayout) {
+    return false;
+  }
+  // Every item takes at least 4 bytes, so a corrupt count fails the
+  // reader instead of running on
+  const uint8_t *end = snapshot.data() + snapshot.size();
+  auto count = [&reader, end]() -> uint32_t {
+    uint32_t n = reader.U32();
+    if (n > static_cast<size_t>(end - reader.position()) / 4) {
+      reader.Fail("Count exceeds snapshot");
+      return 0;
+    }
+    return n;
+  };
+  out->has_columns = reader.U8() != 0;
+  for (uint32_t i = 0, n = count(); i < n && reader.ok(); i++) {
+    out->table_types.emplace_back(reader.String());
+  }
+  for (uint32_t i = 0, n = count(); i < n && reader.ok(); i++) {
+    MetadataCatalog &catalog = out->catalogs.emplace_back();
+    catalog.name = reader.String();
+    for (uint32_t j = 0, m = count(); j < m && reader.ok(); j++) {
+      MetadataSchema &schema = catalog.schemas.emplace_back();
+      schema.name = reader.String();
+      for (uint32_t k = 0, t = count(); k < t && reader.ok(); k++) {
+        MetadataTable &table = schema.tables.emplace_back();
+        table.name = reader.String();
+        table.type = reader.String();
+        for (uint32_t c = 0, cs = count(); c < cs && reader.ok(); c++) {
+          MetadataColumn &column = table.columns.emplace_back();
+          column.name = reader.String();
+          column.ordinal_position = static_cast<int32_t>(reader.U32());
+          column.data_type = reader.String();
+          column.is_nullable = reader.String();
+        }
+      }
+    }
+  }
+  if (!reader.ok()) {
+    return false;
+  }
+  // Table entries no longer move once every table has been added
+  for (auto &catalog : out->catalogs) {
+    for (auto &schema : catalog.schemas) {
+      for (auto &table : schema.tables) {
+        out->tables_by_schema.emplace(TableKey(schema.name, table.name, ""),
+                                      &table);
+        out->tables_by_name.emplace(table.name, &table);
+      }
+    }
+  }
+  return true;
+}
+
+std::shared_ptr<CubeMetadataCache::Partition>
+CubeMetadataCache::FindPartition(const std::string &token) const {
+  return partitions_.Read(
+      [&](const std::shared_ptr<const Partitions> &partitions) {
+        auto it = partitions->find(token);
+        return it != partitions->end() ? it->second : nullptr;
+      });
+}
+
+std::shared_ptr<CubeMetadataCache::Partition>
+CubeMetadataCache::AddPartition(const std::string &token,
+                                std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto current = partitions_.Load();
+  auto it = current->find(token);
+  if (it != current->end()) {
+    return it->second;
+  }
+  // Partitions of tokens no longer in use go once their model is stale,
+  // unless one is being loaded for them
+  auto partitions = std::make_shared<Partitions>();
+  for (const auto &[key, partition] : *current) {
+    auto entry = partition->entry.Load();
+    bool stale = !entry || now - entry->loaded >= ttl_;
+    if (stale && partition->loading.try_lock()) {
+      partition->loading.unlock();
+      continue;
+    }
+    partitions->emplace(key, partition);
+  }
+  auto partition = std::make_shared<Partition>();
+  partitions->emplace(token, partition);
+  partitions_.Store(std::move(partitions));
+  return partition;
+}
+
+Result<std::shared_ptr<const MetadataModel>>
+CubeMetadataCache::Get(CubeConnectionImpl *connection) {
+  const std::string &token = connection->token();
+  auto now = std::chrono::steady_clock::now();
+  auto fresh = [&](const std::shared_ptr<const Entry> &entry) {
+    return entry && now - entry->loaded < ttl_ ? entry->model : nullptr;
+  };
+  auto model = partitions_.Read(
+      [&](const std::shared_ptr<const Partitions> &partitions)
+          -> std::shared_ptr<const MetadataModel> {
+        auto it = partitions->find(token);
+        return it != partitions->end() ? it->second->entry.Read(fresh)
+                                       : nullptr;
+      });
+  if (model) {
+    return model;
+  }
+  auto partition = AddPartition(token, now);
+  // One connection per token loads it; the others under the token wait
+  // for it here, and the other tokens do not wait at all
+  std::lock_guard<std::mutex> loading(partition->loading);
+  if (auto model = partition->entry.Read(fresh)) {
+    return model;
+  }
+  auto loaded = std::make_shared<MetadataModel>();
+  std::string model_version;
+  bool restored = false;
+  if (disk_cache_) {
+    model_version =
+        connection->server_parameter(HANDSHAKE_MODEL_VERSION).value_or("");
+    std::vector<uint8_t> snapshot;
+    restored = disk_cache_->FindSnapshot(connection->token(), model_version,
+                                         &snapshot) &&
+               DecodeMetadataModel(snapshot, loaded.get());
+    if (!restored) {
+      *loaded = MetadataModel();
+    }
+  }
+  if (!restored) {
+    UNWRAP_STATUS(LoadMetadataModel(connection, /*with_columns=*/true,
+                                    loaded.get()));
+    if (disk_cache_) {
+      disk_cache_->InsertSnapshot(connection->token(), model_version,
+                                  EncodeMetadataModel(*loaded));
+    }
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->model = std::move(loaded);
+  entry->loaded = now;
+  {
+    // Published even if Invalidate dropped the partition meanwhile; it is
+    // then no longer found, and the next lookup loads the model again
+    std::lock_guard<std::mutex> publish(partition->publish);
+    partition->entry.Store(entry);
+  }
+  return entry->model;
+}
+
+Result<std::shared_ptr<const MetadataTableStatistics>>
+CubeMetadataCache::GetStatistics(CubeConnectionImpl *connection,
+                                 const std::string &db_schema,
+                                 const MetadataTable &table, bool approximate,
+                                 bool *cached) {
+  *cached = false;
+  std::string key = TableKey(db_schema, table.name, "");
+  auto partition = FindPartition(connection->token());
+  if (!partition) {
+    auto statistics = std::make_shared<MetadataTableStatistics>();
+    UNWRAP_STATUS(
+        LoadTableStatistics(connection, db_schema, table, statistics.get()));
+    return statistics;
+  }
+  if (approximate) {
+    auto kept = partition->entry.Read(
+        [&](const std::shared_ptr<const Entry> &entry)
+            -> std::shared_ptr<const MetadataTableStatistics> {
+          if (!entry) {
+            return nullptr;
+          }
+          auto it = entry->statistics.find(key);
+          return it != entry->statistics.end() ? it->second : nullptr;
+        });
+    if (kept) {
+      *cached = true;
+      return kept;
+    }
+  }
+  // The model the statistics are read for; they are kept with it only
+  auto model = partition->entry.Read(
+      [](const std::shared_ptr<const Entry> &entry)
+          -> std::shared_ptr<const MetadataModel> {
+        return entry ? entry->model : nullptr;
+      });
+  // Read without a lock, so that lookups and loads of other tables and
+  // tokens do not wait for these queries
+  auto statistics = std::make_shared<MetadataTableStatistics>();
+  UNWRAP_STATUS(
+      LoadTableStatistics(connection, db_schema, table, statistics.get()));
+  if (!model) {
+    return statistics;
+  }
+  // Kept in a copy of the entry, since published entries are never
+  // changed, unless the model was loaded again meanwhile
+  std::lock_guard<std::mutex> publish(partition->publish);
+  auto current = partition->entry.Load();
+  if (current && current->model == model) {
+    auto updated = std::make_shared<Entry>(*current);
+    updated->statistics[key] = statistics;
+    partition->entry.Store(std::move(updated));
+  }
+  return statistics;
+}
+
+void CubeMetadataCache::Invalidate() {
+  // Loads in progress finish into the partitions dropped here, which no
+  // lookup finds any more
+  std::lock_guard<std::mutex> lock(mutex_);
+  partitions_.Store(std::make_shared<Partitions>());
+}
+
+Status ReadStatistics(CubeConnectionImpl *connection,
+                      std::optional<std::string_view> catalog_filter,
+                      std::optional<std::string_view> schema_filter,
+                      std::optional<std::string_view> table_filter,
+                      bool approximate, struct ArrowArrayStream *out) {
+  const auto &cache = connection->metadata_cache();
+  std::shared_ptr<const MetadataModel> model;
+  if (cache) {
+    UNWRAP_RESULT(model, cache->Get(connection));
+  } else {
+    auto loaded = std::make_shared<MetadataModel>();
+    UNWRAP_STATUS(
+        LoadMetadataModel(connection, /*with_columns=*/true, loaded.get()));
+    model = std::move(loaded);
+  }
+
+  std::vector<StatisticsCatalog> catalogs;
+  for (const auto &catalog : model->catalogs) {
+    if (!Matches(catalog.name, catalog_filter)) {
+      continue;
+    }
+    StatisticsCatalog &catalog_match = catalogs.emplace_back();
+    catalog_match.catalog = &catalog;
+    for (const auto &schema : catalog.schemas) {
+      if (!Matches(schema.name, schema_filter)) {
+        continue;
+      }
+      StatisticsSchema &schema_match = catalog_match.schemas.emplace_back();
+      schema_match.schema = &schema;
+      for (const auto &table : schema.tables) {
+        if (!Matches(table.name, table_filter)) {
+          continue;
+        }
+        StatisticsTable &table_match = schema_match.tables.emplace_back();
+        table_match.table = &table;
+        table_match.approximate = false;
+        if (cache) {
+          UNWRAP_RESULT(table_match.statistics,
+                        cache->GetStatistics(connection, schema.name, table,
+                                             approximate,
+                                             &table_match.approximate));
+        } else {
+          auto statistics = std::make_shared<MetadataTableStatistics>();
+          UNWRAP_STATUS(LoadTableStatistics(connection, schema.name, table,
+                                            statistics.get()));
+          table_match.statistics = std::move(statistics);
+        }
+      }
+    }
+  }
+
+  nanoarrow::UniqueSchema schema;
+  nanoarrow::UniqueArray array;
+  if (InitStatisticsSchema(schema.get()) != NANOARROW_OK ||
+      ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr) !=
+          NANOARROW_OK ||
+      BuildStatistics(catalogs, array.get()) != NANOARROW_OK) {
+    return status::Internal("Failed to build statistics result");
+  }
+  driver::MakeArrayStream(schema.get(), array.get(), out);
+  return status::Ok();
+}
+
+Status CubeGetObjectsHelper::Load(
+    driver::GetObjectsDepth depth,
+    std::optional<std::string_view> catalog_filter,
+    std::optional<std::string_view> schema_filter,
+    std::optional<std::string_view> table_filter,
+    std::optional<std::string_view> column_filter,
+    const std::vector<std::string_view> &table_types) {
+  catalogs_.clear();
+  column_filter_.reset();
+  if (const auto &cache = connection_->metadata_cache()) {
+    UNWRAP_RESULT(model_, cache->Get(connection_));
+  } else {
+    auto model = std::make_shared<MetadataModel>();
+    UNWRAP_STATUS(LoadMetadataModel(
+        connection_, depth == driver::GetObjectsDepth::kColumns, model.get()));
+    model_ = std::move(model);
+  }
+  if (column_filter) {
+    column_filter_ = std::string(*column_filter);
+  }
+
+  // Catalogs and schemas are listed even when everything in them is
+  // filtered out at a deeper level
+  bool want_schemas = depth != driver::GetObjectsDepth::kCatalogs;
+  bool want_tables =
+      want_schemas && depth != driver::GetObjectsDepth::kSchemas;
+  for (const auto &catalog : model_->catalogs) {
+    if (!Matches(catalog.name, catalog_filter)) {
+      continue;
+    }
+    CatalogMatch &catalog_match = catalogs_.emplace_back();
+    catalog_match.catalog = &catalog;
+    if (!want_schemas) {
+      continue;
+    }
+    for (const auto &schema : catalog.schemas) {
+      if (!Matches(schema.name, schema_filter)) {
+        continue;
+      }
+      SchemaMatch &schema_match = catalog_match.schemas.emplace_back();
+      schema_match.schema = &schema;
+      if (!want_tables) {
+        continue;
+      }
+      for (const auto &table : schema.tables) {
+        if (Matches(table.name, table_filter) &&
+            MatchesType(table.type, table_types)) {
+          schema_match.tables.push_back(&table);
+        }
+      }
+    }
+  }
+  return status::Ok();
+}
+
+Status CubeGetObjectsHelper::LoadCatalogs(
+    std::optional<std::string_view> catalog_filter) {
+  next_catalog_ = 0;
+  return status::Ok();
+}
+
+Result<std::optional<std::string_view>> CubeGetObjectsHelper::NextCatalog() {
+  if (next_catalog_ >= catalogs_.size()) {
+    return std::nullopt;
+  }
+  catalog_ = &catalogs_[next_catalog_++];
+  return catalog_->catalog->name;
+}
+
+Status CubeGetObjectsHelper::LoadSchemas(
+    std::string_view catalog, std::optional<std::string_view> schema_filter) {
+  next_schema_ = 0;
+  return status::Ok();
+}
+
+Result<std::optional<std::string_view>> CubeGetObjectsHelper::NextSchema() {
+  if (!catalog_ || next_schema_ >= catalog_->schemas.size()) {
+    return std::nullopt;
+  }
+  schema_ = &catalog_->schemas[next_schema_++];
+  return schema_->schema->name;
+}
+
+Status CubeGetObjectsHelper::LoadTables(
+    std::string_view catalog, std::string_view schema,
+    std::optional<std::string_view> table_filter,
+    const std::vector<std::string_view> &table_types) {
+  next_table_ = 0;
+  return status::Ok();
+}
+
+Result<std::optional<driver::GetObjectsHelper::Table>>
+CubeGetObjectsHelper::NextTable() {
+  if (!schema_ || next_table_ >= schema_->tables.size()) {
+    return std::nullopt;
+  }
+  table_ = schema_->tables[next_table_++];
+  return Table{table_->name, table_->type};
+}
+
+Status CubeGetObjectsHelper::LoadColumns(
+    std::string_view catalog, std::string_view schema, std::string_view table,
+    std::optional<std::string_view> column_filter) {
+  next_column_ = 0;
+  return status::Ok();
+}
+
+Result<std::optional<driver::GetObjectsHelper::Column>>
+CubeGetObjectsHelper::NextColumn() {
+  if (!table_) {
+    return std::nullopt;
+  }
+  while (next_column_ < table_->columns.size() && column_filter_ &&
+         !MatchesLikePattern(table_->columns[next_column_].name,
+                             *column_filter_)) {
+    next_column_++;
+  }
+  if (next_column_ >= table_->columns.size()) {
+    return std::nullopt;
+  }
+  const MetadataColumn &entry = table_->columns[next_column_++];
+  Column column;
+  column.column_name = entry.name;
+  column.ordinal_position = entry.ordinal_position;
+  ColumnXdbc xdbc;
+  if (!entry.data_type.empty()) {
+    xdbc.xdbc_type_name = entry.data_type;
+  }
+  if (!entry.is_nullable.empty()) {
+    xdbc.xdbc_is_nullable = entry.is_nullable;
+    xdbc.xdbc_nullable = entry.is_nullable == "NO" ? 0 : 1;
+  }
+  column.xdbc = xdbc;
+  return column;
+}
+
 MetadataBuilder::MetadataBuilder() {}
 
 MetadataBuilder::~MetadataBuilder() {}
 
 void MetadataBuilder::AddColumn(const std::string &column_name,
-                                const std::string &cube_sql_type) {
+                                const std::string &cube_sql_type,
+                                bool nullable) {
   column_names_.push_back(column_name);
   column_types_.push_back(cube_sql_type);
+  column_nullable_.push_back(nullable);
 }
 
-struct ArrowSchema MetadataBuilder::Build() {
-  struct ArrowSchema schema = {};
-
-  // Initialize schema structure
-  schema.format = "+sn"; // Struct type with no nullability
-  schema.n_children = static_cast<int64_t>(column_names_.size());
-
-  if (schema.n_children == 0) {
-    schema.release(&schema);
-    return schema;
-  }
-
-  // Allocate children array
-  schema.children = static_cast<struct ArrowSchema **>(
-      malloc(schema.n_children * sizeof(struct ArrowSchema *)));
-
-  // Build each child field
-  for (int64_t i = 0; i < schema.n_children; i++) {
-    schema.children[i] =
-        static_cast<struct ArrowSchema *>(malloc(sizeof(struct ArrowSchema)));
-    struct ArrowSchema *child = schema.children[i];
-
-    ArrowSchemaInit(child);
-
-    // Set field name
-    ArrowSchemaSetName(child, column_names_[i].c_str());
-
-    // Set Arrow type based on Cube SQL type
-    ArrowType arrow_type =
-        CubeTypeMapper::MapCubeTypeToArrowType(column_types_[i]);
-
-    // Format string for type
-    switch (arrow_type) {
-    case NANOARROW_TYPE_BOOL:
-      child->format = "c";
-      break;
-    case NANOARROW_TYPE_INT8:
-      child->format = "c";
-      break;
-    case NANOARROW_TYPE_INT16:
-      child->format = "s";
-      break;
-    case NANOARROW_TYPE_INT32:
-      child->format = "i";
-      break;
-    case NANOARROW_TYPE_INT64:
-      child->format = "l";
-      break;
-    case NANOARROW_TYPE_UINT8:
-      child->format = "C";
-      break;
-    case NANOARROW_TYPE_UINT16:
-      child->format = "S";
-      break;
-    case NANOARROW_TYPE_UINT32:
-      child->format = "I";
-      break;
-    case NANOARROW_TYPE_UINT64:
-      child->format = "L";
-      break;
-    case NANOARROW_TYPE_FLOAT:
-      child->format = "f";
-      break;
-    case NANOARROW_TYPE_DOUBLE:
-      child->format = "g";
-      break;
-    case NANOARROW_TYPE_STRING:
-      child->format = "u";
-      break;
-    case NANOARROW_TYPE_BINARY:
-      child->format = "z";
-      break;
-    case NANOARROW_TYPE_DATE32:
-      child->format = "tdD";
-      break;
-    case NANOARROW_TYPE_TIME64:
-      child->format = "ttu";
-      break;
-    case NANOARROW_TYPE_TIMESTAMP:
-      child->format = "tsu:";
-      break;
-    default:
-      child->format = "z"; // Binary as fallback
-      break;
-    }
-
-    // Store metadata about original Cube SQL type
-    child->metadata =
-        nullptr; // Simplified: would store type mapping in metadata
-  }
-
-  // Set parent schema release function
-  schema.release = [](struct ArrowSchema *s) {
-    if (s->children != nullptr) {
-      for (int64_t i = 0; i < s->n_children; i++) {
-        if (s->children[i] != nullptr) {
-          if (s->children[i]->release != nullptr) {
-            s->children[i]->release(s->children[i]);
-          }
-          free(s->children[i]);
-        }
-      }
-      free(s->children);
+Status MetadataBuilder::Build(struct ArrowSchema *out) const {
+  nanoarrow::UniqueSchema schema;
+  ArrowSchemaInit(schema.get());
+  if (ArrowSchemaSetTypeStruct(schema.get(),
+                               static_cast<int64_t>(column_names_.size())) !=
+      NANOARROW_OK) {
+    return status::Internal("Failed to allocate table schema");
+  }
+
+  for (size_t i = 0; i < column_names_.size(); i++) {
+    struct ArrowSchema *child = schema->children[i];
+    CubeTypeInfo info = CubeTypeMapper::ParseCubeType(column_types_[i]);
+    ArrowType type = info.type;
+    ArrowErrorCode code;
+    if (type == NANOARROW_TYPE_TIMESTAMP) {
+      code = ArrowSchemaSetTypeDateTime(child, type, NANOARROW_TIME_UNIT_MICRO,
+                                        info.with_time_zone ? "UTC" : nullptr);
+    } else if (type == NANOARROW_TYPE_TIME64) {
+      code = ArrowSchemaSetTypeDateTime(child, type, NANOARROW_TIME_UNIT_MICRO,
+                                        nullptr);
+    } else {
+      code = ArrowSchemaSetType(child, type);
     }
-    s->children = nullptr;
-    s->n_children = 0;
-  };
+    if (code == NANOARROW_OK) {
+      code = ArrowSchemaSetName(child, column_names_[i].c_str());
+    }
+    if (code != NANOARROW_OK) {
+      return status::Internal("Failed to build schema for column ",
+                              column_names_[i]);
+    }
+    if (!column_nullable_[i]) {
+      child->flags &= ~ARROW_FLAG_NULLABLE;
+    }
+  }
 
-  return schema;
+  ArrowSchemaMove(schema.get(), out);
+  return status::Ok();
+}
+
+bool TableSchemaCache::Get(const std::string &db_schema,
+                           const std::string &table, struct ArrowSchema *out) {
+  auto it = entries_.find(TableKey(db_schema, table, ""));
+  if (it == entries_.end()) {
+    return false;
+  }
+  if (std::chrono::steady_clock::now() >= it->second.expires) {
+    entries_.erase(it);
+    return false;
+  }
+  return ArrowSchemaDeepCopy(it->second.schema.get(), out) == NANOARROW_OK;
+}
+
+void TableSchemaCache::Put(const std::string &db_schema,
+                           const std::string &table,
+                           const struct ArrowSchema *schema) {
+  Entry entry;
+  if (ArrowSchemaDeepCopy(schema, entry.schema.get()) != NANOARROW_OK) {
+    return;
+  }
+  entry.expires = std::chrono::steady_clock::now() + ttl_;
+  entries_[TableKey(db_schema, table, "")] = std::move(entry);
 }
 
 } // namespace adbc::cube
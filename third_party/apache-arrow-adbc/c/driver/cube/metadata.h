@@ -17,14 +17,261 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
-#include <nanoarrow/nanoarrow.h>
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/snapshot.h"
+#include "driver/framework/objects.h"
+#include "driver/framework/status.h"
 
 namespace adbc::cube {
 
+using driver::Result;
+using driver::Status;
+namespace status = adbc::driver::status;
+
+class CubeConnectionImpl;
+class CubeDiskCache;
+
+// Read every row of a metadata query result, each cell rendered as text
+// (integers in decimal, nulls as std::nullopt). The stream is released.
+Status
+ReadMetadataRows(struct ArrowArrayStream *stream,
+                 std::vector<std::vector<std::optional<std::string>>> *rows);
+
+// Whether value matches a SQL LIKE pattern ('%' any run, '_' any one
+// character, '\\' escapes the next one)
+bool MatchesLikePattern(std::string_view value, std::string_view pattern);
+
+// Cube's data model as information_schema reports it: cubes and views are
+// the tables, their measures and dimensions the columns
+struct MetadataColumn {
+  std::string name;
+  int32_t ordinal_position;
+  std::string data_type;
+  std::string is_nullable; // "YES" or "NO"
+};
+
+struct MetadataTable {
+  std::string name;
+  std::string type;
+  std::vector<MetadataColumn> columns;
+};
+
+struct MetadataSchema {
+  std::string name;
+  std::vector<MetadataTable> tables;
+};
+
+struct MetadataCatalog {
+  std::string name;
+  std::vector<MetadataSchema> schemas;
+};
+
+// The whole model, in the order the server lists it. Indexes point into
+// catalogs, so a model is not copied once loaded.
+struct MetadataModel {
+  std::vector<MetadataCatalog> catalogs;
+  std::vector<std::string> table_types; // Distinct, in order of appearance
+  bool has_columns = false;
+
+  // The table in db_schema, or with an empty db_schema the first one of
+  // that name; nullptr if there is none
+  const MetadataTable *FindTable(const std::string &db_schema,
+                                 const std::string &table) const;
+
+  std::unordered_map<std::string, const MetadataTable *> tables_by_schema;
+  std::unordered_map<std::string, const MetadataTable *> tables_by_name;
+};
+
+// Read information_schema.tables, and information_schema.columns when
+// with_columns is set, in one query each
+Status LoadMetadataModel(CubeConnectionImpl *connection, bool with_columns,
+                         MetadataModel *out);
+
+// The model as a snapshot for CubeDiskCache, and back; false if the
+// snapshot is malformed or of another layout
+std::vector<uint8_t> EncodeMetadataModel(const MetadataModel &model);
+bool DecodeMetadataModel(const std::vector<uint8_t> &snapshot,
+                         MetadataModel *out);
+
+// A statistic of a table (no column) or of one of its columns, keyed by
+// an ADBC_STATISTIC_*_KEY; the value is carried as the int64, float64 or
+// binary member of the statistic_value union
+struct MetadataStatistic {
+  std::optional<std::string> column;
+  int16_t key;
+  std::variant<int64_t, double, std::string> value;
+};
+
+struct MetadataTableStatistics {
+  std::vector<MetadataStatistic> statistics;
+};
+
+// Read a table's row count, then each column's distinct count, minimum and
+// maximum, with one aggregate query per column. Cube answers them from a
+// matching pre-aggregation in CubeStore when the data model has one. A
+// column whose query fails (a measure that cannot be aggregated that way,
+// say) is left without statistics.
+Status LoadTableStatistics(CubeConnectionImpl *connection,
+                           const std::string &db_schema,
+                           const MetadataTable &table,
+                           MetadataTableStatistics *out);
+
+// A database's data model, loaded once per token and shared by its
+// connections.
+// It is loaded again once older than the ttl, or after Invalidate (called
+// when a connection changes the model itself), so GetObjects,
+// GetTableSchema and GetTableTypes are answered from memory in between.
+// Each token's model is published as immutable snapshots (see
+// CubeSnapshot) in a partition of its own, so the connections looking
+// them up take no lock and do not hold each other up, and publishing one
+// copies nothing of the other tokens'. Models and statistics are read
+// from the server without holding a lock other tokens need: one
+// connection per token loads its model while the others under that token
+// wait for it, and statistics are kept only if the model they were read
+// for is still the token's.
+// With a disk cache, a model not in memory is first looked for there (as
+// a snapshot stored under the same data model version the server now
+// reports), and each model loaded is stored there, so a restarted process
+// need not read it again.
+class CubeMetadataCache {
+public:
+  explicit CubeMetadataCache(std::chrono::milliseconds ttl,
+                             std::shared_ptr<CubeDiskCache> disk_cache = {})
+      : ttl_(ttl), disk_cache_(std::move(disk_cache)),
+        partitions_(std::make_shared<Partitions>()) {}
+
+  // The model the connection's token sees, loaded through connection if
+  // it is missing or stale
+  Result<std::shared_ptr<const MetadataModel>>
+  Get(CubeConnectionImpl *connection);
+  // Statistics of a table of the model, kept with it until it is loaded
+  // again: the kept ones when approximate ones will do (*cached is then
+  // set), otherwise read through connection and kept
+  Result<std::shared_ptr<const MetadataTableStatistics>>
+  GetStatistics(CubeConnectionImpl *connection, const std::string &db_schema,
+                const MetadataTable &table, bool approximate, bool *cached);
+  void Invalidate();
+
+private:
+  // Never changed once published
+  struct Entry {
+    std::shared_ptr<const MetadataModel> model;
+    std::chrono::steady_clock::time_point loaded;
+    // By schema and table name
+    std::unordered_map<std::string,
+                       std::shared_ptr<const MetadataTableStatistics>>
+        statistics;
+  };
+
+  // A token's model, with the locks of those loading and changing it
+  struct Partition {
+    CubeSnapshot<Entry> entry{nullptr}; // Null until loaded
+    std::mutex loading; // Held while the model is read from the server
+    std::mutex publish; // Serialises changes to entry
+  };
+
+  // By token, since each security context may see another data model
+  using Partitions =
+      std::unordered_map<std::string, std::shared_ptr<Partition>>;
+
+  // The token's partition; null if it has none
+  std::shared_ptr<Partition> FindPartition(const std::string &token) const;
+  // The token's partition, added if it has none, dropping those of tokens
+  // whose models went stale
+  std::shared_ptr<Partition>
+  AddPartition(const std::string &token,
+               std::chrono::steady_clock::time_point now);
+
+  std::chrono::milliseconds ttl_;
+  const std::shared_ptr<CubeDiskCache> disk_cache_; // Null if disabled
+  CubeSnapshot<Partitions> partitions_;
+  std::mutex mutex_; // Serialises changes to partitions_
+};
+
+// GetObjects over the data model: from the connection's CubeMetadataCache
+// when it has one, otherwise read for the call. Load applies the filters
+// locally; the Load* / Next* calls then walk what matched.
+class CubeGetObjectsHelper : public driver::GetObjectsHelper {
+public:
+  explicit CubeGetObjectsHelper(CubeConnectionImpl *connection)
+      : connection_(connection) {}
+
+  Status Load(driver::GetObjectsDepth depth,
+              std::optional<std::string_view> catalog_filter,
+              std::optional<std::string_view> schema_filter,
+              std::optional<std::string_view> table_filter,
+              std::optional<std::string_view> column_filter,
+              const std::vector<std::string_view> &table_types) override;
+
+  Status
+  LoadCatalogs(std::optional<std::string_view> catalog_filter) override;
+  Result<std::optional<std::string_view>> NextCatalog() override;
+
+  Status
+  LoadSchemas(std::string_view catalog,
+              std::optional<std::string_view> schema_filter) override;
+  Result<std::optional<std::string_view>> NextSchema() override;
+
+  Status
+  LoadTables(std::string_view catalog, std::string_view schema,
+             std::optional<std::string_view> table_filter,
+             const std::vector<std::string_view> &table_types) override;
+  Result<std::optional<Table>> NextTable() override;
+
+  Status
+  LoadColumns(std::string_view catalog, std::string_view schema,
+              std::string_view table,
+              std::optional<std::string_view> column_filter) override;
+  Result<std::optional<Column>> NextColumn() override;
+
+private:
+  // What matched the filters, pointing into model_
+  struct SchemaMatch {
+    const MetadataSchema *schema;
+    std::vector<const MetadataTable *> tables;
+  };
+  struct CatalogMatch {
+    const MetadataCatalog *catalog;
+    std::vector<SchemaMatch> schemas;
+  };
+
+  CubeConnectionImpl *connection_; // Non-owning
+  std::shared_ptr<const MetadataModel> model_;
+  std::vector<CatalogMatch> catalogs_;
+  std::optional<std::string> column_filter_;
+
+  // Walk position; the framework visits the tree depth first, so the entry
+  // being loaded is always the one last returned by the level above
+  size_t next_catalog_ = 0;
+  size_t next_schema_ = 0;
+  size_t next_table_ = 0;
+  size_t next_column_ = 0;
+  const CatalogMatch *catalog_ = nullptr;
+  const SchemaMatch *schema_ = nullptr;
+  const MetadataTable *table_ = nullptr;
+};
+
+// GetStatistics over the data model: the tables matching the filters, with
+// their statistics from the connection's CubeMetadataCache when it has one
+// and approximate ones will do, otherwise read for the call
+Status ReadStatistics(CubeConnectionImpl *connection,
+                      std::optional<std::string_view> catalog_filter,
+                      std::optional<std::string_view> schema_filter,
+                      std::optional<std::string_view> table_filter,
+                      bool approximate, struct ArrowArrayStream *out);
+
 // Helper for building Arrow schemas from Cube SQL metadata
 class MetadataBuilder {
 public:
@@ -33,14 +280,40 @@ public:
 
   // Add a column to the schema
   void AddColumn(const std::string &column_name,
-                 const std::string &cube_sql_type);
+                 const std::string &cube_sql_type, bool nullable = true);
 
-  // Build the final Arrow schema
-  struct ArrowSchema Build();
+  // Build the final Arrow schema, types mapped by CubeTypeMapper
+  Status Build(struct ArrowSchema *out) const;
 
 private:
   std::vector<std::string> column_names_;
   std::vector<std::string> column_types_;
+  std::vector<bool> column_nullable_;
+};
+
+// Table schemas returned by GetTableSchema, keyed by (schema, table) and
+// kept for a fixed time, so tools that ask for the same table before every
+// query do not go back to the server
+class TableSchemaCache {
+public:
+  explicit TableSchemaCache(std::chrono::milliseconds ttl) : ttl_(ttl) {}
+
+  // Copy the cached schema into out; false if absent or expired
+  bool Get(const std::string &db_schema, const std::string &table,
+           struct ArrowSchema *out);
+  // Keep a copy of schema
+  void Put(const std::string &db_schema, const std::string &table,
+           const struct ArrowSchema *schema);
+  void Clear() { entries_.clear(); }
+
+private:
+  struct Entry {
+    nanoarrow::UniqueSchema schema;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  std::chrono::milliseconds ttl_;
+  std::unordered_map<std::string, Entry> entries_;
 };
 
 } // namespace adbc::cube
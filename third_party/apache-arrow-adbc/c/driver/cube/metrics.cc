@@ -0,0 +1,293 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/metrics.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#include <cmath>
+#include <cstdio>
+
+namespace adbc::cube {
+
+namespace {
+
+int64_t MicrosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void AppendHeader(std::string *out, const char *name, const char *type,
+                  const char *help) {
+  *out += "# HELP adbc_cube_";
+  *out += name;
+  *out += ' ';
+  *out += help;
+  *out += "\n# TYPE adbc_cube_";
+  *out += name;
+  *out += ' ';
+  *out += type;
+  *out += '\n';
+}
+
+void AppendValue(std::string *out, const char *name, const char *type,
+                 const char *help, const std::atomic<int64_t> &value) {
+  AppendHeader(out, name, type, help);
+  *out += "adbc_cube_";
+  *out += name;
+  *out += ' ';
+  *out += std::to_string(value.load(std::memory_order_relaxed));
+  *out += '\n';
+}
+
+void AppendSeconds(std::string *out, const char *name, const char *suffix,
+                   double seconds) {
+  char line[128];
+  std::snprintf(line, sizeof(line), "adbc_cube_%s%s %.6f\n", name, suffix,
+                seconds);
+  *out += line;
+}
+
+// A histogram of microseconds as a summary in seconds
+void AppendSummary(std::string *out, const char *name, const char *help,
+                   const CubeHistogram &histogram) {
+  AppendHeader(out, name, "summary", help);
+  static constexpr struct {
+    const char *label;
+    double q;
+  } kQuantiles[] = {{"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99},
+                    {"0.999", 0.999}};
+  for (const auto &quantile : kQuantiles) {
+    std::string suffix =
+        std::string("{quantile=\"") + quantile.label + "\"}";
+    AppendSeconds(out, name, suffix.c_str(),
+                  histogram.Quantile(quantile.q) / 1e6);
+  }
+  AppendSeconds(out, name, "_sum", histogram.sum() / 1e6);
+  *out += "adbc_cube_";
+  *out += name;
+  *out += "_count ";
+  *out += std::to_string(histogram.count());
+  *out += '\n';
+}
+
+void AppendLockWaits(std::string *out, const CubeMetrics &metrics) {
+  static constexpr struct {
+    const char *label;
+    CubeLockWaits CubeMetrics::*waits;
+  } kLocks[] = {{"pool", &CubeMetrics::pool_lock},
+                {"result_cache", &CubeMetrics::result_cache_lock},
+                {"schema_cache", &CubeMetrics::schema_cache_lock},
+                {"decode", &CubeMetrics::decode_lock}};
+  AppendHeader(out, "lock_waits_total", "counter",
+               "Times a shared lock was found held by another thread.");
+  for (const auto &lock : kLocks) {
+    *out += "adbc_cube_lock_waits_total{lock=\"";
+    *out += lock.label;
+    *out += "\"} ";
+    *out += std::to_string(
+        (metrics.*lock.waits).waits.load(std::memory_order_relaxed));
+    *out += '\n';
+  }
+  AppendHeader(out, "lock_wait_seconds_total", "counter",
+               "Time spent waiting for shared locks held by other threads.");
+  for (const auto &lock : kLocks) {
+    std::string suffix = std::string("{lock=\"") + lock.label + "\"}";
+    AppendSeconds(
+        out, "lock_wait_seconds_total", suffix.c_str(),
+        (metrics.*lock.waits).wait_nanos.load(std::memory_order_relaxed) /
+            1e9);
+  }
+}
+
+} // namespace
+
+std::unique_lock<std::mutex> CubeLockCounted(std::mutex &mutex,
+                                             CubeLockWaits &waits) {
+  std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    auto start = std::chrono::steady_clock::now();
+    lock.lock();
+    waits.waits.fetch_add(1, std::memory_order_relaxed);
+    waits.wait_nanos.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count(),
+        std::memory_order_relaxed);
+  }
+  return lock;
+}
+
+void CubeHistogram::Record(int64_t value) {
+  if (value < 0) {
+    value = 0;
+  }
+  buckets_[BucketOf(static_cast<uint64_t>(value))].fetch_add(
+      1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+int64_t CubeHistogram::Quantile(double q) const {
+  int64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  auto rank =
+      static_cast<int64_t>(std::ceil(q * static_cast<double>(total)));
+  if (rank < 1) {
+    rank = 1;
+  }
+  int64_t seen = 0;
+  size_t last = 0;
+  for (size_t i = 0; i < kBuckets; i++) {
+    int64_t n = buckets_[i].load(std::memory_order_relaxed);
+    if (n == 0) {
+      continue;
+    }
+    last = i;
+    seen += n;
+    if (seen >= rank) {
+      return UpperBound(i);
+    }
+  }
+  // Counts recorded after count() was read
+  return UpperBound(last);
+}
+
+size_t CubeHistogram::BucketOf(uint64_t value) {
+  constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+  if (value < kSubBuckets) {
+    return static_cast<size_t>(value);
+  }
+  // The top kSubBucketBits + 1 bits: the leading one gives the power of
+  // two, the rest the bucket within it
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - kSubBucketBits;
+  uint64_t sub = (value >> shift) & (kSubBuckets - 1);
+  return static_cast<size_t>((shift + 1) << kSubBucketBits) + sub;
+}
+
+int64_t CubeHistogram::UpperBound(size_t bucket) {
+  constexpr size_t kSubBuckets = size_t{1} << kSubBucketBits;
+  if (bucket < kSubBuckets) {
+    return static_cast<int64_t>(bucket);
+  }
+  int shift = static_cast<int>(bucket >> kSubBucketBits) - 1;
+  uint64_t lower = (kSubBuckets + (bucket & (kSubBuckets - 1))) << shift;
+  uint64_t upper = lower + ((uint64_t{1} << shift) - 1);
+  return upper > static_cast<uint64_t>(INT64_MAX) ? INT64_MAX
+                                                  : static_cast<int64_t>(upper);
+}
+
+CubeMetrics &CubeMetrics::Global() {
+  static CubeMetrics metrics;
+  return metrics;
+}
+
+void CubeMetrics::RecordConnect(std::chrono::steady_clock::time_point start,
+                                bool ok) {
+  if (ok) {
+    connects.fetch_add(1, std::memory_order_relaxed);
+    connect_latency_us.Record(MicrosSince(start));
+  } else {
+    connect_errors.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void CubeMetrics::RecordQuery(std::chrono::steady_clock::time_point sent,
+                              bool ok) {
+  queries.fetch_add(1, std::memory_order_relaxed);
+  if (!ok) {
+    query_errors.fetch_add(1, std::memory_order_relaxed);
+  }
+  query_latency_us.Record(MicrosSince(sent));
+}
+
+int64_t CubeMetrics::ThreadPageFaults() {
+#if defined(__linux__) && defined(RUSAGE_THREAD)
+  struct rusage usage;
+  if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+    return static_cast<int64_t>(usage.ru_minflt) +
+           static_cast<int64_t>(usage.ru_majflt);
+  }
+#endif
+  return 0;
+}
+
+std::string CubeMetrics::Format() const {
+  std::string out;
+  AppendValue(&out, "connects_total", "counter",
+              "Native sessions opened.", connects);
+  AppendValue(&out, "connect_errors_total", "counter",
+              "Native session attempts that failed.", connect_errors);
+  AppendSummary(&out, "connect_latency_seconds",
+                "Time to open a native session, handshake included.",
+                connect_latency_us);
+  AppendValue(&out, "queries_total", "counter",
+              "Native queries completed, failed ones included.", queries);
+  AppendValue(&out, "query_errors_total", "counter",
+              "Native queries that failed.", query_errors);
+  AppendSummary(&out, "query_latency_seconds",
+                "Time from sending a native query to the end of its result.",
+                query_latency_us);
+  AppendValue(&out, "received_bytes_total", "counter",
+              "Native protocol bytes read.", bytes_received);
+  AppendValue(&out, "sent_bytes_total", "counter",
+              "Native protocol bytes written.", bytes_sent);
+  AppendValue(&out, "pool_hits_total", "counter",
+              "Sessions reused from a connection pool.", pool_hits);
+  AppendValue(&out, "pool_misses_total", "counter",
+              "Connection pool lookups that found no usable session.",
+              pool_misses);
+  AppendValue(&out, "admission_waits_total", "counter",
+              "Queries that waited for admission control.", admission_waits);
+  AppendValue(&out, "admission_timeouts_total", "counter",
+              "Queries that gave up waiting for admission control.",
+              admission_timeouts);
+  AppendSummary(&out, "admission_wait_seconds",
+                "Time a query waited for admission control.",
+                admission_wait_us);
+  AppendValue(&out, "hedges_total", "counter",
+              "Queries also sent to a second server.", hedges);
+  AppendValue(&out, "hedge_wins_total", "counter",
+              "Hedged queries the second server answered first.", hedge_wins);
+  AppendValue(&out, "affinity_moves_total", "counter",
+              "Sessions moved to the server a query hashes to.",
+              affinity_moves);
+  AppendValue(&out, "active_connections", "gauge", "Open connections.",
+              active_connections);
+  AppendValue(&out, "decoded_bytes_total", "counter",
+              "Arrow IPC batch bytes decoded.", decoded_bytes);
+  AppendHeader(&out, "decode_seconds_total", "counter",
+               "Time spent decoding Arrow IPC batches.");
+  AppendSeconds(&out, "decode_seconds_total", "",
+                decode_nanos.load(std::memory_order_relaxed) / 1e9);
+  AppendValue(&out, "receive_page_faults_total", "counter",
+              "Page faults taken while reading responses.",
+              receive_page_faults);
+  AppendValue(&out, "decode_page_faults_total", "counter",
+              "Page faults taken while decoding Arrow IPC batches.",
+              decode_page_faults);
+  AppendLockWaits(&out, *this);
+  return out;
+}
+
+} // namespace adbc::cube
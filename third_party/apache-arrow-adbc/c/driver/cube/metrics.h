@@ -0,0 +1,146 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace adbc::cube {
+
+/// Log-linear histogram of non-negative values, in the style of HDR
+/// histograms: each power of two is split into 8 buckets, so a recorded
+/// value is known to within 12.5%. Recording is a few relaxed atomic
+/// increments; reads taken while values are recorded are approximate.
+class CubeHistogram {
+public:
+  void Record(int64_t value);
+
+  int64_t count() const { return count_.load(std::memory_order_relaxed); }
+  int64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+  /// Upper bound of the bucket holding the value at quantile q (0 to 1), or
+  /// 0 if nothing was recorded
+  int64_t Quantile(double q) const;
+
+private:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr size_t kBuckets = (64 - kSubBucketBits + 1)
+                                     << kSubBucketBits;
+
+  static size_t BucketOf(uint64_t value);
+  static int64_t UpperBound(size_t bucket);
+
+  std::atomic<int64_t> buckets_[kBuckets] = {};
+  std::atomic<int64_t> count_{0};
+  std::atomic<int64_t> sum_{0};
+};
+
+/// Contention on one of the locks shared by the connections of a process:
+/// how often a thread found it held by another, and how long such threads
+/// waited. An uncontended lock costs a try_lock and nothing else.
+struct CubeLockWaits {
+  std::atomic<int64_t> waits{0};
+  std::atomic<int64_t> wait_nanos{0};
+};
+
+/// Lock mutex, counting in waits the time spent waiting for it if another
+/// thread holds it
+std::unique_lock<std::mutex> CubeLockCounted(std::mutex &mutex,
+                                             CubeLockWaits &waits);
+
+/// Counters and latency histograms aggregated over every connection of the
+/// process, for spotting regressions across a fleet rather than in one
+/// query (see CubeQueryStats for those). Updated with relaxed atomics only.
+struct CubeMetrics {
+  /// The process-wide instance
+  static CubeMetrics &Global();
+
+  // Native sessions opened (TCP, TLS and handshake), and failed attempts
+  std::atomic<int64_t> connects{0};
+  std::atomic<int64_t> connect_errors{0};
+  CubeHistogram connect_latency_us;
+
+  // Native queries completed, including failed ones, from send to the
+  // last message of their response
+  std::atomic<int64_t> queries{0};
+  std::atomic<int64_t> query_errors{0};
+  CubeHistogram query_latency_us;
+
+  // Native protocol frames read and written, framing included
+  std::atomic<int64_t> bytes_received{0};
+  std::atomic<int64_t> bytes_sent{0};
+
+  // Sessions taken from a connection pool, and lookups that found none
+  std::atomic<int64_t> pool_hits{0};
+  std::atomic<int64_t> pool_misses{0};
+
+  // Queries that queued for admission control, those that gave up, and
+  // the time from asking to being let in (0 for the ones that did not wait)
+  std::atomic<int64_t> admission_waits{0};
+  std::atomic<int64_t> admission_timeouts{0};
+  CubeHistogram admission_wait_us;
+
+  // Queries sent to a second server after hedge_after, and those the
+  // second server answered first
+  std::atomic<int64_t> hedges{0};
+  std::atomic<int64_t> hedge_wins{0};
+
+  // Sessions moved to the server a query hashes to (hosts.routing)
+  std::atomic<int64_t> affinity_moves{0};
+
+  // Connections open now, on either protocol
+  std::atomic<int64_t> active_connections{0};
+
+  // Arrow IPC batch bytes decoded and the time spent on them
+  std::atomic<int64_t> decoded_bytes{0};
+  std::atomic<int64_t> decode_nanos{0};
+
+  // Page faults taken by the threads reading responses and decoding
+  // batches while they did so (Linux only), mostly first touches of fresh
+  // buffers; see CubeMemoryPlacement
+  std::atomic<int64_t> receive_page_faults{0};
+  std::atomic<int64_t> decode_page_faults{0};
+
+  // The locks queries of different connections meet at: the database's
+  // session pool, its result cache, the connections' schema caches and the
+  // decode pool's scheduler
+  CubeLockWaits pool_lock;
+  CubeLockWaits result_cache_lock;
+  CubeLockWaits schema_cache_lock;
+  CubeLockWaits decode_lock;
+
+  /// Count a connect attempt that started at start
+  void RecordConnect(std::chrono::steady_clock::time_point start, bool ok);
+
+  /// Count a query sent at sent that has now completed
+  void RecordQuery(std::chrono::steady_clock::time_point sent, bool ok);
+
+  /// Page faults, minor and major, the calling thread has taken so far;
+  /// 0 where the system does not count them per thread
+  static int64_t ThreadPageFaults();
+
+  /// All of the above in the Prometheus text exposition format, with
+  /// names prefixed "adbc_cube_" and latencies as summaries in seconds
+  std::string Format() const;
+};
+
+} // namespace adbc::cube
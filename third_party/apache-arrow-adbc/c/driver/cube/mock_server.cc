@@ -0,0 +1,371 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/mock_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/arrow_writer.h"
+#include "driver/cube/native_protocol.h"
+
+namespace adbc::cube {
+
+namespace {
+
+void InitColumns(MockResultShape shape, struct ArrowSchema *schema) {
+  int n_columns = shape == MockResultShape::NumericWide ? 32
+                  : shape == MockResultShape::Nullable  ? 8
+                                                        : 4;
+  ArrowSchemaInit(schema);
+  ArrowSchemaSetTypeStruct(schema, n_columns);
+  for (int i = 0; i < n_columns; i++) {
+    struct ArrowSchema *child = schema->children[i];
+    switch (shape) {
+    case MockResultShape::NumericWide:
+      ArrowSchemaSetType(child, i % 2 ? NANOARROW_TYPE_DOUBLE
+                                      : NANOARROW_TYPE_INT64);
+      break;
+    case MockResultShape::StringHeavy:
+      ArrowSchemaSetType(child, NANOARROW_TYPE_STRING);
+      break;
+    case MockResultShape::Nullable:
+      ArrowSchemaSetType(child, i % 2 ? NANOARROW_TYPE_DOUBLE
+                                      : NANOARROW_TYPE_INT32);
+      break;
+    case MockResultShape::Timestamps:
+      if (i % 2) {
+        ArrowSchemaSetType(child, NANOARROW_TYPE_DATE32);
+      } else {
+        ArrowSchemaSetTypeDateTime(child, NANOARROW_TYPE_TIMESTAMP,
+                                   NANOARROW_TIME_UNIT_MICRO, "UTC");
+      }
+      break;
+    }
+    ArrowSchemaSetName(child, ("c" + std::to_string(i)).c_str());
+  }
+}
+
+void AppendRows(MockResultShape shape, int64_t rows, std::mt19937 *rng,
+                struct ArrowArray *array) {
+  ArrowArrayStartAppending(array);
+  for (int64_t row = 0; row < rows; row++) {
+    for (int64_t i = 0; i < array->n_children; i++) {
+      struct ArrowArray *child = array->children[i];
+      uint32_t r = (*rng)();
+      switch (shape) {
+      case MockResultShape::NumericWide:
+        if (i % 2) {
+          ArrowArrayAppendDouble(child, r / 1000.0);
+        } else {
+          ArrowArrayAppendInt(child, r);
+        }
+        break;
+      case MockResultShape::StringHeavy: {
+        std::string value(8 + r % 57, static_cast<char>('a' + r % 26));
+        ArrowArrayAppendString(child, ArrowCharView(value.c_str()));
+        break;
+      }
+      case MockResultShape::Nullable:
+        if (r % 10 == 0) {
+          ArrowArrayAppendNull(child, 1);
+        } else if (i % 2) {
+          ArrowArrayAppendDouble(child, r / 1000.0);
+        } else {
+          ArrowArrayAppendInt(child, r % 100000);
+        }
+        break;
+      case MockResultShape::Timestamps:
+        // Within a few years of 2024
+        if (i % 2) {
+          ArrowArrayAppendInt(child, 19723 + r % 1000);
+        } else {
+          ArrowArrayAppendInt(child, 1704067200000000 +
+                                         static_cast<int64_t>(r) * 50000);
+        }
+        break;
+      }
+    }
+    ArrowArrayFinishElement(array);
+  }
+  ArrowArrayFinishBuildingDefault(array, nullptr);
+}
+
+bool ReadAll(int fd, uint8_t *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool WriteAll(int fd, const std::vector<uint8_t> &data) {
+  const uint8_t *ptr = data.data();
+  size_t size = data.size();
+  while (size > 0) {
+    ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    ptr += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// Payload of the next frame: the message type, then its fields
+bool ReadFrame(int fd, std::vector<uint8_t> *payload) {
+  uint8_t prefix[4];
+  if (!ReadAll(fd, prefix, sizeof(prefix))) {
+    return false;
+  }
+  const uint8_t *ptr = prefix;
+  uint32_t length = MessageCodec::GetU32(ptr, prefix + sizeof(prefix));
+  if (length == 0) {
+    return false;
+  }
+  payload->resize(length);
+  return ReadAll(fd, payload->data(), length);
+}
+
+// CAPABILITY_* bits a HandshakeRequest offers
+uint32_t OfferedCapabilities(const std::vector<uint8_t> &payload) {
+  const uint8_t *ptr = payload.data() + 1;
+  const uint8_t *end = payload.data() + payload.size();
+  try {
+    MessageCodec::GetU32(ptr, end); // Version
+    if (ptr == end) {
+      return 0;
+    }
+    ptr += MessageCodec::GetU8(ptr, end); // Compression codecs
+    return ptr < end ? MessageCodec::GetU32(ptr, end) : 0;
+  } catch (const std::runtime_error &) {
+    return 0;
+  }
+}
+
+std::vector<uint8_t> EncodeError(const std::string &message) {
+  ErrorMessage error;
+  error.code = "MOCK";
+  error.message = message;
+  return error.Encode();
+}
+
+} // namespace
+
+const char *MockResultShapeName(MockResultShape shape) {
+  switch (shape) {
+  case MockResultShape::NumericWide:
+    return "numeric_wide";
+  case MockResultShape::StringHeavy:
+    return "string_heavy";
+  case MockResultShape::Nullable:
+    return "nullable";
+  case MockResultShape::Timestamps:
+    return "timestamps";
+  }
+  return "";
+}
+
+MockResult MakeMockResult(const MockResultOptions &options) {
+  MockResult result;
+  struct ArrowSchema schema;
+  InitColumns(options.shape, &schema);
+  WriteArrowIpcSchema(&schema, &result.schema, nullptr);
+  std::mt19937 rng(42);
+  for (int i = 0; i < options.batches; i++) {
+    struct ArrowArray array;
+    ArrowArrayInitFromSchema(&array, &schema, nullptr);
+    AppendRows(options.shape, options.rows_per_batch, &rng, &array);
+    std::vector<uint8_t> batch;
+    WriteArrowIpcRecordBatch(&schema, &array, 0, array.length, &batch,
+                             nullptr);
+    result.batches.push_back(std::move(batch));
+    result.rows += array.length;
+    ArrowArrayRelease(&array);
+  }
+  ArrowSchemaRelease(&schema);
+  return result;
+}
+
+CubeMockServer::CubeMockServer(MockServerOptions options)
+    : options_(options) {
+  MockResult result = MakeMockResult(options_.result);
+  rows_ = result.rows;
+  QueryResponseSchema schema;
+  schema.arrow_ipc_schema = std::move(result.schema);
+  response_ = schema.Encode();
+  for (auto &ipc : result.batches) {
+    QueryResponseBatch batch;
+    batch.arrow_ipc_batch = std::move(ipc);
+    auto frame = batch.Encode();
+    response_.insert(response_.end(), frame.begin(), frame.end());
+  }
+  QueryComplete complete;
+  complete.rows_affected = rows_;
+  auto frame = complete.Encode();
+  response_.insert(response_.end(), frame.begin(), frame.end());
+}
+
+CubeMockServer::~CubeMockServer() { Stop(); }
+
+int CubeMockServer::Start() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    return errno;
+  }
+  int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd_, SOMAXCONN) != 0 ||
+      getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&address),
+                  &length) != 0) {
+    int err = errno;
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return err;
+  }
+  port_ = ntohs(address.sin_port);
+  acceptor_ = std::thread(&CubeMockServer::Accept, this);
+  return 0;
+}
+
+void CubeMockServer::Stop() {
+  if (listen_fd_ < 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  // Wakes accept() on Linux
+  shutdown(listen_fd_, SHUT_RDWR);
+  acceptor_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (int fd : sessions_) {
+    shutdown(fd, SHUT_RDWR);
+  }
+  // Session threads are detached, so that a benchmark opening thousands of
+  // sessions does not keep a thread per closed one
+  closed_.wait(lock, [this] { return sessions_.empty(); });
+}
+
+void CubeMockServer::Accept() {
+  while (true) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      close(fd);
+      return;
+    }
+    sessions_.push_back(fd);
+    std::thread(&CubeMockServer::Serve, this, fd).detach();
+  }
+}
+
+void CubeMockServer::Serve(int fd) {
+  std::vector<uint8_t> payload;
+  bool open = true;
+  while (open && ReadFrame(fd, &payload)) {
+    switch (static_cast<MessageType>(payload[0])) {
+    case MessageType::HandshakeRequest: {
+      uint32_t offered = OfferedCapabilities(payload);
+      if ((offered & CAPABILITY_SCHEMA_ONCE) == 0) {
+        WriteAll(fd, EncodeError("The mock server requires schema-once "
+                                 "results"));
+        open = false;
+        break;
+      }
+      HandshakeResponse response;
+      response.version = PROTOCOL_VERSION;
+      response.server_version = "mock";
+      response.capabilities =
+          offered & (CAPABILITY_SCHEMA_ONCE | CAPABILITY_QUERY_TIMEOUT |
+                     CAPABILITY_TRACE_CONTEXT);
+      open = WriteAll(fd, response.Encode());
+      break;
+    }
+    case MessageType::AuthRequest: {
+      AuthResponse response;
+      response.success = true;
+      response.session_id = "mock-" + std::to_string(fd);
+      open = WriteAll(fd, response.Encode());
+      break;
+    }
+    case MessageType::QueryRequest:
+      if (options_.latency.count() > 0) {
+        std::this_thread::sleep_for(options_.latency);
+      }
+      open = WriteAll(fd, response_);
+      break;
+    case MessageType::CancelRequest:
+    case MessageType::ClosePreparedRequest:
+    case MessageType::SharedMemoryRelease:
+      // Unanswered
+      break;
+    default:
+      open = WriteAll(fd, EncodeError("Not supported by the mock server"));
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < sessions_.size(); i++) {
+    if (sessions_[i] == fd) {
+      sessions_.erase(sessions_.begin() + i);
+      break;
+    }
+  }
+  close(fd);
+  closed_.notify_all();
+}
+
+} // namespace adbc::cube
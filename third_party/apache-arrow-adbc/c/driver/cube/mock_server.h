@@ -0,0 +1,112 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace adbc::cube {
+
+/// Column layouts of the synthetic results MakeMockResult builds
+enum class MockResultShape {
+  NumericWide, // 32 int64 and float64 columns
+  StringHeavy, // 4 utf8 columns of 8 to 64 bytes
+  Nullable,    // 8 int32 and float64 columns, 10% null
+  Timestamps,  // 4 timestamp[us] and date32 columns
+};
+
+/// Name of a shape ("numeric_wide", "string_heavy", "nullable" or
+/// "timestamps")
+const char *MockResultShapeName(MockResultShape shape);
+
+struct MockResultOptions {
+  MockResultShape shape = MockResultShape::NumericWide;
+  int64_t rows_per_batch = 65536;
+  int batches = 8;
+};
+
+/// A result as a server with CAPABILITY_SCHEMA_ONCE sends it: the Arrow IPC
+/// Schema message, then each batch's RecordBatch message. Columns are
+/// filled from a fixed seed, so a given shape is the same on every run.
+struct MockResult {
+  std::vector<uint8_t> schema;
+  std::vector<std::vector<uint8_t>> batches;
+  int64_t rows = 0;
+};
+
+MockResult MakeMockResult(const MockResultOptions &options);
+
+struct MockServerOptions {
+  MockResultOptions result;
+  /// Time the server waits before answering each query, standing in for
+  /// planning and execution
+  std::chrono::microseconds latency{0};
+};
+
+/// Loopback server speaking the native protocol (native_protocol.h) well
+/// enough to benchmark the client without Cube: it accepts any token and
+/// answers every QueryRequest with the same synthetic result, whatever the
+/// SQL. Prepared statements, ingestion and compression are refused. Each
+/// session is served by its own thread.
+class CubeMockServer {
+public:
+  explicit CubeMockServer(MockServerOptions options);
+  ~CubeMockServer();
+
+  CubeMockServer(const CubeMockServer &) = delete;
+  CubeMockServer &operator=(const CubeMockServer &) = delete;
+
+  /// Listen on 127.0.0.1 on a port picked by the kernel
+  /// @return 0, or an errno value
+  int Start();
+
+  /// Close the listening socket and every session, and wait for their
+  /// threads to finish
+  void Stop();
+
+  /// Port listened on, once started
+  int port() const { return port_; }
+
+  /// Rows of the result each query returns
+  int64_t rows() const { return rows_; }
+
+  /// Bytes the server sends in answer to each query, framing included
+  size_t response_bytes() const { return response_.size(); }
+
+private:
+  void Accept();
+  void Serve(int fd);
+
+  const MockServerOptions options_;
+  // The whole response to a query, frames encoded once up front
+  std::vector<uint8_t> response_;
+  int64_t rows_ = 0;
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::thread acceptor_;
+  std::mutex mutex_;
+  std::condition_variable closed_; // Signalled as sessions end
+  std::vector<int> sessions_;      // Sockets of open sessions
+  bool stopping_ = false;
+};
+
+} // namespace adbc::cube
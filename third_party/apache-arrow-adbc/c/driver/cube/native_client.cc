@@ -1,24 +1,37 @@
-// Set to 1 to enable debug logging
-#ifndef CUBE_DEBUG_LOGGING
-#define CUBE_DEBUG_LOGGING 0
-#endif
-
-#if CUBE_DEBUG_LOGGING
-#define DEBUG_LOG(...) fprintf(stderr, __VA_ARGS__)
-#else
-#define DEBUG_LOG(...) ((void)0)
-#endif
-
 #include "native_client.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <chrono>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "arrow_writer.h"
+#include "batch_queue.h"
+#include "fork_guard.h"
+#include "log.h"
+#include "metrics.h"
+#include "rechunk_stream.h"
+#include "spill_file.h"
 
 namespace adbc::cube {
 
@@ -49,54 +62,362 @@ void SetNativeClientError(AdbcError *error, const std::string &message) {
   }
 }
 
-NativeClient::NativeClient() : socket_fd_(-1), authenticated_(false) {}
+namespace {
+
+// How long a connection attempt gets before the next address is tried
+// alongside it (RFC 8305 "Connection Attempt Delay")
+constexpr auto kConnectAttemptDelay = std::chrono::milliseconds(250);
+
+// Bytes ReadExact asks the socket for at once. Reads of at least this much
+// that find nothing buffered go straight into the caller's buffer instead,
+// so large batches are not copied.
+constexpr size_t kReadAheadBytes = 256 * 1024;
+
+// Numeric form of an address, for error messages
+std::string FormatAddress(const CubeSocketAddress &address) {
+  char host[NI_MAXHOST];
+  if (getnameinfo(reinterpret_cast<const struct sockaddr *>(&address.address),
+                  address.length, host, sizeof(host), nullptr, 0,
+                  NI_NUMERICHOST) != 0) {
+    return "?";
+  }
+  return address.family == AF_INET6 ? "[" + std::string(host) + "]" : host;
+}
+
+// Apply options to a socket that is about to connect. Buffer sizes are set
+// first, since the receive window is negotiated during the handshake.
+// Best effort: options the system refuses are left at their defaults.
+void ApplySocketOptions(int fd, const NativeSocketOptions &options) {
+  auto set = [fd](int level, int name, int value) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) != 0) {
+      CUBE_LOG(Warn, "NativeClient", "setsockopt failed",
+               {{"level", level}, {"name", name}, {"error", strerror(errno)}});
+    }
+  };
+  if (options.recv_buffer_bytes > 0) {
+    set(SOL_SOCKET, SO_RCVBUF, options.recv_buffer_bytes);
+  }
+  if (options.send_buffer_bytes > 0) {
+    set(SOL_SOCKET, SO_SNDBUF, options.send_buffer_bytes);
+  }
+  if (options.tcp_nodelay) {
+    set(IPPROTO_TCP, TCP_NODELAY, 1);
+  }
+  if (options.keepalive_idle_s > 0) {
+    set(SOL_SOCKET, SO_KEEPALIVE, 1);
+#if defined(TCP_KEEPIDLE)
+    set(IPPROTO_TCP, TCP_KEEPIDLE, options.keepalive_idle_s);
+#elif defined(TCP_KEEPALIVE)
+    set(IPPROTO_TCP, TCP_KEEPALIVE, options.keepalive_idle_s);
+#endif
+#if defined(TCP_KEEPINTVL)
+    if (options.keepalive_interval_s > 0) {
+      set(IPPROTO_TCP, TCP_KEEPINTVL, options.keepalive_interval_s);
+    }
+#endif
+#if defined(TCP_KEEPCNT)
+    if (options.keepalive_count > 0) {
+      set(IPPROTO_TCP, TCP_KEEPCNT, options.keepalive_count);
+    }
+#endif
+  }
+#if defined(SO_BUSY_POLL)
+  if (options.busy_poll_us > 0) {
+    set(SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us);
+  }
+#endif
+}
+
+// Milliseconds from now until deadline for poll(), rounded up so a wait
+// never ends just short of it; -1 (forever) for max()
+int PollTimeoutMs(std::chrono::steady_clock::time_point deadline) {
+  using Clock = std::chrono::steady_clock;
+  if (deadline == Clock::time_point::max()) {
+    return -1;
+  }
+  auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline -
+                                                           Clock::now());
+  return static_cast<int>(std::clamp<int64_t>(wait.count(), 0, INT32_MAX));
+}
+
+// Connect to whichever of addresses accepts first, Happy Eyeballs style:
+// attempts start kConnectAttemptDelay apart, or as soon as the one before
+// fails, and the first to complete wins. Gives up at deadline, setting
+// timed_out. Returns a blocking socket, or -1 with the reason the last
+// attempt failed.
+int ConnectToAny(const std::vector<CubeSocketAddress> &addresses,
+                 const NativeSocketOptions &options,
+                 std::chrono::steady_clock::time_point deadline,
+                 std::string *reason, bool *timed_out) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<struct pollfd> attempts;
+  std::vector<size_t> attempt_addresses; // Index into addresses
+  size_t next = 0;
+  auto next_start = Clock::now();
+  int connected = -1;
+  *reason = "no addresses";
+  auto fail = [&](size_t index, int code) {
+    *reason = FormatAddress(addresses[index]) + ": " + std::strerror(code);
+    next_start = Clock::now();
+  };
+
+  while (connected < 0 && (next < addresses.size() || !attempts.empty())) {
+    if (Clock::now() >= deadline) {
+      *reason = "timed out";
+      *timed_out = true;
+      break;
+    }
+    if (next < addresses.size() &&
+        (attempts.empty() || Clock::now() >= next_start)) {
+      size_t index = next++;
+      const auto &address = addresses[index];
+      int fd = socket(address.family, SOCK_STREAM, 0);
+      if (fd < 0) {
+        fail(index, errno);
+        continue;
+      }
+      ApplySocketOptions(fd, options);
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      const auto *sockaddr =
+          reinterpret_cast<const struct sockaddr *>(&address.address);
+      if (connect(fd, sockaddr, address.length) == 0) {
+        connected = fd;
+        break;
+      }
+      if (errno != EINPROGRESS) {
+        fail(index, errno);
+        close(fd);
+        continue;
+      }
+      attempts.push_back({fd, POLLOUT, 0});
+      attempt_addresses.push_back(index);
+      next_start = Clock::now() + kConnectAttemptDelay;
+    }
+
+    auto wake = deadline;
+    if (next < addresses.size()) {
+      wake = std::min(wake, next_start);
+    }
+    int ready = poll(attempts.data(), attempts.size(), PollTimeoutMs(wake));
+    if (ready < 0 && errno != EINTR) {
+      *reason = std::string("poll failed: ") + std::strerror(errno);
+      break;
+    }
+    for (size_t i = 0; ready > 0 && i < attempts.size();) {
+      if (attempts[i].revents == 0) {
+        i++;
+        continue;
+      }
+      int code = 0;
+      socklen_t length = sizeof(code);
+      if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &code, &length) !=
+          0) {
+        code = errno;
+      }
+      if (code == 0) {
+        connected = attempts[i].fd;
+      } else {
+        fail(attempt_addresses[i], code);
+        close(attempts[i].fd);
+      }
+      attempts.erase(attempts.begin() + i);
+      attempt_addresses.erase(attempt_addresses.begin() + i);
+      if (connected >= 0) {
+        break;
+      }
+    }
+  }
+
+  for (const auto &attempt : attempts) {
+    close(attempt.fd);
+  }
+  if (connected >= 0) {
+    fcntl(connected, F_SETFL, fcntl(connected, F_GETFL) & ~O_NONBLOCK);
+  }
+  return connected;
+}
+
+// Host prefix naming a Unix domain socket path instead of a network host
+constexpr std::string_view kUnixSocketScheme = "unix://";
+
+// Connect to the Unix domain socket at path, giving up at deadline (only
+// reached while the server's accept backlog is full). Only the buffer size
+// options apply to it. Returns a blocking socket, or -1 with the reason.
+int ConnectUnix(const std::string &path, const NativeSocketOptions &options,
+                std::chrono::steady_clock::time_point deadline,
+                std::string *reason, bool *timed_out) {
+  struct sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    *reason = "socket path must be 1 to " +
+              std::to_string(sizeof(address.sun_path) - 1) + " bytes long";
+    return -1;
+  }
+  std::memcpy(address.sun_path, path.data(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    *reason = std::strerror(errno);
+    return -1;
+  }
+  NativeSocketOptions buffers;
+  buffers.tcp_nodelay = false;
+  buffers.recv_buffer_bytes = options.recv_buffer_bytes;
+  buffers.send_buffer_bytes = options.send_buffer_bytes;
+  ApplySocketOptions(fd, buffers);
+
+  // A blocking connect waits out a full backlog for up to SO_SNDTIMEO
+  bool limited = deadline != std::chrono::steady_clock::time_point::max();
+  if (limited) {
+    int ms = std::max(PollTimeoutMs(deadline), 1);
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+  int result;
+  do {
+    result = connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+                     sizeof(address));
+  } while (result != 0 && errno == EINTR);
+  if (result != 0) {
+    int code = errno;
+    close(fd);
+    if (limited && (code == EAGAIN || code == EINPROGRESS)) {
+      *reason = "timed out";
+      *timed_out = true;
+    } else {
+      *reason = std::strerror(code);
+    }
+    return -1;
+  }
+  if (limited) {
+    struct timeval none = {0, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &none, sizeof(none));
+  }
+  return fd;
+}
+
+} // namespace
+
+NativeClient::NativeClient()
+    : authenticated_(false),
+      max_message_bytes_(DEFAULT_MAX_MESSAGE_BYTES), pipelining_(false) {}
 
 NativeClient::~NativeClient() { Close(); }
 
 AdbcStatusCode NativeClient::Connect(const std::string &host, int port,
-                                     AdbcError *error) {
+                                     AdbcError *error,
+                                     CubeAddressCache *address_cache) {
+  CubeSpan span(tracer_, "Connect");
+  auto start = std::chrono::steady_clock::now();
+  auto status = ConnectImpl(host, port, error, address_cache, span);
+  CubeMetrics::Global().RecordConnect(start, status == ADBC_STATUS_OK);
+  span.SetStatus(status);
+  return status;
+}
+
+AdbcStatusCode NativeClient::ConnectImpl(const std::string &host, int port,
+                                         AdbcError *error,
+                                         CubeAddressCache *address_cache,
+                                         const CubeSpan &span) {
   if (IsConnected()) {
     SetNativeClientError(error, "Already connected");
     return ADBC_STATUS_INVALID_STATE;
   }
 
-  // Create socket
-  socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (socket_fd_ < 0) {
-    SetNativeClientError(error, "Failed to create socket: " +
-                                    std::string(strerror(errno)));
-    return ADBC_STATUS_IO;
+  timed_out_ = false;
+  auto deadline = std::chrono::steady_clock::time_point::max();
+  if (timeouts_.connect_ms > 0) {
+    deadline = std::chrono::steady_clock::now() +
+               std::chrono::milliseconds(timeouts_.connect_ms);
+  }
+  std::string reason;
+  bool timed_out = false;
+  int fd = -1;
+  bool is_unix = host.compare(0, kUnixSocketScheme.size(),
+                              kUnixSocketScheme) == 0;
+  std::string target = is_unix ? host : host + ":" + std::to_string(port);
+  // Only a local peer can map the region, and TLS cannot pass the memfd; a
+  // capture would hold positions in the region instead of the batches
+  offer_shared_memory_ = is_unix && !tls_context_ && !capture_ &&
+                         shared_memory_bytes_ > 0 && SharedMemoryAvailable();
+  if (is_unix) {
+    fd = ConnectUnix(host.substr(kUnixSocketScheme.size()), socket_options_,
+                     deadline, &reason, &timed_out);
+  } else {
+    std::vector<CubeSocketAddress> addresses;
+    bool cached = false;
+    int code = address_cache
+                   ? address_cache->Resolve(host, port, &addresses, &cached)
+                   : ResolveAddresses(host, port, &addresses);
+    if (code != 0) {
+      SetNativeClientError(error, "Failed to resolve hostname " + host +
+                                      ": " + gai_strerror(code));
+      return ADBC_STATUS_IO;
+    }
+    fd = ConnectToAny(addresses, socket_options_, deadline, &reason,
+                      &timed_out);
+    if (fd < 0 && cached && !timed_out) {
+      // The host may have moved since it was resolved
+      address_cache->Invalidate(host, port);
+      if (address_cache->Resolve(host, port, &addresses, &cached) == 0) {
+        fd = ConnectToAny(addresses, socket_options_, deadline, &reason,
+                          &timed_out);
+      }
+    }
+  }
+  if (fd < 0) {
+    if (timed_out) {
+      reason += " after " + std::to_string(timeouts_.connect_ms) + " ms";
+    }
+    SetNativeClientError(error, "Failed to connect to " + target + ": " +
+                                    reason);
+    return timed_out ? ADBC_STATUS_TIMEOUT : ADBC_STATUS_IO;
   }
+  if (tls_context_) {
+    transport_ = tls_context_->Connect(fd, host, port, deadline, &reason,
+                                       &timed_out);
+    if (!transport_) {
+      SetNativeClientError(error, "TLS handshake with " + target +
+                                      " failed: " + reason);
+      return timed_out ? ADBC_STATUS_TIMEOUT : ADBC_STATUS_IO;
+    }
+  } else {
+    transport_ = CubeTransport::Make(transport_kind_, fd);
+  }
+  return StartSession(span, error);
+}
 
-  // Resolve hostname
-  struct hostent *server = gethostbyname(host.c_str());
-  if (server == nullptr) {
-    close(socket_fd_);
-    socket_fd_ = -1;
-    SetNativeClientError(error, "Failed to resolve hostname: " + host);
-    return ADBC_STATUS_IO;
+AdbcStatusCode NativeClient::Attach(std::unique_ptr<CubeTransport> transport,
+                                    AdbcError *error) {
+  if (IsConnected()) {
+    SetNativeClientError(error, "Already connected");
+    return ADBC_STATUS_INVALID_STATE;
   }
+  timed_out_ = false;
+  offer_shared_memory_ = false;
+  transport_ = std::move(transport);
+  CubeSpan span(tracer_, "Connect");
+  auto status = StartSession(span, error);
+  span.SetStatus(status);
+  return status;
+}
 
-  // Setup server address
-  struct sockaddr_in server_addr;
-  std::memset(&server_addr, 0, sizeof(server_addr));
-  server_addr.sin_family = AF_INET;
-  std::memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-  server_addr.sin_port = htons(port);
-
-  // Connect to server
-  if (connect(socket_fd_, reinterpret_cast<struct sockaddr *>(&server_addr),
-              sizeof(server_addr)) < 0) {
-    close(socket_fd_);
-    socket_fd_ = -1;
-    SetNativeClientError(error, "Failed to connect to " + host + ":" +
-                                    std::to_string(port) + ": " +
-                                    std::string(strerror(errno)));
-    return ADBC_STATUS_IO;
+AdbcStatusCode NativeClient::StartSession(const CubeSpan &span,
+                                          AdbcError *error) {
+  fork_generation_ = CubeForkGeneration();
+  if (inbound_) {
+    transport_->RegisterBuffer(inbound_.get(), inbound_capacity_);
   }
+  CUBE_LOG(Debug, "NativeClient", "Connected",
+           {{"transport", transport_->name()}});
 
   // Perform handshake
+  CubeSpan handshake(span, "PerformHandshake");
   auto status = PerformHandshake(error);
+  handshake.SetStatus(status);
   if (status != ADBC_STATUS_OK) {
     Close();
     return status;
@@ -109,6 +430,42 @@ AdbcStatusCode NativeClient::PerformHandshake(AdbcError *error) {
   // Send handshake request
   HandshakeRequest request;
   request.version = PROTOCOL_VERSION;
+  if (requested_compression_ != CompressionCodec::None) {
+    request.compression_codecs.push_back(
+        static_cast<uint8_t>(requested_compression_));
+  }
+  request.capabilities = CAPABILITY_SCHEMA_ONCE |
+                         CAPABILITY_PREPARED_STATEMENTS |
+                         CAPABILITY_QUERY_PARAMETERS | CAPABILITY_BULK_INGEST |
+                         CAPABILITY_SIZE_HINTS | CAPABILITY_QUERY_TIMEOUT |
+                         CAPABILITY_TRACE_CONTEXT | CAPABILITY_PARTITIONS |
+                         CAPABILITY_CURSORS | CAPABILITY_FLOW_CONTROL |
+                         CAPABILITY_BATCH_LIMITS | CAPABILITY_SCHEMA_ONLY |
+                         CAPABILITY_QUERY_BATCH | CAPABILITY_DELTA_RESULTS |
+                         CAPABILITY_SUBSCRIPTIONS |
+                         CAPABILITY_SECURITY_CONTEXT | CAPABILITY_PING |
+                         CAPABILITY_QUERY_PRIORITY |
+                         CAPABILITY_FIRST_BATCH_ROWS |
+                         CAPABILITY_REQUIRE_PREAGGREGATION |
+                         CAPABILITY_QUERY_DIAGNOSTICS |
+                         CAPABILITY_RESUMABLE_RESULTS |
+                         CAPABILITY_STAGED_INGEST | CAPABILITY_JSON_QUERY |
+                         CAPABILITY_SAMPLING |
+                         CAPABILITY_CHANGE_NOTIFICATIONS |
+                         CAPABILITY_QUERY_ESTIMATES |
+                         CAPABILITY_INCREMENTAL_PARTITIONS;
+  if (offer_shared_memory_) {
+    request.capabilities |= CAPABILITY_SHARED_MEMORY;
+  }
+  request.parameters.emplace_back(HANDSHAKE_CLIENT, "adbc-driver-cube");
+  request.parameters.emplace_back(HANDSHAKE_MAX_MESSAGE_BYTES,
+                                  std::to_string(max_message_bytes_));
+  // Offered once: a server that does not resume it wants a full login
+  std::string resume = std::move(resume_session_);
+  resume_session_.clear();
+  if (!resume.empty()) {
+    request.parameters.emplace_back(HANDSHAKE_RESUME_SESSION, resume);
+  }
 
   auto data = request.Encode();
   auto status = WriteMessage(data, error);
@@ -117,38 +474,148 @@ AdbcStatusCode NativeClient::PerformHandshake(AdbcError *error) {
   }
 
   // Receive handshake response
-  auto response_data = ReadMessage(error);
-  if (response_data.empty()) {
-    SetNativeClientError(error, "Empty handshake response");
-    return ADBC_STATUS_IO;
+  status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
   }
 
-  // Skip length prefix (first 4 bytes) and decode
   try {
-    auto response = HandshakeResponse::Decode(response_data.data() + 4,
-                                              response_data.size() - 4);
-
-    if (response->version != PROTOCOL_VERSION) {
+    auto response = HandshakeResponse::Decode(recv_buffer_.data(),
+                                              recv_buffer_.size());
+
+    // The server picks the version; features beyond the oldest one are
+    // turned on by capability bits, so the range only moves when an old
+    // version stops being spoken
+    if (response->version < MIN_PROTOCOL_VERSION ||
+        response->version > PROTOCOL_VERSION) {
       SetNativeClientError(
           error, "Protocol version mismatch. Client: " +
+                     std::to_string(MIN_PROTOCOL_VERSION) + " to " +
                      std::to_string(PROTOCOL_VERSION) +
                      ", Server: " + std::to_string(response->version));
       return ADBC_STATUS_INVALID_DATA;
     }
 
     server_version_ = response->server_version;
+
+    auto codec = static_cast<CompressionCodec>(response->compression_codec);
+    if (codec != CompressionCodec::None && codec != requested_compression_) {
+      SetNativeClientError(error, "Server chose compression codec " +
+                                      std::to_string(response->compression_codec) +
+                                      " that was not offered");
+      return ADBC_STATUS_INVALID_DATA;
+    }
+    compression_ = codec;
+
+    if ((response->capabilities & ~request.capabilities) != 0) {
+      SetNativeClientError(error, "Server agreed to capabilities " +
+                                      std::to_string(response->capabilities) +
+                                      " that were not offered");
+      return ADBC_STATUS_INVALID_DATA;
+    }
+    capabilities_ = response->capabilities;
+
+    server_max_message_bytes_ = 0;
+    for (const auto &[key, value] : response->parameters) {
+      if (key == HANDSHAKE_MAX_MESSAGE_BYTES) {
+        uint64_t bytes = 0;
+        auto parsed =
+            std::from_chars(value.data(), value.data() + value.size(), bytes);
+        if (parsed.ec != std::errc() ||
+            parsed.ptr != value.data() + value.size()) {
+          SetNativeClientError(error, "Invalid handshake parameter " +
+                                          key + ": '" + value + "'");
+          return ADBC_STATUS_INVALID_DATA;
+        }
+        server_max_message_bytes_ =
+            static_cast<uint32_t>(std::min<uint64_t>(bytes, UINT32_MAX));
+      } else if (key == HANDSHAKE_RESUME_SESSION) {
+        if (resume.empty() || value != resume) {
+          SetNativeClientError(error, "Server resumed session '" + value +
+                                          "' that was not offered");
+          return ADBC_STATUS_INVALID_DATA;
+        }
+        session_id_ = value;
+        token_ = resume_token_;
+        authenticated_ = true;
+      }
+    }
+    server_parameters_ = std::move(response->parameters);
   } catch (const std::exception &e) {
     SetNativeClientError(error, "Failed to decode handshake response: " +
                                     std::string(e.what()));
     return ADBC_STATUS_INVALID_DATA;
   }
 
+  if ((capabilities_ & CAPABILITY_SHARED_MEMORY) != 0) {
+    return AttachSharedMemory(error);
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::AttachSharedMemory(AdbcError *error) {
+  std::shared_ptr<CubeSharedMemory> region;
+  int code = CubeSharedMemory::Create(shared_memory_bytes_, &region);
+  if (code != 0) {
+    // The server sends every batch inline until a region is attached
+    CUBE_LOG(Info, "NativeClient", "Cannot create shared memory",
+             {{"error", std::strerror(code)}});
+    return ADBC_STATUS_OK;
+  }
+  SharedMemoryAttach request;
+  request.size = static_cast<int64_t>(region->size());
+  auto data = request.Encode();
+  struct iovec iov = {data.data(), data.size()};
+  ssize_t n;
+  while ((n = transport_->WriteWithFd(&iov, 1, region->fd())) < 0) {
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      SetNativeClientError(error, "Failed to pass shared memory: " +
+                                      std::string(strerror(errno)));
+      return ADBC_STATUS_IO;
+    }
+    auto status = WaitForSocket(
+        POLLOUT, std::chrono::steady_clock::time_point::max(), error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+  }
+  if (static_cast<size_t>(n) < data.size()) {
+    auto status = WriteExact(data.data() + n, data.size() - n, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+  }
+  shared_memory_ = std::move(region);
+  CUBE_LOG(Debug, "NativeClient", "Attached shared memory",
+           {{"bytes", shared_memory_->size()}});
   return ADBC_STATUS_OK;
 }
 
+AdbcStatusCode NativeClient::WriteSharedMemoryReleases(AdbcError *error) {
+  if (!shared_memory_ || !shared_memory_->HasReleased()) {
+    return ADBC_STATUS_OK;
+  }
+  SharedMemoryRelease release;
+  release.ranges = shared_memory_->TakeReleased();
+  auto data = release.Encode();
+  return WriteExact(data.data(), data.size(), error);
+}
+
 AdbcStatusCode NativeClient::Authenticate(const std::string &token,
                                           const std::string &database,
                                           AdbcError *error) {
+  CubeSpan span(tracer_, "Authenticate");
+  auto status = AuthenticateImpl(token, database, error);
+  span.SetStatus(status);
+  return status;
+}
+
+AdbcStatusCode NativeClient::AuthenticateImpl(const std::string &token,
+                                              const std::string &database,
+                                              AdbcError *error) {
   if (!IsConnected()) {
     SetNativeClientError(error, "Not connected");
     return ADBC_STATUS_INVALID_STATE;
@@ -171,16 +638,14 @@ AdbcStatusCode NativeClient::Authenticate(const std::string &token,
   }
 
   // Receive authentication response
-  auto response_data = ReadMessage(error);
-  if (response_data.empty()) {
-    SetNativeClientError(error, "Empty authentication response");
-    return ADBC_STATUS_IO;
+  status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
   }
 
-  // Skip length prefix and decode
   try {
-    auto response = AuthResponse::Decode(response_data.data() + 4,
-                                         response_data.size() - 4);
+    auto response =
+        AuthResponse::Decode(recv_buffer_.data(), recv_buffer_.size());
 
     if (!response->success) {
       SetNativeClientError(error, "Authentication failed");
@@ -188,6 +653,7 @@ AdbcStatusCode NativeClient::Authenticate(const std::string &token,
     }
 
     session_id_ = response->session_id;
+    token_ = token;
     authenticated_ = true;
   } catch (const std::exception &e) {
     SetNativeClientError(error, "Failed to decode authentication response: " +
@@ -198,217 +664,3063 @@ AdbcStatusCode NativeClient::Authenticate(const std::string &token,
   return ADBC_STATUS_OK;
 }
 
-AdbcStatusCode NativeClient::ExecuteQuery(const std::string &sql,
-                                          struct ArrowArrayStream *out,
-                                          AdbcError *error) {
-  if (!IsConnected()) {
-    SetNativeClientError(error, "Not connected");
-    return ADBC_STATUS_INVALID_STATE;
-  }
-
+AdbcStatusCode NativeClient::SetSecurityContext(const std::string &token,
+                                                const std::string &database,
+                                                AdbcError *error) {
   if (!authenticated_) {
     SetNativeClientError(error, "Not authenticated");
-    return ADBC_STATUS_UNAUTHENTICATED;
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  if (!SupportsSecurityContext()) {
+    SetNativeClientError(error, "The server cannot switch the security "
+                                "context of a session");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  // Queries already sent run under the context they were sent with
+  if (!pending_.empty() || prefetching_) {
+    SetNativeClientError(error, "Results of earlier queries must be read "
+                                "before the token is changed");
+    return ADBC_STATUS_INVALID_STATE;
   }
 
-  // Send query request
-  QueryRequest request;
-  request.sql = sql;
-
-  auto data = request.Encode();
-  auto status = WriteMessage(data, error);
+  CubeSpan span(tracer_, "SetSecurityContext");
+  SecurityContextRequest request;
+  request.token = token;
+  request.database = database;
+  auto status = WriteMessage(request.Encode(), error);
+  if (status == ADBC_STATUS_OK) {
+    status = ReadMessage(error);
+  }
+  if (status == ADBC_STATUS_OK) {
+    try {
+      auto response =
+          AuthResponse::Decode(recv_buffer_.data(), recv_buffer_.size());
+      if (!response->success) {
+        SetNativeClientError(error, "Authentication failed");
+        status = ADBC_STATUS_UNAUTHENTICATED;
+      }
+    } catch (const std::exception &e) {
+      SetNativeClientError(error,
+                           "Failed to decode authentication response: " +
+                               std::string(e.what()));
+      status = ADBC_STATUS_INVALID_DATA;
+    }
+  }
+  span.SetStatus(status);
   if (status != ADBC_STATUS_OK) {
+    // Neither context can be trusted to hold any more
+    authenticated_ = false;
+    Close();
     return status;
   }
+  token_ = token;
+  return ADBC_STATUS_OK;
+}
 
-  // Initialize output stream to a safe empty state
-  // This ensures the stream can be safely released even if we return early with an error
-  memset(out, 0, sizeof(*out));
+AdbcStatusCode NativeClient::Ping(std::chrono::milliseconds timeout,
+                                  AdbcError *error) {
+  if (!IsReusable()) {
+    SetNativeClientError(error, "Results of earlier queries must be read "
+                                "before a ping");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  if (!SupportsPing()) {
+    SetNativeClientError(error, "The server does not answer pings");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
 
-  // Collect Arrow IPC batch data (which includes schema)
-  // NOTE: We only use the batch data, not the schema-only message,
-  // because each is a complete Arrow IPC stream with EOS markers.
-  // Using both would create: [Schema][EOS][Schema][Batch][EOS]
-  // which PyArrow sees as two separate streams.
-  std::vector<uint8_t> arrow_ipc_data;
-  bool query_complete = false;
-
-  while (!query_complete) {
-    auto response_data = ReadMessage(error);
-    if (response_data.empty()) {
-      SetNativeClientError(error, "Empty query response");
-      return ADBC_STATUS_IO;
+  PingRequest request;
+  request.sequence = ++ping_sequence_;
+  auto status = WriteMessage(request.Encode(), error);
+  if (status == ADBC_STATUS_OK) {
+    if (timeout.count() > 0) {
+      read_deadline_ = std::chrono::steady_clock::now() + timeout;
     }
-
-    // Check message type (byte at offset 4, after length prefix)
-    MessageType msg_type = static_cast<MessageType>(response_data[4]);
-
+    status = ReadMessage(error);
+    read_deadline_ = std::chrono::steady_clock::time_point::max();
+    if (status == ADBC_STATUS_TIMEOUT) {
+      SetNativeClientError(error, "Ping not answered within " +
+                                      std::to_string(timeout.count()) +
+                                      " ms");
+    }
+  }
+  if (status == ADBC_STATUS_OK) {
     try {
-      switch (msg_type) {
-      case MessageType::QueryResponseSchema: {
-        // Skip schema-only message - we'll get schema from batch
-        DEBUG_LOG(
-            "[NativeClient::ExecuteQuery] Skipping schema-only message\n");
-        break;
-      }
-
-      case MessageType::QueryResponseBatch: {
-        auto response = QueryResponseBatch::Decode(response_data.data() + 4,
-                                                   response_data.size() - 4);
-        // Use only batch data (contains both schema and data)
-        arrow_ipc_data = std::move(response->arrow_ipc_batch);
-        DEBUG_LOG("[NativeClient::ExecuteQuery] Got batch data: %zu bytes\n",
-                  arrow_ipc_data.size());
-        break;
-      }
-
-      case MessageType::QueryComplete: {
-        auto response = QueryComplete::Decode(response_data.data() + 4,
-                                              response_data.size() - 4);
-        // rows_affected = response->rows_affected;  // Unused for now
-        (void)response; // Suppress unused variable warning
-        query_complete = true;
-        break;
+      auto response =
+          PongResponse::Decode(recv_buffer_.data(), recv_buffer_.size());
+      if (response->sequence != request.sequence) {
+        SetNativeClientError(error, "Pong answers ping " +
+                                        std::to_string(response->sequence) +
+                                        ", expected " +
+                                        std::to_string(request.sequence));
+        status = ADBC_STATUS_INVALID_DATA;
       }
+    } catch (const std::exception &e) {
+      SetNativeClientError(error, "Failed to decode pong: " +
+                                      std::string(e.what()));
+      status = ADBC_STATUS_INVALID_DATA;
+    }
+  }
+  if (status != ADBC_STATUS_OK) {
+    // Still authenticated, so the session can be offered for resumption
+    CloseAfterError(error);
+  }
+  return status;
+}
 
-      case MessageType::Error: {
-        DEBUG_LOG("[NativeClient::ExecuteQuery] Received Error message, size=%zu\n",
-                  response_data.size());
+AdbcStatusCode NativeClient::WatchChanges(AdbcError *error) {
+  if (!IsReusable()) {
+    SetNativeClientError(error, "Results of earlier queries must be read "
+                                "before watching for changes");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  if (!SupportsChangeNotifications()) {
+    SetNativeClientError(error, "The server does not push change "
+                                "notifications");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
 
-        if (response_data.size() < 5) {  // Need at least length(4) + msgtype(1)
-          SetNativeClientError(error, "Error message too short");
-          return ADBC_STATUS_INVALID_DATA;
-        }
+  WatchChangesRequest request;
+  auto status = WriteMessage(request.Encode(), error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return status;
+  }
+  watching_ = true;
+  return ADBC_STATUS_OK;
+}
 
-        try {
-          auto response = ErrorMessage::Decode(response_data.data() + 4,
-                                               response_data.size() - 4);
-          DEBUG_LOG("[NativeClient::ExecuteQuery] Decoded error: code=%s, message=%s\n",
-                    response->code.c_str(), response->message.c_str());
-          SetNativeClientError(error, "Query error [" + response->code +
-                                          "]: " + response->message);
-        } catch (const std::exception &decode_error) {
-          DEBUG_LOG("[NativeClient::ExecuteQuery] Failed to decode error message: %s\n",
-                    decode_error.what());
-          SetNativeClientError(error, "Query failed (error message decode failed): " +
-                                          std::string(decode_error.what()));
-        }
-        return ADBC_STATUS_UNKNOWN;
-      }
+AdbcStatusCode NativeClient::ReadChange(std::chrono::milliseconds timeout,
+                                        ChangeNotification *out,
+                                        AdbcError *error) {
+  if (!IsConnected() || !watching_) {
+    SetNativeClientError(error, "The session is not watching for changes");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  // Waiting for a notification is not waiting on the server: no read
+  // timeout applies, and running out of time leaves the session as it was
+  if (inbound_pos_ == inbound_end_ && !transport_->HasBuffered()) {
+    struct pollfd pfd;
+    pfd.fd = transport_->fd();
+    pfd.events = POLLIN;
+    int ready;
+    do {
+      pfd.revents = 0;
+      ready = poll(&pfd, 1, static_cast<int>(timeout.count()));
+    } while (ready < 0 && errno == EINTR);
+    if (ready == 0) {
+      SetNativeClientError(error, "No change within " +
+                                      std::to_string(timeout.count()) +
+                                      " ms");
+      return ADBC_STATUS_TIMEOUT;
+    }
+  }
 
-      default: {
-        SetNativeClientError(
-            error, "Unexpected message type: " +
-                       std::to_string(static_cast<uint8_t>(msg_type)));
-        return ADBC_STATUS_INVALID_DATA;
-      }
+  auto status = ReadMessage(error);
+  if (status == ADBC_STATUS_OK) {
+    try {
+      auto msg_type = static_cast<MessageType>(recv_buffer_[0]);
+      if (msg_type == MessageType::Error) {
+        auto message =
+            ErrorMessage::Decode(recv_buffer_.data(), recv_buffer_.size());
+        SetNativeClientError(error, "Change notification error [" +
+                                        message->code +
+                                        "]: " + message->message);
+        status = ADBC_STATUS_IO;
+      } else {
+        *out = std::move(*ChangeNotification::Decode(recv_buffer_.data(),
+                                                     recv_buffer_.size()));
       }
     } catch (const std::exception &e) {
-      SetNativeClientError(error, "Failed to decode response: " +
+      SetNativeClientError(error, "Failed to decode change notification: " +
                                       std::string(e.what()));
-      return ADBC_STATUS_INVALID_DATA;
+      status = ADBC_STATUS_INVALID_DATA;
     }
   }
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+  }
+  return status;
+}
 
-  // Parse Arrow IPC data using CubeArrowReader
-  if (arrow_ipc_data.empty()) {
-    SetNativeClientError(error, "No Arrow IPC data received");
-    return ADBC_STATUS_INVALID_DATA;
+namespace {
+
+// Copy an AdbcError's message into a string and release the error
+std::string TakeErrorMessage(AdbcError *error, const char *fallback) {
+  std::string message = error->message ? error->message : fallback;
+  if (error->release) {
+    error->release(error);
+  }
+  return message;
+}
+
+// Bytes held by the buffers of a nanoarrow-built array and its children.
+// Dictionaries are shared across batches (and not built by nanoarrow), so
+// they are not counted.
+size_t ArrayBufferBytes(struct ArrowArray *array) {
+  size_t bytes = 0;
+  int64_t n_fixed =
+      std::min<int64_t>(array->n_buffers, NANOARROW_MAX_FIXED_BUFFERS);
+  for (int64_t i = 0; i < n_fixed; i++) {
+    bytes += static_cast<size_t>(ArrowArrayBuffer(array, i)->size_bytes);
+  }
+  // String and binary views keep their data in variadic buffers
+  auto private_data =
+      static_cast<struct ArrowArrayPrivateData *>(array->private_data);
+  for (int32_t i = 0; i < private_data->n_variadic_buffers; i++) {
+    bytes += static_cast<size_t>(private_data->variadic_buffer_sizes[i]);
+  }
+  for (int64_t i = 0; i < array->n_children; i++) {
+    bytes += ArrayBufferBytes(array->children[i]);
   }
+  return bytes;
+}
 
-  try {
-    auto reader = std::make_unique<CubeArrowReader>(std::move(arrow_ipc_data));
-    ArrowError arrow_error;
-    memset(&arrow_error, 0, sizeof(arrow_error)); // Initialize to zeros
-    auto init_status = reader->Init(&arrow_error);
-    if (init_status != NANOARROW_OK) {
-      std::string error_msg = "Failed to initialize Arrow reader: ";
-      error_msg += arrow_error.message;
-      SetNativeClientError(error, error_msg);
-      DEBUG_LOG("[NativeClient::ExecuteQuery] Init failed with status %d: %s\n",
-                init_status, error_msg.c_str());
-      return ADBC_STATUS_INTERNAL;
+// Adds the time from its construction to its destruction to the driver's
+// decode time, and to *nanos unless nanos is null, and the page faults the
+// thread took meanwhile to the driver's count
+class DecodeTimer {
+public:
+  explicit DecodeTimer(std::atomic<int64_t> *nanos)
+      : nanos_(nanos), start_(std::chrono::steady_clock::now()),
+        faults_(CubeMetrics::ThreadPageFaults()) {}
+  ~DecodeTimer() {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start_)
+                          .count();
+    auto &metrics = CubeMetrics::Global();
+    metrics.decode_nanos.fetch_add(elapsed, std::memory_order_relaxed);
+    metrics.decode_page_faults.fetch_add(
+        CubeMetrics::ThreadPageFaults() - faults_, std::memory_order_relaxed);
+    if (nanos_) {
+      nanos_->fetch_add(elapsed, std::memory_order_relaxed);
     }
+  }
 
-    // Release the empty stream before replacing it with real data
-    if (out->release != nullptr) {
-      out->release(out);
+private:
+  std::atomic<int64_t> *nanos_;
+  std::chrono::steady_clock::time_point start_;
+  int64_t faults_;
+};
+
+// Received bytes a result keeps in memory, with the memory charge and the
+// spill accounting (if any) that last as long as they do
+struct ResidentIpcBytes {
+  ResidentIpcBytes(CubeIpcBuffer buffer, CubeMemoryCharge charge,
+                   std::shared_ptr<std::atomic<size_t>> resident)
+      : bytes(std::move(buffer)), charge(std::move(charge)),
+        resident(std::move(resident)) {}
+  ~ResidentIpcBytes() {
+    if (resident) {
+      resident->fetch_sub(bytes.size());
     }
+  }
 
-    // Export to ArrowArrayStream
-    DEBUG_LOG(
-        "[NativeClient::ExecuteQuery] Exporting to ArrowArrayStream...\n");
-    reader->ExportTo(out);
-    DEBUG_LOG("[NativeClient::ExecuteQuery] Export complete\n");
+  CubeIpcBytes bytes;
+  CubeMemoryCharge charge;
+  std::shared_ptr<std::atomic<size_t>> resident;
+};
+
+std::shared_ptr<const CubeIpcBytes>
+KeepResident(CubeIpcBuffer buffer, CubeMemoryCharge charge,
+             std::shared_ptr<std::atomic<size_t>> resident) {
+  auto owner = std::make_shared<ResidentIpcBytes>(
+      std::move(buffer), std::move(charge), std::move(resident));
+  return std::shared_ptr<const CubeIpcBytes>(owner, &owner->bytes);
+}
 
-    // Reader ownership transferred to ArrowArrayStream
-    reader.release();
+} // namespace
+
+/// ArrowArrayStream private data for the response to one QueryRequest.
+///
+/// Messages are pulled off the socket on demand. Responses arrive in request
+/// order, so when a later query on the same client is read first
+/// (pipelining), the rest of this response is buffered in memory. Each batch
+/// message carries a complete Arrow IPC stream, so every batch gets its own
+/// CubeArrowReader. With schema-once delivery the batches leave out the
+/// Schema message, and their readers share the one parsed from the
+/// QueryResponseSchema sent ahead of them.
+///
+/// With decode-ahead (StartPrefetch), a background thread does the reading
+/// and decoding and hands finished arrays to get_next through a lock-free
+/// CubeBatchQueue. While it runs, it is the only thread that touches the
+/// client's read side.
+class NativeResultStream {
+public:
+  NativeResultStream(NativeClient *client, CubeReaderOptions options,
+                     uint64_t sequence, bool schema_once)
+      : client_(client), options_(options), sequence_(sequence),
+        schema_once_(schema_once), sent_(std::chrono::steady_clock::now()) {}
+
+  ~NativeResultStream() {
+    if (prefetch_client_) {
+      prefetch_client_->StopPrefetch();
+    } else {
+      StopPrefetch();
+    }
+    if (client_) {
+      // Leave the socket positioned at the next query's response
+      client_->AbandonResult(this);
+    }
+  }
 
-  } catch (const std::exception &e) {
-    SetNativeClientError(error, "Failed to parse Arrow IPC data: " +
-                                    std::string(e.what()));
-    DEBUG_LOG("[NativeClient::ExecuteQuery] Exception: %s\n", e.what());
-    return ADBC_STATUS_INVALID_DATA;
+  /// Called by NativeClient when the rest of this response will never be
+  /// read (socket closed, or result discarded)
+  void Detach(AdbcStatusCode code, const std::string &reason) {
+    if (client_ && !complete_) {
+      CubeMetrics::Global().RecordQuery(sent_, false);
+    }
+    client_ = nullptr;
+    if (!complete_) {
+      complete_ = true;
+      Fail(code, reason);
+    }
   }
 
-  return ADBC_STATUS_OK;
-}
+  /// Queue one batch of this response. Called by NativeClient.
+  void AddBatch(CubeIpcBuffer batch) {
+    CountBatch();
+    if (capture_) {
+      capture_->AddBatch(batch);
+    }
+    CubeMemoryCharge charge(options_.memory, batch.size());
+    batches_.emplace_back(std::move(batch), std::move(charge));
+  }
 
-void NativeClient::Close() {
-  if (socket_fd_ >= 0) {
-    close(socket_fd_);
-    socket_fd_ = -1;
+  /// Queue one batch of this response that is shared in place from the
+  /// client's shared memory. Called by NativeClient.
+  void AddSharedBatch(std::shared_ptr<const CubeIpcBytes> batch) {
+    CountBatch();
+    if (capture_) {
+      capture_->AddBatch(batch->data(), batch->size());
+    }
+    batches_.push_back(std::move(batch));
   }
-  authenticated_ = false;
-  session_id_.clear();
-  server_version_.clear();
-}
 
-std::vector<uint8_t> NativeClient::ReadMessage(AdbcError *error) {
-  // Read 4-byte length prefix
-  uint8_t length_buf[4];
-  auto status = ReadExact(length_buf, 4, error);
-  if (status != ADBC_STATUS_OK) {
-    return {};
+  /// Take over the query's ExecuteQuery span, ended with the stream
+  void SetSpan(CubeSpan span) { span_ = std::move(span); }
+
+  /// Called by NativeClient for each message of this response it reads
+  void Received() {
+    if (span_.active() && !responded_) {
+      responded_ = true;
+      span_.Event("first_byte");
+    }
   }
 
-  // Decode length (big-endian)
-  uint32_t length = (static_cast<uint32_t>(length_buf[0]) << 24) |
-                    (static_cast<uint32_t>(length_buf[1]) << 16) |
-                    (static_cast<uint32_t>(length_buf[2]) << 8) |
-                    (static_cast<uint32_t>(length_buf[3]));
+  /// Statistics to add this result's to, or null (called by NativeClient
+  /// to count the bytes and socket time of the messages it reads)
+  CubeQueryStats *stats() const { return options_.stats.get(); }
 
-  if (length == 0 || length > 100 * 1024 * 1024) { // 100MB max
-    SetNativeClientError(error,
-                         "Invalid message length: " + std::to_string(length));
-    return {};
+  /// Keep the schema-only message, used when the result has no batches
+  void SetSchemaMessage(CubeIpcBuffer schema) {
+    if (capture_) {
+      capture_->AddSchemaMessage(schema);
+    }
+    schema_message_ = std::move(schema);
   }
 
-  // Read payload
-  std::vector<uint8_t> payload(length);
-  status = ReadExact(payload.data(), length, error);
-  if (status != ADBC_STATUS_OK) {
-    return {};
+  /// Hand every message received from now on to capture, and store the
+  /// result with it if the response completes without error
+  void SetCapture(std::unique_ptr<CubeResultCapture> capture) {
+    capture_ = std::move(capture);
+  }
+  bool capturing() const { return capture_ != nullptr; }
+
+  /// Keep the size estimate sent with the schema-only message
+  void SetSizeHint(const ResultSizeHint &hint) {
+    size_hint_ = hint;
+    if (options_.stats) {
+      options_.stats->estimated_rows.store(hint.rows,
+                                           std::memory_order_relaxed);
+      options_.stats->estimated_bytes.store(hint.bytes,
+                                            std::memory_order_relaxed);
+    }
   }
 
-  // Return length prefix + payload (for easier parsing)
-  std::vector<uint8_t> result;
-  result.insert(result.end(), length_buf, length_buf + 4);
-  result.insert(result.end(), payload.begin(), payload.end());
+  /// Keep the version sent with the schema-only message
+  void SetDelta(ResultDelta delta) { delta_ = std::move(delta); }
+
+  /// Where a cursor result (QUERY_FLAG_CURSOR) stands; kept by NativeClient
+  struct Cursor {
+    bool open = false;
+    // FetchRequests whose answer has not ended, the QueryRequest that
+    // opened the cursor counting as the first
+    int outstanding = 0;
+    size_t fetch_bytes = 0; // Size of the next FetchRequest
+    size_t min_bytes = 0;
+    size_t max_bytes = 0;
+    // When the last FetchRequest went out, and the client's socket wait
+    // then, to tell how much of the time since was spent waiting
+    std::chrono::steady_clock::time_point last_fetch;
+    int64_t wait_at_last_fetch = 0;
+  };
+
+  /// Read this result through a cursor, starting with fetches of
+  /// fetch_bytes, adapted within [fetch_bytes / 8, fetch_bytes * 16]
+  void OpenCursor(size_t fetch_bytes) {
+    constexpr size_t kMinFetchBytes = 64 * 1024;
+    cursor_.open = true;
+    cursor_.outstanding = 1;
+    cursor_.fetch_bytes = fetch_bytes;
+    cursor_.min_bytes =
+        std::min(fetch_bytes, std::max(fetch_bytes / 8, kMinFetchBytes));
+    cursor_.max_bytes = fetch_bytes * 16;
+  }
 
-  return result;
-}
+  Cursor &cursor() { return cursor_; }
+
+  /// Where a subscribed result (QUERY_FLAG_SUBSCRIBE) stands; kept by
+  /// NativeClient
+  struct Subscription {
+    bool open = false;
+    bool idle = false; // A version has ended and the next awaits a refresh
+  };
+
+  Subscription &subscription() { return subscription_; }
+
+  /// Mark the end of a version of a subscribed result, returned by get_next
+  /// as an empty batch. Called by NativeClient.
+  void EndVersion() { batches_.emplace_back(); }
+
+  /// Credit of a result sent under flow control (QUERY_FLAG_CREDIT); kept
+  /// by NativeClient
+  struct Credit {
+    bool limited = false;
+    uint32_t window_batches = 0; // 0 = no limit on the count
+    int64_t window_bytes = 0;    // 0 = no limit on the size
+    // Taken by get_next since credit was last granted
+    uint32_t taken_batches = 0;
+    int64_t taken_bytes = 0;
+  };
+
+  /// Send this result under flow control with the given window
+  void OpenCredit(uint32_t batches, size_t bytes) {
+    credit_.limited = true;
+    credit_.window_batches = batches;
+    credit_.window_bytes = static_cast<int64_t>(bytes);
+  }
 
-AdbcStatusCode NativeClient::WriteMessage(const std::vector<uint8_t> &data,
-                                          AdbcError *error) {
-  return WriteExact(data.data(), data.size(), error);
-}
+  Credit &credit() { return credit_; }
+
+  /// Server estimate of the result's size; unknown until the schema-only
+  /// message has been read, or if the server sent none
+  const ResultSizeHint &size_hint() const { return size_hint_; }
+
+  /// Version and merge hint of a QUERY_FLAG_DELTA result; known once the
+  /// schema-only message has been read
+  const ResultDelta &delta() const { return delta_; }
+
+  /// Called by NativeClient once QueryComplete or Error has been read,
+  /// with the pre-aggregation QueryDiagnostics named, if any
+  void Finish(int64_t rows_affected = -1, std::string preaggregation = {}) {
+    if (client_) {
+      CubeMetrics::Global().RecordQuery(sent_, status_ == ADBC_STATUS_OK);
+    }
+    client_ = nullptr;
+    complete_ = true;
+    span_.Event("complete");
+    rows_affected_ = rows_affected;
+    if (options_.stats && rows_affected >= 0 && status_ == ADBC_STATUS_OK &&
+        !limit_reached_) {
+      options_.stats->total_rows.store(rows_affected,
+                                       std::memory_order_relaxed);
+    }
+    if (capture_ && status_ == ADBC_STATUS_OK) {
+      capture_->Complete(rows_affected, std::move(preaggregation));
+    }
+    capture_.reset();
+  }
+
+  /// Row count from QueryComplete; -1 until it has been read, or if the
+  /// server did not know it
+  int64_t rows_affected() const { return rows_affected_; }
+
+  /// Record the first error; buffered data is dropped since the result is
+  /// no longer usable
+  void Fail(AdbcStatusCode code, const std::string &message) {
+    if (status_ != ADBC_STATUS_OK) {
+      return;
+    }
+    status_ = code;
+    last_error_ = message;
+    span_.SetStatus(code);
+    capture_.reset();
+    reader_.reset();
+    batches_.clear();
+    // The queue is the consumer's to empty: get_next releases what is left
+    discard_ready_.store(true, std::memory_order_release);
+  }
+
+  uint64_t sequence() const { return sequence_; }
+
+  /// When the query runs out of time (max() if it has no limit)
+  std::chrono::steady_clock::time_point deadline() const { return deadline_; }
+  void SetDeadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+  }
+
+  /// Whether part of the response is still to be read from the client
+  bool pending() const { return client_ != nullptr; }
+
+  /// Read up to the first batch so the schema is known
+  AdbcStatusCode Start(AdbcError *error) {
+    if (!started_) {
+      started_ = true;
+      StartImpl();
+    }
+    if (status_ != ADBC_STATUS_OK) {
+      SetNativeClientError(error, last_error_);
+    }
+    return status_;
+  }
+
+  int GetSchema(struct ArrowSchema *out) {
+    if (Start(nullptr) != ADBC_STATUS_OK) {
+      return ErrorCode();
+    }
+    if (options_.columns.empty() || options_.raw_ipc) {
+      return ArrowSchemaDeepCopy(&schema_plan_->schema, out);
+    }
+    std::vector<int> fields;
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    int code = ResolveColumns(&schema_plan_->schema, options_.columns,
+                              &fields, &arrow_error);
+    if (code != NANOARROW_OK) {
+      last_error_ = arrow_error.message;
+      return code;
+    }
+    return ProjectSchema(&schema_plan_->schema, fields, out);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    if (Start(nullptr) != ADBC_STATUS_OK) {
+      return ErrorCode();
+    }
+    if (ready_) {
+      // Batches decoded ahead come first, including those queued before
+      // the thread was stopped
+      struct ArrowArray array;
+      while (ready_->Pop(&array)) {
+        if (!discard_ready_.load(std::memory_order_acquire)) {
+          ArrowArrayMove(&array, out);
+          return NANOARROW_OK;
+        }
+        ArrowArrayRelease(&array);
+      }
+      // The thread is done; whatever it stopped at is read from here on
+      if (prefetch_thread_.joinable()) {
+        prefetch_thread_.join();
+      }
+    }
+    return ReadNext(out);
+  }
+
+  /// Start decoding ahead on a background thread, keeping up to
+  /// budget_bytes of decoded batches (at least one) queued for get_next.
+  /// The client must call StopPrefetch before touching its socket again.
+  /// @return false if no thread could be started
+  bool StartPrefetch(NativeClient *client, size_t budget_bytes) {
+    ready_ = std::make_unique<CubeBatchQueue>(kPrefetchBatches, budget_bytes);
+    try {
+      prefetch_thread_ = std::thread([this] { PrefetchLoop(); });
+    } catch (const std::system_error &) {
+      ready_.reset();
+      return false;
+    }
+    prefetch_client_ = client;
+    return true;
+  }
+
+  /// Stop the decode-ahead thread once it has finished the message it is
+  /// reading; already queued batches are still returned, the rest is read
+  /// on demand. Called through NativeClient::StopPrefetch.
+  void StopPrefetch() {
+    prefetch_client_ = nullptr;
+    if (!prefetch_thread_.joinable()) {
+      return;
+    }
+    ready_->Close();
+    prefetch_thread_.join();
+  }
+
+  /// Whether get_next would return without waiting on the decode-ahead
+  /// thread
+  bool PrefetchReady() { return !ready_ || ready_->ready(); }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<NativeResultStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<NativeResultStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<NativeResultStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<NativeResultStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  /// Return the next array, reading from the socket as needed. Runs on the
+  /// decode-ahead thread while it is active, on the consumer otherwise.
+  int ReadNext(struct ArrowArray *out) {
+    while (status_ == ADBC_STATUS_OK) {
+      if (limit_reached_) {
+        out->release = nullptr;
+        return NANOARROW_OK;
+      }
+      if (client_ && client_->IsCancelled(sequence_)) {
+        Fail(ADBC_STATUS_CANCELLED, "Query was cancelled");
+        break;
+      }
+      if (reader_) {
+        int status;
+        {
+          CubeSpan span(span_, "GetNext");
+          DecodeTimer timer(decode_nanos());
+          status = reader_->GetNext(out);
+        }
+        if (status == NANOARROW_OK) {
+          LimitRows(out);
+          if (options_.stats && out->release) {
+            options_.stats->rows.fetch_add(out->length,
+                                           std::memory_order_relaxed);
+          }
+          return NANOARROW_OK;
+        }
+        if (status != ENOMSG) {
+          Fail(ADBC_STATUS_INVALID_DATA,
+               "Failed to decode Arrow IPC record batch");
+          break;
+        }
+        reader_.reset();
+      }
+
+      if (!batches_.empty()) {
+        if (batches_.front().version_end) {
+          batches_.pop_front();
+          return EmptyBatch(out);
+        }
+        if (raw_framer_) {
+          if (TakeRawBatch(out)) {
+            return NANOARROW_OK;
+          }
+          continue;
+        }
+        OpenNextBatch();
+        continue;
+      }
+
+      if (complete_) {
+        out->release = nullptr;
+        return NANOARROW_OK;
+      }
+
+      client_->ReadResult(this);
+    }
+    return ErrorCode();
+  }
+
+  /// Count a decoded batch against options_.max_rows. The batch that
+  /// reaches it is cut to a slice sharing its buffers, and whatever else
+  /// of the result was received is dropped undecoded.
+  void LimitRows(struct ArrowArray *out) {
+    if (options_.max_rows <= 0) {
+      return;
+    }
+    int64_t left = options_.max_rows - rows_returned_;
+    if (out->length < left) {
+      rows_returned_ += out->length;
+      return;
+    }
+    if (out->length > left) {
+      auto batch = std::make_shared<nanoarrow::UniqueArray>();
+      ArrowArrayMove(out, batch->get());
+      ExportSlice(batch, 0, left, out);
+    }
+    rows_returned_ = options_.max_rows;
+    limit_reached_ = true;
+    if (options_.stats) {
+      options_.stats->total_rows.store(options_.max_rows,
+                                       std::memory_order_relaxed);
+    }
+    capture_.reset(); // Not the whole result
+    reader_.reset();
+    batches_.clear();
+    if (client_) {
+      client_->StopResult(this);
+    }
+  }
+
+  /// A batch of no rows of the result's schema
+  int EmptyBatch(struct ArrowArray *out) {
+    nanoarrow::UniqueSchema schema;
+    nanoarrow::UniqueArray array;
+    int code = GetSchema(schema.get());
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr);
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayStartAppending(array.get());
+    }
+    if (code == NANOARROW_OK) {
+      code = ArrowArrayFinishBuildingDefault(array.get(), nullptr);
+    }
+    if (code != NANOARROW_OK) {
+      Fail(ADBC_STATUS_INTERNAL, "Failed to build the end of a version");
+      return ErrorCode();
+    }
+    ArrowArrayMove(array.get(), out);
+    return NANOARROW_OK;
+  }
+
+  void PrefetchLoop() {
+    while (!ready_->closed() && status_ == ADBC_STATUS_OK) {
+      // Wake up now and then so a cancelled query is noticed (and its
+      // response drained) even if the consumer stopped reading; that read
+      // fails before it decodes anything, so it needs no room
+      if (!ready_->WaitForRoom(std::chrono::milliseconds(100)) &&
+          !(client_ && client_->IsCancelled(sequence_))) {
+        continue;
+      }
+      struct ArrowArray array;
+      array.release = nullptr;
+      int status = ReadNext(&array);
+      if (status != NANOARROW_OK || array.release == nullptr) {
+        break;
+      }
+      size_t bytes = ArrayBufferBytes(&array);
+      if (!ready_->TryPush(&array, bytes)) {
+        ArrowArrayRelease(&array);
+        Fail(ADBC_STATUS_INTERNAL, "Decoded batch queue overflowed");
+        break;
+      }
+    }
+    ready_->Close();
+  }
+
+  void StartImpl() {
+    while (status_ == ADBC_STATUS_OK && batches_.empty() && !complete_) {
+      client_->ReadResult(this);
+    }
+    if (status_ != ADBC_STATUS_OK) {
+      return;
+    }
+
+    if (options_.raw_ipc) {
+      StartRaw();
+      return;
+    }
+
+    if (schema_once_) {
+      // The schema-only message comes first and batches rely on it
+      if (schema_message_.empty()) {
+        Fail(ADBC_STATUS_INVALID_DATA, "No result schema received");
+        return;
+      }
+      CubeArrowReader schema_reader(std::move(schema_message_), options_);
+      ArrowError arrow_error;
+      std::memset(&arrow_error, 0, sizeof(arrow_error));
+      int init_status;
+      {
+        DecodeTimer timer(decode_nanos());
+        init_status = schema_reader.Init(&arrow_error);
+      }
+      if (init_status != NANOARROW_OK) {
+        Fail(ADBC_STATUS_INTERNAL,
+             std::string("Failed to read result schema: ") +
+                 arrow_error.message);
+        return;
+      }
+      schema_plan_ = schema_reader.schema_plan();
+      if (!batches_.empty() && !batches_.front().version_end) {
+        OpenNextBatch();
+      }
+      return;
+    }
+
+    // NOTE: Each batch is a complete Arrow IPC stream ([Schema][Batch][EOS]),
+    // so the schema-only message is only used when the result has no batches
+    if (batches_.empty()) {
+      if (schema_message_.empty()) {
+        Fail(ADBC_STATUS_INVALID_DATA, "No Arrow IPC data received");
+        return;
+      }
+      batches_.push_back(std::move(schema_message_));
+    }
+    if (!OpenNextBatch()) {
+      return;
+    }
+    schema_plan_ = reader_->schema_plan();
+  }
+
+  bool OpenNextBatch() {
+    DecodeTimer timer(decode_nanos());
+    std::shared_ptr<const CubeIpcBytes> message;
+    if (!TakeNextBatch(&message)) {
+      return false;
+    }
+    CubeMetrics::Global().decoded_bytes.fetch_add(message->size(),
+                                                  std::memory_order_relaxed);
+    auto reader = std::make_unique<CubeArrowReader>(
+        std::move(message), options_, schema_once_ ? schema_plan_ : nullptr);
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    int init_status = reader->Init(&arrow_error);
+    if (init_status != NANOARROW_OK) {
+      CUBE_LOG(Debug, "NativeResultStream", "Init failed",
+               {{"status", init_status}, {"error", arrow_error.message}});
+      Fail(ADBC_STATUS_INTERNAL, std::string("Failed to initialize Arrow reader: ") +
+                                     arrow_error.message);
+      return false;
+    }
+    reader_ = std::move(reader);
+    return true;
+  }
+
+  /// Raw mode: rows of a single large_binary column "arrow_ipc" hold the
+  /// received messages, one row per batch sent, framed by a CubeIpcExporter
+  /// so that the rows concatenated are one Arrow IPC stream (without the
+  /// end-of-stream marker). The first row holds the schema.
+  void StartRaw() {
+    if (!schema_message_.empty()) {
+      batches_.push_front(std::move(schema_message_));
+      schema_message_.clear();
+    }
+    if (batches_.empty()) {
+      Fail(ADBC_STATUS_INVALID_DATA, "No Arrow IPC data received");
+      return;
+    }
+    auto plan = std::make_shared<CubeSchemaPlan>();
+    struct ArrowSchema *schema = &plan->schema;
+    ArrowSchemaInit(schema);
+    if (ArrowSchemaSetTypeStruct(schema, 1) != NANOARROW_OK ||
+        ArrowSchemaSetType(schema->children[0], NANOARROW_TYPE_LARGE_BINARY) !=
+            NANOARROW_OK ||
+        ArrowSchemaSetName(schema->children[0], "arrow_ipc") != NANOARROW_OK) {
+      Fail(ADBC_STATUS_INTERNAL, "Failed to build raw Arrow IPC schema");
+      return;
+    }
+    schema->children[0]->flags &= ~ARROW_FLAG_NULLABLE;
+    schema_plan_ = std::move(plan);
+    raw_framer_ = std::make_unique<CubeIpcExporter>(
+        [this](const uint8_t *data, size_t size, struct ArrowError *) {
+          raw_runs_.emplace_back(data, size);
+          return NANOARROW_OK;
+        });
+  }
+
+  /// Turn the oldest received batch into a raw row
+  /// @return false if it yields no row (only repeated schema or
+  ///   end-of-stream messages) or the stream failed
+  bool TakeRawBatch(struct ArrowArray *out) {
+    DecodeTimer timer(decode_nanos());
+    std::shared_ptr<const CubeIpcBytes> fragment;
+    if (!TakeNextBatch(&fragment)) {
+      return false;
+    }
+    CubeMetrics::Global().decoded_bytes.fetch_add(fragment->size(),
+                                                  std::memory_order_relaxed);
+    raw_runs_.clear();
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    if (raw_framer_->Write(fragment->data(), fragment->size(), &arrow_error) !=
+        NANOARROW_OK) {
+      Fail(ADBC_STATUS_INVALID_DATA,
+           std::string("Invalid Arrow IPC data: ") + arrow_error.message);
+      return false;
+    }
+    if (raw_runs_.empty()) {
+      return false;
+    }
+    // Almost always one run, shared with the row as is
+    if (raw_runs_.size() > 1) {
+      CubeIpcBuffer joined;
+      for (const auto &run : raw_runs_) {
+        joined.insert(joined.end(), run.first, run.first + run.second);
+      }
+      fragment = std::make_shared<const CubeIpcBytes>(std::move(joined));
+      raw_runs_.assign(1, {fragment->data(), fragment->size()});
+    }
+
+    nanoarrow::UniqueArray array;
+    int status = ArrowArrayInitFromSchema(array.get(), &schema_plan_->schema,
+                                          nullptr);
+    if (status == NANOARROW_OK) {
+      struct ArrowArray *column = array->children[0];
+      const int64_t size = static_cast<int64_t>(raw_runs_[0].second);
+      const int64_t bounds[2] = {0, size};
+      struct ArrowBuffer offsets;
+      ArrowBufferInit(&offsets);
+      struct ArrowBuffer values;
+      WrapSharedIpcBuffer(fragment, raw_runs_[0].first, size, &values);
+      if (ArrowBufferAppend(&offsets, bounds, sizeof(bounds)) != NANOARROW_OK ||
+          ArrowArraySetBuffer(column, 1, &offsets) != NANOARROW_OK ||
+          ArrowArraySetBuffer(column, 2, &values) != NANOARROW_OK) {
+        ArrowBufferReset(&offsets);
+        ArrowBufferReset(&values);
+        status = ENOMEM;
+      } else {
+        column->length = 1;
+        array->length = 1;
+        status = ArrowArrayFinishBuildingDefault(array.get(), nullptr);
+      }
+    }
+    if (status != NANOARROW_OK) {
+      Fail(ADBC_STATUS_INTERNAL, "Failed to build raw Arrow IPC batch");
+      return false;
+    }
+    ArrowArrayMove(array.get(), out);
+    return true;
+  }
+
+  /// Take the oldest received batch. With a spill directory, batches stay
+  /// in memory while those of this result still alive there (in readers
+  /// or shared with arrays) take at most spill_budget_bytes, and the
+  /// memory tracker is within its limit; the rest are moved to the spill
+  /// file. Without one, a batch taken past the limit fails the result.
+  bool TakeNextBatch(std::shared_ptr<const CubeIpcBytes> *out) {
+    if (credit_.limited && client_ && !complete_) {
+      const auto &front = batches_.front();
+      credit_.taken_batches++;
+      credit_.taken_bytes += static_cast<int64_t>(
+          front.shared ? front.shared->size() : front.bytes.size());
+      // Granting half the window at a time keeps the server sending while
+      // the rest is consumed
+      if ((credit_.window_batches > 0 &&
+           credit_.taken_batches * 2 >= credit_.window_batches) ||
+          (credit_.window_bytes > 0 &&
+           credit_.taken_bytes * 2 >= credit_.window_bytes)) {
+        client_->GrantCredit(this);
+      }
+    }
+    if (batches_.front().shared) {
+      // Not on the heap, and spilling it would only copy it
+      *out = std::move(batches_.front().shared);
+      batches_.pop_front();
+      return true;
+    }
+    CubeIpcBuffer batch = std::move(batches_.front().bytes);
+    CubeMemoryCharge charge = std::move(batches_.front().charge);
+    batches_.pop_front();
+    const size_t size = batch.size();
+    // The batch is charged already, so this counts it
+    const bool over_limit = options_.memory && options_.memory->Exceeded();
+    if (options_.spill_dir.empty()) {
+      if (over_limit) {
+        Fail(ADBC_STATUS_INTERNAL,
+             "Result exceeds adbc.cube.memory_limit_bytes with " +
+                 std::to_string(options_.memory->current()) +
+                 " bytes held; release earlier results or set "
+                 "adbc.cube.spill_dir");
+        return false;
+      }
+      *out = KeepResident(std::move(batch), std::move(charge), nullptr);
+      return true;
+    }
+    if (!over_limit &&
+        resident_bytes_->load() + size <= options_.spill_budget_bytes) {
+      resident_bytes_->fetch_add(size);
+      *out = KeepResident(std::move(batch), std::move(charge),
+                          resident_bytes_);
+      return true;
+    }
+    // The copy in the spill file is not counted against the limit
+    charge.Reset();
+    int code = spill_file_ ? 0 : CubeSpillFile::Open(options_.spill_dir,
+                                                     &spill_file_);
+    if (code == 0) {
+      code = spill_file_->Spill(batch, out);
+    }
+    if (code != 0) {
+      Fail(ADBC_STATUS_IO, "Failed to spill result to " + options_.spill_dir +
+                               ": " + std::strerror(code));
+      return false;
+    }
+    return true;
+  }
+
+  /// Where decode time goes, or null when no statistics are kept
+  std::atomic<int64_t> *decode_nanos() const {
+    return options_.stats ? &options_.stats->decode_nanos : nullptr;
+  }
+
+  void CountBatch() {
+    CubeQueryStats *stats = options_.stats.get();
+    if (!stats) {
+      return;
+    }
+    // With several executions, only the first batch of all of them counts
+    if (stats->batches.fetch_add(1, std::memory_order_relaxed) == 0) {
+      stats->time_to_first_batch_nanos.store(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - sent_)
+              .count(),
+          std::memory_order_relaxed);
+    }
+  }
+
+  int ErrorCode() const {
+    switch (status_) {
+    case ADBC_STATUS_CANCELLED:
+      return ECANCELED;
+    case ADBC_STATUS_TIMEOUT:
+      return ETIMEDOUT;
+    case ADBC_STATUS_NOT_FOUND:
+      return ENOENT;
+    case ADBC_STATUS_IO:
+    case ADBC_STATUS_UNKNOWN:
+      return EIO;
+    default:
+      return EINVAL;
+    }
+  }
+
+  NativeClient *client_; // Non-owning; cleared once the response is read
+  CubeReaderOptions options_;
+  uint64_t sequence_; // Position of the query on the session
+  bool schema_once_;  // Batches carry no Schema message
+  std::chrono::steady_clock::time_point sent_; // When the query was sent
+  std::chrono::steady_clock::time_point deadline_ =
+      std::chrono::steady_clock::time_point::max(); // When the query times out
+  // A received batch: bytes the stream owns, or one shared in place; or
+  // the end of a version of a subscribed result
+  struct ReceivedBatch {
+    ReceivedBatch() : version_end(true) {}
+    ReceivedBatch(CubeIpcBuffer received,
+                  CubeMemoryCharge charged = CubeMemoryCharge())
+        : bytes(std::move(received)), charge(std::move(charged)) {}
+    ReceivedBatch(std::shared_ptr<const CubeIpcBytes> received)
+        : shared(std::move(received)) {}
+
+    CubeIpcBuffer bytes;
+    CubeMemoryCharge charge; // For bytes, until they are taken
+    std::shared_ptr<const CubeIpcBytes> shared;
+    bool version_end = false;
+  };
+
+  std::deque<ReceivedBatch> batches_; // Received, not yet decoded
+  CubeIpcBuffer schema_message_;
+  std::unique_ptr<CubeArrowReader> reader_;
+  std::shared_ptr<const CubeSchemaPlan> schema_plan_; // Set by Start
+  std::unique_ptr<CubeResultCapture> capture_; // Null unless caching
+  // Spilling state: bytes of batches held in memory, which shrinks as
+  // arrays are released on any thread, and the file created on demand
+  std::shared_ptr<std::atomic<size_t>> resident_bytes_ =
+      std::make_shared<std::atomic<size_t>>(0);
+  std::unique_ptr<CubeSpillFile> spill_file_;
+  // Raw mode framing, and the runs of the batch being framed
+  std::unique_ptr<CubeIpcExporter> raw_framer_;
+  std::vector<std::pair<const uint8_t *, size_t>> raw_runs_;
+
+  // Decode-ahead state. The queue holds at most kPrefetchBatches batches,
+  // and one more only while those take less than the budget.
+  static constexpr size_t kPrefetchBatches = 256;
+  std::thread prefetch_thread_;
+  NativeClient *prefetch_client_ = nullptr; // Set while the client knows
+  std::unique_ptr<CubeBatchQueue> ready_;   // Created by StartPrefetch
+  std::atomic<bool> discard_ready_{false};  // Set by Fail on either thread
+  bool started_ = false;
+  bool complete_ = false;
+  int64_t rows_returned_ = 0; // Counted only with max_rows
+  bool limit_reached_ = false;
+  CubeSpan span_;          // ExecuteQuery span; inactive without a tracer
+  bool responded_ = false; // first_byte reported
+  int64_t rows_affected_ = -1;
+  ResultSizeHint size_hint_;
+  ResultDelta delta_;
+  Cursor cursor_; // Closed unless the result is read through a cursor
+  Subscription subscription_; // Closed unless the result is subscribed to
+  Credit credit_; // Not limited unless sent under flow control
+  AdbcStatusCode status_ = ADBC_STATUS_OK;
+  std::string last_error_;
+};
+
+AdbcStatusCode NativeClient::ExecuteQuery(const std::string &sql,
+                                          struct ArrowArrayStream *out,
+                                          AdbcError *error) {
+  return ExecuteQuery(sql, reader_options_, out, error);
+}
+
+AdbcStatusCode NativeClient::ExecuteQuery(const std::string &sql,
+                                          const CubeReaderOptions &options,
+                                          struct ArrowArrayStream *out,
+                                          AdbcError *error) {
+  QueryRequest request;
+  request.sql = sql;
+  return SendQuery(request, options, out, error);
+}
+
+AdbcStatusCode NativeClient::Prepare(const std::string &sql,
+                                     std::string *statement_id,
+                                     struct ArrowSchema *result_schema,
+                                     struct ArrowSchema *parameter_schema,
+                                     AdbcError *error) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  if (!authenticated_) {
+    SetNativeClientError(error, "Not authenticated");
+    return ADBC_STATUS_UNAUTHENTICATED;
+  }
+
+  if (!SupportsPrepare()) {
+    SetNativeClientError(error, "Server does not support prepared statements");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+
+  // The PrepareResponse comes after every response already owed
+  auto status = ReadPendingResponses(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  PrepareRequest request;
+  request.sql = sql;
+  auto data = request.Encode();
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto status = WriteExact(data.data(), data.size(), error);
+    if (status != ADBC_STATUS_OK) {
+      CloseAfterError(error);
+      return ADBC_STATUS_IO;
+    }
+  }
+
+  status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+
+  std::unique_ptr<PrepareResponse> response;
+  try {
+    auto msg_type = static_cast<MessageType>(recv_buffer_[0]);
+    if (msg_type == MessageType::Error) {
+      auto message =
+          ErrorMessage::Decode(recv_buffer_.data(), recv_buffer_.size());
+      SetNativeClientError(error, "Prepare error [" + message->code +
+                                      "]: " + message->message);
+      return ADBC_STATUS_UNKNOWN;
+    }
+    response =
+        PrepareResponse::Decode(recv_buffer_.data(), recv_buffer_.size());
+  } catch (const std::exception &e) {
+    SetNativeClientError(error, "Failed to decode prepare response: " +
+                                    std::string(e.what()));
+    CloseAfterError(error);
+    return ADBC_STATUS_INVALID_DATA;
+  }
+
+  // Schemas are parsed like a result's, so the result schema lands in the
+  // schema cache before the statement first runs
+  struct Target {
+    std::vector<uint8_t> *message;
+    struct ArrowSchema *schema;
+  };
+  for (auto target : {Target{&response->result_schema, result_schema},
+                      Target{&response->parameter_schema, parameter_schema}}) {
+    if (target.message->empty()) {
+      continue;
+    }
+    CubeArrowReader reader(*target.message, reader_options_);
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    if (reader.Init(&arrow_error) != NANOARROW_OK ||
+        reader.GetSchema(target.schema) != NANOARROW_OK) {
+      if (result_schema->release) {
+        ArrowSchemaRelease(result_schema);
+      }
+      ClosePrepared(response->statement_id);
+      SetNativeClientError(error, std::string("Failed to read prepared "
+                                              "statement schema: ") +
+                                      arrow_error.message);
+      return ADBC_STATUS_INVALID_DATA;
+    }
+  }
+  *statement_id = std::move(response->statement_id);
+  CUBE_LOG(Debug, "NativeClient", "Prepared statement",
+           {{"statement_id", *statement_id}});
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::Partition(const std::string &sql,
+                                       uint32_t max_partitions,
+                                       struct ArrowSchema *schema,
+                                       std::vector<std::string> *partitions,
+                                       AdbcError *error, bool *more) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  if (!authenticated_) {
+    SetNativeClientError(error, "Not authenticated");
+    return ADBC_STATUS_UNAUTHENTICATED;
+  }
+
+  if (!SupportsPartitions()) {
+    SetNativeClientError(error, "Server does not support partitions");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+
+  if (partitioning_) {
+    SetNativeClientError(error, "Partitions of an earlier query must be "
+                                "read first");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  // The PartitionResponse comes after every response already owed
+  auto status = ReadPendingResponses(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  PartitionRequest request;
+  request.sql = sql;
+  request.max_partitions = max_partitions;
+  request.incremental = more && SupportsIncrementalPartitions();
+  auto data = request.Encode();
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto status = WriteExact(data.data(), data.size(), error);
+    if (status != ADBC_STATUS_OK) {
+      CloseAfterError(error);
+      return ADBC_STATUS_IO;
+    }
+  }
+
+  std::unique_ptr<PartitionResponse> response;
+  status = ReadPartitionResponse(&response, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  // Parsed like a result's schema, so it lands in the schema cache before
+  // the partitions are read
+  CubeArrowReader reader(response->result_schema, reader_options_);
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  if (reader.Init(&arrow_error) != NANOARROW_OK ||
+      reader.GetSchema(schema) != NANOARROW_OK) {
+    SetNativeClientError(error,
+                         std::string("Failed to read partitioned result "
+                                     "schema: ") +
+                             arrow_error.message);
+    if (response->more) {
+      // The rest would be read as answers to later requests
+      CloseAfterError(error);
+    }
+    return ADBC_STATUS_INVALID_DATA;
+  }
+  *partitions = std::move(response->partitions);
+  partitioning_ = request.incremental && response->more;
+  if (more) {
+    *more = partitioning_;
+  }
+  CUBE_LOG(Debug, "NativeClient", "Partitioned query",
+           {{"partitions", partitions->size()}, {"more", partitioning_}});
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::NextPartitions(
+    std::vector<std::string> *partitions, bool *more, AdbcError *error) {
+  if (!IsConnected() || !partitioning_) {
+    SetNativeClientError(error, "No partitions are owed on the session");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  std::unique_ptr<PartitionResponse> response;
+  auto status = ReadPartitionResponse(&response, error);
+  if (status != ADBC_STATUS_OK) {
+    partitioning_ = false;
+    return status;
+  }
+  *partitions = std::move(response->partitions);
+  partitioning_ = response->more;
+  *more = partitioning_;
+  CUBE_LOG(Debug, "NativeClient", "Partitions found",
+           {{"partitions", partitions->size()}, {"more", partitioning_}});
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::ReadPartitionResponse(
+    std::unique_ptr<PartitionResponse> *response, AdbcError *error) {
+  auto status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+
+  try {
+    auto msg_type = static_cast<MessageType>(recv_buffer_[0]);
+    if (msg_type == MessageType::Error) {
+      auto message =
+          ErrorMessage::Decode(recv_buffer_.data(), recv_buffer_.size());
+      SetNativeClientError(error, "Partition error [" + message->code +
+                                      "]: " + message->message);
+      return ADBC_STATUS_UNKNOWN;
+    }
+    *response =
+        PartitionResponse::Decode(recv_buffer_.data(), recv_buffer_.size());
+  } catch (const std::exception &e) {
+    SetNativeClientError(error, "Failed to decode partition response: " +
+                                    std::string(e.what()));
+    CloseAfterError(error);
+    return ADBC_STATUS_INVALID_DATA;
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::ReadPendingResponses(AdbcError *error) {
+  StopPrefetch();
+  // Everything is buffered without being consumed, so no credit would come
+  // back
+  for (auto *pending : pending_) {
+    if (pending) {
+      GrantCredit(pending, true);
+    }
+  }
+  while (!pending_.empty() && IsConnected()) {
+    ReadResponseMessage();
+  }
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Connection lost while reading a result");
+    return ADBC_STATUS_IO;
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::Ingest(IngestRequest request,
+                                    struct ArrowArrayStream *data,
+                                    int64_t *rows, AdbcError *error) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  if (!authenticated_) {
+    SetNativeClientError(error, "Not authenticated");
+    return ADBC_STATUS_UNAUTHENTICATED;
+  }
+
+  if (!SupportsIngest()) {
+    SetNativeClientError(error, "Server does not support bulk ingestion");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  nanoarrow::UniqueSchema schema;
+  if (ArrowArrayStreamGetSchema(data, schema.get(), &arrow_error) !=
+      NANOARROW_OK) {
+    SetNativeClientError(error, std::string("Failed to get schema of data: ") +
+                                    arrow_error.message);
+    return ADBC_STATUS_INVALID_ARGUMENT;
+  }
+  int code = WriteArrowIpcSchema(schema.get(), &request.arrow_ipc_schema,
+                                 &arrow_error);
+  if (code != NANOARROW_OK) {
+    SetNativeClientError(error, std::string("Cannot ingest data: ") +
+                                    arrow_error.message);
+    return code == ENOTSUP ? ADBC_STATUS_NOT_IMPLEMENTED
+                           : ADBC_STATUS_INVALID_ARGUMENT;
+  }
+
+  // The IngestReady comes after every response already owed
+  auto status = ReadPendingResponses(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  status = WriteMessage(request.Encode(), error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+  status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+
+  IngestProgress progress;
+  try {
+    auto msg_type = static_cast<MessageType>(recv_buffer_[0]);
+    if (msg_type == MessageType::Error) {
+      auto message =
+          ErrorMessage::Decode(recv_buffer_.data(), recv_buffer_.size());
+      SetNativeClientError(error, "Ingest error [" + message->code +
+                                      "]: " + message->message);
+      return ADBC_STATUS_UNKNOWN;
+    }
+    auto ready = IngestReady::Decode(recv_buffer_.data(), recv_buffer_.size());
+    progress.window = std::max<uint32_t>(ready->window, 1);
+  } catch (const std::exception &e) {
+    SetNativeClientError(error, "Failed to decode ingest response: " +
+                                    std::string(e.what()));
+    CloseAfterError(error);
+    return ADBC_STATUS_INVALID_DATA;
+  }
+
+  // Stream the batches. A failure ends the load with an aborting
+  // IngestEnd, unless the server already ended it with an Error.
+  AdbcStatusCode result = ADBC_STATUS_OK;
+  while (true) {
+    nanoarrow::UniqueArray batch;
+    if (ArrowArrayStreamGetNext(data, batch.get(), &arrow_error) !=
+        NANOARROW_OK) {
+      SetNativeClientError(error, std::string("Failed to read data: ") +
+                                      arrow_error.message);
+      result = ADBC_STATUS_INVALID_ARGUMENT;
+      break;
+    }
+    if (!batch->release) {
+      break;
+    }
+    result = SendIngestBatch(schema.get(), batch.get(), 0, batch->length,
+                             &progress, error);
+    if (result != ADBC_STATUS_OK) {
+      break;
+    }
+  }
+  if (!IsConnected()) {
+    return result != ADBC_STATUS_OK ? result : ADBC_STATUS_IO;
+  }
+
+  IngestEnd end;
+  end.abort = result != ADBC_STATUS_OK;
+  status = WriteMessage(end.Encode(), error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+  while (!progress.done) {
+    // After a failure of our own, its error is the one reported
+    status = ReadIngestReply(&progress,
+                             result == ADBC_STATUS_OK ? error : nullptr);
+    if (result == ADBC_STATUS_OK) {
+      result = status;
+    }
+  }
+  if (result != ADBC_STATUS_OK) {
+    return result;
+  }
+  *rows = progress.rows;
+  CUBE_LOG(Debug, "NativeClient", "Ingested",
+           {{"rows", progress.rows}, {"table", request.table}});
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::SendIngestBatch(const struct ArrowSchema *schema,
+                                             const struct ArrowArray *array,
+                                             int64_t offset, int64_t length,
+                                             IngestProgress *progress,
+                                             AdbcError *error) {
+  // The batch is written from the caller's buffers, compressed with the
+  // codec the server chose for results, if any
+  ArrowIpcSlices batch;
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  int code = EncodeArrowIpcRecordBatch(schema, array, offset, length,
+                                       compression_, &batch, &arrow_error);
+  if (code != NANOARROW_OK) {
+    SetNativeClientError(error, std::string("Cannot ingest data: ") +
+                                    arrow_error.message);
+    return code == ENOTSUP ? ADBC_STATUS_NOT_IMPLEMENTED
+                           : ADBC_STATUS_INVALID_ARGUMENT;
+  }
+  auto head = IngestBatch::EncodeHead(batch.size);
+  size_t frame_size = head.size() + batch.size;
+  // Either side's limit, whichever is tighter
+  uint32_t limit = max_message_bytes_;
+  if (server_max_message_bytes_ != 0 &&
+      (limit == 0 || server_max_message_bytes_ < limit)) {
+    limit = server_max_message_bytes_;
+  }
+  if (limit != 0 && frame_size > limit && length > 1) {
+    // Split the rows until each message fits
+    int64_t half = length / 2;
+    auto status = SendIngestBatch(schema, array, offset, half, progress, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    return SendIngestBatch(schema, array, offset + half, length - half,
+                           progress, error);
+  }
+
+  // Back-pressure: wait for the server to store a batch rather than go
+  // past its window
+  while (progress->in_flight >= progress->window && !progress->done) {
+    auto status = ReadIngestReply(progress, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+  }
+  if (progress->done) {
+    SetNativeClientError(error, "Server ended the ingestion early");
+    CloseWithReason("Server ended the ingestion early");
+    return ADBC_STATUS_INVALID_DATA;
+  }
+
+  std::vector<struct iovec> iov;
+  iov.reserve(1 + batch.slices.size());
+  iov.push_back({head.data(), head.size()});
+  for (const auto &slice : batch.slices) {
+    iov.push_back({const_cast<uint8_t *>(slice.data), slice.size});
+  }
+  AdbcStatusCode status;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    status = WriteVectored(iov.data(), static_cast<int>(iov.size()), error);
+  }
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+  progress->in_flight++;
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::CommitIngest(const IngestCommit &commit,
+                                          int64_t *rows, AdbcError *error) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  if (!SupportsStagedIngest()) {
+    SetNativeClientError(error, "Server does not support staged ingestion");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  auto status = ReadPendingResponses(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  status = WriteMessage(commit.Encode(), error);
+  if (status != ADBC_STATUS_OK) {
+    CloseAfterError(error);
+    return ADBC_STATUS_IO;
+  }
+  // Answered like the end of a load
+  IngestProgress progress;
+  status = ReadIngestReply(&progress, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  *rows = progress.rows;
+  CUBE_LOG(Debug, "NativeClient",
+           commit.abort ? "Aborted ingestion" : "Committed ingestion",
+           {{"rows", progress.rows}, {"table", commit.table}});
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::ReadIngestReply(IngestProgress *progress,
+                                             AdbcError *error) {
+  auto status = ReadMessage(error);
+  if (status != ADBC_STATUS_OK) {
+    CloseWithReason("Connection lost during ingestion");
+    progress->done = true;
+    return ADBC_STATUS_IO;
+  }
+  auto msg_type = static_cast<MessageType>(recv_buffer_[0]);
+  const char *decode_error = nullptr;
+  if (msg_type == MessageType::IngestAck && progress->in_flight > 0) {
+    int64_t rows = 0;
+    if (IngestAck::DecodeView(recv_buffer_.data(), recv_buffer_.size(), &rows,
+                              &decode_error)) {
+      progress->in_flight--;
+      return ADBC_STATUS_OK;
+    }
+  } else if (msg_type == MessageType::QueryComplete) {
+    if (QueryComplete::DecodeView(recv_buffer_.data(), recv_buffer_.size(),
+                                  &progress->rows, &decode_error)) {
+      progress->done = true;
+      return ADBC_STATUS_OK;
+    }
+  } else if (msg_type == MessageType::Error) {
+    std::string_view code;
+    std::string_view message;
+    if (ErrorMessage::DecodeView(recv_buffer_.data(), recv_buffer_.size(),
+                                 &code, &message, &decode_error)) {
+      SetNativeClientError(error, "Ingest error [" + std::string(code) +
+                                      "]: " + std::string(message));
+      progress->done = true;
+      return ADBC_STATUS_UNKNOWN;
+    }
+  }
+  std::string reason = decode_error ? std::string(decode_error)
+                                    : "Unexpected message type " +
+                                          std::to_string(recv_buffer_[0]);
+  SetNativeClientError(error, "Failed to decode ingest response: " + reason);
+  CloseWithReason("Failed to decode ingest response");
+  progress->done = true;
+  return ADBC_STATUS_INVALID_DATA;
+}
+
+void NativeClient::ClosePrepared(const std::string &statement_id) {
+  if (!IsConnected() || !SupportsPrepare()) {
+    return;
+  }
+  ClosePreparedRequest request;
+  request.statement_id = statement_id;
+  auto data = request.Encode();
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  AdbcError error = ADBC_ERROR_INIT;
+  WriteExact(data.data(), data.size(), &error);
+  if (error.release) {
+    error.release(&error);
+  }
+}
+
+AdbcStatusCode NativeClient::SendQuery(
+    const QueryRequest &query, const CubeReaderOptions &options,
+    struct ArrowArrayStream *out, AdbcError *error, int64_t *rows_affected,
+    ResultSizeHint *size_hint, std::unique_ptr<CubeResultCapture> capture,
+    ResultDelta *delta) {
+  return SendQueryImpl(query, options, /*discard_unread=*/!pipelining_,
+                       /*start=*/!pipelining_, out, error, rows_affected,
+                       size_hint, std::move(capture), delta);
+}
+
+AdbcStatusCode NativeClient::EstimateQuery(
+    const QueryRequest &query, const CubeReaderOptions &options,
+    struct ArrowSchema *schema, ResultSizeHint *size_hint,
+    std::optional<QueryDiagnostics> *diagnostics, AdbcError *error) {
+  if (!SupportsQueryEstimates() || !SupportsSchemaOnly()) {
+    SetNativeClientError(error, "The server cannot estimate queries");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  QueryRequest request = query;
+  request.flags |= QUERY_FLAG_SCHEMA_ONLY;
+  // The plan's diagnostics come with QueryComplete, into stats
+  CubeReaderOptions reader_options = options;
+  reader_options.stats = std::make_shared<CubeQueryStats>();
+  nanoarrow::UniqueArrayStream stream;
+  // Started even when pipelining, so the estimate arrives with the schema
+  auto status = SendQueryImpl(request, reader_options,
+                              /*discard_unread=*/!pipelining_,
+                              /*start=*/true, stream.get(), error,
+                              /*rows_affected=*/nullptr, size_hint);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  if (stream->get_schema(stream.get(), schema) != NANOARROW_OK) {
+    const char *message = stream->get_last_error(stream.get());
+    SetNativeClientError(error, std::string("Failed to read the result "
+                                            "schema: ") +
+                                    (message ? message : "unknown error"));
+    return ADBC_STATUS_IO;
+  }
+  // A schema-only result has no batches: this reads its QueryComplete
+  struct ArrowArray array;
+  if (stream->get_next(stream.get(), &array) != NANOARROW_OK) {
+    const char *message = stream->get_last_error(stream.get());
+    SetNativeClientError(error, std::string("Failed to read the query "
+                                            "plan: ") +
+                                    (message ? message : "unknown error"));
+    ArrowSchemaRelease(schema);
+    return ADBC_STATUS_IO;
+  }
+  if (array.release) {
+    ArrowArrayRelease(&array);
+  }
+  *diagnostics = reader_options.stats->diagnostics();
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::ExecuteUpdate(const QueryRequest &query,
+                                           int64_t *rows_affected,
+                                           AdbcError *error,
+                                           CubeIpcExporter *exporter,
+                                           NativeResumePoint *resume) {
+  auto status = CheckQuery(query, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  // Earlier results are discarded as by SendQuery, or with pipelining read
+  // into their streams, so the next response on the socket is this one
+  status = pipelining_ ? ReadPendingResponses(error) : DiscardUnread(error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  auto deadline = QueryDeadline();
+  auto request = WithTimeout(query);
+  bool resuming = exporter && resume && !resume->handle.empty();
+  if (resuming) {
+    if ((capabilities_ & CAPABILITY_RESUMABLE_RESULTS) == 0) {
+      SetNativeClientError(error, "Server does not support resumable results");
+      return ADBC_STATUS_NOT_IMPLEMENTED;
+    }
+    request.resume_handle = resume->handle;
+    request.resume_from_batch = resume->batches;
+  }
+  auto frame = request.EncodeParts();
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    status = WriteSharedMemoryReleases(error);
+    if (status == ADBC_STATUS_OK) {
+      status = WriteFrame(frame, error);
+    }
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    sequence = ++queries_sent_;
+  }
+  auto sent = std::chrono::steady_clock::now();
+
+  // Keep a released result in pending_ while reading, so the batches are
+  // skipped on the socket rather than decoded
+  pending_.push_back(nullptr);
+  bool complete = false;
+  *rows_affected = -1;
+  CubeIpcBuffer batch;
+  CubeIpcBuffer schema;
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  int export_status = NANOARROW_OK;
+  read_deadline_ = deadline;
+  while (!complete && status == ADBC_STATUS_OK) {
+    bool exporting = exporter && export_status == NANOARROW_OK;
+    schema.clear();
+    status = ReadNextBatch(
+        exporting ? &batch : nullptr, exporting ? &schema : nullptr,
+        &complete, error, rows_affected, /*size_hint=*/nullptr,
+        /*shared=*/nullptr, /*fetch_end=*/nullptr, /*delta=*/nullptr,
+        /*refresh_end=*/nullptr, /*diagnostics=*/nullptr,
+        exporting && resume && !resuming ? &resume->handle : nullptr);
+    if (status == ADBC_STATUS_OK && exporting) {
+      // The schema-only message comes ahead of any batch; a resumed result
+      // sends it again, but the exporter has it already
+      if (!resuming) {
+        export_status = exporter->Write(schema.data(), schema.size(),
+                                        &arrow_error);
+      }
+      if (export_status == NANOARROW_OK && !batch.empty()) {
+        export_status =
+            exporter->Write(batch.data(), batch.size(), &arrow_error);
+        if (export_status == NANOARROW_OK && resume) {
+          resume->batches++;
+        }
+      }
+    }
+  }
+  read_deadline_ = std::chrono::steady_clock::time_point::max();
+  CubeMetrics::Global().RecordQuery(
+      sent, status == ADBC_STATUS_OK && export_status == NANOARROW_OK);
+  if (complete && !pending_.empty()) {
+    pending_.pop_front();
+  }
+  if (status != ADBC_STATUS_OK && IsCancelled(sequence)) {
+    SetNativeClientError(error, "Query was cancelled");
+    return ADBC_STATUS_CANCELLED;
+  }
+  if (status != ADBC_STATUS_OK && timed_out_) {
+    return ADBC_STATUS_TIMEOUT;
+  }
+  if (status == ADBC_STATUS_OK && export_status != NANOARROW_OK) {
+    SetNativeClientError(error, std::string("Failed to export result: ") +
+                                    arrow_error.message);
+    return ADBC_STATUS_IO;
+  }
+  return status;
+}
+
+std::chrono::steady_clock::time_point NativeClient::QueryDeadline() const {
+  if (timeouts_.query_ms <= 0) {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return std::chrono::steady_clock::now() +
+         std::chrono::milliseconds(timeouts_.query_ms);
+}
+
+QueryRequest NativeClient::WithOptions(const QueryRequest &query,
+                                       const CubeReaderOptions &options,
+                                       const CubeSpan &span, bool cursor,
+                                       bool credit) const {
+  QueryRequest request = WithTimeout(query);
+  if ((capabilities_ & CAPABILITY_QUERY_PRIORITY) != 0) {
+    request.priority = options.priority;
+  }
+  if ((capabilities_ & CAPABILITY_FIRST_BATCH_ROWS) != 0) {
+    request.first_batch_rows = options.first_batch_rows;
+  }
+  if ((capabilities_ & CAPABILITY_BATCH_LIMITS) != 0) {
+    request.max_batch_rows = options.max_batch_rows;
+    request.max_batch_bytes = options.max_batch_bytes;
+  }
+  if (options.view_types) {
+    request.flags |= QUERY_FLAG_VIEW_TYPES;
+  }
+  if (options.run_end_encoded) {
+    request.flags |= QUERY_FLAG_RUN_END_ENCODED;
+  }
+  if (span.active() && (capabilities_ & CAPABILITY_TRACE_CONTEXT) != 0) {
+    request.traceparent = span.Traceparent();
+  }
+  if (cursor) {
+    request.flags |= QUERY_FLAG_CURSOR;
+  }
+  if (credit) {
+    request.flags |= QUERY_FLAG_CREDIT;
+  }
+  if (options.subscribe) {
+    request.flags |= QUERY_FLAG_SUBSCRIBE;
+    request.timeout_ms = 0;
+  }
+  if (options.require_preaggregation) {
+    request.flags |= QUERY_FLAG_REQUIRE_PREAGGREGATION;
+  }
+  return request;
+}
+
+bool NativeClient::UseCredit(bool cursor) const {
+  return !cursor && (credit_batches_ > 0 || credit_bytes_ > 0) &&
+         (capabilities_ & CAPABILITY_FLOW_CONTROL) != 0;
+}
+
+AdbcStatusCode NativeClient::WriteInitialCredit(uint64_t query,
+                                                AdbcError *error) {
+  // The server sends no batch before the first grant
+  CreditGrant grant;
+  grant.query = query;
+  grant.batches =
+      credit_batches_ > 0 ? credit_batches_ : CREDIT_UNLIMITED_BATCHES;
+  grant.bytes = credit_bytes_ > 0 ? static_cast<int64_t>(credit_bytes_)
+                                  : CREDIT_UNLIMITED_BYTES;
+  auto data = grant.Encode();
+  return WriteExact(data.data(), data.size(), error);
+}
+
+QueryRequest NativeClient::WithTimeout(const QueryRequest &query) const {
+  QueryRequest request = query;
+  if (timeouts_.query_ms > 0 &&
+      (capabilities_ & CAPABILITY_QUERY_TIMEOUT) != 0) {
+    request.timeout_ms = static_cast<uint32_t>(timeouts_.query_ms);
+  }
+  if ((capabilities_ & CAPABILITY_QUERY_PRIORITY) == 0) {
+    // A hint only: an older server runs the query all the same
+    request.priority = QueryPriority::Default;
+  }
+  return request;
+}
+
+AdbcStatusCode NativeClient::CheckQuery(const QueryRequest &query,
+                                        AdbcError *error) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  if (!authenticated_) {
+    SetNativeClientError(error, "Not authenticated");
+    return ADBC_STATUS_UNAUTHENTICATED;
+  }
+
+  // Older servers would ignore the trailing fields and run something else
+  if (!query.statement_id.empty() && !SupportsPrepare()) {
+    SetNativeClientError(error, "Server does not support prepared statements");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (!query.parameters.empty() && !SupportsParameters()) {
+    SetNativeClientError(error, "Server does not support bound parameters");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (!query.json_query.empty() && !SupportsJsonQuery()) {
+    SetNativeClientError(error, "Server does not support JSON queries");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (query.sampled() && !SupportsSampling()) {
+    SetNativeClientError(error, "Server does not support sampled queries");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (!query.partition.empty() && !SupportsPartitions()) {
+    SetNativeClientError(error, "Server does not support partitions");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (((query.flags & QUERY_FLAG_DELTA) != 0 ||
+       !query.base_version.empty()) &&
+      !SupportsDeltaResults()) {
+    SetNativeClientError(error, "Server does not support delta results");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if ((query.flags & QUERY_FLAG_SUBSCRIBE) != 0 &&
+      (!SupportsSubscriptions() || !IsSchemaOnce())) {
+    SetNativeClientError(error, "Server does not support subscriptions");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  // Sent anyway, the query could reach the source database
+  if ((query.flags & QUERY_FLAG_REQUIRE_PREAGGREGATION) != 0 &&
+      !SupportsRequirePreaggregation()) {
+    SetNativeClientError(
+        error, "Server cannot limit queries to pre-aggregations");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  // A pipelined query would wait behind the subscription forever
+  if (pipelining_ && HasSubscription()) {
+    SetNativeClientError(error, "A subscription holds the session until its "
+                                "stream is released");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  return ADBC_STATUS_OK;
+}
+
+bool NativeClient::HasSubscription() const {
+  for (auto *pending : pending_) {
+    if (pending && pending->subscription().open) {
+      return true;
+    }
+  }
+  return false;
+}
+
+AdbcStatusCode NativeClient::DiscardUnread(AdbcError *error) {
+  // The socket is ours again once the decode-ahead thread has stopped
+  StopPrefetch();
+  for (auto &pending : pending_) {
+    if (pending) {
+      CloseCursor(pending);
+      Unsubscribe(pending);
+      GrantCredit(pending, true);
+      pending->Detach(ADBC_STATUS_INVALID_STATE,
+                      "Result discarded: another query was started on this "
+                      "connection before it was read to the end");
+      pending = nullptr;
+    }
+  }
+  DrainAbandoned();
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Connection lost while discarding a result");
+    return ADBC_STATUS_IO;
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode
+NativeClient::SendQueries(const std::vector<QueryRequest> &queries,
+                          const CubeReaderOptions &options,
+                          std::vector<ArrowArrayStream> *out,
+                          AdbcError *error) {
+  out->clear();
+  if (queries.size() > 1 && SupportsQueryBatch()) {
+    return SendQueryBatch(queries, options, out, error);
+  }
+  for (size_t i = 0; i < queries.size(); i++) {
+    ArrowArrayStream stream;
+    auto status = SendQueryImpl(queries[i], options,
+                                /*discard_unread=*/i == 0 && !pipelining_,
+                                /*start=*/false, &stream, error);
+    if (status != ADBC_STATUS_OK) {
+      for (auto &sent : *out) {
+        sent.release(&sent);
+      }
+      out->clear();
+      return status;
+    }
+    out->push_back(stream);
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode
+NativeClient::SendQueryBatch(const std::vector<QueryRequest> &queries,
+                             const CubeReaderOptions &options,
+                             std::vector<ArrowArrayStream> *out,
+                             AdbcError *error) {
+  for (const auto &query : queries) {
+    auto check = CheckQuery(query, error);
+    if (check != ADBC_STATUS_OK) {
+      return check;
+    }
+  }
+  if (options.require_preaggregation && !SupportsRequirePreaggregation()) {
+    SetNativeClientError(
+        error, "Server cannot limit queries to pre-aggregations");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (pipelining_) {
+    StopPrefetch();
+  } else {
+    auto check = DiscardUnread(error);
+    if (check != ADBC_STATUS_OK) {
+      return check;
+    }
+  }
+
+  // The results come back one after another, so none is read through a
+  // cursor, which would hold back the ones after it
+  bool credit = UseCredit(/*cursor=*/false);
+  std::vector<CubeSpan> spans;
+  spans.reserve(queries.size());
+  QueryBatchRequest batch;
+  batch.queries.reserve(queries.size());
+  for (const auto &query : queries) {
+    spans.emplace_back(tracer_, "ExecuteQuery");
+    batch.queries.push_back(
+        WithOptions(query, options, spans.back(), /*cursor=*/false, credit));
+  }
+  auto deadline = QueryDeadline();
+  auto data = batch.Encode();
+  uint64_t first;
+  {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto status = WriteSharedMemoryReleases(error);
+    if (status == ADBC_STATUS_OK) {
+      status = WriteExact(data.data(), data.size(), error);
+    }
+    for (size_t i = 0; status == ADBC_STATUS_OK && credit && i < queries.size();
+         i++) {
+      status = WriteInitialCredit(queries_sent_ + 1 + i, error);
+    }
+    if (status != ADBC_STATUS_OK) {
+      for (auto &span : spans) {
+        span.SetStatus(status);
+      }
+      return status;
+    }
+    // Each query of the batch is numbered as if sent on its own
+    first = queries_sent_ + 1;
+    queries_sent_ += queries.size();
+  }
+
+  out->resize(queries.size());
+  for (size_t i = 0; i < queries.size(); i++) {
+    spans[i].Event("sent");
+    auto stream = std::make_unique<NativeResultStream>(
+        this, options, first + i, IsSchemaOnce());
+    stream->SetDeadline(deadline);
+    if (credit) {
+      stream->OpenCredit(credit_batches_, credit_bytes_);
+    }
+    stream->SetSpan(std::move(spans[i]));
+    pending_.push_back(stream.get());
+    stream.release()->ExportTo(&(*out)[i]);
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::SendQueryImpl(
+    const QueryRequest &query, const CubeReaderOptions &options,
+    bool discard_unread, bool start, struct ArrowArrayStream *out,
+    AdbcError *error, int64_t *rows_affected, ResultSizeHint *size_hint,
+    std::unique_ptr<CubeResultCapture> capture, ResultDelta *delta) {
+  auto check = CheckQuery(query, error);
+  if (check != ADBC_STATUS_OK) {
+    return check;
+  }
+  if (options.subscribe && (!SupportsSubscriptions() || !IsSchemaOnce())) {
+    SetNativeClientError(error, "Server does not support subscriptions");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+  if (options.require_preaggregation && !SupportsRequirePreaggregation()) {
+    SetNativeClientError(
+        error, "Server cannot limit queries to pre-aggregations");
+    return ADBC_STATUS_NOT_IMPLEMENTED;
+  }
+
+  // Without pipelining, a new query discards whatever earlier results were
+  // not read to the end
+  if (discard_unread) {
+    check = DiscardUnread(error);
+    if (check != ADBC_STATUS_OK) {
+      return check;
+    }
+  } else {
+    // The socket is ours again once the decode-ahead thread has stopped
+    StopPrefetch();
+  }
+
+  // Send query request
+  CubeSpan span(tracer_, "ExecuteQuery");
+  // A cursor holds the session until it ends, so pipelined queries would
+  // wait behind it
+  bool cursor = cursor_fetch_bytes_ > 0 && !pipelining_ && IsSchemaOnce() &&
+                (capabilities_ & CAPABILITY_CURSORS) != 0 &&
+                !options.subscribe;
+  bool credit = UseCredit(cursor);
+  QueryRequest request = WithOptions(query, options, span, cursor, credit);
+
+  // A subscription runs until it is released
+  auto deadline = options.subscribe
+                      ? std::chrono::steady_clock::time_point::max()
+                      : QueryDeadline();
+  auto frame = request.EncodeParts();
+  uint64_t sequence;
+  {
+    // Number the query under the write lock so a concurrent Cancel covers
+    // exactly the queries already on the wire
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto status = WriteSharedMemoryReleases(error);
+    if (status == ADBC_STATUS_OK) {
+      status = WriteFrame(frame, error);
+    }
+    if (status == ADBC_STATUS_OK && credit) {
+      status = WriteInitialCredit(queries_sent_ + 1, error);
+    }
+    if (status != ADBC_STATUS_OK) {
+      span.SetStatus(status);
+      return status;
+    }
+    sequence = ++queries_sent_;
+  }
+  span.Event("sent");
+
+  // Initialize output stream to a safe empty state
+  // This ensures the stream can be safely released even if we return early with an error
+  memset(out, 0, sizeof(*out));
+
+  auto stream =
+      std::make_unique<NativeResultStream>(this, options, sequence,
+                                           IsSchemaOnce());
+  stream->SetCapture(std::move(capture));
+  stream->SetDeadline(deadline);
+  if (cursor) {
+    stream->OpenCursor(cursor_fetch_bytes_);
+  }
+  if (credit) {
+    stream->OpenCredit(credit_batches_, credit_bytes_);
+  }
+  stream->subscription().open = options.subscribe;
+  stream->SetSpan(std::move(span));
+  pending_.push_back(stream.get());
+
+  // Without pipelining, read up to the first batch so errors are reported
+  // here; pipelined results start when the stream is first read
+  if (rows_affected) {
+    *rows_affected = -1;
+  }
+  if (size_hint) {
+    *size_hint = ResultSizeHint();
+  }
+  // The version comes with the schema, so a pipelined result is started
+  // too; the results queued in front of it are buffered
+  if (start || delta) {
+    auto status = stream->Start(error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    if (delta) {
+      *delta = stream->delta();
+    }
+    // Known up front when the whole response has already been read;
+    // otherwise the server's estimate, if it sent one
+    if (size_hint) {
+      *size_hint = stream->size_hint();
+    }
+    if (rows_affected) {
+      *rows_affected = stream->pending() ? stream->size_hint().rows
+                                         : stream->rows_affected();
+    }
+    // The decode-ahead thread could block on a subscription indefinitely
+    if (start && prefetch_bytes_ > 0 && stream->pending() &&
+        !options.subscribe && stream->StartPrefetch(this, prefetch_bytes_)) {
+      prefetching_ = stream.get();
+    }
+  }
+
+  stream.release()->ExportTo(out);
+  CUBE_LOG(Trace, "NativeClient", "Result stream exported");
+  return ADBC_STATUS_OK;
+}
+
+void NativeClient::ReadResult(NativeResultStream *stream) {
+  // Responses arrive in request order: everything queued in front of this
+  // stream is buffered into its own stream, or discarded if abandoned
+  while (!pending_.empty()) {
+    bool mine = pending_.front() == stream;
+    if (!mine && pending_.front()) {
+      // Buffered whether or not it is consumed, so its credit would not
+      // come back while this stream waits behind it
+      GrantCredit(pending_.front(), true);
+    }
+    ReadResponseMessage();
+    if (mine && IsCancelled(stream->sequence())) {
+      // Discard the rest of the cancelled response now so the session is
+      // ready for the next query
+      DrainAbandoned();
+    }
+    if (mine || !IsConnected()) {
+      return;
+    }
+  }
+  stream->Detach(ADBC_STATUS_INTERNAL, "Result is not pending on this client");
+}
+
+AdbcStatusCode NativeClient::ReadResponseMessage() {
+  NativeResultStream *front = pending_.front();
+  if (front && IsCancelled(front->sequence())) {
+    // Discard what the server still sends for a cancelled query
+    front->Fail(ADBC_STATUS_CANCELLED, "Query was cancelled");
+    front->Finish();
+    pending_.front() = nullptr;
+    front = nullptr;
+  }
+  AdbcError error = ADBC_ERROR_INIT;
+  if (front && front->cursor().open && front->cursor().outstanding == 0) {
+    // Nothing more is coming until it is asked for
+    if (SendFetch(front, &error) != ADBC_STATUS_OK) {
+      CloseAfterError(&error);
+      if (error.release) {
+        error.release(&error);
+      }
+      return ADBC_STATUS_IO;
+    }
+  }
+  CubeIpcBuffer batch;
+  CubeIpcBuffer schema;
+  std::shared_ptr<const CubeIpcBytes> shared;
+  bool complete = false;
+  int64_t rows_affected = -1;
+  ResultSizeHint size_hint;
+  ResultDelta delta;
+  bool fetch_end = false;
+  bool refresh_end = false;
+  // A released result has no one waiting on it, so only the read timeout
+  // applies while its response is discarded
+  read_deadline_ =
+      front ? front->deadline() : std::chrono::steady_clock::time_point::max();
+  awaiting_refresh_ =
+      front && front->subscription().open && front->subscription().idle;
+  int64_t received_before = received_bytes_;
+  int64_t wait_before = socket_wait_nanos_;
+  int64_t faults_before = CubeMetrics::ThreadPageFaults();
+  std::optional<QueryDiagnostics> diagnostics;
+  auto status = ReadNextBatch(
+      front ? &batch : nullptr, front ? &schema : nullptr, &complete, &error,
+      &rows_affected, &size_hint, front ? &shared : nullptr, &fetch_end,
+      &delta, &refresh_end,
+      front && (front->stats() || front->capturing()) ? &diagnostics
+                                                      : nullptr);
+  read_deadline_ = std::chrono::steady_clock::time_point::max();
+  awaiting_refresh_ = false;
+  CubeMetrics::Global().receive_page_faults.fetch_add(
+      CubeMetrics::ThreadPageFaults() - faults_before,
+      std::memory_order_relaxed);
+  if (front && front->stats()) {
+    front->stats()->bytes_received.fetch_add(
+        received_bytes_ - received_before, std::memory_order_relaxed);
+    front->stats()->socket_wait_nanos.fetch_add(
+        socket_wait_nanos_ - wait_before, std::memory_order_relaxed);
+  }
+  if (status != ADBC_STATUS_OK && !complete) {
+    // The socket was closed, which already failed every pending result
+    if (error.release) {
+      error.release(&error);
+    }
+    return status;
+  }
+
+  if (front) {
+    front->Received();
+    if (!batch.empty()) {
+      front->AddBatch(std::move(batch));
+    }
+    if (shared) {
+      front->AddSharedBatch(std::move(shared));
+    }
+    if (!schema.empty()) {
+      front->SetSchemaMessage(std::move(schema));
+      front->SetSizeHint(size_hint);
+      front->SetDelta(std::move(delta));
+    }
+    if (front->subscription().open) {
+      front->subscription().idle = refresh_end;
+      if (refresh_end) {
+        front->EndVersion();
+      }
+    }
+    if (status != ADBC_STATUS_OK) {
+      front->Fail(status, TakeErrorMessage(&error, "Query failed"));
+    }
+    if (complete) {
+      // A cached result is tagged with the pre-aggregation that served it,
+      // for CubeChangeWatcher to drop when that one is refreshed
+      std::string preaggregation;
+      if (diagnostics) {
+        preaggregation = diagnostics->preaggregation;
+        if (front->stats()) {
+          front->stats()->SetDiagnostics(std::move(*diagnostics));
+        }
+      }
+      front->cursor().open = false;
+      front->subscription().open = false;
+      front->Finish(rows_affected, std::move(preaggregation));
+    }
+  }
+  if (front && front->cursor().open) {
+    auto &cursor = front->cursor();
+    if (fetch_end) {
+      cursor.outstanding--;
+    } else if ((!batch.empty() || shared) && cursor.outstanding == 1) {
+      // The first batch of a part is in: ask for the next one now, so it
+      // travels while this one is consumed
+      AdbcError fetch_error = ADBC_ERROR_INIT;
+      if (SendFetch(front, &fetch_error) != ADBC_STATUS_OK) {
+        CloseAfterError(&fetch_error);
+      }
+      if (fetch_error.release) {
+        fetch_error.release(&fetch_error);
+      }
+    }
+  }
+  if (error.release) {
+    error.release(&error);
+  }
+  if (complete) {
+    pending_.pop_front();
+  }
+  return status;
+}
+
+AdbcStatusCode NativeClient::SendFetch(NativeResultStream *stream,
+                                       AdbcError *error) {
+  auto &cursor = stream->cursor();
+  auto now = std::chrono::steady_clock::now();
+  if (cursor.last_fetch != std::chrono::steady_clock::time_point()) {
+    int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          now - cursor.last_fetch)
+                          .count();
+    int64_t waited = socket_wait_nanos_ - cursor.wait_at_last_fetch;
+    if (waited * 2 > elapsed) {
+      // The consumer mostly waited on the socket: ask for more at a time
+      cursor.fetch_bytes = std::min(cursor.fetch_bytes * 2, cursor.max_bytes);
+    } else if (waited * 8 < elapsed) {
+      // Batches mostly waited on the consumer: hold less of the result here
+      cursor.fetch_bytes = std::max(cursor.fetch_bytes / 2, cursor.min_bytes);
+    }
+  }
+  cursor.last_fetch = now;
+  cursor.wait_at_last_fetch = socket_wait_nanos_;
+
+  FetchRequest request;
+  request.max_bytes = static_cast<int64_t>(cursor.fetch_bytes);
+  auto data = request.Encode();
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  auto status = WriteExact(data.data(), data.size(), error);
+  if (status == ADBC_STATUS_OK) {
+    cursor.outstanding++;
+  }
+  return status;
+}
+
+void NativeClient::CloseCursor(NativeResultStream *stream) {
+  if (!stream->cursor().open || !IsConnected()) {
+    return;
+  }
+  stream->cursor().open = false;
+  FetchRequest request; // Both limits 0
+  auto data = request.Encode();
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  AdbcError error = ADBC_ERROR_INIT;
+  WriteExact(data.data(), data.size(), &error);
+  if (error.release) {
+    error.release(&error);
+  }
+}
+
+void NativeClient::StopResult(NativeResultStream *stream) {
+  if (!IsConnected()) {
+    return;
+  }
+  if (stream->cursor().open) {
+    CloseCursor(stream);
+    return;
+  }
+  // A CancelRequest stops every query sent before it, so queries sent
+  // after this one must run on; their responses come once the rest of
+  // this one has been skipped
+  if (queries_sent_.load() != stream->sequence()) {
+    return;
+  }
+  AdbcError error = ADBC_ERROR_INIT;
+  Cancel(&error);
+  if (error.release) {
+    error.release(&error);
+  }
+}
+
+void NativeClient::Unsubscribe(NativeResultStream *stream) {
+  if (!stream->subscription().open || !IsConnected()) {
+    return;
+  }
+  stream->subscription().open = false;
+  UnsubscribeRequest request;
+  auto data = request.Encode();
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  AdbcError error = ADBC_ERROR_INIT;
+  WriteExact(data.data(), data.size(), &error);
+  if (error.release) {
+    error.release(&error);
+  }
+}
+
+void NativeClient::GrantCredit(NativeResultStream *stream, bool unlimited) {
+  auto &credit = stream->credit();
+  if (!credit.limited || !IsConnected()) {
+    return;
+  }
+  CreditGrant grant;
+  grant.query = stream->sequence();
+  if (unlimited) {
+    credit.limited = false;
+    grant.batches = CREDIT_UNLIMITED_BATCHES;
+    grant.bytes = CREDIT_UNLIMITED_BYTES;
+  } else {
+    // A dimension without a window was granted unlimited from the start
+    grant.batches = credit.window_batches > 0 ? credit.taken_batches : 0;
+    grant.bytes = credit.window_bytes > 0 ? credit.taken_bytes : 0;
+  }
+  credit.taken_batches = 0;
+  credit.taken_bytes = 0;
+  auto data = grant.Encode();
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  AdbcError error = ADBC_ERROR_INIT;
+  // A failed write surfaces when the result is next read
+  WriteExact(data.data(), data.size(), &error);
+  if (error.release) {
+    error.release(&error);
+  }
+}
+
+void NativeClient::AbandonResult(NativeResultStream *stream) {
+  for (auto &pending : pending_) {
+    if (pending == stream) {
+      // The server stops sending it, and what is already on the way is
+      // skipped
+      CloseCursor(stream);
+      Unsubscribe(stream);
+      GrantCredit(stream, true);
+      pending = nullptr;
+    }
+  }
+  DrainAbandoned();
+}
+
+void NativeClient::DrainAbandoned() {
+  while (!pending_.empty() && !pending_.front()) {
+    ReadResponseMessage();
+  }
+}
+
+AdbcStatusCode NativeClient::ReadNextBatch(CubeIpcBuffer *batch,
+                                           CubeIpcBuffer *schema,
+                                           bool *complete, AdbcError *error,
+                                           int64_t *rows_affected,
+                                           ResultSizeHint *size_hint,
+                                           std::shared_ptr<const CubeIpcBytes>
+                                               *shared,
+                                           bool *fetch_end,
+                                           ResultDelta *delta,
+                                           bool *refresh_end,
+                                           std::optional<QueryDiagnostics>
+                                               *diagnostics,
+                                           std::string *result_handle) {
+  *complete = false;
+  if (batch) {
+    batch->clear();
+  }
+  if (pending_.empty()) {
+    *complete = true;
+    return ADBC_STATUS_OK;
+  }
+  if (shared_memory_ && shared_memory_->HasReleased()) {
+    // Give the server room before waiting on it
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (WriteSharedMemoryReleases(error) != ADBC_STATUS_OK) {
+      CloseAfterError(error);
+      return ADBC_STATUS_IO;
+    }
+  }
+
+  while (true) {
+    uint32_t length = 0;
+    auto status = ReadFrameLength(&length, error);
+    // The refresh a subscription waited on has started to arrive
+    awaiting_refresh_ = false;
+    if (status == ADBC_STATUS_OK) {
+      // Read only the batch header first so the Arrow IPC bytes can go
+      // straight into the vector the reader will own
+      recv_buffer_.resize(
+          std::min<size_t>(length, QueryResponseBatch::kHeaderSize));
+      status = ReadExact(recv_buffer_.data(), recv_buffer_.size(), error);
+    }
+    if (status != ADBC_STATUS_OK) {
+      // Framing is lost once a read fails part-way through a message
+      CloseAfterError(error);
+      return ADBC_STATUS_IO;
+    }
+
+    MessageType msg_type = static_cast<MessageType>(recv_buffer_[0]);
+    if (msg_type != MessageType::QueryResponseBatch &&
+        msg_type != MessageType::QueryResponseBatchChunk &&
+        recv_buffer_.size() < length) {
+      size_t head = recv_buffer_.size();
+      recv_buffer_.resize(length);
+      status = ReadExact(recv_buffer_.data() + head, length - head, error);
+      if (status != ADBC_STATUS_OK) {
+        CloseAfterError(error);
+        return ADBC_STATUS_IO;
+      }
+    }
+
+    // Messages here are decoded in place, without throwing
+    const char *decode_error = nullptr;
+    auto decode_failed = [&]() {
+      SetNativeClientError(error, std::string("Failed to decode response: ") +
+                                      decode_error);
+      CloseAfterError(error);
+      return ADBC_STATUS_INVALID_DATA;
+    };
+    switch (msg_type) {
+    case MessageType::QueryResponseSchema: {
+      if (schema) {
+        const uint8_t *schema_data = nullptr;
+        size_t schema_size = 0;
+        ResultSizeHint hint;
+        ResultDelta result_delta;
+        if (!QueryResponseSchema::DecodeView(
+                recv_buffer_.data(), recv_buffer_.size(), &schema_data,
+                &schema_size, &hint, &result_delta, &decode_error,
+                result_handle)) {
+          return decode_failed();
+        }
+        schema->assign(schema_data, schema_data + schema_size);
+        if (size_hint) {
+          *size_hint = hint;
+        }
+        if (delta) {
+          *delta = std::move(result_delta);
+        }
+      }
+      CUBE_LOG(Trace, "NativeClient", "Schema received");
+      break;
+    }
+
+    case MessageType::QueryResponseBatchChunk:
+    case MessageType::QueryResponseBatch: {
+      // A large batch arrives as chunks followed by a final
+      // QueryResponseBatch; append each piece straight into the batch
+      bool last = msg_type == MessageType::QueryResponseBatch;
+      uint32_t ipc_length = 0;
+      if (!(last ? QueryResponseBatch::DecodeHeader(
+                       recv_buffer_.data(), recv_buffer_.size(), &ipc_length,
+                       &decode_error)
+                 : QueryResponseBatchChunk::DecodeHeader(
+                       recv_buffer_.data(), recv_buffer_.size(), &ipc_length,
+                       &decode_error))) {
+        return decode_failed();
+      }
+      if (ipc_length != length - QueryResponseBatch::kHeaderSize) {
+        SetNativeClientError(error,
+                             "Batch length does not match message length");
+        CloseAfterError(error);
+        return ADBC_STATUS_INVALID_DATA;
+      }
+      if (batch) {
+        size_t offset = batch->size();
+        batch->resize(offset + ipc_length);
+        status = ReadExact(batch->data() + offset, ipc_length, error);
+      } else {
+        status = DiscardExact(ipc_length, error);
+      }
+      if (status != ADBC_STATUS_OK) {
+        if (batch) {
+          batch->clear();
+        }
+        CloseAfterError(error);
+        return ADBC_STATUS_IO;
+      }
+      if (!last) {
+        break;
+      }
+      CUBE_LOG(Trace, "NativeClient", "Batch received",
+               {{"bytes", batch ? batch->size() : 0}});
+      return ADBC_STATUS_OK;
+    }
+
+    case MessageType::QueryResponseBatchCompressed: {
+      uint8_t codec = 0;
+      int64_t uncompressed_length = 0;
+      const uint8_t *compressed = nullptr;
+      size_t compressed_size = 0;
+      if (!QueryResponseBatchCompressed::DecodeView(
+              recv_buffer_.data(), recv_buffer_.size(), &codec,
+              &uncompressed_length, &compressed, &compressed_size,
+              &decode_error)) {
+        return decode_failed();
+      }
+      if (codec != static_cast<uint8_t>(compression_) ||
+          compression_ == CompressionCodec::None) {
+        SetNativeClientError(error, "Batch uses compression codec " +
+                                        std::to_string(codec) +
+                                        " that was not negotiated");
+        CloseAfterError(error);
+        return ADBC_STATUS_INVALID_DATA;
+      }
+      if (uncompressed_length < 0) {
+        SetNativeClientError(error, "Invalid uncompressed batch length");
+        CloseAfterError(error);
+        return ADBC_STATUS_INVALID_DATA;
+      }
+      if (batch) {
+        // Decompress straight into the vector the reader will own
+        size_t offset = batch->size();
+        batch->resize(offset + static_cast<size_t>(uncompressed_length));
+        ArrowError arrow_error;
+        std::memset(&arrow_error, 0, sizeof(arrow_error));
+        if (Decompress(compression_, compressed, compressed_size,
+                       batch->data() + offset,
+                       static_cast<size_t>(uncompressed_length),
+                       &arrow_error) != NANOARROW_OK) {
+          batch->clear();
+          SetNativeClientError(error, arrow_error.message);
+          CloseAfterError(error);
+          return ADBC_STATUS_INVALID_DATA;
+        }
+      }
+      CUBE_LOG(Trace, "NativeClient", "Compressed batch received",
+               {{"bytes", compressed_size},
+                {"uncompressed_bytes", uncompressed_length}});
+      return ADBC_STATUS_OK;
+    }
+
+    case MessageType::QueryResponseBatchShared: {
+      int64_t offset = 0;
+      int64_t shared_length = 0;
+      if (!QueryResponseBatchShared::DecodeView(
+              recv_buffer_.data(), recv_buffer_.size(), &offset,
+              &shared_length, &decode_error)) {
+        return decode_failed();
+      }
+      std::shared_ptr<const CubeIpcBytes> view;
+      if (!shared_memory_ ||
+          !shared_memory_->View(offset, shared_length, &view)) {
+        SetNativeClientError(error,
+                             shared_memory_
+                                 ? "Shared batch is outside the region"
+                                 : "Shared batch without shared memory");
+        CloseAfterError(error);
+        return ADBC_STATUS_INVALID_DATA;
+      }
+      if (shared) {
+        *shared = std::move(view);
+      } else if (batch) {
+        // The range is released once view goes
+        batch->assign(view->data(), view->data() + view->size());
+      }
+      CUBE_LOG(Trace, "NativeClient", "Shared memory batch received",
+               {{"bytes", shared_length}});
+      return ADBC_STATUS_OK;
+    }
+
+    case MessageType::FetchEnd:
+      // A cursor waits for the client to ask for more
+      if (fetch_end) {
+        *fetch_end = true;
+      }
+      return ADBC_STATUS_OK;
+
+    case MessageType::RefreshEnd:
+      // A subscription waits for the data to be refreshed
+      if (refresh_end) {
+        *refresh_end = true;
+      }
+      return ADBC_STATUS_OK;
+
+    case MessageType::QueryComplete: {
+      int64_t rows = 0;
+      if (!QueryComplete::DecodeView(recv_buffer_.data(), recv_buffer_.size(),
+                                     &rows, &decode_error, diagnostics)) {
+        return decode_failed();
+      }
+      if (rows_affected) {
+        *rows_affected = rows;
+      }
+      *complete = true;
+      return ADBC_STATUS_OK;
+    }
+
+    case MessageType::Error: {
+      // The server ends the query with the error message
+      *complete = true;
+
+      std::string_view code;
+      std::string_view message;
+      if (ErrorMessage::DecodeView(recv_buffer_.data(), recv_buffer_.size(),
+                                   &code, &message, &decode_error)) {
+        CUBE_LOG(Debug, "NativeClient", "Query failed",
+                 {{"code", code}, {"message", message}});
+        SetNativeClientError(error, "Query error [" + std::string(code) +
+                                        "]: " + std::string(message));
+        // Told apart from other failures, so callers can fall back
+        if (code == ERROR_CODE_NO_PREAGGREGATION) {
+          return ADBC_STATUS_NOT_FOUND;
+        }
+        if (code == ERROR_CODE_STALE_STATEMENT) {
+          return ADBC_STATUS_INVALID_STATE;
+        }
+      } else {
+        CUBE_LOG(Warn, "NativeClient", "Cannot decode error message",
+                 {{"error", decode_error}});
+        SetNativeClientError(error,
+                             std::string("Query failed (error message decode "
+                                         "failed): ") +
+                                 decode_error);
+      }
+      return ADBC_STATUS_UNKNOWN;
+    }
+
+    default: {
+      SetNativeClientError(
+          error, "Unexpected message type: " +
+                     std::to_string(static_cast<uint8_t>(msg_type)));
+      CloseAfterError(error);
+      return ADBC_STATUS_INVALID_DATA;
+    }
+    }
+  }
+}
+
+AdbcStatusCode NativeClient::PollResponse(bool *ready, AdbcError *error) {
+  if (prefetching_) {
+    // The decode-ahead thread owns the socket
+    *ready = prefetching_->PrefetchReady();
+    return ADBC_STATUS_OK;
+  }
+
+  *ready = true;
+  if (!IsConnected() || pending_.empty()) {
+    return ADBC_STATUS_OK;
+  }
+
+  size_t missing;
+  int fetch_ends = 0;
+  while ((missing = InboundMissingBytes(&fetch_ends)) > 0) {
+    NativeResultStream *front = pending_.front();
+    if (front && front->cursor().open &&
+        front->cursor().outstanding <= fetch_ends) {
+      // Every part asked for is here; nothing more comes until the next
+      // one is asked for
+      if (SendFetch(front, error) != ADBC_STATUS_OK) {
+        CloseAfterError(error);
+        return ADBC_STATUS_IO;
+      }
+    }
+    constexpr size_t kMinRead = 64 * 1024;
+    size_t want = std::max(missing, kMinRead);
+    uint8_t *target = ReserveInbound(want);
+    ssize_t n = transport_->ReadAvailable(target, want);
+    if (n > 0) {
+      inbound_end_ += static_cast<size_t>(n);
+      if (capture_) {
+        capture_->Received(target, static_cast<size_t>(n));
+      }
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        *ready = false;
+        return ADBC_STATUS_OK;
+      }
+      SetNativeClientError(error, "Socket read error: " +
+                                      std::string(strerror(errno)));
+      CloseAfterError(error);
+      return ADBC_STATUS_IO;
+    }
+    if (n == 0) {
+      // Peer closed; the buffered bytes are still served and the next
+      // blocking read reports the EOF
+      return ADBC_STATUS_OK;
+    }
+  }
+  return ADBC_STATUS_OK;
+}
+
+size_t NativeClient::InboundMissingBytes(int *fetch_ends) const {
+  size_t pos = inbound_pos_;
+  if (fetch_ends) {
+    *fetch_ends = 0;
+  }
+  while (true) {
+    size_t available = inbound_end_ - pos;
+    if (available < 4) {
+      return 4 - available;
+    }
+    const uint8_t *frame = inbound_.get() + pos;
+    uint32_t length = (static_cast<uint32_t>(frame[0]) << 24) |
+                      (static_cast<uint32_t>(frame[1]) << 16) |
+                      (static_cast<uint32_t>(frame[2]) << 8) |
+                      (static_cast<uint32_t>(frame[3]));
+    if (length == 0) {
+      // Malformed; let the blocking read report it
+      return 0;
+    }
+    if (available < 4 + static_cast<size_t>(length)) {
+      return 4 + static_cast<size_t>(length) - available;
+    }
+    auto type = static_cast<MessageType>(frame[4]);
+    if (type != MessageType::QueryResponseBatchChunk &&
+        type != MessageType::QueryResponseSchema &&
+        type != MessageType::FetchEnd) {
+      return 0;
+    }
+    if (type == MessageType::FetchEnd && fetch_ends) {
+      (*fetch_ends)++;
+    }
+    pos += 4 + static_cast<size_t>(length);
+  }
+}
+
+bool NativeClient::IsHealthy() const {
+  if (!IsReusable() || inbound_pos_ != inbound_end_ ||
+      transport_->HasBuffered()) {
+    return false;
+  }
+  struct pollfd pfd;
+  pfd.fd = transport_->fd();
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int ready;
+  do {
+    ready = poll(&pfd, 1, 0);
+  } while (ready < 0 && errno == EINTR);
+  return ready == 0;
+}
+
+AdbcStatusCode NativeClient::Cancel(AdbcError *error) {
+  if (!IsConnected()) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  uint64_t sent = queries_sent_.load();
+  if (cancelled_upto_.load() >= sent) {
+    return ADBC_STATUS_OK; // Nothing new to cancel
+  }
+  CancelRequest request;
+  auto data = request.Encode();
+  auto status = WriteExact(data.data(), data.size(), error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  cancelled_upto_.store(sent);
+  return ADBC_STATUS_OK;
+}
+
+void NativeClient::Close() {
+  if (prefetching_) {
+    // Wake the decode-ahead thread if it is blocked on the socket
+    if (transport_) {
+      transport_->Shutdown();
+    }
+    StopPrefetch();
+  }
+  CloseWithReason("Connection closed");
+}
+
+void NativeClient::StopPrefetch() {
+  if (prefetching_) {
+    // Clear the pointer only after the thread is gone, since the thread
+    // may read it through CloseWithReason
+    prefetching_->StopPrefetch();
+    prefetching_ = nullptr;
+  }
+}
+
+void NativeClient::Abandon() {
+  // The session is the parent's: it is neither resumed nor told to close
+  authenticated_ = false;
+  session_id_.clear();
+  lost_session_id_.clear();
+  CloseWithReason("Connection was opened by the parent process");
+}
+
+void NativeClient::CloseAfterError(const AdbcError *error) {
+  CloseWithReason(error && error->message ? error->message
+                                          : "Connection lost");
+}
+
+void NativeClient::CloseWithReason(const std::string &reason) {
+  auto pending = std::move(pending_);
+  pending_.clear();
+  auto code = timed_out_ ? ADBC_STATUS_TIMEOUT : ADBC_STATUS_IO;
+  for (auto *stream : pending) {
+    if (stream) {
+      stream->Detach(code, reason);
+    }
+  }
+  inbound_pos_ = 0;
+  inbound_end_ = 0;
+  transport_.reset();
+  // A session given over to notifications has no queries to resume
+  if (authenticated_ && !watching_) {
+    lost_session_id_ = std::move(session_id_);
+  }
+  authenticated_ = false;
+  watching_ = false;
+  partitioning_ = false;
+  session_id_.clear();
+  server_version_.clear();
+  compression_ = CompressionCodec::None;
+  capabilities_ = 0;
+  server_parameters_.clear();
+  server_max_message_bytes_ = 0;
+  shared_memory_.reset();
+}
+
+AdbcStatusCode NativeClient::ReadFrameLength(uint32_t *length,
+                                             AdbcError *error) {
+  // Read 4-byte length prefix
+  uint8_t length_buf[4];
+  auto status = ReadExact(length_buf, 4, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  // Decode length (big-endian)
+  *length = (static_cast<uint32_t>(length_buf[0]) << 24) |
+            (static_cast<uint32_t>(length_buf[1]) << 16) |
+            (static_cast<uint32_t>(length_buf[2]) << 8) |
+            (static_cast<uint32_t>(length_buf[3]));
+
+  if (*length == 0) {
+    SetNativeClientError(error, "Invalid message length: 0");
+    return ADBC_STATUS_IO;
+  }
+  if (max_message_bytes_ != 0 && *length > max_message_bytes_) {
+    SetNativeClientError(error, "Message length " + std::to_string(*length) +
+                                    " exceeds adbc.cube.max_message_bytes (" +
+                                    std::to_string(max_message_bytes_) + ")");
+    return ADBC_STATUS_IO;
+  }
+  received_bytes_ += 4 + static_cast<int64_t>(*length);
+  CubeMetrics::Global().bytes_received.fetch_add(
+      4 + static_cast<int64_t>(*length), std::memory_order_relaxed);
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::ReadMessage(AdbcError *error) {
+  uint32_t length = 0;
+  auto status = ReadFrameLength(&length, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+
+  // Read the payload in place; the buffer keeps its capacity between messages
+  recv_buffer_.resize(length);
+  return ReadExact(recv_buffer_.data(), length, error);
+}
+
+AdbcStatusCode NativeClient::DiscardExact(size_t length, AdbcError *error) {
+  constexpr size_t kDiscardChunk = 64 * 1024;
+  recv_buffer_.resize(std::min(length, kDiscardChunk));
+  while (length > 0) {
+    size_t n = std::min(length, recv_buffer_.size());
+    auto status = ReadExact(recv_buffer_.data(), n, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    length -= n;
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::WriteMessage(const std::vector<uint8_t> &data,
+                                          AdbcError *error) {
+  std::lock_guard<std::mutex> lock(write_mutex_);
+  return WriteExact(data.data(), data.size(), error);
+}
+
+uint8_t *NativeClient::ReserveInbound(size_t length) {
+  size_t buffered = inbound_end_ - inbound_pos_;
+  if (inbound_capacity_ - inbound_end_ < length) {
+    if (inbound_capacity_ - buffered >= length) {
+      // Enough room once the consumed bytes are dropped
+      std::memmove(inbound_.get(), inbound_.get() + inbound_pos_, buffered);
+    } else {
+      size_t capacity = std::max(buffered + length, 2 * inbound_capacity_);
+      std::unique_ptr<uint8_t[]> grown(new uint8_t[capacity]);
+      if (buffered > 0) {
+        std::memcpy(grown.get(), inbound_.get() + inbound_pos_, buffered);
+      }
+      inbound_ = std::move(grown);
+      inbound_capacity_ = capacity;
+      if (transport_) {
+        transport_->RegisterBuffer(inbound_.get(), inbound_capacity_);
+      }
+    }
+    inbound_pos_ = 0;
+    inbound_end_ = buffered;
+  }
+  return inbound_.get() + inbound_end_;
+}
+
+void NativeClient::ConsumeInbound(size_t length) {
+  inbound_pos_ += length;
+  if (inbound_pos_ == inbound_end_) {
+    inbound_pos_ = 0;
+    inbound_end_ = 0;
+    if (inbound_capacity_ > kReadAheadBytes) {
+      // Grown by PollResponse for a large message; don't keep it
+      if (transport_) {
+        transport_->RegisterBuffer(nullptr, 0);
+      }
+      inbound_.reset();
+      inbound_capacity_ = 0;
+    }
+  }
+}
 
 AdbcStatusCode NativeClient::ReadExact(uint8_t *buffer, size_t length,
                                        AdbcError *error) {
-  size_t total_read = 0;
+  size_t total_read = std::min(length, inbound_end_ - inbound_pos_);
+  if (total_read > 0) {
+    std::memcpy(buffer, inbound_.get() + inbound_pos_, total_read);
+    ConsumeInbound(total_read);
+  }
+  if (total_read < length && !transport_) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_IO;
+  }
+  bool limited = (timeouts_.read_ms > 0 && !awaiting_refresh_) ||
+                 read_deadline_ != std::chrono::steady_clock::time_point::max();
   while (total_read < length) {
-    ssize_t n = read(socket_fd_, buffer + total_read, length - total_read);
+    auto wait_start = std::chrono::steady_clock::now();
+    if (limited) {
+      auto status = WaitForSocket(POLLIN, read_deadline_, error);
+      if (status != ADBC_STATUS_OK) {
+        return status;
+      }
+    }
+    // Nothing is buffered here: a large read goes straight into buffer,
+    // anything smaller reads a whole window ahead
+    size_t missing = length - total_read;
+    bool direct = missing >= kReadAheadBytes;
+    uint8_t *target =
+        direct ? buffer + total_read : ReserveInbound(kReadAheadBytes);
+    ssize_t n = transport_->Read(target, direct ? missing : kReadAheadBytes);
+    socket_wait_nanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - wait_start)
+                              .count();
     if (n < 0) {
       if (errno == EINTR)
         continue; // Interrupted, retry
@@ -420,27 +3732,164 @@ AdbcStatusCode NativeClient::ReadExact(uint8_t *buffer, size_t length,
       SetNativeClientError(error, "Connection closed by server");
       return ADBC_STATUS_IO;
     }
-    total_read += n;
+    if (capture_) {
+      capture_->Received(target, static_cast<size_t>(n));
+    }
+    if (direct) {
+      total_read += static_cast<size_t>(n);
+      continue;
+    }
+    inbound_end_ += static_cast<size_t>(n);
+    size_t take = std::min(missing, static_cast<size_t>(n));
+    std::memcpy(buffer + total_read, target, take);
+    ConsumeInbound(take);
+    total_read += take;
+  }
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode NativeClient::WaitForSocket(
+    short events, std::chrono::steady_clock::time_point deadline,
+    AdbcError *error) {
+  using Clock = std::chrono::steady_clock;
+  auto wake = deadline;
+  if (timeouts_.read_ms > 0 && !awaiting_refresh_) {
+    auto read_limit = std::chrono::milliseconds(timeouts_.read_ms);
+    wake = std::min(wake, Clock::now() + read_limit);
+  }
+  if ((events & POLLIN) != 0 && transport_->HasBuffered()) {
+    return ADBC_STATUS_OK;
+  }
+  struct pollfd pfd;
+  pfd.fd = transport_->fd();
+  pfd.events = events;
+  int ready;
+  do {
+    pfd.revents = 0;
+    ready = poll(&pfd, 1, PollTimeoutMs(wake));
+  } while (ready < 0 && errno == EINTR);
+  if (ready < 0) {
+    SetNativeClientError(error, "Socket poll error: " +
+                                    std::string(strerror(errno)));
+    return ADBC_STATUS_IO;
+  }
+  if (ready == 0) {
+    timed_out_ = true;
+    if (wake == deadline) {
+      SetNativeClientError(error, "Query timed out after " +
+                                      std::to_string(timeouts_.query_ms) +
+                                      " ms");
+    } else {
+      SetNativeClientError(error, "Timed out after " +
+                                      std::to_string(timeouts_.read_ms) +
+                                      " ms waiting for the server");
+    }
+    return ADBC_STATUS_TIMEOUT;
   }
   return ADBC_STATUS_OK;
 }
 
 AdbcStatusCode NativeClient::WriteExact(const uint8_t *buffer, size_t length,
                                         AdbcError *error) {
-  size_t total_written = 0;
-  while (total_written < length) {
-    ssize_t n =
-        write(socket_fd_, buffer + total_written, length - total_written);
+  struct iovec iov;
+  iov.iov_base = const_cast<uint8_t *>(buffer);
+  iov.iov_len = length;
+  return WriteVectored(&iov, 1, error);
+}
+
+AdbcStatusCode NativeClient::WriteFrame(const FrameParts &frame,
+                                        AdbcError *error) {
+  struct iovec iov[3];
+  iov[0].iov_base = const_cast<uint8_t *>(frame.head.data());
+  iov[0].iov_len = frame.head.size();
+  iov[1].iov_base = const_cast<uint8_t *>(frame.body);
+  iov[1].iov_len = frame.body_size;
+  iov[2].iov_base = const_cast<uint8_t *>(frame.tail.data());
+  iov[2].iov_len = frame.tail.size();
+  return WriteVectored(iov, 3, error);
+}
+
+AdbcStatusCode NativeClient::WriteVectored(struct iovec *iov, int count,
+                                           AdbcError *error) {
+  // Writes do not block, so a server that stops reading is noticed by
+  // WaitForSocket; only the read timeout applies, since Cancel may write
+  // from another thread while a query is read
+  if (!transport_) {
+    SetNativeClientError(error, "Not connected");
+    return ADBC_STATUS_IO;
+  }
+  if (IsInherited()) {
+    // Bytes written here would land among the parent's frames
+    SetNativeClientError(error, "Connection was opened by the parent process");
+    return ADBC_STATUS_INVALID_STATE;
+  }
+  while (count > 0) {
+    // A wide ingested batch may be made of more buffers than one call takes
+    int batch = std::min(count, IOV_MAX);
+    ssize_t n = transport_->Write(iov, batch);
     if (n < 0) {
       if (errno == EINTR)
         continue; // Interrupted, retry
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        auto status = WaitForSocket(
+            POLLOUT, std::chrono::steady_clock::time_point::max(), error);
+        if (status != ADBC_STATUS_OK) {
+          return status;
+        }
+        continue;
+      }
       SetNativeClientError(error, "Socket write error: " +
                                       std::string(strerror(errno)));
       return ADBC_STATUS_IO;
     }
-    total_written += n;
+    CubeMetrics::Global().bytes_sent.fetch_add(n, std::memory_order_relaxed);
+    if (capture_) {
+      capture_->Sent(iov, batch, static_cast<size_t>(n));
+    }
+    // Skip what was written, including empty parts
+    size_t written = static_cast<size_t>(n);
+    while (count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
   }
   return ADBC_STATUS_OK;
 }
 
+void ExportCachedResult(const CubeCachedResult &result,
+                        const CubeReaderOptions &options,
+                        struct ArrowArrayStream *out) {
+  // A stream with no client and a complete response, filled with copies
+  // since the readers take ownership of their messages
+  auto stream = std::make_unique<NativeResultStream>(nullptr, options, 0,
+                                                     result.schema_once);
+  stream->SetSchemaMessage(result.schema_message);
+  for (const auto &batch : result.batches) {
+    stream->AddBatch(batch);
+  }
+  stream->Finish(result.rows_affected);
+  stream.release()->ExportTo(out);
+}
+
+void ExportSharedResult(const CubeSharedResult &result,
+                        const CubeReaderOptions &options,
+                        struct ArrowArrayStream *out) {
+  auto stream = std::make_unique<NativeResultStream>(nullptr, options, 0,
+                                                     result.schema_once);
+  const auto &[schema, schema_size] = result.schema_message;
+  stream->SetSchemaMessage(CubeIpcBuffer(schema, schema + schema_size));
+  for (const auto &[data, size] : result.batches) {
+    // Each batch keeps the mapping alive until its arrays are released
+    stream->AddSharedBatch(
+        std::make_shared<const CubeIpcBytes>(result.owner, data, size));
+  }
+  stream->Finish(result.rows_affected);
+  stream.release()->ExportTo(out);
+}
+
 } // namespace adbc::cube
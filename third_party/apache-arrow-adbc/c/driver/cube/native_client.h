@@ -1,16 +1,67 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include <sys/uio.h>
+
+#include "address_cache.h"
 #include "arrow_reader.h"
+#include "capture.h"
+#include "compression.h"
+#include "fork_guard.h"
+#include "ipc_export.h"
 #include "native_protocol.h"
+#include "result_cache.h"
+#include "shared_memory.h"
+#include "shared_result_cache.h"
+#include "tls.h"
+#include "tracing.h"
+#include "transport.h"
 #include <arrow-adbc/adbc.h>
 
 namespace adbc::cube {
 
+class NativeResultStream;
+
+/// Options applied to the native protocol socket before it connects
+struct NativeSocketOptions {
+  bool tcp_nodelay = true;   // Send small requests at once (no Nagle delay)
+  int recv_buffer_bytes = 0; // SO_RCVBUF; 0 = system default
+  int send_buffer_bytes = 0; // SO_SNDBUF; 0 = system default
+  // TCP keepalive: probe a connection idle for keepalive_idle_s seconds
+  // (0 = no keepalive) every keepalive_interval_s seconds, and drop it
+  // after keepalive_count unanswered probes (0 = system default)
+  int keepalive_idle_s = 0;
+  int keepalive_interval_s = 0;
+  int keepalive_count = 0;
+  // SO_BUSY_POLL (Linux): microseconds a blocking read spins on the device
+  // queue before sleeping; 0 = off
+  int busy_poll_us = 0;
+};
+
 /// Native client for connecting to Cube via custom Arrow IPC protocol
+/// How long the native protocol waits on the server; 0 = no limit
+struct NativeTimeouts {
+  int connect_ms = 0; // Connecting, across every address tried
+  int read_ms = 0;    // Any one wait for the server to send or take data
+  int query_ms = 0;   // A query, from sending it to its last message
+};
+
+/// How far an exported result got, so that after the session is lost one
+/// resuming it can have the server send the rest
+/// (CAPABILITY_RESUMABLE_RESULTS)
+struct NativeResumePoint {
+  std::string handle;  // From QueryResponseSchema; empty if not resumable
+  int64_t batches = 0; // Batches the exporter has taken
+};
+
 class NativeClient {
 public:
   NativeClient();
@@ -21,12 +72,25 @@ public:
   NativeClient &operator=(const NativeClient &) = delete;
 
   /// Connect to the Cube ADBC Server
-  /// @param host Server hostname or IP address
+  ///
+  /// Every IPv6 and IPv4 address of host is tried, Happy Eyeballs style
+  /// (RFC 8305): a new attempt starts every 250 ms, or as soon as the last
+  /// one fails, until one connects. A host of the form unix:///path connects
+  /// to that Unix domain socket instead, ignoring port and address_cache.
+  /// @param host Server hostname, IP address or unix:// socket path
   /// @param port Server port (default: 8120)
   /// @param error Optional error output
+  /// @param address_cache Optional; host is looked up here first, and
+  ///   resolved again if none of the cached addresses accepts
   /// @return Status code
   AdbcStatusCode Connect(const std::string &host, int port,
-                         AdbcError *error = nullptr);
+                         AdbcError *error = nullptr,
+                         CubeAddressCache *address_cache = nullptr);
+
+  /// Run the session over an already connected transport instead, such as
+  /// one replaying a capture (see replay.h); starts with the handshake
+  AdbcStatusCode Attach(std::unique_ptr<CubeTransport> transport,
+                        AdbcError *error = nullptr);
 
   /// Authenticate with the server
   /// @param token Authentication token
@@ -37,7 +101,100 @@ public:
                               const std::string &database = "",
                               AdbcError *error = nullptr);
 
+  /// Run later queries of the authenticated session under the security
+  /// context of another token, without reconnecting. Results of earlier
+  /// queries must have been read.
+  /// @return ADBC_STATUS_NOT_IMPLEMENTED if the server cannot switch
+  ///   (see SupportsSecurityContext); ADBC_STATUS_UNAUTHENTICATED if it
+  ///   rejects the token, leaving the session closed
+  AdbcStatusCode SetSecurityContext(const std::string &token,
+                                    const std::string &database,
+                                    AdbcError *error);
+
+  /// Check whether the server agreed to switch security contexts
+  bool SupportsSecurityContext() const {
+    return (capabilities_ & CAPABILITY_SECURITY_CONTEXT) != 0;
+  }
+
+  /// Token whose security context the session runs under
+  const std::string &GetToken() const { return token_; }
+
+  /// Check that the server still answers on a reusable session with one
+  /// Ping round trip, waiting up to timeout (0 = the read timeout alone)
+  /// @return ADBC_STATUS_NOT_IMPLEMENTED if the server cannot answer
+  ///   (see SupportsPing); any other failure leaves the session closed
+  AdbcStatusCode Ping(std::chrono::milliseconds timeout, AdbcError *error);
+
+  /// Check whether the server agreed to answer Pings
+  bool SupportsPing() const { return (capabilities_ & CAPABILITY_PING) != 0; }
+
+  /// Check whether the server agreed to reject queries no pre-aggregation
+  /// serves (QUERY_FLAG_REQUIRE_PREAGGREGATION)
+  bool SupportsRequirePreaggregation() const {
+    return (capabilities_ & CAPABILITY_REQUIRE_PREAGGREGATION) != 0;
+  }
+
+  /// Check whether the server runs Cube JSON queries (QueryRequest::
+  /// json_query)
+  bool SupportsJsonQuery() const {
+    return (capabilities_ & CAPABILITY_JSON_QUERY) != 0;
+  }
+
+  /// Check whether the server answers queries from a sample of the rows
+  /// (QueryRequest::sample_fraction_ppm and sample_rows)
+  bool SupportsSampling() const {
+    return (capabilities_ & CAPABILITY_SAMPLING) != 0;
+  }
+
+  /// Check whether the server estimates the cost of schema-only queries
+  /// (EstimateQuery)
+  bool SupportsQueryEstimates() const {
+    return (capabilities_ & CAPABILITY_QUERY_ESTIMATES) != 0;
+  }
+
+  /// Plan a query without running it, as a schema-only query, and return
+  /// what the planner expects it to cost along with its result schema
+  /// @param size_hint Output estimate of the result's size; -1 where the
+  ///   planner cannot tell
+  /// @param diagnostics Output diagnostics of the plan: the pre-aggregation
+  ///   serving it, or none; unset if the server sent none
+  /// @return ADBC_STATUS_NOT_IMPLEMENTED if the server cannot estimate
+  ///   queries (see SupportsQueryEstimates)
+  AdbcStatusCode EstimateQuery(const QueryRequest &request,
+                               const CubeReaderOptions &options,
+                               struct ArrowSchema *schema,
+                               ResultSizeHint *size_hint,
+                               std::optional<QueryDiagnostics> *diagnostics,
+                               AdbcError *error);
+
+  /// Check whether the server pushes change notifications
+  /// (WatchChanges)
+  bool SupportsChangeNotifications() const {
+    return (capabilities_ & CAPABILITY_CHANGE_NOTIFICATIONS) != 0;
+  }
+
+  /// Give a reusable session over to change notifications, read with
+  /// ReadChange; the session takes no queries afterwards and is never
+  /// reusable again
+  /// @return ADBC_STATUS_NOT_IMPLEMENTED if the server cannot push them
+  ///   (see SupportsChangeNotifications)
+  AdbcStatusCode WatchChanges(AdbcError *error);
+
+  /// Wait up to timeout for the next change notification of a session
+  /// given over by WatchChanges
+  /// @return ADBC_STATUS_TIMEOUT if none came, leaving the session open;
+  ///   any other failure leaves it closed
+  AdbcStatusCode ReadChange(std::chrono::milliseconds timeout,
+                            ChangeNotification *out, AdbcError *error);
+
   /// Execute a query and return results as ArrowArrayStream
+  ///
+  /// Batches are pulled off the socket as the stream's get_next is called.
+  /// Without pipelining, the stream must be consumed (or released) before
+  /// the next query on this client; starting a new query discards whatever
+  /// is left. With pipelining, the query is only sent here and its errors
+  /// are reported by the stream; any number of queries can be outstanding
+  /// and their streams may be read in any order.
   /// @param sql SQL query string
   /// @param out Output ArrowArrayStream
   /// @param error Optional error output
@@ -46,24 +203,411 @@ public:
                               struct ArrowArrayStream *out,
                               AdbcError *error = nullptr);
 
+  /// Execute a query whose batches are decoded with the given options
+  /// instead of the ones set by SetReaderOptions
+  AdbcStatusCode ExecuteQuery(const std::string &sql,
+                              const CubeReaderOptions &options,
+                              struct ArrowArrayStream *out,
+                              AdbcError *error = nullptr);
+
+  /// Send several queries before reading any of their responses, as with
+  /// pipelining, and return their streams in order. Errors of each query
+  /// are reported by its stream. Without pipelining, the streams must be
+  /// read before the next ExecuteQuery, which discards what is left.
+  /// Servers that agreed to it get them in a single QueryBatchRequest,
+  /// and no result of the batch is read through a cursor.
+  /// @return Status code; on failure no stream is returned
+  AdbcStatusCode SendQueries(const std::vector<QueryRequest> &requests,
+                             const CubeReaderOptions &options,
+                             std::vector<ArrowArrayStream> *out,
+                             AdbcError *error = nullptr);
+
+  /// Parse and plan a query on the server without running it
+  ///
+  /// Results of earlier queries that have not been read yet are buffered
+  /// first, since the server answers in order.
+  /// @param sql SQL query string
+  /// @param statement_id Output handle for ExecutePrepared and ClosePrepared
+  /// @param result_schema Output schema of the result; left released when
+  ///   the server cannot tell it before running the query
+  /// @param parameter_schema Output schema of the parameters; left released
+  ///   when unknown
+  /// @param error Optional error output
+  /// @return Status code; ADBC_STATUS_NOT_IMPLEMENTED if the server did not
+  ///   agree to prepared statements in the handshake
+  AdbcStatusCode Prepare(const std::string &sql, std::string *statement_id,
+                         struct ArrowSchema *result_schema,
+                         struct ArrowSchema *parameter_schema,
+                         AdbcError *error = nullptr);
+
+  /// Execute a request naming a prepared statement or carrying parameters,
+  /// like ExecuteQuery
+  /// @return Status code; ADBC_STATUS_NOT_IMPLEMENTED if the request uses a
+  ///   feature the server did not agree to in the handshake
+  /// @param rows_affected Optional output row count: the QueryComplete
+  ///   count if the whole response was read before returning, otherwise
+  ///   the server's estimate, or -1
+  /// @param size_hint Optional output for the server's estimate of the
+  ///   result's size, when it sent one ahead of the first batch
+  /// @param capture Optional recorder given every message of the result,
+  ///   to store it in a CubeResultCache once read to the end
+  /// @param delta Optional output for the version and merge hint of a
+  ///   request with QUERY_FLAG_DELTA; the schema is read before returning
+  ///   even when pipelining
+  AdbcStatusCode
+  SendQuery(const QueryRequest &request, const CubeReaderOptions &options,
+            struct ArrowArrayStream *out, AdbcError *error = nullptr,
+            int64_t *rows_affected = nullptr,
+            ResultSizeHint *size_hint = nullptr,
+            std::unique_ptr<CubeResultCapture> capture = nullptr,
+            ResultDelta *delta = nullptr);
+
+  /// Execute a request for its row count only: any batches the server
+  /// sends are skipped on the socket without being decoded
+  /// @param rows_affected Output count from QueryComplete (-1 if unknown)
+  /// @param exporter Optional; given every message of the result instead
+  ///   of skipping it (the caller finishes it). If it fails, the rest of
+  ///   the response is skipped and ADBC_STATUS_IO returned.
+  /// @param resume Optional, with exporter; tracks the exported result. A
+  ///   handle already set resumes that result from the batch after those
+  ///   taken, without giving the exporter its schema again.
+  /// @return Status code
+  AdbcStatusCode ExecuteUpdate(const QueryRequest &request,
+                               int64_t *rows_affected,
+                               AdbcError *error = nullptr,
+                               CubeIpcExporter *exporter = nullptr,
+                               NativeResumePoint *resume = nullptr);
+
+  /// Free a statement returned by Prepare. Nothing is read back, so this is
+  /// safe while results are pending.
+  void ClosePrepared(const std::string &statement_id);
+
+  /// Plan a query on the server and split its result into partitions, each
+  /// run by a QueryRequest carrying it on any session with the server
+  ///
+  /// Results of earlier queries that have not been read yet are buffered
+  /// first, since the server answers in order.
+  /// @param max_partitions Most partitions wanted; 0 lets the server choose
+  /// @param schema Output schema of the result
+  /// @param partitions Output partitions, in no particular order
+  /// @param more Optional; when set, partitions are asked for as the
+  ///   server's planner finds them, and *more is set if NextPartitions has
+  ///   more to read. Servers that cannot send them so send every partition
+  ///   at once, leaving *more false.
+  /// @return Status code; ADBC_STATUS_NOT_IMPLEMENTED if the server did not
+  ///   agree to partitions in the handshake
+  AdbcStatusCode Partition(const std::string &sql, uint32_t max_partitions,
+                           struct ArrowSchema *schema,
+                           std::vector<std::string> *partitions,
+                           AdbcError *error = nullptr, bool *more = nullptr);
+
+  /// Read the partitions the server found since the last Partition or
+  /// NextPartitions call with *more set, waiting for at least one response.
+  /// The session takes no other request until *more comes back false.
+  AdbcStatusCode NextPartitions(std::vector<std::string> *partitions,
+                                bool *more, AdbcError *error = nullptr);
+
+  /// Whether the server can split queries into partitions (available after
+  /// handshake)
+  bool SupportsPartitions() const {
+    return (capabilities_ & CAPABILITY_PARTITIONS) != 0;
+  }
+
+  /// Whether the server can send partitions as its planner finds them
+  bool SupportsIncrementalPartitions() const {
+    return (capabilities_ & CAPABILITY_INCREMENTAL_PARTITIONS) != 0;
+  }
+
+  /// Whether the server can answer with a delta against an earlier result
+  /// (available after handshake)
+  bool SupportsDeltaResults() const {
+    return (capabilities_ & CAPABILITY_DELTA_RESULTS) != 0 && IsSchemaOnce();
+  }
+
+  /// Whether the server can push new versions of a subscribed result
+  /// (available after handshake)
+  bool SupportsSubscriptions() const {
+    return (capabilities_ & CAPABILITY_SUBSCRIPTIONS) != 0;
+  }
+
+  /// Whether the server takes several queries in one QueryBatchRequest
+  /// (available after handshake)
+  bool SupportsQueryBatch() const {
+    return (capabilities_ & CAPABILITY_QUERY_BATCH) != 0;
+  }
+
+  /// Whether the server can return a result schema without running the
+  /// query (available after handshake)
+  bool SupportsSchemaOnly() const {
+    return (capabilities_ & CAPABILITY_SCHEMA_ONLY) != 0;
+  }
+
+  /// Whether the server agreed to prepared statements (available after
+  /// handshake)
+  bool SupportsPrepare() const {
+    return (capabilities_ & CAPABILITY_PREPARED_STATEMENTS) != 0;
+  }
+
+  /// Whether the server accepts bound parameters (available after
+  /// handshake)
+  bool SupportsParameters() const {
+    return (capabilities_ & CAPABILITY_QUERY_PARAMETERS) != 0;
+  }
+
+  /// Load a stream of Arrow data into a table
+  ///
+  /// Batches are sent as they are read from data, never more than the
+  /// window granted by the server ahead of its acknowledgements, so a slow
+  /// server holds the client back instead of data piling up in memory.
+  /// Batches whose message would exceed max_message_bytes are split.
+  /// Results of earlier queries that have not been read yet are buffered
+  /// first.
+  /// @param request Target table and mode; the schema is taken from data
+  /// @param data Stream of struct arrays to load; read to the end
+  /// @param rows Output number of rows stored
+  /// @param error Optional error output
+  /// @return Status code; ADBC_STATUS_NOT_IMPLEMENTED if the server did not
+  ///   agree to bulk ingestion in the handshake
+  AdbcStatusCode Ingest(IngestRequest request, struct ArrowArrayStream *data,
+                        int64_t *rows, AdbcError *error = nullptr);
+
+  /// Whether the server accepts bulk ingestion (available after handshake)
+  bool SupportsIngest() const {
+    return (capabilities_ & CAPABILITY_BULK_INGEST) != 0;
+  }
+
+  /// Swap a staging table that Ingest calls with request.staging_id loaded,
+  /// on this session or others, into the target table, or drop it
+  /// @param rows Output number of rows committed
+  /// @return Status code; ADBC_STATUS_NOT_IMPLEMENTED if the server did not
+  ///   agree to staged ingestion in the handshake
+  AdbcStatusCode CommitIngest(const IngestCommit &commit, int64_t *rows,
+                              AdbcError *error = nullptr);
+
+  /// Whether IngestRequest::staging_id and CommitIngest are understood
+  /// (available after handshake)
+  bool SupportsStagedIngest() const {
+    return (capabilities_ & CAPABILITY_STAGED_INGEST) != 0;
+  }
+
+  /// Cancel every query sent so far that has not completed.
+  ///
+  /// Safe to call from another thread while a result is being read. Their
+  /// streams fail with ADBC_STATUS_CANCELLED (ECANCELED); whatever the server
+  /// still sends for them is discarded as it is read, leaving the session
+  /// usable for further queries.
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode Cancel(AdbcError *error = nullptr);
+
   /// Close the connection
   void Close();
 
   /// Check if connected
-  bool IsConnected() const { return socket_fd_ >= 0; }
+  bool IsConnected() const { return transport_ != nullptr; }
+
+  /// Check whether the session can be handed to another connection: it is
+  /// authenticated, has no response left to read and is this process's
+  bool IsReusable() const {
+    return IsConnected() && authenticated_ && !prefetching_ &&
+           !watching_ && !partitioning_ && pending_.empty() &&
+           !IsInherited();
+  }
+
+  /// Check whether the socket was opened before the process forked, so
+  /// that the parent still reads and writes it
+  bool IsInherited() const {
+    return IsConnected() && fork_generation_ != CubeForkGeneration();
+  }
+
+  /// Drop an inherited socket without writing to it, and without keeping
+  /// its session to resume; the parent still holds both
+  void Abandon();
+
+  /// Check that a reusable session's socket is still open. An idle session
+  /// must have nothing to read, so readable means EOF, an error or bytes the
+  /// protocol cannot account for.
+  bool IsHealthy() const;
 
   /// Get session ID (available after authentication)
   const std::string &GetSessionId() const { return session_id_; }
 
+  /// Whether the session is authenticated, by Authenticate or by resuming
+  /// a lost one in the handshake
+  bool IsAuthenticated() const { return authenticated_; }
+
+  /// Offer to resume the session with this ID in the next handshake. A
+  /// server that agrees leaves the client authenticated as that session;
+  /// otherwise Authenticate is needed as usual.
+  /// @param token Token the session was authenticated with
+  void SetResumeSession(std::string session_id, std::string token) {
+    resume_session_ = std::move(session_id);
+    resume_token_ = std::move(token);
+  }
+
+  /// ID of the session this client holds or, once closed, last held
+  const std::string &GetResumableSessionId() const {
+    return authenticated_ ? session_id_ : lost_session_id_;
+  }
+
   /// Get server version (available after handshake)
   const std::string &GetServerVersion() const { return server_version_; }
 
+  /// CAPABILITY_* bits agreed in the handshake
+  uint32_t GetCapabilities() const { return capabilities_; }
+
+  /// Settings the server sent in the handshake
+  const HandshakeParameters &GetServerParameters() const {
+    return server_parameters_;
+  }
+
+  /// Set decode options for result batches of subsequent queries
+  void SetReaderOptions(const CubeReaderOptions &options) {
+    reader_options_ = options;
+  }
+
+  /// Set how the next Connect moves bytes over its socket
+  void SetTransport(CubeTransportKind kind) { transport_kind_ = kind; }
+
+  /// Talk TLS over the sockets of subsequent Connects (null = plain TCP).
+  /// The transport kind is then ignored.
+  void SetTls(std::shared_ptr<CubeTlsContext> context) {
+    tls_context_ = std::move(context);
+  }
+
+  /// Offer the server a shared memory region of this many bytes for result
+  /// batches on subsequent Connects to a unix:// host without TLS (0 =
+  /// off). A server that agrees writes batches there and sends only their
+  /// position, and readers share them in place; it still sends a batch
+  /// inline when the region has no room, for instance while the arrays of
+  /// earlier batches are held.
+  void SetSharedMemory(size_t bytes) { shared_memory_bytes_ = bytes; }
+
+  /// Whether the server agreed to write batches into shared memory
+  /// (available after handshake)
+  bool IsSharedMemoryAttached() const { return shared_memory_ != nullptr; }
+
+  /// Report spans of subsequent connects and queries to tracer
+  void SetTracer(const CubeTracer &tracer) { tracer_ = tracer; }
+
+  /// Record every frame sent and received from the next Connect on (null
+  /// stops). Shared memory is not offered while capturing.
+  void SetCapture(std::unique_ptr<CubeSessionCapture> capture) {
+    capture_ = std::move(capture);
+  }
+
+  /// Set the options applied to the socket by the next Connect
+  void SetSocketOptions(const NativeSocketOptions &options) {
+    socket_options_ = options;
+  }
+
+  /// Set the timeouts used by the next Connect and every query after it.
+  /// A query that runs out of time fails with ADBC_STATUS_TIMEOUT and closes
+  /// the connection, since its response can no longer be read in step; the
+  /// server is told the query's limit when it supports it.
+  void SetTimeouts(const NativeTimeouts &timeouts) { timeouts_ = timeouts; }
+
+  /// Set the largest frame payload accepted from the server (0 = no limit).
+  /// Batches larger than this must be sent as QueryResponseBatchChunk frames.
+  void SetMaxMessageBytes(uint32_t max_message_bytes) {
+    max_message_bytes_ = max_message_bytes;
+  }
+
+  /// Ask for compressed batches during the handshake (before Connect). The
+  /// server may still decline and send batches uncompressed.
+  void SetCompression(CompressionCodec codec) {
+    requested_compression_ = codec;
+  }
+
+  /// Codec the server agreed to use (available after handshake)
+  CompressionCodec GetCompression() const { return compression_; }
+
+  /// Whether the server sends each result's schema once rather than with
+  /// every batch (available after handshake)
+  bool IsSchemaOnce() const {
+    return (capabilities_ & CAPABILITY_SCHEMA_ONCE) != 0;
+  }
+
+  /// Socket to watch for readability when driving results from an event loop
+  int GetSocketFd() const { return transport_ ? transport_->fd() : -1; }
+
+  /// Read whatever response bytes are available without blocking.
+  ///
+  /// Meant to be called when GetSocketFd() polls readable. Once it reports
+  /// ready, the next get_next on the oldest unfinished result returns
+  /// without waiting on the socket.
+  /// @param ready Set to true once the next response message is fully
+  ///   buffered, or when there is nothing left to wait for (no pending
+  ///   result, or the connection is gone and reading will report why)
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode PollResponse(bool *ready, AdbcError *error = nullptr);
+
+  /// Let ExecuteQuery send a query while earlier results are still unread.
+  /// The server answers queries in the order they were sent, so responses
+  /// are matched to streams by position.
+  void SetPipelining(bool enabled) { pipelining_ = enabled; }
+
+  /// Decode ahead on a background thread, keeping up to this many bytes of
+  /// decoded batches queued per result (0 = off). Ignored with pipelining.
+  /// The socket is handed back once the result is read, released, or the
+  /// next query starts.
+  void SetPrefetchBytes(size_t prefetch_bytes) {
+    prefetch_bytes_ = prefetch_bytes;
+  }
+
+  /// Read results through server-side cursors, asking for about this many
+  /// bytes of batches at a time (0 = off: the server pushes each result
+  /// whole). The size then follows consumption: it grows while get_next
+  /// mostly waits on the socket and shrinks while batches sit unread. Used
+  /// when the server agreed to cursors and the schema is sent once; ignored
+  /// with pipelining.
+  void SetCursorFetchBytes(size_t fetch_bytes) {
+    cursor_fetch_bytes_ = fetch_bytes;
+  }
+
+  /// Have the server send pushed results against credit: at most batches
+  /// batches or bytes bytes (0 = no limit) are on the way or unread at a
+  /// time, and credit is handed back as get_next takes them. Used when the
+  /// server agreed to flow control and the result is not read through a
+  /// cursor.
+  void SetFlowControl(uint32_t batches, size_t bytes) {
+    credit_batches_ = batches;
+    credit_bytes_ = bytes;
+  }
+
+  /// Read every response still owed to pending results into their
+  /// streams, so the next message read answers a new request
+  AdbcStatusCode ReadPendingResponses(AdbcError *error);
+
 private:
-  /// Socket file descriptor
-  int socket_fd_;
+  friend class NativeResultStream;
+
+  /// Connected socket and how it is read and written; null when closed
+  std::unique_ptr<CubeTransport> transport_;
+  CubeTransportKind transport_kind_ = CubeTransportKind::Socket;
+  std::shared_ptr<CubeTlsContext> tls_context_;
+  size_t shared_memory_bytes_ = 0;
+  bool offer_shared_memory_ = false; // This Connect can pass a memfd
+  /// Region batches are written into; null unless attached
+  std::shared_ptr<CubeSharedMemory> shared_memory_;
+
+  /// Where spans are reported; disabled unless set
+  CubeTracer tracer_;
+
+  /// Where frames are recorded; null unless capturing
+  std::unique_ptr<CubeSessionCapture> capture_;
 
-  /// Session ID received from server
+  /// Session ID received from server, the one kept after a close, and the
+  /// one to offer in the next handshake
   std::string session_id_;
+  std::string lost_session_id_;
+  std::string resume_session_;
+  std::string resume_token_;
+
+  /// Token of the security context the session runs under; kept after a
+  /// close along with lost_session_id_
+  std::string token_;
 
   /// Server version string
   std::string server_version_;
@@ -71,10 +615,295 @@ private:
   /// Connection state
   bool authenticated_;
 
-  /// Read a complete message from the socket
+  /// CubeForkGeneration() when the socket was opened
+  uint64_t fork_generation_ = 0;
+
+  /// Largest frame payload accepted (0 = no limit)
+  uint32_t max_message_bytes_;
+
+  /// Applied to the socket when connecting
+  NativeSocketOptions socket_options_;
+
+  /// Limits on waiting for the server. read_deadline_ is when the query
+  /// being read runs out of time (max() if it has no limit); timed_out_ is
+  /// set once a wait has timed out, so the results failed by closing the
+  /// socket report ADBC_STATUS_TIMEOUT. awaiting_refresh_ lifts the read
+  /// timeout while a subscription waits for the data to be refreshed.
+  NativeTimeouts timeouts_;
+  std::chrono::steady_clock::time_point read_deadline_ =
+      std::chrono::steady_clock::time_point::max();
+  bool awaiting_refresh_ = false;
+  std::atomic<bool> timed_out_{false};
+
+  /// Decode options passed to every CubeArrowReader
+  CubeReaderOptions reader_options_;
+
+  /// Send queries without waiting for earlier responses to be read
+  bool pipelining_;
+
+  /// Decode-ahead budget per result (0 = off), and the result whose thread
+  /// currently reads the socket. prefetching_ is only changed by the thread
+  /// that owns this client, never by the decode-ahead thread.
+  size_t prefetch_bytes_ = 0;
+  NativeResultStream *prefetching_ = nullptr;
+
+  /// First FetchRequest size of cursor results (0 = no cursors)
+  size_t cursor_fetch_bytes_ = 0;
+
+  /// Credit window of pushed results (both 0 = no flow control)
+  uint32_t credit_batches_ = 0;
+  size_t credit_bytes_ = 0;
+
+  /// Codec offered in the handshake, and the one the server picked
+  CompressionCodec requested_compression_ = CompressionCodec::None;
+  CompressionCodec compression_ = CompressionCodec::None;
+
+  /// CAPABILITY_* bits agreed in the handshake
+  uint32_t capabilities_ = 0;
+
+  /// Sequence number of the last Ping sent
+  uint32_t ping_sequence_ = 0;
+
+  /// Set once the session is given over to change notifications
+  bool watching_ = false;
+
+  /// Set while PartitionResponses of an incremental Partition are owed
+  bool partitioning_ = false;
+
+  /// Handshake parameters of the server, and the largest frame payload it
+  /// accepts from them (0 = no limit)
+  HandshakeParameters server_parameters_;
+  uint32_t server_max_message_bytes_ = 0;
+
+  /// Serializes socket writes, since Cancel may run on another thread
+  std::mutex write_mutex_;
+
+  /// Number of QueryRequests written so far; results are numbered from 1
+  std::atomic<uint64_t> queries_sent_{0};
+
+  /// Results numbered up to this one have been cancelled
+  std::atomic<uint64_t> cancelled_upto_{0};
+
+  /// Results whose responses have not been fully read, in request order
+  /// (non-owning). The front one owns the next message on the socket; a
+  /// nullptr entry is a released result whose response is discarded.
+  std::deque<NativeResultStream *> pending_;
+
+  /// Bytes read from the socket but not consumed yet, at [inbound_pos_,
+  /// inbound_end_) of inbound_. ReadExact refills it a read-ahead window at
+  /// a time so one read() serves several small frames; PollResponse fills
+  /// it as far as the next response message needs.
+  std::unique_ptr<uint8_t[]> inbound_;
+  size_t inbound_capacity_ = 0;
+  size_t inbound_pos_ = 0;
+  size_t inbound_end_ = 0;
+
+  /// Make room for length more bytes at inbound_end_, keeping the bytes not
+  /// consumed yet
+  /// @return Where to write them
+  uint8_t *ReserveInbound(size_t length);
+
+  /// Mark length buffered bytes as consumed
+  void ConsumeInbound(size_t length);
+
+  /// Receive buffer for control messages, reused across messages. Holds the
+  /// payload of the last message read (message type first, no length prefix)
+  std::vector<uint8_t> recv_buffer_;
+
+  /// Framed bytes of the messages read so far, and nanoseconds spent
+  /// blocked on the socket while reading; ReadResponseMessage adds what a
+  /// message took to its result's CubeQueryStats
+  int64_t received_bytes_ = 0;
+  int64_t socket_wait_nanos_ = 0;
+
+  /// Read the next message of the query at the front of pending_
+  /// @param batch Output Arrow IPC bytes of the next batch, reassembled from
+  ///   chunks if needed; nullptr skips the batch
+  /// @param schema Optional output for a schema-only QueryResponseSchema
+  /// @param complete Set to true once QueryComplete or Error has been read
   /// @param error Optional error output
-  /// @return Message data (length + type + payload)
-  std::vector<uint8_t> ReadMessage(AdbcError *error = nullptr);
+  /// @return Status code
+  /// @param rows_affected Optional output count from QueryComplete
+  /// @param size_hint Optional output for the estimate sent with the schema
+  /// @param shared Optional output for a batch in shared memory, shared in
+  ///   place; without it such a batch is copied into batch
+  /// @param fetch_end Optional; set to true when a FetchEnd was read
+  ///   instead of a batch
+  /// @param delta Optional output for the version sent with the schema
+  /// @param refresh_end Optional; set to true when a RefreshEnd was read
+  ///   instead of a batch
+  /// @param diagnostics Optional output for those sent with QueryComplete
+  /// @param result_handle Optional output for the handle sent with the
+  ///   schema
+  AdbcStatusCode ReadNextBatch(CubeIpcBuffer *batch, CubeIpcBuffer *schema,
+                               bool *complete,
+                               AdbcError *error = nullptr,
+                               int64_t *rows_affected = nullptr,
+                               ResultSizeHint *size_hint = nullptr,
+                               std::shared_ptr<const CubeIpcBytes> *shared =
+                                   nullptr,
+                               bool *fetch_end = nullptr,
+                               ResultDelta *delta = nullptr,
+                               bool *refresh_end = nullptr,
+                               std::optional<QueryDiagnostics> *diagnostics =
+                                   nullptr,
+                               std::string *result_handle = nullptr);
+
+  /// Ask the server for the next part of a cursor result, sized to how the
+  /// consumer kept up with the last one
+  AdbcStatusCode SendFetch(NativeResultStream *stream, AdbcError *error);
+
+  /// Tell the server to end a cursor result whose rest will be discarded,
+  /// so it is not sent. Nothing is read back.
+  void CloseCursor(NativeResultStream *stream);
+
+  /// Tell the server to stop a result the consumer has read all it wants
+  /// of: close its cursor, or cancel it if it is the last query sent.
+  /// Nothing is read back; the rest is skipped when the stream is released.
+  void StopResult(NativeResultStream *stream);
+
+  /// Tell the server to end a subscription whose rest will be discarded.
+  /// Nothing is read back.
+  void Unsubscribe(NativeResultStream *stream);
+
+  /// Whether a subscription is pending, which holds the session until it
+  /// is released
+  bool HasSubscription() const;
+
+  /// Hand back the credit of the batches get_next took from a result sent
+  /// under flow control, or all of it with unlimited
+  void GrantCredit(NativeResultStream *stream, bool unlimited = false);
+
+  /// Create the shared memory region and pass it to the server, once it
+  /// agreed to CAPABILITY_SHARED_MEMORY
+  AdbcStatusCode AttachSharedMemory(AdbcError *error);
+
+  /// Hand the ranges of released shared batches back to the server. The
+  /// caller holds write_mutex_.
+  AdbcStatusCode WriteSharedMemoryReleases(AdbcError *error);
+
+  /// Send a query and export the stream for its results
+  /// @param discard_unread Detach the results not read to the end first
+  /// @param start Read up to the first batch before returning
+  AdbcStatusCode SendQueryImpl(const QueryRequest &request,
+                               const CubeReaderOptions &options,
+                               bool discard_unread, bool start,
+                               struct ArrowArrayStream *out, AdbcError *error,
+                               int64_t *rows_affected = nullptr,
+                               ResultSizeHint *size_hint = nullptr,
+                               std::unique_ptr<CubeResultCapture> capture =
+                                   nullptr,
+                               ResultDelta *delta = nullptr);
+
+  /// When a query sent now runs out of time (max() if it has no limit)
+  std::chrono::steady_clock::time_point QueryDeadline() const;
+
+  /// Copy of query to send, carrying its time limit if the server takes one
+  QueryRequest WithTimeout(const QueryRequest &query) const;
+
+  /// Copy of query to send with the limits, flags and trace context of
+  /// options and span, read through a cursor or against credit if asked
+  QueryRequest WithOptions(const QueryRequest &query,
+                           const CubeReaderOptions &options,
+                           const CubeSpan &span, bool cursor,
+                           bool credit) const;
+
+  /// Whether a result not read through a cursor is sent against credit
+  bool UseCredit(bool cursor) const;
+
+  /// Open the credit window of the query numbered query. The caller holds
+  /// write_mutex_.
+  AdbcStatusCode WriteInitialCredit(uint64_t query, AdbcError *error);
+
+  /// SendQueries as one QueryBatchRequest
+  AdbcStatusCode SendQueryBatch(const std::vector<QueryRequest> &queries,
+                                const CubeReaderOptions &options,
+                                std::vector<ArrowArrayStream> *out,
+                                AdbcError *error);
+
+  /// Check that a request can be sent: connected, authenticated, and only
+  /// using features the server agreed to
+  AdbcStatusCode CheckQuery(const QueryRequest &request, AdbcError *error);
+
+  /// Detach the results not read to the end and skip their responses
+  AdbcStatusCode DiscardUnread(AdbcError *error);
+
+  /// Read and decode the next PartitionResponse
+  AdbcStatusCode ReadPartitionResponse(
+      std::unique_ptr<PartitionResponse> *response, AdbcError *error);
+
+  /// Where an Ingest stands: batches sent but not acknowledged, and
+  /// whether the server has sent its final QueryComplete or Error
+  struct IngestProgress {
+    uint32_t window = 1;
+    uint32_t in_flight = 0;
+    int64_t rows = 0;
+    bool done = false;
+  };
+
+  /// Send rows [offset, offset + length) of a batch as IngestBatch
+  /// messages, waiting for acknowledgements while the window is full
+  AdbcStatusCode SendIngestBatch(const struct ArrowSchema *schema,
+                                 const struct ArrowArray *array,
+                                 int64_t offset, int64_t length,
+                                 IngestProgress *progress, AdbcError *error);
+
+  /// Read one response to an Ingest: an IngestAck, or the final
+  /// QueryComplete or Error
+  AdbcStatusCode ReadIngestReply(IngestProgress *progress, AdbcError *error);
+
+  /// Read the next message for a pending result, first buffering or
+  /// discarding the responses queued in front of it. Errors are recorded on
+  /// the stream.
+  void ReadResult(NativeResultStream *stream);
+
+  /// Check whether the result with the given number was cancelled
+  bool IsCancelled(uint64_t sequence) const {
+    return sequence <= cancelled_upto_.load();
+  }
+
+  /// Read one message for the front of pending_ and hand it to its stream
+  /// @return Status code
+  AdbcStatusCode ReadResponseMessage();
+
+  /// Join the decode-ahead thread, if any, so the socket can be used here
+  void StopPrefetch();
+
+  /// Forget a released stream and discard its response
+  void AbandonResult(NativeResultStream *stream);
+
+  /// Discard responses of released results at the front of pending_
+  void DrainAbandoned();
+
+  /// Close the socket after a read error, failing pending results with it
+  void CloseAfterError(const AdbcError *error);
+
+  /// Close the socket, failing pending results with the given reason
+  void CloseWithReason(const std::string &reason);
+
+  /// Read and validate the length prefix of the next message
+  /// @param length Output payload length
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode ReadFrameLength(uint32_t *length, AdbcError *error = nullptr);
+
+  /// Read a complete message from the socket into recv_buffer_
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode ReadMessage(AdbcError *error = nullptr);
+
+  /// Bytes still needed before inbound_ holds the next response message
+  /// (0 if it does). Chunk, schema-only and FetchEnd frames do not count on
+  /// their own since reading them does not complete a get_next.
+  /// @param fetch_ends Optional output number of FetchEnd frames buffered
+  ///   ahead of it
+  size_t InboundMissingBytes(int *fetch_ends = nullptr) const;
+
+  /// Read and throw away bytes from the socket
+  /// @param length Number of bytes to skip
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode DiscardExact(size_t length, AdbcError *error = nullptr);
 
   /// Write a message to the socket
   /// @param data Message data (should already include length prefix)
@@ -83,6 +912,13 @@ private:
   AdbcStatusCode WriteMessage(const std::vector<uint8_t> &data,
                               AdbcError *error = nullptr);
 
+  /// Wait until the socket is ready for events, giving up at deadline or
+  /// after the read timeout, whichever comes first
+  /// @return Status code; ADBC_STATUS_TIMEOUT once the wait has timed out
+  AdbcStatusCode WaitForSocket(short events,
+                               std::chrono::steady_clock::time_point deadline,
+                               AdbcError *error);
+
   /// Read exact number of bytes from socket
   /// @param buffer Output buffer
   /// @param length Number of bytes to read
@@ -99,6 +935,31 @@ private:
   AdbcStatusCode WriteExact(const uint8_t *buffer, size_t length,
                             AdbcError *error = nullptr);
 
+  /// Write a frame without joining its parts (writev)
+  /// @param frame Frame from EncodeParts
+  /// @param error Optional error output
+  /// @return Status code
+  AdbcStatusCode WriteFrame(const FrameParts &frame,
+                            AdbcError *error = nullptr);
+
+  /// Write every byte of count buffers, in one system call when the socket
+  /// takes them all. iov is advanced past what has been written.
+  AdbcStatusCode WriteVectored(struct iovec *iov, int count,
+                               AdbcError *error = nullptr);
+
+  /// Connect, within the given Connect span
+  AdbcStatusCode ConnectImpl(const std::string &host, int port,
+                             AdbcError *error, CubeAddressCache *address_cache,
+                             const CubeSpan &span);
+
+  /// Handshake over the transport just set, within the Connect span
+  AdbcStatusCode StartSession(const CubeSpan &span, AdbcError *error);
+
+  /// Authenticate, within an Authenticate span
+  AdbcStatusCode AuthenticateImpl(const std::string &token,
+                                  const std::string &database,
+                                  AdbcError *error);
+
   /// Perform handshake with server
   /// @param error Optional error output
   /// @return Status code
@@ -108,6 +969,18 @@ private:
   void SetError(AdbcError *error, const std::string &message);
 };
 
+/// Export a stream that decodes a result stored by CubeResultCache, the same
+/// way as when it was read from the server
+void ExportCachedResult(const CubeCachedResult &result,
+                        const CubeReaderOptions &options,
+                        struct ArrowArrayStream *out);
+
+/// Export a stream that decodes a result found in CubeSharedResultCache,
+/// reading its batches in place from the mapping
+void ExportSharedResult(const CubeSharedResult &result,
+                        const CubeReaderOptions &options,
+                        struct ArrowArrayStream *out);
+
 /// Helper function to create error message in AdbcError struct
 void SetNativeClientError(AdbcError *error, const std::string &message);
 
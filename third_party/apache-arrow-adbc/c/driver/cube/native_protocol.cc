@@ -8,17 +8,19 @@ namespace adbc::cube {
 
 // Helper functions implementation
 void MessageCodec::PutU32(std::vector<uint8_t> &buf, uint32_t value) {
-  uint32_t net_value = htonl(value);
-  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&net_value);
+  uint8_t bytes[4];
+  StoreU32(bytes, value);
   buf.insert(buf.end(), bytes, bytes + 4);
 }
 
 void MessageCodec::PutI64(std::vector<uint8_t> &buf, int64_t value) {
-  // Convert to network byte order (big-endian)
+  // Network byte order (big-endian)
   uint64_t net_value = static_cast<uint64_t>(value);
-  for (int i = 7; i >= 0; --i) {
-    buf.push_back(static_cast<uint8_t>((net_value >> (i * 8)) & 0xFF));
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = static_cast<uint8_t>(net_value >> ((7 - i) * 8));
   }
+  buf.insert(buf.end(), bytes, bytes + 8);
 }
 
 void MessageCodec::PutU8(std::vector<uint8_t> &buf, uint8_t value) {
@@ -47,83 +49,175 @@ void MessageCodec::PutBytes(std::vector<uint8_t> &buf,
   buf.insert(buf.end(), bytes.begin(), bytes.end());
 }
 
+void MessageCodec::BeginFrame(std::vector<uint8_t> &buf, MessageType type,
+                              size_t fields_size) {
+  buf.reserve(buf.size() + kFrameHeaderSize + fields_size);
+  buf.insert(buf.end(), 4, 0); // Length, filled in by EndFrame
+  PutU8(buf, static_cast<uint8_t>(type));
+}
+
+void MessageCodec::EndFrame(std::vector<uint8_t> &buf, size_t extra) {
+  StoreU32(buf.data(), static_cast<uint32_t>(buf.size() - 4 + extra));
+}
+
+void MessageCodec::StoreU32(uint8_t *out, uint32_t value) {
+  uint32_t net_value = htonl(value);
+  std::memcpy(out, &net_value, 4);
+}
+
+std::vector<uint8_t> FrameParts::Join() && {
+  if (body_size == 0 && tail.empty()) {
+    return std::move(head);
+  }
+  std::vector<uint8_t> frame;
+  frame.reserve(size());
+  frame.insert(frame.end(), head.begin(), head.end());
+  frame.insert(frame.end(), body, body + body_size);
+  frame.insert(frame.end(), tail.begin(), tail.end());
+  return frame;
+}
+
+namespace {
+
+// Run one read of a MessageReader at ptr, advancing ptr past it
+template <typename Read>
+auto ReadOrThrow(const uint8_t *&ptr, const uint8_t *end, Read read) {
+  MessageReader reader(ptr, ptr < end ? static_cast<size_t>(end - ptr) : 0);
+  auto value = read(reader);
+  if (!reader.ok()) {
+    throw std::runtime_error(reader.error());
+  }
+  ptr = reader.position();
+  return value;
+}
+
+// Turn a failed DecodeView into the exception of the matching Decode;
+// error is read only after the DecodeView that sets it has run
+void ThrowIfFailed(bool ok, const char *const *error) {
+  if (!ok) {
+    throw std::runtime_error(*error);
+  }
+}
+
+} // namespace
+
 uint32_t MessageCodec::GetU32(const uint8_t *&ptr, const uint8_t *end) {
-  if (ptr + 4 > end)
-    throw std::runtime_error("Insufficient data for U32");
-  uint32_t net_value;
-  std::memcpy(&net_value, ptr, 4);
-  ptr += 4;
-  return ntohl(net_value);
+  return ReadOrThrow(ptr, end, [](MessageReader &r) { return r.U32(); });
 }
 
 int64_t MessageCodec::GetI64(const uint8_t *&ptr, const uint8_t *end) {
-  if (ptr + 8 > end)
-    throw std::runtime_error("Insufficient data for I64");
-  uint64_t value = 0;
-  for (int i = 0; i < 8; ++i) {
-    value = (value << 8) | ptr[i];
-  }
-  ptr += 8;
-  return static_cast<int64_t>(value);
+  return ReadOrThrow(ptr, end, [](MessageReader &r) { return r.I64(); });
 }
 
 uint8_t MessageCodec::GetU8(const uint8_t *&ptr, const uint8_t *end) {
-  if (ptr >= end)
-    throw std::runtime_error("Insufficient data for U8");
-  return *ptr++;
+  return ReadOrThrow(ptr, end, [](MessageReader &r) { return r.U8(); });
 }
 
 std::string MessageCodec::GetString(const uint8_t *&ptr, const uint8_t *end) {
-  uint32_t length = GetU32(ptr, end);
-  if (ptr + length > end)
-    throw std::runtime_error("Insufficient data for string");
-  std::string result(reinterpret_cast<const char *>(ptr), length);
-  ptr += length;
-  return result;
+  return std::string(
+      ReadOrThrow(ptr, end, [](MessageReader &r) { return r.String(); }));
 }
 
 std::string MessageCodec::GetOptionalString(const uint8_t *&ptr,
                                             const uint8_t *end) {
-  uint8_t has_value = GetU8(ptr, end);
-  if (has_value) {
-    return GetString(ptr, end);
-  }
-  return "";
+  return std::string(ReadOrThrow(
+      ptr, end, [](MessageReader &r) { return r.OptionalString(); }));
 }
 
 std::vector<uint8_t> MessageCodec::GetBytes(const uint8_t *&ptr,
                                             const uint8_t *end) {
-  uint32_t length = GetU32(ptr, end);
-  if (ptr + length > end)
-    throw std::runtime_error("Insufficient data for bytes");
-  std::vector<uint8_t> result(ptr, ptr + length);
-  ptr += length;
-  return result;
+  size_t length = 0;
+  const uint8_t *bytes = GetBytesView(ptr, end, &length);
+  return std::vector<uint8_t>(bytes, bytes + length);
+}
+
+const uint8_t *MessageCodec::GetBytesView(const uint8_t *&ptr,
+                                          const uint8_t *end,
+                                          size_t *length) {
+  return ReadOrThrow(ptr, end,
+                     [length](MessageReader &r) { return r.Bytes(length); });
 }
 
 // Message implementations
 
-std::vector<uint8_t> HandshakeRequest::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutU32(payload, version);
+namespace {
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+size_t ParametersSize(const HandshakeParameters &parameters) {
+  size_t size = 4;
+  for (const auto &[key, value] : parameters) {
+    size += MessageCodec::StringSize(key) + MessageCodec::StringSize(value);
+  }
+  return size;
 }
 
-std::vector<uint8_t> HandshakeResponse::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutU32(payload, version);
-  MessageCodec::PutString(payload, server_version);
+void PutParameters(std::vector<uint8_t> &buf,
+                   const HandshakeParameters &parameters) {
+  MessageCodec::PutU32(buf, static_cast<uint32_t>(parameters.size()));
+  for (const auto &[key, value] : parameters) {
+    MessageCodec::PutString(buf, key);
+    MessageCodec::PutString(buf, value);
+  }
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+HandshakeParameters GetParameters(const uint8_t *&ptr, const uint8_t *end) {
+  uint32_t count = MessageCodec::GetU32(ptr, end);
+  // Each takes at least two length prefixes
+  if (count > static_cast<size_t>(end - ptr) / 8) {
+    throw std::runtime_error("Handshake parameter count " +
+                             std::to_string(count) + " exceeds message");
+  }
+  HandshakeParameters parameters;
+  parameters.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    std::string key = MessageCodec::GetString(ptr, end);
+    parameters.emplace_back(std::move(key), MessageCodec::GetString(ptr, end));
+  }
+  return parameters;
+}
+
+} // namespace
+
+std::vector<uint8_t> HandshakeRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           4 + 1 + compression_codecs.size() + 4 +
+                               ParametersSize(parameters));
+  MessageCodec::PutU32(frame, version);
+  if (!compression_codecs.empty() || capabilities != 0 ||
+      !parameters.empty()) {
+    MessageCodec::PutU8(frame,
+                        static_cast<uint8_t>(compression_codecs.size()));
+    frame.insert(frame.end(), compression_codecs.begin(),
+                   compression_codecs.end());
+  }
+  if (capabilities != 0 || !parameters.empty()) {
+    MessageCodec::PutU32(frame, capabilities);
+  }
+  if (!parameters.empty()) {
+    PutParameters(frame, parameters);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> HandshakeResponse::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           4 + MessageCodec::StringSize(server_version) + 1 +
+                               4 + ParametersSize(parameters));
+  MessageCodec::PutU32(frame, version);
+  MessageCodec::PutString(frame, server_version);
+  if (compression_codec != 0 || capabilities != 0 || !parameters.empty()) {
+    MessageCodec::PutU8(frame, compression_codec);
+  }
+  if (capabilities != 0 || !parameters.empty()) {
+    MessageCodec::PutU32(frame, capabilities);
+  }
+  if (!parameters.empty()) {
+    PutParameters(frame, parameters);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
 std::unique_ptr<HandshakeResponse>
@@ -139,32 +233,81 @@ HandshakeResponse::Decode(const uint8_t *data, size_t length) {
 
   response->version = MessageCodec::GetU32(ptr, end);
   response->server_version = MessageCodec::GetString(ptr, end);
+  if (ptr < end) {
+    response->compression_codec = MessageCodec::GetU8(ptr, end);
+  }
+  if (ptr < end) {
+    response->capabilities = MessageCodec::GetU32(ptr, end);
+  }
+  if (ptr < end) {
+    response->parameters = GetParameters(ptr, end);
+  }
 
   return response;
 }
 
 std::vector<uint8_t> AuthRequest::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutString(payload, token);
-  MessageCodec::PutOptionalString(payload, database);
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(token) + 1 +
+                               MessageCodec::StringSize(database));
+  MessageCodec::PutString(frame, token);
+  MessageCodec::PutOptionalString(frame, database);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> SecurityContextRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(token) + 1 +
+                               MessageCodec::StringSize(database));
+  MessageCodec::PutString(frame, token);
+  MessageCodec::PutOptionalString(frame, database);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
-std::vector<uint8_t> AuthResponse::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutU8(payload, success ? 1 : 0);
-  MessageCodec::PutString(payload, session_id);
+std::vector<uint8_t> PingRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4);
+  MessageCodec::PutU32(frame, sequence);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> PongResponse::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4);
+  MessageCodec::PutU32(frame, sequence);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<PongResponse> PongResponse::Decode(const uint8_t *data,
+                                                   size_t length) {
+  auto response = std::make_unique<PongResponse>();
+  const uint8_t *ptr = data;
+  const uint8_t *end = data + length;
+
+  uint8_t msg_type = MessageCodec::GetU8(ptr, end);
+  if (msg_type != static_cast<uint8_t>(MessageType::Pong)) {
+    throw std::runtime_error("Invalid message type for Pong");
+  }
+
+  response->sequence = MessageCodec::GetU32(ptr, end);
+
+  return response;
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> AuthResponse::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           1 + MessageCodec::StringSize(session_id));
+  MessageCodec::PutU8(frame, success ? 1 : 0);
+  MessageCodec::PutString(frame, session_id);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
 std::unique_ptr<AuthResponse> AuthResponse::Decode(const uint8_t *data,
@@ -184,53 +327,486 @@ std::unique_ptr<AuthResponse> AuthResponse::Decode(const uint8_t *data,
   return response;
 }
 
+FrameParts QueryRequest::EncodeParts() const {
+  FrameParts parts;
+  MessageCodec::BeginFrame(parts.head, GetType(),
+                           MessageCodec::StringSize(sql) + 1 +
+                               MessageCodec::StringSize(statement_id) + 4);
+  MessageCodec::PutString(parts.head, sql);
+  // Each optional field is sent when it or any field after it is set
+  bool has_sample = sampled();
+  bool has_json_query = !json_query.empty() || has_sample;
+  bool has_resume = !resume_handle.empty() || has_json_query;
+  bool has_first_batch_rows = first_batch_rows != 0 || has_resume;
+  bool has_priority =
+      priority != QueryPriority::Default || has_first_batch_rows;
+  bool has_base_version = !base_version.empty() || has_priority;
+  bool has_batch_limits =
+      max_batch_rows != 0 || max_batch_bytes != 0 || has_base_version;
+  bool has_partition = !partition.empty() || has_batch_limits;
+  bool has_traceparent = !traceparent.empty() || has_partition;
+  bool has_timeout = timeout_ms != 0 || has_traceparent;
+  bool has_parameters = !parameters.empty() || has_timeout;
+  bool has_statement = !statement_id.empty() || has_parameters;
+  if (flags != 0 || has_statement) {
+    MessageCodec::PutU8(parts.head, flags);
+  }
+  if (has_statement) {
+    MessageCodec::PutString(parts.head, statement_id);
+  }
+  if (has_parameters) {
+    MessageCodec::PutU32(parts.head, static_cast<uint32_t>(parameters.size()));
+    parts.body = parameters.data();
+    parts.body_size = parameters.size();
+  }
+  if (has_timeout) {
+    MessageCodec::PutU32(parts.tail, timeout_ms);
+  }
+  if (has_traceparent) {
+    MessageCodec::PutString(parts.tail, traceparent);
+  }
+  if (has_partition) {
+    MessageCodec::PutString(parts.tail, partition);
+  }
+  if (has_batch_limits) {
+    MessageCodec::PutU32(parts.tail, max_batch_rows);
+    MessageCodec::PutI64(parts.tail, max_batch_bytes);
+  }
+  if (has_base_version) {
+    MessageCodec::PutString(parts.tail, base_version);
+  }
+  if (has_priority) {
+    MessageCodec::PutU8(parts.tail, static_cast<uint8_t>(priority));
+  }
+  if (has_first_batch_rows) {
+    MessageCodec::PutU32(parts.tail, first_batch_rows);
+  }
+  if (has_resume) {
+    MessageCodec::PutString(parts.tail, resume_handle);
+    MessageCodec::PutI64(parts.tail, resume_from_batch);
+  }
+  if (has_json_query) {
+    MessageCodec::PutString(parts.tail, json_query);
+  }
+  if (has_sample) {
+    MessageCodec::PutU32(parts.tail, sample_fraction_ppm);
+    MessageCodec::PutI64(parts.tail, sample_rows);
+    MessageCodec::PutI64(parts.tail, sample_seed);
+  }
+  MessageCodec::EndFrame(parts.head, parts.body_size + parts.tail.size());
+  return parts;
+}
+
 std::vector<uint8_t> QueryRequest::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutString(payload, sql);
+  return EncodeParts().Join();
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> QueryBatchRequest::Encode() const {
+  std::vector<std::vector<uint8_t>> frames;
+  size_t size = 4;
+  for (const auto &query : queries) {
+    frames.push_back(query.Encode());
+    size += frames.back().size();
+  }
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), size);
+  MessageCodec::PutU32(frame, static_cast<uint32_t>(frames.size()));
+  for (const auto &query : frames) {
+    frame.insert(frame.end(), query.begin(), query.end());
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
-std::vector<uint8_t> QueryResponseSchema::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutBytes(payload, arrow_ipc_schema);
+std::vector<uint8_t> CancelRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> PrepareRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), MessageCodec::StringSize(sql));
+  MessageCodec::PutString(frame, sql);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
-std::unique_ptr<QueryResponseSchema>
-QueryResponseSchema::Decode(const uint8_t *data, size_t length) {
-  auto response = std::make_unique<QueryResponseSchema>();
+std::vector<uint8_t> PrepareResponse::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(statement_id) + 4 +
+                               result_schema.size() + 4 +
+                               parameter_schema.size());
+  MessageCodec::PutString(frame, statement_id);
+  MessageCodec::PutBytes(frame, result_schema);
+  MessageCodec::PutBytes(frame, parameter_schema);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<PrepareResponse> PrepareResponse::Decode(const uint8_t *data,
+                                                         size_t length) {
+  auto response = std::make_unique<PrepareResponse>();
   const uint8_t *ptr = data;
   const uint8_t *end = data + length;
 
   uint8_t msg_type = MessageCodec::GetU8(ptr, end);
-  if (msg_type != static_cast<uint8_t>(MessageType::QueryResponseSchema)) {
-    throw std::runtime_error("Invalid message type for QueryResponseSchema");
+  if (msg_type != static_cast<uint8_t>(MessageType::PrepareResponse)) {
+    throw std::runtime_error("Invalid message type for PrepareResponse");
   }
 
-  response->arrow_ipc_schema = MessageCodec::GetBytes(ptr, end);
+  response->statement_id = MessageCodec::GetString(ptr, end);
+  response->result_schema = MessageCodec::GetBytes(ptr, end);
+  response->parameter_schema = MessageCodec::GetBytes(ptr, end);
 
   return response;
 }
 
-std::vector<uint8_t> QueryResponseBatch::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutBytes(payload, arrow_ipc_batch);
+std::vector<uint8_t> FetchRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4 + 8);
+  MessageCodec::PutU32(frame, max_rows);
+  MessageCodec::PutI64(frame, max_bytes);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> FetchEnd::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> RefreshEnd::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> UnsubscribeRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> CreditGrant::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 8 + 4 + 8);
+  MessageCodec::PutI64(frame, static_cast<int64_t>(query));
+  MessageCodec::PutU32(frame, batches);
+  MessageCodec::PutI64(frame, bytes);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> PartitionRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(sql) + 4 +
+                               (incremental ? 1 : 0));
+  MessageCodec::PutString(frame, sql);
+  MessageCodec::PutU32(frame, max_partitions);
+  if (incremental) {
+    MessageCodec::PutU8(frame, 1);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> PartitionResponse::Encode() const {
+  size_t size = 4 + result_schema.size() + 4 + (more ? 1 : 0);
+  for (const auto &partition : partitions) {
+    size += MessageCodec::StringSize(partition);
+  }
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), size);
+  MessageCodec::PutBytes(frame, result_schema);
+  MessageCodec::PutU32(frame, static_cast<uint32_t>(partitions.size()));
+  for (const auto &partition : partitions) {
+    MessageCodec::PutString(frame, partition);
+  }
+  if (more) {
+    MessageCodec::PutU8(frame, 1);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<PartitionResponse>
+PartitionResponse::Decode(const uint8_t *data, size_t length) {
+  auto response = std::make_unique<PartitionResponse>();
+  const uint8_t *ptr = data;
+  const uint8_t *end = data + length;
+
+  uint8_t msg_type = MessageCodec::GetU8(ptr, end);
+  if (msg_type != static_cast<uint8_t>(MessageType::PartitionResponse)) {
+    throw std::runtime_error("Invalid message type for PartitionResponse");
+  }
+
+  response->result_schema = MessageCodec::GetBytes(ptr, end);
+  uint32_t count = MessageCodec::GetU32(ptr, end);
+  // Each partition takes at least its length, so a corrupt count cannot
+  // reserve more than the message holds
+  if (count > static_cast<size_t>(end - ptr) / 4) {
+    throw std::runtime_error("Partition count exceeds message size");
+  }
+  response->partitions.reserve(count);
+  for (uint32_t i = 0; i < count; i++) {
+    response->partitions.push_back(MessageCodec::GetString(ptr, end));
+  }
+  if (ptr < end) {
+    response->more = MessageCodec::GetU8(ptr, end) != 0;
+  }
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+  return response;
+}
+
+std::vector<uint8_t> WatchChangesRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> ChangeNotification::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           1 + 8 + MessageCodec::StringSize(name));
+  MessageCodec::PutU8(frame, static_cast<uint8_t>(kind));
+  MessageCodec::PutI64(frame, version);
+  MessageCodec::PutString(frame, name);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<ChangeNotification>
+ChangeNotification::Decode(const uint8_t *data, size_t length) {
+  auto notification = std::make_unique<ChangeNotification>();
+  const uint8_t *ptr = data;
+  const uint8_t *end = data + length;
+
+  uint8_t msg_type = MessageCodec::GetU8(ptr, end);
+  if (msg_type != static_cast<uint8_t>(MessageType::ChangeNotification)) {
+    throw std::runtime_error("Invalid message type for ChangeNotification");
+  }
+
+  uint8_t kind = MessageCodec::GetU8(ptr, end);
+  if (kind != static_cast<uint8_t>(ChangeKind::DataModel) &&
+      kind != static_cast<uint8_t>(ChangeKind::Preaggregation)) {
+    throw std::runtime_error("Unknown change kind " + std::to_string(kind));
+  }
+  notification->kind = static_cast<ChangeKind>(kind);
+  notification->version = MessageCodec::GetI64(ptr, end);
+  notification->name = MessageCodec::GetString(ptr, end);
+
+  return notification;
+}
+
+std::vector<uint8_t> ClosePreparedRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(statement_id));
+  MessageCodec::PutString(frame, statement_id);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> IngestRequest::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(table) +
+                               MessageCodec::StringSize(db_schema) + 1 + 4 +
+                               arrow_ipc_schema.size() +
+                               MessageCodec::StringSize(staging_id));
+  MessageCodec::PutString(frame, table);
+  MessageCodec::PutString(frame, db_schema);
+  MessageCodec::PutU8(frame, mode);
+  MessageCodec::PutBytes(frame, arrow_ipc_schema);
+  if (!staging_id.empty()) {
+    MessageCodec::PutString(frame, staging_id);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> IngestReady::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4);
+  MessageCodec::PutU32(frame, window);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<IngestReady> IngestReady::Decode(const uint8_t *data,
+                                                 size_t length) {
+  auto response = std::make_unique<IngestReady>();
+  const uint8_t *ptr = data;
+  const uint8_t *end = data + length;
+
+  uint8_t msg_type = MessageCodec::GetU8(ptr, end);
+  if (msg_type != static_cast<uint8_t>(MessageType::IngestReady)) {
+    throw std::runtime_error("Invalid message type for IngestReady");
+  }
+
+  response->window = MessageCodec::GetU32(ptr, end);
+
+  return response;
+}
+
+FrameParts IngestBatch::EncodeParts() const {
+  FrameParts parts;
+  parts.head = EncodeHead(arrow_ipc_batch.size());
+  parts.body = arrow_ipc_batch.data();
+  parts.body_size = arrow_ipc_batch.size();
+  return parts;
+}
+
+std::vector<uint8_t> IngestBatch::EncodeHead(size_t batch_size) {
+  std::vector<uint8_t> head;
+  MessageCodec::BeginFrame(head, MessageType::IngestBatch, 4);
+  MessageCodec::PutU32(head, static_cast<uint32_t>(batch_size));
+  MessageCodec::EndFrame(head, batch_size);
+  return head;
+}
+
+std::vector<uint8_t> IngestBatch::Encode() const {
+  return EncodeParts().Join();
+}
+
+std::vector<uint8_t> IngestAck::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 8);
+  MessageCodec::PutI64(frame, rows);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<IngestAck> IngestAck::Decode(const uint8_t *data,
+                                             size_t length) {
+  auto response = std::make_unique<IngestAck>();
+  const char *error = nullptr;
+  ThrowIfFailed(DecodeView(data, length, &response->rows, &error), &error);
+  return response;
+}
+
+bool IngestAck::DecodeView(const uint8_t *data, size_t length, int64_t *rows,
+                           const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::IngestAck,
+                    "Invalid message type for IngestAck");
+  *rows = reader.I64();
+  *error = reader.error();
+  return reader.ok();
+}
+
+std::vector<uint8_t> IngestEnd::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 1);
+  MessageCodec::PutU8(frame, abort ? 1 : 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> IngestCommit::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(table) +
+                               MessageCodec::StringSize(db_schema) + 1 +
+                               MessageCodec::StringSize(staging_id) + 1);
+  MessageCodec::PutString(frame, table);
+  MessageCodec::PutString(frame, db_schema);
+  MessageCodec::PutU8(frame, mode);
+  MessageCodec::PutString(frame, staging_id);
+  MessageCodec::PutU8(frame, abort ? 1 : 0);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> QueryResponseSchema::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4 + arrow_ipc_schema.size() + 16);
+  MessageCodec::PutBytes(frame, arrow_ipc_schema);
+  bool has_delta = !delta.version.empty() || !result_handle.empty();
+  if (size_hint.rows >= 0 || size_hint.bytes >= 0 || has_delta) {
+    MessageCodec::PutI64(frame, size_hint.rows);
+    MessageCodec::PutI64(frame, size_hint.bytes);
+  }
+  if (has_delta) {
+    MessageCodec::PutString(frame, delta.version);
+    MessageCodec::PutU8(frame, delta.merge);
+    MessageCodec::PutI64(frame, delta.keep_rows);
+    MessageCodec::PutU32(frame,
+                         static_cast<uint32_t>(delta.key_columns.size()));
+    for (const auto &column : delta.key_columns) {
+      MessageCodec::PutString(frame, column);
+    }
+  }
+  if (!result_handle.empty()) {
+    MessageCodec::PutString(frame, result_handle);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<QueryResponseSchema>
+QueryResponseSchema::Decode(const uint8_t *data, size_t length) {
+  auto response = std::make_unique<QueryResponseSchema>();
+  const uint8_t *schema = nullptr;
+  size_t schema_size = 0;
+  const char *error = nullptr;
+  ThrowIfFailed(DecodeView(data, length, &schema, &schema_size,
+                           &response->size_hint, &response->delta, &error,
+                           &response->result_handle),
+                &error);
+  response->arrow_ipc_schema.assign(schema, schema + schema_size);
+  return response;
+}
+
+bool QueryResponseSchema::DecodeView(const uint8_t *data, size_t length,
+                                     const uint8_t **schema_data,
+                                     size_t *schema_size,
+                                     ResultSizeHint *size_hint,
+                                     ResultDelta *delta, const char **error,
+                                     std::string *result_handle) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryResponseSchema,
+                    "Invalid message type for QueryResponseSchema");
+  *schema_data = reader.Bytes(schema_size);
+  if (!reader.AtEnd()) {
+    size_hint->rows = reader.I64();
+    size_hint->bytes = reader.I64();
+  }
+  if (!reader.AtEnd()) {
+    delta->version = std::string(reader.String());
+    delta->merge = reader.U8();
+    delta->keep_rows = reader.I64();
+    uint32_t keys = reader.U32();
+    delta->key_columns.clear();
+    for (uint32_t i = 0; i < keys && reader.ok(); i++) {
+      delta->key_columns.emplace_back(reader.String());
+    }
+  }
+  if (!reader.AtEnd()) {
+    std::string_view handle = reader.String();
+    if (result_handle) {
+      result_handle->assign(handle);
+    }
+  }
+  *error = reader.error();
+  return reader.ok();
+}
+
+std::vector<uint8_t> QueryResponseBatch::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4 + arrow_ipc_batch.size());
+  MessageCodec::PutBytes(frame, arrow_ipc_batch);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
 std::unique_ptr<QueryResponseBatch>
@@ -249,60 +825,237 @@ QueryResponseBatch::Decode(const uint8_t *data, size_t length) {
   return response;
 }
 
-std::vector<uint8_t> QueryComplete::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutI64(payload, rows_affected);
+bool QueryResponseBatch::DecodeHeader(const uint8_t *data, size_t length,
+                                      uint32_t *ipc_length,
+                                      const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryResponseBatch,
+                    "Invalid message type for QueryResponseBatch");
+  *ipc_length = reader.U32();
+  *error = reader.error();
+  return reader.ok();
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> QueryResponseBatchChunk::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4 + arrow_ipc_chunk.size());
+  MessageCodec::PutBytes(frame, arrow_ipc_chunk);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
-std::unique_ptr<QueryComplete> QueryComplete::Decode(const uint8_t *data,
-                                                     size_t length) {
-  auto response = std::make_unique<QueryComplete>();
+std::unique_ptr<QueryResponseBatchChunk>
+QueryResponseBatchChunk::Decode(const uint8_t *data, size_t length) {
+  auto response = std::make_unique<QueryResponseBatchChunk>();
   const uint8_t *ptr = data;
   const uint8_t *end = data + length;
 
   uint8_t msg_type = MessageCodec::GetU8(ptr, end);
-  if (msg_type != static_cast<uint8_t>(MessageType::QueryComplete)) {
-    throw std::runtime_error("Invalid message type for QueryComplete");
+  if (msg_type != static_cast<uint8_t>(MessageType::QueryResponseBatchChunk)) {
+    throw std::runtime_error(
+        "Invalid message type for QueryResponseBatchChunk");
   }
 
-  response->rows_affected = MessageCodec::GetI64(ptr, end);
+  response->arrow_ipc_chunk = MessageCodec::GetBytes(ptr, end);
 
   return response;
 }
 
-std::vector<uint8_t> ErrorMessage::Encode() const {
-  std::vector<uint8_t> payload;
-  MessageCodec::PutU8(payload, static_cast<uint8_t>(GetType()));
-  MessageCodec::PutString(payload, code);
-  MessageCodec::PutString(payload, message);
+bool QueryResponseBatchChunk::DecodeHeader(const uint8_t *data,
+                                           size_t length,
+                                           uint32_t *ipc_length,
+                                           const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryResponseBatchChunk,
+                    "Invalid message type for QueryResponseBatchChunk");
+  *ipc_length = reader.U32();
+  *error = reader.error();
+  return reader.ok();
+}
 
-  std::vector<uint8_t> result;
-  MessageCodec::PutU32(result, static_cast<uint32_t>(payload.size()));
-  result.insert(result.end(), payload.begin(), payload.end());
-  return result;
+std::vector<uint8_t> QueryResponseBatchCompressed::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           1 + 8 + 4 + compressed_batch.size());
+  MessageCodec::PutU8(frame, codec);
+  MessageCodec::PutI64(frame, uncompressed_length);
+  MessageCodec::PutBytes(frame, compressed_batch);
+  MessageCodec::EndFrame(frame);
+  return frame;
 }
 
-std::unique_ptr<ErrorMessage> ErrorMessage::Decode(const uint8_t *data,
-                                                   size_t length) {
-  auto response = std::make_unique<ErrorMessage>();
+std::unique_ptr<QueryResponseBatchCompressed>
+QueryResponseBatchCompressed::Decode(const uint8_t *data, size_t length) {
+  auto response = std::make_unique<QueryResponseBatchCompressed>();
   const uint8_t *ptr = data;
   const uint8_t *end = data + length;
 
   uint8_t msg_type = MessageCodec::GetU8(ptr, end);
-  if (msg_type != static_cast<uint8_t>(MessageType::Error)) {
-    throw std::runtime_error("Invalid message type for ErrorMessage");
+  if (msg_type !=
+      static_cast<uint8_t>(MessageType::QueryResponseBatchCompressed)) {
+    throw std::runtime_error(
+        "Invalid message type for QueryResponseBatchCompressed");
   }
 
-  response->code = MessageCodec::GetString(ptr, end);
-  response->message = MessageCodec::GetString(ptr, end);
+  response->codec = MessageCodec::GetU8(ptr, end);
+  response->uncompressed_length = MessageCodec::GetI64(ptr, end);
+  response->compressed_batch = MessageCodec::GetBytes(ptr, end);
 
   return response;
 }
 
+bool QueryResponseBatchCompressed::DecodeView(const uint8_t *data,
+                                              size_t length, uint8_t *codec,
+                                              int64_t *uncompressed_length,
+                                              const uint8_t **compressed_data,
+                                              size_t *compressed_size,
+                                              const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryResponseBatchCompressed,
+                    "Invalid message type for QueryResponseBatchCompressed");
+  *codec = reader.U8();
+  *uncompressed_length = reader.I64();
+  *compressed_data = reader.Bytes(compressed_size);
+  *error = reader.error();
+  return reader.ok();
+}
+
+std::vector<uint8_t> QueryResponseBatchShared::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 16);
+  MessageCodec::PutI64(frame, offset);
+  MessageCodec::PutI64(frame, length);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<QueryResponseBatchShared>
+QueryResponseBatchShared::Decode(const uint8_t *data, size_t length) {
+  auto response = std::make_unique<QueryResponseBatchShared>();
+  const char *error = nullptr;
+  ThrowIfFailed(DecodeView(data, length, &response->offset,
+                           &response->length, &error),
+                &error);
+  return response;
+}
+
+bool QueryResponseBatchShared::DecodeView(const uint8_t *data, size_t length,
+                                          int64_t *offset,
+                                          int64_t *batch_length,
+                                          const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryResponseBatchShared,
+                    "Invalid message type for QueryResponseBatchShared");
+  *offset = reader.I64();
+  *batch_length = reader.I64();
+  *error = reader.error();
+  return reader.ok();
+}
+
+std::vector<uint8_t> SharedMemoryAttach::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 8);
+  MessageCodec::PutI64(frame, size);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> SharedMemoryRelease::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(), 4 + 16 * ranges.size());
+  MessageCodec::PutU32(frame, static_cast<uint32_t>(ranges.size()));
+  for (const auto &range : ranges) {
+    MessageCodec::PutI64(frame, range.first);
+    MessageCodec::PutI64(frame, range.second);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::vector<uint8_t> QueryComplete::Encode() const {
+  std::vector<uint8_t> frame;
+  size_t size = 8;
+  if (diagnostics) {
+    size += MessageCodec::StringSize(diagnostics->preaggregation) + 1 + 4 * 8;
+  }
+  MessageCodec::BeginFrame(frame, GetType(), size);
+  MessageCodec::PutI64(frame, rows_affected);
+  if (diagnostics) {
+    MessageCodec::PutString(frame, diagnostics->preaggregation);
+    MessageCodec::PutU8(frame,
+                        static_cast<uint8_t>(diagnostics->result_cache_hit));
+    MessageCodec::PutI64(frame, diagnostics->planning_nanos);
+    MessageCodec::PutI64(frame, diagnostics->execution_nanos);
+    MessageCodec::PutI64(frame, diagnostics->serialization_nanos);
+    MessageCodec::PutI64(frame, diagnostics->bytes_produced);
+  }
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<QueryComplete> QueryComplete::Decode(const uint8_t *data,
+                                                     size_t length) {
+  auto response = std::make_unique<QueryComplete>();
+  const char *error = nullptr;
+  ThrowIfFailed(DecodeView(data, length, &response->rows_affected, &error,
+                           &response->diagnostics),
+                &error);
+  return response;
+}
+
+bool QueryComplete::DecodeView(const uint8_t *data, size_t length,
+                               int64_t *rows_affected, const char **error,
+                               std::optional<QueryDiagnostics> *diagnostics) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::QueryComplete,
+                    "Invalid message type for QueryComplete");
+  *rows_affected = reader.I64();
+  if (!reader.AtEnd() && diagnostics) {
+    QueryDiagnostics &out = diagnostics->emplace();
+    out.preaggregation = std::string(reader.String());
+    out.result_cache_hit = static_cast<int8_t>(reader.U8());
+    out.planning_nanos = reader.I64();
+    out.execution_nanos = reader.I64();
+    out.serialization_nanos = reader.I64();
+    out.bytes_produced = reader.I64();
+  }
+  *error = reader.error();
+  return reader.ok();
+}
+
+std::vector<uint8_t> ErrorMessage::Encode() const {
+  std::vector<uint8_t> frame;
+  MessageCodec::BeginFrame(frame, GetType(),
+                           MessageCodec::StringSize(code) +
+                               MessageCodec::StringSize(message));
+  MessageCodec::PutString(frame, code);
+  MessageCodec::PutString(frame, message);
+  MessageCodec::EndFrame(frame);
+  return frame;
+}
+
+std::unique_ptr<ErrorMessage> ErrorMessage::Decode(const uint8_t *data,
+                                                   size_t length) {
+  auto response = std::make_unique<ErrorMessage>();
+  std::string_view code;
+  std::string_view message;
+  const char *error = nullptr;
+  ThrowIfFailed(DecodeView(data, length, &code, &message, &error), &error);
+  response->code = std::string(code);
+  response->message = std::string(message);
+  return response;
+}
+
+bool ErrorMessage::DecodeView(const uint8_t *data, size_t length,
+                              std::string_view *code,
+                              std::string_view *message, const char **error) {
+  MessageReader reader(data, length);
+  reader.ExpectType(MessageType::Error,
+                    "Invalid message type for ErrorMessage");
+  *code = reader.String();
+  *message = reader.String();
+  *error = reader.error();
+  return reader.ok();
+}
+
 } // namespace adbc::cube
@@ -2,13 +2,22 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace adbc::cube {
 
-// Protocol version
+// Protocol version. The client sends the newest version it speaks; the
+// server answers with the one the session will use, which the client
+// accepts from MIN_PROTOCOL_VERSION up.
 constexpr uint32_t PROTOCOL_VERSION = 1;
+constexpr uint32_t MIN_PROTOCOL_VERSION = 1;
+
+// Default limit on the payload of a single frame
+constexpr uint32_t DEFAULT_MAX_MESSAGE_BYTES = 100 * 1024 * 1024; // 100MB
 
 // Message types
 enum class MessageType : uint8_t {
@@ -16,13 +25,56 @@ enum class MessageType : uint8_t {
   HandshakeResponse = 0x02,
   AuthRequest = 0x03,
   AuthResponse = 0x04,
+  SecurityContextRequest = 0x05,
+  Ping = 0x06,
+  Pong = 0x07,
   QueryRequest = 0x10,
   QueryResponseSchema = 0x11,
   QueryResponseBatch = 0x12,
   QueryComplete = 0x13,
+  QueryResponseBatchChunk = 0x14,
+  QueryResponseBatchCompressed = 0x15,
+  QueryResponseBatchShared = 0x16,
+  FetchRequest = 0x17,
+  FetchEnd = 0x18,
+  CreditGrant = 0x19,
+  QueryBatchRequest = 0x1A,
+  RefreshEnd = 0x1B,
+  UnsubscribeRequest = 0x1C,
+  CancelRequest = 0x20,
+  PrepareRequest = 0x30,
+  PrepareResponse = 0x31,
+  ClosePreparedRequest = 0x32,
+  IngestRequest = 0x40,
+  IngestReady = 0x41,
+  IngestBatch = 0x42,
+  IngestAck = 0x43,
+  IngestEnd = 0x44,
+  IngestCommit = 0x45,
+  SharedMemoryAttach = 0x50,
+  SharedMemoryRelease = 0x51,
+  PartitionRequest = 0x60,
+  PartitionResponse = 0x61,
+  WatchChangesRequest = 0x70,
+  ChangeNotification = 0x71,
   Error = 0xFF,
 };
 
+// A frame split around its one large field, so the field can be written
+// from where it is (writev) instead of being copied into the frame: head,
+// then body_size bytes at body, then tail.
+struct FrameParts {
+  std::vector<uint8_t> head;     // Length prefix, type and leading fields
+  const uint8_t *body = nullptr; // Borrowed from the encoded message
+  size_t body_size = 0;
+  std::vector<uint8_t> tail; // Fields after the body
+
+  size_t size() const { return head.size() + body_size + tail.size(); }
+
+  // The whole frame in one buffer; moves head out when there is no body
+  std::vector<uint8_t> Join() &&;
+};
+
 // Base message structure
 struct Message {
   virtual ~Message() = default;
@@ -30,9 +82,124 @@ struct Message {
   virtual std::vector<uint8_t> Encode() const = 0;
 };
 
+// Handshake capability bits
+// The schema of a result is sent once in QueryResponseSchema, before its
+// batches; each QueryResponseBatch then holds only the DictionaryBatch and
+// RecordBatch messages of that batch, without a Schema message
+constexpr uint32_t CAPABILITY_SCHEMA_ONCE = 0x01;
+// PrepareRequest and ClosePreparedRequest are understood, and a QueryRequest
+// may name a prepared statement instead of carrying SQL
+constexpr uint32_t CAPABILITY_PREPARED_STATEMENTS = 0x02;
+// A QueryRequest may carry bound parameters as an Arrow IPC stream
+constexpr uint32_t CAPABILITY_QUERY_PARAMETERS = 0x04;
+// IngestRequest and the messages that follow it are understood
+constexpr uint32_t CAPABILITY_BULK_INGEST = 0x08;
+// QueryResponseSchema may carry the server's estimate of the result's size
+constexpr uint32_t CAPABILITY_SIZE_HINTS = 0x10;
+// A QueryRequest may carry the time the client will wait for its result, so
+// the server can stop work the client has given up on
+constexpr uint32_t CAPABILITY_QUERY_TIMEOUT = 0x20;
+// Over a Unix domain socket, the client may hand the server a shared memory
+// region (SharedMemoryAttach), which the server may then write batches into
+// (QueryResponseBatchShared) instead of sending their bytes
+constexpr uint32_t CAPABILITY_SHARED_MEMORY = 0x40;
+// A QueryRequest may carry the W3C traceparent of the client's span, so the
+// server's spans for the query join the client's trace
+constexpr uint32_t CAPABILITY_TRACE_CONTEXT = 0x80;
+// PartitionRequest is understood, and a QueryRequest may carry one of the
+// partitions it returned instead of SQL
+constexpr uint32_t CAPABILITY_PARTITIONS = 0x100;
+// A QueryRequest may open a cursor (QUERY_FLAG_CURSOR), whose batches the
+// server sends only in answer to FetchRequests
+constexpr uint32_t CAPABILITY_CURSORS = 0x200;
+// A QueryRequest may ask for its batches to be sent against credit the
+// client grants (QUERY_FLAG_CREDIT, CreditGrant)
+constexpr uint32_t CAPABILITY_FLOW_CONTROL = 0x400;
+// A QueryRequest may cap the rows and bytes of each batch of its result
+constexpr uint32_t CAPABILITY_BATCH_LIMITS = 0x800;
+// A QueryRequest may ask for the result schema alone (QUERY_FLAG_SCHEMA_ONLY)
+constexpr uint32_t CAPABILITY_SCHEMA_ONLY = 0x1000;
+// Several queries may be sent in one QueryBatchRequest
+constexpr uint32_t CAPABILITY_QUERY_BATCH = 0x2000;
+// A QueryRequest may ask for a versioned result (QUERY_FLAG_DELTA) and name
+// the version of an earlier result of the same query the client kept; the
+// server may then send only what changed since, with a merge hint in
+// QueryResponseSchema
+constexpr uint32_t CAPABILITY_DELTA_RESULTS = 0x4000;
+// A QueryRequest may subscribe to its result (QUERY_FLAG_SUBSCRIBE), which
+// the server sends again each time the data it is built from is refreshed
+constexpr uint32_t CAPABILITY_SUBSCRIPTIONS = 0x8000;
+// An authenticated session may switch to another token's security context
+// (SecurityContextRequest) between queries, without a new connection
+constexpr uint32_t CAPABILITY_SECURITY_CONTEXT = 0x10000;
+// A Ping between queries is answered by a Pong straight from the session's
+// connection handler, without taking a slot of the query scheduler
+constexpr uint32_t CAPABILITY_PING = 0x20000;
+// A QueryRequest may carry the class of work it is (QueryPriority), which
+// the server's query queue lets in ahead of or behind the other classes
+constexpr uint32_t CAPABILITY_QUERY_PRIORITY = 0x40000;
+// A QueryRequest may ask for a small first batch, sent as soon as that many
+// rows are ready, ahead of batches of the usual size
+constexpr uint32_t CAPABILITY_FIRST_BATCH_ROWS = 0x80000;
+// A QueryRequest may be limited to pre-aggregations
+// (QUERY_FLAG_REQUIRE_PREAGGREGATION)
+constexpr uint32_t CAPABILITY_REQUIRE_PREAGGREGATION = 0x100000;
+// A QueryComplete may carry the server's QueryDiagnostics
+constexpr uint32_t CAPABILITY_QUERY_DIAGNOSTICS = 0x200000;
+// The server may name a result in QueryResponseSchema and keep it for a
+// while, so that a session taking up a lost one (HANDSHAKE_RESUME_SESSION)
+// can ask for the rest of it from a given batch on
+constexpr uint32_t CAPABILITY_RESUMABLE_RESULTS = 0x400000;
+// An IngestRequest may load into a staging table shared by several
+// sessions, which an IngestCommit then swaps into the target table
+constexpr uint32_t CAPABILITY_STAGED_INGEST = 0x800000;
+// A QueryRequest may carry a Cube JSON query to run instead of SQL text,
+// skipping the SQL front end
+constexpr uint32_t CAPABILITY_JSON_QUERY = 0x1000000;
+// A QueryRequest may ask for an approximate result computed from a sample
+// of the source rows
+constexpr uint32_t CAPABILITY_SAMPLING = 0x2000000;
+// A session may be given over to ChangeNotifications (WatchChangesRequest),
+// pushed as the data model is compiled again or pre-aggregations refresh
+constexpr uint32_t CAPABILITY_CHANGE_NOTIFICATIONS = 0x4000000;
+// A schema-only query (QUERY_FLAG_SCHEMA_ONLY) is answered with the
+// planner's estimate of the result's size in QueryResponseSchema, and with
+// the pre-aggregation the plan uses in QueryComplete's diagnostics, still
+// without running it
+constexpr uint32_t CAPABILITY_QUERY_ESTIMATES = 0x8000000;
+// A PartitionRequest may ask for partitions as the planner finds them
+// (PartitionRequest::incremental)
+constexpr uint32_t CAPABILITY_INCREMENTAL_PARTITIONS = 0x10000000;
+
 // Handshake messages
+// Key/value settings exchanged at handshake. Either side ignores keys it
+// does not know, so new ones need no new capability bit.
+using HandshakeParameters = std::vector<std::pair<std::string, std::string>>;
+
+// Handshake parameter keys
+// Name and version of the client
+constexpr const char *HANDSHAKE_CLIENT = "client";
+// Largest frame payload the sender accepts, in decimal bytes; absent or 0
+// means no limit
+constexpr const char *HANDSHAKE_MAX_MESSAGE_BYTES = "max_message_bytes";
+// From the client, the session_id of an authenticated session it lost, to
+// take up again instead of authenticating; from the server, the same ID
+// once the new connection is that session
+constexpr const char *HANDSHAKE_RESUME_SESSION = "resume_session";
+// From the server, the version of the data model it has compiled, which
+// changes whenever the model does
+constexpr const char *HANDSHAKE_MODEL_VERSION = "model_version";
+
 struct HandshakeRequest : public Message {
   uint32_t version = PROTOCOL_VERSION;
+  // Compression codec ids the client accepts, in order of preference.
+  // Only sent when non-empty, so older servers see the original message.
+  std::vector<uint8_t> compression_codecs;
+  // CAPABILITY_* bits the client supports. Only sent when non-zero, after
+  // the (possibly empty) codec list.
+  uint32_t capabilities = 0;
+  // Only sent when non-empty, after the capabilities (then sent even if 0)
+  HandshakeParameters parameters;
 
   MessageType GetType() const override { return MessageType::HandshakeRequest; }
   std::vector<uint8_t> Encode() const override;
@@ -41,6 +208,14 @@ struct HandshakeRequest : public Message {
 struct HandshakeResponse : public Message {
   uint32_t version;
   std::string server_version;
+  // Codec the server will use for QueryResponseBatchCompressed; 0 (none) if
+  // the server does not send the field
+  uint8_t compression_codec = 0;
+  // CAPABILITY_* bits the server agreed to, a subset of the requested ones;
+  // 0 if the server does not send the field
+  uint32_t capabilities = 0;
+  // Settings of the server, after the capabilities; empty if not sent
+  HandshakeParameters parameters;
 
   MessageType GetType() const override {
     return MessageType::HandshakeResponse;
@@ -60,6 +235,37 @@ struct AuthRequest : public Message {
   std::vector<uint8_t> Encode() const override;
 };
 
+// Run the session's later queries under the security context of token,
+// answered by an AuthResponse with the unchanged session_id. Only sent
+// while no query is running (CAPABILITY_SECURITY_CONTEXT).
+struct SecurityContextRequest : public Message {
+  std::string token;
+  std::string database; // optional
+
+  MessageType GetType() const override {
+    return MessageType::SecurityContextRequest;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Liveness check, only sent while no query is running (CAPABILITY_PING)
+struct PingRequest : public Message {
+  uint32_t sequence = 0; // Echoed by the Pong
+
+  MessageType GetType() const override { return MessageType::Ping; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+struct PongResponse : public Message {
+  uint32_t sequence = 0;
+
+  MessageType GetType() const override { return MessageType::Pong; }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<PongResponse> Decode(const uint8_t *data,
+                                              size_t length);
+};
+
 struct AuthResponse : public Message {
   bool success;
   std::string session_id;
@@ -71,16 +277,430 @@ struct AuthResponse : public Message {
                                               size_t length);
 };
 
+// QueryRequest flags
+// Send text and binary columns as Utf8View/BinaryView
+constexpr uint8_t QUERY_FLAG_VIEW_TYPES = 0x01;
+// Open a cursor: the server answers with QueryResponseSchema and FetchEnd
+// (or an Error) and holds the rest of the result for FetchRequests
+// (CAPABILITY_CURSORS)
+constexpr uint8_t QUERY_FLAG_CURSOR = 0x02;
+// Send batches only against the credit of CreditGrant messages
+// (CAPABILITY_FLOW_CONTROL)
+constexpr uint8_t QUERY_FLAG_CREDIT = 0x04;
+// Plan the query without running it: the response is the schema-only
+// QueryResponseSchema and a QueryComplete (CAPABILITY_SCHEMA_ONLY)
+constexpr uint8_t QUERY_FLAG_SCHEMA_ONLY = 0x08;
+// Send columns whose values repeat in long runs (sorted dimensions,
+// constants) as RunEndEncoded
+constexpr uint8_t QUERY_FLAG_RUN_END_ENCODED = 0x10;
+// Send the version of the result in QueryResponseSchema, and a delta
+// against base_version when the server still knows it
+// (CAPABILITY_DELTA_RESULTS)
+constexpr uint8_t QUERY_FLAG_DELTA = 0x20;
+// Subscribe to the result: the server sends QueryResponseSchema, then the
+// batches of each version of the result followed by a RefreshEnd, the
+// first version at once and another whenever the data is refreshed, until
+// an UnsubscribeRequest or CancelRequest ends it with QueryComplete. The
+// query timeout does not apply (CAPABILITY_SUBSCRIPTIONS).
+constexpr uint8_t QUERY_FLAG_SUBSCRIBE = 0x40;
+// Run the query only if a pre-aggregation serves it: one that would go to
+// the source database is rejected while planning, with an Error of code
+// ERROR_CODE_NO_PREAGGREGATION (CAPABILITY_REQUIRE_PREAGGREGATION)
+constexpr uint8_t QUERY_FLAG_REQUIRE_PREAGGREGATION = 0x80;
+
+// Class of work a query is, for the server's queue
+enum class QueryPriority : uint8_t {
+  Default = 0,     // The server's own choice; not sent
+  Interactive = 1, // A user waits for it: dashboards, ad-hoc queries
+  Batch = 2,       // Exports and scheduled reports
+  Background = 3,  // Warm-ups and refreshes, only when nothing else waits
+};
+
 // Query messages
 struct QueryRequest : public Message {
   std::string sql;
+  // QUERY_FLAG_* bits. Only sent when non-zero, so older servers see the
+  // original message.
+  uint8_t flags = 0;
+  // Statement returned by PrepareResponse to run instead of sql. Only sent
+  // when non-empty, after the flags (CAPABILITY_PREPARED_STATEMENTS).
+  std::string statement_id;
+  // Parameter values: an Arrow IPC stream of one row, its columns in
+  // parameter order. Only sent when non-empty, after the statement id
+  // (CAPABILITY_QUERY_PARAMETERS).
+  std::vector<uint8_t> parameters;
+  // Milliseconds the client will wait for the whole result; 0 = no limit.
+  // Only sent when non-zero, after the (possibly empty) parameters
+  // (CAPABILITY_QUERY_TIMEOUT).
+  uint32_t timeout_ms = 0;
+  // W3C traceparent of the client span the query runs in. Only sent when
+  // non-empty, after the (possibly zero) timeout (CAPABILITY_TRACE_CONTEXT).
+  std::string traceparent;
+  // Partition from a PartitionResponse to run instead of sql. Only sent
+  // when non-empty, after the (possibly empty) traceparent
+  // (CAPABILITY_PARTITIONS).
+  std::string partition;
+  // Largest batches the result is to be sent in; 0 = the server's choice.
+  // Sent together when either is non-zero, after the (possibly empty)
+  // partition (CAPABILITY_BATCH_LIMITS).
+  uint32_t max_batch_rows = 0;
+  int64_t max_batch_bytes = 0;
+  // Version of the earlier result the client holds (QUERY_FLAG_DELTA). Only
+  // sent when non-empty, after the (possibly zero) batch limits
+  // (CAPABILITY_DELTA_RESULTS).
+  std::string base_version;
+  // Only sent when not Default, after the (possibly empty) base version
+  // (CAPABILITY_QUERY_PRIORITY).
+  QueryPriority priority = QueryPriority::Default;
+  // Most rows of the first batch of the result, so the client can show
+  // them while the rest is produced; 0 = as the others. Only sent when
+  // non-zero, after the (possibly default) priority
+  // (CAPABILITY_FIRST_BATCH_ROWS).
+  uint32_t first_batch_rows = 0;
+  // Result named by an earlier QueryResponseSchema to send again instead
+  // of running the query, skipping its first resume_from_batch batches; the
+  // schema is sent as usual. Sent together when the handle is non-empty,
+  // after the (possibly zero) first batch rows (CAPABILITY_RESUMABLE_RESULTS).
+  std::string resume_handle;
+  int64_t resume_from_batch = 0;
+  // Cube query as JSON (measures, dimensions, filters, timeDimensions, ...)
+  // to run instead of sql, which is left empty. Only sent when non-empty,
+  // after the (possibly empty) resume handle (CAPABILITY_JSON_QUERY).
+  std::string json_query;
+  // Answer from a sample of the source rows instead of all of them: a
+  // fraction of them in millionths and/or at most sample_rows, drawn with
+  // sample_seed so that the same request samples the same rows; both 0 =
+  // exact. Sent together when either is non-zero, after the (possibly
+  // empty) JSON query (CAPABILITY_SAMPLING).
+  uint32_t sample_fraction_ppm = 0;
+  int64_t sample_rows = 0;
+  int64_t sample_seed = 0;
+
+  bool sampled() const { return sample_fraction_ppm != 0 || sample_rows != 0; }
 
   MessageType GetType() const override { return MessageType::QueryRequest; }
   std::vector<uint8_t> Encode() const override;
+
+  // Encode with the parameters left in place; the request must outlive the
+  // result
+  FrameParts EncodeParts() const;
+};
+
+// Several queries in one frame (CAPABILITY_QUERY_BATCH): a count, then
+// each query as a whole QueryRequest frame. The server may run them
+// concurrently, but answers as if each had been sent on its own, in order,
+// and numbers them for CancelRequest and CreditGrant the same way.
+struct QueryBatchRequest : public Message {
+  std::vector<QueryRequest> queries;
+
+  MessageType GetType() const override {
+    return MessageType::QueryBatchRequest;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Asks the server to stop every query sent before it on this session. Each
+// cancelled query still ends with its own QueryComplete or Error, so the
+// responses stay in order.
+struct CancelRequest : public Message {
+  MessageType GetType() const override { return MessageType::CancelRequest; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Parses and plans a query without running it. Answered by a
+// PrepareResponse, or an Error if the query is invalid; the statement stays
+// on the session until closed.
+struct PrepareRequest : public Message {
+  std::string sql;
+
+  MessageType GetType() const override { return MessageType::PrepareRequest; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+struct PrepareResponse : public Message {
+  std::string statement_id;
+  // Arrow IPC Schema messages of the result and of the parameters; empty
+  // when the server cannot tell before running the query
+  std::vector<uint8_t> result_schema;
+  std::vector<uint8_t> parameter_schema;
+
+  MessageType GetType() const override {
+    return MessageType::PrepareResponse;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<PrepareResponse> Decode(const uint8_t *data,
+                                                 size_t length);
+};
+
+// Frees a prepared statement. The server does not answer it.
+struct ClosePreparedRequest : public Message {
+  std::string statement_id;
+
+  MessageType GetType() const override {
+    return MessageType::ClosePreparedRequest;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Asks for the next part of the result of the oldest cursor on the session
+// that has not ended; ignored if there is none. The server answers with
+// whole batches until it has sent max_rows rows or max_bytes bytes of
+// them (at least one batch; 0 = no limit), then FetchEnd, or QueryComplete
+// once the result is exhausted. Several fetches may be outstanding; they are
+// answered in order. Both limits 0 closes the cursor: once the fetches
+// before it are answered, the result ends with QueryComplete.
+struct FetchRequest : public Message {
+  uint32_t max_rows = 0;
+  int64_t max_bytes = 0;
+
+  MessageType GetType() const override { return MessageType::FetchRequest; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Ends the answer to a FetchRequest (or to the QueryRequest opening a
+// cursor) while the result has more to send
+struct FetchEnd : public Message {
+  MessageType GetType() const override { return MessageType::FetchEnd; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Ends the batches of one version of a subscribed result
+struct RefreshEnd : public Message {
+  MessageType GetType() const override { return MessageType::RefreshEnd; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Ends the oldest subscription on the session that has not ended; ignored
+// if there is none. The server finishes the version it is sending, if any,
+// and ends the result with QueryComplete. Unanswered otherwise.
+struct UnsubscribeRequest : public Message {
+  MessageType GetType() const override {
+    return MessageType::UnsubscribeRequest;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// CreditGrant values lifting the limit for the rest of a result
+constexpr uint32_t CREDIT_UNLIMITED_BATCHES = UINT32_MAX;
+constexpr int64_t CREDIT_UNLIMITED_BYTES = INT64_MAX;
+
+// Adds to the credit of a result sent with QUERY_FLAG_CREDIT, which starts
+// with none. The server sends a batch while it holds at least one batch
+// and a positive number of bytes of credit, then takes the batch and its
+// Arrow IPC bytes (before compression) off; the byte credit may go
+// negative, so a batch larger than the window still goes. Other messages
+// need no credit. Unanswered, and ignored once the result has ended.
+struct CreditGrant : public Message {
+  uint64_t query = 0; // Position of the QueryRequest on the session, from 1
+  uint32_t batches = 0;
+  int64_t bytes = 0;
+
+  MessageType GetType() const override { return MessageType::CreditGrant; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Plans a query and splits its result into partitions (for example by
+// CubeStore partition or time range) that can be run separately, on any
+// session with the same server, and whose results together are the query's.
+// Answered by a PartitionResponse, or an Error.
+struct PartitionRequest : public Message {
+  std::string sql;
+  // Most partitions the client wants; 0 lets the server choose
+  uint32_t max_partitions = 0;
+  // Send partitions as planning finds them, in several PartitionResponses
+  // of which all but the last have more set; an Error may follow any of
+  // them. Nothing else may be sent on the session until the last. Only
+  // sent when set, after max_partitions (CAPABILITY_INCREMENTAL_PARTITIONS).
+  bool incremental = false;
+
+  MessageType GetType() const override { return MessageType::PartitionRequest; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+struct PartitionResponse : public Message {
+  // Arrow IPC Schema message of the result, shared by every partition;
+  // only in the first response to an incremental request
+  std::vector<uint8_t> result_schema;
+  // Opaque to the client; each one is run by a QueryRequest carrying it
+  std::vector<std::string> partitions;
+  // More responses follow (PartitionRequest::incremental). Only sent when
+  // set, after the partitions.
+  bool more = false;
+
+  MessageType GetType() const override {
+    return MessageType::PartitionResponse;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<PartitionResponse> Decode(const uint8_t *data,
+                                                   size_t length);
+};
+
+// Gives the session over to ChangeNotifications, which the server sends
+// from then on, for changes the session's security context can see, until
+// the session closes. Nothing else is sent on the session afterwards.
+struct WatchChangesRequest : public Message {
+  MessageType GetType() const override {
+    return MessageType::WatchChangesRequest;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// What a ChangeNotification reports
+enum class ChangeKind : uint8_t {
+  DataModel = 1,      // The data model was compiled again
+  Preaggregation = 2, // A pre-aggregation was refreshed
+};
+
+struct ChangeNotification : public Message {
+  ChangeKind kind = ChangeKind::DataModel;
+  // Grows with each change of the kind (and, for Preaggregation, name)
+  int64_t version = 0;
+  // The pre-aggregation refreshed, as QueryDiagnostics names it; empty for
+  // DataModel
+  std::string name;
+
+  MessageType GetType() const override {
+    return MessageType::ChangeNotification;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<ChangeNotification> Decode(const uint8_t *data,
+                                                    size_t length);
+};
+
+// IngestRequest modes, as ADBC_INGEST_OPTION_MODE
+constexpr uint8_t INGEST_MODE_CREATE = 0;
+constexpr uint8_t INGEST_MODE_APPEND = 1;
+constexpr uint8_t INGEST_MODE_REPLACE = 2;
+constexpr uint8_t INGEST_MODE_CREATE_APPEND = 3;
+
+// Starts loading Arrow data into a table. The server answers with an
+// IngestReady, or an Error if the table cannot take the data; the client
+// then sends IngestBatch messages, one IngestAck coming back for each batch
+// stored, and finishes with IngestEnd. The load ends with a QueryComplete
+// counting the rows stored, or an Error; after an Error the server ignores
+// the messages of the load up to IngestEnd and does not answer it.
+struct IngestRequest : public Message {
+  std::string table;
+  std::string db_schema; // Empty for the default schema
+  uint8_t mode = INGEST_MODE_CREATE;
+  // Arrow IPC Schema message of the data
+  std::vector<uint8_t> arrow_ipc_schema;
+  // Only sent when set (CAPABILITY_STAGED_INGEST). The data then goes to the
+  // staging table of that ID, which the first load naming it creates with
+  // the data's schema, and mode is ignored; nothing reaches table until an
+  // IngestCommit names the ID. The QueryComplete of each load counts the
+  // rows it staged.
+  std::string staging_id;
+
+  MessageType GetType() const override { return MessageType::IngestRequest; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+struct IngestReady : public Message {
+  // IngestBatch messages the client may send before their IngestAck
+  uint32_t window = 1;
+
+  MessageType GetType() const override { return MessageType::IngestReady; }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<IngestReady> Decode(const uint8_t *data,
+                                             size_t length);
+};
+
+// One RecordBatch message and its body, without a Schema message
+struct IngestBatch : public Message {
+  std::vector<uint8_t> arrow_ipc_batch;
+
+  MessageType GetType() const override { return MessageType::IngestBatch; }
+  std::vector<uint8_t> Encode() const override;
+
+  // Encode with the batch left in place; the message must outlive the
+  // result
+  FrameParts EncodeParts() const;
+
+  // The frame up to its batch, for a batch of batch_size bytes written
+  // right after it from wherever it lies
+  static std::vector<uint8_t> EncodeHead(size_t batch_size);
+};
+
+struct IngestAck : public Message {
+  int64_t rows = 0; // Rows of the batch stored
+
+  MessageType GetType() const override { return MessageType::IngestAck; }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<IngestAck> Decode(const uint8_t *data, size_t length);
+
+  /// Decode without allocating or throwing
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length, int64_t *rows,
+                         const char **error);
+};
+
+struct IngestEnd : public Message {
+  // Discard the data sent so far instead of storing it; still answered by
+  // a QueryComplete or Error
+  bool abort = false;
+
+  MessageType GetType() const override { return MessageType::IngestEnd; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Ends a staged ingestion (CAPABILITY_STAGED_INGEST) once every load into
+// its staging table is over: the staging table replaces or is appended to
+// table, as mode says, in one transaction, and is dropped. Answered by a
+// QueryComplete counting the rows committed, or an Error, after which the
+// table is as it was.
+struct IngestCommit : public Message {
+  std::string table;
+  std::string db_schema; // Empty for the default schema
+  uint8_t mode = INGEST_MODE_CREATE;
+  std::string staging_id;
+  // Drop the staging table without touching table
+  bool abort = false;
+
+  MessageType GetType() const override { return MessageType::IngestCommit; }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Server estimate of the size of a result, so consumers can allocate once;
+// -1 where unknown
+struct ResultSizeHint {
+  int64_t rows = -1;
+  int64_t bytes = -1; // Arrow buffer bytes of all batches
+};
+
+// How the batches of a versioned result combine with the base result
+constexpr uint8_t DELTA_MERGE_FULL = 0;   // They are the whole result
+constexpr uint8_t DELTA_MERGE_TAIL = 1;   // They follow its first keep_rows
+constexpr uint8_t DELTA_MERGE_UPSERT = 2; // They replace its rows of equal key
+
+// Version of a result sent with QUERY_FLAG_DELTA, and how to build it from
+// the base result the request named. With DELTA_MERGE_UPSERT, the rows of
+// the base whose key_columns equal those of a row sent are dropped, and the
+// rows sent follow the others.
+struct ResultDelta {
+  std::string version; // Empty when the server keeps no versions
+  uint8_t merge = DELTA_MERGE_FULL;
+  int64_t keep_rows = 0; // DELTA_MERGE_TAIL
+  std::vector<std::string> key_columns; // DELTA_MERGE_UPSERT
 };
 
 struct QueryResponseSchema : public Message {
   std::vector<uint8_t> arrow_ipc_schema;
+  // Only sent when the client offered CAPABILITY_SIZE_HINTS and either
+  // estimate is known, or before the delta, after the schema
+  ResultSizeHint size_hint;
+  // Only sent for a request with QUERY_FLAG_DELTA when the version is
+  // known, or before the result handle, after the size hint
+  ResultDelta delta;
+  // Name the server kept the result under, for a QueryRequest to resume it
+  // by. Only sent when non-empty, after the (possibly empty) delta
+  // (CAPABILITY_RESUMABLE_RESULTS).
+  std::string result_handle;
 
   MessageType GetType() const override {
     return MessageType::QueryResponseSchema;
@@ -89,6 +709,14 @@ struct QueryResponseSchema : public Message {
 
   static std::unique_ptr<QueryResponseSchema> Decode(const uint8_t *data,
                                                      size_t length);
+
+  /// Decode without throwing; schema_data points into the input
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length,
+                         const uint8_t **schema_data, size_t *schema_size,
+                         ResultSizeHint *size_hint, ResultDelta *delta,
+                         const char **error,
+                         std::string *result_handle = nullptr);
 };
 
 struct QueryResponseBatch : public Message {
@@ -101,18 +729,148 @@ struct QueryResponseBatch : public Message {
 
   static std::unique_ptr<QueryResponseBatch> Decode(const uint8_t *data,
                                                     size_t length);
+
+  /// Bytes preceding the Arrow IPC data in a payload (type + byte length)
+  static constexpr size_t kHeaderSize = 5;
+
+  /// Decode only the header of a payload so the Arrow IPC bytes can be read
+  /// from the socket straight into their final buffer; ipc_length is set to
+  /// the length of the Arrow IPC bytes that follow it
+  /// @return false, with error set, if the header is malformed
+  static bool DecodeHeader(const uint8_t *data, size_t length,
+                           uint32_t *ipc_length, const char **error);
+};
+
+// A batch too large for one frame is sent as one or more chunks followed by
+// a QueryResponseBatch holding the final piece; the client concatenates them
+struct QueryResponseBatchChunk : public Message {
+  std::vector<uint8_t> arrow_ipc_chunk;
+
+  MessageType GetType() const override {
+    return MessageType::QueryResponseBatchChunk;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<QueryResponseBatchChunk> Decode(const uint8_t *data,
+                                                         size_t length);
+
+  /// Same layout as the QueryResponseBatch header
+  static constexpr size_t kHeaderSize = QueryResponseBatch::kHeaderSize;
+
+  /// @return false, with error set, if the header is malformed
+  static bool DecodeHeader(const uint8_t *data, size_t length,
+                           uint32_t *ipc_length, const char **error);
+};
+
+// A whole Arrow IPC batch compressed with the codec agreed in the handshake
+struct QueryResponseBatchCompressed : public Message {
+  uint8_t codec = 0;
+  int64_t uncompressed_length = 0;
+  std::vector<uint8_t> compressed_batch;
+
+  MessageType GetType() const override {
+    return MessageType::QueryResponseBatchCompressed;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<QueryResponseBatchCompressed>
+  Decode(const uint8_t *data, size_t length);
+
+  /// Decode without copying or throwing; compressed_data points into the
+  /// input
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length, uint8_t *codec,
+                         int64_t *uncompressed_length,
+                         const uint8_t **compressed_data,
+                         size_t *compressed_size, const char **error);
+};
+
+// A whole Arrow IPC batch the server wrote into the attached shared memory
+// region. The range stays the client's until it is released.
+struct QueryResponseBatchShared : public Message {
+  int64_t offset = 0; // From the start of the region
+  int64_t length = 0;
+
+  MessageType GetType() const override {
+    return MessageType::QueryResponseBatchShared;
+  }
+  std::vector<uint8_t> Encode() const override;
+
+  static std::unique_ptr<QueryResponseBatchShared> Decode(const uint8_t *data,
+                                                          size_t length);
+
+  /// Decode without allocating or throwing
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length, int64_t *offset,
+                         int64_t *batch_length, const char **error);
+};
+
+// Sent once after the handshake, with the region's memfd attached
+// (SCM_RIGHTS); the server maps it to write result batches into.
+// Unanswered: a server that cannot map it sends every batch inline.
+struct SharedMemoryAttach : public Message {
+  int64_t size = 0; // Bytes of the region
+
+  MessageType GetType() const override {
+    return MessageType::SharedMemoryAttach;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// Hands ranges of QueryResponseBatchShared back to the server for reuse.
+// Unanswered.
+struct SharedMemoryRelease : public Message {
+  // (offset, length) of each range, as the server sent them
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+
+  MessageType GetType() const override {
+    return MessageType::SharedMemoryRelease;
+  }
+  std::vector<uint8_t> Encode() const override;
+};
+
+// How the server ran a query, so missing pre-aggregations can be found
+// from the client; -1 where the server does not know
+struct QueryDiagnostics {
+  std::string preaggregation; // The one that served the query; empty if none
+  int8_t result_cache_hit = -1; // 1 if answered from the server's cache
+  int64_t planning_nanos = -1;
+  int64_t execution_nanos = -1;
+  int64_t serialization_nanos = -1; // Turning the result into Arrow IPC
+  int64_t bytes_produced = -1;      // Arrow IPC bytes of the result
 };
 
 struct QueryComplete : public Message {
   int64_t rows_affected;
+  // Only sent when set, after the row count (CAPABILITY_QUERY_DIAGNOSTICS)
+  std::optional<QueryDiagnostics> diagnostics;
 
   MessageType GetType() const override { return MessageType::QueryComplete; }
   std::vector<uint8_t> Encode() const override;
 
   static std::unique_ptr<QueryComplete> Decode(const uint8_t *data,
                                                size_t length);
+
+  /// Decode without throwing, and without allocating unless diagnostics
+  /// are sent and wanted
+  /// @param diagnostics Set when the message carries them; may be null
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length,
+                         int64_t *rows_affected, const char **error,
+                         std::optional<QueryDiagnostics> *diagnostics =
+                             nullptr);
 };
 
+// ErrorMessage code of a query rejected under
+// QUERY_FLAG_REQUIRE_PREAGGREGATION
+constexpr std::string_view ERROR_CODE_NO_PREAGGREGATION = "NO_PREAGGREGATION";
+
+// ErrorMessage code of a request naming a prepared statement that was
+// planned against an earlier version of the data model. The server has
+// freed the statement; the client prepares the query again or sends it as
+// text.
+constexpr std::string_view ERROR_CODE_STALE_STATEMENT = "STALE_STATEMENT";
+
 struct ErrorMessage : public Message {
   std::string code;
   std::string message;
@@ -122,6 +880,13 @@ struct ErrorMessage : public Message {
 
   static std::unique_ptr<ErrorMessage> Decode(const uint8_t *data,
                                               size_t length);
+
+  /// Decode without copying or throwing; code and message point into the
+  /// input
+  /// @return false, with error set, if the payload is malformed
+  static bool DecodeView(const uint8_t *data, size_t length,
+                         std::string_view *code, std::string_view *message,
+                         const char **error);
 };
 
 // Helper functions for encoding/decoding
@@ -137,6 +902,19 @@ public:
   static void PutBytes(std::vector<uint8_t> &buf,
                        const std::vector<uint8_t> &bytes);
 
+  // Length prefix and message type
+  static constexpr size_t kFrameHeaderSize = 5;
+  // Bytes PutString writes for str
+  static size_t StringSize(const std::string &str) { return 4 + str.size(); }
+  // Start a frame of the given type, reserving room for fields_size bytes
+  // of fields after the type so they are appended without reallocating
+  static void BeginFrame(std::vector<uint8_t> &buf, MessageType type,
+                         size_t fields_size);
+  // Fill in the length prefix of the frame started at the front of buf by
+  // BeginFrame; extra counts bytes of the frame sent outside buf
+  static void EndFrame(std::vector<uint8_t> &buf, size_t extra = 0);
+  static void StoreU32(uint8_t *out, uint32_t value);
+
   // Decode helpers
   static uint32_t GetU32(const uint8_t *&ptr, const uint8_t *end);
   static int64_t GetI64(const uint8_t *&ptr, const uint8_t *end);
@@ -144,6 +922,115 @@ public:
   static std::string GetString(const uint8_t *&ptr, const uint8_t *end);
   static std::string GetOptionalString(const uint8_t *&ptr, const uint8_t *end);
   static std::vector<uint8_t> GetBytes(const uint8_t *&ptr, const uint8_t *end);
+  // Returns a pointer into the input instead of copying
+  static const uint8_t *GetBytesView(const uint8_t *&ptr, const uint8_t *end,
+                                     size_t *length);
+};
+
+// Bounds-checked reads from a received payload that neither throw nor
+// copy: strings and bytes are views into the payload, valid as long as it
+// is. The first read past the end fails the reader, and every read after
+// it returns zero or an empty view, so a decoder checks ok() once after
+// its last read. The MessageCodec::Get helpers are this reader throwing on
+// failure.
+class MessageReader {
+public:
+  MessageReader(const uint8_t *data, size_t length)
+      : ptr_(data), end_(data + length) {}
+
+  // Read the message type, failing with error unless it is type
+  bool ExpectType(MessageType type, const char *error) {
+    if (U8() != static_cast<uint8_t>(type) && ok()) {
+      Fail(error);
+    }
+    return ok();
+  }
+
+  uint8_t U8() {
+    if (!Have(1, "Insufficient data for U8")) {
+      return 0;
+    }
+    return *ptr_++;
+  }
+
+  uint32_t U32() {
+    if (!Have(4, "Insufficient data for U32")) {
+      return 0;
+    }
+    uint32_t value = (uint32_t(ptr_[0]) << 24) | (uint32_t(ptr_[1]) << 16) |
+                     (uint32_t(ptr_[2]) << 8) | uint32_t(ptr_[3]);
+    ptr_ += 4;
+    return value;
+  }
+
+  int64_t I64() {
+    if (!Have(8, "Insufficient data for I64")) {
+      return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | ptr_[i];
+    }
+    ptr_ += 8;
+    return static_cast<int64_t>(value);
+  }
+
+  std::string_view String() {
+    size_t length = 0;
+    const uint8_t *data = Sized(&length, "Insufficient data for string");
+    return std::string_view(reinterpret_cast<const char *>(data), length);
+  }
+
+  std::string_view OptionalString() {
+    return U8() != 0 ? String() : std::string_view();
+  }
+
+  // Length-prefixed bytes, as a pointer into the payload
+  const uint8_t *Bytes(size_t *length) {
+    return Sized(length, "Insufficient data for bytes");
+  }
+
+  bool ok() const { return error_ == nullptr; }
+  // What the first failed read was missing, or nullptr
+  const char *error() const { return error_; }
+  // Next byte to read; the end once the reader has failed
+  const uint8_t *position() const { return ptr_; }
+  bool AtEnd() const { return ptr_ == end_; }
+
+  void Fail(const char *error) {
+    if (!error_) {
+      error_ = error;
+    }
+    ptr_ = end_;
+  }
+
+private:
+  bool Have(size_t n, const char *error) {
+    if (error_) {
+      return false;
+    }
+    if (n > static_cast<size_t>(end_ - ptr_)) {
+      Fail(error);
+      return false;
+    }
+    return true;
+  }
+
+  const uint8_t *Sized(size_t *length, const char *error) {
+    uint32_t size = U32();
+    *length = 0;
+    if (!Have(size, error)) {
+      return nullptr;
+    }
+    const uint8_t *data = ptr_;
+    ptr_ += size;
+    *length = size;
+    return data;
+  }
+
+  const uint8_t *ptr_;
+  const uint8_t *end_;
+  const char *error_ = nullptr;
 };
 
 } // namespace adbc::cube
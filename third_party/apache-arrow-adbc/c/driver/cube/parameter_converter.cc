@@ -15,355 +15,301 @@
 // specific language governing permissions and limitations
 // under the License.
 
-#include <cmath>
-#include <cstring>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
-
 #include "driver/cube/parameter_converter.h"
 
+#include <cstring>
+#include <limits>
+
 namespace adbc::cube {
 
 namespace {
 
-// Helper to format dates as YYYY-MM-DD
-std::string FormatDate(int32_t days_since_epoch) {
-  // Unix epoch is 1970-01-01
-  // But Arrow uses 1970-01-01 as day 0
-  int64_t total_days = days_since_epoch;
-
-  // Simplified: convert to year/month/day
-  // Real implementation would use proper calendar math
-  int year = 1970;
-  int month = 1;
-  int day = 1;
-
-  // Add days to epoch date
-  int remaining_days = total_days;
-
-  // Count years
-  while (remaining_days >= 365) {
-    int days_in_year =
-        (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 366 : 365;
-    if (remaining_days >= days_in_year) {
-      remaining_days -= days_in_year;
-      year++;
-    } else {
-      break;
-    }
-  }
-
-  // Count months
-  const int days_in_month[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-  bool is_leap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
-
-  for (int m = 0; m < 12; m++) {
-    int days = days_in_month[m];
-    if (m == 1 && is_leap)
-      days = 29;
-
-    if (remaining_days >= days) {
-      remaining_days -= days;
-      month++;
-    } else {
-      day = remaining_days + 1;
-      break;
-    }
-  }
-
-  std::ostringstream oss;
-  oss << std::setfill('0') << std::setw(4) << year << "-" << std::setw(2)
-      << month << "-" << std::setw(2) << day;
-  return oss.str();
-}
-
-// Helper to format timestamps as ISO 8601
-std::string FormatTimestamp(int64_t micros_since_epoch) {
-  // Convert microseconds to seconds and fractional part
-  int64_t seconds = micros_since_epoch / 1000000;
-  int32_t micros = micros_since_epoch % 1000000;
-
-  // Get date from seconds (similar to FormatDate but with time)
-  // Simplified version
-  time_t t = seconds;
-  struct tm tm_result = {};
-
-#ifdef _WIN32
-  gmtime_s(&tm_result, &t);
-#else
-  gmtime_r(&t, &tm_result);
-#endif
-
-  std::ostringstream oss;
-  oss << std::setfill('0') << std::setw(4) << (tm_result.tm_year + 1900) << "-"
-      << std::setw(2) << (tm_result.tm_mon + 1) << "-" << std::setw(2)
-      << tm_result.tm_mday << "T" << std::setw(2) << tm_result.tm_hour << ":"
-      << std::setw(2) << tm_result.tm_min << ":" << std::setw(2)
-      << tm_result.tm_sec << "." << std::setw(6) << micros;
-  return oss.str();
-}
-
-} // namespace
-
-ParameterConverter::ParameterConverter() {}
-
-ParameterConverter::~ParameterConverter() {}
-
-bool ParameterConverter::IsValueNull(const ArrowArray *array, int64_t row) {
-  if (!array->buffers[0]) {
-    // No validity buffer = no nulls
+// Type OIDs parameters are sent as (pg_type.h)
+constexpr Oid kUnknownOid = 0;
+constexpr Oid kBoolOid = 16;
+constexpr Oid kByteaOid = 17;
+constexpr Oid kInt8Oid = 20;
+constexpr Oid kInt2Oid = 21;
+constexpr Oid kInt4Oid = 23;
+constexpr Oid kTextOid = 25;
+constexpr Oid kFloat4Oid = 700;
+constexpr Oid kFloat8Oid = 701;
+constexpr Oid kDateOid = 1082;
+constexpr Oid kTimeOid = 1083;
+constexpr Oid kTimestampOid = 1114;
+constexpr Oid kTimestampTzOid = 1184;
+
+// PostgreSQL counts days and microseconds from 2000-01-01
+constexpr int64_t kPostgresEpochDays = 10957;
+constexpr int64_t kPostgresEpochMicros = kPostgresEpochDays * 86400 * 1000000;
+
+bool IsIntegerType(ArrowType type) {
+  switch (type) {
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+    return true;
+  default:
     return false;
   }
-
-  const uint8_t *validity_bitmap =
-      static_cast<const uint8_t *>(array->buffers[0]);
-  int64_t byte_index = row / 8;
-  int64_t bit_index = row % 8;
-
-  return !(validity_bitmap[byte_index] & (1 << bit_index));
-}
-
-std::string ParameterConverter::ConvertInt8(const ArrowArray *array,
-                                            int64_t row) {
-  const int8_t *data = static_cast<const int8_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertInt16(const ArrowArray *array,
-                                             int64_t row) {
-  const int16_t *data = static_cast<const int16_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertInt32(const ArrowArray *array,
-                                             int64_t row) {
-  const int32_t *data = static_cast<const int32_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertInt64(const ArrowArray *array,
-                                             int64_t row) {
-  const int64_t *data = static_cast<const int64_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertUInt8(const ArrowArray *array,
-                                             int64_t row) {
-  const uint8_t *data = static_cast<const uint8_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertUInt16(const ArrowArray *array,
-                                              int64_t row) {
-  const uint16_t *data = static_cast<const uint16_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertUInt32(const ArrowArray *array,
-                                              int64_t row) {
-  const uint32_t *data = static_cast<const uint32_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
 }
 
-std::string ParameterConverter::ConvertUInt64(const ArrowArray *array,
-                                              int64_t row) {
-  const uint64_t *data = static_cast<const uint64_t *>(array->buffers[1]);
-  return std::to_string(data[row]);
-}
-
-std::string ParameterConverter::ConvertFloat(const ArrowArray *array,
-                                             int64_t row) {
-  const float *data = static_cast<const float *>(array->buffers[1]);
-  std::ostringstream oss;
-  oss << std::fixed << std::setprecision(6) << data[row];
-  return oss.str();
-}
-
-std::string ParameterConverter::ConvertDouble(const ArrowArray *array,
-                                              int64_t row) {
-  const double *data = static_cast<const double *>(array->buffers[1]);
-  std::ostringstream oss;
-  oss << std::fixed << std::setprecision(15) << data[row];
-  return oss.str();
-}
-
-std::string ParameterConverter::ConvertString(const ArrowArray *array,
-                                              int64_t row) {
-  // For large strings, buffer[1] contains offsets, buffer[2] contains data
-  const int32_t *offsets = static_cast<const int32_t *>(array->buffers[1]);
-  const char *data = static_cast<const char *>(array->buffers[2]);
-
-  int32_t start_offset = offsets[row];
-  int32_t end_offset = offsets[row + 1];
-  int32_t length = end_offset - start_offset;
-
-  return std::string(data + start_offset, length);
-}
-
-std::string ParameterConverter::ConvertBinary(const ArrowArray *array,
-                                              int64_t row) {
-  // Similar to string but binary data
-  const int32_t *offsets = static_cast<const int32_t *>(array->buffers[1]);
-  const uint8_t *data = static_cast<const uint8_t *>(array->buffers[2]);
-
-  int32_t start_offset = offsets[row];
-  int32_t end_offset = offsets[row + 1];
-  int32_t length = end_offset - start_offset;
-
-  // Convert binary to hex string for PostgreSQL
-  std::ostringstream oss;
-  oss << "\\x";
-  for (int32_t i = 0; i < length; i++) {
-    oss << std::setfill('0') << std::setw(2) << std::hex
-        << data[start_offset + i];
+// Type a column is sent as when the server gave none; 0 if unsupported
+Oid NaturalOid(const ArrowSchemaView &view) {
+  switch (view.type) {
+  case NANOARROW_TYPE_NA:
+    return kUnknownOid;
+  case NANOARROW_TYPE_BOOL:
+    return kBoolOid;
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_UINT8:
+    return kInt2Oid;
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_UINT16:
+    return kInt4Oid;
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+    return kInt8Oid;
+  case NANOARROW_TYPE_FLOAT:
+    return kFloat4Oid;
+  case NANOARROW_TYPE_DOUBLE:
+    return kFloat8Oid;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+    return kTextOid;
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    return kByteaOid;
+  case NANOARROW_TYPE_DATE32:
+  case NANOARROW_TYPE_DATE64:
+    return kDateOid;
+  case NANOARROW_TYPE_TIME32:
+  case NANOARROW_TYPE_TIME64:
+    return kTimeOid;
+  case NANOARROW_TYPE_TIMESTAMP:
+    return view.timezone && view.timezone[0] ? kTimestampTzOid
+                                             : kTimestampOid;
+  default:
+    return kUnknownOid;
   }
-  return oss.str();
 }
 
-std::string ParameterConverter::ConvertBool(const ArrowArray *array,
-                                            int64_t row) {
-  const uint8_t *data = static_cast<const uint8_t *>(array->buffers[1]);
-  int64_t byte_index = row / 8;
-  int64_t bit_index = row % 8;
-
-  bool value = (data[byte_index] & (1 << bit_index)) != 0;
-  return value ? "true" : "false";
+int64_t MicrosPerUnit(ArrowTimeUnit unit) {
+  switch (unit) {
+  case NANOARROW_TIME_UNIT_SECOND:
+    return 1000000;
+  case NANOARROW_TIME_UNIT_MILLI:
+    return 1000;
+  default:
+    return 1;
+  }
 }
 
-std::string ParameterConverter::ConvertDate32(const ArrowArray *array,
-                                              int64_t row) {
-  const int32_t *data = static_cast<const int32_t *>(array->buffers[1]);
-  return FormatDate(data[row]);
+// A time or timestamp value in microseconds, truncating nanoseconds
+int64_t ToMicros(int64_t value, ArrowTimeUnit unit) {
+  if (unit == NANOARROW_TIME_UNIT_NANO) {
+    return value / 1000 - (value % 1000 < 0 ? 1 : 0);
+  }
+  return value * MicrosPerUnit(unit);
 }
 
-std::string ParameterConverter::ConvertDate64(const ArrowArray *array,
-                                              int64_t row) {
-  const int64_t *data = static_cast<const int64_t *>(array->buffers[1]);
-  // Date64 is milliseconds since epoch
-  return FormatDate(data[row] / 86400000); // ms to days
+void AppendBE(std::string *data, uint64_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    data->push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+  }
 }
 
-std::string ParameterConverter::ConvertTime64(const ArrowArray *array,
-                                              int64_t row) {
-  const int64_t *data = static_cast<const int64_t *>(array->buffers[1]);
+} // namespace
 
-  // Convert microseconds to HH:MM:SS.FFFFFF
-  int64_t micros = data[row];
-  int32_t hours = (micros / 3600000000LL) % 24;
-  int32_t minutes = (micros / 60000000LL) % 60;
-  int32_t seconds = (micros / 1000000LL) % 60;
-  int32_t microseconds = micros % 1000000;
+ArrowErrorCode ParameterConverter::Init(const ArrowSchema *schema,
+                                        const ArrowArray *array,
+                                        const std::vector<Oid> &target_types,
+                                        ArrowError *error) {
+  view_.reset();
+  columns_.clear();
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayViewInitFromSchema(view_.get(), schema, error));
+  NANOARROW_RETURN_NOT_OK(ArrowArrayViewSetArray(view_.get(), array, error));
+  if (view_->storage_type != NANOARROW_TYPE_STRUCT) {
+    ArrowErrorSet(error, "Parameters must be a struct array");
+    return EINVAL;
+  }
+  if (!target_types.empty() &&
+      target_types.size() != static_cast<size_t>(schema->n_children)) {
+    ArrowErrorSet(error, "Statement takes %d parameters, %lld are bound",
+                  static_cast<int>(target_types.size()),
+                  static_cast<long long>(schema->n_children));
+    return EINVAL;
+  }
 
-  std::ostringstream oss;
-  oss << std::setfill('0') << std::setw(2) << hours << ":" << std::setw(2)
-      << minutes << ":" << std::setw(2) << seconds << "." << std::setw(6)
-      << microseconds;
-  return oss.str();
+  for (int64_t i = 0; i < schema->n_children; i++) {
+    ArrowSchemaView child;
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSchemaViewInit(&child, schema->children[i], error));
+    Oid oid = NaturalOid(child);
+    if (oid == kUnknownOid && child.type != NANOARROW_TYPE_NA) {
+      ArrowErrorSet(error, "Cannot send a %s column as a parameter",
+                    ArrowTypeString(child.type));
+      return ENOTSUP;
+    }
+    Oid target = target_types.empty() ? kUnknownOid : target_types[i];
+    bool is_integer = IsIntegerType(child.type);
+    bool is_float = child.type == NANOARROW_TYPE_FLOAT ||
+                    child.type == NANOARROW_TYPE_DOUBLE;
+    if ((is_integer &&
+         (target == kInt2Oid || target == kInt4Oid || target == kInt8Oid)) ||
+        ((is_integer || is_float) &&
+         (target == kFloat4Oid || target == kFloat8Oid))) {
+      oid = target;
+    }
+    columns_.push_back({oid, child.time_unit});
+  }
+  return NANOARROW_OK;
 }
 
-std::string ParameterConverter::ConvertTimestamp(const ArrowArray *array,
-                                                 int64_t row,
-                                                 const ArrowSchema *schema) {
-  const int64_t *data = static_cast<const int64_t *>(array->buffers[1]);
-
-  // Get the time unit from schema
-  // For now, assume microseconds (most common)
-  return FormatTimestamp(data[row]);
+PostgresParams PostgresParamArena::Row(int64_t row) const {
+  PostgresParams params;
+  params.count = static_cast<int>(types.size());
+  size_t first = static_cast<size_t>(row) * types.size();
+  params.types = types.data();
+  params.values = values.data() + first;
+  params.lengths = lengths.data() + first;
+  params.formats = formats.data();
+  return params;
 }
 
-std::string ParameterConverter::ConvertArrowValue(const ArrowArray *array,
-                                                  int64_t row,
-                                                  const ArrowSchema *schema,
-                                                  bool *is_null) {
-  *is_null = IsValueNull(array, row);
-
-  if (*is_null) {
-    return "";
+ArrowErrorCode ParameterConverter::Convert(PostgresParamArena *out,
+                                           ArrowError *error) {
+  size_t n = columns_.size();
+  auto rows = static_cast<size_t>(view_->length);
+  out->types.resize(n);
+  out->formats.assign(n, 1);
+  out->data.clear();
+  out->values.assign(rows * n, nullptr);
+  out->lengths.assign(rows * n, -1);
+  for (size_t i = 0; i < n; i++) {
+    out->types[i] = columns_[i].oid;
   }
 
-  // Route based on Arrow type
-  switch (schema->format[0]) {
-  case 'c': // int8
-    return ConvertInt8(array, row);
-  case 's': // int16
-    return ConvertInt16(array, row);
-  case 'i': // int32
-    return ConvertInt32(array, row);
-  case 'l': // int64
-    return ConvertInt64(array, row);
-  case 'C': // uint8
-    return ConvertUInt8(array, row);
-  case 'S': // uint16
-    return ConvertUInt16(array, row);
-  case 'I': // uint32
-    return ConvertUInt32(array, row);
-  case 'L': // uint64
-    return ConvertUInt64(array, row);
-  case 'f': // float
-    return ConvertFloat(array, row);
-  case 'g': // double
-    return ConvertDouble(array, row);
-  case 'u': // utf8 string
-  case 'U': // large utf8 string
-    return ConvertString(array, row);
-  case 'z': // binary
-  case 'Z': // large binary
-    return ConvertBinary(array, row);
-  case 'b': // bool
-    return ConvertBool(array, row);
-  case 'd': // date (check precision)
-    if (schema->format[1] == 'D') {
-      return ConvertDate32(array, row); // Date32
-    } else {
-      return ConvertDate64(array, row); // Date64
+  // Values are appended back to back, a length of -1 marking a NULL, and
+  // pointed to once data stops growing
+  for (size_t row = 0; row < rows; row++) {
+    for (size_t i = 0; i < n; i++) {
+      const ArrowArrayView *child = view_->children[i];
+      if (ArrowArrayViewIsNull(child, static_cast<int64_t>(row))) {
+        continue;
+      }
+      size_t start = out->data.size();
+      NANOARROW_RETURN_NOT_OK(AppendValue(child, columns_[i],
+                                          static_cast<int64_t>(row),
+                                          &out->data, error));
+      out->lengths[row * n + i] = static_cast<int>(out->data.size() - start);
     }
-  case 't': // time (check precision)
-    if (schema->format[1] == 't') {
-      return ConvertTime64(array, row);
+  }
+  const char *value = out->data.data();
+  for (size_t k = 0; k < out->lengths.size(); k++) {
+    if (out->lengths[k] < 0) {
+      out->lengths[k] = 0;
+    } else {
+      out->values[k] = value;
+      value += out->lengths[k];
     }
-    break;
-  case 'T': // timestamp
-    return ConvertTimestamp(array, row, schema);
   }
-
-  // Fallback for unknown types
-  return "";
+  return NANOARROW_OK;
 }
 
-std::vector<std::string>
-ParameterConverter::ConvertArrowArrayToParams(const ArrowArray *values,
-                                              const ArrowSchema *schema) {
-  std::vector<std::string> result;
-
-  if (!values || !schema) {
-    return result;
+ArrowErrorCode ParameterConverter::AppendValue(const ArrowArrayView *view,
+                                               const Column &column,
+                                               int64_t row, std::string *data,
+                                               ArrowError *error) {
+  ArrowType type = view->storage_type;
+  switch (column.oid) {
+  case kBoolOid:
+    data->push_back(ArrowArrayViewGetIntUnsafe(view, row) ? 1 : 0);
+    return NANOARROW_OK;
+  case kInt2Oid:
+  case kInt4Oid:
+  case kInt8Oid: {
+    int64_t value;
+    if (type == NANOARROW_TYPE_UINT64) {
+      uint64_t unsigned_value = ArrowArrayViewGetUIntUnsafe(view, row);
+      if (unsigned_value >
+          static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+        ArrowErrorSet(error, "Parameter value %llu is out of range for int8",
+                      static_cast<unsigned long long>(unsigned_value));
+        return ERANGE;
+      }
+      value = static_cast<int64_t>(unsigned_value);
+    } else {
+      value = ArrowArrayViewGetIntUnsafe(view, row);
+    }
+    int bytes = column.oid == kInt2Oid ? 2 : column.oid == kInt4Oid ? 4 : 8;
+    if (bytes < 8) {
+      int64_t limit = (int64_t{1} << (bytes * 8 - 1));
+      if (value < -limit || value >= limit) {
+        ArrowErrorSet(error, "Parameter value %lld is out of range for int%d",
+                      static_cast<long long>(value), bytes);
+        return ERANGE;
+      }
+    }
+    AppendBE(data, static_cast<uint64_t>(value), bytes);
+    return NANOARROW_OK;
   }
-
-  for (int64_t row = 0; row < values->length; row++) {
-    bool is_null = false;
-    std::string param_value = ConvertArrowValue(values, row, schema, &is_null);
-    result.push_back(param_value);
+  case kFloat4Oid: {
+    float value = static_cast<float>(ArrowArrayViewGetDoubleUnsafe(view, row));
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    AppendBE(data, bits, 4);
+    return NANOARROW_OK;
   }
-
-  return result;
-}
-
-const char **ParameterConverter::GetParamValuesCArray(
-    const std::vector<std::string> &param_values) {
-  if (param_values.empty()) {
-    return nullptr;
+  case kFloat8Oid: {
+    double value = ArrowArrayViewGetDoubleUnsafe(view, row);
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    AppendBE(data, bits, 8);
+    return NANOARROW_OK;
   }
-
-  // Allocate C array of string pointers
-  char **result =
-      static_cast<char **>(malloc(param_values.size() * sizeof(char *)));
-
-  for (size_t i = 0; i < param_values.size(); i++) {
-    result[i] = const_cast<char *>(param_values[i].c_str());
+  case kTextOid:
+  case kByteaOid: {
+    // The binary format of text and bytea is the bytes themselves
+    ArrowBufferView bytes = ArrowArrayViewGetBytesUnsafe(view, row);
+    data->append(bytes.data.as_char, static_cast<size_t>(bytes.size_bytes));
+    return NANOARROW_OK;
+  }
+  case kDateOid: {
+    int64_t days = ArrowArrayViewGetIntUnsafe(view, row);
+    if (type == NANOARROW_TYPE_DATE64) {
+      days = days / 86400000 - (days % 86400000 < 0 ? 1 : 0);
+    }
+    AppendBE(data, static_cast<uint64_t>(days - kPostgresEpochDays), 4);
+    return NANOARROW_OK;
+  }
+  case kTimeOid: {
+    int64_t micros =
+        ToMicros(ArrowArrayViewGetIntUnsafe(view, row), column.unit);
+    AppendBE(data, static_cast<uint64_t>(micros), 8);
+    return NANOARROW_OK;
+  }
+  case kTimestampOid:
+  case kTimestampTzOid: {
+    int64_t micros =
+        ToMicros(ArrowArrayViewGetIntUnsafe(view, row), column.unit);
+    AppendBE(data, static_cast<uint64_t>(micros - kPostgresEpochMicros), 8);
+    return NANOARROW_OK;
+  }
+  default:
+    ArrowErrorSet(error, "Cannot send a %s value as a parameter",
+                  ArrowTypeString(type));
+    return ENOTSUP;
   }
-
-  return const_cast<const char **>(result);
 }
 
 } // namespace adbc::cube
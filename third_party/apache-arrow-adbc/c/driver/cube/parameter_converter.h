@@ -21,59 +21,78 @@
 #include <string>
 #include <vector>
 
+// Try to include real libpq, fall back to compatibility header
+#ifdef __has_include
+#if __has_include(<libpq-fe.h>)
+#include <libpq-fe.h>
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+
 #include <arrow-adbc/adbc.h>
-#include <nanoarrow/nanoarrow.h>
+#include <nanoarrow/nanoarrow.hpp>
 
 namespace adbc::cube {
 
-// Helper class to convert Arrow arrays to PostgreSQL parameter format
-// Converts Arrow values to text strings for use with PQexecParams()
+// Parameters of one execution in PostgreSQL binary format, laid out as
+// PQsendQueryParams and PQsendQueryPrepared take them. Points into the
+// PostgresParamArena of its batch.
+struct PostgresParams {
+  int count = 0;
+  const Oid *types = nullptr;
+  const char *const *values = nullptr; // nullptr for NULL
+  const int *lengths = nullptr;
+  const int *formats = nullptr; // All 1 (binary)
+};
+
+// Every row of a parameter batch in PostgreSQL binary format: the values
+// back to back in one buffer, with a pointer and a length per value, row
+// after row. Nothing is allocated per row, and encoding another batch into
+// the same arena reuses its capacity.
+struct PostgresParamArena {
+  std::vector<Oid> types;   // One per parameter
+  std::vector<int> formats; // One per parameter
+  std::string data;
+  std::vector<const char *> values; // nullptr for NULL; points into data
+  std::vector<int> lengths;
+
+  // Parameters of one row; valid while the arena is neither changed nor
+  // destroyed
+  PostgresParams Row(int64_t row) const;
+};
+
+// Encodes rows of a bound parameter batch (a struct array, one child per
+// parameter) as binary PostgreSQL parameters, so no value is formatted as
+// text. Integers, floats, booleans, strings, binary, dates, times and
+// timestamps are supported.
 class ParameterConverter {
 public:
-  ParameterConverter();
-  ~ParameterConverter();
+  // Set the batch to convert. target_types, when not empty, are the
+  // parameter types the server chose when the statement was prepared;
+  // integer and floating-point columns are converted to them.
+  ArrowErrorCode Init(const ArrowSchema *schema, const ArrowArray *array,
+                      const std::vector<Oid> &target_types, ArrowError *error);
 
-  // Convert a single Arrow value to PostgreSQL text format
-  // Returns the text representation, or empty string for NULL values
-  // Sets is_null to true for NULL values
-  static std::string ConvertArrowValue(const ArrowArray *array, int64_t row,
-                                       const ArrowSchema *schema,
-                                       bool *is_null);
+  int64_t num_rows() const { return view_->length; }
 
-  // Convert Arrow array to vector of PostgreSQL parameter strings
-  // Returns parameter values and nullness flags for use with PQexecParams
-  static std::vector<std::string>
-  ConvertArrowArrayToParams(const ArrowArray *values,
-                            const ArrowSchema *schema);
-
-  // Get the C-style parameter values array for PQexecParams
-  // Should be freed with free() after use
-  static const char **
-  GetParamValuesCArray(const std::vector<std::string> &param_values);
+  // Encode every row of the batch into out, replacing what it held
+  ArrowErrorCode Convert(PostgresParamArena *out, ArrowError *error);
 
 private:
-  // Type-specific converters
-  static std::string ConvertInt8(const ArrowArray *array, int64_t row);
-  static std::string ConvertInt16(const ArrowArray *array, int64_t row);
-  static std::string ConvertInt32(const ArrowArray *array, int64_t row);
-  static std::string ConvertInt64(const ArrowArray *array, int64_t row);
-  static std::string ConvertUInt8(const ArrowArray *array, int64_t row);
-  static std::string ConvertUInt16(const ArrowArray *array, int64_t row);
-  static std::string ConvertUInt32(const ArrowArray *array, int64_t row);
-  static std::string ConvertUInt64(const ArrowArray *array, int64_t row);
-  static std::string ConvertFloat(const ArrowArray *array, int64_t row);
-  static std::string ConvertDouble(const ArrowArray *array, int64_t row);
-  static std::string ConvertString(const ArrowArray *array, int64_t row);
-  static std::string ConvertBinary(const ArrowArray *array, int64_t row);
-  static std::string ConvertBool(const ArrowArray *array, int64_t row);
-  static std::string ConvertDate32(const ArrowArray *array, int64_t row);
-  static std::string ConvertDate64(const ArrowArray *array, int64_t row);
-  static std::string ConvertTime64(const ArrowArray *array, int64_t row);
-  static std::string ConvertTimestamp(const ArrowArray *array, int64_t row,
-                                      const ArrowSchema *schema);
+  struct Column {
+    Oid oid;            // Type the value is sent as
+    ArrowTimeUnit unit; // Time and timestamp columns
+  };
+
+  ArrowErrorCode AppendValue(const ArrowArrayView *view, const Column &column,
+                             int64_t row, std::string *data,
+                             ArrowError *error);
 
-  // Helper to check if value is NULL
-  static bool IsValueNull(const ArrowArray *array, int64_t row);
+  nanoarrow::UniqueArrayView view_;
+  std::vector<Column> columns_;
 };
 
 } // namespace adbc::cube
@@ -0,0 +1,1123 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/parquet_export.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+namespace {
+
+// Values from parquet.thrift
+enum PhysicalType : int32_t {
+  kBoolean = 0,
+  kInt32 = 1,
+  kInt64 = 2,
+  kFloat = 4,
+  kDouble = 5,
+  kByteArray = 6,
+  kFixedLenByteArray = 7,
+};
+
+enum ConvertedType : int32_t {
+  kNoConvertedType = -1,
+  kUtf8 = 0,
+  kDecimal = 5,
+  kDate = 6,
+  kTimeMillis = 7,
+  kTimeMicros = 8,
+  kTimestampMillis = 9,
+  kTimestampMicros = 10,
+  kUint8 = 11,
+  kUint16 = 12,
+  kUint32 = 13,
+  kUint64 = 14,
+  kInt8 = 15,
+  kInt16 = 16,
+};
+
+// Field ids of the LogicalType union
+enum LogicalType : int16_t {
+  kNoLogicalType = 0,
+  kStringType = 1,
+  kDecimalType = 5,
+  kDateType = 6,
+  kTimeType = 7,
+  kTimestampType = 8,
+  kIntType = 10,
+};
+
+// Field ids of the TimeUnit union
+enum TimeUnit : int16_t {
+  kMillis = 1,
+  kMicros = 2,
+  kNanos = 3,
+};
+
+constexpr int32_t kEncodingPlain = 0;
+constexpr int32_t kEncodingRle = 3;
+constexpr int32_t kEncodingRleDictionary = 8;
+constexpr int32_t kPageData = 0;
+constexpr int32_t kPageDictionary = 2;
+constexpr int32_t kRepetitionOptional = 1;
+constexpr int32_t kCodecUncompressed = 0;
+constexpr int32_t kCodecZstd = 6;
+
+constexpr uint8_t kMagic[4] = {'P', 'A', 'R', '1'};
+// Data pages are cut once their plain values reach this size
+constexpr size_t kPageBytes = 1 << 20;
+// A chunk is dictionary encoded only if its dictionary fits in this
+constexpr size_t kMaxDictionaryBytes = 1 << 20;
+// A row group is written early once its values reach this size
+constexpr size_t kMaxRowGroupBytes = size_t{256} << 20;
+// Output is written once this much has been encoded
+constexpr size_t kWriteBytes = 1 << 20;
+// Batches read ahead of the writer thread
+constexpr size_t kQueuedBatches = 4;
+
+// Encoder for the Thrift compact protocol the Parquet footer and page
+// headers use
+class ThriftWriter {
+public:
+  enum Type : uint8_t {
+    kTrue = 1,
+    kFalse = 2,
+    kByte = 3,
+    kI32 = 5,
+    kI64 = 6,
+    kBinary = 8,
+    kList = 9,
+    kStruct = 12,
+  };
+
+  std::vector<uint8_t> &data() { return out_; }
+
+  void BeginStruct() {
+    last_ids_.push_back(last_id_);
+    last_id_ = 0;
+  }
+  void EndStruct() {
+    out_.push_back(0);
+    last_id_ = last_ids_.back();
+    last_ids_.pop_back();
+  }
+
+  void FieldBool(int16_t id, bool value) { Header(id, value ? kTrue : kFalse); }
+  void FieldByte(int16_t id, int8_t value) {
+    Header(id, kByte);
+    out_.push_back(static_cast<uint8_t>(value));
+  }
+  void FieldI32(int16_t id, int32_t value) {
+    Header(id, kI32);
+    I32(value);
+  }
+  void FieldI64(int16_t id, int64_t value) {
+    Header(id, kI64);
+    Varint((static_cast<uint64_t>(value) << 1) ^
+           static_cast<uint64_t>(value >> 63));
+  }
+  void FieldBinary(int16_t id, std::string_view value) {
+    Header(id, kBinary);
+    Binary(value);
+  }
+  // Followed by the struct's fields and EndStruct
+  void FieldStruct(int16_t id) {
+    Header(id, kStruct);
+    BeginStruct();
+  }
+  // Followed by size elements
+  void FieldList(int16_t id, Type element, size_t size) {
+    Header(id, kList);
+    if (size < 15) {
+      out_.push_back(static_cast<uint8_t>(size << 4 | element));
+    } else {
+      out_.push_back(0xF0 | element);
+      Varint(size);
+    }
+  }
+
+  void I32(int32_t value) {
+    Varint((static_cast<uint32_t>(value) << 1) ^
+           static_cast<uint32_t>(value >> 31));
+  }
+  void Binary(std::string_view value) {
+    Varint(value.size());
+    out_.insert(out_.end(), value.begin(), value.end());
+  }
+
+private:
+  void Header(int16_t id, uint8_t type) {
+    int delta = id - last_id_;
+    if (delta > 0 && delta <= 15) {
+      out_.push_back(static_cast<uint8_t>(delta << 4 | type));
+    } else {
+      out_.push_back(type);
+      I32(id);
+    }
+    last_id_ = id;
+  }
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      out_.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out_.push_back(static_cast<uint8_t>(value));
+  }
+
+  std::vector<uint8_t> out_;
+  int16_t last_id_ = 0;
+  std::vector<int16_t> last_ids_;
+};
+
+void AppendU32(std::vector<uint8_t> *out, uint32_t value) {
+  uint8_t bytes[4] = {static_cast<uint8_t>(value),
+                      static_cast<uint8_t>(value >> 8),
+                      static_cast<uint8_t>(value >> 16),
+                      static_cast<uint8_t>(value >> 24)};
+  out->insert(out->end(), bytes, bytes + 4);
+}
+
+void AppendVarint(std::vector<uint8_t> *out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+// RLE / bit-packing hybrid encoding of values of bit_width bits: runs of
+// eight or more equal values as repeated runs, the rest bit-packed in
+// groups of eight
+void EncodeHybrid(const uint32_t *values, size_t count, int bit_width,
+                  std::vector<uint8_t> *out) {
+  const int value_bytes = (bit_width + 7) / 8;
+  size_t i = 0;
+  while (i < count) {
+    size_t run = 1;
+    while (i + run < count && values[i + run] == values[i]) {
+      run++;
+    }
+    if (run >= 8) {
+      AppendVarint(out, static_cast<uint64_t>(run) << 1);
+      for (int b = 0; b < value_bytes; b++) {
+        out->push_back(static_cast<uint8_t>(values[i] >> (8 * b)));
+      }
+      i += run;
+      continue;
+    }
+
+    // Groups of eight until the next long run; the last group is padded
+    size_t start = i;
+    size_t groups = 0;
+    while (i < count && groups < 63) {
+      if (groups > 0 && i + 8 <= count &&
+          std::all_of(values + i + 1, values + i + 8,
+                      [&](uint32_t v) { return v == values[i]; })) {
+        break;
+      }
+      i = std::min(i + 8, count);
+      groups++;
+    }
+    AppendVarint(out, groups << 1 | 1);
+    uint64_t bits = 0;
+    int pending = 0;
+    for (size_t k = start; k < start + groups * 8; k++) {
+      uint64_t value = k < count ? values[k] : 0;
+      bits |= value << pending;
+      pending += bit_width;
+      while (pending >= 8) {
+        out->push_back(static_cast<uint8_t>(bits));
+        bits >>= 8;
+        pending -= 8;
+      }
+    }
+  }
+}
+
+int BitWidth(size_t max_value) {
+  int width = 1;
+  while (width < 32 && (max_value >> width) != 0) {
+    width++;
+  }
+  return width;
+}
+
+// How the values of an Arrow column become Parquet values
+enum class ValueKind {
+  Bool,
+  Int32,
+  Int64,
+  UInt64,
+  Float,
+  Double,
+  Bytes,
+  FixedBytes,
+  Decimal128,
+};
+
+// One column of the output and how it is filled
+struct ColumnSpec {
+  std::string name;
+  ValueKind kind;
+  int32_t physical_type;
+  int32_t type_length = 0; // FIXED_LEN_BYTE_ARRAY only
+  int32_t converted_type = kNoConvertedType;
+  int16_t logical_type = kNoLogicalType;
+  int8_t int_bits = 0;       // kIntType
+  bool int_signed = true;    // kIntType
+  bool utc = false;          // kTimeType, kTimestampType
+  int16_t time_unit = 0;     // kTimeType, kTimestampType
+  int32_t precision = 0;     // kDecimalType
+  int32_t scale = 0;         // kDecimalType
+  int64_t multiplier = 1;    // Applied to integer values
+  int64_t divisor = 1;       // Applied (rounding down) to integer values
+  bool dictionary = false;   // The Arrow column is dictionary encoded
+};
+
+// Values of one column of the row group being buffered
+struct ColumnBuffer {
+  std::vector<uint8_t> levels; // Definition level of each row: 0 is null
+  std::vector<uint8_t> values; // Plain values, without length prefixes
+  std::vector<size_t> ends;    // Byte arrays: end of each value in values
+  int64_t null_count = 0;
+  size_t count = 0; // Non-null values
+
+  void Clear() {
+    levels.clear();
+    values.clear();
+    ends.clear();
+    null_count = 0;
+    count = 0;
+  }
+};
+
+// Where a written column chunk is
+struct ChunkInfo {
+  int32_t physical_type;
+  bool dictionary;
+  int64_t dictionary_page_offset = -1;
+  int64_t data_page_offset = 0;
+  int64_t num_values = 0;
+  int64_t uncompressed_bytes = 0;
+  int64_t compressed_bytes = 0;
+  int64_t null_count = 0;
+};
+
+struct RowGroupInfo {
+  std::vector<ChunkInfo> chunks;
+  int64_t rows = 0;
+};
+
+ArrowErrorCode WriteToFd(int fd, const uint8_t *data, size_t size,
+                         struct ArrowError *error) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int code = errno;
+      ArrowErrorSet(error, "Failed to write Parquet file: %s",
+                    std::strerror(code));
+      return code;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  return NANOARROW_OK;
+}
+
+ArrowErrorCode MakeColumnSpec(const struct ArrowSchema *field,
+                              ColumnSpec *spec, struct ArrowError *error) {
+  spec->name = field->name ? field->name : "";
+  struct ArrowSchemaView view;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaViewInit(&view, field, error));
+  if (view.type == NANOARROW_TYPE_DICTIONARY) {
+    spec->dictionary = true;
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSchemaViewInit(&view, field->dictionary, error));
+  }
+
+  auto integer = [&](ValueKind kind, int32_t physical, int8_t bits,
+                     bool is_signed, int32_t converted) {
+    spec->kind = kind;
+    spec->physical_type = physical;
+    spec->converted_type = converted;
+    spec->logical_type = kIntType;
+    spec->int_bits = bits;
+    spec->int_signed = is_signed;
+  };
+  auto temporal = [&](ValueKind kind, int32_t physical, int16_t logical,
+                      int16_t unit, int32_t converted) {
+    spec->kind = kind;
+    spec->physical_type = physical;
+    spec->logical_type = logical;
+    spec->time_unit = unit;
+    spec->converted_type = converted;
+  };
+
+  switch (view.type) {
+  case NANOARROW_TYPE_BOOL:
+    spec->kind = ValueKind::Bool;
+    spec->physical_type = kBoolean;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_INT8:
+    integer(ValueKind::Int32, kInt32, 8, true, kInt8);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_INT16:
+    integer(ValueKind::Int32, kInt32, 16, true, kInt16);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_INT32:
+    spec->kind = ValueKind::Int32;
+    spec->physical_type = kInt32;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_DURATION:
+    spec->kind = ValueKind::Int64;
+    spec->physical_type = kInt64;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_UINT8:
+    integer(ValueKind::Int32, kInt32, 8, false, kUint8);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_UINT16:
+    integer(ValueKind::Int32, kInt32, 16, false, kUint16);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_UINT32:
+    integer(ValueKind::Int32, kInt32, 32, false, kUint32);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_UINT64:
+    integer(ValueKind::UInt64, kInt64, 64, false, kUint64);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_FLOAT:
+    spec->kind = ValueKind::Float;
+    spec->physical_type = kFloat;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_DOUBLE:
+    spec->kind = ValueKind::Double;
+    spec->physical_type = kDouble;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_STRING_VIEW:
+    spec->kind = ValueKind::Bytes;
+    spec->physical_type = kByteArray;
+    spec->converted_type = kUtf8;
+    spec->logical_type = kStringType;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_BINARY_VIEW:
+    spec->kind = ValueKind::Bytes;
+    spec->physical_type = kByteArray;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    spec->kind = ValueKind::FixedBytes;
+    spec->physical_type = kFixedLenByteArray;
+    spec->type_length = view.fixed_size;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_DECIMAL128:
+    spec->kind = ValueKind::Decimal128;
+    spec->physical_type = kFixedLenByteArray;
+    spec->type_length = 16;
+    spec->converted_type = kDecimal;
+    spec->logical_type = kDecimalType;
+    spec->precision = view.decimal_precision;
+    spec->scale = view.decimal_scale;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_DATE32:
+    temporal(ValueKind::Int32, kInt32, kDateType, 0, kDate);
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_DATE64:
+    temporal(ValueKind::Int32, kInt32, kDateType, 0, kDate);
+    spec->divisor = 86400000;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_TIME32:
+    // Parquet has no second unit, so seconds are written as milliseconds
+    temporal(ValueKind::Int32, kInt32, kTimeType, kMillis, kTimeMillis);
+    spec->multiplier = view.time_unit == NANOARROW_TIME_UNIT_SECOND ? 1000 : 1;
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_TIME64:
+    if (view.time_unit == NANOARROW_TIME_UNIT_MICRO) {
+      temporal(ValueKind::Int64, kInt64, kTimeType, kMicros, kTimeMicros);
+    } else {
+      temporal(ValueKind::Int64, kInt64, kTimeType, kNanos,
+               kNoConvertedType);
+    }
+    return NANOARROW_OK;
+  case NANOARROW_TYPE_TIMESTAMP: {
+    spec->utc = view.timezone != nullptr && view.timezone[0] != '\0';
+    switch (view.time_unit) {
+    case NANOARROW_TIME_UNIT_SECOND:
+    case NANOARROW_TIME_UNIT_MILLI:
+      temporal(ValueKind::Int64, kInt64, kTimestampType, kMillis,
+               kTimestampMillis);
+      spec->multiplier =
+          view.time_unit == NANOARROW_TIME_UNIT_SECOND ? 1000 : 1;
+      break;
+    case NANOARROW_TIME_UNIT_MICRO:
+      temporal(ValueKind::Int64, kInt64, kTimestampType, kMicros,
+               kTimestampMicros);
+      break;
+    case NANOARROW_TIME_UNIT_NANO:
+      temporal(ValueKind::Int64, kInt64, kTimestampType, kNanos,
+               kNoConvertedType);
+      break;
+    }
+    // The converted types only describe instants
+    if (!spec->utc) {
+      spec->converted_type = kNoConvertedType;
+    }
+    return NANOARROW_OK;
+  }
+  default:
+    ArrowErrorSet(error, "Cannot write column '%s' of type %s to Parquet",
+                  spec->name.c_str(), ArrowTypeString(view.type));
+    return ENOTSUP;
+  }
+}
+
+// Buffers row groups of a result and writes them as a Parquet file
+class ParquetFileWriter {
+public:
+  ParquetFileWriter(int fd, const CubeParquetOptions &options)
+      : fd_(fd), options_(options) {}
+  ~ParquetFileWriter() {
+    if (view_initialized_) {
+      ArrowArrayViewReset(&view_);
+    }
+  }
+
+  ArrowErrorCode Init(const struct ArrowSchema *schema,
+                      struct ArrowError *error) {
+    if (options_.compression != CompressionCodec::None &&
+        options_.compression != CompressionCodec::Zstd) {
+      ArrowErrorSet(error, "Parquet export supports no compression or zstd");
+      return ENOTSUP;
+    }
+    if (!IsCompressionCodecAvailable(options_.compression)) {
+      ArrowErrorSet(error, "zstd is not available in this build");
+      return ENOTSUP;
+    }
+    if (options_.row_group_rows <= 0) {
+      ArrowErrorSet(error, "Row groups must have at least one row");
+      return EINVAL;
+    }
+    columns_.resize(static_cast<size_t>(schema->n_children));
+    buffers_.resize(columns_.size());
+    for (size_t c = 0; c < columns_.size(); c++) {
+      NANOARROW_RETURN_NOT_OK(
+          MakeColumnSpec(schema->children[c], &columns_[c], error));
+    }
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayViewInitFromSchema(&view_, schema, error));
+    view_initialized_ = true;
+    out_.assign(kMagic, kMagic + sizeof(kMagic));
+    return NANOARROW_OK;
+  }
+
+  ArrowErrorCode Append(const struct ArrowArray *batch,
+                        struct ArrowError *error) {
+    NANOARROW_RETURN_NOT_OK(ArrowArrayViewSetArray(&view_, batch, error));
+    int64_t begin = 0;
+    while (begin < batch->length) {
+      int64_t end = std::min(batch->length,
+                             begin + options_.row_group_rows - buffered_rows_);
+      for (size_t c = 0; c < columns_.size(); c++) {
+        AppendColumn(columns_[c], view_.children[c], begin, end, &buffers_[c]);
+      }
+      buffered_rows_ += end - begin;
+      begin = end;
+      if (buffered_rows_ == options_.row_group_rows ||
+          BufferedBytes() >= kMaxRowGroupBytes) {
+        NANOARROW_RETURN_NOT_OK(FlushRowGroup(error));
+      }
+    }
+    return NANOARROW_OK;
+  }
+
+  ArrowErrorCode Finish(struct ArrowError *error) {
+    NANOARROW_RETURN_NOT_OK(FlushRowGroup(error));
+    size_t footer_start = out_.size();
+    WriteFooter();
+    uint32_t footer_size = static_cast<uint32_t>(out_.size() - footer_start);
+    AppendU32(&out_, footer_size);
+    out_.insert(out_.end(), kMagic, kMagic + sizeof(kMagic));
+    return Flush(error);
+  }
+
+  int64_t rows() const { return rows_; }
+
+private:
+  size_t BufferedBytes() const {
+    size_t bytes = 0;
+    for (const auto &buffer : buffers_) {
+      bytes += buffer.values.size() + buffer.levels.size();
+    }
+    return bytes;
+  }
+
+  static void AppendColumn(const ColumnSpec &spec,
+                           const struct ArrowArrayView *view, int64_t begin,
+                           int64_t end, ColumnBuffer *buffer) {
+    const struct ArrowArrayView *values = spec.dictionary ? view->dictionary
+                                                          : view;
+    for (int64_t i = begin; i < end; i++) {
+      int64_t index = i;
+      bool null = ArrowArrayViewIsNull(view, i);
+      if (!null && spec.dictionary) {
+        index = ArrowArrayViewGetIntUnsafe(view, i);
+        null = ArrowArrayViewIsNull(values, index);
+      }
+      if (null) {
+        buffer->levels.push_back(0);
+        buffer->null_count++;
+        continue;
+      }
+      buffer->levels.push_back(1);
+      buffer->count++;
+      AppendValue(spec, values, index, buffer);
+    }
+  }
+
+  static void AppendValue(const ColumnSpec &spec,
+                          const struct ArrowArrayView *values, int64_t index,
+                          ColumnBuffer *buffer) {
+    auto append = [&](const void *data, size_t size) {
+      const auto *bytes = static_cast<const uint8_t *>(data);
+      buffer->values.insert(buffer->values.end(), bytes, bytes + size);
+    };
+    auto scaled = [&](int64_t value) {
+      value *= spec.multiplier;
+      if (spec.divisor != 1) {
+        int64_t quotient = value / spec.divisor;
+        value = quotient - (quotient * spec.divisor > value ? 1 : 0);
+      }
+      return value;
+    };
+    switch (spec.kind) {
+    case ValueKind::Bool:
+      buffer->values.push_back(ArrowArrayViewGetIntUnsafe(values, index) != 0);
+      break;
+    case ValueKind::Int32: {
+      auto value = static_cast<int32_t>(
+          scaled(ArrowArrayViewGetIntUnsafe(values, index)));
+      append(&value, sizeof(value));
+      break;
+    }
+    case ValueKind::Int64: {
+      int64_t value = scaled(ArrowArrayViewGetIntUnsafe(values, index));
+      append(&value, sizeof(value));
+      break;
+    }
+    case ValueKind::UInt64: {
+      uint64_t value = ArrowArrayViewGetUIntUnsafe(values, index);
+      append(&value, sizeof(value));
+      break;
+    }
+    case ValueKind::Float: {
+      auto value =
+          static_cast<float>(ArrowArrayViewGetDoubleUnsafe(values, index));
+      append(&value, sizeof(value));
+      break;
+    }
+    case ValueKind::Double: {
+      double value = ArrowArrayViewGetDoubleUnsafe(values, index);
+      append(&value, sizeof(value));
+      break;
+    }
+    case ValueKind::Bytes:
+    case ValueKind::FixedBytes: {
+      struct ArrowBufferView value =
+          ArrowArrayViewGetBytesUnsafe(values, index);
+      append(value.data.data, static_cast<size_t>(value.size_bytes));
+      if (spec.kind == ValueKind::Bytes) {
+        buffer->ends.push_back(buffer->values.size());
+      }
+      break;
+    }
+    case ValueKind::Decimal128: {
+      // Parquet decimals are big-endian
+      const uint8_t *value = values->buffer_views[1].data.as_uint8 +
+                             (values->offset + index) * 16;
+      for (int b = 15; b >= 0; b--) {
+        buffer->values.push_back(value[b]);
+      }
+      break;
+    }
+    }
+  }
+
+  // Value k of a buffered column
+  static std::string_view Value(const ColumnSpec &spec,
+                                const ColumnBuffer &buffer, size_t k) {
+    const char *values = reinterpret_cast<const char *>(buffer.values.data());
+    if (spec.kind == ValueKind::Bytes) {
+      size_t start = k == 0 ? 0 : buffer.ends[k - 1];
+      return std::string_view(values + start, buffer.ends[k] - start);
+    }
+    size_t width = ValueWidth(spec);
+    return std::string_view(values + k * width, width);
+  }
+
+  static size_t ValueWidth(const ColumnSpec &spec) {
+    switch (spec.physical_type) {
+    case kBoolean:
+      return 1;
+    case kInt32:
+    case kFloat:
+      return 4;
+    case kInt64:
+    case kDouble:
+      return 8;
+    default:
+      return static_cast<size_t>(spec.type_length);
+    }
+  }
+
+  // Plain encoding of values [begin, end) of a column
+  static void EncodePlain(const ColumnSpec &spec, const ColumnBuffer &buffer,
+                          size_t begin, size_t end, std::vector<uint8_t> *out) {
+    if (spec.physical_type == kBoolean) {
+      uint8_t byte = 0;
+      for (size_t k = begin; k < end; k++) {
+        byte |= buffer.values[k] << ((k - begin) % 8);
+        if ((k - begin) % 8 == 7) {
+          out->push_back(byte);
+          byte = 0;
+        }
+      }
+      if ((end - begin) % 8 != 0) {
+        out->push_back(byte);
+      }
+      return;
+    }
+    for (size_t k = begin; k < end; k++) {
+      std::string_view value = Value(spec, buffer, k);
+      if (spec.physical_type == kByteArray) {
+        AppendU32(out, static_cast<uint32_t>(value.size()));
+      }
+      out->insert(out->end(), value.begin(), value.end());
+    }
+  }
+
+  // Dictionary of a column chunk and the index of each value, or false if
+  // dictionary encoding would not make it smaller
+  bool BuildDictionary(const ColumnSpec &spec, const ColumnBuffer &buffer,
+                       std::vector<std::string_view> *entries,
+                       std::vector<uint32_t> *indices) {
+    if (!options_.dictionary || spec.physical_type == kBoolean ||
+        buffer.count == 0) {
+      return false;
+    }
+    const size_t prefix = spec.physical_type == kByteArray ? 4 : 0;
+    const size_t plain_bytes = buffer.values.size() + prefix * buffer.count;
+    std::unordered_map<std::string_view, uint32_t> ids;
+    size_t dictionary_bytes = 0;
+    indices->resize(buffer.count);
+    for (size_t k = 0; k < buffer.count; k++) {
+      std::string_view value = Value(spec, buffer, k);
+      auto inserted =
+          ids.emplace(value, static_cast<uint32_t>(entries->size()));
+      if (inserted.second) {
+        entries->push_back(value);
+        dictionary_bytes += value.size() + prefix;
+        if (dictionary_bytes > kMaxDictionaryBytes ||
+            dictionary_bytes > plain_bytes / 2) {
+          return false;
+        }
+      }
+      (*indices)[k] = inserted.first->second;
+    }
+    return true;
+  }
+
+  // Compress a page body and append it with its header
+  ArrowErrorCode WritePage(int32_t page_type, int32_t num_values,
+                           int32_t encoding, const std::vector<uint8_t> &body,
+                           ChunkInfo *chunk, struct ArrowError *error) {
+    const std::vector<uint8_t> *compressed = &body;
+    if (options_.compression != CompressionCodec::None) {
+      NANOARROW_RETURN_NOT_OK(Compress(options_.compression, body.data(),
+                                       body.size(), &compressed_, error));
+      compressed = &compressed_;
+    }
+    ThriftWriter header;
+    header.BeginStruct();
+    header.FieldI32(1, page_type);
+    header.FieldI32(2, static_cast<int32_t>(body.size()));
+    header.FieldI32(3, static_cast<int32_t>(compressed->size()));
+    if (page_type == kPageDictionary) {
+      header.FieldStruct(7);
+      header.FieldI32(1, num_values);
+      header.FieldI32(2, kEncodingPlain);
+      header.EndStruct();
+    } else {
+      header.FieldStruct(5);
+      header.FieldI32(1, num_values);
+      header.FieldI32(2, encoding);
+      header.FieldI32(3, kEncodingRle);
+      header.FieldI32(4, kEncodingRle);
+      header.EndStruct();
+    }
+    header.EndStruct();
+    out_.insert(out_.end(), header.data().begin(), header.data().end());
+    out_.insert(out_.end(), compressed->begin(), compressed->end());
+    chunk->uncompressed_bytes +=
+        static_cast<int64_t>(header.data().size() + body.size());
+    chunk->compressed_bytes +=
+        static_cast<int64_t>(header.data().size() + compressed->size());
+    return NANOARROW_OK;
+  }
+
+  ArrowErrorCode WriteColumnChunk(const ColumnSpec &spec,
+                                  const ColumnBuffer &buffer, ChunkInfo *chunk,
+                                  struct ArrowError *error) {
+    chunk->physical_type = spec.physical_type;
+    chunk->num_values = static_cast<int64_t>(buffer.levels.size());
+    chunk->null_count = buffer.null_count;
+
+    std::vector<std::string_view> entries;
+    std::vector<uint32_t> indices;
+    chunk->dictionary = BuildDictionary(spec, buffer, &entries, &indices);
+    std::vector<uint8_t> body;
+    if (chunk->dictionary) {
+      chunk->dictionary_page_offset = position_ + to_int64(out_.size());
+      for (std::string_view entry : entries) {
+        if (spec.physical_type == kByteArray) {
+          AppendU32(&body, static_cast<uint32_t>(entry.size()));
+        }
+        body.insert(body.end(), entry.begin(), entry.end());
+      }
+      NANOARROW_RETURN_NOT_OK(WritePage(
+          kPageDictionary, static_cast<int32_t>(entries.size()),
+          kEncodingPlain, body, chunk, error));
+    }
+    chunk->data_page_offset = position_ + to_int64(out_.size());
+    const int bit_width = BitWidth(entries.empty() ? 0 : entries.size() - 1);
+    const size_t prefix = spec.physical_type == kByteArray ? 4 : 0;
+
+    // Pages of whole rows, cut once their plain values reach kPageBytes
+    std::vector<uint32_t> levels;
+    size_t row = 0;
+    size_t value = 0;
+    const size_t rows = buffer.levels.size();
+    do {
+      size_t first_row = row;
+      size_t first_value = value;
+      size_t bytes = 0;
+      while (row < rows && bytes < kPageBytes) {
+        if (buffer.levels[row]) {
+          bytes += Value(spec, buffer, value).size() + prefix;
+          value++;
+        }
+        row++;
+      }
+
+      body.clear();
+      levels.assign(buffer.levels.begin() + first_row,
+                    buffer.levels.begin() + row);
+      body.resize(4);
+      EncodeHybrid(levels.data(), levels.size(), 1, &body);
+      uint32_t levels_size = static_cast<uint32_t>(body.size() - 4);
+      std::memcpy(body.data(), &levels_size, sizeof(levels_size));
+      if (chunk->dictionary) {
+        body.push_back(static_cast<uint8_t>(bit_width));
+        EncodeHybrid(indices.data() + first_value, value - first_value,
+                     bit_width, &body);
+      } else {
+        EncodePlain(spec, buffer, first_value, value, &body);
+      }
+      NANOARROW_RETURN_NOT_OK(WritePage(
+          kPageData, static_cast<int32_t>(row - first_row),
+          chunk->dictionary ? kEncodingRleDictionary : kEncodingPlain, body,
+          chunk, error));
+      if (out_.size() >= kWriteBytes) {
+        NANOARROW_RETURN_NOT_OK(Flush(error));
+      }
+    } while (row < rows);
+    return NANOARROW_OK;
+  }
+
+  ArrowErrorCode FlushRowGroup(struct ArrowError *error) {
+    if (buffered_rows_ == 0) {
+      return NANOARROW_OK;
+    }
+    RowGroupInfo group;
+    group.rows = buffered_rows_;
+    group.chunks.resize(columns_.size());
+    for (size_t c = 0; c < columns_.size(); c++) {
+      NANOARROW_RETURN_NOT_OK(
+          WriteColumnChunk(columns_[c], buffers_[c], &group.chunks[c], error));
+      buffers_[c].Clear();
+    }
+    row_groups_.push_back(std::move(group));
+    rows_ += buffered_rows_;
+    buffered_rows_ = 0;
+    return Flush(error);
+  }
+
+  void WriteFooter() {
+    ThriftWriter meta;
+    meta.BeginStruct();
+    meta.FieldI32(1, 1);
+    meta.FieldList(2, ThriftWriter::kStruct, columns_.size() + 1);
+    meta.BeginStruct();
+    meta.FieldBinary(4, "schema");
+    meta.FieldI32(5, static_cast<int32_t>(columns_.size()));
+    meta.EndStruct();
+    for (const auto &spec : columns_) {
+      meta.BeginStruct();
+      meta.FieldI32(1, spec.physical_type);
+      if (spec.physical_type == kFixedLenByteArray) {
+        meta.FieldI32(2, spec.type_length);
+      }
+      meta.FieldI32(3, kRepetitionOptional);
+      meta.FieldBinary(4, spec.name);
+      if (spec.converted_type != kNoConvertedType) {
+        meta.FieldI32(6, spec.converted_type);
+      }
+      if (spec.logical_type == kDecimalType) {
+        meta.FieldI32(7, spec.scale);
+        meta.FieldI32(8, spec.precision);
+      }
+      if (spec.logical_type != kNoLogicalType) {
+        WriteLogicalType(spec, &meta);
+      }
+      meta.EndStruct();
+    }
+    meta.FieldI64(3, rows_);
+    meta.FieldList(4, ThriftWriter::kStruct, row_groups_.size());
+    for (const auto &group : row_groups_) {
+      meta.BeginStruct();
+      meta.FieldList(1, ThriftWriter::kStruct, group.chunks.size());
+      int64_t total_bytes = 0;
+      int64_t compressed_bytes = 0;
+      int64_t group_offset = position_;
+      for (size_t c = 0; c < group.chunks.size(); c++) {
+        const ChunkInfo &chunk = group.chunks[c];
+        total_bytes += chunk.uncompressed_bytes;
+        compressed_bytes += chunk.compressed_bytes;
+        int64_t first_page = chunk.dictionary ? chunk.dictionary_page_offset
+                                              : chunk.data_page_offset;
+        if (c == 0) {
+          group_offset = first_page;
+        }
+        meta.BeginStruct();
+        meta.FieldI64(2, first_page);
+        meta.FieldStruct(3);
+        meta.FieldI32(1, chunk.physical_type);
+        if (chunk.dictionary) {
+          meta.FieldList(2, ThriftWriter::kI32, 3);
+          meta.I32(kEncodingPlain);
+          meta.I32(kEncodingRle);
+          meta.I32(kEncodingRleDictionary);
+        } else {
+          meta.FieldList(2, ThriftWriter::kI32, 2);
+          meta.I32(kEncodingPlain);
+          meta.I32(kEncodingRle);
+        }
+        meta.FieldList(3, ThriftWriter::kBinary, 1);
+        meta.Binary(columns_[c].name);
+        meta.FieldI32(4, options_.compression == CompressionCodec::Zstd
+                             ? kCodecZstd
+                             : kCodecUncompressed);
+        meta.FieldI64(5, chunk.num_values);
+        meta.FieldI64(6, chunk.uncompressed_bytes);
+        meta.FieldI64(7, chunk.compressed_bytes);
+        meta.FieldI64(9, chunk.data_page_offset);
+        if (chunk.dictionary) {
+          meta.FieldI64(11, chunk.dictionary_page_offset);
+        }
+        meta.FieldStruct(12);
+        meta.FieldI64(3, chunk.null_count);
+        meta.EndStruct();
+        meta.EndStruct();
+        meta.EndStruct();
+      }
+      meta.FieldI64(2, total_bytes);
+      meta.FieldI64(3, group.rows);
+      meta.FieldI64(5, group_offset);
+      meta.FieldI64(6, compressed_bytes);
+      meta.EndStruct();
+    }
+    meta.FieldBinary(6, "adbc-driver-cube");
+    meta.EndStruct();
+    out_.insert(out_.end(), meta.data().begin(), meta.data().end());
+  }
+
+  static void WriteLogicalType(const ColumnSpec &spec, ThriftWriter *meta) {
+    meta->FieldStruct(10);
+    meta->FieldStruct(spec.logical_type);
+    switch (spec.logical_type) {
+    case kDecimalType:
+      meta->FieldI32(1, spec.scale);
+      meta->FieldI32(2, spec.precision);
+      break;
+    case kTimeType:
+    case kTimestampType:
+      meta->FieldBool(1, spec.utc);
+      meta->FieldStruct(2);
+      meta->FieldStruct(spec.time_unit);
+      meta->EndStruct();
+      meta->EndStruct();
+      break;
+    case kIntType:
+      meta->FieldByte(1, spec.int_bits);
+      meta->FieldBool(2, spec.int_signed);
+      break;
+    default:
+      break;
+    }
+    meta->EndStruct();
+    meta->EndStruct();
+  }
+
+  ArrowErrorCode Flush(struct ArrowError *error) {
+    NANOARROW_RETURN_NOT_OK(WriteToFd(fd_, out_.data(), out_.size(), error));
+    position_ += to_int64(out_.size());
+    out_.clear();
+    return NANOARROW_OK;
+  }
+
+  static int64_t to_int64(size_t value) { return static_cast<int64_t>(value); }
+
+  int fd_;
+  CubeParquetOptions options_;
+  std::vector<ColumnSpec> columns_;
+  std::vector<ColumnBuffer> buffers_;
+  struct ArrowArrayView view_;
+  bool view_initialized_ = false;
+  int64_t buffered_rows_ = 0;
+  int64_t rows_ = 0; // Rows of the row groups written
+  std::vector<RowGroupInfo> row_groups_;
+  std::vector<uint8_t> out_; // Encoded but not yet written
+  int64_t position_ = 0;     // Bytes written before out_
+  std::vector<uint8_t> compressed_;
+};
+
+} // namespace
+
+ArrowErrorCode ExportParquet(struct ArrowArrayStream *stream, int fd,
+                             const CubeParquetOptions &options, int64_t *rows,
+                             struct ArrowError *error) {
+  nanoarrow::UniqueSchema schema;
+  int code = stream->get_schema(stream, schema.get());
+  if (code != NANOARROW_OK) {
+    const char *message = stream->get_last_error(stream);
+    ArrowErrorSet(error, "Failed to read result schema: %s",
+                  message ? message : std::strerror(code));
+    return code;
+  }
+  ParquetFileWriter writer(fd, options);
+  NANOARROW_RETURN_NOT_OK(writer.Init(schema.get(), error));
+
+  // Batches read here are written by the thread below
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<nanoarrow::UniqueArray> queue;
+  bool done = false;      // No more batches are coming
+  bool aborted = false;   // Reading failed: stop without finishing the file
+  int write_code = NANOARROW_OK;
+  struct ArrowError write_error;
+  std::memset(&write_error, 0, sizeof(write_error));
+
+  std::thread thread([&] {
+    int result = NANOARROW_OK;
+    while (true) {
+      nanoarrow::UniqueArray batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !queue.empty() || done; });
+        if (queue.empty() || aborted) {
+          break;
+        }
+        batch = std::move(queue.front());
+        queue.pop_front();
+      }
+      cv.notify_all();
+      result = writer.Append(batch.get(), &write_error);
+      if (result != NANOARROW_OK) {
+        break;
+      }
+    }
+    if (result == NANOARROW_OK && !aborted) {
+      result = writer.Finish(&write_error);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    write_code = result;
+    done = true;
+    cv.notify_all();
+  });
+
+  int read_code = NANOARROW_OK;
+  while (true) {
+    nanoarrow::UniqueArray batch;
+    read_code = stream->get_next(stream, batch.get());
+    if (read_code != NANOARROW_OK) {
+      const char *message = stream->get_last_error(stream);
+      ArrowErrorSet(error, "Failed to read result: %s",
+                    message ? message : std::strerror(read_code));
+      break;
+    }
+    if (!batch->release) {
+      break;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&] { return queue.size() < kQueuedBatches || done; });
+    if (done) {
+      break; // The writer failed
+    }
+    queue.push_back(std::move(batch));
+    lock.unlock();
+    cv.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    aborted = read_code != NANOARROW_OK;
+    done = true;
+  }
+  cv.notify_all();
+  thread.join();
+
+  if (read_code != NANOARROW_OK) {
+    return read_code;
+  }
+  if (write_code != NANOARROW_OK) {
+    ArrowErrorSet(error, "%s", write_error.message);
+    return write_code;
+  }
+  *rows = writer.rows();
+  return NANOARROW_OK;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,63 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/compression.h"
+
+namespace adbc::cube {
+
+/// How results are laid out in a Parquet file
+struct CubeParquetOptions {
+  /// Rows of each row group (the last may have fewer); a row group is
+  /// buffered in memory until it is full
+  int64_t row_group_rows = 1 << 20;
+  /// Whether column chunks may be dictionary encoded; each chunk is if its
+  /// distinct values are few enough to be worth it
+  bool dictionary = true;
+  /// Codec of the pages: None or Zstd
+  CompressionCodec compression = IsCompressionCodecAvailable(
+                                     CompressionCodec::Zstd)
+                                     ? CompressionCodec::Zstd
+                                     : CompressionCodec::None;
+};
+
+/// Write every batch of a stream to fd as one Parquet file. The stream is
+/// read on the calling thread while a background thread encodes,
+/// compresses and writes the batches it has read, so decoding the result
+/// and writing it overlap. Columns are flat and optional: booleans,
+/// integers, floating point, strings and binaries (including the large,
+/// view and dictionary-encoded layouts), fixed-size binaries, decimal128,
+/// dates, times, timestamps and durations. Other types fail before
+/// anything is written.
+/// @param stream Stream whose batches are written; not released
+/// @param fd File written at its current position; not closed
+/// @param options Row group size, dictionary encoding and compression
+/// @param rows Set to the number of rows written
+/// @param error Optional error output
+/// @return NANOARROW_OK; ENOTSUP for a column type Parquet output does not
+///   support or an unavailable codec; the stream's error code if reading
+///   failed; an errno value if writing failed
+ArrowErrorCode ExportParquet(struct ArrowArrayStream *stream, int fd,
+                             const CubeParquetOptions &options, int64_t *rows,
+                             struct ArrowError *error);
+
+} // namespace adbc::cube
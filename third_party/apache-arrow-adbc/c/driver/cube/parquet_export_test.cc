@@ -0,0 +1,485 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Round-trip tests of ExportParquet without a Parquet library: the file is
+// read back byte by byte (magic, footer, Thrift compact metadata, page
+// headers, levels and values) and compared with the batches written.
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/parquet_export.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// A decoded Thrift compact value: an integer, a binary, a list or a
+// struct by field id
+struct Thrift {
+  int64_t i = 0;
+  std::string binary;
+  std::vector<Thrift> list;
+  std::map<int16_t, Thrift> fields;
+
+  const Thrift &operator[](int16_t id) const {
+    static const Thrift missing;
+    auto it = fields.find(id);
+    return it != fields.end() ? it->second : missing;
+  }
+  bool has(int16_t id) const { return fields.count(id) != 0; }
+};
+
+class ThriftReader {
+public:
+  ThriftReader(const uint8_t *data, size_t size) : data_(data), size_(size) {}
+
+  size_t position() const { return pos_; }
+  bool ok() const { return ok_; }
+
+  Thrift Struct() {
+    Thrift value;
+    int16_t last_id = 0;
+    while (ok_) {
+      uint8_t header = Byte();
+      if (header == 0) {
+        break;
+      }
+      int16_t delta = header >> 4;
+      int16_t id = delta ? static_cast<int16_t>(last_id + delta)
+                         : static_cast<int16_t>(Zigzag(Varint()));
+      last_id = id;
+      value.fields[id] = Value(header & 0x0f);
+    }
+    return value;
+  }
+
+private:
+  Thrift Value(uint8_t type) {
+    Thrift value;
+    switch (type) {
+    case 1: // True
+    case 2: // False
+      value.i = type == 1;
+      break;
+    case 3: // Byte
+      value.i = static_cast<int8_t>(Byte());
+      break;
+    case 4: // I16
+    case 5: // I32
+    case 6: // I64
+      value.i = Zigzag(Varint());
+      break;
+    case 8: { // Binary
+      uint64_t size = Varint();
+      if (size > size_ - pos_) {
+        ok_ = false;
+        break;
+      }
+      value.binary.assign(reinterpret_cast<const char *>(data_ + pos_),
+                          size);
+      pos_ += size;
+      break;
+    }
+    case 9: { // List
+      uint8_t header = Byte();
+      uint64_t size = header >> 4;
+      if (size == 15) {
+        size = Varint();
+      }
+      for (uint64_t i = 0; ok_ && i < size; i++) {
+        value.list.push_back(Value(header & 0x0f));
+      }
+      break;
+    }
+    case 12: // Struct
+      value = Struct();
+      break;
+    default:
+      ok_ = false;
+    }
+    return value;
+  }
+
+  uint8_t Byte() {
+    if (pos_ >= size_) {
+      ok_ = false;
+      return 0;
+    }
+    return data_[pos_++];
+  }
+  uint64_t Varint() {
+    uint64_t value = 0;
+    for (int shift = 0; ok_ && shift < 64; shift += 7) {
+      uint8_t byte = Byte();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    return value;
+  }
+  static int64_t Zigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+  const uint8_t *data_;
+  size_t size_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+// Decode count values of the RLE / bit-packing hybrid encoding
+std::vector<uint32_t> DecodeHybrid(const uint8_t *data, size_t size,
+                                   int bit_width, size_t count) {
+  std::vector<uint32_t> values;
+  size_t pos = 0;
+  while (values.size() < count && pos < size) {
+    uint64_t header = 0;
+    for (int shift = 0; pos < size; shift += 7) {
+      header |= static_cast<uint64_t>(data[pos] & 0x7f) << shift;
+      if ((data[pos++] & 0x80) == 0) {
+        break;
+      }
+    }
+    if (header & 1) {
+      size_t total = (header >> 1) * 8;
+      uint64_t bits = 0;
+      int pending = 0;
+      for (size_t i = 0; i < total; i++) {
+        while (pending < bit_width) {
+          bits |= static_cast<uint64_t>(pos < size ? data[pos++] : 0)
+                  << pending;
+          pending += 8;
+        }
+        if (values.size() < count) {
+          values.push_back(static_cast<uint32_t>(
+              bits & ((uint64_t{1} << bit_width) - 1)));
+        }
+        bits >>= bit_width;
+        pending -= bit_width;
+      }
+    } else {
+      uint32_t value = 0;
+      for (int b = 0; b < (bit_width + 7) / 8; b++) {
+        value |= static_cast<uint32_t>(data[pos++]) << (8 * b);
+      }
+      values.insert(values.end(), header >> 1, value);
+    }
+  }
+  values.resize(count);
+  return values;
+}
+
+// A column read back: each row's value as bytes (int64 little-endian, or
+// the string), null as nullopt
+using Column = std::vector<std::optional<std::string>>;
+
+struct ParquetFile {
+  Thrift metadata;
+  std::vector<Column> columns;
+};
+
+// Read the values of a column chunk, dictionary or plain encoded
+void ReadChunk(const std::vector<uint8_t> &file, const Thrift &chunk,
+               Column *out) {
+  const Thrift &meta = chunk[3];
+  ASSERT_EQ(meta[4].i, 0) << "pages must be uncompressed to be read back";
+  const bool byte_array = meta[1].i == 6;
+  int64_t remaining = meta[5].i;
+  size_t pos = static_cast<size_t>(meta.has(11) ? meta[11].i : meta[9].i);
+  std::vector<std::string> dictionary;
+  while (remaining > 0) {
+    ASSERT_LT(pos, file.size());
+    ThriftReader reader(file.data() + pos, file.size() - pos);
+    Thrift header = reader.Struct();
+    ASSERT_TRUE(reader.ok());
+    ASSERT_EQ(header[2].i, header[3].i);
+    const uint8_t *body = file.data() + pos + reader.position();
+    size_t body_size = static_cast<size_t>(header[2].i);
+    ASSERT_LE(pos + reader.position() + body_size, file.size());
+    pos += reader.position() + body_size;
+
+    auto plain = [&](size_t *at) {
+      std::string value;
+      size_t length = 8;
+      if (byte_array) {
+        uint32_t prefix;
+        std::memcpy(&prefix, body + *at, 4);
+        *at += 4;
+        length = prefix;
+      }
+      value.assign(reinterpret_cast<const char *>(body + *at), length);
+      *at += length;
+      return value;
+    };
+
+    if (header[1].i == 2) { // Dictionary page
+      size_t at = 0;
+      for (int64_t i = 0; i < header[7][1].i; i++) {
+        dictionary.push_back(plain(&at));
+      }
+      continue;
+    }
+    ASSERT_EQ(header[1].i, 0); // Data page
+    size_t rows = static_cast<size_t>(header[5][1].i);
+    uint32_t levels_size;
+    std::memcpy(&levels_size, body, 4);
+    auto levels = DecodeHybrid(body + 4, levels_size, 1, rows);
+    size_t at = 4 + levels_size;
+    size_t present = 0;
+    for (uint32_t level : levels) {
+      present += level;
+    }
+    std::vector<std::string> values;
+    if (header[5][2].i == 8) { // RLE_DICTIONARY
+      int bit_width = body[at++];
+      for (uint32_t index :
+           DecodeHybrid(body + at, body_size - at, bit_width, present)) {
+        ASSERT_LT(index, dictionary.size());
+        values.push_back(dictionary[index]);
+      }
+    } else {
+      ASSERT_EQ(header[5][2].i, 0); // PLAIN
+      for (size_t i = 0; i < present; i++) {
+        values.push_back(plain(&at));
+      }
+    }
+    size_t next = 0;
+    for (uint32_t level : levels) {
+      out->push_back(level ? std::optional<std::string>(values[next++])
+                           : std::nullopt);
+    }
+    remaining -= static_cast<int64_t>(rows);
+  }
+}
+
+void ReadParquet(const std::vector<uint8_t> &file, ParquetFile *out) {
+  ASSERT_GE(file.size(), 12u);
+  ASSERT_EQ(std::memcmp(file.data(), "PAR1", 4), 0);
+  ASSERT_EQ(std::memcmp(file.data() + file.size() - 4, "PAR1", 4), 0);
+  uint32_t footer_size;
+  std::memcpy(&footer_size, file.data() + file.size() - 8, 4);
+  ASSERT_LE(footer_size, file.size() - 12);
+  const uint8_t *footer = file.data() + file.size() - 8 - footer_size;
+  ThriftReader reader(footer, footer_size);
+  out->metadata = reader.Struct();
+  ASSERT_TRUE(reader.ok());
+  ASSERT_EQ(reader.position(), footer_size);
+
+  const auto &schema = out->metadata[2].list;
+  ASSERT_FALSE(schema.empty());
+  out->columns.assign(schema.size() - 1, Column());
+  for (const auto &group : out->metadata[4].list) {
+    ASSERT_EQ(group[1].list.size(), out->columns.size());
+    for (size_t c = 0; c < out->columns.size(); c++) {
+      size_t before = out->columns[c].size();
+      ReadChunk(file, group[1].list[c], &out->columns[c]);
+      ASSERT_EQ(out->columns[c].size() - before,
+                static_cast<size_t>(group[3].i));
+    }
+  }
+}
+
+std::string Int64Bytes(int64_t value) {
+  std::string bytes(8, '\0');
+  std::memcpy(bytes.data(), &value, 8);
+  return bytes;
+}
+
+// Rows of the test result: an int64 and a string column, with nulls
+struct TestRow {
+  std::optional<int64_t> id;
+  std::optional<std::string> name;
+};
+
+void MakeStream(const std::vector<std::vector<TestRow>> &batches,
+                struct ArrowArrayStream *out) {
+  nanoarrow::UniqueSchema schema;
+  ArrowSchemaInit(schema.get());
+  ASSERT_EQ(ArrowSchemaSetTypeStruct(schema.get(), 2), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[0], NANOARROW_TYPE_INT64),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[0], "id"), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[1], NANOARROW_TYPE_STRING),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[1], "name"), NANOARROW_OK);
+  nanoarrow::UniqueSchema stream_schema;
+  ASSERT_EQ(ArrowSchemaDeepCopy(schema.get(), stream_schema.get()),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowBasicArrayStreamInit(out, stream_schema.get(),
+                                      static_cast<int64_t>(batches.size())),
+            NANOARROW_OK);
+  for (size_t b = 0; b < batches.size(); b++) {
+    nanoarrow::UniqueArray array;
+    ASSERT_EQ(ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr),
+              NANOARROW_OK);
+    ASSERT_EQ(ArrowArrayStartAppending(array.get()), NANOARROW_OK);
+    for (const auto &row : batches[b]) {
+      if (row.id) {
+        ASSERT_EQ(ArrowArrayAppendInt(array->children[0], *row.id),
+                  NANOARROW_OK);
+      } else {
+        ASSERT_EQ(ArrowArrayAppendNull(array->children[0], 1), NANOARROW_OK);
+      }
+      if (row.name) {
+        ASSERT_EQ(ArrowArrayAppendString(array->children[1],
+                                         ArrowCharView(row.name->c_str())),
+                  NANOARROW_OK);
+      } else {
+        ASSERT_EQ(ArrowArrayAppendNull(array->children[1], 1), NANOARROW_OK);
+      }
+      ASSERT_EQ(ArrowArrayFinishElement(array.get()), NANOARROW_OK);
+    }
+    ASSERT_EQ(ArrowArrayFinishBuildingDefault(array.get(), nullptr),
+              NANOARROW_OK);
+    ArrowBasicArrayStreamSetArray(out, static_cast<int64_t>(b), array.get());
+  }
+}
+
+// Export stream to a temporary file and read the file back
+int Export(struct ArrowArrayStream *stream, const CubeParquetOptions &options,
+           int64_t *rows, std::vector<uint8_t> *file) {
+  std::FILE *temp = std::tmpfile();
+  if (!temp) {
+    return errno;
+  }
+  struct ArrowError error;
+  error.message[0] = '\0';
+  int code = ExportParquet(stream, fileno(temp), options, rows, &error);
+  std::fseek(temp, 0, SEEK_END);
+  file->resize(static_cast<size_t>(std::ftell(temp)));
+  std::rewind(temp);
+  if (!file->empty() &&
+      std::fread(file->data(), 1, file->size(), temp) != file->size()) {
+    code = EIO;
+  }
+  std::fclose(temp);
+  return code;
+}
+
+const std::vector<std::vector<TestRow>> kBatches = {
+    {{1, "north"}, {2, std::nullopt}, {std::nullopt, "south"}},
+    {{4, "north"}, {5, "north"}},
+    {},
+    {{-6, "north"}, {7, ""}},
+};
+
+class ParquetRoundTripTest : public ::testing::TestWithParam<bool> {};
+
+} // namespace
+
+TEST_P(ParquetRoundTripTest, Encodings) {
+  nanoarrow::UniqueArrayStream stream;
+  MakeStream(kBatches, stream.get());
+  CubeParquetOptions options;
+  options.row_group_rows = 3;
+  options.dictionary = GetParam();
+  options.compression = CompressionCodec::None;
+  int64_t rows = 0;
+  std::vector<uint8_t> file;
+  ASSERT_EQ(Export(stream.get(), options, &rows, &file), NANOARROW_OK);
+  EXPECT_EQ(rows, 7);
+
+  ParquetFile parquet;
+  ReadParquet(file, &parquet);
+  const Thrift &metadata = parquet.metadata;
+  EXPECT_EQ(metadata[3].i, 7);
+  // 7 rows in groups of 3
+  ASSERT_EQ(metadata[4].list.size(), 3u);
+  EXPECT_EQ(metadata[4].list[2][3].i, 1);
+
+  const auto &schema = metadata[2].list;
+  ASSERT_EQ(schema.size(), 3u);
+  EXPECT_EQ(schema[0][5].i, 2);
+  EXPECT_EQ(schema[1][4].binary, "id");
+  EXPECT_EQ(schema[1][1].i, 2); // INT64
+  EXPECT_EQ(schema[1][3].i, 1); // OPTIONAL
+  EXPECT_EQ(schema[2][4].binary, "name");
+  EXPECT_EQ(schema[2][1].i, 6); // BYTE_ARRAY
+  EXPECT_EQ(schema[2][6].i, 0); // UTF8
+
+  Column ids;
+  Column names;
+  for (const auto &batch : kBatches) {
+    for (const auto &row : batch) {
+      ids.push_back(row.id ? std::optional<std::string>(Int64Bytes(*row.id))
+                           : std::nullopt);
+      names.push_back(row.name);
+    }
+  }
+  ASSERT_EQ(parquet.columns.size(), 2u);
+  EXPECT_EQ(parquet.columns[0], ids);
+  EXPECT_EQ(parquet.columns[1], names);
+
+  // The repeated names are worth a dictionary when one is allowed
+  EXPECT_EQ(metadata[4].list[1][1].list[1][3].has(11), GetParam());
+
+  // Null counts are kept in the chunk statistics
+  EXPECT_EQ(metadata[4].list[0][1].list[0][3][12][3].i, 1);
+  EXPECT_EQ(metadata[4].list[0][1].list[1][3][12][3].i, 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Dictionary, ParquetRoundTripTest, ::testing::Bool());
+
+TEST(ParquetExportTest, EmptyResult) {
+  nanoarrow::UniqueArrayStream stream;
+  MakeStream({}, stream.get());
+  CubeParquetOptions options;
+  options.compression = CompressionCodec::None;
+  int64_t rows = -1;
+  std::vector<uint8_t> file;
+  ASSERT_EQ(Export(stream.get(), options, &rows, &file), NANOARROW_OK);
+  EXPECT_EQ(rows, 0);
+  ParquetFile parquet;
+  ReadParquet(file, &parquet);
+  EXPECT_EQ(parquet.metadata[3].i, 0);
+  EXPECT_TRUE(parquet.metadata[4].list.empty());
+  EXPECT_EQ(parquet.metadata[2].list.size(), 3u);
+}
+
+TEST(ParquetExportTest, UnsupportedTypeWritesNothing) {
+  nanoarrow::UniqueSchema schema;
+  ArrowSchemaInit(schema.get());
+  ASSERT_EQ(ArrowSchemaSetTypeStruct(schema.get(), 1), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[0], NANOARROW_TYPE_LIST),
+            NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetName(schema->children[0], "items"), NANOARROW_OK);
+  ASSERT_EQ(ArrowSchemaSetType(schema->children[0]->children[0],
+                               NANOARROW_TYPE_INT32),
+            NANOARROW_OK);
+  nanoarrow::UniqueArrayStream stream;
+  ASSERT_EQ(ArrowBasicArrayStreamInit(stream.get(), schema.get(), 0),
+            NANOARROW_OK);
+  int64_t rows = 0;
+  std::vector<uint8_t> file;
+  EXPECT_EQ(Export(stream.get(), CubeParquetOptions(), &rows, &file),
+            ENOTSUP);
+  EXPECT_TRUE(file.empty());
+}
+
+} // namespace adbc::cube
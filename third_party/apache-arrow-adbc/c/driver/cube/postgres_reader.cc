@@ -0,0 +1,1647 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/postgres_reader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/libpq_loader.h"
+#include "driver/cube/log.h"
+#include "driver/cube/native_client.h"
+#include "driver/cube/text_parsers.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// Type OIDs of the PostgreSQL built-in types Cube SQL returns
+constexpr Oid kBoolOid = 16;
+constexpr Oid kByteaOid = 17;
+constexpr Oid kCharOid = 18;
+constexpr Oid kNameOid = 19;
+constexpr Oid kInt8Oid = 20;
+constexpr Oid kInt2Oid = 21;
+constexpr Oid kInt4Oid = 23;
+constexpr Oid kTextOid = 25;
+constexpr Oid kOidOid = 26;
+constexpr Oid kJsonOid = 114;
+constexpr Oid kFloat4Oid = 700;
+constexpr Oid kFloat8Oid = 701;
+constexpr Oid kUnknownOid = 705;
+constexpr Oid kBpcharOid = 1042;
+constexpr Oid kVarcharOid = 1043;
+constexpr Oid kDateOid = 1082;
+constexpr Oid kTimeOid = 1083;
+constexpr Oid kTimestampOid = 1114;
+constexpr Oid kTimestampTzOid = 1184;
+constexpr Oid kIntervalOid = 1186;
+constexpr Oid kNumericOid = 1700;
+constexpr Oid kUuidOid = 2950;
+constexpr Oid kJsonbOid = 3802;
+
+// Binary dates and timestamps count from 2000-01-01 instead of 1970-01-01
+constexpr int32_t kPostgresEpochDays = 10957;
+constexpr int64_t kPostgresEpochMicros =
+    static_cast<int64_t>(kPostgresEpochDays) * 86400 * 1000000;
+
+// Sign word of a binary numeric
+constexpr uint16_t kNumericNegative = 0x4000;
+constexpr uint16_t kNumericNaN = 0xC000;
+constexpr uint16_t kNumericPositiveInf = 0xD000;
+constexpr uint16_t kNumericNegativeInf = 0xF000;
+
+// Binary format is big-endian
+uint16_t ReadBE16(const char *data) {
+  auto bytes = reinterpret_cast<const uint8_t *>(data);
+  return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+uint32_t ReadBE32(const char *data) {
+  auto bytes = reinterpret_cast<const uint8_t *>(data);
+  return (static_cast<uint32_t>(bytes[0]) << 24) |
+         (static_cast<uint32_t>(bytes[1]) << 16) |
+         (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+
+uint64_t ReadBE64(const char *data) {
+  return (static_cast<uint64_t>(ReadBE32(data)) << 32) | ReadBE32(data + 4);
+}
+
+// Precision and scale of a numeric column from its type modifier. False
+// when the column is unconstrained (typmod -1) or does not fit decimal128.
+bool NumericTypmod(int typmod, int32_t *precision, int32_t *scale) {
+  // The modifier is ((precision << 16) | scale) + VARHDRSZ; the scale is
+  // 11 bits, signed since PostgreSQL 15
+  if (typmod < 4) {
+    return false;
+  }
+  *precision = ((typmod - 4) >> 16) & 0xFFFF;
+  *scale = (((typmod - 4) & 0x7FF) ^ 1024) - 1024;
+  return *precision >= 1 && *precision <= 38 && *scale >= 0 &&
+         *scale <= *precision;
+}
+
+// Arrow type a column of the given type OID is decoded into. Numeric
+// columns with a declared precision become decimal128; other numerics,
+// UUID and JSON become strings, as in CubeTypeMapper. Types without a
+// decoder keep their binary representation.
+ArrowType ArrowTypeForOid(Oid oid) {
+  switch (oid) {
+  case kBoolOid:
+    return NANOARROW_TYPE_BOOL;
+  case kInt2Oid:
+    return NANOARROW_TYPE_INT16;
+  case kInt4Oid:
+    return NANOARROW_TYPE_INT32;
+  case kInt8Oid:
+    return NANOARROW_TYPE_INT64;
+  case kOidOid:
+    return NANOARROW_TYPE_UINT32;
+  case kFloat4Oid:
+    return NANOARROW_TYPE_FLOAT;
+  case kFloat8Oid:
+    return NANOARROW_TYPE_DOUBLE;
+  case kCharOid:
+  case kNameOid:
+  case kTextOid:
+  case kJsonOid:
+  case kUnknownOid:
+  case kBpcharOid:
+  case kVarcharOid:
+  case kJsonbOid:
+  case kNumericOid:
+  case kUuidOid:
+    return NANOARROW_TYPE_STRING;
+  case kDateOid:
+    return NANOARROW_TYPE_DATE32;
+  case kTimeOid:
+    return NANOARROW_TYPE_TIME64;
+  case kTimestampOid:
+  case kTimestampTzOid:
+    return NANOARROW_TYPE_TIMESTAMP;
+  case kIntervalOid:
+    return NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO;
+  case kByteaOid:
+  default:
+    return NANOARROW_TYPE_BINARY;
+  }
+}
+
+ArrowErrorCode SetColumnSchema(ArrowSchema *schema, Oid oid, const char *name,
+                               int typmod = -1) {
+  ArrowType type = ArrowTypeForOid(oid);
+  int32_t precision, scale;
+  if (oid == kNumericOid && NumericTypmod(typmod, &precision, &scale)) {
+    type = NANOARROW_TYPE_DECIMAL128;
+  }
+  ArrowErrorCode status;
+  switch (type) {
+  case NANOARROW_TYPE_DECIMAL128:
+    status = ArrowSchemaSetTypeDecimal(schema, type, precision, scale);
+    break;
+  case NANOARROW_TYPE_TIME64:
+    status = ArrowSchemaSetTypeDateTime(schema, type, NANOARROW_TIME_UNIT_MICRO,
+                                        nullptr);
+    break;
+  case NANOARROW_TYPE_TIMESTAMP:
+    status = ArrowSchemaSetTypeDateTime(
+        schema, type, NANOARROW_TIME_UNIT_MICRO,
+        oid == kTimestampTzOid ? "UTC" : nullptr);
+    break;
+  default:
+    status = ArrowSchemaSetType(schema, type);
+    break;
+  }
+  if (status != NANOARROW_OK) {
+    return status;
+  }
+  return ArrowSchemaSetName(schema, name ? name : "");
+}
+
+// Decimal text of a binary numeric: int16 ndigits, int16 weight, uint16
+// sign, int16 dscale, then ndigits base-10000 digits, the first of which
+// is multiplied by 10000^weight
+bool FormatNumeric(const char *value, int length, std::string *out) {
+  if (length < 8) {
+    return false;
+  }
+  int ndigits = static_cast<int16_t>(ReadBE16(value));
+  int weight = static_cast<int16_t>(ReadBE16(value + 2));
+  uint16_t sign = ReadBE16(value + 4);
+  int dscale = static_cast<int16_t>(ReadBE16(value + 6));
+  if (ndigits < 0 || dscale < 0 || length != 8 + 2 * ndigits) {
+    return false;
+  }
+  out->clear();
+  switch (sign) {
+  case kNumericNaN:
+    *out = "NaN";
+    return true;
+  case kNumericPositiveInf:
+    *out = "Infinity";
+    return true;
+  case kNumericNegativeInf:
+    *out = "-Infinity";
+    return true;
+  default:
+    break;
+  }
+  auto digit = [&](int i) -> int {
+    return i >= 0 && i < ndigits ? ReadBE16(value + 8 + 2 * i) : 0;
+  };
+
+  if (sign == kNumericNegative) {
+    out->push_back('-');
+  }
+  char buf[8];
+  if (weight < 0) {
+    out->push_back('0');
+  } else {
+    for (int i = 0; i <= weight; i++) {
+      snprintf(buf, sizeof(buf), i == 0 ? "%d" : "%04d", digit(i));
+      out->append(buf);
+    }
+  }
+  if (dscale > 0) {
+    out->push_back('.');
+    size_t point = out->size();
+    for (int i = weight + 1; out->size() - point < static_cast<size_t>(dscale);
+         i++) {
+      snprintf(buf, sizeof(buf), "%04d", digit(i));
+      out->append(buf);
+    }
+    out->resize(point + dscale);
+  }
+  return true;
+}
+
+// Digits a decimal128 holds
+constexpr int kDecimal128Digits = 38;
+
+// Set a decimal128 of the given scale from its unscaled digits, with an
+// optional leading '-'. False if they exceed 38 significant digits.
+bool SetDecimalDigits(const char *digits, int length, int32_t scale,
+                      struct ArrowDecimal *out) {
+  int start = length > 0 && digits[0] == '-' ? 1 : 0;
+  int significant = length - start;
+  for (int i = start; i < length - 1 && digits[i] == '0'; i++) {
+    significant--;
+  }
+  if (significant > kDecimal128Digits) {
+    return false;
+  }
+  ArrowDecimalInit(out, 128, kDecimal128Digits, scale);
+  struct ArrowStringView view = {digits, length};
+  return ArrowDecimalSetDigits(out, view) == NANOARROW_OK;
+}
+
+// Decimal128 of a binary numeric at the column's scale. The digits are
+// gathered in a stack buffer; any past the scale are dropped, as the
+// column's constraint keeps them zero.
+bool NumericToDecimal(const char *value, int length, int32_t scale,
+                      struct ArrowDecimal *out, ArrowError *error) {
+  if (length < 8) {
+    ArrowErrorSet(error, "Invalid binary numeric value of %d bytes", length);
+    return false;
+  }
+  int ndigits = static_cast<int16_t>(ReadBE16(value));
+  int weight = static_cast<int16_t>(ReadBE16(value + 2));
+  uint16_t sign = ReadBE16(value + 4);
+  if (ndigits < 0 || length != 8 + 2 * ndigits) {
+    ArrowErrorSet(error, "Invalid binary numeric value of %d bytes", length);
+    return false;
+  }
+  if (sign != 0 && sign != kNumericNegative) {
+    ArrowErrorSet(error, "NaN and infinite numerics have no decimal value");
+    return false;
+  }
+  // Base-10000 digits from the first integer one (10000^weight) to the
+  // last one the scale reaches
+  int first = std::min(0, weight + 1);
+  int last = weight + (scale + 3) / 4;
+  char buf[4 * (kDecimal128Digits / 4 + 3) + 1];
+  if ((last - first + 1) * 4 + 1 > static_cast<int>(sizeof(buf))) {
+    ArrowErrorSet(error, "Numeric value does not fit decimal128");
+    return false;
+  }
+  int n = 0;
+  if (sign == kNumericNegative) {
+    buf[n++] = '-';
+  }
+  for (int i = first; i <= last; i++) {
+    int group = i >= 0 && i < ndigits ? ReadBE16(value + 8 + 2 * i) : 0;
+    for (int divisor = 1000; divisor > 0; divisor /= 10) {
+      buf[n++] = static_cast<char>('0' + group / divisor % 10);
+    }
+  }
+  n -= (last - weight) * 4 - scale;
+  if (!SetDecimalDigits(buf, n, scale, out)) {
+    ArrowErrorSet(error, "Numeric value does not fit decimal128");
+    return false;
+  }
+  return true;
+}
+
+// Decimal128 of a text numeric, such as "-12.5", at the column's scale
+bool NumericTextToDecimal(const char *value, int length, int32_t scale,
+                          struct ArrowDecimal *out) {
+  char buf[2 * kDecimal128Digits + 2];
+  int n = 0;
+  int i = 0;
+  if (i < length && value[i] == '-') {
+    buf[n++] = value[i++];
+  }
+  int integer_digits = 0;
+  for (; i < length && value[i] >= '0' && value[i] <= '9'; i++) {
+    if (integer_digits++ > kDecimal128Digits) {
+      return false;
+    }
+    buf[n++] = value[i];
+  }
+  int fraction_digits = 0;
+  if (i < length && value[i] == '.') {
+    for (i++; i < length && value[i] >= '0' && value[i] <= '9'; i++) {
+      if (fraction_digits < scale) {
+        buf[n++] = value[i];
+        fraction_digits++;
+      }
+    }
+  }
+  if (i != length || integer_digits + fraction_digits == 0) {
+    return false;
+  }
+  for (; fraction_digits < scale; fraction_digits++) {
+    buf[n++] = '0';
+  }
+  return SetDecimalDigits(buf, n, scale, out);
+}
+
+void FormatUuid(const char *value, std::string *out) {
+  static const char kHex[] = "0123456789abcdef";
+  out->clear();
+  for (int i = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      out->push_back('-');
+    }
+    auto byte = static_cast<uint8_t>(value[i]);
+    out->push_back(kHex[byte >> 4]);
+    out->push_back(kHex[byte & 0x0F]);
+  }
+}
+
+ArrowErrorCode AppendBytes(ArrowArray *out, const char *data, int64_t size) {
+  struct ArrowBufferView view;
+  view.data.as_char = data;
+  view.size_bytes = size;
+  return ArrowArrayAppendBytes(out, view);
+}
+
+// Append one non-null binary-format value of a column with the given OID
+ArrowErrorCode AppendValue(Oid oid, const char *value, int length,
+                           std::string *scratch, ArrowArray *out,
+                           ArrowError *error) {
+  auto expect = [&](int size) {
+    if (length != size) {
+      ArrowErrorSet(error, "Type %u value has %d bytes, expected %d",
+                    static_cast<unsigned>(oid), length, size);
+      return false;
+    }
+    return true;
+  };
+
+  switch (oid) {
+  case kBoolOid:
+    if (!expect(1)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(out, value[0] != 0);
+  case kInt2Oid:
+    if (!expect(2)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(out, static_cast<int16_t>(ReadBE16(value)));
+  case kInt4Oid:
+    if (!expect(4)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(out, static_cast<int32_t>(ReadBE32(value)));
+  case kInt8Oid:
+    if (!expect(8)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(out, static_cast<int64_t>(ReadBE64(value)));
+  case kOidOid:
+    if (!expect(4)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendUInt(out, ReadBE32(value));
+  case kFloat4Oid: {
+    if (!expect(4)) {
+      return EINVAL;
+    }
+    uint32_t bits = ReadBE32(value);
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return ArrowArrayAppendDouble(out, result);
+  }
+  case kFloat8Oid: {
+    if (!expect(8)) {
+      return EINVAL;
+    }
+    uint64_t bits = ReadBE64(value);
+    double result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return ArrowArrayAppendDouble(out, result);
+  }
+  case kDateOid:
+    if (!expect(4)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(
+        out, static_cast<int64_t>(static_cast<int32_t>(ReadBE32(value))) +
+                 kPostgresEpochDays);
+  case kTimeOid:
+    if (!expect(8)) {
+      return EINVAL;
+    }
+    return ArrowArrayAppendInt(out, static_cast<int64_t>(ReadBE64(value)));
+  case kTimestampOid:
+  case kTimestampTzOid: {
+    if (!expect(8)) {
+      return EINVAL;
+    }
+    auto micros = static_cast<int64_t>(ReadBE64(value));
+    // Leave +/-infinity (INT64_MAX/MIN) as is rather than overflow
+    if (micros != INT64_MAX && micros != INT64_MIN) {
+      micros += kPostgresEpochMicros;
+    }
+    return ArrowArrayAppendInt(out, micros);
+  }
+  case kIntervalOid: {
+    if (!expect(16)) {
+      return EINVAL;
+    }
+    struct ArrowInterval interval;
+    ArrowIntervalInit(&interval, NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO);
+    interval.ns = static_cast<int64_t>(ReadBE64(value)) * 1000;
+    interval.days = static_cast<int32_t>(ReadBE32(value + 8));
+    interval.months = static_cast<int32_t>(ReadBE32(value + 12));
+    return ArrowArrayAppendInterval(out, &interval);
+  }
+  case kNumericOid:
+    if (!FormatNumeric(value, length, scratch)) {
+      ArrowErrorSet(error, "Invalid binary numeric value of %d bytes", length);
+      return EINVAL;
+    }
+    return AppendBytes(out, scratch->data(), scratch->size());
+  case kUuidOid:
+    if (!expect(16)) {
+      return EINVAL;
+    }
+    FormatUuid(value, scratch);
+    return AppendBytes(out, scratch->data(), scratch->size());
+  case kJsonbOid:
+    // Version byte, then the JSON text
+    if (length < 1) {
+      ArrowErrorSet(error, "Empty binary jsonb value");
+      return EINVAL;
+    }
+    return AppendBytes(out, value + 1, length - 1);
+  default:
+    // Text types are sent as their bytes; anything else keeps its binary
+    // representation
+    return AppendBytes(out, value, length);
+  }
+}
+
+// Decode a text bytea, \x followed by two hex digits a byte
+bool DecodeHexBytea(const char *value, int length, std::string *out) {
+  if (length < 2 || value[0] != '\\' || value[1] != 'x' || length % 2 != 0) {
+    return false;
+  }
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  };
+  out->clear();
+  for (int i = 2; i < length; i += 2) {
+    int high = nibble(value[i]);
+    int low = nibble(value[i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out->push_back(static_cast<char>((high << 4) | low));
+  }
+  return true;
+}
+
+// Append one non-null text-format value of a column with the given OID,
+// for the columns a server sends as text although binary was asked for
+ArrowErrorCode AppendTextValue(Oid oid, const char *value, int length,
+                               std::string *scratch, ArrowArray *out,
+                               ArrowError *error) {
+  auto size = static_cast<size_t>(length);
+  auto invalid = [&]() {
+    ArrowErrorSet(error, "Invalid text value for type %u: '%.*s'",
+                  static_cast<unsigned>(oid), std::min(length, 64), value);
+    return EINVAL;
+  };
+
+  switch (oid) {
+  case kBoolOid:
+    if (length != 1 || (value[0] != 't' && value[0] != 'f')) {
+      return invalid();
+    }
+    return ArrowArrayAppendInt(out, value[0] == 't');
+  case kInt2Oid:
+  case kInt4Oid:
+  case kInt8Oid:
+  case kOidOid: {
+    int64_t result;
+    if (!ParseInt64Text(value, size, &result)) {
+      return invalid();
+    }
+    int64_t min = oid == kInt2Oid   ? INT16_MIN
+                  : oid == kInt4Oid ? INT32_MIN
+                  : oid == kOidOid  ? 0
+                                    : INT64_MIN;
+    int64_t max = oid == kInt2Oid   ? INT16_MAX
+                  : oid == kInt4Oid ? INT32_MAX
+                  : oid == kOidOid  ? UINT32_MAX
+                                    : INT64_MAX;
+    if (result < min || result > max) {
+      return invalid();
+    }
+    return ArrowArrayAppendInt(out, result);
+  }
+  case kFloat4Oid:
+  case kFloat8Oid: {
+    double result;
+    if (!ParseDoubleText(value, size, &result)) {
+      return invalid();
+    }
+    return ArrowArrayAppendDouble(out, result);
+  }
+  case kDateOid: {
+    int32_t days;
+    if (!ParseDateText(value, size, &days)) {
+      return invalid();
+    }
+    return ArrowArrayAppendInt(out, days);
+  }
+  case kTimeOid: {
+    int64_t micros;
+    if (!ParseTimeText(value, size, &micros)) {
+      return invalid();
+    }
+    return ArrowArrayAppendInt(out, micros);
+  }
+  case kTimestampOid:
+  case kTimestampTzOid: {
+    int64_t micros;
+    if (!ParseTimestampText(value, size, &micros)) {
+      return invalid();
+    }
+    return ArrowArrayAppendInt(out, micros);
+  }
+  case kIntervalOid: {
+    struct ArrowInterval interval;
+    ArrowIntervalInit(&interval, NANOARROW_TYPE_INTERVAL_MONTH_DAY_NANO);
+    int64_t micros;
+    if (!ParseIntervalText(value, size, &interval.months, &interval.days,
+                           &micros)) {
+      return invalid();
+    }
+    interval.ns = micros * 1000;
+    return ArrowArrayAppendInterval(out, &interval);
+  }
+  case kByteaOid:
+    if (!DecodeHexBytea(value, length, scratch)) {
+      return invalid();
+    }
+    return AppendBytes(out, scratch->data(), scratch->size());
+  default:
+    // Numeric, UUID, JSON and the text types are already their text
+    return AppendBytes(out, value, length);
+  }
+}
+
+// How a result column is decoded
+struct PostgresColumn {
+  Oid oid;
+  int32_t decimal_scale = -1; // Numeric decoded as decimal128 when >= 0
+};
+
+// Append a non-null value the column's buffers were reserved for
+template <typename T>
+ArrowErrorCode AppendReserved(struct ArrowArray *out, T value) {
+  struct ArrowBitmap *validity = ArrowArrayValidityBitmap(out);
+  if (validity->buffer.data) {
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapAppend(validity, 1, 1));
+  }
+  ArrowBufferAppendUnsafe(ArrowArrayBuffer(out, 1), &value, sizeof(T));
+  out->length++;
+  return NANOARROW_OK;
+}
+
+// Decode a binary fixed-width column of n_rows rows, with room reserved
+// for them, straight into its data buffer: decode turns the size bytes of
+// a value into the buffer's type
+template <typename T, typename Decode>
+ArrowErrorCode AppendFixedColumn(const PGresult *result, int col, int n_rows,
+                                 int size, Decode decode,
+                                 struct ArrowArray *out, ArrowError *error) {
+  for (int row = 0; row < n_rows; row++) {
+    if (PQgetisnull(result, row, col)) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(out, 1));
+      continue;
+    }
+    int length = PQgetlength(result, row, col);
+    if (length != size) {
+      ArrowErrorSet(error, "Type %u value has %d bytes, expected %d",
+                    static_cast<unsigned>(PQftype(result, col)), length,
+                    size);
+      return EINVAL;
+    }
+    NANOARROW_RETURN_NOT_OK(
+        AppendReserved<T>(out, decode(PQgetvalue(result, row, col))));
+  }
+  return NANOARROW_OK;
+}
+
+// Decode a column of the n_rows rows of a result into its builder. The
+// fixed-width binary types go through a converter for their type, one
+// call per column rather than per value; the rest a value at a time.
+ArrowErrorCode AppendColumn(const PGresult *result, int col, int n_rows,
+                            const PostgresColumn &column, std::string *scratch,
+                            struct ArrowArray *out, ArrowError *error) {
+  NANOARROW_RETURN_NOT_OK(ArrowArrayReserve(out, n_rows));
+  bool binary = PQfformat(result, col) != 0;
+  if (binary) {
+    switch (column.oid) {
+    case kInt2Oid:
+      return AppendFixedColumn<int16_t>(
+          result, col, n_rows, 2,
+          [](const char *v) { return static_cast<int16_t>(ReadBE16(v)); },
+          out, error);
+    case kInt4Oid:
+      return AppendFixedColumn<int32_t>(
+          result, col, n_rows, 4,
+          [](const char *v) { return static_cast<int32_t>(ReadBE32(v)); },
+          out, error);
+    case kInt8Oid:
+    case kTimeOid:
+      return AppendFixedColumn<int64_t>(
+          result, col, n_rows, 8,
+          [](const char *v) { return static_cast<int64_t>(ReadBE64(v)); },
+          out, error);
+    case kOidOid:
+      return AppendFixedColumn<uint32_t>(result, col, n_rows, 4, ReadBE32,
+                                         out, error);
+    case kFloat4Oid:
+      return AppendFixedColumn<float>(
+          result, col, n_rows, 4,
+          [](const char *v) {
+            uint32_t bits = ReadBE32(v);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+          },
+          out, error);
+    case kFloat8Oid:
+      return AppendFixedColumn<double>(
+          result, col, n_rows, 8,
+          [](const char *v) {
+            uint64_t bits = ReadBE64(v);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+          },
+          out, error);
+    case kDateOid:
+      return AppendFixedColumn<int32_t>(
+          result, col, n_rows, 4,
+          [](const char *v) {
+            auto days = static_cast<int32_t>(ReadBE32(v));
+            // Leave +/-infinity (INT32_MAX/MIN) as is rather than overflow
+            if (days != INT32_MAX && days != INT32_MIN) {
+              days += kPostgresEpochDays;
+            }
+            return days;
+          },
+          out, error);
+    case kTimestampOid:
+    case kTimestampTzOid:
+      return AppendFixedColumn<int64_t>(
+          result, col, n_rows, 8,
+          [](const char *v) {
+            auto micros = static_cast<int64_t>(ReadBE64(v));
+            // Leave +/-infinity (INT64_MAX/MIN) as is rather than overflow
+            if (micros != INT64_MAX && micros != INT64_MIN) {
+              micros += kPostgresEpochMicros;
+            }
+            return micros;
+          },
+          out, error);
+    default:
+      break;
+    }
+  }
+  if (column.decimal_scale < 0 &&
+      ArrowTypeForOid(column.oid) == NANOARROW_TYPE_STRING) {
+    // Reserve the bytes of the values up front, near enough for the types
+    // formatted as text
+    int64_t bytes = 0;
+    for (int row = 0; row < n_rows; row++) {
+      bytes += PQgetlength(result, row, col);
+    }
+    NANOARROW_RETURN_NOT_OK(
+        ArrowBufferReserve(ArrowArrayBuffer(out, 2), bytes));
+  }
+
+  for (int row = 0; row < n_rows; row++) {
+    if (PQgetisnull(result, row, col)) {
+      NANOARROW_RETURN_NOT_OK(ArrowArrayAppendNull(out, 1));
+      continue;
+    }
+    const char *value = PQgetvalue(result, row, col);
+    int length = PQgetlength(result, row, col);
+    ArrowErrorCode status;
+    if (column.decimal_scale >= 0) {
+      struct ArrowDecimal decimal;
+      if (binary) {
+        if (!NumericToDecimal(value, length, column.decimal_scale, &decimal,
+                              error)) {
+          return EINVAL;
+        }
+      } else if (!NumericTextToDecimal(value, length, column.decimal_scale,
+                                       &decimal)) {
+        ArrowErrorSet(error, "Invalid text value for numeric: '%.*s'",
+                      std::min(length, 64), value);
+        return EINVAL;
+      }
+      status = ArrowArrayAppendDecimal(out, &decimal);
+    } else if (binary) {
+      status = AppendValue(column.oid, value, length, scratch, out, error);
+    } else {
+      status = AppendTextValue(column.oid, value, length, scratch, out, error);
+    }
+    NANOARROW_RETURN_NOT_OK(status);
+  }
+  return NANOARROW_OK;
+}
+
+bool IsRowsStatus(ExecStatusType status) {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  if (status == PGRES_TUPLES_CHUNK) {
+    return true;
+  }
+#endif
+  return status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK;
+}
+
+std::string ResultErrorMessage(const PGresult *result) {
+#ifdef LIBPQ_HAS_PIPELINING
+  if (PQresultStatus(result) == PGRES_PIPELINE_ABORTED) {
+    return "Query not run: an earlier query of the pipeline failed";
+  }
+#endif
+  const char *sqlstate = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+  std::string message = PQresultErrorMessage(result);
+  while (!message.empty() && message.back() == '\n') {
+    message.pop_back();
+  }
+  return "Query error [" + std::string(sqlstate ? sqlstate : "") +
+         "]: " + message;
+}
+
+/// Send a query asking for binary results. libpq copies the parameters
+/// into its output buffer, so they need not outlive the call.
+int SendPostgresQuery(PGconn *conn, const PostgresQuery &query) {
+  const PostgresParams *params = query.params;
+  int n_params = params ? params->count : 0;
+  const char *const *values = params ? params->values : nullptr;
+  const int *lengths = params ? params->lengths : nullptr;
+  const int *formats = params ? params->formats : nullptr;
+  return query.statement_name.empty()
+             ? PQsendQueryParams(conn, query.sql.c_str(), n_params,
+                                 params ? params->types : nullptr,
+                                 values, lengths, formats, /*resultFormat=*/1)
+             : PQsendQueryPrepared(conn, query.statement_name.c_str(),
+                                   n_params, values, lengths, formats,
+                                   /*resultFormat=*/1);
+}
+
+/// Row count reported by a command, -1 if it reports none
+int64_t CommandRows(PGresult *result) {
+  const char *rows = PQcmdTuples(result);
+  if (!rows || !*rows) {
+    return -1;
+  }
+  return std::strtoll(rows, nullptr, 10);
+}
+
+/// ArrowArrayStream private data for a query sent with PQsendQueryParams.
+///
+/// libpq hands the rows over in chunks (single rows before libpq 17); each
+/// get_next decodes chunks into the column builders until a batch is full.
+/// With Arrow IPC output, each row instead holds an Arrow IPC stream that
+/// is decoded by a CubeArrowReader, one row at a time. The connection
+/// cannot run another query until every result has been taken from it, so
+/// the stream drains it when released.
+class PostgresResultStream {
+public:
+  PostgresResultStream(PGconn *conn, int64_t batch_rows,
+                       const CubeReaderOptions *ipc_options,
+                       bool pipelined = false)
+      : conn_(conn), batch_rows_(batch_rows > 0 ? batch_rows : 1),
+        pipelined_(pipelined) {
+    std::memset(&schema_, 0, sizeof(schema_));
+    if (ipc_options) {
+      ipc_options_ = *ipc_options;
+    }
+  }
+
+  ~PostgresResultStream() {
+    if (pending_) {
+      PQclear(pending_);
+    }
+    if (!done_) {
+      // Stop the server from producing rows nobody will read; in a
+      // pipeline that would also cancel the queries sent after this one
+      PGcancel *cancel = pipelined_ ? nullptr : PQgetCancel(conn_);
+      if (cancel) {
+        char errbuf[256];
+        PQcancel(cancel, errbuf, sizeof(errbuf));
+        PQfreeCancel(cancel);
+      }
+      Drain();
+    }
+    if (schema_.release) {
+      ArrowSchemaRelease(&schema_);
+    }
+  }
+
+  /// Send the query and read up to its first result so the schema is known
+  AdbcStatusCode Start(const PostgresQuery &query, AdbcError *error) {
+    if (!SendPostgresQuery(conn_, query)) {
+      done_ = true;
+      SetNativeClientError(error, std::string("Failed to send query: ") +
+                                      PQerrorMessage(conn_));
+      return ADBC_STATUS_IO;
+    }
+    return Receive(error);
+  }
+
+  /// Read up to the first result of a query already sent, which must be
+  /// the next one on the connection
+  AdbcStatusCode Receive(AdbcError *error) {
+    // Without either mode the rows arrive as one result, which still works
+#ifdef LIBPQ_HAS_CHUNK_MODE
+    if (LibpqHasChunkedRowsMode()) {
+      PQsetChunkedRowsMode(conn_, static_cast<int>(std::min<int64_t>(
+                                      batch_rows_, INT32_MAX)));
+    } else {
+      PQsetSingleRowMode(conn_);
+    }
+#else
+    PQsetSingleRowMode(conn_);
+#endif
+
+    pending_ = PQgetResult(conn_);
+    if (!pending_) {
+      done_ = true;
+      SetNativeClientError(error, "Query returned no result");
+      return ADBC_STATUS_INTERNAL;
+    }
+    ExecStatusType result_status = PQresultStatus(pending_);
+    if (result_status == PGRES_COMMAND_OK ||
+        result_status == PGRES_EMPTY_QUERY) {
+      // No result set; the stream is an empty struct
+      rows_affected_ = CommandRows(pending_);
+      PQclear(pending_);
+      pending_ = nullptr;
+      Drain();
+    } else if (!IsRowsStatus(result_status)) {
+      SetNativeClientError(error, ResultErrorMessage(pending_));
+      PQclear(pending_);
+      pending_ = nullptr;
+      Drain();
+      return ADBC_STATUS_UNKNOWN;
+    }
+
+    int n_fields = pending_ ? PQnfields(pending_) : 0;
+    if (ipc_options_ && n_fields == 1 && PQftype(pending_, 0) == kByteaOid) {
+      return StartIpc(error);
+    }
+    ArrowSchemaInit(&schema_);
+    int status = ArrowSchemaSetTypeStruct(&schema_, n_fields);
+    for (int i = 0; i < n_fields && status == NANOARROW_OK; i++) {
+      Oid oid = PQftype(pending_, i);
+      int typmod = PQfmod(pending_, i);
+      PostgresColumn column{oid};
+      int32_t precision;
+      if (oid != kNumericOid ||
+          !NumericTypmod(typmod, &precision, &column.decimal_scale)) {
+        column.decimal_scale = -1;
+      }
+      columns_.push_back(column);
+      status = SetColumnSchema(schema_.children[i], oid, PQfname(pending_, i),
+                               typmod);
+    }
+    if (status != NANOARROW_OK) {
+      SetNativeClientError(error, "Failed to build result schema");
+      return ADBC_STATUS_INTERNAL;
+    }
+    CUBE_LOG(Debug, "PostgresResultStream", "Result started",
+             {{"columns", n_fields}});
+    return ADBC_STATUS_OK;
+  }
+
+  int GetSchema(struct ArrowSchema *out) {
+    return ArrowSchemaDeepCopy(&schema_, out);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    if (!last_error_.empty()) {
+      return error_code_;
+    }
+    if (ipc_) {
+      return GetNextIpc(out);
+    }
+    if (done_ && !pending_) {
+      out->release = nullptr;
+      return NANOARROW_OK;
+    }
+
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    int status = ArrowArrayInitFromSchema(out, &schema_, &arrow_error);
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayStartAppending(out);
+    }
+    if (status != NANOARROW_OK) {
+      return Fail(status, "Failed to initialize result batch");
+    }
+
+    int64_t rows = 0;
+    while (rows < batch_rows_ && !done_) {
+      PGresult *result = pending_ ? pending_ : PQgetResult(conn_);
+      pending_ = nullptr;
+      if (!result) {
+        done_ = true;
+        break;
+      }
+      ExecStatusType result_status = PQresultStatus(result);
+      if (!IsRowsStatus(result_status)) {
+        std::string message = ResultErrorMessage(result);
+        PQclear(result);
+        Drain();
+        ArrowArrayRelease(out);
+        return Fail(EIO, message);
+      }
+      status = AppendRows(result, out, &arrow_error);
+      rows += PQntuples(result);
+      PQclear(result);
+      if (status != NANOARROW_OK) {
+        Drain();
+        ArrowArrayRelease(out);
+        return Fail(status, std::string("Failed to decode result: ") +
+                                arrow_error.message);
+      }
+      if (result_status == PGRES_TUPLES_OK) {
+        // The final result; whatever follows it is empty
+        Drain();
+      }
+    }
+
+    if (rows == 0) {
+      ArrowArrayRelease(out);
+      out->release = nullptr;
+      return NANOARROW_OK;
+    }
+    status = ArrowArrayFinishBuildingDefault(out, &arrow_error);
+    if (status != NANOARROW_OK) {
+      ArrowArrayRelease(out);
+      return Fail(status, std::string("Failed to finish result batch: ") +
+                              arrow_error.message);
+    }
+    CUBE_LOG(Trace, "PostgresResultStream", "Batch built", {{"rows", rows}});
+    return NANOARROW_OK;
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  /// Rows reported by a command without a result set, -1 otherwise
+  int64_t rows_affected() const { return rows_affected_; }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<PostgresResultStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<PostgresResultStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<PostgresResultStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<PostgresResultStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  /// Decode every row of a result into the column builders
+  int AppendRows(const PGresult *result, struct ArrowArray *out,
+                 ArrowError *error) {
+    int n_rows = PQntuples(result);
+    int n_fields = static_cast<int>(columns_.size());
+    if (PQnfields(result) != n_fields) {
+      ArrowErrorSet(error, "Result has %d columns, expected %d",
+                    PQnfields(result), n_fields);
+      return EINVAL;
+    }
+    // Column by column, so each is decoded by one converter into buffers
+    // reserved for the whole chunk
+    for (int col = 0; col < n_fields; col++) {
+      int status = AppendColumn(result, col, n_rows, columns_[col], &scratch_,
+                                out->children[col], error);
+      if (status != NANOARROW_OK) {
+        return status;
+      }
+    }
+    out->length += n_rows;
+    return NANOARROW_OK;
+  }
+
+  /// Read the first Arrow IPC stream of the result for its schema
+  AdbcStatusCode StartIpc(AdbcError *error) {
+    ipc_ = true;
+    CubeIpcBuffer bytes;
+    int status = NextIpcValue(&bytes);
+    if (status == ENOMSG) {
+      Fail(EINVAL, "Arrow IPC result holds no stream");
+    } else if (status == NANOARROW_OK) {
+      status = OpenIpcStream(std::move(bytes));
+      if (status == NANOARROW_OK &&
+          reader_->GetSchema(&schema_) != NANOARROW_OK) {
+        Fail(EINVAL, "Failed to copy result schema");
+      }
+    }
+    if (!last_error_.empty()) {
+      SetNativeClientError(error, last_error_);
+      return error_code_ == EIO ? ADBC_STATUS_UNKNOWN
+                                : ADBC_STATUS_INVALID_DATA;
+    }
+    CUBE_LOG(Debug, "PostgresResultStream", "Result is Arrow IPC");
+    return ADBC_STATUS_OK;
+  }
+
+  int GetNextIpc(struct ArrowArray *out) {
+    while (true) {
+      if (reader_) {
+        int status = reader_->GetNext(out);
+        if (status == NANOARROW_OK) {
+          return NANOARROW_OK;
+        }
+        if (status != ENOMSG) {
+          return Fail(status, "Failed to decode Arrow IPC record batch");
+        }
+        reader_.reset();
+      }
+      CubeIpcBuffer bytes;
+      int status = NextIpcValue(&bytes);
+      if (status == ENOMSG) {
+        out->release = nullptr;
+        return NANOARROW_OK;
+      }
+      if (status == NANOARROW_OK) {
+        status = OpenIpcStream(std::move(bytes));
+      }
+      if (status != NANOARROW_OK) {
+        return status;
+      }
+    }
+  }
+
+  /// Copy out the next row's value; ENOMSG once the result is exhausted
+  int NextIpcValue(CubeIpcBuffer *bytes) {
+    while (true) {
+      if (pending_ && pending_row_ < PQntuples(pending_)) {
+        if (PQnfields(pending_) != 1) {
+          return Fail(EINVAL, "Arrow IPC result must have one column");
+        }
+        auto value = reinterpret_cast<const uint8_t *>(
+            PQgetvalue(pending_, pending_row_, 0));
+        bytes->assign(value, value + PQgetlength(pending_, pending_row_, 0));
+        pending_row_++;
+        return NANOARROW_OK;
+      }
+      if (pending_) {
+        bool final = PQresultStatus(pending_) == PGRES_TUPLES_OK;
+        PQclear(pending_);
+        pending_ = nullptr;
+        pending_row_ = 0;
+        if (final) {
+          Drain();
+        }
+      }
+      if (done_) {
+        return ENOMSG;
+      }
+      pending_ = PQgetResult(conn_);
+      if (!pending_) {
+        done_ = true;
+        return ENOMSG;
+      }
+      if (!IsRowsStatus(PQresultStatus(pending_))) {
+        std::string message = ResultErrorMessage(pending_);
+        PQclear(pending_);
+        pending_ = nullptr;
+        Drain();
+        return Fail(EIO, message);
+      }
+    }
+  }
+
+  int OpenIpcStream(CubeIpcBuffer bytes) {
+    auto reader =
+        std::make_unique<CubeArrowReader>(std::move(bytes), *ipc_options_);
+    ArrowError arrow_error;
+    std::memset(&arrow_error, 0, sizeof(arrow_error));
+    int status = reader->Init(&arrow_error);
+    if (status != NANOARROW_OK) {
+      return Fail(status, std::string("Failed to initialize Arrow reader: ") +
+                              arrow_error.message);
+    }
+    reader_ = std::move(reader);
+    return NANOARROW_OK;
+  }
+
+  /// Take the results left on the connection so it can run another query
+  void Drain() {
+    while (PGresult *result = PQgetResult(conn_)) {
+      PQclear(result);
+    }
+    done_ = true;
+  }
+
+  int Fail(int code, const std::string &message) {
+    error_code_ = code;
+    last_error_ = message;
+    return code;
+  }
+
+  PGconn *conn_; // Non-owning; busy with this query until done_
+  int64_t batch_rows_;
+  bool pipelined_; // Later queries are queued behind this one
+  PGresult *pending_ = nullptr; // Result read but not yet decoded
+  bool done_ = false;           // Every result has been taken from conn_
+  int64_t rows_affected_ = -1;
+  std::vector<PostgresColumn> columns_;
+  struct ArrowSchema schema_;
+  std::string scratch_; // Text of a numeric or uuid value being appended
+  std::string last_error_;
+  int error_code_ = NANOARROW_OK;
+
+  // Arrow IPC output: set when the server may send it; ipc_ once the
+  // result turned out to be a single bytea column of IPC streams
+  std::optional<CubeReaderOptions> ipc_options_;
+  bool ipc_ = false;
+  int pending_row_ = 0; // Next row of pending_ to decode
+  std::unique_ptr<CubeArrowReader> reader_;
+};
+
+#ifdef LIBPQ_HAS_PIPELINING
+/// Queries sent back to back in libpq pipeline mode, ended by one Sync.
+///
+/// Their results come off the connection in the order the queries were
+/// sent. The query whose result is next is read straight from the
+/// connection by a PostgresResultStream; reading a later query first moves
+/// the batches of those before it into memory (or drops them if their
+/// stream was released). Once every result has been taken, the Sync is
+/// read and the connection leaves pipeline mode.
+class PostgresPipeline {
+public:
+  PostgresPipeline(PGconn *conn, int64_t batch_rows,
+                   const CubeReaderOptions *ipc_options)
+      : conn_(conn), batch_rows_(batch_rows) {
+    if (ipc_options) {
+      ipc_options_ = *ipc_options;
+    }
+  }
+
+  ~PostgresPipeline() { Advance(slots_.size()); }
+
+  /// Enter pipeline mode and send every query, then the Sync
+  AdbcStatusCode Send(const std::vector<PostgresQuery> &queries,
+                      AdbcError *error) {
+    if (!PQenterPipelineMode(conn_)) {
+      SetNativeClientError(error, std::string("Failed to enter pipeline "
+                                              "mode: ") +
+                                      PQerrorMessage(conn_));
+      return ADBC_STATUS_IO;
+    }
+    active_ = true;
+    AdbcStatusCode status = ADBC_STATUS_OK;
+    for (const auto &query : queries) {
+      if (!SendPostgresQuery(conn_, query)) {
+        SetNativeClientError(error, std::string("Failed to send query: ") +
+                                        PQerrorMessage(conn_));
+        status = ADBC_STATUS_IO;
+        break;
+      }
+      slots_.emplace_back();
+    }
+    if (!PQpipelineSync(conn_) && status == ADBC_STATUS_OK) {
+      SetNativeClientError(error, std::string("Failed to send sync: ") +
+                                      PQerrorMessage(conn_));
+      status = ADBC_STATUS_IO;
+    }
+    if (status != ADBC_STATUS_OK) {
+      // The queries already sent are read and dropped
+      Advance(slots_.size());
+    }
+    return status;
+  }
+
+  size_t size() const { return slots_.size(); }
+
+  int GetSchema(size_t index, struct ArrowSchema *out) {
+    Slot &slot = slots_[index];
+    if (!slot.schema->release) {
+      Advance(index);
+    }
+    if (slot.code != NANOARROW_OK) {
+      return slot.code;
+    }
+    return ArrowSchemaDeepCopy(slot.schema.get(), out);
+  }
+
+  int GetNext(size_t index, struct ArrowArray *out) {
+    Slot &slot = slots_[index];
+    if (!slot.buffered.empty()) {
+      ArrowArrayMove(slot.buffered.front().get(), out);
+      slot.buffered.erase(slot.buffered.begin());
+      return NANOARROW_OK;
+    }
+    if (slot.code != NANOARROW_OK) {
+      return slot.code;
+    }
+    if (slot.read) {
+      out->release = nullptr;
+      return NANOARROW_OK;
+    }
+    Advance(index);
+    if (!slot.stream) {
+      return GetNext(index, out);
+    }
+    int status = slot.stream->GetNext(out);
+    if (status != NANOARROW_OK || !out->release) {
+      Finish(slot, status);
+    }
+    return status;
+  }
+
+  const char *GetLastError(size_t index) const {
+    return slots_[index].error.c_str();
+  }
+
+  /// Drop what was buffered for the query; its later results are skipped
+  void Release(size_t index) {
+    slots_[index].released = true;
+    slots_[index].buffered.clear();
+  }
+
+  /// Read each query through to the end for its row count; the total is
+  /// -1 if any query reports none
+  AdbcStatusCode CountRows(int64_t *rows_affected, AdbcError *error) {
+    *rows_affected = 0;
+    for (size_t i = 0; i < slots_.size(); i++) {
+      Release(i);
+      Advance(i + 1);
+      Slot &slot = slots_[i];
+      if (slot.code != NANOARROW_OK) {
+        SetNativeClientError(error, slot.error);
+        return ADBC_STATUS_UNKNOWN;
+      }
+      *rows_affected = (*rows_affected < 0 || slot.rows_affected < 0)
+                           ? -1
+                           : *rows_affected + slot.rows_affected;
+    }
+    return ADBC_STATUS_OK;
+  }
+
+private:
+  struct Slot {
+    // Reads the query's results off the connection while it is next_
+    std::unique_ptr<PostgresResultStream> stream;
+    nanoarrow::UniqueSchema schema;
+    std::vector<nanoarrow::UniqueArray> buffered;
+    int64_t rows_affected = -1;
+    bool read = false; // Every result has been taken from the connection
+    bool released = false;
+    std::string error;
+    int code = NANOARROW_OK;
+  };
+
+  /// Take every result before the query at index off the connection and
+  /// start reading that one
+  void Advance(size_t index) {
+    while (next_ < slots_.size() && next_ <= index) {
+      Slot &slot = slots_[next_];
+      if (!slot.stream) {
+        Start(slot);
+        continue;
+      }
+      if (next_ == index) {
+        return;
+      }
+      int status;
+      while (true) {
+        nanoarrow::UniqueArray batch;
+        status = slot.stream->GetNext(batch.get());
+        if (status != NANOARROW_OK || !batch->release) {
+          break;
+        }
+        if (!slot.released) {
+          slot.buffered.push_back(std::move(batch));
+        }
+      }
+      Finish(slot, status);
+    }
+    if (next_ == slots_.size()) {
+      End();
+    }
+  }
+
+  void Start(Slot &slot) {
+    slot.stream = std::make_unique<PostgresResultStream>(
+        conn_, batch_rows_, ipc_options_ ? &*ipc_options_ : nullptr,
+        /*pipelined=*/true);
+    AdbcError error = ADBC_ERROR_INIT;
+    AdbcStatusCode status = slot.stream->Receive(&error);
+    if (status != ADBC_STATUS_OK) {
+      slot.code = EIO;
+      slot.error = error.message ? error.message : "Query failed";
+      if (error.release) {
+        error.release(&error);
+      }
+      Finish(slot, EIO);
+      return;
+    }
+    slot.rows_affected = slot.stream->rows_affected();
+    if (slot.stream->GetSchema(slot.schema.get()) != NANOARROW_OK) {
+      slot.code = ENOMEM;
+      slot.error = "Failed to copy result schema";
+    }
+  }
+
+  /// The query's results are all off the connection; move on to the next
+  void Finish(Slot &slot, int status) {
+    if (status != NANOARROW_OK && slot.code == NANOARROW_OK) {
+      slot.code = status;
+      slot.error = slot.stream->GetLastError();
+    }
+    slot.stream.reset();
+    slot.read = true;
+    if (++next_ == slots_.size()) {
+      End();
+    }
+  }
+
+  /// Read the Sync and leave pipeline mode
+  void End() {
+    if (!active_) {
+      return;
+    }
+    active_ = false;
+    while (PGresult *result = PQgetResult(conn_)) {
+      bool sync = PQresultStatus(result) == PGRES_PIPELINE_SYNC;
+      PQclear(result);
+      if (sync) {
+        break;
+      }
+    }
+    PQexitPipelineMode(conn_);
+  }
+
+  PGconn *conn_; // Non-owning; in pipeline mode while active_
+  int64_t batch_rows_;
+  std::optional<CubeReaderOptions> ipc_options_;
+  std::vector<Slot> slots_; // One per query sent
+  size_t next_ = 0;         // Query whose results are next on conn_
+  bool active_ = false;
+};
+
+/// ArrowArrayStream private data for one query of a PostgresPipeline
+class PipelinedResultStream {
+public:
+  PipelinedResultStream(std::shared_ptr<PostgresPipeline> pipeline,
+                        size_t index)
+      : pipeline_(std::move(pipeline)), index_(index) {}
+
+  ~PipelinedResultStream() { pipeline_->Release(index_); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      auto *self = static_cast<PipelinedResultStream *>(stream->private_data);
+      return self->pipeline_->GetSchema(self->index_, schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      auto *self = static_cast<PipelinedResultStream *>(stream->private_data);
+      return self->pipeline_->GetNext(self->index_, array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      auto *self = static_cast<PipelinedResultStream *>(stream->private_data);
+      return self->pipeline_->GetLastError(self->index_);
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<PipelinedResultStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::shared_ptr<PostgresPipeline> pipeline_;
+  size_t index_;
+};
+#endif
+
+} // namespace
+
+std::optional<PostgresOutputFormat>
+ParsePostgresOutputFormat(std::string_view name) {
+  if (name == "auto") {
+    return PostgresOutputFormat::Auto;
+  } else if (name == "arrow_ipc") {
+    return PostgresOutputFormat::ArrowIpc;
+  } else if (name == "binary") {
+    return PostgresOutputFormat::Binary;
+  }
+  return std::nullopt;
+}
+
+bool EnablePostgresArrowOutput(PGconn *conn, std::string *message) {
+  const char *server_version = PQparameterStatus(conn, "server_version");
+  CUBE_LOG(Debug, "Postgres", "Asking for Arrow IPC output",
+           {{"server_version", server_version}});
+  // Servers without Arrow IPC output reject the unknown setting
+  PGresult *result = PQexec(conn, "SET output_format = 'arrow_ipc'");
+  bool ok = result && PQresultStatus(result) == PGRES_COMMAND_OK;
+  if (!ok && message) {
+    *message = result ? PQresultErrorMessage(result) : PQerrorMessage(conn);
+    while (!message->empty() && message->back() == '\n') {
+      message->pop_back();
+    }
+  }
+  if (result) {
+    PQclear(result);
+  }
+  return ok;
+}
+
+AdbcStatusCode PreparePostgresStatement(PGconn *conn, const std::string &name,
+                                        const std::string &sql,
+                                        struct ArrowSchema *result_schema,
+                                        struct ArrowSchema *parameter_schema,
+                                        std::vector<Oid> *parameter_types,
+                                        AdbcError *error) {
+  PGresult *result = PQprepare(conn, name.c_str(), sql.c_str(), 0, nullptr);
+  if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+    SetNativeClientError(error, result ? ResultErrorMessage(result)
+                                       : std::string("Failed to prepare: ") +
+                                             PQerrorMessage(conn));
+    if (result) {
+      PQclear(result);
+    }
+    return ADBC_STATUS_UNKNOWN;
+  }
+  PQclear(result);
+
+  result = PQdescribePrepared(conn, name.c_str());
+  if (!result || PQresultStatus(result) != PGRES_COMMAND_OK) {
+    SetNativeClientError(error, result ? ResultErrorMessage(result)
+                                       : std::string("Failed to describe: ") +
+                                             PQerrorMessage(conn));
+    if (result) {
+      PQclear(result);
+    }
+    ClosePostgresStatement(conn, name);
+    return ADBC_STATUS_UNKNOWN;
+  }
+
+  int n_fields = PQnfields(result);
+  int n_params = PQnparams(result);
+  std::memset(result_schema, 0, sizeof(*result_schema));
+  std::memset(parameter_schema, 0, sizeof(*parameter_schema));
+  ArrowSchemaInit(result_schema);
+  ArrowSchemaInit(parameter_schema);
+  int status = ArrowSchemaSetTypeStruct(result_schema, n_fields);
+  for (int i = 0; i < n_fields && status == NANOARROW_OK; i++) {
+    status = SetColumnSchema(result_schema->children[i], PQftype(result, i),
+                             PQfname(result, i), PQfmod(result, i));
+  }
+  if (status == NANOARROW_OK) {
+    status = ArrowSchemaSetTypeStruct(parameter_schema, n_params);
+  }
+  parameter_types->clear();
+  for (int i = 0; i < n_params && status == NANOARROW_OK; i++) {
+    Oid oid = PQparamtype(result, i);
+    parameter_types->push_back(oid);
+    std::string param_name = "$" + std::to_string(i + 1);
+    status = SetColumnSchema(parameter_schema->children[i], oid,
+                             param_name.c_str());
+  }
+  PQclear(result);
+  if (status != NANOARROW_OK) {
+    ArrowSchemaRelease(result_schema);
+    ArrowSchemaRelease(parameter_schema);
+    ClosePostgresStatement(conn, name);
+    SetNativeClientError(error, "Failed to build prepared statement schema");
+    return ADBC_STATUS_INTERNAL;
+  }
+  CUBE_LOG(Debug, "Postgres", "Prepared statement",
+           {{"name", name}, {"columns", n_fields}, {"parameters", n_params}});
+  return ADBC_STATUS_OK;
+}
+
+void ClosePostgresStatement(PGconn *conn, const std::string &name) {
+  // Statement names are generated by the driver, so they need no quoting
+  std::string sql = "DEALLOCATE " + name;
+  PGresult *result = PQexec(conn, sql.c_str());
+  if (result) {
+    PQclear(result);
+  }
+}
+
+AdbcStatusCode ExecutePostgresQuery(PGconn *conn, const PostgresQuery &query,
+                                    int64_t batch_rows,
+                                    const CubeReaderOptions *ipc_options,
+                                    struct ArrowArrayStream *out,
+                                    AdbcError *error, int64_t *rows_affected) {
+  std::memset(out, 0, sizeof(*out));
+  auto stream =
+      std::make_unique<PostgresResultStream>(conn, batch_rows, ipc_options);
+  auto status = stream->Start(query, error);
+  if (status != ADBC_STATUS_OK) {
+    return status;
+  }
+  if (rows_affected) {
+    *rows_affected = stream->rows_affected();
+  }
+  stream.release()->ExportTo(out);
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode ExecutePostgresUpdate(PGconn *conn, const PostgresQuery &query,
+                                     int64_t *rows_affected, AdbcError *error) {
+  *rows_affected = -1;
+  if (!SendPostgresQuery(conn, query)) {
+    SetNativeClientError(error, std::string("Failed to send query: ") +
+                                    PQerrorMessage(conn));
+    return ADBC_STATUS_IO;
+  }
+  // Rows a query returns are dropped as they arrive; only the count is kept
+  AdbcStatusCode status = ADBC_STATUS_OK;
+  while (PGresult *result = PQgetResult(conn)) {
+    ExecStatusType result_status = PQresultStatus(result);
+    if (result_status == PGRES_COMMAND_OK || result_status == PGRES_TUPLES_OK) {
+      *rows_affected = CommandRows(result);
+    } else if (result_status != PGRES_EMPTY_QUERY &&
+               status == ADBC_STATUS_OK) {
+      SetNativeClientError(error, ResultErrorMessage(result));
+      status = ADBC_STATUS_UNKNOWN;
+    }
+    PQclear(result);
+  }
+  return status;
+}
+
+
+AdbcStatusCode ExecutePostgresPipeline(
+    PGconn *conn, const std::vector<PostgresQuery> &queries,
+    int64_t batch_rows, const CubeReaderOptions *ipc_options,
+    std::vector<struct ArrowArrayStream> *out, AdbcError *error) {
+#ifdef LIBPQ_HAS_PIPELINING
+  if (LibpqHasPipelineMode()) {
+    auto pipeline =
+        std::make_shared<PostgresPipeline>(conn, batch_rows, ipc_options);
+    AdbcStatusCode status = pipeline->Send(queries, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    CUBE_LOG(Debug, "Postgres", "Pipeline sent",
+             {{"queries", queries.size()}});
+    out->resize(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+      (new PipelinedResultStream(pipeline, i))->ExportTo(&(*out)[i]);
+    }
+    return ADBC_STATUS_OK;
+  }
+#endif
+  SetNativeClientError(error, "libpq was built without pipeline mode");
+  return ADBC_STATUS_NOT_IMPLEMENTED;
+}
+
+AdbcStatusCode ExecutePostgresPipelineUpdate(
+    PGconn *conn, const std::vector<PostgresQuery> &queries,
+    int64_t *rows_affected, AdbcError *error) {
+#ifdef LIBPQ_HAS_PIPELINING
+  if (LibpqHasPipelineMode()) {
+    PostgresPipeline pipeline(conn, DEFAULT_POSTGRES_BATCH_ROWS, nullptr);
+    AdbcStatusCode status = pipeline.Send(queries, error);
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    return pipeline.CountRows(rows_affected, error);
+  }
+#endif
+  SetNativeClientError(error, "libpq was built without pipeline mode");
+  return ADBC_STATUS_NOT_IMPLEMENTED;
+}
+
+} // namespace adbc::cube
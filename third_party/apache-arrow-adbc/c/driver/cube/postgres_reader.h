@@ -0,0 +1,143 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Try to include real libpq, fall back to compatibility header
+#ifdef __has_include
+#if __has_include(<libpq-fe.h>)
+#include <libpq-fe.h>
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+#else
+#include "driver/cube/libpq_compat.h"
+#endif
+
+#include <arrow-adbc/adbc.h>
+#include <nanoarrow/nanoarrow.h>
+
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/parameter_converter.h"
+
+namespace adbc::cube {
+
+// Rows gathered into one Arrow batch on the PostgreSQL path
+constexpr int64_t DEFAULT_POSTGRES_BATCH_ROWS = 65536;
+
+// How results are requested on the PostgreSQL path
+enum class PostgresOutputFormat {
+  Auto,     // Arrow IPC when the server supports it, binary rows otherwise
+  ArrowIpc, // Arrow IPC; connecting fails when the server lacks it
+  Binary,   // Binary rows decoded by type OID
+};
+
+// Parse a PostgresOutputFormat from its option value ("auto", "arrow_ipc"
+// or "binary")
+std::optional<PostgresOutputFormat>
+ParsePostgresOutputFormat(std::string_view name);
+
+// Ask the server to send results as Arrow IPC. Returns false, with the
+// server's reason in message, when it does not support it; the connection
+// is still usable for binary rows.
+bool EnablePostgresArrowOutput(PGconn *conn, std::string *message);
+
+// Prepare sql on the server as the named statement, so running it skips
+// parsing and planning. result_schema receives the columns of its result
+// (an empty struct if it returns none), parameter_schema one column per
+// parameter, and parameter_types the type OID of each parameter.
+AdbcStatusCode PreparePostgresStatement(PGconn *conn, const std::string &name,
+                                        const std::string &sql,
+                                        struct ArrowSchema *result_schema,
+                                        struct ArrowSchema *parameter_schema,
+                                        std::vector<Oid> *parameter_types,
+                                        AdbcError *error = nullptr);
+
+// Free a statement prepared by PreparePostgresStatement
+void ClosePostgresStatement(PGconn *conn, const std::string &name);
+
+// What ExecutePostgresQuery sends
+struct PostgresQuery {
+  std::string sql;
+  // Statement prepared by PreparePostgresStatement, run instead of sql
+  std::string statement_name;
+  // Bound parameter values; must outlive the call
+  const PostgresParams *params = nullptr;
+};
+
+// Run a query over the PostgreSQL protocol and stream its result as Arrow
+// batches.
+//
+// Every column is requested in binary format and each value is decoded
+// straight into the column's builder by type OID, so no text is parsed.
+// Rows are fetched in chunks of batch_rows (one row at a time with a libpq
+// older than 17), so the result is never held in memory as a whole. The
+// stream owns the connection until it is read to the end or released;
+// releasing it early cancels the query.
+//
+// When ipc_options is set, Arrow IPC output has been enabled on conn: a
+// result made of a single bytea column is read as one Arrow IPC stream per
+// row, decoded with those reader options, and its batches are passed
+// through unchanged.
+//
+// rows_affected, when set, receives the count of a command without a
+// result set, or -1.
+AdbcStatusCode ExecutePostgresQuery(PGconn *conn, const PostgresQuery &query,
+                                    int64_t batch_rows,
+                                    const CubeReaderOptions *ipc_options,
+                                    struct ArrowArrayStream *out,
+                                    AdbcError *error = nullptr,
+                                    int64_t *rows_affected = nullptr);
+
+// Run a query for its row count only (-1 if the server reports none); no
+// result stream is built.
+AdbcStatusCode ExecutePostgresUpdate(PGconn *conn, const PostgresQuery &query,
+                                     int64_t *rows_affected,
+                                     AdbcError *error = nullptr);
+
+// Send queries back to back in libpq pipeline mode, ended by one Sync, so
+// the server runs them without waiting for the client between queries.
+// out receives one stream per query, as ExecutePostgresQuery builds it.
+//
+// The results arrive in the order the queries were sent: reading a stream
+// before those of earlier queries holds their batches in memory until they
+// are read, and releasing a stream drops the rest of its result. The
+// connection leaves pipeline mode once every result has been taken. The
+// queries run as one implicit transaction, so if one fails none of them
+// takes effect and the streams of those after it fail too.
+//
+// Returns ADBC_STATUS_NOT_IMPLEMENTED when libpq is older than 14; run the
+// queries one at a time instead.
+AdbcStatusCode ExecutePostgresPipeline(
+    PGconn *conn, const std::vector<PostgresQuery> &queries,
+    int64_t batch_rows, const CubeReaderOptions *ipc_options,
+    std::vector<struct ArrowArrayStream> *out, AdbcError *error = nullptr);
+
+// Send queries in pipeline mode as ExecutePostgresPipeline does, for their
+// row counts only: rows_affected receives the sum of their counts, or -1
+// if any query reports none.
+AdbcStatusCode ExecutePostgresPipelineUpdate(
+    PGconn *conn, const std::vector<PostgresQuery> &queries,
+    int64_t *rows_affected, AdbcError *error = nullptr);
+
+} // namespace adbc::cube
@@ -0,0 +1,187 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/prefetch.h"
+
+#include <tuple>
+#include <utility>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/fork_guard.h"
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr std::chrono::minutes kBudgetWindow{1};
+
+// Bytes of IPC messages in a raw_ipc batch
+size_t RawBytes(const struct ArrowArray *array) {
+  const struct ArrowArray *column = array->children[0];
+  auto offsets = static_cast<const int64_t *>(column->buffers[1]);
+  return static_cast<size_t>(offsets[column->offset + column->length] -
+                             offsets[column->offset]);
+}
+
+void ReleaseError(struct AdbcError *error) {
+  if (error->release) {
+    error->release(error);
+  }
+}
+
+} // namespace
+
+CubePrefetcher::CubePrefetcher(CubePrefetchOptions options,
+                               std::shared_ptr<NativeClientPool> pool,
+                               std::shared_ptr<CubeResultCache> cache)
+    : options_(options), pool_(std::move(pool)), cache_(std::move(cache)),
+      window_start_(std::chrono::steady_clock::now()),
+      fork_generation_(CubeForkGeneration()) {
+  thread_ = std::thread(&CubePrefetcher::Run, this);
+}
+
+CubePrefetcher::~CubePrefetcher() {
+  if (fork_generation_ != CubeForkGeneration()) {
+    // The thread stayed in the parent, still counted as waiting on
+    // queued_cv_, so it is neither woken nor joined
+    thread_.detach();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queued_cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void CubePrefetcher::Submit(CubePrefetchRequest request) {
+  if (options_.max_queued == 0 || cache_->Contains(request.key)) {
+    return;
+  }
+  if (fork_generation_ != CubeForkGeneration()) {
+    // Nothing runs queries in a forked child
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &queued : queue_) {
+      if (queued.key == request.key) {
+        return;
+      }
+    }
+    if (queue_.size() >= options_.max_queued) {
+      // Navigation moved on; the newest guess is the likelier one
+      queue_.pop_front();
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    queue_.push_back(std::move(request));
+  }
+  queued_cv_.notify_one();
+}
+
+void CubePrefetcher::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    queued_cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    CubePrefetchRequest request = std::move(queue_.front());
+    queue_.pop_front();
+    lock.unlock();
+    Prefetch(request);
+    lock.lock();
+  }
+}
+
+void CubePrefetcher::Prefetch(const CubePrefetchRequest &request) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - window_start_ >= kBudgetWindow) {
+    window_start_ = now;
+    spent_ = 0;
+  }
+  if (cache_->Contains(request.key)) {
+    return;
+  }
+  size_t remaining =
+      spent_ < options_.budget_bytes ? options_.budget_bytes - spent_ : 0;
+  std::unique_ptr<NativeClient> client;
+  if (remaining > 0) {
+    client = pool_->Acquire(request.endpoint, request.token);
+  }
+  if (!client) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  CubeReaderOptions options;
+  options.raw_ipc = true;
+  options.priority = QueryPriority::Background;
+  options.view_types = request.view_types;
+  options.run_end_encoded = request.run_end_encoded;
+  QueryRequest query;
+  query.sql = request.sql;
+  auto capture = std::make_unique<CubeResultCapture>(cache_, request.key,
+                                                     client->IsSchemaOnce());
+  nanoarrow::UniqueArrayStream stream;
+  ResultSizeHint size_hint;
+  struct AdbcError error = ADBC_ERROR_INIT;
+  AdbcStatusCode code =
+      client->SendQuery(query, options, stream.get(), &error, nullptr,
+                        &size_hint, std::move(capture));
+  ReleaseError(&error);
+  bool complete = code == ADBC_STATUS_OK &&
+                  (size_hint.bytes < 0 ||
+                   static_cast<size_t>(size_hint.bytes) <= remaining);
+  size_t bytes = 0;
+  while (complete) {
+    nanoarrow::UniqueArray batch;
+    if (stream->get_next(stream.get(), batch.get()) != NANOARROW_OK) {
+      complete = false;
+      break;
+    }
+    if (!batch->release) {
+      break;
+    }
+    bytes += RawBytes(batch.get());
+    complete = bytes <= remaining;
+  }
+  spent_ += bytes;
+  if (complete) {
+    prefetched_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    if (code == ADBC_STATUS_OK) {
+      // Stop the server, and skip what it already sent so the session can
+      // go back to the pool
+      std::ignore = client->Cancel();
+    }
+  }
+  stream.reset();
+  if (client->IsConnected()) {
+    std::ignore = client->ReadPendingResponses(&error);
+    ReleaseError(&error);
+  }
+  pool_->Release(std::move(client), request.endpoint);
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,115 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "driver/cube/connection_pool.h"
+#include "driver/cube/result_cache.h"
+
+namespace adbc::cube {
+
+struct CubePrefetchOptions {
+  /// Bytes of results prefetched per minute; 0 disables prefetching
+  size_t budget_bytes = 0;
+  /// Queries waiting to run; the oldest is dropped to make room for another
+  size_t max_queued = 8;
+  /// After a roll-up query with a DATE_TRUNC time dimension, also prefetch
+  /// it one grain finer (see DrillDownQuery)
+  bool drill_down = false;
+};
+
+/// A query to run before it is asked for
+struct CubePrefetchRequest {
+  std::string sql;
+  std::string key;     // CubeResultCacheKey its result is stored under
+  std::string token;   // Security context it runs under
+  size_t endpoint = 0; // Server it runs on (see CubeEndpointSet)
+  // Sent with the query, as they are part of the key
+  bool view_types = false;
+  bool run_end_encoded = false;
+};
+
+/// Runs queries the application, or the drill-down heuristic, expects to
+/// be asked for next, so that they are answered from the result cache.
+///
+/// Owned by a CubeDatabase. Queries run one at a time on a background
+/// thread, at QueryPriority::Background, and only on sessions idle in the
+/// pool: a query finding none is dropped rather than opening one, as is
+/// one already cached. Their results are read as raw IPC, without being
+/// decoded. The bytes read are charged to a budget renewed every minute; a
+/// result that would take more than what is left is cancelled and not
+/// stored. Thread-safe. In a forked child, whose copy has no thread, every
+/// query is dropped.
+class CubePrefetcher {
+public:
+  CubePrefetcher(CubePrefetchOptions options,
+                 std::shared_ptr<NativeClientPool> pool,
+                 std::shared_ptr<CubeResultCache> cache);
+  /// Waits for the query running, if any; queued ones are dropped
+  ~CubePrefetcher();
+
+  CubePrefetcher(const CubePrefetcher &) = delete;
+  CubePrefetcher &operator=(const CubePrefetcher &) = delete;
+
+  const CubePrefetchOptions &options() const { return options_; }
+
+  /// Queue a query, unless its result is cached or it is already queued
+  void Submit(CubePrefetchRequest request);
+
+  /// Results stored in the cache
+  int64_t prefetched() const {
+    return prefetched_.load(std::memory_order_relaxed);
+  }
+  /// Queries dropped: pushed out of the queue, without an idle session, or
+  /// over the budget
+  int64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  /// Run queued queries until stopped
+  void Run();
+  /// Run one query on an idle session, storing its result if it completes
+  /// within budget
+  void Prefetch(const CubePrefetchRequest &request);
+
+  const CubePrefetchOptions options_;
+  const std::shared_ptr<NativeClientPool> pool_;
+  const std::shared_ptr<CubeResultCache> cache_;
+  std::mutex mutex_;
+  std::condition_variable queued_cv_;
+  std::deque<CubePrefetchRequest> queue_; // Oldest first
+  bool stopping_ = false;
+  // Budget spent since window_start_; only used by the thread
+  std::chrono::steady_clock::time_point window_start_;
+  size_t spent_ = 0;
+  std::atomic<int64_t> prefetched_{0};
+  std::atomic<int64_t> dropped_{0};
+  const uint64_t fork_generation_; // CubeForkGeneration() of thread_
+  std::thread thread_;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,1873 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/rechunk_stream.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+namespace {
+
+// A column slice: the source column with its offset moved, holding the
+// whole source batch alive
+struct SlicePrivate {
+  std::shared_ptr<nanoarrow::UniqueArray> batch;
+  std::vector<struct ArrowArray> columns;
+  std::vector<struct ArrowArray *> column_pointers;
+  const void *validity = nullptr; // The slice has no null rows
+};
+
+void ReleaseColumnSlice(struct ArrowArray *array) {
+  // Buffers, children and dictionary belong to the source batch
+  array->release = nullptr;
+}
+
+void ReleaseSlice(struct ArrowArray *array) {
+  auto *slice = static_cast<SlicePrivate *>(array->private_data);
+  delete slice;
+  array->private_data = nullptr;
+  array->release = nullptr;
+}
+
+} // namespace
+
+void ExportSlice(const std::shared_ptr<nanoarrow::UniqueArray> &batch,
+                 int64_t offset, int64_t length, struct ArrowArray *out) {
+  const struct ArrowArray *source = batch->get();
+  auto *slice = new SlicePrivate();
+  slice->batch = batch;
+  slice->columns.resize(static_cast<size_t>(source->n_children));
+  for (int64_t i = 0; i < source->n_children; i++) {
+    struct ArrowArray &column = slice->columns[i];
+    column = *source->children[i];
+    column.offset += source->offset + offset;
+    column.length = length;
+    // Unknown for the slice unless the whole column has none
+    column.null_count = column.null_count == 0 ? 0 : -1;
+    column.release = ReleaseColumnSlice;
+    column.private_data = nullptr;
+    slice->column_pointers.push_back(&column);
+  }
+  *out = *source;
+  out->length = length;
+  out->offset = 0;
+  out->null_count = 0;
+  out->buffers = &slice->validity;
+  out->children = slice->column_pointers.data();
+  out->release = ReleaseSlice;
+  out->private_data = slice;
+}
+
+namespace {
+
+// Whether AppendValue supports a column
+bool CanAppend(const struct ArrowArrayView &column) {
+  if (column.dictionary || column.n_children > 0) {
+    return false;
+  }
+  switch (column.storage_type) {
+  case NANOARROW_TYPE_NA:
+  case NANOARROW_TYPE_BOOL:
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+  case NANOARROW_TYPE_HALF_FLOAT:
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE:
+  case NANOARROW_TYPE_DECIMAL128:
+  case NANOARROW_TYPE_DECIMAL256:
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_BINARY_VIEW:
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Whether AppendValue supports every column of a struct schema
+bool CanMerge(const struct ArrowArrayView &view) {
+  for (int64_t i = 0; i < view.n_children; i++) {
+    if (!CanAppend(*view.children[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Append value i of column to out, of the same type
+ArrowErrorCode AppendValue(const struct ArrowArrayView &column, int64_t i,
+                           struct ArrowArray *out) {
+  if (ArrowArrayViewIsNull(&column, i)) {
+    return ArrowArrayAppendNull(out, 1);
+  }
+  switch (column.storage_type) {
+  case NANOARROW_TYPE_BOOL:
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+    return ArrowArrayAppendInt(out, ArrowArrayViewGetIntUnsafe(&column, i));
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+    return ArrowArrayAppendUInt(out, ArrowArrayViewGetUIntUnsafe(&column, i));
+  case NANOARROW_TYPE_HALF_FLOAT:
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE:
+    return ArrowArrayAppendDouble(out,
+                                  ArrowArrayViewGetDoubleUnsafe(&column, i));
+  case NANOARROW_TYPE_DECIMAL128:
+  case NANOARROW_TYPE_DECIMAL256: {
+    struct ArrowDecimal value;
+    ArrowDecimalInit(&value,
+                     column.storage_type == NANOARROW_TYPE_DECIMAL128 ? 128
+                                                                      : 256,
+                     0, 0);
+    ArrowArrayViewGetDecimalUnsafe(&column, i, &value);
+    return ArrowArrayAppendDecimal(out, &value);
+  }
+  case NANOARROW_TYPE_NA:
+    return ArrowArrayAppendNull(out, 1);
+  default:
+    return ArrowArrayAppendBytes(out, ArrowArrayViewGetBytesUnsafe(&column, i));
+  }
+}
+
+class RechunkedStream {
+public:
+  RechunkedStream(int64_t target_rows, struct ArrowArrayStream *source)
+      : target_rows_(target_rows) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    out->release = nullptr;
+    while (true) {
+      if (!batch_ || offset_ == (*batch_)->length) {
+        status = ReadSource();
+        if (status != NANOARROW_OK) {
+          return status;
+        }
+        if (!batch_) {
+          // End of the source: what was gathered is the last batch
+          return built_ > 0 ? FinishMerged(out) : NANOARROW_OK;
+        }
+      }
+      int64_t remaining = (*batch_)->length - offset_;
+      if (built_ == 0 && (remaining >= target_rows_ || !can_merge_)) {
+        int64_t length = std::min(remaining, target_rows_);
+        if (offset_ == 0 && length == remaining) {
+          ArrowArrayMove(batch_->get(), out);
+          batch_.reset();
+        } else {
+          ExportSlice(batch_, offset_, length, out);
+          offset_ += length;
+        }
+        return NANOARROW_OK;
+      }
+      int64_t take = std::min(remaining, target_rows_ - built_);
+      status = Append(offset_, take);
+      if (status != NANOARROW_OK) {
+        return status;
+      }
+      offset_ += take;
+      if (built_ == target_rows_) {
+        return FinishMerged(out);
+      }
+    }
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<RechunkedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<RechunkedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<RechunkedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<RechunkedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  // Read the schema and decide whether batches can be merged
+  int Init() {
+    if (schema_->release) {
+      return NANOARROW_OK;
+    }
+    int status = source_->get_schema(source_.get(), schema_.get());
+    if (status != NANOARROW_OK) {
+      return SourceError(status);
+    }
+    struct ArrowError error;
+    error.message[0] = '\0';
+    status = ArrowArrayViewInitFromSchema(view_.get(), schema_.get(), &error);
+    if (status != NANOARROW_OK) {
+      // A type the views do not know can still be passed through
+      view_.reset();
+      can_merge_ = false;
+      return NANOARROW_OK;
+    }
+    can_merge_ = view_->storage_type == NANOARROW_TYPE_STRUCT &&
+                 CanMerge(*view_.get());
+    return NANOARROW_OK;
+  }
+
+  // Take the next non-empty source batch; batch_ is left null at the end
+  int ReadSource() {
+    batch_.reset();
+    offset_ = 0;
+    while (true) {
+      auto next = std::make_shared<nanoarrow::UniqueArray>();
+      int status = source_->get_next(source_.get(), next->get());
+      if (status != NANOARROW_OK) {
+        return SourceError(status);
+      }
+      if (!(*next)->release) {
+        return NANOARROW_OK;
+      }
+      if ((*next)->length == 0) {
+        continue;
+      }
+      if (can_merge_) {
+        struct ArrowError error;
+        error.message[0] = '\0';
+        status = ArrowArrayViewSetArray(view_.get(), next->get(), &error);
+        if (status != NANOARROW_OK) {
+          last_error_ = std::string("Invalid batch: ") + error.message;
+          return status;
+        }
+      }
+      batch_ = std::move(next);
+      return NANOARROW_OK;
+    }
+  }
+
+  // Copy rows [offset, offset + length) of batch_ into merged_
+  int Append(int64_t offset, int64_t length) {
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int status = NANOARROW_OK;
+    if (!merged_->release) {
+      status = ArrowArrayInitFromSchema(merged_.get(), schema_.get(), &error);
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayStartAppending(merged_.get());
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayReserve(merged_.get(), target_rows_);
+      }
+    }
+    // Rows of a struct are offset into its columns by its own offset
+    offset += view_->offset;
+    for (int64_t row = offset; status == NANOARROW_OK && row < offset + length;
+         row++) {
+      for (int64_t i = 0; status == NANOARROW_OK && i < view_->n_children;
+           i++) {
+        status = AppendValue(*view_->children[i], row,
+                             merged_->children[i]);
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayFinishElement(merged_.get());
+      }
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ = std::string("Failed to merge batches: ") + error.message;
+      return status;
+    }
+    built_ += length;
+    return NANOARROW_OK;
+  }
+
+  int FinishMerged(struct ArrowArray *out) {
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int status = ArrowArrayFinishBuildingDefault(merged_.get(), &error);
+    if (status != NANOARROW_OK) {
+      last_error_ = std::string("Failed to merge batches: ") + error.message;
+      return status;
+    }
+    ArrowArrayMove(merged_.get(), out);
+    built_ = 0;
+    return NANOARROW_OK;
+  }
+
+  int SourceError(int status) {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  int64_t target_rows_;
+  nanoarrow::UniqueArrayStream source_;
+  nanoarrow::UniqueSchema schema_;
+  nanoarrow::UniqueArrayView view_;
+  bool can_merge_ = false;
+  // Source batch being split or merged, and its first row not yet output
+  std::shared_ptr<nanoarrow::UniqueArray> batch_;
+  int64_t offset_ = 0;
+  nanoarrow::UniqueArray merged_; // Rows gathered from small batches
+  int64_t built_ = 0;
+  std::string last_error_;
+};
+
+// Append value i of column n times to out. Fixed-width values are copied
+// into the buffer directly rather than appended one at a time.
+ArrowErrorCode AppendRepeated(const struct ArrowArrayView &column, int64_t i,
+                              int64_t n, struct ArrowArray *out) {
+  if (ArrowArrayViewIsNull(&column, i)) {
+    return ArrowArrayAppendNull(out, n);
+  }
+  int64_t bits = column.layout.element_size_bits[1];
+  if (column.layout.buffer_type[1] != NANOARROW_BUFFER_TYPE_DATA ||
+      bits == 0 || bits % 8 != 0) {
+    for (int64_t k = 0; k < n; k++) {
+      NANOARROW_RETURN_NOT_OK(AppendValue(column, i, out));
+    }
+    return NANOARROW_OK;
+  }
+  int64_t width = bits / 8;
+  const uint8_t *value =
+      column.buffer_views[1].data.as_uint8 + (column.offset + i) * width;
+  struct ArrowBitmap *validity = ArrowArrayValidityBitmap(out);
+  if (validity->buffer.data) {
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapAppend(validity, 1, n));
+  }
+  struct ArrowBuffer *data = ArrowArrayBuffer(out, 1);
+  NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(data, n * width));
+  for (int64_t k = 0; k < n; k++) {
+    ArrowBufferAppendUnsafe(data, value, width);
+  }
+  out->length += n;
+  return NANOARROW_OK;
+}
+
+// Top-level run-end encoded columns of a struct whose values AppendValue
+// supports
+std::vector<int64_t> ExpandableColumns(const struct ArrowArrayView &view) {
+  std::vector<int64_t> columns;
+  for (int64_t i = 0; i < view.n_children; i++) {
+    const struct ArrowArrayView *column = view.children[i];
+    if (column->storage_type == NANOARROW_TYPE_RUN_END_ENCODED &&
+        CanAppend(*column->children[1])) {
+      columns.push_back(i);
+    }
+  }
+  return columns;
+}
+
+// Replace the given columns of a struct schema with their values field
+ArrowErrorCode ReplaceWithValues(const std::vector<int64_t> &columns,
+                                 struct ArrowSchema *schema) {
+  for (int64_t i : columns) {
+    struct ArrowSchema *column = schema->children[i];
+    nanoarrow::UniqueSchema values;
+    NANOARROW_RETURN_NOT_OK(
+        ArrowSchemaDeepCopy(column->children[1], values.get()));
+    NANOARROW_RETURN_NOT_OK(ArrowSchemaSetName(values.get(), column->name));
+    ArrowSchemaRelease(column);
+    ArrowSchemaMove(values.get(), column);
+  }
+  return NANOARROW_OK;
+}
+
+// Run-end encoded columns of each batch expanded into their value type
+class RunEndExpandedStream {
+public:
+  explicit RunEndExpandedStream(struct ArrowArrayStream *source) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    status = source_->get_next(source_.get(), out);
+    if (status != NANOARROW_OK) {
+      return SourceError(status);
+    }
+    if (!out->release || columns_.empty()) {
+      return NANOARROW_OK;
+    }
+    struct ArrowError error;
+    error.message[0] = '\0';
+    status = ArrowArrayViewSetArray(view_.get(), out, &error);
+    for (size_t i = 0; status == NANOARROW_OK && i < columns_.size(); i++) {
+      status = Expand(columns_[i], out, &error);
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ =
+          std::string("Failed to expand run-end encoded column: ") +
+          error.message;
+      if (out->release) {
+        out->release(out);
+      }
+    }
+    return status;
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<RunEndExpandedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<RunEndExpandedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<RunEndExpandedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<RunEndExpandedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  // Read the source schema and replace each expandable run-end encoded
+  // column with its values field
+  int Init() {
+    if (schema_->release) {
+      return NANOARROW_OK;
+    }
+    nanoarrow::UniqueSchema source_schema;
+    int status = source_->get_schema(source_.get(), source_schema.get());
+    if (status != NANOARROW_OK) {
+      return SourceError(status);
+    }
+    struct ArrowError error;
+    error.message[0] = '\0';
+    if (ArrowArrayViewInitFromSchema(view_.get(), source_schema.get(),
+                                     &error) != NANOARROW_OK ||
+        view_->storage_type != NANOARROW_TYPE_STRUCT) {
+      // Nothing the views know how to expand
+      view_.reset();
+      ArrowSchemaMove(source_schema.get(), schema_.get());
+      return NANOARROW_OK;
+    }
+    columns_ = ExpandableColumns(*view_.get());
+    ArrowSchemaMove(source_schema.get(), schema_.get());
+    status = ReplaceWithValues(columns_, schema_.get());
+    if (status != NANOARROW_OK) {
+      last_error_ = "Failed to expand the run-end encoded schema";
+      schema_.reset();
+    }
+    return status;
+  }
+
+  // Replace column i of batch with its values, each repeated over its run
+  int Expand(int64_t i, struct ArrowArray *batch, struct ArrowError *error) {
+    const struct ArrowArrayView &column = *view_->children[i];
+    const struct ArrowArrayView &run_ends = *column.children[0];
+    const struct ArrowArrayView &values = *column.children[1];
+    nanoarrow::UniqueArray expanded;
+    NANOARROW_RETURN_NOT_OK(ArrowArrayInitFromSchema(
+        expanded.get(), schema_->children[i], error));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(expanded.get()));
+    NANOARROW_RETURN_NOT_OK(ArrowArrayReserve(expanded.get(), column.length));
+    // The whole child is expanded, so the batch's offset still applies
+    int64_t begin = column.offset;
+    int64_t end = begin + column.length;
+    int64_t run_start = 0;
+    for (int64_t run = 0; run < run_ends.length && run_start < end; run++) {
+      int64_t run_end = ArrowArrayViewGetIntUnsafe(&run_ends, run);
+      int64_t from = std::max(run_start, begin);
+      int64_t to = std::min(run_end, end);
+      if (to > from) {
+        NANOARROW_RETURN_NOT_OK(
+            AppendRepeated(values, run, to - from, expanded.get()));
+      }
+      run_start = run_end;
+    }
+    if (expanded->length != column.length) {
+      ArrowErrorSet(error, "Run ends cover %lld of %lld rows",
+                    static_cast<long long>(expanded->length),
+                    static_cast<long long>(column.length));
+      return EINVAL;
+    }
+    NANOARROW_RETURN_NOT_OK(
+        ArrowArrayFinishBuildingDefault(expanded.get(), error));
+    // The batch owns its children; the one replaced is released here
+    struct ArrowArray *child = batch->children[i];
+    child->release(child);
+    ArrowArrayMove(expanded.get(), child);
+    return NANOARROW_OK;
+  }
+
+  int SourceError(int status) {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  nanoarrow::UniqueArrayStream source_;
+  nanoarrow::UniqueSchema schema_;
+  nanoarrow::UniqueArrayView view_; // Of the source schema
+  std::vector<int64_t> columns_;    // Run-end encoded columns to expand
+  std::string last_error_;
+};
+
+// Stream returning the first max_rows rows of another, releasing it as
+// soon as they have been read
+class LimitedStream {
+public:
+  LimitedStream(int64_t max_rows, struct ArrowArrayStream *source)
+      : left_(max_rows) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    if (!schema_->release) {
+      int status = source_->get_schema(source_.get(), schema_.get());
+      if (status != NANOARROW_OK) {
+        return SourceError(status);
+      }
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    if (left_ == 0) {
+      out->release = nullptr;
+      return NANOARROW_OK;
+    }
+    int status = source_->get_next(source_.get(), out);
+    if (status != NANOARROW_OK) {
+      return SourceError(status);
+    }
+    if (!out->release || out->length < left_) {
+      left_ -= out->release ? out->length : 0;
+      return NANOARROW_OK;
+    }
+    if (out->length > left_) {
+      auto batch = std::make_shared<nanoarrow::UniqueArray>();
+      ArrowArrayMove(out, batch->get());
+      ExportSlice(batch, 0, left_, out);
+    }
+    left_ = 0;
+    // The schema outlives the source, which stops whatever feeds it
+    if (!schema_->release &&
+        source_->get_schema(source_.get(), schema_.get()) != NANOARROW_OK) {
+      schema_.reset();
+      return NANOARROW_OK;
+    }
+    source_.reset();
+    return NANOARROW_OK;
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<LimitedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<LimitedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<LimitedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<LimitedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  int SourceError(int status) {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  int64_t left_;
+  nanoarrow::UniqueArrayStream source_; // Released once left_ is 0
+  nanoarrow::UniqueSchema schema_;
+  std::string last_error_;
+};
+
+// A sampled result with its schema metadata marked, going on to the exact
+// result, if any, once the sample ends
+class ApproximateStream {
+public:
+  ApproximateStream(std::vector<std::pair<std::string, std::string>> metadata,
+                    struct ArrowArrayStream *sample,
+                    struct ArrowArrayStream *exact)
+      : metadata_(std::move(metadata)) {
+    ArrowArrayStreamMove(sample, source_.get());
+    if (exact && exact->release) {
+      ArrowArrayStreamMove(exact, exact_.get());
+    }
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    int status = EnsureSchema();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    if (!source_->release) {
+      if (!exact_->release) {
+        out->release = nullptr;
+        return NANOARROW_OK;
+      }
+      int status = exact_->get_next(exact_.get(), out);
+      return status == NANOARROW_OK ? status : SourceError(exact_, status);
+    }
+    int status = source_->get_next(source_.get(), out);
+    if (status != NANOARROW_OK) {
+      return SourceError(source_, status);
+    }
+    if (out->release || !exact_->release) {
+      return NANOARROW_OK;
+    }
+    // The sample is over: an empty batch ends it, as it ends a version of
+    // a subscription, and the exact result comes next
+    status = EnsureSchema();
+    nanoarrow::UniqueArray empty;
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayInitFromSchema(empty.get(), schema_.get(), nullptr);
+    }
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayStartAppending(empty.get());
+    }
+    if (status == NANOARROW_OK) {
+      status = ArrowArrayFinishBuildingDefault(empty.get(), nullptr);
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ = "Failed to build the end of the sampled result";
+      return status;
+    }
+    source_.reset();
+    ArrowArrayMove(empty.get(), out);
+    return NANOARROW_OK;
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<ApproximateStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<ApproximateStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<ApproximateStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<ApproximateStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  // The sample's schema with metadata_ set in its metadata
+  int EnsureSchema() {
+    if (schema_->release) {
+      return NANOARROW_OK;
+    }
+    nanoarrow::UniqueSchema schema;
+    int status = source_->get_schema(source_.get(), schema.get());
+    if (status != NANOARROW_OK) {
+      return SourceError(source_, status);
+    }
+    nanoarrow::UniqueBuffer metadata;
+    status = ArrowMetadataBuilderInit(metadata.get(), schema->metadata);
+    for (size_t i = 0; status == NANOARROW_OK && i < metadata_.size(); i++) {
+      const auto &[key, value] = metadata_[i];
+      status = ArrowMetadataBuilderSet(
+          metadata.get(), {key.data(), static_cast<int64_t>(key.size())},
+          {value.data(), static_cast<int64_t>(value.size())});
+    }
+    if (status == NANOARROW_OK) {
+      status = ArrowSchemaSetMetadata(
+          schema.get(), reinterpret_cast<const char *>(metadata->data));
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ = "Failed to mark the result schema approximate";
+      return status;
+    }
+    ArrowSchemaMove(schema.get(), schema_.get());
+    return NANOARROW_OK;
+  }
+
+  int SourceError(nanoarrow::UniqueArrayStream &source, int status) {
+    const char *message = source->get_last_error(source.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  std::vector<std::pair<std::string, std::string>> metadata_;
+  nanoarrow::UniqueArrayStream source_; // Released once the sample ends
+  nanoarrow::UniqueArrayStream exact_;
+  nanoarrow::UniqueSchema schema_;
+  std::string last_error_;
+};
+
+// What the streams of a tee share: the source, and the batches read from it
+// that an open stream has yet to return
+class TeeState {
+public:
+  TeeState(struct ArrowArrayStream *source, size_t count, int64_t max_buffered)
+      : positions_(count, 0), max_buffered_(max_buffered) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Not while another stream reads the source
+    cv_.wait(lock, [this] { return !reading_; });
+    if (status_ == NANOARROW_OK && !schema_->release) {
+      int status = source_->get_schema(source_.get(), schema_.get());
+      if (status != NANOARROW_OK) {
+        return SourceError(status);
+      }
+    }
+    if (status_ != NANOARROW_OK) {
+      return status_;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(size_t stream, struct ArrowArray *out) {
+    out->release = nullptr;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      int64_t position = positions_[stream];
+      if (position < first_ + static_cast<int64_t>(batches_.size())) {
+        auto batch = batches_[static_cast<size_t>(position - first_)];
+        positions_[stream]++;
+        Trim();
+        lock.unlock();
+        ExportSlice(batch, 0, (*batch)->length, out);
+        return NANOARROW_OK;
+      }
+      if (status_ != NANOARROW_OK) {
+        return status_;
+      }
+      if (finished_) {
+        return NANOARROW_OK;
+      }
+      if (reading_ ||
+          (max_buffered_ > 0 &&
+           static_cast<int64_t>(batches_.size()) >= max_buffered_)) {
+        cv_.wait(lock);
+        continue;
+      }
+
+      // One stream reads the source at a time, the others wait for it
+      reading_ = true;
+      lock.unlock();
+      auto next = std::make_shared<nanoarrow::UniqueArray>();
+      int status = source_->get_next(source_.get(), next->get());
+      lock.lock();
+      reading_ = false;
+      if (status != NANOARROW_OK) {
+        SourceError(status);
+      } else if (!(*next)->release) {
+        finished_ = true;
+      } else {
+        batches_.push_back(std::move(next));
+      }
+      cv_.notify_all();
+    }
+  }
+
+  // Set once, by the first error, before the failing call returns
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void Release(size_t stream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    positions_[stream] = kReleased;
+    Trim();
+  }
+
+private:
+  static constexpr int64_t kReleased = std::numeric_limits<int64_t>::max();
+
+  // Drop the batches every open stream has returned
+  void Trim() {
+    int64_t slowest = *std::min_element(positions_.begin(), positions_.end());
+    bool dropped = false;
+    while (!batches_.empty() && first_ < slowest) {
+      batches_.pop_front();
+      first_++;
+      dropped = true;
+    }
+    if (dropped) {
+      cv_.notify_all();
+    }
+  }
+
+  int SourceError(int status) {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read result";
+    status_ = status;
+    return status;
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  nanoarrow::UniqueArrayStream source_;
+  nanoarrow::UniqueSchema schema_;
+  std::deque<std::shared_ptr<nanoarrow::UniqueArray>> batches_;
+  int64_t first_ = 0;              // Index of batches_.front() in the result
+  std::vector<int64_t> positions_; // Next batch of each stream, or kReleased
+  int64_t max_buffered_;
+  bool reading_ = false;
+  bool finished_ = false;
+  int status_ = NANOARROW_OK;
+  std::string last_error_;
+};
+
+// One of the streams of a tee
+class TeeStream {
+public:
+  TeeStream(std::shared_ptr<TeeState> state, size_t index)
+      : state_(std::move(state)), index_(index) {}
+
+  ~TeeStream() { state_->Release(index_); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<TeeStream *>(stream->private_data)
+          ->state_->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      auto *tee = static_cast<TeeStream *>(stream->private_data);
+      return tee->state_->GetNext(tee->index_, array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<TeeStream *>(stream->private_data)
+          ->state_->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<TeeStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::shared_ptr<TeeState> state_;
+  size_t index_;
+};
+
+// Hash of value i of a column, for picking the stream a row goes to; 0 for
+// null
+uint64_t HashValue(const struct ArrowArrayView &column, int64_t i) {
+  if (ArrowArrayViewIsNull(&column, i)) {
+    return 0;
+  }
+  const uint8_t *data;
+  int64_t size;
+  uint8_t bit;
+  switch (column.storage_type) {
+  case NANOARROW_TYPE_NA:
+    return 0;
+  case NANOARROW_TYPE_BOOL:
+    bit = ArrowBitGet(column.buffer_views[1].data.as_uint8, column.offset + i);
+    data = &bit;
+    size = 1;
+    break;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_BINARY_VIEW:
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY: {
+    struct ArrowBufferView bytes = ArrowArrayViewGetBytesUnsafe(&column, i);
+    data = bytes.data.as_uint8;
+    size = bytes.size_bytes;
+    break;
+  }
+  default:
+    size = column.layout.element_size_bits[1] / 8;
+    data = column.buffer_views[1].data.as_uint8 + (column.offset + i) * size;
+    break;
+  }
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (int64_t j = 0; j < size; j++) {
+    hash = (hash ^ data[j]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// What the streams of a split share: the source, and the batches read from
+// it for each stream that it has yet to return
+class SplitState {
+public:
+  SplitState(struct ArrowArrayStream *source, size_t count,
+             int64_t key_column, int64_t max_buffered)
+      : queues_(count), released_(count, false), key_column_(key_column),
+        max_buffered_(max_buffered) {
+    ArrowArrayStreamMove(source, source_.get());
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !reading_; });
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(size_t stream, struct ArrowArray *out) {
+    out->release = nullptr;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      auto &queue = queues_[stream];
+      if (!queue.empty()) {
+        ArrowArrayMove(queue.front().get(), out);
+        queue.pop_front();
+        cv_.notify_all();
+        return NANOARROW_OK;
+      }
+      if (status_ != NANOARROW_OK) {
+        return status_;
+      }
+      if (finished_) {
+        return NANOARROW_OK;
+      }
+      if (reading_ || Full()) {
+        cv_.wait(lock);
+        continue;
+      }
+
+      // One stream reads and splits a batch at a time, the others wait
+      reading_ = true;
+      int status = Init();
+      bool end = false;
+      if (status == NANOARROW_OK) {
+        lock.unlock();
+        nanoarrow::UniqueArray batch;
+        status = source_->get_next(source_.get(), batch.get());
+        if (status != NANOARROW_OK) {
+          SetSourceError();
+        } else if (!batch->release) {
+          end = true;
+        } else if (batch->length > 0) {
+          status = Split(batch.get());
+        }
+        lock.lock();
+      }
+      reading_ = false;
+      if (status != NANOARROW_OK) {
+        status_ = status;
+      } else if (end) {
+        finished_ = true;
+      }
+      cv_.notify_all();
+    }
+  }
+
+  // Set once, by the first error, before the failing call returns
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void Release(size_t stream) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    released_[stream] = true;
+    queues_[stream].clear();
+    cv_.notify_all();
+  }
+
+private:
+  // Read the schema and, to split rows by key, check the columns; called
+  // with mutex_ held
+  int Init() {
+    if (schema_->release) {
+      return status_;
+    }
+    int status = source_->get_schema(source_.get(), schema_.get());
+    if (status != NANOARROW_OK) {
+      SetSourceError();
+      return status_ = status;
+    }
+    if (key_column_ < 0) {
+      return NANOARROW_OK;
+    }
+    struct ArrowError error;
+    error.message[0] = '\0';
+    status = ArrowArrayViewInitFromSchema(view_.get(), schema_.get(), &error);
+    if (status == NANOARROW_OK &&
+        (view_->storage_type != NANOARROW_TYPE_STRUCT ||
+         key_column_ >= view_->n_children || !CanMerge(*view_.get()))) {
+      ArrowErrorSet(&error, "Cannot split rows by column %lld of this schema",
+                    static_cast<long long>(key_column_));
+      status = EINVAL;
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ = error.message;
+      return status_ = status;
+    }
+    return NANOARROW_OK;
+  }
+
+  // Whether an open stream holds as many batches as may be buffered
+  bool Full() const {
+    if (max_buffered_ <= 0) {
+      return false;
+    }
+    for (const auto &queue : queues_) {
+      if (static_cast<int64_t>(queue.size()) >= max_buffered_) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Queue batch, or its rows, for the streams. Called by the one stream
+  // reading, without mutex_ held; only the queues are shared.
+  int Split(struct ArrowArray *batch) {
+    if (key_column_ < 0) {
+      nanoarrow::UniqueArray whole;
+      ArrowArrayMove(batch, whole.get());
+      Queue(next_++ % queues_.size(), std::move(whole));
+      return NANOARROW_OK;
+    }
+
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int status = ArrowArrayViewSetArray(view_.get(), batch, &error);
+    if (status != NANOARROW_OK) {
+      last_error_ = std::string("Invalid batch: ") + error.message;
+      return status;
+    }
+    const struct ArrowArrayView &key = *view_->children[key_column_];
+    std::vector<std::vector<int64_t>> rows(queues_.size());
+    for (int64_t i = 0; i < batch->length; i++) {
+      int64_t row = view_->offset + i;
+      rows[HashValue(key, row) % queues_.size()].push_back(row);
+    }
+    for (size_t stream = 0; stream < rows.size(); stream++) {
+      if (rows[stream].empty()) {
+        continue;
+      }
+      nanoarrow::UniqueArray part;
+      status = ArrowArrayInitFromSchema(part.get(), schema_.get(), &error);
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayStartAppending(part.get());
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayReserve(
+            part.get(), static_cast<int64_t>(rows[stream].size()));
+      }
+      for (size_t r = 0; status == NANOARROW_OK && r < rows[stream].size();
+           r++) {
+        for (int64_t i = 0; status == NANOARROW_OK && i < view_->n_children;
+             i++) {
+          status = AppendValue(*view_->children[i], rows[stream][r],
+                               part->children[i]);
+        }
+        if (status == NANOARROW_OK) {
+          status = ArrowArrayFinishElement(part.get());
+        }
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayFinishBuildingDefault(part.get(), &error);
+      }
+      if (status != NANOARROW_OK) {
+        last_error_ = std::string("Failed to split batch: ") + error.message;
+        return status;
+      }
+      Queue(stream, std::move(part));
+    }
+    return NANOARROW_OK;
+  }
+
+  void Queue(size_t stream, nanoarrow::UniqueArray batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!released_[stream]) {
+      queues_[stream].push_back(std::move(batch));
+    }
+  }
+
+  void SetSourceError() {
+    const char *message = source_->get_last_error(source_.get());
+    last_error_ = message ? message : "Failed to read data";
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  nanoarrow::UniqueArrayStream source_;
+  nanoarrow::UniqueSchema schema_;
+  nanoarrow::UniqueArrayView view_; // Of the batch being split by key
+  std::vector<std::deque<nanoarrow::UniqueArray>> queues_;
+  std::vector<bool> released_;
+  int64_t key_column_;
+  int64_t max_buffered_;
+  size_t next_ = 0; // Stream the next whole batch goes to
+  bool reading_ = false;
+  bool finished_ = false;
+  int status_ = NANOARROW_OK;
+  std::string last_error_;
+};
+
+// One of the streams of a split
+class SplitStream {
+public:
+  SplitStream(std::shared_ptr<SplitState> state, size_t index)
+      : state_(std::move(state)), index_(index) {}
+
+  ~SplitStream() { state_->Release(index_); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<SplitStream *>(stream->private_data)
+          ->state_->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      auto *split = static_cast<SplitStream *>(stream->private_data);
+      return split->state_->GetNext(split->index_, array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<SplitStream *>(stream->private_data)
+          ->state_->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<SplitStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  std::shared_ptr<SplitState> state_;
+  size_t index_;
+};
+
+// Compare value i of column a with value j of column b, both of one type
+// and neither null
+using CompareFunction = int (*)(const struct ArrowArrayView &a, int64_t i,
+                                const struct ArrowArrayView &b, int64_t j);
+
+template <typename T> int Compare3(T a, T b) { return (a > b) - (a < b); }
+
+int CompareInt(const struct ArrowArrayView &a, int64_t i,
+               const struct ArrowArrayView &b, int64_t j) {
+  return Compare3(ArrowArrayViewGetIntUnsafe(&a, i),
+                  ArrowArrayViewGetIntUnsafe(&b, j));
+}
+
+int CompareUInt(const struct ArrowArrayView &a, int64_t i,
+                const struct ArrowArrayView &b, int64_t j) {
+  return Compare3(ArrowArrayViewGetUIntUnsafe(&a, i),
+                  ArrowArrayViewGetUIntUnsafe(&b, j));
+}
+
+int CompareDouble(const struct ArrowArrayView &a, int64_t i,
+                  const struct ArrowArrayView &b, int64_t j) {
+  double x = ArrowArrayViewGetDoubleUnsafe(&a, i);
+  double y = ArrowArrayViewGetDoubleUnsafe(&b, j);
+  // NaN sorts after every other value, as on the server
+  if (std::isnan(x) || std::isnan(y)) {
+    return Compare3(std::isnan(x), std::isnan(y));
+  }
+  return Compare3(x, y);
+}
+
+int CompareBytes(const struct ArrowArrayView &a, int64_t i,
+                 const struct ArrowArrayView &b, int64_t j) {
+  struct ArrowBufferView x = ArrowArrayViewGetBytesUnsafe(&a, i);
+  struct ArrowBufferView y = ArrowArrayViewGetBytesUnsafe(&b, j);
+  int64_t common = std::min(x.size_bytes, y.size_bytes);
+  int c = common > 0 ? std::memcmp(x.data.data, y.data.data,
+                                   static_cast<size_t>(common))
+                     : 0;
+  return c != 0 ? Compare3(c, 0) : Compare3(x.size_bytes, y.size_bytes);
+}
+
+int CompareDecimal128(const struct ArrowArrayView &a, int64_t i,
+                      const struct ArrowArrayView &b, int64_t j) {
+  // Little-endian two's complement: the high word is signed
+  uint64_t x[2];
+  uint64_t y[2];
+  std::memcpy(x, a.buffer_views[1].data.as_uint8 + (a.offset + i) * 16, 16);
+  std::memcpy(y, b.buffer_views[1].data.as_uint8 + (b.offset + j) * 16, 16);
+  int c = Compare3(static_cast<int64_t>(x[1]), static_cast<int64_t>(y[1]));
+  return c != 0 ? c : Compare3(x[0], y[0]);
+}
+
+// How to compare a column of a storage type; null if it cannot be
+CompareFunction SortCompareFunction(ArrowType type) {
+  switch (type) {
+  case NANOARROW_TYPE_BOOL:
+  case NANOARROW_TYPE_INT8:
+  case NANOARROW_TYPE_INT16:
+  case NANOARROW_TYPE_INT32:
+  case NANOARROW_TYPE_INT64:
+    return CompareInt;
+  case NANOARROW_TYPE_UINT8:
+  case NANOARROW_TYPE_UINT16:
+  case NANOARROW_TYPE_UINT32:
+  case NANOARROW_TYPE_UINT64:
+    return CompareUInt;
+  case NANOARROW_TYPE_HALF_FLOAT:
+  case NANOARROW_TYPE_FLOAT:
+  case NANOARROW_TYPE_DOUBLE:
+    return CompareDouble;
+  case NANOARROW_TYPE_STRING:
+  case NANOARROW_TYPE_LARGE_STRING:
+  case NANOARROW_TYPE_STRING_VIEW:
+  case NANOARROW_TYPE_BINARY:
+  case NANOARROW_TYPE_LARGE_BINARY:
+  case NANOARROW_TYPE_BINARY_VIEW:
+  case NANOARROW_TYPE_FIXED_SIZE_BINARY:
+    return CompareBytes;
+  case NANOARROW_TYPE_DECIMAL128:
+    return CompareDecimal128;
+  default:
+    return nullptr;
+  }
+}
+
+// Storage type of column i of a struct schema, or NA if it has none
+ArrowType StorageType(const struct ArrowSchema *schema, int64_t i) {
+  struct ArrowSchemaView view;
+  if (ArrowSchemaViewInit(&view, schema->children[i], nullptr) !=
+      NANOARROW_OK) {
+    return NANOARROW_TYPE_NA;
+  }
+  return view.storage_type;
+}
+
+// Skip word, matched case-insensitively as a whole word, and the spaces
+// after it if text starts with it
+bool ConsumeWord(std::string_view *text, std::string_view word) {
+  if (text->size() < word.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < word.size(); i++) {
+    if (std::toupper(static_cast<unsigned char>((*text)[i])) != word[i]) {
+      return false;
+    }
+  }
+  if (text->size() > word.size() &&
+      !std::isspace(static_cast<unsigned char>((*text)[word.size()]))) {
+    return false;
+  }
+  text->remove_prefix(word.size());
+  while (!text->empty() &&
+         std::isspace(static_cast<unsigned char>(text->front()))) {
+    text->remove_prefix(1);
+  }
+  return true;
+}
+
+// A merged input and the row of its batch it is at
+struct MergeInput {
+  nanoarrow::UniqueArrayStream stream;
+  nanoarrow::UniqueArrayView view;
+  std::shared_ptr<nanoarrow::UniqueArray> batch;
+  int64_t row = 0; // Of the batch, not counting its offset
+  bool done = false;
+};
+
+class MergedStream {
+public:
+  MergedStream(std::vector<nanoarrow::UniqueArrayStream> inputs,
+               std::vector<CubeSortKey> keys, int64_t target_rows)
+      : inputs_(inputs.size()), keys_(std::move(keys)),
+        target_rows_(std::max<int64_t>(target_rows, 1)) {
+    for (size_t i = 0; i < inputs.size(); i++) {
+      inputs_[i].stream = std::move(inputs[i]);
+    }
+  }
+
+  int GetSchema(struct ArrowSchema *schema) {
+    int status = Init();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    return ArrowSchemaDeepCopy(schema_.get(), schema);
+  }
+
+  int GetNext(struct ArrowArray *out) {
+    out->release = nullptr;
+    int status = Start();
+    if (status != NANOARROW_OK) {
+      return status;
+    }
+    while (true) {
+      int winner = losers_.empty() ? -1 : losers_[0];
+      if (winner < 0 || inputs_[winner].done) {
+        return built_ > 0 ? FinishMerged(out) : NANOARROW_OK;
+      }
+      MergeInput &input = inputs_[winner];
+      int64_t run = RunLength(winner);
+      if (built_ == 0 && (run >= target_rows_ / 2 || !can_append_)) {
+        int64_t length = std::min(run, target_rows_);
+        ExportSlice(input.batch, input.row, length, out);
+        return Advance(winner, length);
+      }
+      int64_t take = std::min(run, target_rows_ - built_);
+      status = Append(input, take);
+      if (status == NANOARROW_OK) {
+        status = Advance(winner, take);
+      }
+      if (status != NANOARROW_OK) {
+        return status;
+      }
+      if (built_ == target_rows_) {
+        return FinishMerged(out);
+      }
+    }
+  }
+
+  const char *GetLastError() const { return last_error_.c_str(); }
+
+  void ExportTo(struct ArrowArrayStream *out) {
+    out->get_schema = [](struct ArrowArrayStream *stream,
+                         struct ArrowSchema *schema) {
+      return static_cast<MergedStream *>(stream->private_data)
+          ->GetSchema(schema);
+    };
+    out->get_next = [](struct ArrowArrayStream *stream,
+                       struct ArrowArray *array) {
+      return static_cast<MergedStream *>(stream->private_data)
+          ->GetNext(array);
+    };
+    out->get_last_error = [](struct ArrowArrayStream *stream) {
+      return static_cast<MergedStream *>(stream->private_data)
+          ->GetLastError();
+    };
+    out->release = [](struct ArrowArrayStream *stream) {
+      delete static_cast<MergedStream *>(stream->private_data);
+      stream->private_data = nullptr;
+      stream->release = nullptr;
+    };
+    out->private_data = this;
+  }
+
+private:
+  // Read the schema of the first input and check the sort columns
+  int Init() {
+    if (schema_->release) {
+      return status_;
+    }
+    if (inputs_.empty()) {
+      last_error_ = "No streams to merge";
+      return status_ = EINVAL;
+    }
+    int status = inputs_[0].stream->get_schema(inputs_[0].stream.get(),
+                                               schema_.get());
+    if (status != NANOARROW_OK) {
+      return status_ = InputError(0, status);
+    }
+    struct ArrowError error;
+    error.message[0] = '\0';
+    for (auto &input : inputs_) {
+      status = ArrowArrayViewInitFromSchema(input.view.get(), schema_.get(),
+                                            &error);
+      if (status != NANOARROW_OK) {
+        last_error_ = std::string("Cannot merge results: ") + error.message;
+        return status_ = status;
+      }
+    }
+    const struct ArrowArrayView &view = *inputs_[0].view.get();
+    for (const auto &key : keys_) {
+      CompareFunction compare = nullptr;
+      if (view.storage_type == NANOARROW_TYPE_STRUCT && key.column >= 0 &&
+          key.column < view.n_children) {
+        compare = SortCompareFunction(view.children[key.column]->storage_type);
+      }
+      if (!compare) {
+        last_error_ = "Cannot merge results on column " +
+                      std::to_string(key.column);
+        return status_ = EINVAL;
+      }
+      compare_.push_back(compare);
+    }
+    can_append_ = CanMerge(view);
+    return NANOARROW_OK;
+  }
+
+  // Read the first batch of every input and play the first tournament
+  int Start() {
+    if (started_) {
+      return status_;
+    }
+    started_ = true;
+    int status = Init();
+    for (size_t i = 0; status == NANOARROW_OK && i < inputs_.size(); i++) {
+      status = ReadInput(static_cast<int>(i));
+    }
+    if (status != NANOARROW_OK) {
+      return status_ = status;
+    }
+    // Every node starts out holding a sentinel that beats any input, so
+    // each input played in settles at the first node it loses at
+    losers_.assign(inputs_.size(), -1);
+    for (size_t i = 0; i < inputs_.size(); i++) {
+      Replay(static_cast<int>(i));
+    }
+    return NANOARROW_OK;
+  }
+
+  // Take the next non-empty batch of an input, or mark it done
+  int ReadInput(int i) {
+    MergeInput &input = inputs_[i];
+    input.row = 0;
+    while (true) {
+      auto next = std::make_shared<nanoarrow::UniqueArray>();
+      int status = input.stream->get_next(input.stream.get(), next->get());
+      if (status != NANOARROW_OK) {
+        return InputError(i, status);
+      }
+      if (!(*next)->release) {
+        input.batch.reset();
+        input.done = true;
+        return NANOARROW_OK;
+      }
+      if ((*next)->length == 0) {
+        continue;
+      }
+      struct ArrowError error;
+      error.message[0] = '\0';
+      status = ArrowArrayViewSetArray(input.view.get(), next->get(), &error);
+      if (status != NANOARROW_OK) {
+        last_error_ = std::string("Invalid batch: ") + error.message;
+        return status;
+      }
+      input.batch = std::move(next);
+      return NANOARROW_OK;
+    }
+  }
+
+  // Move an input past length rows and play it back up the tree
+  int Advance(int i, int64_t length) {
+    MergeInput &input = inputs_[i];
+    input.row += length;
+    if (input.row == (*input.batch)->length) {
+      int status = ReadInput(i);
+      if (status != NANOARROW_OK) {
+        return status_ = status;
+      }
+    }
+    Replay(i);
+    return NANOARROW_OK;
+  }
+
+  // Compare row i of input a with row j of input b on the sort keys
+  int CompareRows(const MergeInput &a, int64_t i, const MergeInput &b,
+                  int64_t j) const {
+    i += a.view->offset;
+    j += b.view->offset;
+    for (size_t k = 0; k < keys_.size(); k++) {
+      const struct ArrowArrayView &x = *a.view->children[keys_[k].column];
+      const struct ArrowArrayView &y = *b.view->children[keys_[k].column];
+      bool x_null = ArrowArrayViewIsNull(&x, i);
+      bool y_null = ArrowArrayViewIsNull(&y, j);
+      int c;
+      if (x_null || y_null) {
+        if (x_null == y_null) {
+          continue;
+        }
+        c = x_null == keys_[k].nulls_first ? -1 : 1;
+      } else {
+        c = compare_[k](x, i, y, j);
+        if (keys_[k].descending) {
+          c = -c;
+        }
+      }
+      if (c != 0) {
+        return c;
+      }
+    }
+    return 0;
+  }
+
+  // Whether the current row of input a comes before that of input b; -1
+  // is the sentinel that comes before all, and an input that is done comes
+  // after all. Equal rows go in input order.
+  bool Before(int a, int b) const {
+    if (a < 0 || b < 0) {
+      return a < 0;
+    }
+    if (inputs_[a].done || inputs_[b].done) {
+      return !inputs_[a].done;
+    }
+    int c = CompareRows(inputs_[a], inputs_[a].row, inputs_[b],
+                        inputs_[b].row);
+    return c < 0 || (c == 0 && a < b);
+  }
+
+  // Play input i from its leaf up to the root: each node keeps the loser
+  // of its match and sends the winner on; the overall winner is losers_[0]
+  void Replay(int i) {
+    int winner = i;
+    size_t count = inputs_.size();
+    for (size_t node = (i + count) / 2; node > 0; node /= 2) {
+      if (Before(losers_[node], winner)) {
+        std::swap(losers_[node], winner);
+      }
+    }
+    losers_[0] = winner;
+  }
+
+  // Rows of the winner's batch, from its current row, that come before the
+  // current row of every other input
+  int64_t RunLength(int winner) const {
+    // The next input in order is one the winner beat on its way up
+    int second = -1;
+    size_t count = inputs_.size();
+    for (size_t node = (winner + count) / 2; node > 0; node /= 2) {
+      int loser = losers_[node];
+      if (loser >= 0 && !inputs_[loser].done &&
+          (second < 0 || Before(loser, second))) {
+        second = loser;
+      }
+    }
+    const MergeInput &input = inputs_[winner];
+    int64_t end = (*input.batch)->length;
+    if (second < 0) {
+      return end - input.row;
+    }
+    const MergeInput &other = inputs_[second];
+    auto before = [&](int64_t row) {
+      int c = CompareRows(input, row, other, other.row);
+      return c < 0 || (c == 0 && winner < second);
+    };
+    // Gallop to bracket the first row that does not come first, then
+    // search the bracket
+    int64_t low = input.row + 1;
+    int64_t step = 1;
+    int64_t high = low;
+    while (high < end && before(high)) {
+      low = high + 1;
+      high = std::min(end, high + step);
+      step *= 2;
+    }
+    while (low < high) {
+      int64_t middle = low + (high - low) / 2;
+      if (before(middle)) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return low - input.row;
+  }
+
+  // Copy length rows of an input from its current row into merged_
+  int Append(const MergeInput &input, int64_t length) {
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int status = NANOARROW_OK;
+    if (!merged_->release) {
+      status = ArrowArrayInitFromSchema(merged_.get(), schema_.get(), &error);
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayStartAppending(merged_.get());
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayReserve(merged_.get(), target_rows_);
+      }
+    }
+    const struct ArrowArrayView &view = *input.view.get();
+    int64_t first = view.offset + input.row;
+    for (int64_t row = first; status == NANOARROW_OK && row < first + length;
+         row++) {
+      for (int64_t i = 0; status == NANOARROW_OK && i < view.n_children;
+           i++) {
+        status = AppendValue(*view.children[i], row, merged_->children[i]);
+      }
+      if (status == NANOARROW_OK) {
+        status = ArrowArrayFinishElement(merged_.get());
+      }
+    }
+    if (status != NANOARROW_OK) {
+      last_error_ = std::string("Failed to merge batches: ") + error.message;
+      return status_ = status;
+    }
+    built_ += length;
+    return NANOARROW_OK;
+  }
+
+  int FinishMerged(struct ArrowArray *out) {
+    struct ArrowError error;
+    error.message[0] = '\0';
+    int status = ArrowArrayFinishBuildingDefault(merged_.get(), &error);
+    if (status != NANOARROW_OK) {
+      last_error_ = std::string("Failed to merge batches: ") + error.message;
+      return status_ = status;
+    }
+    ArrowArrayMove(merged_.get(), out);
+    built_ = 0;
+    return NANOARROW_OK;
+  }
+
+  int InputError(size_t i, int status) {
+    const char *message =
+        inputs_[i].stream->get_last_error(inputs_[i].stream.get());
+    last_error_ = message ? message : "Failed to read result";
+    return status;
+  }
+
+  std::vector<MergeInput> inputs_;
+  std::vector<CubeSortKey> keys_;
+  std::vector<CompareFunction> compare_; // One for each key
+  int64_t target_rows_;
+  nanoarrow::UniqueSchema schema_;
+  bool can_append_ = false;
+  bool started_ = false;
+  // Tournament tree over the inputs: losers_[0] is the input whose row
+  // comes next, node n > 0 the loser of the match at it. Input i plays in
+  // at node (i + inputs) / 2.
+  std::vector<int> losers_;
+  nanoarrow::UniqueArray merged_; // Rows of short runs gathered
+  int64_t built_ = 0;
+  int status_ = NANOARROW_OK;
+  std::string last_error_;
+};
+
+} // namespace
+
+void RechunkArrayStream(int64_t target_rows, struct ArrowArrayStream *stream) {
+  auto *rechunked = new RechunkedStream(target_rows, stream);
+  rechunked->ExportTo(stream);
+}
+
+void ExpandRunEndEncoded(struct ArrowArrayStream *stream) {
+  auto *expanded = new RunEndExpandedStream(stream);
+  expanded->ExportTo(stream);
+}
+
+void LimitArrayStream(int64_t max_rows, struct ArrowArrayStream *stream) {
+  auto *limited = new LimitedStream(max_rows, stream);
+  limited->ExportTo(stream);
+}
+
+void ApproximateArrayStream(
+    std::vector<std::pair<std::string, std::string>> metadata,
+    struct ArrowArrayStream *stream, struct ArrowArrayStream *exact) {
+  auto *approximate =
+      new ApproximateStream(std::move(metadata), stream, exact);
+  approximate->ExportTo(stream);
+}
+
+ArrowErrorCode ExpandRunEndEncodedSchema(struct ArrowSchema *schema) {
+  nanoarrow::UniqueArrayView view;
+  if (ArrowArrayViewInitFromSchema(view.get(), schema, nullptr) !=
+          NANOARROW_OK ||
+      view->storage_type != NANOARROW_TYPE_STRUCT) {
+    return NANOARROW_OK; // Left as it is, like the stream's batches
+  }
+  return ReplaceWithValues(ExpandableColumns(*view.get()), schema);
+}
+
+void TeeArrayStream(struct ArrowArrayStream *source, size_t count,
+                    int64_t max_buffered, struct ArrowArrayStream *out) {
+  auto state = std::make_shared<TeeState>(source, count, max_buffered);
+  for (size_t i = 0; i < count; i++) {
+    auto *tee = new TeeStream(state, i);
+    tee->ExportTo(&out[i]);
+  }
+}
+
+void SplitArrayStream(struct ArrowArrayStream *source, size_t count,
+                      int64_t key_column, int64_t max_buffered,
+                      struct ArrowArrayStream *out) {
+  auto state =
+      std::make_shared<SplitState>(source, count, key_column, max_buffered);
+  for (size_t i = 0; i < count; i++) {
+    auto *split = new SplitStream(state, i);
+    split->ExportTo(&out[i]);
+  }
+}
+
+ArrowErrorCode ParseSortKeys(std::string_view spec,
+                             const struct ArrowSchema *schema,
+                             std::vector<CubeSortKey> *out,
+                             struct ArrowError *error) {
+  out->clear();
+  while (!spec.empty()) {
+    size_t comma = spec.find(',');
+    std::string_view item = spec.substr(0, comma);
+    spec = comma == std::string_view::npos ? std::string_view()
+                                           : spec.substr(comma + 1);
+    while (!item.empty() &&
+           std::isspace(static_cast<unsigned char>(item.front()))) {
+      item.remove_prefix(1);
+    }
+    size_t name_end = 0;
+    while (name_end < item.size() &&
+           !std::isspace(static_cast<unsigned char>(item[name_end]))) {
+      name_end++;
+    }
+    std::string_view name = item.substr(0, name_end);
+    std::string_view rest = item.substr(name_end);
+    while (!rest.empty() &&
+           std::isspace(static_cast<unsigned char>(rest.front()))) {
+      rest.remove_prefix(1);
+    }
+    if (name.empty()) {
+      ArrowErrorSet(error, "Empty column in sort keys");
+      return EINVAL;
+    }
+
+    CubeSortKey key;
+    key.column = -1;
+    for (int64_t i = 0; i < schema->n_children; i++) {
+      const char *child = schema->children[i]->name;
+      if (child && name == child) {
+        key.column = i;
+        break;
+      }
+    }
+    if (key.column < 0) {
+      ArrowErrorSet(error, "Sort key '%.*s' is not a column of the result",
+                    static_cast<int>(name.size()), name.data());
+      return EINVAL;
+    }
+    if (!SortCompareFunction(StorageType(schema, key.column))) {
+      ArrowErrorSet(error, "Cannot sort on column '%.*s' of its type",
+                    static_cast<int>(name.size()), name.data());
+      return EINVAL;
+    }
+    if (ConsumeWord(&rest, "DESC")) {
+      key.descending = true;
+    } else {
+      ConsumeWord(&rest, "ASC");
+    }
+    key.nulls_first = key.descending;
+    if (ConsumeWord(&rest, "NULLS")) {
+      if (ConsumeWord(&rest, "FIRST")) {
+        key.nulls_first = true;
+      } else if (ConsumeWord(&rest, "LAST")) {
+        key.nulls_first = false;
+      } else {
+        rest = "NULLS";
+      }
+    }
+    if (!rest.empty()) {
+      ArrowErrorSet(error, "Unexpected '%.*s' after sort key '%.*s'",
+                    static_cast<int>(rest.size()), rest.data(),
+                    static_cast<int>(name.size()), name.data());
+      return EINVAL;
+    }
+    out->push_back(key);
+  }
+  if (out->empty()) {
+    ArrowErrorSet(error, "No sort keys");
+    return EINVAL;
+  }
+  return NANOARROW_OK;
+}
+
+void MergeSortedStreams(std::vector<nanoarrow::UniqueArrayStream> inputs,
+                        std::vector<CubeSortKey> keys, int64_t target_rows,
+                        struct ArrowArrayStream *out) {
+  auto *merged =
+      new MergedStream(std::move(inputs), std::move(keys), target_rows);
+  merged->ExportTo(out);
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,128 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+/// Rows [offset, offset + length) of a batch as an array sharing its
+/// buffers, which live until the batch and every slice are released. Null
+/// rows of the batch itself, unused in results, are dropped.
+void ExportSlice(const std::shared_ptr<nanoarrow::UniqueArray> &batch,
+                 int64_t offset, int64_t length, struct ArrowArray *out);
+
+/// Replace stream with one returning batches of target_rows rows, whatever
+/// sizes the source sends. Batches larger than that are sliced: each slice
+/// shares the buffers of the source batch, its columns offset into them.
+/// Smaller batches are copied together until target_rows are gathered; the
+/// last batch of the result may be shorter. Only flat columns of
+/// primitive, decimal, string and binary types are merged; with any other
+/// column, small batches are passed through as they come.
+void RechunkArrayStream(int64_t target_rows, struct ArrowArrayStream *stream);
+
+/// Replace stream with one whose run-end encoded top-level columns are
+/// expanded into plain arrays of their value type, one batch at a time as
+/// they are read. Columns whose values are nested or dictionary-encoded are
+/// passed through encoded.
+void ExpandRunEndEncoded(struct ArrowArrayStream *stream);
+
+/// Change a result schema in place the way ExpandRunEndEncoded changes the
+/// schema of its stream
+ArrowErrorCode ExpandRunEndEncodedSchema(struct ArrowSchema *schema);
+
+/// Replace stream with one returning only its first max_rows rows (> 0).
+/// The batch that reaches the limit is sliced, sharing its buffers, and
+/// the source is released then rather than read to its end, so a result
+/// behind it is stopped early.
+void LimitArrayStream(int64_t max_rows, struct ArrowArrayStream *stream);
+
+/// Replace stream, the result of a sampled query, with one whose schema
+/// metadata holds metadata as well, replacing entries of the same keys.
+/// Given exact (may be null), the result of the same query run in full,
+/// the stream goes on to it when the sample ends: an empty batch, then the
+/// exact batches, as the versions of a subscription come. exact is taken
+/// over, and released unread if the stream is released first.
+void ApproximateArrayStream(
+    std::vector<std::pair<std::string, std::string>> metadata,
+    struct ArrowArrayStream *stream, struct ArrowArrayStream *exact);
+
+/// Move source into count streams out[0..count) that each return all of
+/// its batches. Each batch is read from source once and shared: the copies
+/// point at the same buffers, which live until every copy is released.
+/// The streams may be read from different threads. With max_buffered > 0,
+/// a stream that is that many batches ahead of the slowest open one waits
+/// for it to catch up, so such streams must be read concurrently; 0
+/// buffers without bound. Releasing a stream stops it holding the others
+/// back, and source is released with the last of them.
+void TeeArrayStream(struct ArrowArrayStream *source, size_t count,
+                    int64_t max_buffered, struct ArrowArrayStream *out);
+
+/// Move source into count streams out[0..count) that share its rows, so
+/// that each can be loaded through a session of its own. With key_column
+/// < 0, whole batches go to the streams in turn. Otherwise each row goes
+/// to the stream the hash of its value in that column picks, equal values
+/// always to the same one; that needs flat columns of the types
+/// RechunkArrayStream merges (EINVAL from get_next otherwise). The streams
+/// must be read concurrently: none reads the source while another holds
+/// max_buffered batches it has yet to return. Batches for a stream that
+/// has been released are dropped, and source is released with the last
+/// stream.
+void SplitArrayStream(struct ArrowArrayStream *source, size_t count,
+                      int64_t key_column, int64_t max_buffered,
+                      struct ArrowArrayStream *out);
+
+/// A column that a merged result is sorted on
+struct CubeSortKey {
+  int64_t column = 0;
+  bool descending = false;
+  bool nulls_first = false;
+};
+
+/// Parse a comma-separated list of columns of a struct schema, each
+/// optionally followed by ASC or DESC and NULLS FIRST or NULLS LAST, as in
+/// an ORDER BY clause. Nulls come last in ascending order and first in
+/// descending order unless stated. Columns must be of a type
+/// MergeSortedStreams can compare: integer, floating point, boolean,
+/// temporal, decimal128, string or binary (EINVAL otherwise).
+ArrowErrorCode ParseSortKeys(std::string_view spec,
+                             const struct ArrowSchema *schema,
+                             std::vector<CubeSortKey> *out,
+                             struct ArrowError *error);
+
+/// Replace inputs, streams of one schema each sorted on keys, with out,
+/// returning all of their rows sorted on keys, rows that compare equal in
+/// the order of their inputs. A loser tree picks the input whose row comes
+/// next; the run of rows that input has before any other's is then found
+/// with a galloping search over the sort columns and taken at once, as a
+/// slice of the input batch when it fills half a batch, or copied into a
+/// batch of target_rows rows otherwise. Only one batch of each input is
+/// held at a time; inputs are read on the thread reading out.
+void MergeSortedStreams(std::vector<nanoarrow::UniqueArrayStream> inputs,
+                        std::vector<CubeSortKey> keys, int64_t target_rows,
+                        struct ArrowArrayStream *out);
+
+} // namespace adbc::cube
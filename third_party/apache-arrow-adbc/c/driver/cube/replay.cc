@@ -0,0 +1,260 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/replay.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "driver/cube/native_client.h"
+#include "driver/cube/native_protocol.h"
+
+namespace adbc::cube {
+
+namespace {
+
+class ReplayTransport : public CubeTransport {
+public:
+  ReplayTransport(int fd, std::vector<uint8_t> bytes)
+      : CubeTransport(fd), bytes_(std::move(bytes)) {}
+
+  const char *name() const override { return "replay"; }
+
+  ssize_t Read(uint8_t *buffer, size_t length) override {
+    size_t n = std::min(length, bytes_.size() - position_);
+    std::memcpy(buffer, bytes_.data() + position_, n);
+    position_ += n;
+    return static_cast<ssize_t>(n);
+  }
+
+  ssize_t ReadAvailable(uint8_t *buffer, size_t length) override {
+    return Read(buffer, length);
+  }
+
+  ssize_t Write(const struct iovec *iov, int count) override {
+    size_t n = 0;
+    for (int i = 0; i < count; i++) {
+      n += iov[i].iov_len;
+    }
+    return static_cast<ssize_t>(n);
+  }
+
+  ssize_t WriteWithFd(const struct iovec *, int, int) override {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  bool HasBuffered() const override { return position_ < bytes_.size(); }
+
+private:
+  std::vector<uint8_t> bytes_;
+  size_t position_ = 0;
+};
+
+MessageType TypeOf(const CubeCapturedFrame &frame) {
+  return frame.frame.size() > 4 ? static_cast<MessageType>(frame.frame[4])
+                                : MessageType::Error;
+}
+
+// Forget an error the recorded session also got, so the replay goes on
+void ClearError(AdbcError *error) {
+  if (error && error->release) {
+    error->release(error);
+  }
+}
+
+// Read a result to the end, counting what it held
+void Drain(struct ArrowArrayStream *stream, CubeReplayResult *result) {
+  while (true) {
+    struct ArrowArray array;
+    if (stream->get_next(stream, &array) != 0) {
+      result->errors++;
+      break;
+    }
+    if (!array.release) {
+      break;
+    }
+    result->batches++;
+    result->rows += array.length;
+    array.release(&array);
+  }
+  stream->release(stream);
+}
+
+// Run one recorded query; fails only if the session is lost
+AdbcStatusCode ReplayQuery(NativeClient *client,
+                           const CubeReaderOptions &options,
+                           CubeReplayResult *result, AdbcError *error) {
+  result->queries++;
+  struct ArrowArrayStream stream;
+  if (client->ExecuteQuery("replay", options, &stream, error) ==
+      ADBC_STATUS_OK) {
+    Drain(&stream, result);
+  } else if (client->IsConnected()) {
+    result->errors++;
+    ClearError(error);
+  } else {
+    return ADBC_STATUS_IO;
+  }
+  return ADBC_STATUS_OK;
+}
+
+} // namespace
+
+std::unique_ptr<CubeTransport> MakeReplayTransport(std::vector<uint8_t> bytes) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return nullptr;
+  }
+  close(fds[1]);
+  return std::make_unique<ReplayTransport>(fds[0], std::move(bytes));
+}
+
+AdbcStatusCode ReplayCapture(const std::vector<CubeCapturedFrame> &frames,
+                             const CubeReaderOptions &options,
+                             CubeReplayResult *result, AdbcError *error) {
+  *result = CubeReplayResult();
+  std::vector<uint8_t> received;
+  CompressionCodec codec = CompressionCodec::None;
+  for (const auto &frame : frames) {
+    if (frame.sent) {
+      continue;
+    }
+    if (TypeOf(frame) == MessageType::HandshakeResponse) {
+      // The client must offer the codec the server picked
+      try {
+        codec = static_cast<CompressionCodec>(
+            HandshakeResponse::Decode(frame.frame.data() + 4,
+                                      frame.frame.size() - 4)
+                ->compression_codec);
+      } catch (const std::exception &e) {
+        SetNativeClientError(error, std::string("Invalid handshake in "
+                                                "capture: ") +
+                                        e.what());
+        return ADBC_STATUS_INVALID_DATA;
+      }
+    }
+    received.insert(received.end(), frame.frame.begin(), frame.frame.end());
+  }
+  result->bytes = static_cast<int64_t>(received.size());
+
+  auto transport = MakeReplayTransport(std::move(received));
+  if (!transport) {
+    SetNativeClientError(error, "Failed to create a socket pair: " +
+                                    std::string(strerror(errno)));
+    return ADBC_STATUS_IO;
+  }
+  auto start = std::chrono::steady_clock::now();
+  NativeClient client;
+  client.SetCompression(codec);
+  client.SetReaderOptions(options);
+  auto status = client.Attach(std::move(transport), error);
+  bool handshake = true;
+  for (const auto &frame : frames) {
+    if (status != ADBC_STATUS_OK) {
+      return status;
+    }
+    if (!frame.sent) {
+      continue;
+    }
+    switch (TypeOf(frame)) {
+    case MessageType::HandshakeRequest:
+      if (!handshake) {
+        SetNativeClientError(error, "Capture holds more than one session");
+        return ADBC_STATUS_NOT_IMPLEMENTED;
+      }
+      handshake = false;
+      break;
+    case MessageType::AuthRequest:
+      status = client.Authenticate("replay", "", error);
+      break;
+    case MessageType::QueryRequest:
+      status = ReplayQuery(&client, options, result, error);
+      break;
+    case MessageType::QueryBatchRequest: {
+      // Answered as that many queries, one after another
+      uint32_t count = 0;
+      if (frame.frame.size() >= 9) {
+        const uint8_t *ptr = frame.frame.data() + 5; // After length and type
+        count = MessageCodec::GetU32(ptr, ptr + 4);
+      }
+      for (uint32_t i = 0; i < count && status == ADBC_STATUS_OK; i++) {
+        status = ReplayQuery(&client, options, result, error);
+      }
+      break;
+    }
+    case MessageType::PrepareRequest: {
+      std::string statement_id;
+      struct ArrowSchema result_schema = {};
+      struct ArrowSchema parameter_schema = {};
+      if (client.Prepare("replay", &statement_id, &result_schema,
+                         &parameter_schema, error) != ADBC_STATUS_OK) {
+        if (client.IsConnected()) {
+          ClearError(error);
+        } else {
+          status = ADBC_STATUS_IO;
+        }
+      }
+      if (result_schema.release) {
+        result_schema.release(&result_schema);
+      }
+      if (parameter_schema.release) {
+        parameter_schema.release(&parameter_schema);
+      }
+      break;
+    }
+    case MessageType::PartitionRequest: {
+      std::vector<std::string> partitions;
+      struct ArrowSchema schema = {};
+      if (client.Partition("replay", 0, &schema, &partitions, error) !=
+          ADBC_STATUS_OK) {
+        if (client.IsConnected()) {
+          ClearError(error);
+        } else {
+          status = ADBC_STATUS_IO;
+        }
+      }
+      if (schema.release) {
+        schema.release(&schema);
+      }
+      break;
+    }
+    case MessageType::CancelRequest:
+    case MessageType::ClosePreparedRequest:
+    case MessageType::FetchRequest:
+    case MessageType::CreditGrant:
+    case MessageType::SharedMemoryRelease:
+      // Unanswered
+      break;
+    default:
+      SetNativeClientError(error, "Capture holds a request that cannot be "
+                                  "replayed (message type " +
+                                      std::to_string(frame.frame[4]) + ")");
+      return ADBC_STATUS_NOT_IMPLEMENTED;
+    }
+  }
+  result->elapsed = std::chrono::steady_clock::now() - start;
+  return status;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,60 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <arrow-adbc/adbc.h>
+
+#include "driver/cube/arrow_reader.h"
+#include "driver/cube/capture.h"
+#include "driver/cube/transport.h"
+
+namespace adbc::cube {
+
+/// Transport that reads the given bytes, then the end of the stream, and
+/// takes every write without sending it anywhere. Its fd() is one end of a
+/// socket pair whose other end is closed, so polling it never blocks.
+/// @return null if the socket pair cannot be created
+std::unique_ptr<CubeTransport> MakeReplayTransport(std::vector<uint8_t> bytes);
+
+/// What ReplayCapture went through
+struct CubeReplayResult {
+  int64_t queries = 0; // Query responses read
+  int64_t errors = 0;  // Of those, responses that were errors
+  int64_t batches = 0;
+  int64_t rows = 0;
+  int64_t bytes = 0; // Received frame bytes, framing included
+  std::chrono::nanoseconds elapsed{0};
+};
+
+/// Feed the received frames of a capture back through a NativeClient as
+/// fast as it reads them: the handshake and authentication replies, then,
+/// for each QueryRequest the client sent, the recorded response, read to
+/// the end and decoded with options. Recorded timings are ignored, so the
+/// result measures the client alone. Sessions that prepared statements
+/// replay too; ingestion is not supported (ADBC_STATUS_NOT_IMPLEMENTED).
+AdbcStatusCode ReplayCapture(const std::vector<CubeCapturedFrame> &frames,
+                             const CubeReaderOptions &options,
+                             CubeReplayResult *result,
+                             AdbcError *error = nullptr);
+
+} // namespace adbc::cube
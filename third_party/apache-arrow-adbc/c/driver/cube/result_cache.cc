@@ -0,0 +1,321 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/result_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <utility>
+
+#include "driver/cube/metrics.h"
+#include "driver/cube/sql_fingerprint.h"
+
+namespace adbc::cube {
+
+std::shared_ptr<const CubeCachedResult>
+CubeResultCache::Find(std::string_view key) {
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().result_cache_lock);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  if (ttl_.count() > 0 &&
+      std::chrono::steady_clock::now() - it->second.stored >= ttl_) {
+    Erase(it);
+    return nullptr;
+  }
+  keys_.splice(keys_.begin(), keys_, it->second.key);
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return it->second.result;
+}
+
+bool CubeResultCache::Contains(std::string_view key) {
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().result_cache_lock);
+  auto it = entries_.find(key);
+  return it != entries_.end() &&
+         (ttl_.count() == 0 ||
+          std::chrono::steady_clock::now() - it->second.stored < ttl_);
+}
+
+void CubeResultCache::Insert(std::string key,
+                             std::shared_ptr<const CubeCachedResult> result) {
+  if (result->bytes > max_bytes_) {
+    return;
+  }
+  auto lock = CubeLockCounted(mutex_, CubeMetrics::Global().result_cache_lock);
+  auto it = entries_.find(key);
+  if (it != entries_.end()) {
+    // Another connection ran the same query meanwhile; keep the newer one
+    Erase(it);
+  }
+  while (bytes_ + result->bytes > max_bytes_ && !keys_.empty()) {
+    Erase(entries_.find(std::string_view(keys_.back())));
+  }
+  while (memory_ && !memory_->TryReserve(result->bytes)) {
+    if (keys_.empty()) {
+      return;
+    }
+    Erase(entries_.find(std::string_view(keys_.back())));
+  }
+  bytes_ += result->bytes;
+  keys_.push_front(std::move(key));
+  entries_.emplace(std::string_view(keys_.front()),
+                   Entry{keys_.begin(), std::move(result),
+                         std::chrono::steady_clock::now()});
+}
+
+void CubeResultCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  keys_.clear();
+  if (memory_) {
+    memory_->Release(bytes_);
+  }
+  bytes_ = 0;
+}
+
+size_t CubeResultCache::ErasePreaggregation(std::string_view name) {
+  if (name.empty()) {
+    // Results no pre-aggregation served
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t erased = 0;
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto next = std::next(it);
+    if (it->second.result->preaggregation == name) {
+      Erase(it);
+      erased++;
+    }
+    it = next;
+  }
+  return erased;
+}
+
+void CubeResultCache::Erase(
+    std::unordered_map<std::string_view, Entry>::iterator it) {
+  auto key = it->second.key;
+  bytes_ -= it->second.result->bytes;
+  if (memory_) {
+    memory_->Release(it->second.result->bytes);
+  }
+  entries_.erase(it);
+  keys_.erase(key);
+}
+
+std::shared_ptr<const CubeCachedResult> CubeInflightQueries::Call::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return done_; });
+  return result_;
+}
+
+std::shared_ptr<CubeInflightQueries::Call>
+CubeInflightQueries::Join(const std::string &key, bool *leader) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &call = calls_[key];
+  *leader = !call;
+  if (!call) {
+    call = std::make_shared<Call>();
+  }
+  return call;
+}
+
+void CubeInflightQueries::Finish(
+    const std::string &key, const std::shared_ptr<Call> &call,
+    std::shared_ptr<const CubeCachedResult> result) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = calls_.find(key);
+    if (it != calls_.end() && it->second == call) {
+      calls_.erase(it);
+    }
+  }
+  std::lock_guard<std::mutex> lock(call->mutex_);
+  call->done_ = true;
+  call->result_ = std::move(result);
+  if (call->result_ && call.use_count() > 1) {
+    shared_.fetch_add(1, std::memory_order_relaxed);
+  }
+  call->done_cv_.notify_all();
+}
+
+CubeResultCapture::CubeResultCapture(std::shared_ptr<CubeResultCache> cache,
+                                     std::string key, bool schema_once)
+    : cache_(std::move(cache)), key_(std::move(key)),
+      result_(std::make_shared<CubeCachedResult>()) {
+  result_->schema_once = schema_once;
+}
+
+CubeResultCapture::~CubeResultCapture() {
+  if (call_) {
+    inflight_->Finish(key_, call_, nullptr);
+  }
+}
+
+void CubeResultCapture::Share(
+    std::shared_ptr<CubeInflightQueries> inflight,
+    std::shared_ptr<CubeInflightQueries::Call> call) {
+  inflight_ = std::move(inflight);
+  call_ = std::move(call);
+}
+
+void CubeResultCapture::Keep(
+    size_t max_bytes,
+    std::function<void(std::shared_ptr<const CubeCachedResult>)> keep) {
+  keepers_.push_back(Keeper{max_bytes, std::move(keep)});
+}
+
+bool CubeResultCapture::Reserve(size_t bytes) {
+  if (!result_) {
+    return false;
+  }
+  if (cache_ && result_->bytes + bytes > cache_->max_bytes()) {
+    cache_.reset();
+  }
+  keepers_.erase(std::remove_if(keepers_.begin(), keepers_.end(),
+                                [&](const Keeper &keeper) {
+                                  return result_->bytes + bytes >
+                                         keeper.max_bytes;
+                                }),
+                 keepers_.end());
+  if (!cache_ && !call_ && keepers_.empty()) {
+    result_.reset();
+    return false;
+  }
+  result_->bytes += bytes;
+  return true;
+}
+
+void CubeResultCapture::AddSchemaMessage(const CubeIpcBuffer &message) {
+  if (Reserve(message.size())) {
+    result_->schema_message = message;
+  }
+}
+
+void CubeResultCapture::AddBatch(const CubeIpcBuffer &batch) {
+  if (Reserve(batch.size())) {
+    result_->batches.push_back(batch);
+  }
+}
+
+void CubeResultCapture::AddBatch(const uint8_t *data, size_t size) {
+  if (Reserve(size)) {
+    result_->batches.emplace_back(data, data + size);
+  }
+}
+
+void CubeResultCapture::Complete(int64_t rows_affected,
+                                 std::string preaggregation) {
+  if (!result_) {
+    return;
+  }
+  result_->rows_affected = rows_affected;
+  result_->preaggregation = std::move(preaggregation);
+  if (cache_) {
+    cache_->Insert(key_, result_);
+    cache_.reset();
+  }
+  for (auto &keeper : keepers_) {
+    keeper.keep(result_);
+  }
+  keepers_.clear();
+  if (call_) {
+    inflight_->Finish(key_, call_, std::move(result_));
+    call_.reset();
+  }
+  result_.reset();
+}
+
+std::string NormalizeQueryText(std::string_view sql) {
+  std::string out;
+  out.reserve(sql.size());
+  char quote = 0; // Quote character of the literal or name being copied
+  bool space = false;
+  for (char c : sql) {
+    if (quote) {
+      out.push_back(c);
+      if (c == quote) {
+        quote = 0;
+      }
+      continue;
+    }
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = !out.empty();
+      continue;
+    }
+    if (space) {
+      out.push_back(' ');
+      space = false;
+    }
+    if (c == '\'' || c == '"') {
+      quote = c;
+    }
+    out.push_back(c);
+  }
+  while (!out.empty() && (out.back() == ';' || out.back() == ' ')) {
+    out.pop_back();
+  }
+  return out;
+}
+
+bool IsCacheableQuery(std::string_view normalized_sql) {
+  auto starts_with = [&](std::string_view word) {
+    if (normalized_sql.size() < word.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < word.size(); i++) {
+      if (std::tolower(static_cast<unsigned char>(normalized_sql[i])) !=
+          word[i]) {
+        return false;
+      }
+    }
+    return normalized_sql.size() == word.size() ||
+           !std::isalnum(
+               static_cast<unsigned char>(normalized_sql[word.size()]));
+  };
+  return starts_with("select") || starts_with("with");
+}
+
+std::string CubeResultCacheKey(std::string_view server_version,
+                               std::string_view database,
+                               std::string_view user, std::string_view token,
+                               uint32_t flags, std::string_view normalized_sql,
+                               const std::vector<uint8_t> &parameters) {
+  std::string key;
+  key.reserve(server_version.size() + database.size() + user.size() +
+              token.size() + parameters.size() + 64);
+  for (auto part : {server_version, database, user, token}) {
+    key.append(part);
+    key.push_back('\0');
+  }
+  key.append(std::to_string(flags));
+  key.push_back('\0');
+  // The query's fingerprint stands for its text, so comments, case and
+  // spacing do not split the entries and long queries make short keys
+  CubeSqlFingerprint fingerprint = FingerprintSql(normalized_sql);
+  for (uint64_t half : {fingerprint.high, fingerprint.low}) {
+    for (int i = 0; i < 8; i++) {
+      key.push_back(static_cast<char>(half >> (8 * i)));
+    }
+  }
+  key.push_back('\0');
+  key.append(parameters.begin(), parameters.end());
+  return key;
+}
+
+} // namespace adbc::cube
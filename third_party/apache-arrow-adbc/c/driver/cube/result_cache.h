@@ -0,0 +1,209 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/ipc_buffer.h"
+#include "driver/cube/memory_tracker.h"
+
+namespace adbc::cube {
+
+// The messages of one native-protocol result as they came off the socket,
+// enough to decode the result again without the server
+struct CubeCachedResult {
+  bool schema_once = false; // Batches carry no Schema message
+  CubeIpcBuffer schema_message;
+  std::vector<CubeIpcBuffer> batches;
+  int64_t rows_affected = -1;
+  size_t bytes = 0; // Sum of the message sizes
+  // Pre-aggregation that served the query, from its QueryDiagnostics;
+  // empty if none did or the server did not say
+  std::string preaggregation;
+};
+
+// Results of recent queries, keyed by CubeResultCacheKey and bounded by the
+// total size of their messages. Shared by the connections of a database.
+// Entries older than the ttl (if non-zero) are not returned. Stored
+// results are charged to memory (if set), and more are evicted to keep
+// within its limit. Thread-safe.
+class CubeResultCache {
+public:
+  CubeResultCache(size_t max_bytes, std::chrono::milliseconds ttl,
+                  std::shared_ptr<CubeMemoryTracker> memory = nullptr)
+      : max_bytes_(max_bytes), ttl_(ttl), memory_(std::move(memory)) {
+    // A forked child keeps the results its parent cached
+    CubeForkRegisterMutex(&mutex_);
+  }
+  ~CubeResultCache() {
+    Clear();
+    CubeForkUnregisterMutex(&mutex_);
+  }
+
+  size_t max_bytes() const { return max_bytes_; }
+
+  // Result previously stored under key, if it has not expired
+  std::shared_ptr<const CubeCachedResult> Find(std::string_view key);
+
+  // Whether Find would return a result for key, without counting a hit or
+  // making it more recently used
+  bool Contains(std::string_view key);
+
+  // Store a result, evicting the least recently used ones until it fits;
+  // a result larger than the cache, or than the memory limit leaves room
+  // for, is not stored
+  void Insert(std::string key, std::shared_ptr<const CubeCachedResult> result);
+
+  void Clear();
+
+  // Drop the results the pre-aggregation name served; returns how many
+  size_t ErasePreaggregation(std::string_view name);
+
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    std::list<std::string>::iterator key;
+    std::shared_ptr<const CubeCachedResult> result;
+    std::chrono::steady_clock::time_point stored;
+  };
+
+  void Erase(std::unordered_map<std::string_view, Entry>::iterator it);
+
+  size_t max_bytes_;
+  std::chrono::milliseconds ttl_;
+  std::shared_ptr<CubeMemoryTracker> memory_;
+  std::mutex mutex_;
+  size_t bytes_ = 0;
+  std::list<std::string> keys_; // Most recently used first
+  // Keys view the strings in keys_, whose nodes never move
+  std::unordered_map<std::string_view, Entry> entries_;
+  std::atomic<int64_t> hits_{0};
+};
+
+// Queries being run on behalf of several connections of a database, keyed
+// by CubeResultCacheKey: the first connection to ask runs the query and
+// the others wait for its whole result instead of sending it again.
+// Thread-safe.
+class CubeInflightQueries {
+public:
+  // One execution and the connections waiting on it
+  class Call {
+  public:
+    // Block until the result arrives; null if the query failed, in which
+    // case the caller runs it itself
+    std::shared_ptr<const CubeCachedResult> Wait();
+
+  private:
+    friend class CubeInflightQueries;
+
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    bool done_ = false;
+    std::shared_ptr<const CubeCachedResult> result_;
+  };
+
+  // The call running key, with leader set if the caller is to run it
+  std::shared_ptr<Call> Join(const std::string &key, bool *leader);
+
+  // Hand the leader's result (null if it failed) to the waiting callers;
+  // later callers of Join start a new call
+  void Finish(const std::string &key, const std::shared_ptr<Call> &call,
+              std::shared_ptr<const CubeCachedResult> result);
+
+  int64_t shared() const { return shared_.load(std::memory_order_relaxed); }
+
+private:
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Call>> calls_;
+  std::atomic<int64_t> shared_{0}; // Results handed to a waiting caller
+};
+
+// Collects the messages of a result while it is read, and stores them in
+// the cache once the whole response arrived without error. Gives up as
+// soon as the result outgrows the cache, unless it is also shared with the
+// callers of an in-flight query or kept by other caches.
+class CubeResultCapture {
+public:
+  // cache may be null when the result is only shared
+  CubeResultCapture(std::shared_ptr<CubeResultCache> cache, std::string key,
+                    bool schema_once);
+  // Fails the shared call if the result did not complete
+  ~CubeResultCapture();
+
+  // Also hand the result to the callers waiting on call
+  void Share(std::shared_ptr<CubeInflightQueries> inflight,
+             std::shared_ptr<CubeInflightQueries::Call> call);
+
+  // Also hand the complete result to keep, unless it grows past max_bytes;
+  // each call adds another
+  void Keep(size_t max_bytes,
+            std::function<void(std::shared_ptr<const CubeCachedResult>)> keep);
+
+  void AddSchemaMessage(const CubeIpcBuffer &message);
+  void AddBatch(const CubeIpcBuffer &batch);
+  void AddBatch(const uint8_t *data, size_t size);
+  // preaggregation is the one that served the query, if any
+  void Complete(int64_t rows_affected, std::string preaggregation = {});
+
+private:
+  bool Reserve(size_t bytes);
+
+  std::shared_ptr<CubeResultCache> cache_; // Null once given up or stored
+  std::string key_;
+  std::shared_ptr<CubeCachedResult> result_;
+  std::shared_ptr<CubeInflightQueries> inflight_; // Null unless shared
+  std::shared_ptr<CubeInflightQueries::Call> call_;
+  struct Keeper {
+    size_t max_bytes;
+    std::function<void(std::shared_ptr<const CubeCachedResult>)> keep;
+  };
+  std::vector<Keeper> keepers_;
+};
+
+// Normalize SQL for use in a cache key: whitespace runs outside quotes
+// become one space, and leading or trailing whitespace and semicolons are
+// dropped. Case is kept, since quoted names and literals depend on it.
+std::string NormalizeQueryText(std::string_view sql);
+
+// Whether a query may be answered from the cache: a SELECT or WITH query
+// (checked on normalized text)
+bool IsCacheableQuery(std::string_view normalized_sql);
+
+// Key of a result: everything that decides what the server sends back
+// (server version, database, user and token, request flags, the
+// FingerprintSql of the SQL and the encoded parameters)
+std::string CubeResultCacheKey(std::string_view server_version,
+                               std::string_view database,
+                               std::string_view user, std::string_view token,
+                               uint32_t flags, std::string_view normalized_sql,
+                               const std::vector<uint8_t> &parameters);
+
+} // namespace adbc::cube
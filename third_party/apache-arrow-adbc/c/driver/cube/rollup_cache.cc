@@ -0,0 +1,1263 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/rollup_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+
+#include "driver/cube/native_client.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// SQL tokens of a normalized query
+struct Token {
+  enum Kind { Word, Quoted, String, Number, Symbol, End };
+  Kind kind;
+  std::string_view text; // Without the quotes of Quoted and String
+  size_t begin;          // Offsets of the token in the query
+  size_t end;
+};
+
+bool IsWordStart(char c) {
+  return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool IsWordChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Split sql into tokens, ending with an End token; false on an unclosed
+// quote
+bool Tokenize(std::string_view sql, std::vector<Token> *out) {
+  size_t i = 0;
+  while (i < sql.size()) {
+    char c = sql[i];
+    if (c == ' ') {
+      i++;
+      continue;
+    }
+    size_t begin = i;
+    if (c == '\'' || c == '"') {
+      // A doubled quote is part of the text
+      for (i++;; i++) {
+        if (i >= sql.size()) {
+          return false;
+        }
+        if (sql[i] == c) {
+          if (i + 1 < sql.size() && sql[i + 1] == c) {
+            i++;
+            continue;
+          }
+          break;
+        }
+      }
+      i++;
+      out->push_back({c == '"' ? Token::Quoted : Token::String,
+                      sql.substr(begin + 1, i - begin - 2), begin, i});
+      continue;
+    }
+    Token::Kind kind = Token::Symbol;
+    if (IsWordStart(c)) {
+      kind = Token::Word;
+      while (i < sql.size() && IsWordChar(sql[i])) {
+        i++;
+      }
+    } else if (std::isdigit(static_cast<unsigned char>(c))) {
+      kind = Token::Number;
+      while (i < sql.size() &&
+             (std::isalnum(static_cast<unsigned char>(sql[i])) ||
+              sql[i] == '.')) {
+        i++;
+      }
+    } else {
+      i++;
+    }
+    out->push_back({kind, sql.substr(begin, i - begin), begin, i});
+  }
+  out->push_back({Token::End, {}, sql.size(), sql.size()});
+  return true;
+}
+
+bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Words that end a select item or table reference instead of naming it
+bool IsReserved(std::string_view word) {
+  static constexpr std::string_view kReserved[] = {
+      "all", "and", "as", "asc", "by", "cross", "desc", "distinct", "fetch",
+      "from", "full", "group", "having", "inner", "join", "left", "limit",
+      "natural", "not", "nulls", "offset", "on", "or", "order", "right",
+      "select", "union", "using", "where", "window", "with",
+  };
+  for (auto reserved : kReserved) {
+    if (EqualsIgnoreCase(word, reserved)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::optional<TimeGrain> ParseGrain(std::string_view name) {
+  static constexpr std::pair<std::string_view, TimeGrain> kGrains[] = {
+      {"second", TimeGrain::Second}, {"minute", TimeGrain::Minute},
+      {"hour", TimeGrain::Hour},     {"day", TimeGrain::Day},
+      {"week", TimeGrain::Week},     {"month", TimeGrain::Month},
+      {"quarter", TimeGrain::Quarter}, {"year", TimeGrain::Year},
+  };
+  for (const auto &[grain_name, grain] : kGrains) {
+    if (EqualsIgnoreCase(name, grain_name)) {
+      return grain;
+    }
+  }
+  return std::nullopt;
+}
+
+class RollupParser {
+public:
+  explicit RollupParser(std::string_view sql) : sql_(sql) {}
+
+  std::optional<RollupQuery> Parse() {
+    if (!Tokenize(sql_, &tokens_) || !Keyword("select")) {
+      return std::nullopt;
+    }
+    RollupQuery query;
+    do {
+      RollupColumn column;
+      if (!ParseExpression(&column)) {
+        return std::nullopt;
+      }
+      if (Keyword("as")) {
+        if (!ParseName(&column.name)) {
+          return std::nullopt;
+        }
+      } else if (Peek().kind == Token::Quoted ||
+                 (Peek().kind == Token::Word && !IsReserved(Peek().text))) {
+        ParseName(&column.name);
+      }
+      query.columns.push_back(std::move(column));
+    } while (Symbol(','));
+
+    size_t source_begin = Peek().begin;
+    if (!Keyword("from") || !ParseFrom()) {
+      return std::nullopt;
+    }
+    if (Keyword("where") && !SkipFilter(query)) {
+      return std::nullopt;
+    }
+    query.source = std::string(sql_.substr(source_begin,
+                                           Peek().begin - source_begin));
+    while (!query.source.empty() && query.source.back() == ' ') {
+      query.source.pop_back();
+    }
+
+    std::vector<bool> grouped(query.columns.size(), false);
+    if (Keyword("group")) {
+      if (!Keyword("by")) {
+        return std::nullopt;
+      }
+      do {
+        auto column = ParseReference(query, /*prefer_names=*/false);
+        if (!column || query.columns[*column].is_measure()) {
+          return std::nullopt;
+        }
+        grouped[*column] = true;
+      } while (Symbol(','));
+    }
+    for (size_t i = 0; i < query.columns.size(); i++) {
+      if (!query.columns[i].is_measure() && !grouped[i]) {
+        return std::nullopt;
+      }
+    }
+
+    if (Keyword("order")) {
+      if (!Keyword("by")) {
+        return std::nullopt;
+      }
+      do {
+        auto column = ParseReference(query, /*prefer_names=*/true);
+        if (!column) {
+          return std::nullopt;
+        }
+        RollupOrder order;
+        order.column = *column;
+        if (Keyword("desc")) {
+          order.descending = true;
+        } else {
+          Keyword("asc");
+        }
+        order.nulls_first = order.descending;
+        if (Keyword("nulls")) {
+          if (Keyword("first")) {
+            order.nulls_first = true;
+          } else if (Keyword("last")) {
+            order.nulls_first = false;
+          } else {
+            return std::nullopt;
+          }
+        }
+        query.order.push_back(order);
+      } while (Symbol(','));
+    }
+    if (Peek().kind != Token::End) {
+      return std::nullopt;
+    }
+    for (const auto &qualifier : qualifiers_) {
+      if (qualifier != table_ && qualifier != alias_) {
+        return std::nullopt;
+      }
+    }
+    return query;
+  }
+
+private:
+  const Token &Peek(size_t ahead = 0) const {
+    return tokens_[std::min(pos_ + ahead, tokens_.size() - 1)];
+  }
+
+  bool PeekKeyword(std::string_view word, size_t ahead = 0) const {
+    return Peek(ahead).kind == Token::Word &&
+           EqualsIgnoreCase(Peek(ahead).text, word);
+  }
+
+  bool PeekSymbol(char c, size_t ahead = 0) const {
+    const Token &token = Peek(ahead);
+    return token.kind == Token::Symbol && token.text.size() == 1 &&
+           token.text[0] == c;
+  }
+
+  bool Keyword(std::string_view word) {
+    if (!PeekKeyword(word)) {
+      return false;
+    }
+    pos_++;
+    return true;
+  }
+
+  bool Symbol(char c) {
+    if (!PeekSymbol(c)) {
+      return false;
+    }
+    pos_++;
+    return true;
+  }
+
+  // An identifier, folded to lower case unless quoted
+  bool ParseName(std::string *out) {
+    const Token &token = Peek();
+    if (token.kind == Token::Quoted) {
+      *out = std::string(token.text);
+    } else if (token.kind == Token::Word && !IsReserved(token.text)) {
+      out->clear();
+      for (char c : token.text) {
+        out->push_back(
+            static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+      }
+    } else {
+      return false;
+    }
+    pos_++;
+    return true;
+  }
+
+  // [qualifier.]member; qualifiers are checked against the FROM clause
+  // once it is parsed
+  bool ParseMember(std::string *member) {
+    if (PeekSymbol('(', 1)) {
+      return false; // A function this parser does not know
+    }
+    if (!ParseName(member)) {
+      return false;
+    }
+    if (Symbol('.')) {
+      qualifiers_.push_back(std::move(*member));
+      return ParseName(member);
+    }
+    return true;
+  }
+
+  bool ParseExpression(RollupColumn *column) {
+    if (PeekKeyword("date_trunc") && PeekSymbol('(', 1)) {
+      pos_ += 2;
+      if (Peek().kind != Token::String) {
+        return false;
+      }
+      auto grain = ParseGrain(Peek().text);
+      pos_++;
+      if (!grain || !Symbol(',') || !ParseMember(&column->member) ||
+          !Symbol(')')) {
+        return false;
+      }
+      column->grain = *grain;
+      return true;
+    }
+    static constexpr std::pair<std::string_view, RollupAggregate>
+        kAggregates[] = {
+            {"sum", RollupAggregate::Sum},
+            {"count", RollupAggregate::Count},
+            {"min", RollupAggregate::Min},
+            {"max", RollupAggregate::Max},
+        };
+    for (const auto &[name, aggregate] : kAggregates) {
+      if (PeekKeyword(name) && PeekSymbol('(', 1)) {
+        pos_ += 2;
+        if (aggregate == RollupAggregate::Count && Symbol('*')) {
+          column->member = "*";
+        } else if (!ParseMember(&column->member)) {
+          return false;
+        }
+        column->aggregate = aggregate;
+        return Symbol(')');
+      }
+    }
+    if (!ParseMember(&column->member)) {
+      return false;
+    }
+    column->name = column->member;
+    return true;
+  }
+
+  // cube[.schema] [[AS] alias], with no join
+  bool ParseFrom() {
+    if (!ParseName(&table_)) {
+      return false;
+    }
+    if (Symbol('.') && !ParseName(&table_)) {
+      return false;
+    }
+    if (Keyword("as")) {
+      return ParseName(&alias_);
+    }
+    if (Peek().kind == Token::Quoted ||
+        (Peek().kind == Token::Word && !IsReserved(Peek().text))) {
+      ParseName(&alias_);
+    }
+    return true;
+  }
+
+  // Step over a WHERE filter to the clause after it. Cube applies filters
+  // on measures after aggregating, so a filter naming a selected measure
+  // rejects the query.
+  bool SkipFilter(const RollupQuery &query) {
+    int depth = 0;
+    for (;; pos_++) {
+      const Token &token = Peek();
+      if (token.kind == Token::End) {
+        return depth == 0;
+      }
+      if (PeekSymbol('(')) {
+        depth++;
+        continue;
+      }
+      if (PeekSymbol(')')) {
+        depth--;
+        continue;
+      }
+      if (depth == 0 && token.kind == Token::Word) {
+        if ((PeekKeyword("group") || PeekKeyword("order")) &&
+            PeekKeyword("by", 1)) {
+          return true;
+        }
+        for (auto word : {"having", "limit", "offset", "union", "fetch"}) {
+          if (PeekKeyword(word)) {
+            return false;
+          }
+        }
+      }
+      if (token.kind == Token::Word || token.kind == Token::Quoted) {
+        std::string name;
+        size_t pos = pos_;
+        if (ParseName(&name)) {
+          pos_ = pos;
+          for (const auto &column : query.columns) {
+            if (column.is_measure() && column.member == name) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // A GROUP BY or ORDER BY item: a 1-based ordinal, an expression of the
+  // select list or the name of one of its columns
+  std::optional<size_t> ParseReference(const RollupQuery &query,
+                                       bool prefer_names) {
+    if (Peek().kind == Token::Number) {
+      size_t ordinal = 0;
+      for (char c : Peek().text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+          return std::nullopt;
+        }
+        ordinal = ordinal * 10 + static_cast<size_t>(c - '0');
+        if (ordinal > query.columns.size()) {
+          return std::nullopt;
+        }
+      }
+      pos_++;
+      if (ordinal == 0) {
+        return std::nullopt;
+      }
+      return ordinal - 1;
+    }
+    size_t qualifiers = qualifiers_.size();
+    RollupColumn expression;
+    if (!ParseExpression(&expression)) {
+      return std::nullopt;
+    }
+    bool plain = expression.name == expression.member &&
+                 qualifiers_.size() == qualifiers;
+    auto by_name = [&]() -> std::optional<size_t> {
+      for (size_t i = 0; plain && i < query.columns.size(); i++) {
+        if (query.columns[i].name == expression.member) {
+          return i;
+        }
+      }
+      return std::nullopt;
+    };
+    if (prefer_names) {
+      if (auto column = by_name()) {
+        return column;
+      }
+    }
+    for (size_t i = 0; i < query.columns.size(); i++) {
+      const auto &column = query.columns[i];
+      if (column.member == expression.member &&
+          column.grain == expression.grain &&
+          column.aggregate == expression.aggregate) {
+        return i;
+      }
+    }
+    return by_name();
+  }
+
+  std::string_view sql_;
+  std::vector<Token> tokens_;
+  size_t pos_ = 0;
+  std::vector<std::string> qualifiers_;
+  std::string table_;
+  std::string alias_;
+};
+
+// How one column of an answer is computed from a stored result
+struct ColumnPlan {
+  size_t source; // Column of the stored result
+  TimeGrain source_grain;
+  TimeGrain grain;
+  RollupAggregate aggregate;
+};
+
+// Map each column of query to a column of stored it can be computed from
+bool PlanRollUp(const RollupQuery &stored, const RollupQuery &query,
+                std::vector<ColumnPlan> *plan) {
+  plan->clear();
+  for (const auto &column : query.columns) {
+    bool found = false;
+    for (size_t i = 0; i < stored.columns.size() && !found; i++) {
+      const auto &source = stored.columns[i];
+      if (source.member != column.member ||
+          source.aggregate != column.aggregate) {
+        continue;
+      }
+      if (column.is_measure() || source.grain == column.grain ||
+          (source.grain != TimeGrain::None &&
+           column.grain != TimeGrain::None &&
+           CanRollUp(source.grain, column.grain))) {
+        plan->push_back({i, source.grain, column.grain, column.aggregate});
+        found = true;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SameColumns(const RollupQuery &a, const RollupQuery &b) {
+  if (a.columns.size() != b.columns.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.columns.size(); i++) {
+    if (a.columns[i].member != b.columns[i].member ||
+        a.columns[i].grain != b.columns[i].grain ||
+        a.columns[i].aggregate != b.columns[i].aggregate) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int64_t FloorDiv(int64_t a, int64_t b) {
+  int64_t q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+// Days since 1970-01-01 of the first day of the week (Monday), month,
+// quarter or year holding days
+int64_t TruncateDays(int64_t days, TimeGrain grain) {
+  if (grain == TimeGrain::Week) {
+    // 1970-01-01 was a Thursday
+    return days - (days + 3 - FloorDiv(days + 3, 7) * 7);
+  }
+  // Civil calendar conversions from H. Hinnant's chrono-compatible
+  // low-level date algorithms
+  int64_t z = days + 719468;
+  int64_t era = FloorDiv(z, 146097);
+  auto doe = static_cast<unsigned>(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned month = mp < 10 ? mp + 3 : mp - 9;
+  int64_t year = static_cast<int64_t>(yoe) + era * 400 + (month <= 2);
+  if (grain == TimeGrain::Year) {
+    month = 1;
+  } else if (grain == TimeGrain::Quarter) {
+    month = (month - 1) / 3 * 3 + 1;
+  }
+  year -= month <= 2;
+  era = FloorDiv(year, 400);
+  yoe = static_cast<unsigned>(year - era * 400);
+  doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// Truncate a value counting ticks_per_second since the epoch, or days when
+// ticks_per_second is 0
+int64_t Truncate(int64_t value, int64_t ticks_per_second, TimeGrain grain) {
+  if (ticks_per_second == 0) {
+    return grain > TimeGrain::Day ? TruncateDays(value, grain) : value;
+  }
+  int64_t unit = ticks_per_second;
+  switch (grain) {
+  case TimeGrain::None:
+    return value;
+  case TimeGrain::Second:
+    break;
+  case TimeGrain::Minute:
+    unit *= 60;
+    break;
+  case TimeGrain::Hour:
+    unit *= 3600;
+    break;
+  default: {
+    int64_t per_day = ticks_per_second * 86400;
+    int64_t days = FloorDiv(value, per_day);
+    return (grain == TimeGrain::Day ? days : TruncateDays(days, grain)) *
+           per_day;
+  }
+  }
+  return FloorDiv(value, unit) * unit;
+}
+
+bool AddChecked(int64_t a, int64_t b, int64_t *out) {
+  if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+    return false;
+  }
+  *out = a + b;
+  return true;
+}
+
+// Order of doubles with NaN after every number, as the server sorts them
+int CompareDoubles(double a, double b) {
+  if (std::isnan(a) || std::isnan(b)) {
+    return std::isnan(a) - std::isnan(b);
+  }
+  return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+enum class ValueKind { Int, Float, Bytes };
+
+struct Value {
+  bool null = true;
+  int64_t i = 0;
+  double d = 0;
+  std::string_view s;
+};
+
+int CompareValues(ValueKind kind, const Value &a, const Value &b) {
+  switch (kind) {
+  case ValueKind::Int:
+    return a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+  case ValueKind::Float:
+    return CompareDoubles(a.d, b.d);
+  case ValueKind::Bytes:
+    return a.s.compare(b.s) < 0 ? -1 : (a.s == b.s ? 0 : 1);
+  }
+  return 0;
+}
+
+// A partial group while the rows are grouped: the group of the key
+// columns before this one, extended with this column's value
+struct KeyCode {
+  uint32_t parent;
+  bool null;
+  uint64_t code;
+
+  bool operator==(const KeyCode &other) const {
+    return parent == other.parent && null == other.null &&
+           code == other.code;
+  }
+};
+
+struct KeyCodeHash {
+  size_t operator()(const KeyCode &key) const {
+    uint64_t h = key.code * 0x9E3779B97F4A7C15ULL;
+    h ^= (static_cast<uint64_t>(key.parent) << 1 | key.null) +
+         0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h);
+  }
+};
+
+// Groups the rows of a stored result by the answer's dimensions one key
+// column at a time, then folds each measure column into its groups
+class RollUpKernel {
+public:
+  RollUpKernel(const RollupQuery &query, std::vector<ColumnPlan> plan)
+      : query_(query), plan_(std::move(plan)) {}
+
+  bool Init(const struct ArrowSchema *schema) {
+    if (ArrowArrayViewInitFromSchema(view_.get(), schema, nullptr) !=
+            NANOARROW_OK ||
+        view_->storage_type != NANOARROW_TYPE_STRUCT) {
+      return false;
+    }
+    schema_ = schema;
+    columns_.resize(plan_.size());
+    for (size_t c = 0; c < plan_.size(); c++) {
+      const auto &plan = plan_[c];
+      if (static_cast<int64_t>(plan.source) >= schema->n_children ||
+          schema->children[plan.source]->dictionary) {
+        return false;
+      }
+      struct ArrowSchemaView type;
+      if (ArrowSchemaViewInit(&type, schema->children[plan.source],
+                              nullptr) != NANOARROW_OK) {
+        return false;
+      }
+      Column &column = columns_[c];
+      bool temporal = false;
+      switch (type.type) {
+      case NANOARROW_TYPE_BOOL:
+        if (plan.aggregate != RollupAggregate::None) {
+          return false;
+        }
+        column.kind = ValueKind::Int;
+        break;
+      case NANOARROW_TYPE_INT8:
+      case NANOARROW_TYPE_INT16:
+      case NANOARROW_TYPE_INT32:
+      case NANOARROW_TYPE_INT64:
+      case NANOARROW_TYPE_UINT8:
+      case NANOARROW_TYPE_UINT16:
+      case NANOARROW_TYPE_UINT32:
+        column.kind = ValueKind::Int;
+        break;
+      case NANOARROW_TYPE_FLOAT:
+      case NANOARROW_TYPE_DOUBLE:
+        column.kind = ValueKind::Float;
+        break;
+      case NANOARROW_TYPE_STRING:
+      case NANOARROW_TYPE_LARGE_STRING:
+      case NANOARROW_TYPE_BINARY:
+      case NANOARROW_TYPE_LARGE_BINARY:
+        if (plan.aggregate != RollupAggregate::None) {
+          return false;
+        }
+        column.kind = ValueKind::Bytes;
+        break;
+      case NANOARROW_TYPE_DATE32:
+        temporal = true;
+        break;
+      case NANOARROW_TYPE_DATE64:
+        temporal = true;
+        column.ticks_per_second = 1000;
+        break;
+      case NANOARROW_TYPE_TIMESTAMP: {
+        // Truncation is done in UTC
+        std::string_view timezone = type.timezone ? type.timezone : "";
+        if (!timezone.empty() && timezone != "UTC" &&
+            timezone != "Etc/UTC" && timezone != "+00:00") {
+          return false;
+        }
+        temporal = true;
+        static constexpr int64_t kTicks[] = {1, 1000, 1000000, 1000000000};
+        column.ticks_per_second = kTicks[type.time_unit];
+        break;
+      }
+      default:
+        return false;
+      }
+      if (temporal) {
+        if (plan.aggregate != RollupAggregate::None) {
+          return false;
+        }
+        column.kind = ValueKind::Int;
+      } else if (plan.grain != TimeGrain::None) {
+        return false;
+      }
+      if (plan.aggregate == RollupAggregate::None) {
+        keys_.push_back(c);
+        column.index = levels_.size();
+        levels_.emplace_back();
+        strings_.emplace_back();
+        key_values_.emplace_back();
+      } else {
+        column.index = accumulators_.size();
+        accumulators_.emplace_back();
+      }
+    }
+    if (keys_.empty()) {
+      // Aggregates without GROUP BY return one row, even for no input
+      groups_ = 1;
+      Grow();
+    }
+    return true;
+  }
+
+  bool Add(const struct ArrowArray *batch) {
+    if (ArrowArrayViewSetArray(view_.get(), batch, nullptr) != NANOARROW_OK) {
+      return false;
+    }
+    int64_t length = batch->length;
+    ids_.assign(static_cast<size_t>(length), 0);
+    for (size_t k = 0; k < keys_.size(); k++) {
+      const Column &column = columns_[keys_[k]];
+      const struct ArrowArrayView *values =
+          view_->children[plan_[keys_[k]].source];
+      auto &level = levels_[k];
+      bool last = k + 1 == keys_.size();
+      for (int64_t i = 0; i < length; i++) {
+        KeyCode key{ids_[i], ArrowArrayViewIsNull(values, i) != 0, 0};
+        if (!key.null) {
+          key.code = Code(column, keys_[k], *values, i);
+        }
+        auto [it, inserted] =
+            level.try_emplace(key, static_cast<uint32_t>(level.size()));
+        ids_[i] = it->second;
+        if (last && inserted) {
+          NewGroup(i);
+        }
+      }
+    }
+    Grow();
+    for (size_t c = 0; c < plan_.size(); c++) {
+      if (plan_[c].aggregate != RollupAggregate::None &&
+          !Accumulate(c, *view_->children[plan_[c].source], length)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool Finish(struct ArrowArrayStream *out) {
+    std::vector<uint32_t> order(groups_);
+    std::iota(order.begin(), order.end(), 0);
+    if (!query_.order.empty()) {
+      std::stable_sort(order.begin(), order.end(),
+                       [this](uint32_t a, uint32_t b) { return Less(a, b); });
+    }
+
+    nanoarrow::UniqueSchema schema;
+    ArrowSchemaInit(schema.get());
+    if (ArrowSchemaSetTypeStruct(schema.get(),
+                                 static_cast<int64_t>(plan_.size())) !=
+        NANOARROW_OK) {
+      return false;
+    }
+    for (size_t c = 0; c < plan_.size(); c++) {
+      struct ArrowSchema *child = schema->children[c];
+      child->release(child);
+      if (ArrowSchemaDeepCopy(schema_->children[plan_[c].source], child) !=
+              NANOARROW_OK ||
+          ArrowSchemaSetName(child, query_.columns[c].name.c_str()) !=
+              NANOARROW_OK) {
+        return false;
+      }
+      child->flags |= ARROW_FLAG_NULLABLE;
+    }
+
+    nanoarrow::UniqueArray array;
+    if (ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr) !=
+            NANOARROW_OK ||
+        ArrowArrayStartAppending(array.get()) != NANOARROW_OK) {
+      return false;
+    }
+    for (uint32_t group : order) {
+      for (size_t c = 0; c < plan_.size(); c++) {
+        if (Append(columns_[c].kind, Cell(c, group), array->children[c]) !=
+            NANOARROW_OK) {
+          return false;
+        }
+      }
+      if (ArrowArrayFinishElement(array.get()) != NANOARROW_OK) {
+        return false;
+      }
+    }
+    if (ArrowArrayFinishBuildingDefault(array.get(), nullptr) !=
+        NANOARROW_OK) {
+      return false;
+    }
+    nanoarrow::VectorArrayStream(schema.get(), array.get()).ToArrayStream(out);
+    return true;
+  }
+
+private:
+  struct Column {
+    ValueKind kind = ValueKind::Int;
+    int64_t ticks_per_second = 0; // Of a temporal column; 0 for days
+    size_t index = 0;             // Into levels_ or accumulators_
+  };
+
+  // Partial aggregates of one measure, by group
+  struct Accumulator {
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<uint8_t> valid;
+  };
+
+  Value Read(size_t c, const struct ArrowArrayView &values, int64_t i) const {
+    Value value;
+    if (ArrowArrayViewIsNull(&values, i)) {
+      return value;
+    }
+    value.null = false;
+    const Column &column = columns_[c];
+    switch (column.kind) {
+    case ValueKind::Int:
+      value.i = ArrowArrayViewGetIntUnsafe(&values, i);
+      if (plan_[c].grain != plan_[c].source_grain) {
+        value.i = Truncate(value.i, column.ticks_per_second, plan_[c].grain);
+      }
+      break;
+    case ValueKind::Float:
+      value.d = ArrowArrayViewGetDoubleUnsafe(&values, i);
+      break;
+    case ValueKind::Bytes: {
+      struct ArrowBufferView bytes = ArrowArrayViewGetBytesUnsafe(&values, i);
+      value.s = std::string_view(bytes.data.as_char,
+                                 static_cast<size_t>(bytes.size_bytes));
+      break;
+    }
+    }
+    return value;
+  }
+
+  // A number identifying a non-null key value within its column
+  uint64_t Code(const Column &column, size_t c,
+                const struct ArrowArrayView &values, int64_t i) {
+    Value value = Read(c, values, i);
+    switch (column.kind) {
+    case ValueKind::Int:
+      return static_cast<uint64_t>(value.i);
+    case ValueKind::Float: {
+      // One code for 0 and -0, and for every NaN
+      double d = value.d == 0 ? 0 : (std::isnan(value.d) ? NAN : value.d);
+      uint64_t bits;
+      std::memcpy(&bits, &d, sizeof(bits));
+      return bits;
+    }
+    case ValueKind::Bytes: {
+      auto &strings = strings_[column.index];
+      return strings.try_emplace(value.s, strings.size()).first->second;
+    }
+    }
+    return 0;
+  }
+
+  void NewGroup(int64_t i) {
+    groups_++;
+    for (size_t c : keys_) {
+      key_values_[columns_[c].index].push_back(
+          Read(c, *view_->children[plan_[c].source], i));
+    }
+  }
+
+  void Grow() {
+    for (auto &accumulator : accumulators_) {
+      accumulator.ints.resize(groups_);
+      accumulator.doubles.resize(groups_);
+      accumulator.valid.resize(groups_);
+    }
+  }
+
+  bool Accumulate(size_t c, const struct ArrowArrayView &values,
+                  int64_t length) {
+    Accumulator &accumulator = accumulators_[columns_[c].index];
+    RollupAggregate aggregate = plan_[c].aggregate;
+    bool sum = aggregate == RollupAggregate::Sum ||
+               aggregate == RollupAggregate::Count;
+    if (columns_[c].kind == ValueKind::Int) {
+      for (int64_t i = 0; i < length; i++) {
+        if (ArrowArrayViewIsNull(&values, i)) {
+          continue;
+        }
+        uint32_t g = ids_[i];
+        int64_t v = ArrowArrayViewGetIntUnsafe(&values, i);
+        int64_t &total = accumulator.ints[g];
+        if (!accumulator.valid[g]) {
+          total = v;
+          accumulator.valid[g] = 1;
+        } else if (sum) {
+          if (!AddChecked(total, v, &total)) {
+            return false;
+          }
+        } else if (aggregate == RollupAggregate::Min ? v < total
+                                                     : v > total) {
+          total = v;
+        }
+      }
+      return true;
+    }
+    for (int64_t i = 0; i < length; i++) {
+      if (ArrowArrayViewIsNull(&values, i)) {
+        continue;
+      }
+      uint32_t g = ids_[i];
+      double v = ArrowArrayViewGetDoubleUnsafe(&values, i);
+      double &total = accumulator.doubles[g];
+      if (!accumulator.valid[g]) {
+        total = v;
+        accumulator.valid[g] = 1;
+      } else if (sum) {
+        total += v;
+      } else {
+        int order = CompareDoubles(v, total);
+        if (aggregate == RollupAggregate::Min ? order < 0 : order > 0) {
+          total = v;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Value of column c of the answer for group
+  Value Cell(size_t c, uint32_t group) const {
+    const Column &column = columns_[c];
+    if (plan_[c].aggregate == RollupAggregate::None) {
+      return key_values_[column.index][group];
+    }
+    const Accumulator &accumulator = accumulators_[column.index];
+    Value value;
+    if (accumulator.valid[group]) {
+      value.null = false;
+      value.i = accumulator.ints[group];
+      value.d = accumulator.doubles[group];
+    } else if (plan_[c].aggregate == RollupAggregate::Count) {
+      value.null = false; // A count over no rows
+    }
+    return value;
+  }
+
+  bool Less(uint32_t a, uint32_t b) const {
+    for (const auto &order : query_.order) {
+      Value left = Cell(order.column, a);
+      Value right = Cell(order.column, b);
+      if (left.null || right.null) {
+        if (left.null == right.null) {
+          continue;
+        }
+        return left.null == order.nulls_first;
+      }
+      int compared =
+          CompareValues(columns_[order.column].kind, left, right);
+      if (compared != 0) {
+        return order.descending ? compared > 0 : compared < 0;
+      }
+    }
+    return false;
+  }
+
+  static ArrowErrorCode Append(ValueKind kind, const Value &value,
+                               struct ArrowArray *out) {
+    if (value.null) {
+      return ArrowArrayAppendNull(out, 1);
+    }
+    switch (kind) {
+    case ValueKind::Int:
+      return ArrowArrayAppendInt(out, value.i);
+    case ValueKind::Float:
+      return ArrowArrayAppendDouble(out, value.d);
+    case ValueKind::Bytes: {
+      struct ArrowBufferView bytes;
+      bytes.data.data = value.s.data();
+      bytes.size_bytes = static_cast<int64_t>(value.s.size());
+      return ArrowArrayAppendBytes(out, bytes);
+    }
+    }
+    return EINVAL;
+  }
+
+  const RollupQuery &query_;
+  std::vector<ColumnPlan> plan_;
+  const struct ArrowSchema *schema_ = nullptr;
+  nanoarrow::UniqueArrayView view_;
+  std::vector<Column> columns_;
+  std::vector<size_t> keys_; // Dimension columns of the answer
+  std::vector<std::unordered_map<KeyCode, uint32_t, KeyCodeHash>> levels_;
+  // Text values of each key column seen so far, viewing the stored batches
+  std::vector<std::unordered_map<std::string_view, uint64_t>> strings_;
+  std::vector<std::vector<Value>> key_values_; // By key column, by group
+  std::vector<Accumulator> accumulators_;
+  std::vector<uint32_t> ids_; // Group of each row of the current batch
+  size_t groups_ = 0;
+};
+
+} // namespace
+
+const char *TimeGrainName(TimeGrain grain) {
+  static constexpr const char *kNames[] = {
+      "", "second", "minute", "hour", "day", "week", "month", "quarter", "year",
+  };
+  return kNames[static_cast<int>(grain)];
+}
+
+bool CanRollUp(TimeGrain fine, TimeGrain coarse) {
+  if (fine == coarse) {
+    return true;
+  }
+  if (fine == TimeGrain::None || coarse == TimeGrain::None ||
+      fine == TimeGrain::Week || coarse < fine) {
+    return false;
+  }
+  // Days make up weeks, but weeks straddle months
+  return fine <= TimeGrain::Day || coarse != TimeGrain::Week;
+}
+
+bool RollupQuery::answerable() const {
+  for (const auto &column : columns) {
+    if (column.name.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<RollupQuery> ParseRollupQuery(std::string_view normalized_sql) {
+  return RollupParser(normalized_sql).Parse();
+}
+
+std::optional<std::string> DrillDownQuery(std::string_view normalized_sql) {
+  if (!ParseRollupQuery(normalized_sql)) {
+    return std::nullopt;
+  }
+  std::vector<Token> tokens;
+  if (!Tokenize(normalized_sql, &tokens)) {
+    return std::nullopt;
+  }
+  // Grain arguments of the DATE_TRUNC calls
+  std::vector<const Token *> grains;
+  std::optional<TimeGrain> grain;
+  for (size_t i = 0; i + 2 < tokens.size(); i++) {
+    if (tokens[i].kind != Token::Word ||
+        !EqualsIgnoreCase(tokens[i].text, "date_trunc") ||
+        tokens[i + 1].text != "(" || tokens[i + 2].kind != Token::String) {
+      continue;
+    }
+    auto parsed = ParseGrain(tokens[i + 2].text);
+    if (!parsed || (grain && *grain != *parsed)) {
+      return std::nullopt;
+    }
+    grain = parsed;
+    grains.push_back(&tokens[i + 2]);
+  }
+  if (!grain) {
+    return std::nullopt;
+  }
+  TimeGrain finer;
+  switch (*grain) {
+  case TimeGrain::Year:
+    finer = TimeGrain::Quarter;
+    break;
+  case TimeGrain::Quarter:
+    finer = TimeGrain::Month;
+    break;
+  case TimeGrain::Month:
+  case TimeGrain::Week:
+    finer = TimeGrain::Day;
+    break;
+  case TimeGrain::Day:
+    finer = TimeGrain::Hour;
+    break;
+  default:
+    return std::nullopt;
+  }
+  std::string drilled;
+  size_t copied = 0;
+  for (const Token *token : grains) {
+    drilled.append(normalized_sql.substr(copied, token->begin + 1 - copied));
+    drilled.append(TimeGrainName(finer));
+    copied = token->end - 1;
+  }
+  drilled.append(normalized_sql.substr(copied));
+  return drilled;
+}
+
+bool CubeRollupCache::Answer(std::string_view family,
+                             const RollupQuery &query,
+                             struct ArrowArrayStream *out) {
+  if (!query.answerable()) {
+    return false;
+  }
+  std::shared_ptr<Entry> entry;
+  std::vector<ColumnPlan> plan;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    auto best = entries_.end();
+    std::vector<ColumnPlan> candidate;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      const auto &stored = *it;
+      if (ttl_.count() > 0 && now - stored->stored >= ttl_) {
+        bytes_ -= stored->result->bytes;
+        it = entries_.erase(it);
+        continue;
+      }
+      if (stored->family == family &&
+          PlanRollUp(stored->query, query, &candidate) &&
+          (best == entries_.end() ||
+           stored->result->bytes < (*best)->result->bytes)) {
+        best = it;
+        plan = std::move(candidate);
+      }
+      ++it;
+    }
+    if (best == entries_.end()) {
+      return false;
+    }
+    entries_.splice(entries_.begin(), entries_, best);
+    entry = *best;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->decoded) {
+      entry->decoded = true;
+      nanoarrow::UniqueArrayStream stream;
+      ExportCachedResult(*entry->result, CubeReaderOptions(), stream.get());
+      bool ok = stream->get_schema(stream.get(), entry->schema.get()) ==
+                NANOARROW_OK;
+      while (ok) {
+        nanoarrow::UniqueArray batch;
+        ok = stream->get_next(stream.get(), batch.get()) == NANOARROW_OK;
+        if (!ok || !batch->release) {
+          break;
+        }
+        entry->batches.push_back(std::move(batch));
+      }
+      if (!ok) {
+        entry->schema.reset();
+        entry->batches.clear();
+      }
+    }
+  }
+  // Decoded batches are only read from here on
+  if (!entry->schema->release ||
+      entry->schema->n_children !=
+          static_cast<int64_t>(entry->query.columns.size())) {
+    return false;
+  }
+  RollUpKernel kernel(query, std::move(plan));
+  if (!kernel.Init(entry->schema.get())) {
+    return false;
+  }
+  for (const auto &batch : entry->batches) {
+    if (!kernel.Add(batch.get())) {
+      return false;
+    }
+  }
+  if (!kernel.Finish(out)) {
+    return false;
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void CubeRollupCache::Insert(std::string family, RollupQuery query,
+                             std::shared_ptr<const CubeCachedResult> result) {
+  if (result->bytes > max_bytes_) {
+    return;
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->family = std::move(family);
+  entry->query = std::move(query);
+  entry->result = std::move(result);
+  entry->stored = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    // The same query run again; keep the newer result
+    if ((*it)->family == entry->family &&
+        SameColumns((*it)->query, entry->query)) {
+      bytes_ -= (*it)->result->bytes;
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  while (bytes_ + entry->result->bytes > max_bytes_ && !entries_.empty()) {
+    bytes_ -= entries_.back()->result->bytes;
+    entries_.pop_back();
+  }
+  bytes_ += entry->result->bytes;
+  entries_.push_front(std::move(entry));
+}
+
+void CubeRollupCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  bytes_ = 0;
+}
+
+size_t CubeRollupCache::ErasePreaggregation(std::string_view name) {
+  if (name.empty()) {
+    // Results no pre-aggregation served
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t erased = 0;
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if ((*it)->result->preaggregation == name) {
+      bytes_ -= (*it)->result->bytes;
+      it = entries_.erase(it);
+      erased++;
+    } else {
+      ++it;
+    }
+  }
+  return erased;
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,170 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/result_cache.h"
+
+namespace adbc::cube {
+
+// Granularity of a DATE_TRUNC time dimension; None for a plain column
+enum class TimeGrain {
+  None,
+  Second,
+  Minute,
+  Hour,
+  Day,
+  Week,
+  Month,
+  Quarter,
+  Year,
+};
+
+// Name of grain as DATE_TRUNC takes it ("day"); empty for None
+const char *TimeGrainName(TimeGrain grain);
+
+// Whether buckets of grain coarse are unions of buckets of grain fine, so
+// that rows grouped by fine can be grouped again by coarse
+bool CanRollUp(TimeGrain fine, TimeGrain coarse);
+
+// Aggregate of a measure column; Cube's additive measure types are the
+// only ones a query can name besides MEASURE()
+enum class RollupAggregate {
+  None, // A dimension
+  Sum,
+  Count, // Its partial counts are summed
+  Min,
+  Max,
+};
+
+// One column of a roll-up query's result
+struct RollupColumn {
+  // Member the column reads, unqualified, with unquoted names folded to
+  // lower case; "*" for COUNT(*)
+  std::string member;
+  TimeGrain grain = TimeGrain::None;
+  RollupAggregate aggregate = RollupAggregate::None;
+  // Name the server gives the column: its alias, or the member of a plain
+  // dimension; empty when the server picks one
+  std::string name;
+
+  bool is_measure() const { return aggregate != RollupAggregate::None; }
+};
+
+struct RollupOrder {
+  size_t column;
+  bool descending = false;
+  bool nulls_first = false;
+};
+
+// A query grouping one cube by dimensions and time dimensions and
+// aggregating measures with SUM, COUNT, MIN or MAX:
+//
+//   SELECT <dimension | DATE_TRUNC('grain', dimension) | AGG(measure)
+//           [[AS] alias]>, ...
+//   FROM cube [[AS] alias] [WHERE filter] [GROUP BY ...] [ORDER BY ...]
+struct RollupQuery {
+  // The FROM and WHERE clauses as written: queries with the same source
+  // aggregate the same rows
+  std::string source;
+  std::vector<RollupColumn> columns;
+  std::vector<RollupOrder> order;
+
+  // Whether every column has a known name, so the result can be built
+  // without the server
+  bool answerable() const;
+};
+
+// Parse normalized SQL (see NormalizeQueryText) as a roll-up query; nullopt
+// for anything else, including filters on selected measures, HAVING,
+// LIMIT, DISTINCT, joins and MEASURE()
+std::optional<RollupQuery> ParseRollupQuery(std::string_view normalized_sql);
+
+// The query a dashboard usually runs after a roll-up query: the same one with
+// its time dimension one grain finer (year to quarter, quarter to month,
+// month or week to day, day to hour). Every DATE_TRUNC of normalized_sql is
+// changed, so GROUP BY and ORDER BY follow. nullopt unless it is a roll-up
+// query truncating to one grain, day or coarser.
+std::optional<std::string> DrillDownQuery(std::string_view normalized_sql);
+
+// Results of roll-up queries kept as Arrow columns, answering queries at a
+// coarser grain (fewer dimensions, or a time dimension truncated further)
+// by grouping a finer result again. Keyed by a family string, built by the
+// caller from the connection identity and the query source, and bounded by
+// the total size of the results' IPC messages, which are decoded the first
+// time they are used. Shared by the connections of a database. Thread-safe.
+class CubeRollupCache {
+public:
+  CubeRollupCache(size_t max_bytes, std::chrono::milliseconds ttl)
+      : max_bytes_(max_bytes), ttl_(ttl) {}
+
+  size_t max_bytes() const { return max_bytes_; }
+
+  // Build the result of query into out from the smallest stored result of
+  // the same family it can be rolled up from; false if there is none or
+  // its columns have types the kernels do not aggregate
+  bool Answer(std::string_view family, const RollupQuery &query,
+              struct ArrowArrayStream *out);
+
+  // Store the result of query, evicting the least recently used ones until
+  // it fits; a result larger than the cache is not stored
+  void Insert(std::string family, RollupQuery query,
+              std::shared_ptr<const CubeCachedResult> result);
+
+  void Clear();
+
+  // Drop the results the pre-aggregation name served; returns how many
+  size_t ErasePreaggregation(std::string_view name);
+
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    std::string family;
+    RollupQuery query;
+    std::shared_ptr<const CubeCachedResult> result;
+    std::chrono::steady_clock::time_point stored;
+
+    // Decoded on first use, under mutex
+    std::mutex mutex;
+    bool decoded = false;
+    nanoarrow::UniqueSchema schema;
+    std::vector<nanoarrow::UniqueArray> batches;
+  };
+
+  size_t max_bytes_;
+  std::chrono::milliseconds ttl_;
+  std::mutex mutex_;
+  size_t bytes_ = 0;
+  std::list<std::shared_ptr<Entry>> entries_; // Most recently used first
+  std::atomic<int64_t> hits_{0};
+};
+
+} // namespace adbc::cube
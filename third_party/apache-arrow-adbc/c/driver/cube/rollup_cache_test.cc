@@ -0,0 +1,316 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of the roll-up cache: which queries parse as roll-up queries, the
+// results it builds from a finer stored one, and the queries it must miss
+// (another family, a column or grain the stored result lacks, unnamed
+// columns, evicted results).
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <nanoarrow/nanoarrow.hpp>
+
+#include "driver/cube/arrow_writer.h"
+#include "driver/cube/result_cache.h"
+#include "driver/cube/rollup_cache.h"
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr int32_t kJan30 = 19752; // 2024-01-30 in days since the epoch
+constexpr int32_t kJan31 = 19753;
+constexpr int32_t kFeb01 = 19754;
+constexpr int32_t kJan01 = 19723;
+
+constexpr char kStoredSql[] =
+    "SELECT region, DATE_TRUNC('day', created_at) AS d, SUM(amount) AS total,"
+    " COUNT(*) AS n FROM orders GROUP BY 1, 2";
+
+struct StoredRow {
+  std::optional<std::string> region;
+  int32_t day;
+  int64_t total;
+  int64_t n;
+};
+
+// The stored query's result, as two IPC streams the way the server sends
+// batches, served by the pre-aggregation orders_daily
+std::shared_ptr<const CubeCachedResult> MakeResult() {
+  const std::vector<std::vector<StoredRow>> batches = {
+      {{"east", kJan30, 10, 1}, {"west", kJan30, 5, 2}},
+      {{"east", kJan31, 7, 1},
+       {"east", kFeb01, 3, 3},
+       {std::nullopt, kFeb01, 4, 1}},
+  };
+  nanoarrow::UniqueSchema schema;
+  ArrowSchemaInit(schema.get());
+  EXPECT_EQ(ArrowSchemaSetTypeStruct(schema.get(), 4), NANOARROW_OK);
+  const std::pair<const char *, ArrowType> fields[] = {
+      {"region", NANOARROW_TYPE_STRING},
+      {"d", NANOARROW_TYPE_DATE32},
+      {"total", NANOARROW_TYPE_INT64},
+      {"n", NANOARROW_TYPE_INT64},
+  };
+  for (int64_t i = 0; i < 4; i++) {
+    EXPECT_EQ(ArrowSchemaSetType(schema->children[i], fields[i].second),
+              NANOARROW_OK);
+    EXPECT_EQ(ArrowSchemaSetName(schema->children[i], fields[i].first),
+              NANOARROW_OK);
+  }
+
+  auto result = std::make_shared<CubeCachedResult>();
+  result->preaggregation = "orders_daily";
+  std::vector<uint8_t> message;
+  EXPECT_EQ(WriteArrowIpcSchema(schema.get(), &message, nullptr),
+            NANOARROW_OK);
+  result->schema_message.assign(message.begin(), message.end());
+  for (const auto &rows : batches) {
+    nanoarrow::UniqueArray array;
+    EXPECT_EQ(ArrowArrayInitFromSchema(array.get(), schema.get(), nullptr),
+              NANOARROW_OK);
+    EXPECT_EQ(ArrowArrayStartAppending(array.get()), NANOARROW_OK);
+    for (const auto &row : rows) {
+      if (row.region) {
+        EXPECT_EQ(ArrowArrayAppendString(array->children[0],
+                                         ArrowCharView(row.region->c_str())),
+                  NANOARROW_OK);
+      } else {
+        EXPECT_EQ(ArrowArrayAppendNull(array->children[0], 1), NANOARROW_OK);
+      }
+      EXPECT_EQ(ArrowArrayAppendInt(array->children[1], row.day),
+                NANOARROW_OK);
+      EXPECT_EQ(ArrowArrayAppendInt(array->children[2], row.total),
+                NANOARROW_OK);
+      EXPECT_EQ(ArrowArrayAppendInt(array->children[3], row.n), NANOARROW_OK);
+      EXPECT_EQ(ArrowArrayFinishElement(array.get()), NANOARROW_OK);
+    }
+    EXPECT_EQ(ArrowArrayFinishBuildingDefault(array.get(), nullptr),
+              NANOARROW_OK);
+    message.clear();
+    EXPECT_EQ(WriteArrowIpcStream(schema.get(), array.get(), 0, array->length,
+                                  &message, nullptr),
+              NANOARROW_OK);
+    result->batches.emplace_back(message.begin(), message.end());
+    result->bytes += message.size();
+  }
+  result->bytes += result->schema_message.size();
+  return result;
+}
+
+using Rows = std::vector<std::vector<std::string>>;
+
+RollupQuery Parse(std::string_view sql) {
+  auto query = ParseRollupQuery(NormalizeQueryText(sql));
+  EXPECT_TRUE(query.has_value()) << sql;
+  return query.value_or(RollupQuery());
+}
+
+// Every row of stream, each cell as text: strings as they are, other
+// values as integers, nulls as "null"
+Rows ReadRows(struct ArrowArrayStream *stream) {
+  Rows rows;
+  nanoarrow::UniqueSchema schema;
+  EXPECT_EQ(stream->get_schema(stream, schema.get()), NANOARROW_OK);
+  nanoarrow::UniqueArrayView view;
+  EXPECT_EQ(ArrowArrayViewInitFromSchema(view.get(), schema.get(), nullptr),
+            NANOARROW_OK);
+  while (true) {
+    nanoarrow::UniqueArray array;
+    EXPECT_EQ(stream->get_next(stream, array.get()), NANOARROW_OK);
+    if (!array->release) {
+      break;
+    }
+    EXPECT_EQ(ArrowArrayViewSetArray(view.get(), array.get(), nullptr),
+              NANOARROW_OK);
+    for (int64_t i = 0; i < array->length; i++) {
+      std::vector<std::string> row;
+      for (int64_t c = 0; c < view->n_children; c++) {
+        const struct ArrowArrayView *column = view->children[c];
+        if (ArrowArrayViewIsNull(column, i)) {
+          row.push_back("null");
+        } else if (column->storage_type == NANOARROW_TYPE_STRING) {
+          struct ArrowStringView value =
+              ArrowArrayViewGetStringUnsafe(column, i);
+          row.emplace_back(value.data, static_cast<size_t>(value.size_bytes));
+        } else {
+          row.push_back(std::to_string(ArrowArrayViewGetIntUnsafe(column, i)));
+        }
+      }
+      rows.push_back(std::move(row));
+    }
+  }
+  return rows;
+}
+
+class CubeRollupCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    result_ = MakeResult();
+    cache_.Insert("orders", Parse(kStoredSql), result_);
+  }
+
+  // The rows the cache answers sql with; nullopt on a miss
+  std::optional<Rows> Answer(std::string_view sql,
+                             std::string_view family = "orders") {
+    nanoarrow::UniqueArrayStream stream;
+    if (!cache_.Answer(family, Parse(sql), stream.get())) {
+      return std::nullopt;
+    }
+    return ReadRows(stream.get());
+  }
+
+  std::shared_ptr<const CubeCachedResult> result_;
+  CubeRollupCache cache_{1 << 20, std::chrono::milliseconds(0)};
+};
+
+} // namespace
+
+TEST(ParseRollupQueryTest, Columns) {
+  auto query = Parse(kStoredSql);
+  ASSERT_EQ(query.columns.size(), 4u);
+  EXPECT_EQ(query.source, "FROM orders");
+  EXPECT_EQ(query.columns[0].member, "region");
+  EXPECT_EQ(query.columns[0].name, "region");
+  EXPECT_EQ(query.columns[1].member, "created_at");
+  EXPECT_EQ(query.columns[1].grain, TimeGrain::Day);
+  EXPECT_EQ(query.columns[1].name, "d");
+  EXPECT_EQ(query.columns[2].aggregate, RollupAggregate::Sum);
+  EXPECT_EQ(query.columns[3].member, "*");
+  EXPECT_EQ(query.columns[3].aggregate, RollupAggregate::Count);
+  EXPECT_TRUE(query.answerable());
+
+  query = Parse("select o.region, max(o.amount) from orders o"
+                " where o.status = 'paid' group by o.region"
+                " order by 2 desc nulls last");
+  EXPECT_EQ(query.source, "from orders o where o.status = 'paid'");
+  ASSERT_EQ(query.order.size(), 1u);
+  EXPECT_EQ(query.order[0].column, 1u);
+  EXPECT_TRUE(query.order[0].descending);
+  EXPECT_FALSE(query.order[0].nulls_first);
+  // MAX(o.amount) has no name the result could be built with
+  EXPECT_FALSE(query.answerable());
+}
+
+TEST(ParseRollupQueryTest, Rejects) {
+  for (const char *sql : {
+           "select region, sum(amount) as s from orders",
+           "select region, sum(amount) as s from orders group by 2",
+           "select region, sum(amount) as s from orders group by 1"
+           " having sum(amount) > 1",
+           "select region, sum(amount) as s from orders group by 1 limit 5",
+           "select region, sum(amount) as s from orders"
+           " where amount > 5 group by 1",
+           "select region, sum(amount) as s from orders join users"
+           " on true group by 1",
+           "select distinct region from orders group by 1",
+           "select region, measure(amount) from orders group by 1",
+           "select x.region from orders group by 1",
+           "select date_trunc('fortnight', created_at) from orders group by 1",
+           "insert into orders values (1)",
+       }) {
+    SCOPED_TRACE(sql);
+    EXPECT_FALSE(ParseRollupQuery(NormalizeQueryText(sql)).has_value());
+  }
+}
+
+TEST_F(CubeRollupCacheTest, RollsUpDimensions) {
+  // Days summed per region; nulls sort last in ascending order
+  EXPECT_EQ(Answer("SELECT region, SUM(amount) AS total, COUNT(*) AS n"
+                   " FROM orders GROUP BY region ORDER BY region"),
+            (Rows{{"east", "20", "5"},
+                  {"west", "5", "2"},
+                  {"null", "4", "1"}}));
+  // No dimensions left: one row
+  EXPECT_EQ(Answer("SELECT SUM(amount) AS total FROM orders"),
+            (Rows{{"29"}}));
+  EXPECT_EQ(cache_.hits(), 2);
+}
+
+TEST_F(CubeRollupCacheTest, RollsUpTimeGrain) {
+  EXPECT_EQ(Answer("SELECT DATE_TRUNC('month', created_at) AS m,"
+                   " SUM(amount) AS total, COUNT(*) AS n FROM orders"
+                   " GROUP BY 1 ORDER BY 1 DESC"),
+            (Rows{{std::to_string(kFeb01), "7", "4"},
+                  {std::to_string(kJan01), "22", "4"}}));
+  // The stored grain itself, by region and day
+  EXPECT_EQ(Answer("SELECT DATE_TRUNC('day', created_at) AS d,"
+                   " region, SUM(amount) AS total FROM orders"
+                   " GROUP BY 1, 2 ORDER BY total"),
+            (Rows{{std::to_string(kFeb01), "east", "3"},
+                  {std::to_string(kFeb01), "null", "4"},
+                  {std::to_string(kJan30), "west", "5"},
+                  {std::to_string(kJan31), "east", "7"},
+                  {std::to_string(kJan30), "east", "10"}}));
+  EXPECT_EQ(cache_.hits(), 2);
+}
+
+TEST_F(CubeRollupCacheTest, Misses) {
+  for (auto [sql, family] : {
+           // Another family, so other rows
+           std::pair<const char *, const char *>{
+               "SELECT region, SUM(amount) AS total FROM orders GROUP BY 1",
+               "customers"},
+           // A measure or dimension the stored result lacks
+           {"SELECT region, MAX(amount) AS top FROM orders GROUP BY 1",
+            "orders"},
+           {"SELECT city, SUM(amount) AS total FROM orders GROUP BY 1",
+            "orders"},
+           // A grain finer than the stored one, or none
+           {"SELECT DATE_TRUNC('hour', created_at) AS h, SUM(amount) AS total"
+            " FROM orders GROUP BY 1",
+            "orders"},
+           {"SELECT created_at, SUM(amount) AS total FROM orders GROUP BY 1",
+            "orders"},
+           // A column the server would name
+           {"SELECT region, SUM(amount) FROM orders GROUP BY 1", "orders"},
+       }) {
+    SCOPED_TRACE(sql);
+    EXPECT_EQ(Answer(sql, family), std::nullopt);
+  }
+  EXPECT_EQ(cache_.hits(), 0);
+}
+
+TEST_F(CubeRollupCacheTest, DroppedResultsMiss) {
+  constexpr char kSql[] = "SELECT SUM(amount) AS total FROM orders";
+  ASSERT_NE(Answer(kSql), std::nullopt);
+
+  // Only results the named pre-aggregation served are dropped
+  EXPECT_EQ(cache_.ErasePreaggregation("orders_monthly"), 0u);
+  EXPECT_EQ(cache_.ErasePreaggregation("orders_daily"), 1u);
+  EXPECT_EQ(Answer(kSql), std::nullopt);
+
+  cache_.Insert("orders", Parse(kStoredSql), result_);
+  ASSERT_NE(Answer(kSql), std::nullopt);
+  cache_.Clear();
+  EXPECT_EQ(Answer(kSql), std::nullopt);
+
+  // A result larger than the whole cache is not stored
+  CubeRollupCache small(result_->bytes - 1, std::chrono::milliseconds(0));
+  small.Insert("orders", Parse(kStoredSql), result_);
+  nanoarrow::UniqueArrayStream stream;
+  EXPECT_FALSE(small.Answer("orders", Parse(kSql), stream.get()));
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,114 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/shared_memory.h"
+
+#include <cerrno>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace adbc::cube {
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING)
+
+bool SharedMemoryAvailable() { return true; }
+
+int CubeSharedMemory::Create(size_t size,
+                             std::shared_ptr<CubeSharedMemory> *out) {
+  static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size = (size + page_size - 1) / page_size * page_size;
+  if (size == 0) {
+    return EINVAL;
+  }
+  int fd = memfd_create("adbc-cube-results", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return errno;
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0 ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+    int code = errno;
+    close(fd);
+    return code;
+  }
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    int code = errno;
+    close(fd);
+    return code;
+  }
+  out->reset(new CubeSharedMemory(fd, static_cast<uint8_t *>(addr), size));
+  return 0;
+}
+
+CubeSharedMemory::~CubeSharedMemory() {
+  munmap(data_, size_);
+  close(fd_);
+}
+
+#else
+
+bool SharedMemoryAvailable() { return false; }
+
+int CubeSharedMemory::Create(size_t, std::shared_ptr<CubeSharedMemory> *) {
+  return ENOTSUP;
+}
+
+CubeSharedMemory::~CubeSharedMemory() = default;
+
+#endif
+
+bool CubeSharedMemory::View(int64_t offset, int64_t length,
+                            std::shared_ptr<const CubeIpcBytes> *out) {
+  // The reader may read up to the end of a message's 64-byte padding
+  const auto size = static_cast<int64_t>(size_);
+  const auto alignment = static_cast<int64_t>(kIpcBufferAlignment);
+  if (offset < 0 || length < 0 || offset > size ||
+      length > size - offset ||
+      (length + alignment - 1) / alignment * alignment > size - offset) {
+    return false;
+  }
+  auto self = shared_from_this();
+  std::shared_ptr<const void> range(
+      data_ + offset,
+      [self, offset, length](const void *) { self->Release(offset, length); });
+  *out = std::make_shared<const CubeIpcBytes>(std::move(range), data_ + offset,
+                                              static_cast<size_t>(length));
+  return true;
+}
+
+void CubeSharedMemory::Release(int64_t offset, int64_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  released_.emplace_back(offset, length);
+}
+
+std::vector<std::pair<int64_t, int64_t>> CubeSharedMemory::TakeReleased() {
+  std::vector<std::pair<int64_t, int64_t>> released;
+  std::lock_guard<std::mutex> lock(mutex_);
+  released.swap(released_);
+  return released;
+}
+
+bool CubeSharedMemory::HasReleased() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !released_.empty();
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,82 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "driver/cube/ipc_buffer.h"
+
+namespace adbc::cube {
+
+/// Whether this build can share memory with the server (Linux memfd)
+bool SharedMemoryAvailable();
+
+/// Region a server on the same host writes result batches into instead of
+/// sending them over the socket. The driver creates it as a sealed memfd
+/// (the server cannot shrink it under our mapping) and passes the fd over
+/// the Unix socket; the server then names batches by offset and length.
+/// Readers share the batch bytes in place, and once the last array using
+/// a batch is released its range is queued to be handed back to the
+/// server. Thread-safe.
+class CubeSharedMemory
+    : public std::enable_shared_from_this<CubeSharedMemory> {
+public:
+  /// Create and map a region of at least size bytes
+  /// @return 0, or an errno value
+  static int Create(size_t size, std::shared_ptr<CubeSharedMemory> *out);
+
+  ~CubeSharedMemory();
+  CubeSharedMemory(const CubeSharedMemory &) = delete;
+  CubeSharedMemory &operator=(const CubeSharedMemory &) = delete;
+
+  /// The memfd to pass to the server
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+
+  /// Share the batch at [offset, offset + length); its range is released
+  /// when out and every copy of it are gone
+  /// @return false if the range, with its padding, is not in the region
+  bool View(int64_t offset, int64_t length,
+            std::shared_ptr<const CubeIpcBytes> *out);
+
+  /// Queue a range that was never viewed (its result was discarded)
+  void Release(int64_t offset, int64_t length);
+
+  /// Ranges released since the last call, for SharedMemoryRelease
+  std::vector<std::pair<int64_t, int64_t>> TakeReleased();
+
+  /// Whether TakeReleased has anything to return
+  bool HasReleased() const;
+
+private:
+  CubeSharedMemory(int fd, uint8_t *data, size_t size)
+      : fd_(fd), data_(data), size_(size) {}
+
+  int fd_;
+  uint8_t *data_; // Read-only mapping of the whole region
+  size_t size_;
+  mutable std::mutex mutex_;
+  std::vector<std::pair<int64_t, int64_t>> released_;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,543 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/shared_result_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "driver/cube/result_cache.h"
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr uint64_t kResultMagic = 0x324c535245425543; // "CUBERSL2"
+
+// Messages start on, and are padded to, this boundary, as received ones
+// are (see CubeAlignedAllocator)
+constexpr size_t kAlignment = 64;
+
+// Start of a result image, followed by batch_count (offset, size) pairs
+// and the messages
+struct ResultHeader {
+  uint64_t magic;
+  uint64_t digest_high; // Of the key stored under
+  uint64_t digest_low;
+  int64_t rows_affected;
+  uint64_t schema_offset;
+  uint64_t schema_size;
+  uint64_t batch_count;
+  uint64_t schema_once;
+};
+
+size_t Align(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// Where the batch table and the schema message of an image start
+constexpr size_t kTableOffset = sizeof(ResultHeader);
+size_t SchemaOffset(const CubeCachedResult &result) {
+  return Align(kTableOffset + 16 * result.batches.size(), kAlignment);
+}
+
+} // namespace
+
+size_t CubeResultImageSize(const CubeCachedResult &result) {
+  size_t size = SchemaOffset(result) +
+                Align(result.schema_message.size(), kAlignment);
+  for (const auto &batch : result.batches) {
+    size += Align(batch.size(), kAlignment);
+  }
+  return size;
+}
+
+void WriteResultImage(const CubeSqlFingerprint &digest,
+                      const CubeCachedResult &result, uint8_t *out) {
+  size_t pos = SchemaOffset(result);
+  ResultHeader header{};
+  header.magic = kResultMagic;
+  header.digest_high = digest.high;
+  header.digest_low = digest.low;
+  header.rows_affected = result.rows_affected;
+  header.schema_offset = pos;
+  header.schema_size = result.schema_message.size();
+  header.batch_count = result.batches.size();
+  header.schema_once = result.schema_once ? 1 : 0;
+  std::memcpy(out, &header, sizeof(header));
+  if (!result.schema_message.empty()) {
+    std::memcpy(out + pos, result.schema_message.data(),
+                result.schema_message.size());
+  }
+  pos += Align(result.schema_message.size(), kAlignment);
+  uint8_t *table = out + kTableOffset;
+  for (const auto &batch : result.batches) {
+    uint64_t range[2] = {pos, batch.size()};
+    std::memcpy(table, range, sizeof(range));
+    table += sizeof(range);
+    if (!batch.empty()) {
+      std::memcpy(out + pos, batch.data(), batch.size());
+    }
+    pos += Align(batch.size(), kAlignment);
+  }
+}
+
+bool ReadResultImage(std::shared_ptr<const void> owner, const uint8_t *data,
+                     size_t size, const CubeSqlFingerprint &digest,
+                     CubeSharedResult *out) {
+  ResultHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != kResultMagic || header.digest_high != digest.high ||
+      header.digest_low != digest.low) {
+    return false;
+  }
+  size_t pos = kTableOffset;
+  // The reader may read up to the end of a message's padding
+  auto in_image = [size](uint64_t offset, uint64_t length) {
+    return offset <= size && Align(length, kAlignment) <= size - offset;
+  };
+  if (pos > size || header.batch_count > (size - pos) / 16 ||
+      !in_image(header.schema_offset, header.schema_size)) {
+    return false;
+  }
+  out->batches.clear();
+  out->batches.reserve(header.batch_count);
+  for (uint64_t i = 0; i < header.batch_count; i++, pos += 16) {
+    uint64_t range[2];
+    std::memcpy(range, data + pos, sizeof(range));
+    if (!in_image(range[0], range[1])) {
+      return false;
+    }
+    out->batches.emplace_back(data + range[0], range[1]);
+  }
+  out->schema_message = {data + header.schema_offset, header.schema_size};
+  out->schema_once = header.schema_once != 0;
+  out->rows_affected = header.rows_affected;
+  out->owner = std::move(owner);
+  return true;
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+namespace {
+
+constexpr uint64_t kIndexMagic = 0x58444e4945425543; // "CUBEINDX"
+constexpr uint32_t kLayoutVersion = 2;
+
+// Slots a key may be stored in, from the one its hash picks on
+constexpr size_t kProbeSlots = 8;
+
+// How long Open waits for the process creating the index to set it up
+constexpr int kOpenWaitMs = 1000;
+
+// FNV-1a, which every process computes alike whatever it was built with;
+// 0 marks empty slots, so it is never returned
+uint64_t HashKey(std::string_view key) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash ? hash : 1;
+}
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+// A slot of the index. Its sequence is odd while a writer holds it;
+// readers read the other fields between two loads of an even sequence and
+// discard them if it changed.
+struct CubeSharedResultCache::Slot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> hash; // 0 = empty
+  std::atomic<uint64_t> id;   // Of the result's segment
+  std::atomic<uint64_t> bytes;
+  std::atomic<int64_t> stored_ms; // Since the Unix epoch
+};
+
+// Start of the index segment, followed by slot_count slots. The fields
+// before ready are written once by the process creating it.
+struct CubeSharedResultCache::Index {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint64_t max_bytes;
+  std::atomic<uint32_t> ready;
+  std::atomic<uint64_t> next_id;
+  std::atomic<int64_t> bytes; // Of the results in the slots
+};
+
+// Processes share these through memory, so they must not hide a lock
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+bool SharedResultCacheAvailable() { return true; }
+
+int CubeSharedResultCache::Open(const std::string &name, size_t max_bytes,
+                                size_t entries, std::chrono::milliseconds ttl,
+                                std::shared_ptr<CubeSharedResultCache> *out) {
+  if (name.empty() || name.size() > 128 ||
+      name.find('/') != std::string::npos || entries == 0 ||
+      entries > std::numeric_limits<uint32_t>::max()) {
+    return EINVAL;
+  }
+  std::string path = "/adbc-cube-" + name;
+  size_t size = sizeof(Index) + entries * sizeof(Slot);
+  bool created = true;
+  int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = shm_open(path.c_str(), O_RDWR, 0);
+  }
+  if (fd < 0) {
+    return errno;
+  }
+  if (created) {
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      int code = errno;
+      close(fd);
+      shm_unlink(path.c_str());
+      return code;
+    }
+  } else {
+    // The process creating it may not have sized it yet
+    struct stat st;
+    for (int waited = 0;; waited++) {
+      if (fstat(fd, &st) != 0) {
+        int code = errno;
+        close(fd);
+        return code;
+      }
+      if (static_cast<size_t>(st.st_size) >= sizeof(Index)) {
+        break;
+      }
+      if (waited == kOpenWaitMs) {
+        close(fd);
+        return EAGAIN;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    size = static_cast<size_t>(st.st_size);
+  }
+  void *addr =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  int code = errno;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return code;
+  }
+  auto *index = static_cast<Index *>(addr);
+  if (created) {
+    // The segment starts zeroed: every slot is empty at sequence 0
+    index->magic = kIndexMagic;
+    index->version = kLayoutVersion;
+    index->slot_count = static_cast<uint32_t>(entries);
+    index->max_bytes = max_bytes;
+    index->ready.store(1, std::memory_order_release);
+  } else {
+    for (int waited = 0; !index->ready.load(std::memory_order_acquire);
+         waited++) {
+      if (waited == kOpenWaitMs) {
+        munmap(addr, size);
+        return EAGAIN;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (index->magic != kIndexMagic || index->version != kLayoutVersion ||
+        size < sizeof(Index) + index->slot_count * sizeof(Slot)) {
+      munmap(addr, size);
+      return EINVAL;
+    }
+  }
+  out->reset(new CubeSharedResultCache(std::move(path), index, size, ttl));
+  return 0;
+}
+
+CubeSharedResultCache::~CubeSharedResultCache() { munmap(index_, size_); }
+
+size_t CubeSharedResultCache::max_bytes() const {
+  return static_cast<size_t>(index_->max_bytes);
+}
+
+CubeSharedResultCache::Slot *CubeSharedResultCache::slots() const {
+  return reinterpret_cast<Slot *>(index_ + 1);
+}
+
+std::string CubeSharedResultCache::SegmentName(uint64_t id) const {
+  char suffix[24];
+  std::snprintf(suffix, sizeof(suffix), ".%016llx",
+                static_cast<unsigned long long>(id));
+  return name_ + suffix;
+}
+
+bool CubeSharedResultCache::Find(std::string_view key, CubeSharedResult *out) {
+  uint64_t hash = HashKey(key);
+  Slot *slots = this->slots();
+  size_t count = index_->slot_count;
+  for (size_t i = 0; i < kProbeSlots && i < count; i++) {
+    Slot *slot = &slots[(hash + i) % count];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    uint64_t slot_hash = slot->hash.load(std::memory_order_relaxed);
+    uint64_t id = slot->id.load(std::memory_order_relaxed);
+    int64_t stored_ms = slot->stored_ms.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((sequence & 1) != 0 ||
+        slot->sequence.load(std::memory_order_relaxed) != sequence ||
+        slot_hash != hash) {
+      continue;
+    }
+    if (ttl_.count() > 0 && NowMs() - stored_ms >= ttl_.count()) {
+      if (Claim(slot, sequence)) {
+        Evict(slot, sequence);
+      }
+      continue;
+    }
+    // The result may have been evicted since, or the hash be another key's
+    if (MapResult(id, key, out)) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CubeSharedResultCache::MapResult(uint64_t id, std::string_view key,
+                                      CubeSharedResult *out) {
+  int fd = shm_open(SegmentName(id).c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  std::shared_ptr<const void> mapping(addr, [size](const void *data) {
+    munmap(const_cast<void *>(data), size);
+  });
+  return ReadResultImage(std::move(mapping), static_cast<const uint8_t *>(addr),
+                         size, CubeMurmurHash3(key), out);
+}
+
+uint64_t CubeSharedResultCache::WriteResult(std::string_view key,
+                                            const CubeCachedResult &result,
+                                            size_t *bytes) {
+  size_t size = CubeResultImageSize(result);
+  uint64_t id = index_->next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::string path = SegmentName(id);
+  int fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return 0;
+  }
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    close(fd);
+    shm_unlink(path.c_str());
+    return 0;
+  }
+  void *addr =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    return 0;
+  }
+  // Padding is left as ftruncate zeroed it
+  WriteResultImage(CubeMurmurHash3(key), result,
+                   static_cast<uint8_t *>(addr));
+  munmap(addr, size);
+  *bytes = size;
+  return id;
+}
+
+void CubeSharedResultCache::Insert(std::string_view key,
+                                   const CubeCachedResult &result) {
+  size_t budget = max_bytes();
+  if (result.bytes > budget) {
+    return;
+  }
+  // Made room for first, so that the index stays near its budget while
+  // the result is written; processes racing here may overshoot it a little
+  while (index_->bytes.load(std::memory_order_relaxed) +
+             static_cast<int64_t>(result.bytes) >
+         static_cast<int64_t>(budget)) {
+    if (!EvictOldest()) {
+      break;
+    }
+  }
+  size_t bytes = 0;
+  uint64_t id = WriteResult(key, result, &bytes);
+  if (id == 0) {
+    return;
+  }
+
+  // The slot holding key already, else an empty one, else the oldest
+  uint64_t hash = HashKey(key);
+  Slot *slots = this->slots();
+  size_t count = index_->slot_count;
+  Slot *target = nullptr;
+  uint64_t target_sequence = 0;
+  int target_rank = 0;
+  int64_t target_ms = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < kProbeSlots && i < count; i++) {
+    Slot *slot = &slots[(hash + i) % count];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0) {
+      continue;
+    }
+    uint64_t slot_hash = slot->hash.load(std::memory_order_relaxed);
+    int64_t stored_ms = slot->stored_ms.load(std::memory_order_relaxed);
+    int rank = slot_hash == hash ? 3 : slot_hash == 0 ? 2 : 1;
+    if (rank > target_rank || (rank == 1 && stored_ms < target_ms)) {
+      target = slot;
+      target_sequence = sequence;
+      target_rank = rank;
+      target_ms = stored_ms;
+    }
+  }
+  if (!target || !Claim(target, target_sequence)) {
+    // Another process is writing there; this result is not kept
+    shm_unlink(SegmentName(id).c_str());
+    return;
+  }
+  if (target->hash.load(std::memory_order_relaxed) != 0) {
+    shm_unlink(
+        SegmentName(target->id.load(std::memory_order_relaxed)).c_str());
+    index_->bytes.fetch_sub(
+        static_cast<int64_t>(target->bytes.load(std::memory_order_relaxed)),
+        std::memory_order_relaxed);
+  }
+  target->hash.store(hash, std::memory_order_relaxed);
+  target->id.store(id, std::memory_order_relaxed);
+  target->bytes.store(bytes, std::memory_order_relaxed);
+  target->stored_ms.store(NowMs(), std::memory_order_relaxed);
+  index_->bytes.fetch_add(static_cast<int64_t>(bytes),
+                          std::memory_order_relaxed);
+  target->sequence.store(target_sequence + 2, std::memory_order_release);
+}
+
+bool CubeSharedResultCache::Claim(Slot *slot, uint64_t sequence) {
+  if ((sequence & 1) != 0 ||
+      !slot->sequence.compare_exchange_strong(sequence, sequence + 1,
+                                              std::memory_order_acquire)) {
+    return false;
+  }
+  // Readers that see the fields change see the odd sequence first
+  std::atomic_thread_fence(std::memory_order_release);
+  return true;
+}
+
+void CubeSharedResultCache::Evict(Slot *slot, uint64_t sequence) {
+  if (slot->hash.load(std::memory_order_relaxed) != 0) {
+    // Mappings made already keep the segment until they are released
+    shm_unlink(SegmentName(slot->id.load(std::memory_order_relaxed)).c_str());
+    index_->bytes.fetch_sub(
+        static_cast<int64_t>(slot->bytes.load(std::memory_order_relaxed)),
+        std::memory_order_relaxed);
+    slot->hash.store(0, std::memory_order_relaxed);
+  }
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool CubeSharedResultCache::EvictOldest() {
+  Slot *slots = this->slots();
+  size_t count = index_->slot_count;
+  Slot *oldest = nullptr;
+  uint64_t oldest_sequence = 0;
+  int64_t oldest_ms = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < count; i++) {
+    uint64_t sequence = slots[i].sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0 ||
+        slots[i].hash.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    int64_t stored_ms = slots[i].stored_ms.load(std::memory_order_relaxed);
+    if (stored_ms < oldest_ms) {
+      oldest = &slots[i];
+      oldest_sequence = sequence;
+      oldest_ms = stored_ms;
+    }
+  }
+  if (!oldest || !Claim(oldest, oldest_sequence)) {
+    return false;
+  }
+  Evict(oldest, oldest_sequence);
+  return true;
+}
+
+void CubeSharedResultCache::Clear() {
+  Slot *slots = this->slots();
+  size_t count = index_->slot_count;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t sequence = slots[i].sequence.load(std::memory_order_acquire);
+    if (slots[i].hash.load(std::memory_order_relaxed) != 0 &&
+        Claim(&slots[i], sequence)) {
+      Evict(&slots[i], sequence);
+    }
+  }
+}
+
+#else
+
+bool SharedResultCacheAvailable() { return false; }
+
+int CubeSharedResultCache::Open(const std::string &, size_t, size_t,
+                                std::chrono::milliseconds,
+                                std::shared_ptr<CubeSharedResultCache> *) {
+  return ENOTSUP;
+}
+
+CubeSharedResultCache::~CubeSharedResultCache() = default;
+
+size_t CubeSharedResultCache::max_bytes() const { return 0; }
+
+bool CubeSharedResultCache::Find(std::string_view, CubeSharedResult *) {
+  return false;
+}
+
+void CubeSharedResultCache::Insert(std::string_view,
+                                   const CubeCachedResult &) {}
+
+void CubeSharedResultCache::Clear() {}
+
+#endif
+
+} // namespace adbc::cube
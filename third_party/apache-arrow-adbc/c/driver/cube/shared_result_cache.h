@@ -0,0 +1,154 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "driver/cube/sql_fingerprint.h"
+
+namespace adbc::cube {
+
+struct CubeCachedResult;
+
+/// Whether this build can share cached results between processes (POSIX
+/// shared memory)
+bool SharedResultCacheAvailable();
+
+/// A result read in place from its image (see WriteResultImage), such as
+/// a mapping of a CubeSharedResultCache segment. Its messages point into
+/// the image, which owner keeps alive.
+struct CubeSharedResult {
+  std::shared_ptr<const void> owner;
+  bool schema_once = false;
+  std::pair<const uint8_t *, size_t> schema_message{nullptr, 0};
+  std::vector<std::pair<const uint8_t *, size_t>> batches;
+  int64_t rows_affected = -1;
+};
+
+/// Bytes of the image WriteResultImage lays result out in
+size_t CubeResultImageSize(const CubeCachedResult &result);
+
+/// Lay result out in the CubeResultImageSize bytes at out, which must be
+/// zeroed: a header holding digest, a hash of the key it is stored under
+/// (the key holds the token, so is never written), then the messages,
+/// each on a 64-byte boundary and padded to one, so that they can be
+/// decoded in place wherever the image is mapped
+void WriteResultImage(const CubeSqlFingerprint &digest,
+                      const CubeCachedResult &result, uint8_t *out);
+
+/// Point out at the messages of the image of size bytes at data, which
+/// owner keeps alive; false if it is malformed or was not written with
+/// digest
+bool ReadResultImage(std::shared_ptr<const void> owner, const uint8_t *data,
+                     size_t size, const CubeSqlFingerprint &digest,
+                     CubeSharedResult *out);
+
+/// Results of recent queries shared by every process on the host that
+/// opens the cache under the same name, so that processes running the
+/// same queries do not each keep, and each miss, their own copy.
+///
+/// Each result is a POSIX shared memory segment of its own, written once
+/// and never changed. An index segment maps CubeResultCacheKey hashes to
+/// them, in slots guarded by sequence locks: readers take no lock, and
+/// writers claim a slot with a compare-and-swap, giving up rather than
+/// waiting when another process holds it. A hit maps the result's segment
+/// and decodes its messages in place. Evicting a result unlinks its
+/// segment, so mappings already made stay valid until their arrays are
+/// released.
+///
+/// Results are evicted oldest first once their bytes exceed the budget the
+/// first process gave the index, or when no slot is left near their key.
+/// Segments hold a 128-bit MurmurHash3 of the key, compared on every hit,
+/// rather than the key and the token in it. The segments outlive the
+/// processes, in /dev/shm on Linux, until evicted. Thread-safe and
+/// fork-safe.
+class CubeSharedResultCache {
+public:
+  /// Open the index called name, creating it with room for max_bytes of
+  /// results in up to entries slots if no process has yet
+  /// @return 0, or an errno value (EINVAL for an invalid name, or an index
+  ///   of another layout)
+  static int Open(const std::string &name, size_t max_bytes, size_t entries,
+                  std::chrono::milliseconds ttl,
+                  std::shared_ptr<CubeSharedResultCache> *out);
+
+  ~CubeSharedResultCache();
+  CubeSharedResultCache(const CubeSharedResultCache &) = delete;
+  CubeSharedResultCache &operator=(const CubeSharedResultCache &) = delete;
+
+  /// Budget of the index, as the process that created it set it
+  size_t max_bytes() const;
+
+  /// Result stored under key by any process, if it has not expired
+  bool Find(std::string_view key, CubeSharedResult *out);
+
+  /// Store a result, evicting the oldest until it fits; one larger than
+  /// the budget, or that finds no free slot, is not stored
+  void Insert(std::string_view key, const CubeCachedResult &result);
+
+  /// Drop every result, for all processes
+  void Clear();
+
+  int64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+private:
+  struct Index;
+  struct Slot;
+
+  CubeSharedResultCache(std::string name, Index *index, size_t size,
+                        std::chrono::milliseconds ttl)
+      : name_(std::move(name)), index_(index), size_(size), ttl_(ttl) {}
+
+  /// Name of the segment holding result id
+  std::string SegmentName(uint64_t id) const;
+
+  /// Map and check the segment of result id; false if it is gone or was
+  /// not stored under key
+  bool MapResult(uint64_t id, std::string_view key, CubeSharedResult *out);
+
+  /// Write result to a new segment; 0 if it could not be created
+  uint64_t WriteResult(std::string_view key, const CubeCachedResult &result,
+                       size_t *bytes);
+
+  /// Take slot from sequence, an even value it was read at, for writing
+  bool Claim(Slot *slot, uint64_t sequence);
+
+  /// Unlink the result of a claimed slot and empty it, then release it
+  void Evict(Slot *slot, uint64_t sequence);
+
+  /// Evict the oldest result; false if there is none or it was taken
+  bool EvictOldest();
+
+  Slot *slots() const;
+
+  const std::string name_;
+  Index *index_; // Mapping of the whole index segment
+  const size_t size_;
+  const std::chrono::milliseconds ttl_;
+  std::atomic<int64_t> hits_{0};
+};
+
+} // namespace adbc::cube
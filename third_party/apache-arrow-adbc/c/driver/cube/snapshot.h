@@ -0,0 +1,143 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace adbc::cube {
+
+/// Reader slot a thread tries first, so that threads spread over them
+inline size_t CubeSnapshotSlotHint() {
+  thread_local const size_t hint =
+      std::hash<std::thread::id>()(std::this_thread::get_id());
+  return hint;
+}
+
+/// A value read by many threads and replaced rarely, published as
+/// immutable snapshots behind an atomic pointer, so that readers take no
+/// lock and write to nothing shared but a reader slot.
+///
+/// A reader announces itself in one of a fixed set of slots, each on a
+/// cache line of its own, with the epoch it started in, then reads the
+/// current snapshot and leaves. Store swaps the pointer and retires the
+/// snapshot it replaced with the epoch it did so in; a retired snapshot is
+/// released once no slot holds that epoch or an earlier one, since only
+/// readers that started before it was replaced can still be reading it.
+/// Readers copying the snapshot's shared_ptr out keep it alive past that,
+/// as usual. Stores are serialised, and release what they can; the rest
+/// goes with the next Store or the destructor. Thread-safe. A child forked
+/// while a reader of the parent was inside Read keeps that slot held, and
+/// so keeps the snapshots it replaces until the destructor.
+template <typename T>
+class CubeSnapshot {
+public:
+  explicit CubeSnapshot(std::shared_ptr<const T> value)
+      : current_(new std::shared_ptr<const T>(std::move(value))) {}
+  ~CubeSnapshot() { delete current_.load(std::memory_order_relaxed); }
+
+  CubeSnapshot(const CubeSnapshot &) = delete;
+  CubeSnapshot &operator=(const CubeSnapshot &) = delete;
+
+  /// Call read with the current snapshot (possibly null); it must not
+  /// keep references into it unless it copies the shared_ptr. With more
+  /// than kSlots threads inside Read at once, the others wait for a slot,
+  /// yielding after each pass over them.
+  template <typename Fn>
+  auto Read(Fn &&read) const {
+    size_t slot = CubeSnapshotSlotHint() % kSlots;
+    for (size_t tried = 1;; tried++) {
+      uint64_t epoch = epoch_.load();
+      uint64_t idle = 0;
+      if (slots_[slot].epoch.compare_exchange_weak(idle, epoch)) {
+        break;
+      }
+      slot = (slot + 1) % kSlots;
+      if (tried % kSlots == 0) {
+        std::this_thread::yield();
+      }
+    }
+    struct Leave {
+      std::atomic<uint64_t> *epoch;
+      ~Leave() { epoch->store(0, std::memory_order_release); }
+    } leave{&slots_[slot].epoch};
+    return read(static_cast<const std::shared_ptr<const T> &>(
+        *current_.load()));
+  }
+
+  /// The current snapshot (possibly null)
+  std::shared_ptr<const T> Load() const {
+    return Read([](const std::shared_ptr<const T> &value) { return value; });
+  }
+
+  /// Publish value in place of the current snapshot
+  void Store(std::shared_ptr<const T> value) {
+    std::unique_ptr<std::shared_ptr<const T>> next(
+        new std::shared_ptr<const T>(std::move(value)));
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<std::shared_ptr<const T>> previous(
+        current_.exchange(next.release()));
+    retired_.emplace_back(epoch_.fetch_add(1), std::move(previous));
+    Release();
+  }
+
+private:
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{0}; // 0 = no reader
+  };
+
+  /// Readers that can be inside Read at once without waiting for a slot
+  static constexpr size_t kSlots = 64;
+
+  /// Release the retired snapshots no reader can still be reading;
+  /// mutex_ is held
+  void Release() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto &slot : slots_) {
+      uint64_t epoch = slot.epoch.load();
+      if (epoch != 0) {
+        oldest = std::min(oldest, epoch);
+      }
+    }
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [oldest](const auto &retired) {
+                                    return retired.first < oldest;
+                                  }),
+                   retired_.end());
+  }
+
+  std::atomic<std::shared_ptr<const T> *> current_;
+  std::atomic<uint64_t> epoch_{1};
+  mutable Slot slots_[kSlots];
+  std::mutex mutex_; // Serialises Store; guards retired_
+  // Replaced snapshots, with the epoch they were replaced in
+  std::vector<std::pair<uint64_t,
+                        std::unique_ptr<std::shared_ptr<const T>>>>
+      retired_;
+};
+
+} // namespace adbc::cube
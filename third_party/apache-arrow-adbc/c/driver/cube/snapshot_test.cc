@@ -0,0 +1,206 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of CubeSnapshot: when replaced snapshots are released, and readers
+// (more of them than there are reader slots) racing a writer, each seeing
+// whole snapshots only, in the order they were stored.
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "driver/cube/snapshot.h"
+
+namespace adbc::cube {
+
+namespace {
+
+// A snapshot that counts the live ones; negated always holds -version, so
+// a reader seeing a torn or released value notices
+struct Value {
+  explicit Value(int64_t version, std::atomic<int64_t> *live)
+      : version(version), negated(-version), live(live) {
+    live->fetch_add(1);
+  }
+  ~Value() {
+    negated = 0;
+    live->fetch_sub(1);
+  }
+
+  int64_t version;
+  int64_t negated;
+  std::atomic<int64_t> *live;
+};
+
+// A thread inside Read of snapshot, checking the snapshot it reads, until
+// leave is set; returned once it is inside
+std::thread HoldRead(const CubeSnapshot<Value> *snapshot,
+                     const std::atomic<bool> *leave) {
+  std::atomic<bool> entered{false};
+  std::thread reader([snapshot, leave, &entered] {
+    snapshot->Read([&](const std::shared_ptr<const Value> &value) {
+      int64_t version = value->version;
+      entered = true;
+      while (!*leave) {
+        std::this_thread::yield();
+      }
+      // Still whole, though replaced since
+      EXPECT_EQ(value->version, version);
+      EXPECT_EQ(value->negated, -version);
+    });
+  });
+  while (!entered) {
+    std::this_thread::yield();
+  }
+  return reader;
+}
+
+} // namespace
+
+TEST(CubeSnapshotTest, LoadAndStore) {
+  std::atomic<int64_t> live{0};
+  CubeSnapshot<Value> snapshot(nullptr);
+  EXPECT_EQ(snapshot.Load(), nullptr);
+  snapshot.Store(std::make_shared<Value>(1, &live));
+  EXPECT_EQ(snapshot.Load()->version, 1);
+  EXPECT_EQ(snapshot.Read([](const std::shared_ptr<const Value> &value) {
+    return value->version + 1;
+  }),
+            2);
+}
+
+TEST(CubeSnapshotTest, ReleasesReplacedSnapshots) {
+  std::atomic<int64_t> live{0};
+  {
+    CubeSnapshot<Value> snapshot(std::make_shared<Value>(0, &live));
+    // With no reader, each Store releases the snapshot it replaced
+    for (int64_t i = 1; i <= 100; i++) {
+      snapshot.Store(std::make_shared<Value>(i, &live));
+      EXPECT_EQ(live.load(), 1);
+    }
+
+    // A copy taken out keeps its snapshot alive
+    std::shared_ptr<const Value> kept = snapshot.Load();
+    snapshot.Store(std::make_shared<Value>(101, &live));
+    EXPECT_EQ(live.load(), 2);
+    kept.reset();
+    EXPECT_EQ(live.load(), 1);
+  }
+  // The destructor releases the current one
+  EXPECT_EQ(live.load(), 0);
+}
+
+TEST(CubeSnapshotTest, KeepsSnapshotsWhileRead) {
+  std::atomic<int64_t> live{0};
+  {
+    CubeSnapshot<Value> snapshot(std::make_shared<Value>(0, &live));
+    std::atomic<bool> leave{false};
+    std::thread reader = HoldRead(&snapshot, &leave);
+
+    // Neither the snapshot being read nor those replaced after it are
+    // released while the reader is inside Read
+    snapshot.Store(std::make_shared<Value>(1, &live));
+    snapshot.Store(std::make_shared<Value>(2, &live));
+    EXPECT_EQ(live.load(), 3);
+    EXPECT_EQ(snapshot.Load()->version, 2);
+
+    leave = true;
+    reader.join();
+    // The next Store releases them
+    snapshot.Store(std::make_shared<Value>(3, &live));
+    EXPECT_EQ(live.load(), 1);
+
+    // Those still held then go with the destructor
+    leave = false;
+    reader = HoldRead(&snapshot, &leave);
+    snapshot.Store(std::make_shared<Value>(4, &live));
+    EXPECT_EQ(live.load(), 2);
+    leave = true;
+    reader.join();
+  }
+  EXPECT_EQ(live.load(), 0);
+}
+
+// Readers (more than there are reader slots, so some wait for one) read
+// while a writer stores new versions. Each reader must only see whole,
+// live snapshots, with versions that never go back; once done, every
+// snapshot must have been released.
+TEST(CubeSnapshotTest, ReadersRaceWriter) {
+  constexpr int kReaders = 96;
+  constexpr int kReads = 100; // At least, and until the writer is done
+  constexpr int64_t kVersions = 2000;
+  std::atomic<int64_t> live{0};
+  std::atomic<int64_t> torn{0};
+  std::atomic<int64_t> went_back{0};
+  {
+    CubeSnapshot<Value> snapshot(std::make_shared<Value>(0, &live));
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < kReaders; r++) {
+      readers.emplace_back([&, r] {
+        int64_t last = 0;
+        for (int i = 0; i < kReads || !done; i++) {
+          int64_t version;
+          if (r % 2 == 0) {
+            version = snapshot.Read(
+                [&](const std::shared_ptr<const Value> &value) {
+                  // Stay inside long enough for the slots to run out
+                  std::this_thread::yield();
+                  if (value->negated != -value->version) {
+                    torn++;
+                  }
+                  return value->version;
+                });
+          } else {
+            // A copy taken out stays whole after later stores
+            std::shared_ptr<const Value> value = snapshot.Load();
+            std::this_thread::yield();
+            if (value->negated != -value->version) {
+              torn++;
+            }
+            version = value->version;
+          }
+          if (version < last) {
+            went_back++;
+          }
+          last = version;
+        }
+      });
+    }
+    for (int64_t i = 1; i <= kVersions; i++) {
+      snapshot.Store(std::make_shared<Value>(i, &live));
+      std::this_thread::yield();
+    }
+    done = true;
+    for (auto &reader : readers) {
+      reader.join();
+    }
+    EXPECT_EQ(snapshot.Load()->version, kVersions);
+    // Every replaced snapshot goes with the next Store once readers left
+    snapshot.Store(std::make_shared<Value>(kVersions + 1, &live));
+    EXPECT_EQ(live.load(), 1);
+  }
+  EXPECT_EQ(torn.load(), 0);
+  EXPECT_EQ(went_back.load(), 0);
+  EXPECT_EQ(live.load(), 0);
+}
+
+} // namespace adbc::cube
@@ -0,0 +1,84 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/spill_file.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <vector>
+
+namespace adbc::cube {
+
+int CubeSpillFile::Open(const std::string &dir,
+                        std::unique_ptr<CubeSpillFile> *out) {
+  std::string path = dir + "/adbc-cube-spill-XXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  int fd = mkstemp(name.data());
+  if (fd < 0) {
+    return errno;
+  }
+  // Nothing else needs the name, and the space must not outlive us
+  unlink(name.data());
+  out->reset(new CubeSpillFile(fd));
+  return 0;
+}
+
+CubeSpillFile::~CubeSpillFile() { close(fd_); }
+
+int CubeSpillFile::Spill(const CubeIpcBuffer &message,
+                         std::shared_ptr<const CubeIpcBytes> *out) {
+  if (message.empty()) {
+    *out = std::make_shared<const CubeIpcBytes>(CubeIpcBuffer());
+    return 0;
+  }
+  const off_t offset = end_;
+  size_t written = 0;
+  while (written < message.size()) {
+    ssize_t n = pwrite(fd_, message.data() + written, message.size() - written,
+                       offset + static_cast<off_t>(written));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    written += static_cast<size_t>(n);
+  }
+
+  void *addr = mmap(nullptr, message.size(), PROT_READ, MAP_SHARED, fd_,
+                    offset);
+  if (addr == MAP_FAILED) {
+    return errno;
+  }
+  // Mappings start at a page boundary, so the next message goes on one
+  static const off_t page_size = static_cast<off_t>(sysconf(_SC_PAGESIZE));
+  end_ = (offset + static_cast<off_t>(message.size()) + page_size - 1) /
+         page_size * page_size;
+  bytes_ += static_cast<int64_t>(message.size());
+
+  size_t length = message.size();
+  std::shared_ptr<const void> mapping(
+      addr, [length](const void *p) { munmap(const_cast<void *>(p), length); });
+  *out = std::make_shared<const CubeIpcBytes>(
+      std::move(mapping), static_cast<const uint8_t *>(addr), length);
+  return 0;
+}
+
+} // namespace adbc::cube
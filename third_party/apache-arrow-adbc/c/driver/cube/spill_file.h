@@ -0,0 +1,63 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "driver/cube/ipc_buffer.h"
+
+namespace adbc::cube {
+
+/// Unnamed file the messages of a large result are moved to. Each message
+/// is written at a page boundary and mapped back read-only, so the reader
+/// and the arrays sharing its buffers read it from the page cache, which
+/// the kernel can reclaim under memory pressure instead of the process
+/// growing. The file is unlinked as soon as it is created; its space is
+/// freed once the file and every mapping of it are gone.
+class CubeSpillFile {
+public:
+  /// Create a spill file in dir
+  /// @return 0, or an errno value
+  static int Open(const std::string &dir, std::unique_ptr<CubeSpillFile> *out);
+
+  ~CubeSpillFile();
+  CubeSpillFile(const CubeSpillFile &) = delete;
+  CubeSpillFile &operator=(const CubeSpillFile &) = delete;
+
+  /// Append message and map it back; out keeps the mapping alive, even
+  /// after this file is destroyed
+  /// @return 0, or an errno value
+  int Spill(const CubeIpcBuffer &message,
+            std::shared_ptr<const CubeIpcBytes> *out);
+
+  /// Bytes of messages written so far
+  int64_t bytes() const { return bytes_; }
+
+private:
+  explicit CubeSpillFile(int fd) : fd_(fd) {}
+
+  int fd_;
+  off_t end_ = 0; // Where the next message goes, page aligned
+  int64_t bytes_ = 0;
+};
+
+} // namespace adbc::cube
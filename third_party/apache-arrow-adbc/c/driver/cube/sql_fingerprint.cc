@@ -0,0 +1,346 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/sql_fingerprint.h"
+
+namespace adbc::cube {
+
+namespace {
+
+bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// Characters of names, keywords and numbers; bytes of multibyte UTF-8
+// characters count as such
+bool IsWordChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || IsDigit(c) ||
+         c == '_' || c == '$' || static_cast<unsigned char>(c) >= 0x80;
+}
+
+char ToLower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+// Walks sql once and hands the normalized text to sink->Put, one
+// character at a time
+template <typename Sink>
+class Normalizer {
+public:
+  Normalizer(bool lift_literals, Sink *sink)
+      : lift_(lift_literals), sink_(sink) {}
+
+  void Run(std::string_view sql) {
+    size_t n = sql.size();
+    size_t i = 0;
+    while (i < n) {
+      char c = sql[i];
+      char next = i + 1 < n ? sql[i + 1] : '\0';
+      size_t dollar_end =
+          c == '$' && !IsDigit(next) ? DollarQuoteEnd(sql, i) : 0;
+      if (IsSpace(c)) {
+        space_ = true;
+        i++;
+      } else if (c == '-' && next == '-') {
+        while (i < n && sql[i] != '\n') {
+          i++;
+        }
+        space_ = true;
+      } else if (c == '/' && next == '*') {
+        i = SkipBlockComment(sql, i + 2);
+        space_ = true;
+      } else if (c == ';') {
+        // Only kept when more follows
+        semicolons_++;
+        i++;
+      } else if (c == '\'' || c == '"') {
+        // Names in double quotes are never lifted
+        i = Quoted(sql, i, QuotedEnd(sql, i), lift_ && c == '\'');
+      } else if (lift_ && (c == 'e' || c == 'E') && next == '\'' &&
+                 !(IsWordChar(last_) && !space_)) {
+        // An E'...' string is lifted whole, prefix included
+        i = Quoted(sql, i + 1, QuotedEnd(sql, i + 1), true);
+      } else if (dollar_end > 0) {
+        i = Quoted(sql, i, dollar_end, lift_);
+      } else if (lift_ && StartsLiteral(c, next)) {
+        i = SkipLiteral(sql, i);
+        Literal();
+      } else if (c == ',' && after_literal_ && !comma_) {
+        // Dropped if another literal follows
+        comma_ = true;
+        i++;
+      } else {
+        Emit(ToLower(c));
+        i++;
+      }
+    }
+  }
+
+private:
+  // Whether a literal or placeholder starts here, rather than the rest of
+  // a name such as t1
+  bool StartsLiteral(char c, char next) const {
+    if (IsWordChar(last_) && !space_) {
+      return false;
+    }
+    return IsDigit(c) || c == '?' || (c == '.' && IsDigit(next)) ||
+           (c == '$' && IsDigit(next));
+  }
+
+  static size_t SkipLiteral(std::string_view sql, size_t i) {
+    if (sql[i] == '?') {
+      return i + 1;
+    }
+    // Digits and the rest of the token: fraction, exponent and its sign
+    i++;
+    while (i < sql.size()) {
+      char c = sql[i];
+      char prev = sql[i - 1];
+      if (IsWordChar(c) || c == '.' ||
+          ((c == '+' || c == '-') && (prev == 'e' || prev == 'E'))) {
+        i++;
+      } else {
+        break;
+      }
+    }
+    return i;
+  }
+
+  // PostgreSQL block comments nest
+  static size_t SkipBlockComment(std::string_view sql, size_t i) {
+    int depth = 1;
+    while (i < sql.size() && depth > 0) {
+      if (sql[i] == '*' && i + 1 < sql.size() && sql[i + 1] == '/') {
+        depth--;
+        i += 2;
+      } else if (sql[i] == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+        depth++;
+        i += 2;
+      } else {
+        i++;
+      }
+    }
+    return i;
+  }
+
+  // End of the literal or name quoted at i: after the closing quote, a
+  // doubled quote standing for one inside it, and a backslash escaping the
+  // next character in an E'...' string
+  static size_t QuotedEnd(std::string_view sql, size_t i) {
+    char quote = sql[i];
+    bool escapes = quote == '\'' && i > 0 &&
+                   (sql[i - 1] == 'e' || sql[i - 1] == 'E') &&
+                   (i < 2 || !IsWordChar(sql[i - 2]));
+    size_t end = i + 1;
+    while (end < sql.size()) {
+      if (escapes && sql[end] == '\\') {
+        end += 2;
+      } else if (sql[end] != quote) {
+        end++;
+      } else if (end + 1 < sql.size() && sql[end + 1] == quote) {
+        end += 2;
+      } else {
+        return end + 1;
+      }
+    }
+    return sql.size();
+  }
+
+  // End of the $tag$...$tag$ string at i (after the closing tag), or 0 if
+  // the $ at i does not open one
+  size_t DollarQuoteEnd(std::string_view sql, size_t i) const {
+    if (IsWordChar(last_) && !space_) {
+      return 0; // Part of a name
+    }
+    size_t close = i + 1;
+    while (close < sql.size() && sql[close] != '$' &&
+           IsWordChar(sql[close])) {
+      close++;
+    }
+    if (close == sql.size() || sql[close] != '$') {
+      return 0;
+    }
+    std::string_view tag = sql.substr(i, close - i + 1);
+    size_t end = sql.find(tag, close + 1);
+    return end == std::string_view::npos ? sql.size() : end + tag.size();
+  }
+
+  // Copy (or lift) the quoted text from i to end, as written
+  // @return end
+  size_t Quoted(std::string_view sql, size_t i, size_t end, bool lift) {
+    if (lift) {
+      Literal();
+      return end;
+    }
+    Emit(sql[i]);
+    for (size_t j = i + 1; j < end; j++) {
+      sink_->Put(sql[j]);
+    }
+    last_ = sql[end - 1];
+    return end;
+  }
+
+  void Literal() {
+    if (comma_) {
+      // Part of a run already shown as one
+      comma_ = false;
+      space_ = false;
+      return;
+    }
+    Emit('?');
+    after_literal_ = true;
+  }
+
+  void Emit(char c) {
+    if (comma_) {
+      sink_->Put(',');
+      last_ = ',';
+      comma_ = false;
+    }
+    for (; semicolons_ > 0; semicolons_--) {
+      sink_->Put(';');
+      last_ = ';';
+    }
+    if (space_ && IsWordChar(last_) && IsWordChar(c)) {
+      sink_->Put(' ');
+    }
+    space_ = false;
+    after_literal_ = false;
+    sink_->Put(c);
+    last_ = c;
+  }
+
+  const bool lift_;
+  Sink *sink_;
+  char last_ = '\0';   // Last character put
+  bool space_ = false; // Whitespace or a comment since last_
+  size_t semicolons_ = 0;
+  bool after_literal_ = false; // last_ is a lifted literal
+  bool comma_ = false;         // A comma after one, held back
+};
+
+struct StringSink {
+  std::string *out;
+  void Put(char c) { out->push_back(c); }
+};
+
+uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+uint64_t FinalMix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3 (x64, 128-bit) over the characters put, taken in blocks of
+// 16 as they arrive
+class HashSink {
+public:
+  explicit HashSink(uint32_t seed = 0) : h1_(seed), h2_(seed) {}
+
+  void Put(char c) {
+    uint64_t byte = static_cast<unsigned char>(c);
+    size_t fill = length_ % 16;
+    if (fill < 8) {
+      k1_ |= byte << (8 * fill);
+    } else {
+      k2_ |= byte << (8 * (fill - 8));
+    }
+    if (++length_ % 16 == 0) {
+      h1_ ^= MixK1(k1_);
+      h1_ = Rotl(h1_, 27) + h2_;
+      h1_ = h1_ * 5 + 0x52dce729;
+      h2_ ^= MixK2(k2_);
+      h2_ = Rotl(h2_, 31) + h1_;
+      h2_ = h2_ * 5 + 0x38495ab5;
+      k1_ = 0;
+      k2_ = 0;
+    }
+  }
+
+  CubeSqlFingerprint Finish() {
+    size_t tail = length_ % 16;
+    if (tail > 8) {
+      h2_ ^= MixK2(k2_);
+    }
+    if (tail > 0) {
+      h1_ ^= MixK1(k1_);
+    }
+    h1_ ^= length_;
+    h2_ ^= length_;
+    h1_ += h2_;
+    h2_ += h1_;
+    h1_ = FinalMix(h1_);
+    h2_ = FinalMix(h2_);
+    h1_ += h2_;
+    h2_ += h1_;
+    return CubeSqlFingerprint{h1_, h2_};
+  }
+
+private:
+  static constexpr uint64_t kC1 = 0x87c37b91114253d5ULL;
+  static constexpr uint64_t kC2 = 0x4cf5ad432745937fULL;
+
+  static uint64_t MixK1(uint64_t k) { return Rotl(k * kC1, 31) * kC2; }
+  static uint64_t MixK2(uint64_t k) { return Rotl(k * kC2, 33) * kC1; }
+
+  uint64_t h1_;
+  uint64_t h2_;
+  uint64_t k1_ = 0;
+  uint64_t k2_ = 0;
+  uint64_t length_ = 0;
+};
+
+} // namespace
+
+std::string CubeSqlFingerprint::ToHex() const {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  std::string hex(32, '0');
+  for (int i = 0; i < 16; i++) {
+    hex[15 - i] = kDigits[(high >> (4 * i)) & 0xf];
+    hex[31 - i] = kDigits[(low >> (4 * i)) & 0xf];
+  }
+  return hex;
+}
+
+std::string NormalizeSql(std::string_view sql, bool lift_literals) {
+  std::string out;
+  out.reserve(sql.size());
+  StringSink sink{&out};
+  Normalizer<StringSink>(lift_literals, &sink).Run(sql);
+  return out;
+}
+
+CubeSqlFingerprint FingerprintSql(std::string_view sql, bool lift_literals) {
+  HashSink sink;
+  Normalizer<HashSink>(lift_literals, &sink).Run(sql);
+  return sink.Finish();
+}
+
+CubeSqlFingerprint CubeMurmurHash3(std::string_view data, uint32_t seed) {
+  HashSink sink(seed);
+  for (char c : data) {
+    sink.Put(c);
+  }
+  return sink.Finish();
+}
+
+} // namespace adbc::cube
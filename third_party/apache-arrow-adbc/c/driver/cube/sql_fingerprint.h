@@ -0,0 +1,62 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace adbc::cube {
+
+// 128-bit non-cryptographic hash of a normalized query. low alone serves
+// as a 64-bit fingerprint.
+struct CubeSqlFingerprint {
+  uint64_t high = 0;
+  uint64_t low = 0;
+
+  bool operator==(const CubeSqlFingerprint &other) const {
+    return high == other.high && low == other.low;
+  }
+  bool operator!=(const CubeSqlFingerprint &other) const {
+    return !(*this == other);
+  }
+
+  // 32 lowercase hex digits, high first
+  std::string ToHex() const;
+};
+
+// Normalize SQL so that queries differing only in layout get the same
+// text: comments are dropped, whitespace runs become one space where two
+// words meet and none elsewhere, unquoted text is lowercased (quoted
+// literals and names, $$ strings included, are kept as written), and
+// trailing semicolons are dropped. With lift_literals, number and string
+// literals and parameter placeholders become '?', and a comma-separated
+// run of them one '?', so that IN lists of any length share a shape.
+std::string NormalizeSql(std::string_view sql, bool lift_literals = false);
+
+// Hash of NormalizeSql(sql, lift_literals), computed in one pass over sql
+// without building the normalized text or allocating
+CubeSqlFingerprint FingerprintSql(std::string_view sql,
+                                  bool lift_literals = false);
+
+// MurmurHash3 x64/128 of data, as the reference implementation computes
+// it (high is its first word); used to name and check entries by key
+// without storing the key
+CubeSqlFingerprint CubeMurmurHash3(std::string_view data, uint32_t seed = 0);
+
+} // namespace adbc::cube
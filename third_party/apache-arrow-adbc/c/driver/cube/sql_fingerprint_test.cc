@@ -0,0 +1,163 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Tests of the SQL normalizer and fingerprint the result cache keys on,
+// case by case over each lexical form, and of the MurmurHash3 under them
+// against vectors from the reference implementation.
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "driver/cube/sql_fingerprint.h"
+
+namespace adbc::cube {
+
+namespace {
+
+struct NormalizeCase {
+  std::string_view sql;
+  std::string_view normalized;
+  std::string_view lifted; // With lift_literals
+};
+
+const NormalizeCase kNormalizeCases[] = {
+    // Whitespace and case
+    {"SELECT  *\n FROM\tOrders", "select*from orders", "select*from orders"},
+    {"select a+b  from t", "select a+b from t", "select a+b from t"},
+    {"select x::int from t", "select x::int from t", "select x::int from t"},
+    {"", "", ""},
+    // Comments
+    {"select a -- note\n from t", "select a from t", "select a from t"},
+    {"select /* a /* nested */ b */ 1", "select 1", "select?"},
+    {"select /* unterminated", "select", "select"},
+    // Semicolons
+    {"select 1;", "select 1", "select?"},
+    {"select 1 ; ; ", "select 1", "select?"},
+    {"select 1; select 2;", "select 1;select 2", "select?;select?"},
+    // Quoted strings and names are kept as written
+    {"SELECT 'Hello World' FROM T", "select'Hello World'from t",
+     "select?from t"},
+    {"select 'it''s'", "select'it''s'", "select?"},
+    {"select 'unterminated", "select'unterminated", "select?"},
+    {"select \"MyCol\" from t", "select\"MyCol\"from t",
+     "select\"MyCol\"from t"},
+    {"SELECT \"Q\"\"x\"", "select\"Q\"\"x\"", "select\"Q\"\"x\""},
+    // E'' strings honour backslash escapes, and are lifted prefix included
+    {"select E'a\\'b' from t", "select e'a\\'b'from t", "select?from t"},
+    {"select E'x\\'y' || 'z'", "select e'x\\'y'||'z'", "select?||?"},
+    // Dollar-quoted strings
+    {"select $$Keep This$$", "select $$Keep This$$", "select?"},
+    {"select $tag$A 'b' $x$ c$tag$ from t",
+     "select $tag$A 'b' $x$ c$tag$ from t", "select?from t"},
+    // Numbers and placeholders
+    {"select a from t where x = 1", "select a from t where x=1",
+     "select a from t where x=?"},
+    {"select col1 from t where a = -1", "select col1 from t where a=-1",
+     "select col1 from t where a=-?"},
+    {"select * from t where x = ? and y = $1",
+     "select*from t where x=?and y=$1", "select*from t where x=?and y=?"},
+    // Runs of literals fold into one
+    {"select * from t where x in (1, 2, 3)", "select*from t where x in(1,2,3)",
+     "select*from t where x in(?)"},
+    {"select * from t where x in ( 'a' , 'b' )",
+     "select*from t where x in('a','b')", "select*from t where x in(?)"},
+    {"select 1.5e-3, .5", "select 1.5e-3,.5", "select?"},
+    {"select $1, $2", "select $1,$2", "select?"},
+    {"select f(1, a, 2)", "select f(1,a,2)", "select f(?,a,?)"},
+};
+
+class NormalizeSqlTest : public ::testing::TestWithParam<NormalizeCase> {};
+
+} // namespace
+
+TEST_P(NormalizeSqlTest, Normalizes) {
+  const NormalizeCase &test = GetParam();
+  EXPECT_EQ(NormalizeSql(test.sql), test.normalized);
+  EXPECT_EQ(NormalizeSql(test.sql, /*lift_literals=*/true), test.lifted);
+}
+
+TEST_P(NormalizeSqlTest, FingerprintHashesNormalizedText) {
+  const NormalizeCase &test = GetParam();
+  for (bool lift : {false, true}) {
+    SCOPED_TRACE(lift ? "lifted" : "not lifted");
+    std::string normalized = NormalizeSql(test.sql, lift);
+    EXPECT_EQ(FingerprintSql(test.sql, lift), CubeMurmurHash3(normalized));
+    EXPECT_EQ(FingerprintSql(test.sql, lift), FingerprintSql(normalized, lift));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(LexicalForms, NormalizeSqlTest,
+                         ::testing::ValuesIn(kNormalizeCases));
+
+TEST(SqlFingerprintTest, LayoutDoesNotMatter) {
+  EXPECT_EQ(FingerprintSql("SELECT a\n  FROM t -- all\n;"),
+            FingerprintSql("select a from t"));
+  EXPECT_NE(FingerprintSql("select a from t where x = 1"),
+            FingerprintSql("select a from t where x = 2"));
+  EXPECT_EQ(FingerprintSql("select a from t where x in (1, 2)", true),
+            FingerprintSql("select a from t where x in (3, 4, 5, 6)", true));
+  EXPECT_NE(FingerprintSql("select 'A'"), FingerprintSql("select 'a'"));
+}
+
+TEST(SqlFingerprintTest, ToHex) {
+  CubeSqlFingerprint fingerprint{0x0123456789abcdefULL, 0xfULL};
+  EXPECT_EQ(fingerprint.ToHex(), "0123456789abcdef000000000000000f");
+}
+
+struct HashVector {
+  std::string_view data;
+  uint32_t seed;
+  uint64_t high;
+  uint64_t low;
+};
+
+// From the reference MurmurHash3_x64_128, its first output word as high;
+// the lengths cover an empty input, tails of each size class, and whole
+// 16-byte blocks with and without a tail
+const HashVector kHashVectors[] = {
+    {"", 0, 0x0000000000000000ULL, 0x0000000000000000ULL},
+    {"", 1, 0x4610abe56eff5cb5ULL, 0x51622daa78f83583ULL},
+    {"a", 0, 0x85555565f6597889ULL, 0xe6b53a48510e895aULL},
+    {"hello", 0, 0xcbd8a7b341bd9b02ULL, 0x5b1e906a48ae1d19ULL},
+    {"hello", 42, 0xc4b8b3c960af6f08ULL, 0x2334b875b0efbc7aULL},
+    {"0123456789abcdef", 0, 0x4be06d94cf4ad1a7ULL, 0x87c35b5c63a708daULL},
+    {"0123456789abcdefg", 0, 0x8e32612daa45f9deULL, 0x0800f4c206c372eeULL},
+    {"The quick brown fox jumps over the lazy dog", 0, 0xe34bbc7bbc071b6cULL,
+     0x7a433ca9c49a9347ULL},
+};
+
+TEST(MurmurHash3Test, ReferenceVectors) {
+  for (const auto &vector : kHashVectors) {
+    SCOPED_TRACE(std::string(vector.data));
+    CubeSqlFingerprint hash = CubeMurmurHash3(vector.data, vector.seed);
+    EXPECT_EQ(hash.high, vector.high);
+    EXPECT_EQ(hash.low, vector.low);
+  }
+}
+
+TEST(MurmurHash3Test, FingerprintOfNormalizedText) {
+  // The hash of the normalized text, as the reference computes it
+  EXPECT_EQ(FingerprintSql("SELECT *\n  FROM orders WHERE id = ?"),
+            (CubeSqlFingerprint{0x22a850210b9b70edULL, 0x04c8637860666567ULL}));
+  EXPECT_EQ(FingerprintSql("SELECT * FROM t WHERE x IN (1, 2, 3)", true),
+            (CubeSqlFingerprint{0x97f9546bcc279ca9ULL, 0x2a8a23f7c11514caULL}));
+}
+
+} // namespace adbc::cube
@@ -15,75 +15,274 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include <nanoarrow/nanoarrow.hpp>
 
 #include "driver/cube/connection.h"
-#include "driver/cube/parameter_converter.h"
+#include "driver/cube/device_stream.h"
+#include "driver/cube/rechunk_stream.h"
+#include "driver/cube/result_cache.h"
+#include "driver/cube/rollup_cache.h"
 #include "driver/cube/statement.h"
 
 namespace adbc::cube {
 
+namespace {
+
+// Statement options reporting CubeQueryStats of the last result
+constexpr std::string_view kStatsPrefix = "adbc.cube.stats.";
+constexpr std::string_view kBatchStatsPrefix = "adbc.cube.batch_stats.";
+constexpr std::string_view kEstimatePrefix = "adbc.cube.estimate.";
+
+// Owns what an AdbcPartitions from ExecutePartitions points to
+struct CubePartitions {
+  std::vector<std::string> partitions;
+  std::vector<const uint8_t *> data;
+  std::vector<size_t> lengths;
+};
+
+void ReleasePartitions(struct AdbcPartitions *partitions) {
+  delete static_cast<CubePartitions *>(partitions->private_data);
+  partitions->num_partitions = 0;
+  partitions->partitions = nullptr;
+  partitions->partition_lengths = nullptr;
+  partitions->private_data = nullptr;
+  partitions->release = nullptr;
+}
+
+// What the query says about the order and keys of its result, when it is
+// one ParseRollupQuery reads: its ORDER BY, its GROUP BY columns when it
+// aggregates, and the grain of its DATE_TRUNC columns
+CubeResultOrdering QueryResultOrdering(const std::string &query) {
+  CubeResultOrdering ordering;
+  auto parsed = ParseRollupQuery(NormalizeQueryText(query));
+  if (!parsed) {
+    return ordering;
+  }
+  bool aggregates = false;
+  std::vector<int64_t> dimensions;
+  for (size_t i = 0; i < parsed->columns.size(); i++) {
+    const RollupColumn &column = parsed->columns[i];
+    if (column.is_measure()) {
+      aggregates = true;
+    } else {
+      dimensions.push_back(static_cast<int64_t>(i));
+    }
+    if (column.grain != TimeGrain::None) {
+      ordering.time_grains.emplace_back(static_cast<int64_t>(i),
+                                        TimeGrainName(column.grain));
+    }
+  }
+  if (aggregates) {
+    ordering.unique_keys = std::move(dimensions);
+  }
+  for (const RollupOrder &order : parsed->order) {
+    CubeSortKey key;
+    key.column = static_cast<int64_t>(order.column);
+    key.descending = order.descending;
+    key.nulls_first = order.nulls_first;
+    ordering.sort_keys.push_back(key);
+  }
+  return ordering;
+}
+
+// Copy a result schema into out, keeping only the adbc.cube.columns ones
+Status CopyResultSchema(const struct ArrowSchema *schema,
+                        const std::vector<std::string> &columns,
+                        struct ArrowSchema *out) {
+  if (columns.empty()) {
+    return ArrowSchemaDeepCopy(schema, out) == NANOARROW_OK
+               ? status::Ok()
+               : status::Internal("Failed to copy the result schema");
+  }
+  std::vector<int> fields;
+  struct ArrowError arrow_error = {};
+  if (ResolveColumns(schema, columns, &fields, &arrow_error) != NANOARROW_OK) {
+    return status::InvalidArgument(arrow_error.message);
+  }
+  return ProjectSchema(schema, fields, out) == NANOARROW_OK
+             ? status::Ok()
+             : status::Internal("Failed to copy the result schema");
+}
+
+} // namespace
+
 CubeStatementImpl::CubeStatementImpl(CubeConnectionImpl *connection,
                                      std::string query)
     : connection_(connection), query_(std::move(query)) {}
 
+CubeStatementImpl::~CubeStatementImpl() {
+  if (connection_) {
+    connection_->ClosePrepared(prepared_statement_);
+  }
+}
+
+void CubeStatementImpl::SetQuery(const std::string &query) {
+  if (query == query_) {
+    return;
+  }
+  if (connection_) {
+    connection_->ClosePrepared(prepared_statement_);
+  }
+  prepared_statement_.handle.clear();
+  prepared_statement_.parameter_types.clear();
+  prepared_statement_.result_schema.reset();
+  prepared_statement_.parameter_schema.reset();
+  prepared_statement_.cached.reset();
+  result_schema_.reset();
+  prepared_ = false;
+  encoded_params_.reset();
+  result_ordering_.reset();
+  query_ = query;
+}
+
 Status CubeStatementImpl::Prepare(struct AdbcError *error) {
-  // TODO: Implement statement preparation
-  // This would validate the query and get parameter info from Cube
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  connection_->ClosePrepared(prepared_statement_);
+  UNWRAP_STATUS(connection_->Prepare(query_, &prepared_statement_, error));
   prepared_ = true;
+  encoded_params_.reset(); // Parameter types may have changed
   return status::Ok();
 }
 
-Status CubeStatementImpl::Bind(struct ArrowArray *values,
-                               struct ArrowSchema *schema,
-                               struct AdbcError *error) {
-  if (!values || !schema) {
-    return status::InvalidArgument(
-        "Parameter values and schema cannot be null");
+Status CubeStatementImpl::ExecuteSchema(struct ArrowSchema *schema,
+                                        const CubeStatementOptions &options,
+                                        struct AdbcError *error) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  // The server prepares without view types or run-end encoding
+  if (prepared_statement_.result_schema->release && !options.view_types &&
+      options.run_end_encoding == RunEndEncoding::Off && !options.estimate) {
+    UNWRAP_STATUS(CopyResultSchema(prepared_statement_.result_schema.get(),
+                                   options.columns, schema));
+    return ConvertResultSchema(options, schema);
+  }
+  if (!result_schema_->release || result_view_types_ != options.view_types ||
+      result_run_end_encoding_ != options.run_end_encoding ||
+      options.estimate) {
+    CubeReaderOptions reader_options = connection_->reader_options();
+    reader_options.view_types = options.view_types;
+    reader_options.run_end_encoded =
+        options.run_end_encoding != RunEndEncoding::Off;
+    nanoarrow::UniqueSchema result_schema;
+    if (options.estimate) {
+      UNWRAP_STATUS(connection_->EstimateQuery(query_, reader_options,
+                                               result_schema.get(),
+                                               &estimate_, error));
+    } else {
+      UNWRAP_STATUS(connection_->ExecuteSchema(query_, reader_options,
+                                               result_schema.get(), error));
+    }
+    if (options.run_end_encoding == RunEndEncoding::Expand &&
+        ExpandRunEndEncodedSchema(result_schema.get()) != NANOARROW_OK) {
+      return status::Internal("Failed to expand the result schema");
+    }
+    result_schema_ = std::move(result_schema);
+    result_view_types_ = options.view_types;
+    result_run_end_encoding_ = options.run_end_encoding;
   }
+  UNWRAP_STATUS(CopyResultSchema(result_schema_.get(), options.columns,
+                                 schema));
+  return ConvertResultSchema(options, schema);
+}
 
-  // Store parameter array and schema for later use
-  param_array_ = *values;
-  param_schema_ = *schema;
-  has_params_ = true;
+Status CubeStatementImpl::ConvertResultSchema(
+    const CubeStatementOptions &options, struct ArrowSchema *schema) {
+  // Rows decoded from the PostgreSQL binary format keep their types
+  if (connection_->connection_mode() != ConnectionMode::Native &&
+      !connection_->postgres_arrow_output()) {
+    return status::Ok();
+  }
+  CubeReaderOptions reader_options;
+  reader_options.timestamp_unit = options.timestamp_unit;
+  reader_options.date_type = options.date_type;
+  int status = ApplyTemporalOptions(reader_options, schema);
+  for (int64_t i = 0; options.dictionary_encode && i < schema->n_children &&
+                      status == NANOARROW_OK;
+       i++) {
+    status = EncodeStringSchema(schema->children[i]);
+  }
+  if (status != NANOARROW_OK) {
+    ArrowSchemaRelease(schema);
+    return status::Internal("Failed to convert the result schema");
+  }
+  return status::Ok();
+}
 
+Status CubeStatementImpl::GetParameterSchema(struct ArrowSchema *schema) {
+  if (!prepared_statement_.parameter_schema->release) {
+    return status::NotImplemented(
+        "Server did not report the parameters of the query");
+  }
+  if (ArrowSchemaDeepCopy(prepared_statement_.parameter_schema.get(),
+                          schema) != NANOARROW_OK) {
+    return status::Internal("Failed to copy parameter schema");
+  }
   return status::Ok();
 }
 
-Status CubeStatementImpl::BindStream(struct ArrowArrayStream *values,
-                                     struct AdbcError *error) {
-  if (!values) {
+Status CubeStatementImpl::BindStream(struct ArrowArrayStream *values) {
+  if (!values || !values->release) {
     return status::InvalidArgument("Parameter stream cannot be null");
   }
 
-  // For streaming parameters, we store the stream and fetch batches as needed
-  // during execution. For now, fetch the first batch to get the schema.
-  struct ArrowArray batch = {};
-  int fetch_status = values->get_next(values, &batch);
+  // Its batches are read when the query is executed
+  param_stream_.reset();
+  param_schema_.reset();
+  param_batches_.clear();
+  encoded_params_.reset();
+  ArrowArrayStreamMove(values, param_stream_.get());
+  return status::Ok();
+}
 
-  if (fetch_status != 0) {
-    return status::Internal(
-        "Failed to fetch first parameter batch from stream");
+Status CubeStatementImpl::ReadParameterStream() {
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  if (ArrowArrayStreamGetSchema(param_stream_.get(), param_schema_.get(),
+                                &arrow_error) != NANOARROW_OK) {
+    return status::fmt::InvalidArgument(
+        "Failed to get parameter stream schema: {}", arrow_error.message);
   }
-
-  // Store the first batch as parameter array
-  param_array_ = batch;
-  if (values->get_schema) {
-    values->get_schema(values, &param_schema_);
+  while (true) {
+    nanoarrow::UniqueArray batch;
+    if (ArrowArrayStreamGetNext(param_stream_.get(), batch.get(),
+                                &arrow_error) != NANOARROW_OK) {
+      return status::fmt::InvalidArgument(
+          "Failed to read parameter batch: {}", arrow_error.message);
+    }
+    if (!batch->release) {
+      break;
+    }
+    param_batches_.push_back(std::move(batch));
   }
-  has_params_ = true;
-
+  param_stream_.reset();
   return status::Ok();
 }
 
-Result<int64_t> CubeStatementImpl::ExecuteQuery(struct ArrowArrayStream *out) {
+Result<int64_t>
+CubeStatementImpl::ExecuteQuery(struct ArrowArrayStream *out,
+                                const CubeStatementOptions &options) {
   if (!connection_) {
     return status::InvalidState("Connection not initialized");
   }
@@ -96,41 +295,398 @@ Result<int64_t> CubeStatementImpl::ExecuteQuery(struct ArrowArrayStream *out) {
     return status::InvalidArgument("Output stream cannot be null");
   }
 
-  // If parameters are bound, convert them to PostgreSQL text format
-  std::vector<std::string> param_values;
-  const char **param_c_values = nullptr;
-  std::unique_ptr<char *[], decltype(&free)> param_cleanup(nullptr, &free);
+  if (options.exporting()) {
+    return status::InvalidState(
+        "An export target is set: execute with a null stream to write the "
+        "result to it");
+  }
 
-  if (has_params_) {
-    // Convert Arrow array parameters to PostgreSQL text format
-    param_values = ParameterConverter::ConvertArrowArrayToParams(
-        &param_array_, &param_schema_);
+  if (options.raw_ipc &&
+      connection_->connection_mode() != ConnectionMode::Native) {
+    return status::NotImplemented(
+        "adbc.cube.raw_ipc requires native connection mode");
+  }
+  if (options.batch_statistics && options.raw_ipc) {
+    // Raw batches are never decoded
+    return status::InvalidArgument(
+        "adbc.cube.batch_statistics cannot be combined with adbc.cube.raw_ipc");
+  }
+  if (!options.columns.empty() &&
+      connection_->connection_mode() != ConnectionMode::Native) {
+    return status::NotImplemented(
+        "adbc.cube.columns requires native connection mode");
+  }
+  if (options.json_query) {
+    if (connection_->connection_mode() != ConnectionMode::Native) {
+      return status::NotImplemented(
+          "adbc.cube.json_query requires native connection mode");
+    }
+    // Parameters and partitions are placeholders and plans of SQL text
+    if (param_schema_->release || param_stream_->release ||
+        !options.merge_sort_keys.empty()) {
+      return status::InvalidArgument(
+          "adbc.cube.json_query cannot be combined with bound parameters or "
+          "adbc.cube.merge_sort_keys");
+    }
+  }
+  if (options.sampled()) {
+    if (connection_->connection_mode() != ConnectionMode::Native) {
+      return status::NotImplemented(
+          "adbc.cube.sample_fraction and adbc.cube.sample_rows require "
+          "native connection mode");
+    }
+    if (!options.merge_sort_keys.empty()) {
+      return status::InvalidArgument(
+          "Sampled queries cannot be combined with adbc.cube.merge_sort_keys");
+    }
+    // The refined result follows the sample as a second version
+    if (options.sample_refine &&
+        (options.subscribe || options.target_batch_rows > 0 ||
+         options.max_rows > 0)) {
+      return status::InvalidArgument(
+          "adbc.cube.sample_refine cannot be combined with "
+          "adbc.cube.subscribe, adbc.cube.target_batch_rows or "
+          "adbc.cube.max_rows");
+    }
+  }
+  if (options.subscribe) {
+    if (connection_->connection_mode() != ConnectionMode::Native) {
+      return status::NotImplemented(
+          "adbc.cube.subscribe requires native connection mode");
+    }
+    // Rechunking would merge the versions
+    if (options.target_batch_rows > 0) {
+      return status::InvalidArgument(
+          "adbc.cube.subscribe cannot be combined with "
+          "adbc.cube.target_batch_rows");
+    }
+  }
 
-    if (!param_values.empty()) {
-      param_c_values = ParameterConverter::GetParamValuesCArray(param_values);
-      if (param_c_values) {
-        param_cleanup.reset(const_cast<char **>(param_c_values));
-      }
+  bool require_preaggregation = options.require_preaggregation.value_or(
+      connection_->require_preaggregation());
+  if (require_preaggregation &&
+      connection_->connection_mode() != ConnectionMode::Native) {
+    return status::NotImplemented(
+        "adbc.cube.require_preaggregation requires native connection mode");
+  }
+
+  // Rechunking would hold the first batch back until the next arrive
+  if (options.first_batch_rows > 0 && options.target_batch_rows > 0) {
+    return status::InvalidArgument(
+        "adbc.cube.first_batch_rows cannot be combined with "
+        "adbc.cube.target_batch_rows");
+  }
+
+  // Versions and raw messages are not counted in rows
+  if (options.max_rows > 0 && (options.subscribe || options.raw_ipc)) {
+    return status::InvalidArgument(
+        "adbc.cube.max_rows cannot be combined with adbc.cube.subscribe or "
+        "adbc.cube.raw_ipc");
+  }
+
+  if (!options.merge_sort_keys.empty()) {
+    if (connection_->connection_mode() != ConnectionMode::Native) {
+      return status::NotImplemented(
+          "adbc.cube.merge_sort_keys requires native connection mode");
+    }
+    if (options.raw_ipc || options.subscribe) {
+      return status::InvalidArgument(
+          "adbc.cube.merge_sort_keys cannot be combined with "
+          "adbc.cube.raw_ipc or adbc.cube.subscribe");
     }
   }
 
+  UNWRAP_STATUS(PrepareParameters());
+  bool bound = encoded_params_ != nullptr;
+  if (options.subscribe && bound && encoded_params_->size() > 1) {
+    return status::InvalidArgument(
+        "adbc.cube.subscribe takes at most one row of bound parameters");
+  }
+  if (options.sampled() && bound && encoded_params_->size() > 1) {
+    return status::InvalidArgument(
+        "Sampled queries take at most one row of bound parameters");
+  }
+
   // Execute query against Cube SQL
-  // TODO: When parameters present, pass them to the query execution
+  CubeReaderOptions reader_options = connection_->reader_options();
+  if (options.decode_threads > 0) {
+    reader_options.decode_threads = options.decode_threads;
+  }
+  reader_options.view_types = options.view_types;
+  reader_options.run_end_encoded =
+      options.run_end_encoding != RunEndEncoding::Off;
+  reader_options.max_batch_rows = options.max_batch_rows;
+  reader_options.max_batch_bytes = options.max_batch_bytes;
+  reader_options.spill_dir = options.spill_dir;
+  reader_options.spill_budget_bytes = options.spill_budget_bytes;
+  reader_options.raw_ipc = options.raw_ipc;
+  reader_options.columns = options.columns;
+  reader_options.subscribe = options.subscribe;
+  reader_options.hedge_after =
+      std::chrono::milliseconds(options.hedge_after_ms);
+  reader_options.priority = options.priority;
+  reader_options.first_batch_rows = options.first_batch_rows;
+  reader_options.max_rows = options.max_rows;
+  reader_options.timestamp_unit = options.timestamp_unit;
+  reader_options.date_type = options.date_type;
+  if (options.columns.empty() && !options.json_query) {
+    // Metadata names the result's columns, so none may be left out
+    if (!result_ordering_) {
+      result_ordering_ = QueryResultOrdering(query_);
+    }
+    reader_options.result_ordering = *result_ordering_;
+  }
+  if (reader_options.schema_cache) {
+    reader_options.schema_slot = schema_slot_;
+  }
+  if (options.dictionary_encode) {
+    // One set of dictionaries per result
+    reader_options.string_dictionaries =
+        std::make_shared<CubeStringDictionaries>();
+  }
+  reader_options.require_preaggregation = require_preaggregation;
+  reader_options.json_query = options.json_query;
+  reader_options.sample_fraction_ppm = options.sample_fraction_ppm;
+  reader_options.sample_rows = options.sample_rows;
+  reader_options.sample_seed = options.sample_seed;
+  reader_options.sample_refine = options.sample_refine;
+  stats_ = std::make_shared<CubeQueryStats>();
+  reader_options.stats = stats_;
+  batch_statistics_ = nullptr;
   struct AdbcError error = ADBC_ERROR_INIT;
-  auto status_result = connection_->ExecuteQuery(query_, out, &error);
+  Status status_result;
+  int64_t rows_affected = -1;
+  size_hint_ = ResultSizeHint();
+  if (!options.merge_sort_keys.empty()) {
+    if (bound) {
+      return status::InvalidArgument(
+          "adbc.cube.merge_sort_keys cannot be used with bound parameters");
+    }
+    status_result = connection_->ExecuteMergedPartitions(
+        query_, options.max_partitions, options.merge_sort_keys,
+        reader_options, out, &error);
+  } else if (bound && encoded_params_->size() > 1) {
+    status_result =
+        connection_->ExecuteBatch(query_, &prepared_statement_, reader_options,
+                                  encoded_params_, out, &error);
+  } else {
+    const CubeQueryParameters *row = bound ? &(*encoded_params_)[0] : nullptr;
+    status_result =
+        prepared_statement_.handle.empty()
+            ? connection_->ExecuteQuery(query_, reader_options, out, &error,
+                                        row, &rows_affected, &size_hint_)
+            : connection_->ExecutePrepared(prepared_statement_, reader_options,
+                                           out, &error, row, &rows_affected,
+                                           &size_hint_);
+  }
   if (!status_result.ok()) {
     if (error.message) {
       error.release(&error);
     }
     return status_result;
   }
+  if (options.run_end_encoding == RunEndEncoding::Expand && !options.raw_ipc) {
+    ExpandRunEndEncoded(out);
+  }
+  if (options.target_batch_rows > 0 && !options.raw_ipc) {
+    RechunkArrayStream(options.target_batch_rows, out);
+  }
+  // Each native result stops itself; this bounds results made of several,
+  // and those of the PostgreSQL protocol
+  if (options.max_rows > 0) {
+    LimitArrayStream(options.max_rows, out);
+    if (rows_affected > options.max_rows) {
+      rows_affected = options.max_rows;
+    }
+  }
+  // Last, so the statistics are of the batches as the caller gets them
+  if (options.batch_statistics) {
+    batch_statistics_ = std::make_shared<CubeBatchStatistics>();
+    BatchStatisticsArrayStream(batch_statistics_, out);
+  }
 
-  return -1L; // Unknown number of affected rows
+  return rows_affected;
 }
 
-Result<int64_t> CubeStatementImpl::ExecuteUpdate() {
-  // TODO: Implement for UPDATE/INSERT/DELETE statements
-  return -1L; // Unknown number of affected rows
+Status CubeStatementImpl::PrepareParameters() {
+  if (param_stream_->release) {
+    UNWRAP_STATUS(ReadParameterStream());
+  }
+  if (!param_schema_->release || encoded_params_) {
+    return status::Ok();
+  }
+
+  int64_t rows = 0;
+  for (const auto &batch : param_batches_) {
+    rows += batch->length;
+  }
+  auto encoded = std::make_shared<std::vector<CubeQueryParameters>>();
+  encoded->reserve(static_cast<size_t>(rows));
+  for (const auto &batch : param_batches_) {
+    UNWRAP_STATUS(connection_->EncodeParameters(
+        param_schema_.get(), batch.get(), prepared_statement_.parameter_types,
+        encoded.get()));
+  }
+  if (encoded->empty()) {
+    return status::InvalidArgument("Bound parameters have no rows");
+  }
+  encoded_params_ = std::move(encoded);
+  return status::Ok();
+}
+
+Result<int64_t>
+CubeStatementImpl::ExecuteUpdate(const CubeStatementOptions &options) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized");
+  }
+
+  if (!connection_->IsConnected()) {
+    return status::InvalidState("Connection not established");
+  }
+
+  if (options.json_query) {
+    return status::NotImplemented(
+        "adbc.cube.json_query queries can only be run by ExecuteQuery");
+  }
+
+  if (!options.parquet_path.empty()) {
+    return ExportParquet(options);
+  }
+
+  UNWRAP_STATUS(PrepareParameters());
+
+  // Every execution's result goes into the one exported stream
+  int fd = options.export_fd;
+  if (!options.export_path.empty()) {
+    fd = open(options.export_path.c_str(),
+              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return status::fmt::IO("Cannot open {}: {}", options.export_path,
+                             std::strerror(errno));
+    }
+  }
+  std::optional<CubeIpcExporter> exporter;
+  if (fd >= 0) {
+    exporter.emplace(fd);
+  }
+  struct FileCloser {
+    int fd;
+    ~FileCloser() {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  } closer{options.export_path.empty() ? -1 : fd};
+
+  // One execution per bound row; the total is unknown if any count is
+  std::vector<const CubeQueryParameters *> rows;
+  if (encoded_params_) {
+    for (const auto &row : *encoded_params_) {
+      rows.push_back(&row);
+    }
+  } else {
+    rows.push_back(nullptr);
+  }
+  int64_t total = 0;
+  if (!exporter && rows.size() > 1) {
+    // Sent together where the connection can pipeline them
+    struct AdbcError error = ADBC_ERROR_INIT;
+    auto status = connection_->ExecuteUpdateBatch(
+        query_, &prepared_statement_, *encoded_params_, &total, &error,
+        options.priority);
+    if (error.message) {
+      error.release(&error);
+    }
+    if (status.ok()) {
+      return total;
+    } else if (status.ToAdbc(nullptr) != ADBC_STATUS_NOT_IMPLEMENTED) {
+      return status;
+    }
+    total = 0;
+  }
+  for (const CubeQueryParameters *row : rows) {
+    int64_t rows_affected = -1;
+    struct AdbcError error = ADBC_ERROR_INIT;
+    auto status = connection_->ExecuteUpdate(
+        query_, &prepared_statement_, row, &rows_affected, &error,
+        exporter ? &*exporter : nullptr, options.view_types, options.priority,
+        exporter && options.require_preaggregation.value_or(
+                        connection_->require_preaggregation()));
+    if (error.message) {
+      error.release(&error);
+    }
+    UNWRAP_STATUS(status);
+    total = (total < 0 || rows_affected < 0) ? -1 : total + rows_affected;
+  }
+  if (!exporter) {
+    return total;
+  }
+
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  if (exporter->Finish(&arrow_error) != NANOARROW_OK) {
+    return status::fmt::IO("Failed to export result: {}", arrow_error.message);
+  }
+  if (closer.fd >= 0) {
+    int code = close(closer.fd);
+    closer.fd = -1;
+    if (code != 0) {
+      return status::fmt::IO("Failed to write {}: {}", options.export_path,
+                             std::strerror(errno));
+    }
+  }
+  return exporter->rows();
+}
+
+Result<int64_t>
+CubeStatementImpl::ExportParquet(const CubeStatementOptions &options) {
+  if (options.raw_ipc) {
+    return status::InvalidArgument(
+        "adbc.cube.raw_ipc cannot be combined with a Parquet export");
+  }
+  if (options.subscribe) {
+    return status::InvalidArgument(
+        "adbc.cube.subscribe cannot be combined with a Parquet export");
+  }
+
+  int fd = open(options.parquet_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return status::fmt::IO("Cannot open {}: {}", options.parquet_path,
+                           std::strerror(errno));
+  }
+  struct FileCloser {
+    int fd;
+    ~FileCloser() {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  } closer{fd};
+
+  // Decoded batches go to the writer as they are read
+  CubeStatementOptions query_options = options;
+  query_options.parquet_path.clear();
+  nanoarrow::UniqueArrayStream stream;
+  UNWRAP_STATUS(ExecuteQuery(stream.get(), query_options).status());
+
+  ArrowError arrow_error;
+  std::memset(&arrow_error, 0, sizeof(arrow_error));
+  int64_t rows = 0;
+  int code = adbc::cube::ExportParquet(stream.get(), fd, options.parquet,
+                                       &rows, &arrow_error);
+  if (code == ENOTSUP) {
+    return status::fmt::NotImplemented("{}", arrow_error.message);
+  }
+  if (code != NANOARROW_OK) {
+    return status::fmt::IO("Failed to export result: {}", arrow_error.message);
+  }
+  closer.fd = -1;
+  if (close(fd) != 0) {
+    return status::fmt::IO("Failed to write {}: {}", options.parquet_path,
+                           std::strerror(errno));
+  }
+  return rows;
 }
 
 // CubeStatement implementation
@@ -145,103 +701,721 @@ Status CubeStatement::InitImpl(void *parent) {
 }
 
 Status CubeStatement::ReleaseImpl() {
+  if (connection_) {
+    connection_->EndIncrementalPartitions(&incremental_);
+  }
   impl_.reset();
   connection_ = nullptr;
   return status::Ok();
 }
 
+CubeStatementImpl *CubeStatement::Impl(const std::string &query) {
+  // Progress is of whatever ran last
+  partitions_progress_ = false;
+  if (!impl_) {
+    impl_ = std::make_unique<CubeStatementImpl>(connection_, query);
+  } else {
+    impl_->SetQuery(query);
+  }
+  return impl_.get();
+}
+
 Status CubeStatement::PrepareImpl(
     driver::Statement<CubeStatement>::QueryState &state) {
-  if (!impl_) {
-    return status::InvalidState("Statement not initialized");
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  if (options_.json_query) {
+    return status::NotImplemented("adbc.cube.json_query queries cannot be "
+                                  "prepared");
   }
   struct AdbcError error = ADBC_ERROR_INIT;
-  auto status = impl_->Prepare(&error);
+  auto status = Impl(state.query)->Prepare(&error);
   if (error.message) {
     error.release(&error);
   }
   return status;
 }
 
-Status
-CubeStatement::BindImpl(driver::Statement<CubeStatement>::QueryState &state) {
+Status CubeStatement::TakeBoundParameters(CubeStatementImpl *impl) {
+  // The framework keeps what AdbcStatementBind and AdbcStatementBindStream
+  // were given in bind_parameters_ (a bound batch as a stream of it); the
+  // statement takes it over, so nothing is copied
+  if (!bind_parameters_.release) {
+    return status::Ok();
+  }
+  return impl->BindStream(&bind_parameters_);
+}
+
+Result<int64_t> CubeStatement::ExecuteQueryImpl(struct ArrowArrayStream *out) {
   if (!impl_) {
     return status::InvalidState("Statement not initialized");
   }
-  struct AdbcError error = ADBC_ERROR_INIT;
-  auto status = impl_->Bind(nullptr, nullptr, &error);
-  if (error.message) {
-    error.release(&error);
-  }
-  return status;
+  UNWRAP_STATUS(TakeBoundParameters(impl_.get()));
+  return impl_->ExecuteQuery(out, options_);
 }
 
-Status CubeStatement::BindStreamImpl(
-    driver::Statement<CubeStatement>::QueryState &state,
-    struct ArrowArrayStream *values) {
+Result<int64_t> CubeStatement::ExecuteQueryImpl(QueryState &state,
+                                                struct ArrowArrayStream *out) {
+  auto *impl = Impl(state.query);
+  UNWRAP_STATUS(TakeBoundParameters(impl));
+  return impl->ExecuteQuery(out, options_);
+}
+
+Result<int64_t> CubeStatement::ExecuteQueryImpl(PreparedState &state,
+                                                struct ArrowArrayStream *out) {
+  // The statement prepared by PrepareImpl is kept while the query is the
+  // same, so repeated executions reuse it
+  auto *impl = Impl(state.query);
+  UNWRAP_STATUS(TakeBoundParameters(impl));
+  return impl->ExecuteQuery(out, options_);
+}
+
+Status CubeStatement::GetParameterSchemaImpl(PreparedState &state,
+                                             struct ArrowSchema *schema) {
   if (!impl_) {
-    return status::InvalidState("Statement not initialized");
+    return status::InvalidState("Statement not prepared");
+  }
+  return impl_->GetParameterSchema(schema);
+}
+
+Result<int64_t> CubeStatement::ExecuteIngestImpl(IngestState &state) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized");
+  }
+  if (!bind_parameters_.release) {
+    return status::InvalidState("Must Bind() before bulk ingestion");
+  }
+  if (!state.target_table) {
+    return status::InvalidState("Must set ", ADBC_INGEST_OPTION_TARGET_TABLE);
+  }
+  if (state.target_catalog) {
+    return status::NotImplemented("Cube has no catalogs to ingest into");
+  }
+  if (state.temporary) {
+    return status::NotImplemented("Cannot ingest into a temporary table");
   }
+
+  uint8_t mode;
+  if (state.table_exists_ == TableExists::kFail) {
+    mode = INGEST_MODE_CREATE;
+  } else if (state.table_exists_ == TableExists::kReplace) {
+    mode = INGEST_MODE_REPLACE;
+  } else if (state.table_does_not_exist_ == TableDoesNotExist::kCreate) {
+    mode = INGEST_MODE_CREATE_APPEND;
+  } else {
+    mode = INGEST_MODE_APPEND;
+  }
+
+  // The bound stream is consumed by the load
+  nanoarrow::UniqueArrayStream data;
+  ArrowArrayStreamMove(&bind_parameters_, data.get());
+  int64_t rows = 0;
   struct AdbcError error = ADBC_ERROR_INIT;
-  auto status = impl_->BindStream(values, &error);
+  auto status = connection_->Ingest(
+      state.target_schema.value_or(""), *state.target_table, mode, data.get(),
+      &rows, &error, options_.ingest_parallelism,
+      options_.ingest_partition_key);
   if (error.message) {
     error.release(&error);
   }
-  return status;
+  UNWRAP_STATUS(status);
+  return rows;
 }
 
-Result<int64_t> CubeStatement::ExecuteQueryImpl(struct ArrowArrayStream *out) {
+Result<int64_t> CubeStatement::ExecuteUpdateImpl() {
   if (!impl_) {
     return status::InvalidState("Statement not initialized");
   }
-  return impl_->ExecuteQuery(out);
+  UNWRAP_STATUS(TakeBoundParameters(impl_.get()));
+  return impl_->ExecuteUpdate(options_);
 }
 
-Result<int64_t> CubeStatement::ExecuteQueryImpl(QueryState &state,
-                                                struct ArrowArrayStream *out) {
-  // Initialize impl with connection if not already done
-  if (!impl_) {
-    impl_ = std::make_unique<CubeStatementImpl>(connection_, state.query);
+Result<int64_t> CubeStatement::ExecuteUpdateImpl(QueryState &state) {
+  auto *impl = Impl(state.query);
+  UNWRAP_STATUS(TakeBoundParameters(impl));
+  return impl->ExecuteUpdate(options_);
+}
+
+Result<int64_t> CubeStatement::ExecuteUpdateImpl(PreparedState &state) {
+  auto *impl = Impl(state.query);
+  UNWRAP_STATUS(TakeBoundParameters(impl));
+  return impl->ExecuteUpdate(options_);
+}
+
+AdbcStatusCode CubeStatement::SetSqlQuery(const char *query,
+                                          struct AdbcError *error) {
+  auto status_code =
+      driver::Statement<CubeStatement>::SetSqlQuery(query, error);
+  if (status_code == ADBC_STATUS_OK) {
+    if (connection_ && query_ != query) {
+      connection_->EndIncrementalPartitions(&incremental_);
+    }
+    query_ = query;
+  }
+  return status_code;
+}
+
+AdbcStatusCode CubeStatement::ExecutePartitions(
+    struct ArrowSchema *schema, struct AdbcPartitions *partitions,
+    int64_t *rows_affected, struct AdbcError *error) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  if (!schema || !partitions) {
+    return status::InvalidArgument("schema and partitions must be non-null")
+        .ToAdbc(error);
+  }
+  if (query_.empty()) {
+    return status::InvalidState(
+               "Cannot ExecutePartitions without setting the query")
+        .ToAdbc(error);
+  }
+  if (bind_parameters_.release) {
+    return status::NotImplemented(
+               "Cannot ExecutePartitions with bound parameters")
+        .ToAdbc(error);
+  }
+  if (options_.json_query) {
+    return status::NotImplemented(
+               "adbc.cube.json_query queries can only be run by ExecuteQuery")
+        .ToAdbc(error);
+  }
+
+  auto result = std::make_unique<CubePartitions>();
+  nanoarrow::UniqueSchema result_schema;
+  struct AdbcError impl_error = ADBC_ERROR_INIT;
+  Status status;
+  if (options_.incremental) {
+    if (!incremental_) {
+      partitions_returned_ = 0;
+      partitions_done_ = false;
+    }
+    status = connection_->ExecutePartitionsIncremental(
+        query_, options_.max_partitions, result_schema.get(),
+        &result->partitions, &incremental_, &impl_error);
+    partitions_progress_ = true;
+    if (incremental_) {
+      partitions_returned_ = incremental_->returned;
+      partitions_done_ = incremental_->done;
+    }
   } else {
-    impl_->SetQuery(state.query);
+    status = connection_->ExecutePartitions(
+        query_, options_.max_partitions, result_schema.get(),
+        &result->partitions, &impl_error);
   }
-  return impl_->ExecuteQuery(out);
+  if (impl_error.message) {
+    impl_error.release(&impl_error);
+  }
+  if (!status.ok()) {
+    return status.ToAdbc(error);
+  }
+
+  for (const auto &partition : result->partitions) {
+    result->data.push_back(reinterpret_cast<const uint8_t *>(partition.data()));
+    result->lengths.push_back(partition.size());
+  }
+  partitions->num_partitions = result->partitions.size();
+  partitions->partitions = result->data.data();
+  partitions->partition_lengths = result->lengths.data();
+  partitions->private_data = result.release();
+  partitions->release = &ReleasePartitions;
+  ArrowSchemaMove(result_schema.get(), schema);
+  if (rows_affected) {
+    *rows_affected = -1;
+  }
+  return ADBC_STATUS_OK;
 }
 
-Result<int64_t> CubeStatement::ExecuteQueryImpl(PreparedState &state,
-                                                struct ArrowArrayStream *out) {
-  // Initialize impl with connection if not already done
-  if (!impl_) {
-    impl_ = std::make_unique<CubeStatementImpl>(connection_, state.query);
+AdbcStatusCode CubeStatement::ExecuteSchema(struct ArrowSchema *schema,
+                                            struct AdbcError *error) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  if (!schema) {
+    return status::InvalidArgument("schema must be non-null").ToAdbc(error);
+  }
+  if (query_.empty()) {
+    return status::InvalidState(
+               "Cannot ExecuteSchema without setting the query")
+        .ToAdbc(error);
+  }
+  if (options_.json_query) {
+    return status::NotImplemented(
+               "adbc.cube.json_query queries can only be run by ExecuteQuery")
+        .ToAdbc(error);
+  }
+  struct AdbcError impl_error = ADBC_ERROR_INIT;
+  auto status = Impl(query_)->ExecuteSchema(schema, options_, &impl_error);
+  if (impl_error.message) {
+    impl_error.release(&impl_error);
+  }
+  return status.ToAdbc(error);
+}
+
+AdbcStatusCode CubeStatement::Cancel(struct AdbcError *error) {
+  if (!connection_) {
+    return status::InvalidState("Connection not initialized").ToAdbc(error);
+  }
+  // The native protocol cancels per session, not per query
+  return connection_->Cancel().ToAdbc(error);
+}
+
+AdbcStatusCode
+CubeStatement::ExecuteQueryAsync(struct ArrowAsyncDeviceStreamHandler *handler,
+                                 struct AdbcError *error) {
+  if (!handler) {
+    return status::InvalidArgument("handler must be non-null").ToAdbc(error);
+  }
+  nanoarrow::UniqueArrayStream stream;
+  AdbcStatusCode status_code;
+  if (!connection_) {
+    status_code =
+        status::InvalidState("Connection not initialized").ToAdbc(error);
+  } else if (connection_->connection_mode() != ConnectionMode::Native) {
+    status_code = status::NotImplemented(
+                      "Async results require native connection mode")
+                      .ToAdbc(error);
   } else {
-    impl_->SetQuery(state.query);
+    status_code = ExecuteQuery(stream.get(), nullptr, error);
+  }
+  if (status_code != ADBC_STATUS_OK) {
+    handler->on_error(handler, EIO,
+                      error && error->message ? error->message
+                                              : "Failed to run the query",
+                      nullptr);
+    handler->release(handler);
+    return status_code;
   }
-  return impl_->ExecuteQuery(out);
+  connection_->StartAsyncStream(stream.get(), handler);
+  return ADBC_STATUS_OK;
 }
 
-Result<int64_t> CubeStatement::ExecuteUpdateImpl() {
-  if (!impl_) {
-    return status::InvalidState("Statement not initialized");
+AdbcStatusCode CubeStatement::ExecuteQueryTee(size_t count,
+                                              int64_t max_buffered_batches,
+                                              struct ArrowArrayStream *out,
+                                              struct AdbcError *error) {
+  if (count == 0 || !out) {
+    return status::InvalidArgument("count must be positive and out non-null")
+        .ToAdbc(error);
   }
-  return impl_->ExecuteUpdate();
+  if (max_buffered_batches < 0) {
+    return status::fmt::InvalidArgument(
+               "max_buffered_batches must be non-negative, got {}",
+               max_buffered_batches)
+        .ToAdbc(error);
+  }
+  nanoarrow::UniqueArrayStream stream;
+  AdbcStatusCode status_code = ExecuteQuery(stream.get(), nullptr, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return status_code;
+  }
+  TeeArrayStream(stream.get(), count, max_buffered_batches, out);
+  return ADBC_STATUS_OK;
+}
+
+AdbcStatusCode
+CubeStatement::ExecuteQueryDevice(struct ArrowDeviceArrayStream *out,
+                                  int64_t *rows_affected,
+                                  struct AdbcError *error) {
+  if (!out) {
+    return status::InvalidArgument("out must be non-null").ToAdbc(error);
+  }
+  nanoarrow::UniqueArrayStream stream;
+  AdbcStatusCode status_code = ExecuteQuery(stream.get(), rows_affected, error);
+  if (status_code != ADBC_STATUS_OK) {
+    return status_code;
+  }
+  ExportDeviceStream(stream.get(), CubeCurrentAllocator(), out);
+  return ADBC_STATUS_OK;
 }
 
 Status CubeStatement::SetOptionImpl(std::string_view key,
                                     driver::Option value) {
-  // Handle standard ADBC statement options
-  if (key == ADBC_INGEST_OPTION_TARGET_TABLE) {
-    // Handle ingestion target table
-    auto str_result = value.AsString();
-    if (str_result.has_value()) {
-      // Store target table for bulk ingestion
-      return status::NotImplemented("Bulk ingestion not yet supported");
+  // The ADBC_INGEST_OPTION_* keys are handled by the framework, which
+  // passes them to ExecuteIngestImpl
+
+  if (key == "adbc.cube.decode_threads") {
+    UNWRAP_RESULT(auto threads, value.AsInt());
+    if (threads < 1 || threads > 1024) {
+      return status::fmt::InvalidArgument("{} must be between 1 and 1024, got {}",
+                                          key, threads);
+    }
+    options_.decode_threads = static_cast<int>(threads);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.view_types") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.view_types = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.run_end_encoding") {
+    UNWRAP_RESULT(auto mode, value.AsString());
+    if (mode == "off") {
+      options_.run_end_encoding = RunEndEncoding::Off;
+    } else if (mode == "keep") {
+      options_.run_end_encoding = RunEndEncoding::Keep;
+    } else if (mode == "expand") {
+      options_.run_end_encoding = RunEndEncoding::Expand;
+    } else {
+      return status::fmt::InvalidArgument(
+          "{} must be 'off', 'keep' or 'expand', got '{}'", key, mode);
+    }
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.timestamp_unit") {
+    UNWRAP_RESULT(auto unit, value.AsString());
+    if (unit.empty()) {
+      options_.timestamp_unit.reset();
+    } else if (unit == "s") {
+      options_.timestamp_unit = NANOARROW_TIME_UNIT_SECOND;
+    } else if (unit == "ms") {
+      options_.timestamp_unit = NANOARROW_TIME_UNIT_MILLI;
+    } else if (unit == "us") {
+      options_.timestamp_unit = NANOARROW_TIME_UNIT_MICRO;
+    } else if (unit == "ns") {
+      options_.timestamp_unit = NANOARROW_TIME_UNIT_NANO;
+    } else {
+      return status::fmt::InvalidArgument(
+          "{} must be 's', 'ms', 'us', 'ns' or empty, got '{}'", key, unit);
+    }
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.date_type") {
+    UNWRAP_RESULT(auto type, value.AsString());
+    if (type.empty()) {
+      options_.date_type.reset();
+    } else if (type == "date32") {
+      options_.date_type = NANOARROW_TYPE_DATE32;
+    } else if (type == "date64") {
+      options_.date_type = NANOARROW_TYPE_DATE64;
+    } else {
+      return status::fmt::InvalidArgument(
+          "{} must be 'date32', 'date64' or empty, got '{}'", key, type);
     }
-    return status::InvalidArgument("Invalid value type for target_table");
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.dictionary_encode") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.dictionary_encode = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.raw_ipc") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.raw_ipc = enabled;
+    return status::Ok();
   }
 
-  if (key == ADBC_INGEST_OPTION_MODE) {
-    // Handle ingestion mode (append/create)
-    return status::NotImplemented("Bulk ingestion not yet supported");
+  if (key == "adbc.cube.subscribe") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.subscribe = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.require_preaggregation") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.require_preaggregation = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.json_query") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.json_query = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.sample_fraction") {
+    double fraction = 0;
+    if (auto *number = std::get_if<double>(&value.value())) {
+      fraction = *number;
+    } else {
+      UNWRAP_RESULT(auto text, value.AsString());
+      std::string copy(text);
+      char *end = nullptr;
+      fraction = std::strtod(copy.c_str(), &end);
+      if (copy.empty() || *end != '\0') {
+        return status::fmt::InvalidArgument("{} must be a number, got '{}'",
+                                            key, copy);
+      }
+    }
+    if (!(fraction >= 0 && fraction <= 1)) {
+      return status::fmt::InvalidArgument("{} must be between 0 and 1, got {}",
+                                          key, fraction);
+    }
+    // 0 and 1 both mean the whole input
+    options_.sample_fraction_ppm = 0;
+    if (fraction > 0 && fraction < 1) {
+      options_.sample_fraction_ppm = std::max<uint32_t>(
+          1, static_cast<uint32_t>(fraction * 1e6 + 0.5));
+    }
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.sample_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, rows);
+    }
+    options_.sample_rows = rows;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.sample_seed") {
+    UNWRAP_RESULT(auto seed, value.AsInt());
+    options_.sample_seed = seed;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.batch_statistics") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.batch_statistics = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.estimate") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.estimate = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.sample_refine") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.sample_refine = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.columns") {
+    UNWRAP_RESULT(auto columns, value.AsString());
+    // Comma-separated names; spaces around each are dropped
+    std::vector<std::string> names;
+    std::string_view rest = columns;
+    while (!rest.empty()) {
+      size_t comma = rest.find(',');
+      std::string_view name = rest.substr(0, comma);
+      rest = comma == std::string_view::npos ? std::string_view()
+                                             : rest.substr(comma + 1);
+      size_t begin = name.find_first_not_of(' ');
+      size_t end = name.find_last_not_of(' ');
+      if (begin == std::string_view::npos) {
+        return status::fmt::InvalidArgument("{} has an empty column name: '{}'",
+                                            key, columns);
+      }
+      names.emplace_back(name.substr(begin, end - begin + 1));
+    }
+    options_.columns = std::move(names);
+    return status::Ok();
+  }
+
+  if (key == ADBC_STATEMENT_OPTION_INCREMENTAL) {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    if (enabled != options_.incremental && connection_) {
+      connection_->EndIncrementalPartitions(&incremental_);
+    }
+    options_.incremental = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.max_partitions") {
+    UNWRAP_RESULT(auto count, value.AsInt());
+    if (count < 0 || count > UINT32_MAX) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, UINT32_MAX, count);
+    }
+    options_.max_partitions = static_cast<uint32_t>(count);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.max_batch_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows < 0 || rows > UINT32_MAX) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, UINT32_MAX, rows);
+    }
+    options_.max_batch_rows = static_cast<uint32_t>(rows);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.max_batch_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    options_.max_batch_bytes = bytes;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.first_batch_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows < 0 || rows > UINT32_MAX) {
+      return status::fmt::InvalidArgument(
+          "{} must be between 0 and {}, got {}", key, UINT32_MAX, rows);
+    }
+    options_.first_batch_rows = static_cast<uint32_t>(rows);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.max_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, rows);
+    }
+    options_.max_rows = rows;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.target_batch_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, rows);
+    }
+    options_.target_batch_rows = rows;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.merge_sort_keys") {
+    UNWRAP_RESULT(auto keys, value.AsString());
+    options_.merge_sort_keys = std::string(keys);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.ingest.parallelism") {
+    UNWRAP_RESULT(auto sessions, value.AsInt());
+    if (sessions < 1) {
+      return status::fmt::InvalidArgument("{} must be at least 1, got {}",
+                                          key, sessions);
+    }
+    options_.ingest_parallelism = sessions;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.ingest.partition_key") {
+    UNWRAP_RESULT(auto column, value.AsString());
+    options_.ingest_partition_key = std::string(column);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.hedge_after_ms") {
+    UNWRAP_RESULT(auto delay_ms, value.AsInt());
+    if (delay_ms < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, delay_ms);
+    }
+    options_.hedge_after_ms = delay_ms;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.query_priority") {
+    UNWRAP_RESULT(auto priority, value.AsString());
+    if (priority == "default") {
+      options_.priority = QueryPriority::Default;
+    } else if (priority == "interactive") {
+      options_.priority = QueryPriority::Interactive;
+    } else if (priority == "batch") {
+      options_.priority = QueryPriority::Batch;
+    } else if (priority == "background") {
+      options_.priority = QueryPriority::Background;
+    } else {
+      return status::fmt::InvalidArgument(
+          "{} must be 'default', 'interactive', 'batch' or 'background', "
+          "got '{}'",
+          key, priority);
+    }
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.spill_dir") {
+    UNWRAP_RESULT(auto dir, value.AsString());
+    options_.spill_dir = std::string(dir);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.spill_budget_bytes") {
+    UNWRAP_RESULT(auto bytes, value.AsInt());
+    if (bytes < 0) {
+      return status::fmt::InvalidArgument("{} must be non-negative, got {}",
+                                          key, bytes);
+    }
+    options_.spill_budget_bytes = static_cast<size_t>(bytes);
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export_path") {
+    UNWRAP_RESULT(auto path, value.AsString());
+    options_.export_path = std::string(path);
+    options_.export_fd = -1;
+    options_.parquet_path.clear();
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export_fd") {
+    UNWRAP_RESULT(auto fd, value.AsInt());
+    if (fd < -1 || fd > INT32_MAX) {
+      return status::fmt::InvalidArgument(
+          "{} must be a file descriptor or -1, got {}", key, fd);
+    }
+    options_.export_fd = static_cast<int>(fd);
+    options_.export_path.clear();
+    options_.parquet_path.clear();
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export.parquet_path") {
+    UNWRAP_RESULT(auto path, value.AsString());
+    options_.parquet_path = std::string(path);
+    options_.export_path.clear();
+    options_.export_fd = -1;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export.parquet_row_group_rows") {
+    UNWRAP_RESULT(auto rows, value.AsInt());
+    if (rows <= 0) {
+      return status::fmt::InvalidArgument("{} must be positive, got {}", key,
+                                          rows);
+    }
+    options_.parquet.row_group_rows = rows;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export.parquet_dictionary") {
+    UNWRAP_RESULT(auto enabled, value.AsBool());
+    options_.parquet.dictionary = enabled;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.export.parquet_compression") {
+    UNWRAP_RESULT(auto name, value.AsString());
+    auto codec = ParseCompressionCodec(name);
+    if (!codec || *codec == CompressionCodec::Lz4Frame) {
+      return status::fmt::InvalidArgument(
+          "{} must be 'none' or 'zstd', got '{}'", key, name);
+    }
+    if (!IsCompressionCodecAvailable(*codec)) {
+      return status::fmt::NotImplemented("{} is not available in this build",
+                                         name);
+    }
+    options_.parquet.compression = *codec;
+    return status::Ok();
+  }
+
+  if (key == "adbc.cube.result_estimated_rows" ||
+      key == "adbc.cube.result_estimated_bytes" ||
+      key == ADBC_STATEMENT_OPTION_PROGRESS ||
+      key == ADBC_STATEMENT_OPTION_MAX_PROGRESS ||
+      key.substr(0, kStatsPrefix.size()) == kStatsPrefix ||
+      key.substr(0, kBatchStatsPrefix.size()) == kBatchStatsPrefix ||
+      key.substr(0, kEstimatePrefix.size()) == kEstimatePrefix) {
+    return status::InvalidArgument(key, " is read-only");
   }
 
   // SQL queries should use set_sql_query() method, not set_options()
@@ -251,4 +1425,162 @@ Status CubeStatement::SetOptionImpl(std::string_view key,
   return status::NotImplemented("Unknown statement option: ", key);
 }
 
+std::pair<double, double> CubeStatement::Progress() const {
+  if (partitions_progress_) {
+    // Partitions the last incremental ExecutePartitions returned; their
+    // total is known once it returned the last of them
+    double returned = static_cast<double>(partitions_returned_);
+    return {returned, partitions_done_ ? returned : 0.0};
+  }
+  // Rows decoded against the row count, once the server sent it, or its
+  // estimate; bytes received against the estimated bytes when only those
+  // are known. Counters are updated as the result is read, and read here
+  // without locking, from any thread.
+  const CubeQueryStats *stats = impl_ ? impl_->stats().get() : nullptr;
+  if (!stats) {
+    return {0.0, 0.0};
+  }
+  int64_t rows = stats->rows.load(std::memory_order_relaxed);
+  int64_t max_rows = stats->total_rows.load(std::memory_order_relaxed);
+  if (max_rows < 0) {
+    max_rows = stats->estimated_rows.load(std::memory_order_relaxed);
+  }
+  if (max_rows >= 0) {
+    // An estimate the result outgrew is no longer a maximum
+    return {static_cast<double>(rows),
+            static_cast<double>(std::max(rows, max_rows))};
+  }
+  int64_t max_bytes = stats->estimated_bytes.load(std::memory_order_relaxed);
+  if (max_bytes > 0) {
+    int64_t bytes = stats->bytes_received.load(std::memory_order_relaxed);
+    return {static_cast<double>(bytes),
+            static_cast<double>(std::max(bytes, max_bytes))};
+  }
+  return {static_cast<double>(rows), 0.0};
+}
+
+Result<driver::Option> CubeStatement::GetOption(std::string_view key) {
+  // Estimates the server sent ahead of the last result; -1 when unknown
+  if (key == "adbc.cube.result_estimated_rows") {
+    return driver::Option(impl_ ? impl_->size_hint().rows : int64_t{-1});
+  } else if (key == "adbc.cube.result_estimated_bytes") {
+    return driver::Option(impl_ ? impl_->size_hint().bytes : int64_t{-1});
+  }
+  if (key == ADBC_STATEMENT_OPTION_PROGRESS ||
+      key == ADBC_STATEMENT_OPTION_MAX_PROGRESS) {
+    auto [progress, max_progress] = Progress();
+    return driver::Option(key == ADBC_STATEMENT_OPTION_PROGRESS
+                              ? progress
+                              : max_progress);
+  }
+  if (key.substr(0, kEstimatePrefix.size()) == kEstimatePrefix) {
+    // Of the last ExecuteSchema with adbc.cube.estimate; -1 (empty for the
+    // pre-aggregation) when unknown
+    CubeQueryEstimate estimate =
+        impl_ ? impl_->estimate() : CubeQueryEstimate();
+    std::string_view name = key.substr(kEstimatePrefix.size());
+    if (name == "rows") {
+      return driver::Option(estimate.size.rows);
+    } else if (name == "bytes") {
+      return driver::Option(estimate.size.bytes);
+    } else if (name == "uses_preaggregation") {
+      return driver::Option(static_cast<int64_t>(estimate.uses_preaggregation));
+    } else if (name == "preaggregation") {
+      return driver::Option(std::move(estimate.preaggregation));
+    }
+  }
+  if (key.substr(0, kStatsPrefix.size()) == kStatsPrefix) {
+    // Statistics of the last result; zero before the first execution
+    const CubeQueryStats *stats = impl_ ? impl_->stats().get() : nullptr;
+    std::string_view name = key.substr(kStatsPrefix.size());
+    auto micros = [](const std::atomic<int64_t> &nanos) {
+      return nanos.load(std::memory_order_relaxed) / 1000;
+    };
+    if (name == "bytes_received") {
+      return driver::Option(stats ? stats->bytes_received.load() : 0);
+    } else if (name == "batches") {
+      return driver::Option(stats ? stats->batches.load() : 0);
+    } else if (name == "rows") {
+      return driver::Option(stats ? stats->rows.load() : 0);
+    } else if (name == "time_to_first_batch_us") {
+      int64_t nanos = stats ? stats->time_to_first_batch_nanos.load() : -1;
+      return driver::Option(nanos < 0 ? int64_t{-1} : nanos / 1000);
+    } else if (name == "decode_us") {
+      return driver::Option(stats ? micros(stats->decode_nanos) : 0);
+    } else if (name == "socket_wait_us") {
+      return driver::Option(stats ? micros(stats->socket_wait_nanos) : 0);
+    } else if (name == "verify_us") {
+      return driver::Option(stats ? micros(stats->verify_nanos) : 0);
+    }
+    // As the server reported them; -1 (empty for the pre-aggregation)
+    // when it did not
+    std::optional<QueryDiagnostics> diagnostics;
+    if (stats) {
+      diagnostics = stats->diagnostics();
+    }
+    QueryDiagnostics server = diagnostics.value_or(QueryDiagnostics());
+    auto server_micros = [](int64_t nanos) {
+      return nanos < 0 ? int64_t{-1} : nanos / 1000;
+    };
+    if (name == "preaggregation") {
+      return driver::Option(std::move(server.preaggregation));
+    } else if (name == "result_cache_hit") {
+      return driver::Option(static_cast<int64_t>(server.result_cache_hit));
+    } else if (name == "server_planning_us") {
+      return driver::Option(server_micros(server.planning_nanos));
+    } else if (name == "server_execution_us") {
+      return driver::Option(server_micros(server.execution_nanos));
+    } else if (name == "server_serialization_us") {
+      return driver::Option(server_micros(server.serialization_nanos));
+    } else if (name == "server_bytes") {
+      return driver::Option(server.bytes_produced);
+    }
+  }
+  if (key.substr(0, kBatchStatsPrefix.size()) == kBatchStatsPrefix) {
+    // Of the batch last read; unset without adbc.cube.batch_statistics
+    // or before the first batch
+    const CubeBatchStatistics *statistics =
+        impl_ ? impl_->batch_statistics().get() : nullptr;
+    std::string_view name = key.substr(kBatchStatsPrefix.size());
+    if (name == "batches") {
+      return driver::Option(statistics ? statistics->batches() : 0);
+    } else if (name == "rows") {
+      return driver::Option(statistics ? statistics->rows() : int64_t{-1});
+    }
+    // <column>.<statistic>, the column by its index
+    size_t dot = name.find('.');
+    size_t column = 0;
+    auto parsed = std::from_chars(name.data(), name.data() + dot, column);
+    CubeColumnStatistics column_statistics;
+    if (dot != std::string_view::npos && parsed.ec == std::errc() &&
+        parsed.ptr == name.data() + dot && statistics &&
+        statistics->column(column, &column_statistics)) {
+      std::string_view statistic = name.substr(dot + 1);
+      auto bound = [](CubeStatisticValue value) {
+        return std::visit(
+            [](auto &&value) -> driver::Option {
+              using T = std::decay_t<decltype(value)>;
+              if constexpr (std::is_same_v<T, std::monostate>) {
+                return driver::Option();
+              } else {
+                return driver::Option(std::move(value));
+              }
+            },
+            std::move(value));
+      };
+      if (statistic == "null_count") {
+        return driver::Option(column_statistics.null_count);
+      } else if (statistic == "distinct_count") {
+        return driver::Option(column_statistics.distinct_count);
+      } else if (statistic == "min") {
+        return bound(std::move(column_statistics.min));
+      } else if (statistic == "max") {
+        return bound(std::move(column_statistics.max));
+      }
+    }
+    return driver::Option();
+  }
+  return driver::Statement<CubeStatement>::GetOption(key);
+}
+
 } // namespace adbc::cube
@@ -19,13 +19,18 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <arrow-adbc/adbc.h>
-#include <nanoarrow/nanoarrow.h>
+#include <nanoarrow/nanoarrow.hpp>
 
 #define ADBC_FRAMEWORK_USE_FMT
+#include "driver/cube/batch_statistics.h"
+#include "driver/cube/connection.h"
+#include "driver/cube/parquet_export.h"
 #include "driver/framework/statement.h"
 #include "driver/framework/status.h"
 
@@ -39,31 +44,191 @@ namespace status = adbc::driver::status;
 class CubeConnection;
 class CubeConnectionImpl;
 
+// How results reach the application with adbc.cube.run_end_encoding
+enum class RunEndEncoding {
+  Off,    // Not asked for; the server sends plain columns
+  Keep,   // Asked for, and run_end_encoded columns are returned as they are
+  Expand, // Asked for, and expanded to plain columns batch by batch
+};
+
+// Statement options that override the connection's reader options
+struct CubeStatementOptions {
+  int decode_threads = 0; // adbc.cube.decode_threads; 0 = connection default
+  bool view_types = false; // adbc.cube.view_types
+  RunEndEncoding run_end_encoding = RunEndEncoding::Off;
+  std::string spill_dir;   // adbc.cube.spill_dir; empty = never spill
+  size_t spill_budget_bytes = CubeReaderOptions().spill_budget_bytes;
+  bool raw_ipc = false; // adbc.cube.raw_ipc
+  // adbc.cube.subscribe: ExecuteQuery returns every version of the result
+  // the server pushes, each followed by an empty batch
+  bool subscribe = false;
+  // adbc.cube.columns: top-level result columns to decode; empty = all
+  std::vector<std::string> columns;
+  // adbc.cube.export_path / adbc.cube.export_fd: where ExecuteUpdate
+  // writes the result as Arrow IPC; at most one is set
+  std::string export_path;
+  int export_fd = -1;
+  // adbc.cube.export.parquet_path: where ExecuteUpdate writes the decoded
+  // result as Parquet instead; setting it clears the Arrow IPC target
+  std::string parquet_path;
+  // adbc.cube.export.parquet_row_group_rows / _dictionary / _compression
+  CubeParquetOptions parquet;
+  // adbc.cube.max_partitions: most partitions ExecutePartitions asks the
+  // server for; 0 lets it choose
+  uint32_t max_partitions = 0;
+  // adbc.statement.exec.incremental: ExecutePartitions returns partitions
+  // as the server finds them, then an empty set once they are all returned
+  bool incremental = false;
+  // adbc.cube.max_batch_rows / adbc.cube.max_batch_bytes: largest result
+  // batches the server is asked for; 0 = its choice
+  uint32_t max_batch_rows = 0;
+  int64_t max_batch_bytes = 0;
+  // adbc.cube.target_batch_rows: rows of each batch ExecuteQuery returns,
+  // whatever the server sends; 0 passes batches through
+  int64_t target_batch_rows = 0;
+  // adbc.cube.hedge_after_ms: when a read-only query sent to another
+  // server too if unanswered; 0 = never
+  int64_t hedge_after_ms = 0;
+  // adbc.cube.query_priority: class of work the queries are
+  QueryPriority priority = QueryPriority::Default;
+  // adbc.cube.first_batch_rows: most rows of the first result batch, for
+  // a quick preview; 0 = as the others
+  uint32_t first_batch_rows = 0;
+  // adbc.cube.max_rows: most rows ExecuteQuery returns, the rest of the
+  // result being stopped on the server; 0 = all
+  int64_t max_rows = 0;
+  // adbc.cube.require_preaggregation: reject queries no pre-aggregation
+  // serves; unset follows the connection's option
+  std::optional<bool> require_preaggregation;
+  // adbc.cube.merge_sort_keys: the ORDER BY of the query, by which its
+  // partitions, read at once, are merged; empty = read the result whole
+  std::string merge_sort_keys;
+  // adbc.cube.ingest.parallelism: sessions a bulk ingestion loads through
+  // at once, committing through a staging table; 1 = the connection's alone
+  int64_t ingest_parallelism = 1;
+  // adbc.cube.ingest.partition_key: column whose value picks the session
+  // each row goes through; empty = whole batches in turn
+  std::string ingest_partition_key;
+  // adbc.cube.timestamp_unit / adbc.cube.date_type: unit and type Arrow
+  // IPC timestamp and date columns are converted to; unset = the server's
+  std::optional<ArrowTimeUnit> timestamp_unit;
+  std::optional<ArrowType> date_type;
+  // adbc.cube.dictionary_encode: dictionary encode the string columns of
+  // Arrow IPC results the server sends plain
+  bool dictionary_encode = false;
+  // adbc.cube.json_query: the query is a Cube JSON query, which
+  // ExecuteQuery sends without SQL for the server to parse and rewrite
+  bool json_query = false;
+  // adbc.cube.sample_fraction / sample_rows / sample_seed: run the query
+  // on a sample of its input, as a fraction in parts per million or at
+  // most that many rows, for a preview; 0 = exact
+  uint32_t sample_fraction_ppm = 0;
+  int64_t sample_rows = 0;
+  int64_t sample_seed = 0;
+  // adbc.cube.sample_refine: follow the sampled result with the exact one
+  bool sample_refine = false;
+
+  bool sampled() const { return sample_fraction_ppm > 0 || sample_rows > 0; }
+  // adbc.cube.batch_statistics: compute the min, max, null count and
+  // distinct estimate of each column of each batch ExecuteQuery returns
+  bool batch_statistics = false;
+  // adbc.cube.estimate: ExecuteSchema also asks the server what running
+  // the query would cost, planning it again each time
+  bool estimate = false;
+
+  bool exporting() const {
+    return !export_path.empty() || export_fd >= 0 || !parquet_path.empty();
+  }
+};
+
 // Cube SQL statement implementation
 class CubeStatementImpl {
 public:
   explicit CubeStatementImpl(CubeConnectionImpl *connection, std::string query);
-  ~CubeStatementImpl() = default;
+  ~CubeStatementImpl();
 
+  // Prepare the query on the server, so executions skip parsing and
+  // planning; servers that cannot prepare get the SQL every time
   Status Prepare(struct AdbcError *error);
-  Status Bind(struct ArrowArray *values, struct ArrowSchema *schema,
-              struct AdbcError *error);
-  Status BindStream(struct ArrowArrayStream *values, struct AdbcError *error);
-  Result<int64_t> ExecuteQuery(struct ArrowArrayStream *out);
-  Result<int64_t> ExecuteUpdate();
+  // Parameter schema reported by the server when the query was prepared
+  Status GetParameterSchema(struct ArrowSchema *schema);
+  // Schema of the query's result without running it; kept until the query
+  // changes, and taken from the prepared statement when it has one. With
+  // options.estimate, planned on the server every time, setting estimate().
+  Status ExecuteSchema(struct ArrowSchema *schema,
+                       const CubeStatementOptions &options,
+                       struct AdbcError *error);
+  // Take ownership of the bound parameters (a batch is bound as a stream of
+  // it); values is left released
+  Status BindStream(struct ArrowArrayStream *values);
+  // Returns the row count when the server knows it once the query has
+  // started, its estimate otherwise, or -1
+  Result<int64_t> ExecuteQuery(struct ArrowArrayStream *out,
+                               const CubeStatementOptions &options = {});
+  // Run the query for its row count only, without a result stream. With an
+  // export target, the result is written there as one Arrow IPC stream
+  // instead, undecoded, or decoded and written as a Parquet file, and the
+  // number of rows written is returned.
+  Result<int64_t> ExecuteUpdate(const CubeStatementOptions &options = {});
+  // ExecuteUpdate with options.parquet_path set
+  Result<int64_t> ExportParquet(const CubeStatementOptions &options);
+
+  // Server estimate of the size of the last result ExecuteQuery returned
+  const ResultSizeHint &size_hint() const { return size_hint_; }
+  // What the server expected the query to cost at the last ExecuteSchema
+  // with adbc.cube.estimate; unknown before it
+  const CubeQueryEstimate &estimate() const { return estimate_; }
+
+  // Statistics of the results of the last ExecuteQuery, updated as they
+  // are read; null before the first one
+  const std::shared_ptr<CubeQueryStats> &stats() const { return stats_; }
+  // Statistics of the batch last read from the result of the last
+  // ExecuteQuery with adbc.cube.batch_statistics; null otherwise
+  const std::shared_ptr<CubeBatchStatistics> &batch_statistics() const {
+    return batch_statistics_;
+  }
 
   const std::string &query() const { return query_; }
-  void SetQuery(const std::string &query) { query_ = query; }
+  // Changing the query drops the statement prepared for the previous one
+  void SetQuery(const std::string &query);
 
 private:
+  // Read the bound stream into param_batches_
+  Status ReadParameterStream();
+  // Read and encode the bound parameters into encoded_params_, if not done
+  // already; encoded_params_ stays null without parameters
+  Status PrepareParameters();
+  // Convert the temporal and string columns of a result schema as options
+  // convert the results; releases schema on failure
+  Status ConvertResultSchema(const CubeStatementOptions &options,
+                             struct ArrowSchema *schema);
+
   CubeConnectionImpl *connection_; // Non-owning
   std::string query_;
   bool prepared_ = false;
+  CubePreparedStatement prepared_statement_; // Handle set once prepared
+  nanoarrow::UniqueSchema result_schema_; // Of the last ExecuteSchema
+  bool result_view_types_ = false;        // Options result_schema_ was for
+  RunEndEncoding result_run_end_encoding_ = RunEndEncoding::Off;
+
+  // Bound parameters: the stream is read at the first execution and its
+  // batches kept for later ones
+  nanoarrow::UniqueArrayStream param_stream_;
+  nanoarrow::UniqueSchema param_schema_;
+  std::vector<nanoarrow::UniqueArray> param_batches_;
+  // param_batches_ encoded, one entry per execution; reused until the
+  // parameters are bound again or the query is prepared again
+  std::shared_ptr<const std::vector<CubeQueryParameters>> encoded_params_;
+  ResultSizeHint size_hint_;
+  CubeQueryEstimate estimate_;
+  std::shared_ptr<CubeQueryStats> stats_;
+  std::shared_ptr<CubeBatchStatistics> batch_statistics_;
 
-  // Parameter binding storage
-  struct ArrowArray param_array_;
-  struct ArrowSchema param_schema_;
-  bool has_params_ = false;
+  // Kept for every execution of the query: what it says about its rows,
+  // and the plan of the last result schema read
+  std::optional<CubeResultOrdering> result_ordering_;
+  std::shared_ptr<CubeSchemaSlot> schema_slot_ =
+      std::make_shared<CubeSchemaSlot>();
 };
 
 class CubeStatement : public driver::Statement<CubeStatement> {
@@ -75,12 +240,15 @@ public:
   Status InitImpl(void *parent);
   Status ReleaseImpl();
   Status PrepareImpl(driver::Statement<CubeStatement>::QueryState &state);
-  Status BindImpl(driver::Statement<CubeStatement>::QueryState &state);
-  Status BindStreamImpl(driver::Statement<CubeStatement>::QueryState &state,
-                        struct ArrowArrayStream *values);
+  Status
+  GetParameterSchemaImpl(driver::Statement<CubeStatement>::PreparedState &state,
+                         struct ArrowSchema *schema);
 
   Result<int64_t> ExecuteQueryImpl(struct ArrowArrayStream *out);
   Result<int64_t> ExecuteUpdateImpl();
+  // Stream the bound data to the target table (native mode only)
+  Result<int64_t>
+  ExecuteIngestImpl(driver::Statement<CubeStatement>::IngestState &state);
 
   // Overloads for Query and Prepared state
   Result<int64_t>
@@ -92,20 +260,74 @@ public:
                    struct ArrowArrayStream *out);
 
   Result<int64_t>
-  ExecuteUpdateImpl(driver::Statement<CubeStatement>::QueryState &state) {
-    return ExecuteUpdateImpl();
-  }
+  ExecuteUpdateImpl(driver::Statement<CubeStatement>::QueryState &state);
 
   Result<int64_t>
-  ExecuteUpdateImpl(driver::Statement<CubeStatement>::PreparedState &state) {
-    return ExecuteUpdateImpl();
-  }
+  ExecuteUpdateImpl(driver::Statement<CubeStatement>::PreparedState &state);
 
   Status SetOptionImpl(std::string_view key, driver::Option value);
+  Result<driver::Option> GetOption(std::string_view key) override;
+
+  /// Also keeps the query for ExecutePartitions, which the framework does
+  /// not route through a state
+  AdbcStatusCode SetSqlQuery(const char *query, struct AdbcError *error);
+
+  /// Split the query into partitions that AdbcConnectionReadPartition can
+  /// read on any connection of the database; with
+  /// ADBC_STATEMENT_OPTION_INCREMENTAL, those found since the last call
+  AdbcStatusCode ExecutePartitions(struct ArrowSchema *schema,
+                                   struct AdbcPartitions *partitions,
+                                   int64_t *rows_affected,
+                                   struct AdbcError *error);
+
+  /// Result schema of the query, planned on the server but not run
+  AdbcStatusCode ExecuteSchema(struct ArrowSchema *schema,
+                               struct AdbcError *error);
+
+  /// Cancel the queries in flight on this statement's connection (may be
+  /// called from another thread)
+  AdbcStatusCode Cancel(struct AdbcError *error);
+
+  /// Run the query and push its result into handler as it arrives (native
+  /// mode only); backs AdbcCubeStatementExecuteQueryAsync
+  AdbcStatusCode
+  ExecuteQueryAsync(struct ArrowAsyncDeviceStreamHandler *handler,
+                    struct AdbcError *error);
+
+  /// Run the query once and split its result into count streams sharing
+  /// its batches; backs AdbcCubeStatementExecuteQueryTee
+  AdbcStatusCode ExecuteQueryTee(size_t count, int64_t max_buffered_batches,
+                                 struct ArrowArrayStream *out,
+                                 struct AdbcError *error);
+
+  /// Run the query and export its result as CPU or CUDA host batches in
+  /// the registered allocator's memory; backs
+  /// AdbcCubeStatementExecuteQueryDevice
+  AdbcStatusCode ExecuteQueryDevice(struct ArrowDeviceArrayStream *out,
+                                    int64_t *rows_affected,
+                                    struct AdbcError *error);
 
 private:
+  // Create impl_ for the query, or point it at the query
+  CubeStatementImpl *Impl(const std::string &query);
+  // Hand the parameters bound since the last execution to impl_
+  Status TakeBoundParameters(CubeStatementImpl *impl);
+  // ADBC_STATEMENT_OPTION_PROGRESS and MAX_PROGRESS of the last execution;
+  // the maximum is 0 while unknown
+  std::pair<double, double> Progress() const;
+
   CubeConnectionImpl *connection_ = nullptr; // Non-owning
   std::unique_ptr<CubeStatementImpl> impl_;
+  CubeStatementOptions options_;
+  std::string query_; // Last query set, for ExecutePartitions
+  // Incremental ExecutePartitions under way, or finished and not yet
+  // followed by its empty set
+  std::unique_ptr<CubeIncrementalPartitions> incremental_;
+  int64_t partitions_returned_ = 0; // By the last incremental execution
+  bool partitions_done_ = false;
+  // The last execution was an incremental ExecutePartitions, whose
+  // progress counts partitions rather than rows
+  bool partitions_progress_ = false;
 };
 
 } // namespace adbc::cube
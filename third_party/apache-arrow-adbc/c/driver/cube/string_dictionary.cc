@@ -0,0 +1,315 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/string_dictionary.h"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nanoarrow/nanoarrow.hpp>
+
+namespace adbc::cube {
+
+uint64_t HashValueBits(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Eight bytes at a time
+uint64_t HashValueBytes(const uint8_t *data, int64_t size) {
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>(size);
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 29;
+    data += 8;
+    size -= 8;
+  }
+  if (size > 0) {
+    uint64_t word = 0;
+    std::memcpy(&word, data, size);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+  }
+  return HashValueBits(hash);
+}
+
+namespace {
+
+// Dictionary values exported to the batches that use them
+struct Snapshot {
+  Snapshot() { values.release = nullptr; }
+  ~Snapshot() {
+    if (values.release) {
+      ArrowArrayRelease(&values);
+    }
+  }
+
+  struct ArrowArray values;
+};
+
+void ReleaseSnapshot(struct ArrowArray *array) {
+  delete static_cast<std::shared_ptr<Snapshot> *>(array->private_data);
+  array->release = nullptr;
+}
+
+// Export dictionary values without copying; the array keeps them alive
+void ExportSnapshot(const std::shared_ptr<Snapshot> &snapshot,
+                    struct ArrowArray *out) {
+  const struct ArrowArray &values = snapshot->values;
+  out->length = values.length;
+  out->null_count = 0;
+  out->offset = 0;
+  out->n_buffers = values.n_buffers;
+  out->n_children = 0;
+  out->buffers = values.buffers;
+  out->children = nullptr;
+  out->dictionary = nullptr;
+  out->release = ReleaseSnapshot;
+  out->private_data = new std::shared_ptr<Snapshot>(snapshot);
+}
+
+// Bytes of value i of a string or large string array
+std::string_view ValueAt(const struct ArrowArray *array, bool large,
+                         int64_t i) {
+  int64_t begin;
+  int64_t end;
+  if (large) {
+    auto offsets = static_cast<const int64_t *>(array->buffers[1]);
+    begin = offsets[array->offset + i];
+    end = offsets[array->offset + i + 1];
+  } else {
+    auto offsets = static_cast<const int32_t *>(array->buffers[1]);
+    begin = offsets[array->offset + i];
+    end = offsets[array->offset + i + 1];
+  }
+  auto data = static_cast<const char *>(array->buffers[2]);
+  return std::string_view(data ? data + begin : "", end - begin);
+}
+
+} // namespace
+
+ArrowErrorCode EncodeStringSchema(struct ArrowSchema *field) {
+  struct ArrowSchemaView view;
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaViewInit(&view, field, nullptr));
+  if (field->dictionary || (view.type != NANOARROW_TYPE_STRING &&
+                            view.type != NANOARROW_TYPE_LARGE_STRING)) {
+    return NANOARROW_OK;
+  }
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaAllocateDictionary(field));
+  ArrowSchemaInit(field->dictionary);
+  NANOARROW_RETURN_NOT_OK(ArrowSchemaSetType(field->dictionary, view.type));
+  return ArrowSchemaSetType(field, NANOARROW_TYPE_INT32);
+}
+
+struct CubeStringDictionaries::Column {
+  std::mutex mutex;
+  bool large = false;
+  bool interning = true; // Cleared once interning the column does not pay
+  int64_t rows = 0;      // Rows interned so far
+
+  // Values in order of their indices
+  std::string data;
+  std::vector<int64_t> offsets{0};
+  std::vector<uint64_t> hashes;
+  // Open-addressing table with linear probing: the upper half of a slot is
+  // the upper half of the value's hash, the lower half its index plus one
+  // (0 = empty). Kept at most half full.
+  std::vector<uint64_t> slots;
+
+  // Dictionary of the last batch interned, shared with the next one if it
+  // adds no values
+  std::shared_ptr<Snapshot> snapshot;
+
+  int64_t size() const { return static_cast<int64_t>(hashes.size()); }
+
+  void Place(int64_t index) {
+    uint64_t hash = hashes[index];
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = (hash & 0xffffffff00000000ULL) |
+                  static_cast<uint64_t>(index + 1);
+  }
+
+  void Grow() {
+    slots.assign(slots.empty() ? 1024 : slots.size() * 2, 0);
+    for (int64_t i = 0; i < size(); i++) {
+      Place(i);
+    }
+  }
+
+  // Index of value, added if new; -1 once the dictionary is full
+  int64_t Intern(std::string_view value) {
+    uint64_t hash =
+        HashValueBytes(reinterpret_cast<const uint8_t *>(value.data()),
+                       static_cast<int64_t>(value.size()));
+    uint64_t tag = hash & 0xffffffff00000000ULL;
+    if (!slots.empty()) {
+      size_t mask = slots.size() - 1;
+      for (size_t slot = hash & mask; slots[slot] != 0;
+           slot = (slot + 1) & mask) {
+        if ((slots[slot] & 0xffffffff00000000ULL) != tag) {
+          continue;
+        }
+        int64_t index = static_cast<int64_t>(slots[slot] & 0xffffffff) - 1;
+        if (std::string_view(data).substr(offsets[index],
+                                          offsets[index + 1] -
+                                              offsets[index]) == value) {
+          return index;
+        }
+      }
+    }
+    if (size() >= kMaxValues ||
+        static_cast<int64_t>(data.size() + value.size()) > kMaxBytes) {
+      return -1;
+    }
+    int64_t index = size();
+    data.append(value);
+    offsets.push_back(static_cast<int64_t>(data.size()));
+    hashes.push_back(hash);
+    if (static_cast<size_t>(size()) * 2 > slots.size()) {
+      Grow();
+    } else {
+      Place(index);
+    }
+    return index;
+  }
+
+  // Dictionary holding every value interned so far
+  ArrowErrorCode Export(struct ArrowArray *out, struct ArrowError *error) {
+    if (!snapshot || snapshot->values.length != size()) {
+      auto values = std::make_shared<Snapshot>();
+      struct ArrowArray *array = &values->values;
+      NANOARROW_RETURN_NOT_OK(ArrowArrayInitFromType(
+          array, large ? NANOARROW_TYPE_LARGE_STRING : NANOARROW_TYPE_STRING));
+      struct ArrowBuffer *offsets_buffer = ArrowArrayBuffer(array, 1);
+      if (large) {
+        NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(
+            offsets_buffer, offsets.data(), offsets.size() * sizeof(int64_t)));
+      } else {
+        NANOARROW_RETURN_NOT_OK(ArrowBufferReserve(
+            offsets_buffer, offsets.size() * sizeof(int32_t)));
+        for (int64_t offset : offsets) {
+          int32_t narrow = static_cast<int32_t>(offset);
+          ArrowBufferAppendUnsafe(offsets_buffer, &narrow, sizeof(narrow));
+        }
+      }
+      NANOARROW_RETURN_NOT_OK(ArrowBufferAppend(ArrowArrayBuffer(array, 2),
+                                                data.data(), data.size()));
+      array->length = size();
+      array->null_count = 0;
+      NANOARROW_RETURN_NOT_OK(ArrowArrayFinishBuildingDefault(array, error));
+      snapshot = std::move(values);
+    }
+    ExportSnapshot(snapshot, out);
+    return NANOARROW_OK;
+  }
+};
+
+CubeStringDictionaries::CubeStringDictionaries() = default;
+CubeStringDictionaries::~CubeStringDictionaries() = default;
+
+ArrowErrorCode CubeStringDictionaries::Encode(int column, int arrow_type,
+                                              struct ArrowArray *array,
+                                              struct ArrowError *error) {
+  bool large = arrow_type == NANOARROW_TYPE_LARGE_STRING;
+  if (!large && arrow_type != NANOARROW_TYPE_STRING) {
+    ArrowErrorSet(error, "Cannot dictionary encode type %d", arrow_type);
+    return EINVAL;
+  }
+  Column *state;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = columns_[(int64_t(column) << 1) | (large ? 1 : 0)];
+    if (!slot) {
+      slot = std::make_unique<Column>();
+      slot->large = large;
+    }
+    state = slot.get();
+  }
+  std::lock_guard<std::mutex> lock(state->mutex);
+
+  int64_t length = array->length;
+  nanoarrow::UniqueArray indices;
+  NANOARROW_RETURN_NOT_OK(
+      ArrowArrayInitFromType(indices.get(), NANOARROW_TYPE_INT32));
+  NANOARROW_RETURN_NOT_OK(ArrowArrayStartAppending(indices.get()));
+  const uint8_t *validity = array->null_count != 0
+                                ? static_cast<const uint8_t *>(array->buffers[0])
+                                : nullptr;
+  if (validity) {
+    struct ArrowBitmap *bitmap = ArrowArrayValidityBitmap(indices.get());
+    NANOARROW_RETURN_NOT_OK(ArrowBitmapReserve(bitmap, length));
+    for (int64_t i = 0; i < length; i++) {
+      ArrowBitmapAppendUnsafe(bitmap, ArrowBitGet(validity, array->offset + i),
+                              1);
+    }
+  }
+  struct ArrowBuffer *buffer = ArrowArrayBuffer(indices.get(), 1);
+  NANOARROW_RETURN_NOT_OK(
+      ArrowBufferReserve(buffer, length * int64_t(sizeof(int32_t))));
+  auto out = reinterpret_cast<int32_t *>(buffer->data);
+
+  bool interned = state->interning;
+  for (int64_t i = 0; interned && i < length; i++) {
+    if (validity && !ArrowBitGet(validity, array->offset + i)) {
+      out[i] = 0;
+      continue;
+    }
+    int64_t index = state->Intern(ValueAt(array, large, i));
+    if (index < 0) {
+      // The values added stay; this batch and the rest go without
+      interned = false;
+      state->interning = false;
+    }
+    out[i] = static_cast<int32_t>(index);
+  }
+  if (interned) {
+    state->rows += length;
+    if (state->rows >= kMinRows && state->size() * 2 > state->rows) {
+      state->interning = false;
+    }
+  } else {
+    for (int64_t i = 0; i < length; i++) {
+      out[i] = static_cast<int32_t>(i);
+    }
+  }
+  buffer->size_bytes = length * int64_t(sizeof(int32_t));
+  indices->length = length;
+  indices->null_count = validity ? array->null_count : 0;
+  NANOARROW_RETURN_NOT_OK(ArrowArrayFinishBuildingDefault(indices.get(),
+                                                          error));
+
+  NANOARROW_RETURN_NOT_OK(ArrowArrayAllocateDictionary(indices.get()));
+  if (interned) {
+    NANOARROW_RETURN_NOT_OK(state->Export(indices->dictionary, error));
+    ArrowArrayRelease(array);
+  } else {
+    ArrowArrayMove(array, indices->dictionary);
+  }
+  ArrowArrayMove(indices.get(), array);
+  return NANOARROW_OK;
+}
+
+} // namespace adbc::cube
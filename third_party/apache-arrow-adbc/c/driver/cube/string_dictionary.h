@@ -0,0 +1,77 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <nanoarrow/nanoarrow.h>
+
+namespace adbc::cube {
+
+/// The hash values are interned by, of a value's bytes; also used to
+/// estimate distinct values (see batch_statistics.h)
+uint64_t HashValueBytes(const uint8_t *data, int64_t size);
+/// The same for a fixed-width value read as 64 bits
+uint64_t HashValueBits(uint64_t bits);
+
+/// Make a string or large string field a dictionary of int32 indices into
+/// values of that type, as CubeStringDictionaries encodes its arrays. Other
+/// fields are left as they are.
+ArrowErrorCode EncodeStringSchema(struct ArrowSchema *field);
+
+/// Dictionaries the readers of one result build for its string columns
+/// (adbc.cube.dictionary_encode), so the columns come out dictionary
+/// encoded even when the server sends plain strings. Each column's values
+/// are interned in an open-addressing hash table as batches are decoded.
+/// A value keeps its index for the rest of the result: the dictionary of a
+/// batch holds every value seen so far, and is shared, not copied, by the
+/// batches after it that add none.
+///
+/// A column whose values are mostly distinct gains nothing from this. Once
+/// more than half of its first rows are distinct, or its dictionary grows
+/// past the limits below, the column stops being interned: later batches
+/// get their own strings as the dictionary, in row order, without hashing.
+///
+/// Thread-safe; columns are encoded independently of each other.
+class CubeStringDictionaries {
+public:
+  /// Most distinct values and value bytes of one column's dictionary
+  static constexpr int64_t kMaxValues = int64_t(1) << 20;
+  static constexpr int64_t kMaxBytes = int64_t(64) << 20;
+  /// Rows of a column seen before its cardinality is judged
+  static constexpr int64_t kMinRows = 1024;
+
+  CubeStringDictionaries();
+  ~CubeStringDictionaries();
+
+  /// Replace array, a string or large string array of column, by its
+  /// int32 indices with the dictionary attached
+  ArrowErrorCode Encode(int column, int arrow_type, struct ArrowArray *array,
+                        struct ArrowError *error);
+
+private:
+  struct Column;
+
+  std::mutex mutex_; // Guards columns_, not the columns themselves
+  std::map<int64_t, std::unique_ptr<Column>> columns_;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,511 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/text_parsers.h"
+
+#include <cfloat>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <system_error>
+
+namespace adbc::cube {
+
+namespace {
+
+constexpr int64_t kMicrosPerSecond = 1000000;
+constexpr int64_t kMicrosPerDay = 86400 * kMicrosPerSecond;
+// Timestamps further from the epoch would overflow int64 microseconds
+constexpr int64_t kMaxTimestampDays =
+    std::numeric_limits<int64_t>::max() / kMicrosPerDay - 1;
+
+// Powers of ten a double holds exactly
+constexpr double kExactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Eight bytes of text, the first in the lowest byte whatever the host order
+uint64_t Load8(const char *data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+// Whether all eight bytes are ASCII digits: the high nibble of each is 3,
+// and adding 6 does not carry into it
+bool IsEightDigits(uint64_t value) {
+  return ((value & 0xF0F0F0F0F0F0F0F0) |
+          (((value + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+         0x3333333333333333;
+}
+
+// Value of eight ASCII digits, the first most significant: digits are
+// combined in pairs, then the pairs in two multiplications
+uint32_t ParseEightDigits(uint64_t value) {
+  constexpr uint64_t kMask = 0x000000FF000000FF;
+  constexpr uint64_t kMul1 = 100 + (1000000ULL << 32);
+  constexpr uint64_t kMul2 = 1 + (10000ULL << 32);
+  value -= 0x3030303030303030;
+  value = (value * 10) + (value >> 8);
+  value = (((value & kMask) * kMul1) + (((value >> 16) & kMask) * kMul2)) >> 32;
+  return static_cast<uint32_t>(value);
+}
+
+unsigned DigitValue(char c) {
+  return static_cast<unsigned>(static_cast<unsigned char>(c)) - '0';
+}
+
+// Two digits at data, -1 if either is not a digit
+int TwoDigits(const char *data) {
+  unsigned tens = DigitValue(data[0]);
+  unsigned ones = DigitValue(data[1]);
+  return tens <= 9 && ones <= 9 ? static_cast<int>(tens * 10 + ones) : -1;
+}
+
+// Read a run of digits at data[*pos, length) into *value; false if there
+// is none or its value exceeds max
+bool ReadNumber(const char *data, size_t length, size_t *pos, uint64_t max,
+                uint64_t *value) {
+  size_t i = *pos;
+  uint64_t result = 0;
+  for (; i + 8 <= length && IsEightDigits(Load8(data + i)); i += 8) {
+    if (result > max / 100000000) {
+      return false;
+    }
+    result = result * 100000000 + ParseEightDigits(Load8(data + i));
+  }
+  for (; i < length && DigitValue(data[i]) <= 9; i++) {
+    if (result > max / 10) {
+      return false;
+    }
+    result = result * 10 + DigitValue(data[i]);
+  }
+  if (i == *pos || result > max) {
+    return false;
+  }
+  *pos = i;
+  *value = result;
+  return true;
+}
+
+bool Matches(const char *data, size_t length, const char *word) {
+  size_t n = std::strlen(word);
+  return length == n && std::memcmp(data, word, n) == 0;
+}
+
+bool IsLeapYear(int64_t year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+
+unsigned DaysInMonth(int64_t year, unsigned month) {
+  static const unsigned kDays[] = {31, 28, 31, 30, 31, 30,
+                                   31, 31, 30, 31, 30, 31};
+  return month == 2 && IsLeapYear(year) ? 29 : kDays[month - 1];
+}
+
+// Days from 1970-01-01 to a proleptic Gregorian date (Howard Hinnant's
+// days_from_civil)
+int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  auto year_of_era = static_cast<unsigned>(year - era * 400);
+  unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 +
+                         day - 1;
+  unsigned day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + static_cast<int64_t>(day_of_era) - 719468;
+}
+
+struct CivilDate {
+  int64_t year;
+  unsigned month;
+  unsigned day;
+};
+
+// Read YYYY-MM-DD at data[*pos]; the year has four digits or more. The day
+// is checked against the month by ReadEra, once the year is known.
+bool ReadDate(const char *data, size_t length, size_t *pos, CivilDate *date) {
+  size_t i = *pos;
+  uint64_t year;
+  if (!ReadNumber(data, length, &i, 99999999, &year) || i - *pos < 4 ||
+      length - i < 6 || data[i] != '-' || data[i + 3] != '-') {
+    return false;
+  }
+  int month = TwoDigits(data + i + 1);
+  int day = TwoDigits(data + i + 4);
+  if (month < 1 || month > 12 || day < 1 || day > 31) {
+    return false;
+  }
+  *date = {static_cast<int64_t>(year), static_cast<unsigned>(month),
+           static_cast<unsigned>(day)};
+  *pos = i + 6;
+  return true;
+}
+
+// Read the fraction of a second after a '.' at data[*pos], if any, as
+// microseconds
+bool ReadFraction(const char *data, size_t length, size_t *pos,
+                  int64_t *micros) {
+  size_t i = *pos;
+  *micros = 0;
+  if (i == length || data[i] != '.') {
+    return true;
+  }
+  i++;
+  int64_t scale = kMicrosPerSecond;
+  for (; i < length && DigitValue(data[i]) <= 9; i++) {
+    scale /= 10;
+    *micros += DigitValue(data[i]) * scale;
+  }
+  if (i == *pos + 1 || i - *pos > 7) {
+    return false;
+  }
+  *pos = i;
+  return true;
+}
+
+// Read HH:MM:SS[.ffffff] at data[*pos]
+bool ReadTime(const char *data, size_t length, size_t *pos, int64_t *micros) {
+  size_t i = *pos;
+  if (length - i < 8 || data[i + 2] != ':' || data[i + 5] != ':') {
+    return false;
+  }
+  int hours = TwoDigits(data + i);
+  int minutes = TwoDigits(data + i + 3);
+  int seconds = TwoDigits(data + i + 6);
+  i += 8;
+  int64_t fraction;
+  if (hours < 0 || minutes < 0 || seconds < 0 || minutes > 59 ||
+      seconds > 59 || !ReadFraction(data, length, &i, &fraction)) {
+    return false;
+  }
+  int64_t result =
+      (hours * 3600 + minutes * 60 + seconds) * kMicrosPerSecond + fraction;
+  if (result > kMicrosPerDay) {
+    return false; // 24:00:00 is the latest time
+  }
+  *pos = i;
+  *micros = result;
+  return true;
+}
+
+// A trailing " BC" turns the year into the astronomical year 1 - year;
+// false if anything else follows or the day is past the end of the month
+bool ReadEra(const char *data, size_t length, size_t *pos, CivilDate *date) {
+  if (Matches(data + *pos, length - *pos, " BC")) {
+    if (date->year < 1) {
+      return false;
+    }
+    date->year = 1 - date->year;
+    *pos = length;
+  }
+  return *pos == length && date->day <= DaysInMonth(date->year, date->month);
+}
+
+} // namespace
+
+bool ParseInt64Text(const char *data, size_t length, int64_t *out) {
+  size_t i = 0;
+  bool negative = false;
+  if (length > 0 && (data[0] == '-' || data[0] == '+')) {
+    negative = data[0] == '-';
+    i++;
+  }
+  uint64_t max = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) +
+                 (negative ? 1 : 0);
+  uint64_t value;
+  if (!ReadNumber(data, length, &i, max, &value) || i != length) {
+    return false;
+  }
+  *out = negative ? static_cast<int64_t>(0 - value)
+                  : static_cast<int64_t>(value);
+  return true;
+}
+
+bool ParseDoubleText(const char *data, size_t length, double *out) {
+  size_t i = 0;
+  bool negative = false;
+  if (length > 0 && (data[0] == '-' || data[0] == '+')) {
+    negative = data[0] == '-';
+    i++;
+  }
+  if (Matches(data + i, length - i, "Infinity")) {
+    *out = negative ? -std::numeric_limits<double>::infinity()
+                    : std::numeric_limits<double>::infinity();
+    return true;
+  }
+  if (Matches(data, length, "NaN")) {
+    *out = std::numeric_limits<double>::quiet_NaN();
+    return true;
+  }
+
+  // Up to 19 significant digits are kept in mantissa; the exponent counts
+  // the digits after the point and those dropped before it
+  size_t number = i;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int64_t exponent = 0;
+  bool truncated = false;
+  auto read_digits = [&](bool fraction) {
+    size_t begin = i;
+    for (; i + 8 <= length && digits + 8 <= 19 &&
+           IsEightDigits(Load8(data + i));
+         i += 8) {
+      mantissa = mantissa * 100000000 + ParseEightDigits(Load8(data + i));
+      digits = mantissa == 0 ? 0 : digits + 8;
+      exponent -= fraction ? 8 : 0;
+    }
+    for (; i < length && DigitValue(data[i]) <= 9; i++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + DigitValue(data[i]);
+        digits += mantissa != 0;
+        exponent -= fraction;
+      } else {
+        truncated = true;
+        exponent += !fraction;
+      }
+    }
+    return i - begin;
+  };
+  size_t n_digits = read_digits(false);
+  if (i < length && data[i] == '.') {
+    i++;
+    n_digits += read_digits(true);
+  }
+  if (n_digits == 0) {
+    return false;
+  }
+  if (i < length && (data[i] == 'e' || data[i] == 'E')) {
+    i++;
+    bool negative_exponent = false;
+    if (i < length && (data[i] == '-' || data[i] == '+')) {
+      negative_exponent = data[i] == '-';
+      i++;
+    }
+    uint64_t value;
+    if (!ReadNumber(data, length, &i, 100000, &value)) {
+      return false;
+    }
+    exponent += negative_exponent ? -static_cast<int64_t>(value)
+                                  : static_cast<int64_t>(value);
+  }
+  if (i != length) {
+    return false;
+  }
+
+  // Both operands are exact, so the one rounding gives the nearest double
+  // (with double arithmetic not carried out in extended precision)
+  if (FLT_EVAL_METHOD == 0 && !truncated && mantissa <= (uint64_t(1) << 53) &&
+      exponent >= -22 && exponent <= 22) {
+    double value = static_cast<double>(mantissa);
+    value = exponent < 0 ? value / kExactPowersOf10[-exponent]
+                         : value * kExactPowersOf10[exponent];
+    *out = negative ? -value : value;
+    return true;
+  }
+
+  double value;
+#if defined(__cpp_lib_to_chars)
+  auto result = std::from_chars(data + number, data + length, value);
+  if (result.ec != std::errc() || result.ptr != data + length) {
+    return false;
+  }
+#else
+  // strtod needs a terminated string
+  std::string text(data + number, length - number);
+  char *end;
+  value = std::strtod(text.c_str(), &end);
+  if (end != text.c_str() + text.size()) {
+    return false;
+  }
+#endif
+  *out = negative ? -value : value;
+  return true;
+}
+
+bool ParseDateText(const char *data, size_t length, int32_t *out) {
+  if (Matches(data, length, "infinity")) {
+    *out = std::numeric_limits<int32_t>::max();
+    return true;
+  }
+  if (Matches(data, length, "-infinity")) {
+    *out = std::numeric_limits<int32_t>::min();
+    return true;
+  }
+  size_t i = 0;
+  CivilDate date;
+  if (!ReadDate(data, length, &i, &date) ||
+      !ReadEra(data, length, &i, &date)) {
+    return false;
+  }
+  int64_t days = DaysFromCivil(date.year, date.month, date.day);
+  if (days <= std::numeric_limits<int32_t>::min() ||
+      days >= std::numeric_limits<int32_t>::max()) {
+    return false;
+  }
+  *out = static_cast<int32_t>(days);
+  return true;
+}
+
+bool ParseTimeText(const char *data, size_t length, int64_t *out) {
+  size_t i = 0;
+  return ReadTime(data, length, &i, out) && i == length;
+}
+
+bool ParseTimestampText(const char *data, size_t length, int64_t *out) {
+  if (Matches(data, length, "infinity")) {
+    *out = std::numeric_limits<int64_t>::max();
+    return true;
+  }
+  if (Matches(data, length, "-infinity")) {
+    *out = std::numeric_limits<int64_t>::min();
+    return true;
+  }
+  size_t i = 0;
+  CivilDate date;
+  int64_t time;
+  if (!ReadDate(data, length, &i, &date) || i == length || data[i] != ' ') {
+    return false;
+  }
+  i++;
+  if (!ReadTime(data, length, &i, &time)) {
+    return false;
+  }
+
+  // UTC offset: +HH, +HH:MM or +HH:MM:SS
+  int64_t offset = 0;
+  if (i < length && (data[i] == '+' || data[i] == '-')) {
+    int64_t sign = data[i] == '-' ? -1 : 1;
+    i++;
+    int64_t seconds = 0;
+    for (int64_t unit : {3600, 60, 1}) {
+      if (length - i < 2) {
+        return false;
+      }
+      int part = TwoDigits(data + i);
+      if (part < 0) {
+        return false;
+      }
+      seconds += part * unit;
+      i += 2;
+      if (unit == 1 || i == length || data[i] != ':') {
+        break;
+      }
+      i++;
+    }
+    offset = sign * seconds * kMicrosPerSecond;
+  }
+  if (!ReadEra(data, length, &i, &date)) {
+    return false;
+  }
+
+  int64_t days = DaysFromCivil(date.year, date.month, date.day);
+  if (days > kMaxTimestampDays || days < -kMaxTimestampDays) {
+    return false;
+  }
+  *out = days * kMicrosPerDay + time - offset;
+  return true;
+}
+
+bool ParseIntervalText(const char *data, size_t length, int32_t *months,
+                       int32_t *days, int64_t *micros) {
+  int64_t total_months = 0;
+  int64_t total_days = 0;
+  int64_t total_micros = 0;
+  bool has_time = false;
+  size_t i = 0;
+  while (i < length) {
+    if (i > 0) {
+      if (data[i] != ' ') {
+        return false;
+      }
+      i++;
+    }
+    int64_t sign = 1;
+    if (i < length && (data[i] == '-' || data[i] == '+')) {
+      sign = data[i] == '-' ? -1 : 1;
+      i++;
+    }
+    uint64_t number;
+    // Hours may take up to the whole int64 microsecond range
+    if (!ReadNumber(data, length, &i, 2562047788, &number)) {
+      return false;
+    }
+    auto value = static_cast<int64_t>(number);
+
+    if (i < length && data[i] == ':') {
+      // The time part comes last
+      if (has_time || length - i < 6 || data[i + 3] != ':') {
+        return false;
+      }
+      int minutes = TwoDigits(data + i + 1);
+      int seconds = TwoDigits(data + i + 4);
+      i += 6;
+      int64_t fraction;
+      if (minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59 ||
+          !ReadFraction(data, length, &i, &fraction) || i != length) {
+        return false;
+      }
+      total_micros =
+          sign * ((value * 3600 + minutes * 60 + seconds) * kMicrosPerSecond +
+                  fraction);
+      has_time = true;
+      continue;
+    }
+
+    if (i == length || data[i] != ' ' ||
+        value > std::numeric_limits<int32_t>::max()) {
+      return false;
+    }
+    i++;
+    size_t unit = i;
+    while (i < length && data[i] != ' ') {
+      i++;
+    }
+    const char *word = data + unit;
+    size_t word_length = i - unit;
+    if (Matches(word, word_length, "year") ||
+        Matches(word, word_length, "years")) {
+      total_months += sign * value * 12;
+    } else if (Matches(word, word_length, "mon") ||
+               Matches(word, word_length, "mons")) {
+      total_months += sign * value;
+    } else if (Matches(word, word_length, "day") ||
+               Matches(word, word_length, "days")) {
+      total_days += sign * value;
+    } else {
+      return false;
+    }
+  }
+  if (i == 0 || total_months < std::numeric_limits<int32_t>::min() ||
+      total_months > std::numeric_limits<int32_t>::max() ||
+      total_days < std::numeric_limits<int32_t>::min() ||
+      total_days > std::numeric_limits<int32_t>::max()) {
+    return false;
+  }
+  *months = static_cast<int32_t>(total_months);
+  *days = static_cast<int32_t>(total_days);
+  *micros = total_micros;
+  return true;
+}
+
+} // namespace adbc::cube
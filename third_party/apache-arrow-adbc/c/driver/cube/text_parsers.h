@@ -0,0 +1,57 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace adbc::cube {
+
+/// Parsers for the text format of PostgreSQL values, for result columns
+/// the server sends as text although binary results were asked for. Each
+/// reads a whole field of the given length (no terminating NUL needed),
+/// accepts what PostgreSQL prints with its default DateStyle and
+/// IntervalStyle, and returns false on anything else. Runs of digits are
+/// read eight at a time from one 64-bit load, and dates and times are
+/// read at fixed positions rather than scanned.
+
+/// Decimal integer with an optional sign
+bool ParseInt64Text(const char *data, size_t length, int64_t *out);
+
+/// Decimal floating point, NaN, Infinity or -Infinity. Values with at most
+/// 19 significant digits and a small exponent are computed exactly without
+/// strtod, which the others fall back to.
+bool ParseDoubleText(const char *data, size_t length, double *out);
+
+/// YYYY-MM-DD [BC] as days since 1970-01-01; infinity and -infinity become
+/// INT32_MAX and INT32_MIN
+bool ParseDateText(const char *data, size_t length, int32_t *out);
+
+/// HH:MM:SS[.ffffff] as microseconds since midnight
+bool ParseTimeText(const char *data, size_t length, int64_t *out);
+
+/// YYYY-MM-DD HH:MM:SS[.ffffff][+-HH[:MM[:SS]]] [BC] as microseconds since
+/// 1970-01-01 UTC, the UTC offset (printed for timestamptz) applied;
+/// infinity and -infinity become INT64_MAX and INT64_MIN
+bool ParseTimestampText(const char *data, size_t length, int64_t *out);
+
+/// [N year[s]] [N mon[s]] [N day[s]] [[+-]HH:MM:SS[.ffffff]]
+bool ParseIntervalText(const char *data, size_t length, int32_t *months,
+                       int32_t *days, int64_t *micros);
+
+} // namespace adbc::cube
@@ -0,0 +1,207 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// Edge cases of the parsers for PostgreSQL's text format: limits of each
+// type, BC dates, UTC offsets, special values, and malformed fields. The
+// expected values were worked out independently of the parsers.
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "driver/cube/text_parsers.h"
+
+namespace adbc::cube {
+
+namespace {
+
+template <typename T> struct TextCase {
+  std::string_view text;
+  std::optional<T> value; // nullopt if the text must be rejected
+};
+
+// The text copied without a terminating NUL, so that a parser reading past
+// the field is caught by sanitizers
+template <typename T, typename Parse>
+void ExpectParses(const TextCase<T> &test, Parse parse) {
+  SCOPED_TRACE(std::string(test.text));
+  std::unique_ptr<char[]> field(new char[test.text.size() + 1]);
+  test.text.copy(field.get(), test.text.size());
+  T value{};
+  bool parsed = parse(field.get(), test.text.size(), &value);
+  ASSERT_EQ(parsed, test.value.has_value());
+  if (parsed) {
+    EXPECT_EQ(value, *test.value);
+  }
+}
+
+constexpr int64_t kMicrosPerDay = int64_t{86400} * 1000000;
+
+} // namespace
+
+TEST(TextParsersTest, Int64) {
+  const TextCase<int64_t> cases[] = {
+      {"0", 0},
+      {"-0", 0},
+      {"+5", 5},
+      {"123456789012345678", 123456789012345678},
+      {"00000000000000000001", 1},
+      {"9223372036854775807", std::numeric_limits<int64_t>::max()},
+      {"-9223372036854775808", std::numeric_limits<int64_t>::min()},
+      {"9223372036854775808", std::nullopt},
+      {"-9223372036854775809", std::nullopt},
+      {"", std::nullopt},
+      {"-", std::nullopt},
+      {"12a", std::nullopt},
+      {" 1", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    ExpectParses(test, ParseInt64Text);
+  }
+}
+
+TEST(TextParsersTest, Double) {
+  const TextCase<double> cases[] = {
+      {"0", 0.0},
+      {"1.5", 1.5},
+      {"-2.25e3", -2250.0},
+      {".5", 0.5},
+      {"1.", 1.0},
+      {"0.1", 0.1},
+      {"123456789.123456789", 123456789.123456789},
+      {"3.14159265358979323846", 3.14159265358979323846},
+      {"1.7976931348623157e308", std::numeric_limits<double>::max()},
+      {"4.9e-324", std::numeric_limits<double>::denorm_min()},
+      {"Infinity", std::numeric_limits<double>::infinity()},
+      {"-Infinity", -std::numeric_limits<double>::infinity()},
+      {"1e400", std::nullopt},
+      {"1e", std::nullopt},
+      {"abc", std::nullopt},
+      {"", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    ExpectParses(test, ParseDoubleText);
+  }
+  double value = 0;
+  ASSERT_TRUE(ParseDoubleText("NaN", 3, &value));
+  EXPECT_TRUE(std::isnan(value));
+}
+
+TEST(TextParsersTest, Date) {
+  const TextCase<int32_t> cases[] = {
+      {"1970-01-01", 0},
+      {"1969-12-31", -1},
+      {"2000-01-01", 10957},
+      {"2024-02-29", 19782},
+      {"0001-01-01", -719162},
+      // Year 1 BC is year 0, a leap year
+      {"0001-12-31 BC", -719163},
+      {"0001-01-01 BC", -719528},
+      {"12345-01-01", 3789391},
+      {"infinity", std::numeric_limits<int32_t>::max()},
+      {"-infinity", std::numeric_limits<int32_t>::min()},
+      {"2023-02-29", std::nullopt},
+      {"2024-13-01", std::nullopt},
+      {"2024-1-01", std::nullopt},
+      {"2024-01-01x", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    ExpectParses(test, ParseDateText);
+  }
+}
+
+TEST(TextParsersTest, Time) {
+  const TextCase<int64_t> cases[] = {
+      {"00:00:00", 0},
+      {"12:34:56.5", 45296500000},
+      {"23:59:59.999999", kMicrosPerDay - 1},
+      {"24:00:00", kMicrosPerDay},
+      {"25:00:00", std::nullopt},
+      {"12:60:00", std::nullopt},
+      {"12:34", std::nullopt},
+      {"12:34:56.1234567", std::nullopt},
+      {"1:02:03", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    ExpectParses(test, ParseTimeText);
+  }
+}
+
+TEST(TextParsersTest, Timestamp) {
+  const TextCase<int64_t> cases[] = {
+      {"1970-01-01 00:00:00", 0},
+      {"1969-12-31 23:59:59.5", -500000},
+      {"2000-01-01 00:00:00.000001", 946684800000001},
+      // Offsets as timestamptz prints them, to the hour, minute or second
+      {"2024-06-01 12:00:00+02", 1717236000000000},
+      {"2024-06-01 12:00:00-05:30", 1717263000000000},
+      {"2024-06-01 12:00:00+05:30:15", 1717223385000000},
+      {"0001-01-01 00:00:00 BC", -719528 * kMicrosPerDay},
+      {"infinity", std::numeric_limits<int64_t>::max()},
+      {"-infinity", std::numeric_limits<int64_t>::min()},
+      {"2024-06-01T12:00:00", std::nullopt},
+      {"2024-06-01 12:00:00+2", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    ExpectParses(test, ParseTimestampText);
+  }
+}
+
+TEST(TextParsersTest, Interval) {
+  struct Interval {
+    int32_t months;
+    int32_t days;
+    int64_t micros;
+  };
+  const TextCase<Interval> cases[] = {
+      {"00:00:00", Interval{0, 0, 0}},
+      {"3 days", Interval{0, 3, 0}},
+      {"2 mons", Interval{2, 0, 0}},
+      {"1 year 2 mons 3 days 04:05:06.5", Interval{14, 3, 14706500000}},
+      {"-1 years -2 mons", Interval{-14, 0, 0}},
+      {"1 day -01:00:00", Interval{0, 1, -3600000000}},
+      {"-00:00:01.25", Interval{0, 0, -1250000}},
+      // Months past INT32_MAX
+      {"178956970 years 8 mons", std::nullopt},
+      {"1 yr", std::nullopt},
+      {"1 year 2", std::nullopt},
+      {"", std::nullopt},
+  };
+  for (const auto &test : cases) {
+    SCOPED_TRACE(std::string(test.text));
+    std::unique_ptr<char[]> field(new char[test.text.size() + 1]);
+    test.text.copy(field.get(), test.text.size());
+    Interval value{};
+    bool parsed = ParseIntervalText(field.get(), test.text.size(),
+                                    &value.months, &value.days,
+                                    &value.micros);
+    ASSERT_EQ(parsed, test.value.has_value());
+    if (parsed) {
+      EXPECT_EQ(value.months, test.value->months);
+      EXPECT_EQ(value.days, test.value->days);
+      EXPECT_EQ(value.micros, test.value->micros);
+    }
+  }
+}
+
+} // namespace adbc::cube
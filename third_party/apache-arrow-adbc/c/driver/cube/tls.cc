@@ -0,0 +1,424 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/tls.h"
+
+#if defined(CUBE_WITH_OPENSSL)
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+
+namespace adbc::cube {
+
+struct CubeTlsContext::Impl {
+  SSL_CTX *ctx = nullptr;
+  CubeTlsOptions options;
+  std::atomic<int64_t> resumptions{0};
+
+  // Latest session per "host:port"
+  std::mutex mutex;
+  std::unordered_map<std::string, SSL_SESSION *> sessions;
+
+  ~Impl() {
+    for (auto &entry : sessions) {
+      SSL_SESSION_free(entry.second);
+    }
+    SSL_CTX_free(ctx);
+  }
+
+  SSL_SESSION *GetSession(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sessions.find(key);
+    if (it == sessions.end()) {
+      return nullptr;
+    }
+    SSL_SESSION_up_ref(it->second);
+    return it->second;
+  }
+
+  void PutSession(const std::string &key, SSL_SESSION *session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &slot = sessions[key];
+    if (slot) {
+      SSL_SESSION_free(slot);
+    }
+    slot = session;
+  }
+};
+
+namespace {
+
+// Index of the session key ("host:port") stored on each SSL
+int SessionKeyIndex() {
+  static const int index =
+      SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+// Called by OpenSSL when the server hands out a session, which for TLS 1.3
+// is after the handshake, while the connection is being read
+int OnNewSession(SSL *ssl, SSL_SESSION *session) {
+  auto *impl = static_cast<CubeTlsContext::Impl *>(
+      SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  auto *key = static_cast<const std::string *>(
+      SSL_get_ex_data(ssl, SessionKeyIndex()));
+  if (!impl || !key || !SSL_SESSION_is_resumable(session)) {
+    return 0;
+  }
+  impl->PutSession(*key, session);
+  return 1; // The cache keeps the reference
+}
+
+// Text of the oldest queued OpenSSL error, or fallback
+std::string TakeOpenSslError(const char *fallback) {
+  unsigned long code = ERR_get_error();
+  ERR_clear_error();
+  if (code == 0) {
+    return fallback;
+  }
+  char buffer[256];
+  ERR_error_string_n(code, buffer, sizeof(buffer));
+  return buffer;
+}
+
+// Wait for events on fd until deadline; false once it has passed
+bool WaitFor(int fd, short events,
+             std::chrono::steady_clock::time_point deadline) {
+  using Clock = std::chrono::steady_clock;
+  while (true) {
+    int timeout_ms = -1;
+    if (deadline != Clock::time_point::max()) {
+      auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline -
+                                                               Clock::now());
+      if (wait.count() <= 0) {
+        return false;
+      }
+      timeout_ms = static_cast<int>(std::min<int64_t>(wait.count(), INT32_MAX));
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready != 0 && !(ready < 0 && errno == EINTR)) {
+      // Errors and hang-ups are reported by the next OpenSSL call
+      return true;
+    }
+  }
+}
+
+// The socket is left non-blocking and OpenSSL's wants are waited on here,
+// so writes and ReadAvailable never block and the lock is not held while
+// waiting. The lock serializes OpenSSL calls, since Cancel writes from
+// another thread while a result is read.
+class TlsTransport final : public CubeTransport {
+public:
+  TlsTransport(int fd, SSL *ssl, std::string session_key)
+      : CubeTransport(fd), ssl_(ssl), session_key_(std::move(session_key)) {
+    SSL_set_ex_data(ssl_, SessionKeyIndex(), &session_key_);
+  }
+
+  ~TlsTransport() override {
+    SSL_set_ex_data(ssl_, SessionKeyIndex(), nullptr);
+    // Freeing a connection that was not shut down marks its session
+    // unresumable; the socket closes without a close_notify either way
+    SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    SSL_free(ssl_);
+  }
+
+  const char *name() const override { return ktls_ ? "tls (ktls)" : "tls"; }
+
+  ssize_t Read(uint8_t *buffer, size_t length) override {
+    while (true) {
+      short wait = 0;
+      ssize_t n = Call(
+          [&](size_t *done) { return SSL_read_ex(ssl_, buffer, length, done); },
+          &wait);
+      if (wait == 0) {
+        return n;
+      }
+      WaitFor(fd_, wait, std::chrono::steady_clock::time_point::max());
+    }
+  }
+
+  ssize_t ReadAvailable(uint8_t *buffer, size_t length) override {
+    short wait = 0;
+    ssize_t n = Call(
+        [&](size_t *done) { return SSL_read_ex(ssl_, buffer, length, done); },
+        &wait);
+    if (wait != 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    return n;
+  }
+
+  ssize_t Write(const struct iovec *iov, int count) override {
+    // One record per part; the caller loops over the rest
+    while (count > 0 && iov->iov_len == 0) {
+      iov++;
+      count--;
+    }
+    if (count == 0) {
+      return 0;
+    }
+    short wait = 0;
+    ssize_t n = Call(
+        [&](size_t *done) {
+          return SSL_write_ex(ssl_, iov->iov_base, iov->iov_len, done);
+        },
+        &wait);
+    if (wait != 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+    return n;
+  }
+
+  ssize_t WriteWithFd(const struct iovec *, int, int) override {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+
+  bool HasBuffered() const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return SSL_pending(ssl_) > 0;
+  }
+
+  bool Handshake(std::chrono::steady_clock::time_point deadline,
+                 std::string *error, bool *timed_out) {
+    while (true) {
+      ERR_clear_error();
+      int result = SSL_connect(ssl_);
+      if (result == 1) {
+#if defined(BIO_get_ktls_send)
+        ktls_ = BIO_get_ktls_send(SSL_get_wbio(ssl_)) != 0;
+#endif
+        return true;
+      }
+      int code = SSL_get_error(ssl_, result);
+      short wait = code == SSL_ERROR_WANT_READ    ? POLLIN
+                   : code == SSL_ERROR_WANT_WRITE ? POLLOUT
+                                                  : 0;
+      if (wait == 0) {
+        long verify = SSL_get_verify_result(ssl_);
+        if (verify != X509_V_OK) {
+          *error = std::string("certificate verification failed: ") +
+                   X509_verify_cert_error_string(verify);
+        } else if (code == SSL_ERROR_SYSCALL && errno != 0) {
+          *error = std::strerror(errno);
+        } else {
+          *error = TakeOpenSslError("handshake failed");
+        }
+        return false;
+      }
+      if (!WaitFor(fd_, wait, deadline)) {
+        *error = "timed out";
+        *timed_out = true;
+        return false;
+      }
+    }
+  }
+
+private:
+  // Run an OpenSSL read or write under the lock. Returns the bytes done,
+  // 0 at the end of the stream or -1 with errno; sets wait to the events
+  // to poll for when OpenSSL needs the socket first.
+  template <typename Op> ssize_t Call(Op op, short *wait) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ERR_clear_error();
+    size_t done = 0;
+    int result = op(&done);
+    if (result == 1) {
+      return static_cast<ssize_t>(done);
+    }
+    switch (SSL_get_error(ssl_, result)) {
+    case SSL_ERROR_WANT_READ:
+      *wait = POLLIN;
+      return -1;
+    case SSL_ERROR_WANT_WRITE:
+      *wait = POLLOUT;
+      return -1;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0; // close_notify
+    case SSL_ERROR_SYSCALL:
+      if (errno == 0) {
+        return 0; // EOF without close_notify
+      }
+      return -1;
+    default:
+      ERR_clear_error();
+      errno = EPROTO;
+      return -1;
+    }
+  }
+
+  SSL *ssl_;
+  std::string session_key_;
+  bool ktls_ = false;
+  mutable std::mutex mutex_;
+};
+
+} // namespace
+
+bool TlsAvailable() { return true; }
+
+CubeTlsContext::CubeTlsContext(std::unique_ptr<Impl> impl)
+    : impl_(std::move(impl)) {}
+
+CubeTlsContext::~CubeTlsContext() = default;
+
+std::shared_ptr<CubeTlsContext>
+CubeTlsContext::Make(const CubeTlsOptions &options, std::string *error) {
+  auto impl = std::make_unique<Impl>();
+  impl->options = options;
+  impl->ctx = SSL_CTX_new(TLS_client_method());
+  if (!impl->ctx) {
+    *error = TakeOpenSslError("cannot create TLS context");
+    return nullptr;
+  }
+  SSL_CTX_set_min_proto_version(impl->ctx, TLS1_2_VERSION);
+  SSL_CTX_set_mode(impl->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#if defined(SSL_OP_ENABLE_KTLS)
+  SSL_CTX_set_options(impl->ctx, SSL_OP_ENABLE_KTLS);
+#endif
+  if (options.verify) {
+    SSL_CTX_set_verify(impl->ctx, SSL_VERIFY_PEER, nullptr);
+    int loaded =
+        options.ca_file.empty()
+            ? SSL_CTX_set_default_verify_paths(impl->ctx)
+            : SSL_CTX_load_verify_locations(impl->ctx, options.ca_file.c_str(),
+                                            nullptr);
+    if (loaded != 1) {
+      *error = "cannot load CA certificates" +
+               (options.ca_file.empty() ? "" : " from " + options.ca_file) +
+               ": " + TakeOpenSslError("unknown error");
+      return nullptr;
+    }
+  }
+  // Sessions are kept per server in Impl rather than OpenSSL's cache,
+  // which cannot look them up by host
+  SSL_CTX_set_session_cache_mode(impl->ctx, SSL_SESS_CACHE_CLIENT |
+                                                SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_sess_set_new_cb(impl->ctx, OnNewSession);
+  SSL_CTX_set_app_data(impl->ctx, impl.get());
+  return std::shared_ptr<CubeTlsContext>(new CubeTlsContext(std::move(impl)));
+}
+
+std::unique_ptr<CubeTransport>
+CubeTlsContext::Connect(int fd, const std::string &host, int port,
+                        std::chrono::steady_clock::time_point deadline,
+                        std::string *error, bool *timed_out) {
+  SSL *ssl = SSL_new(impl_->ctx);
+  if (!ssl) {
+    close(fd);
+    *error = TakeOpenSslError("cannot create TLS session");
+    return nullptr;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  SSL_set_fd(ssl, fd);
+  std::string key = host + ":" + std::to_string(port);
+  auto transport = std::make_unique<TlsTransport>(fd, ssl, key);
+
+  const std::string &name =
+      impl_->options.server_name.empty() ? host : impl_->options.server_name;
+  // A unix:// socket path names no server; only the chain is checked then
+  bool has_name = name.find('/') == std::string::npos;
+  unsigned char address[sizeof(struct in6_addr)];
+  bool is_ip = inet_pton(AF_INET, name.c_str(), address) == 1 ||
+               inet_pton(AF_INET6, name.c_str(), address) == 1;
+  if (has_name && !is_ip) {
+    SSL_set_tlsext_host_name(ssl, name.c_str());
+  }
+  if (has_name && impl_->options.verify) {
+    X509_VERIFY_PARAM *param = SSL_get0_param(ssl);
+    if (is_ip) {
+      X509_VERIFY_PARAM_set1_ip_asc(param, name.c_str());
+    } else {
+      X509_VERIFY_PARAM_set1_host(param, name.c_str(), 0);
+    }
+  }
+  if (SSL_SESSION *session = impl_->GetSession(key)) {
+    SSL_set_session(ssl, session);
+    SSL_SESSION_free(session);
+  }
+
+  if (!transport->Handshake(deadline, error, timed_out)) {
+    return nullptr;
+  }
+  if (SSL_session_reused(ssl)) {
+    impl_->resumptions.fetch_add(1, std::memory_order_relaxed);
+  }
+  return transport;
+}
+
+int64_t CubeTlsContext::resumptions() const {
+  return impl_->resumptions.load(std::memory_order_relaxed);
+}
+
+} // namespace adbc::cube
+
+#else // !CUBE_WITH_OPENSSL
+
+#include <unistd.h>
+
+namespace adbc::cube {
+
+struct CubeTlsContext::Impl {};
+
+bool TlsAvailable() { return false; }
+
+CubeTlsContext::CubeTlsContext(std::unique_ptr<Impl> impl)
+    : impl_(std::move(impl)) {}
+
+CubeTlsContext::~CubeTlsContext() = default;
+
+std::shared_ptr<CubeTlsContext> CubeTlsContext::Make(const CubeTlsOptions &,
+                                                     std::string *error) {
+  *error = "driver was built without TLS support";
+  return nullptr;
+}
+
+std::unique_ptr<CubeTransport>
+CubeTlsContext::Connect(int fd, const std::string &, int,
+                        std::chrono::steady_clock::time_point,
+                        std::string *error, bool *) {
+  close(fd);
+  *error = "driver was built without TLS support";
+  return nullptr;
+}
+
+int64_t CubeTlsContext::resumptions() const { return 0; }
+
+} // namespace adbc::cube
+
+#endif
@@ -0,0 +1,75 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "transport.h"
+
+namespace adbc::cube {
+
+/// How native protocol connections check the server they talk TLS to
+struct CubeTlsOptions {
+  bool verify = true;      // Check the certificate chain and server name
+  std::string ca_file;     // PEM certificates to trust; empty = system ones
+  std::string server_name; // Name sent (SNI) and verified; empty = the host
+};
+
+/// Whether the driver was built with TLS support (OpenSSL)
+bool TlsAvailable();
+
+/// TLS settings shared by the connections of a database, and the sessions
+/// they can resume. A connection to a host:port that already completed a
+/// handshake offers the session (TLS 1.3 ticket or 1.2 session) the server
+/// gave it, so the server can skip the certificate exchange and key
+/// agreement; pooled and reconnecting sessions pay one round trip instead
+/// of a full handshake. Where the kernel and OpenSSL support it, record
+/// encryption is handed to the kernel (kTLS). Thread-safe.
+class CubeTlsContext {
+public:
+  /// @return nullptr, with the reason in error, if the options cannot be
+  ///   used (unreadable CA file, no TLS support)
+  static std::shared_ptr<CubeTlsContext> Make(const CubeTlsOptions &options,
+                                              std::string *error);
+
+  ~CubeTlsContext();
+
+  /// Run the TLS handshake over the connected socket fd, giving up at
+  /// deadline. The transport takes fd, also on failure.
+  /// @return nullptr, with the reason in error and timed_out set if the
+  ///   deadline passed, when the handshake fails
+  std::unique_ptr<CubeTransport>
+  Connect(int fd, const std::string &host, int port,
+          std::chrono::steady_clock::time_point deadline, std::string *error,
+          bool *timed_out);
+
+  /// Handshakes that resumed a cached session
+  int64_t resumptions() const;
+
+  struct Impl;
+
+private:
+  explicit CubeTlsContext(std::unique_ptr<Impl> impl);
+
+  std::unique_ptr<Impl> impl_;
+};
+
+} // namespace adbc::cube
@@ -0,0 +1,269 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/token_source.h"
+
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+#include "driver/cube/connection_pool.h"
+#include "driver/cube/fork_guard.h"
+#include "driver/cube/log.h"
+
+namespace adbc::cube {
+
+namespace {
+
+int Base64UrlValue(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  } else if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  } else if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  } else if (c == '-' || c == '+') {
+    return 62;
+  } else if (c == '_' || c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+// Unpadded base64url, as JWT segments are; false on any other character
+bool DecodeBase64Url(std::string_view text, std::string *out) {
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    if (c == '=') {
+      break;
+    }
+    int value = Base64UrlValue(c);
+    if (value < 0) {
+      return false;
+    }
+    bits = (bits << 6) | static_cast<uint32_t>(value);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out->push_back(static_cast<char>((bits >> count) & 0xff));
+    }
+  }
+  return true;
+}
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+int64_t JwtExpiresAtMs(std::string_view token) {
+  size_t first = token.find('.');
+  if (first == std::string_view::npos) {
+    return 0;
+  }
+  size_t second = token.find('.', first + 1);
+  if (second == std::string_view::npos) {
+    return 0;
+  }
+  std::string payload;
+  if (!DecodeBase64Url(token.substr(first + 1, second - first - 1),
+                       &payload)) {
+    return 0;
+  }
+  // The payload is a flat JSON object; its "exp" is in seconds
+  size_t pos = payload.find("\"exp\"");
+  if (pos == std::string::npos) {
+    return 0;
+  }
+  pos += 5;
+  while (pos < payload.size() &&
+         (std::isspace(static_cast<unsigned char>(payload[pos])) ||
+          payload[pos] == ':')) {
+    pos++;
+  }
+  int64_t seconds = 0;
+  size_t digits = 0;
+  for (; pos < payload.size() && digits < 12 &&
+         std::isdigit(static_cast<unsigned char>(payload[pos]));
+       pos++, digits++) {
+    seconds = seconds * 10 + (payload[pos] - '0');
+  }
+  return digits > 0 ? seconds * 1000 : 0;
+}
+
+std::shared_ptr<CubeTokenSource>
+CubeTokenSource::Make(const AdbcCubeTokenProvider &provider,
+                      std::chrono::milliseconds renew_ahead,
+                      std::shared_ptr<NativeClientPool> pool,
+                      std::string database, std::string *message) {
+  auto source = std::make_shared<CubeTokenSource>(
+      provider, renew_ahead, std::move(pool), std::move(database));
+  if (!source->Fetch(&source->token_, &source->expires_at_ms_, message)) {
+    return nullptr;
+  }
+  source->thread_ = std::thread(&CubeTokenSource::RenewLoop, source.get());
+  return source;
+}
+
+CubeTokenSource::CubeTokenSource(const AdbcCubeTokenProvider &provider,
+                                 std::chrono::milliseconds renew_ahead,
+                                 std::shared_ptr<NativeClientPool> pool,
+                                 std::string database)
+    : provider_(provider), renew_ahead_(renew_ahead), pool_(std::move(pool)),
+      database_(std::move(database)),
+      fork_generation_(CubeForkGeneration()) {
+  CubeForkRegisterMutex(&mutex_);
+}
+
+CubeTokenSource::~CubeTokenSource() {
+  CubeForkUnregisterMutex(&mutex_);
+  if (fork_generation_ != CubeForkGeneration()) {
+    // The renewal thread stayed in the parent, and its condition variable
+    // still counts it as a waiter
+    if (thread_.joinable()) {
+      thread_.detach();
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::string CubeTokenSource::token() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fork_generation_ == CubeForkGeneration() ||
+        std::chrono::system_clock::now() < Due()) {
+      return token_;
+    }
+  }
+  // A forked child has no renewal thread: renew here, keeping the old
+  // token if that fails
+  std::string token;
+  int64_t expires_at_ms = 0;
+  std::string message;
+  if (Fetch(&token, &expires_at_ms, &message)) {
+    Publish(std::move(token), expires_at_ms);
+  } else {
+    CUBE_LOG(Warn, "TokenSource", "Cannot renew token",
+             {{"error", message}});
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return token_;
+}
+
+bool CubeTokenSource::Fetch(std::string *token, int64_t *expires_at_ms,
+                            std::string *message) {
+  std::string buffer(256, '\0');
+  int64_t expires = 0;
+  size_t length =
+      provider_.get_token(provider_.user_data, buffer.data(), buffer.size(),
+                          &expires);
+  if (length > buffer.size()) {
+    buffer.resize(length);
+    expires = 0;
+    length = provider_.get_token(provider_.user_data, buffer.data(),
+                                 buffer.size(), &expires);
+  }
+  if (length == 0 || length > buffer.size()) {
+    *message = "the token provider returned no token";
+    return false;
+  }
+  buffer.resize(length);
+  *expires_at_ms = expires > 0 ? expires : JwtExpiresAtMs(buffer);
+  *token = std::move(buffer);
+  return true;
+}
+
+void CubeTokenSource::Publish(std::string token, int64_t expires_at_ms) {
+  std::string old;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (token == token_) {
+      expires_at_ms_ = expires_at_ms;
+      return;
+    }
+    old = std::exchange(token_, token);
+    expires_at_ms_ = expires_at_ms;
+  }
+  renewals_.fetch_add(1, std::memory_order_relaxed);
+  CUBE_LOG(Debug, "TokenSource", "Renewed token",
+           {{"expires_at_ms", expires_at_ms}});
+  if (pool_) {
+    pool_->SwitchToken(old, token, database_);
+  }
+}
+
+std::chrono::system_clock::time_point CubeTokenSource::Due() const {
+  if (expires_at_ms_ == 0) {
+    return std::chrono::system_clock::time_point::max();
+  }
+  return std::chrono::system_clock::time_point(
+             std::chrono::milliseconds(expires_at_ms_)) -
+         renew_ahead_;
+}
+
+void CubeTokenSource::RenewLoop() {
+  auto retry = kMinRetry;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto next = Due();
+  while (true) {
+    if (expires_at_ms_ == 0) {
+      // A token that does not expire is kept until the source is stopped
+      cv_.wait(lock, [this] { return stopping_; });
+      return;
+    }
+    if (cv_.wait_until(lock, next, [this] { return stopping_; })) {
+      return;
+    }
+    int64_t expires_in_ms = expires_at_ms_ - NowMs();
+    lock.unlock();
+    std::string token;
+    int64_t expires_at_ms = 0;
+    std::string message;
+    bool renewed = Fetch(&token, &expires_at_ms, &message);
+    if (renewed) {
+      Publish(std::move(token), expires_at_ms);
+    } else {
+      CUBE_LOG(Warn, "TokenSource", "Cannot renew token",
+               {{"error", message}, {"expires_in_ms", expires_in_ms}});
+    }
+    lock.lock();
+    if (renewed) {
+      retry = kMinRetry;
+      next = Due();
+      // A provider handing back a token as close to expiry as before is
+      // asked again no sooner than a retry would
+      next = std::max(next, std::chrono::system_clock::now() + kMinRetry);
+    } else {
+      next = std::chrono::system_clock::now() + retry;
+      retry = std::min(retry * 2, kMaxRetry);
+    }
+  }
+}
+
+} // namespace adbc::cube
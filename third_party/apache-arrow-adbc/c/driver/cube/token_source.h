@@ -0,0 +1,133 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+extern "C" {
+
+/// Callback the driver asks for tokens, in place of adbc.cube.token, so
+/// that tokens can be rotated without reconnecting. Register one by
+/// passing its address to AdbcDatabaseSetOptionInt with the key
+/// "adbc.cube.token_provider" (0 unregisters); the driver copies it, so it
+/// need not outlive the call, but user_data must outlive the database.
+///
+/// Called once by AdbcDatabaseInit, then from a background thread ahead
+/// of each token's expiry (see adbc.cube.token_renew_ahead_ms); it must
+/// not call back into the driver.
+struct AdbcCubeTokenProvider {
+  /// Passed back to get_token
+  void *user_data;
+  /// Write the current token to buffer, which holds size bytes, and
+  /// return its length, or 0 on failure. A longer token is asked for again
+  /// with a buffer that fits it. Set *expires_at_ms to when it expires, in
+  /// milliseconds since the Unix epoch, or leave it 0 to take the exp
+  /// claim of a JWT; a token with neither is never renewed.
+  size_t (*get_token)(void *user_data, char *buffer, size_t size,
+                      int64_t *expires_at_ms);
+};
+
+} // extern "C"
+
+namespace adbc::cube {
+
+class NativeClientPool;
+
+/// When a JWT expires, from its exp claim, in milliseconds since the Unix
+/// epoch; 0 if token is not a JWT or has no exp
+int64_t JwtExpiresAtMs(std::string_view token);
+
+/// The token of a database with an AdbcCubeTokenProvider, renewed by a
+/// background thread renew_ahead before it expires. Each renewal switches
+/// the pool's idle sessions to the new token (see
+/// NativeClientPool::SwitchToken), and connections following the source
+/// switch theirs at their next request, so neither has to authenticate
+/// anew on a query's path. A failed renewal is retried with backoff while
+/// the old token lasts. Thread-safe.
+///
+/// Fork-safe: in a child the thread stays with the parent, and token()
+/// renews in the caller once the token is due.
+class CubeTokenSource {
+public:
+  /// Ask provider for the first token and start renewing it; null with
+  /// message set if provider fails
+  static std::shared_ptr<CubeTokenSource>
+  Make(const AdbcCubeTokenProvider &provider,
+       std::chrono::milliseconds renew_ahead,
+       std::shared_ptr<NativeClientPool> pool, std::string database,
+       std::string *message);
+
+  CubeTokenSource(const AdbcCubeTokenProvider &provider,
+                  std::chrono::milliseconds renew_ahead,
+                  std::shared_ptr<NativeClientPool> pool,
+                  std::string database);
+  ~CubeTokenSource();
+
+  CubeTokenSource(const CubeTokenSource &) = delete;
+  CubeTokenSource &operator=(const CubeTokenSource &) = delete;
+
+  /// The current token
+  std::string token();
+
+  /// Tokens taken from the provider after the first
+  int64_t renewals() const {
+    return renewals_.load(std::memory_order_relaxed);
+  }
+
+private:
+  /// Ask the provider for a token
+  bool Fetch(std::string *token, int64_t *expires_at_ms,
+             std::string *message);
+
+  /// Replace the current token and switch the pool's sessions to it
+  void Publish(std::string token, int64_t expires_at_ms);
+
+  /// When the current token is to be renewed (mutex_ must be held)
+  std::chrono::system_clock::time_point Due() const;
+
+  /// Renew the token ahead of each expiry, until stopped
+  void RenewLoop();
+
+  /// First wait after a failed renewal, doubled up to kMaxRetry
+  static constexpr std::chrono::milliseconds kMinRetry{1000};
+  static constexpr std::chrono::milliseconds kMaxRetry{30000};
+
+  const AdbcCubeTokenProvider provider_;
+  const std::chrono::milliseconds renew_ahead_;
+  const std::shared_ptr<NativeClientPool> pool_;
+  const std::string database_;
+  std::mutex mutex_;
+  std::string token_;
+  int64_t expires_at_ms_ = 0; // 0 = never renewed
+  std::atomic<int64_t> renewals_{0};
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  std::thread thread_;
+  uint64_t fork_generation_; // CubeForkGeneration() of thread_
+};
+
+} // namespace adbc::cube
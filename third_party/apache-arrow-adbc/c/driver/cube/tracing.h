@@ -0,0 +1,153 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+extern "C" {
+
+/// Callbacks the driver reports spans to, in the style of OpenTelemetry.
+/// Register one by passing its address to AdbcDatabaseSetOptionInt with
+/// the key "adbc.cube.tracer" (0 unregisters); the driver copies it, so it
+/// need not outlive the call, but user_data must outlive the database.
+/// Callbacks may be called from any thread, and must not call back into
+/// the driver.
+///
+/// Spans: "Connect", with a child "PerformHandshake", and "Authenticate"
+/// for each native session opened; "ExecuteQuery" for each query, with
+/// events "sent", "first_byte" and "complete", ended when its result
+/// stream is released; and "GetNext", a child of it, for each batch
+/// decoded.
+struct AdbcCubeTracer {
+  /// Passed back to every callback
+  void *user_data;
+  /// Begin a span; name is a static string and parent null for a root
+  /// span. Returns the handle passed to the other callbacks, or null to
+  /// skip the span.
+  void *(*start_span)(void *user_data, const char *name, void *parent);
+  /// Record a point in time within span (may be null)
+  void (*add_event)(void *user_data, void *span, const char *name);
+  /// End span; status is the AdbcStatusCode it finished with (0 = OK)
+  void (*end_span)(void *user_data, void *span, int status);
+  /// Write span's W3C traceparent ("00-<trace id>-<span id>-<flags>") to
+  /// buffer, which holds size bytes, and return its length, or 0 if it has
+  /// none (may be null). Sent with the query, so that the server's spans
+  /// join its trace.
+  size_t (*traceparent)(void *user_data, void *span, char *buffer,
+                        size_t size);
+};
+
+} // extern "C"
+
+namespace adbc::cube {
+
+/// A registered AdbcCubeTracer, or none. Spans of a disabled tracer cost
+/// one branch.
+class CubeTracer {
+public:
+  CubeTracer() : callbacks_{} {}
+  explicit CubeTracer(const AdbcCubeTracer &callbacks)
+      : callbacks_(callbacks) {}
+
+  bool enabled() const { return callbacks_.start_span != nullptr; }
+  const AdbcCubeTracer &callbacks() const { return callbacks_; }
+
+private:
+  AdbcCubeTracer callbacks_;
+};
+
+/// One span of a CubeTracer; ended with the status last set when it is
+/// destroyed, unless End was called. Movable.
+class CubeSpan {
+public:
+  CubeSpan() : callbacks_{} {}
+  CubeSpan(const CubeTracer &tracer, const char *name,
+           const CubeSpan *parent = nullptr)
+      : CubeSpan() {
+    if (tracer.enabled()) {
+      Start(tracer.callbacks(), name, parent ? parent->span_ : nullptr);
+    }
+  }
+  /// A child of parent, if it is active
+  CubeSpan(const CubeSpan &parent, const char *name) : CubeSpan() {
+    if (parent.span_) {
+      Start(parent.callbacks_, name, parent.span_);
+    }
+  }
+  CubeSpan(CubeSpan &&other) noexcept
+      : callbacks_(other.callbacks_), span_(other.span_),
+        status_(other.status_) {
+    other.span_ = nullptr;
+  }
+  CubeSpan &operator=(CubeSpan &&other) noexcept {
+    if (this != &other) {
+      End();
+      callbacks_ = other.callbacks_;
+      span_ = std::exchange(other.span_, nullptr);
+      status_ = other.status_;
+    }
+    return *this;
+  }
+  CubeSpan(const CubeSpan &) = delete;
+  CubeSpan &operator=(const CubeSpan &) = delete;
+  ~CubeSpan() { End(); }
+
+  bool active() const { return span_ != nullptr; }
+
+  void Event(const char *name) {
+    if (span_ && callbacks_.add_event) {
+      callbacks_.add_event(callbacks_.user_data, span_, name);
+    }
+  }
+
+  /// Status the span ends with (an AdbcStatusCode)
+  void SetStatus(int status) { status_ = status; }
+
+  void End() {
+    if (span_) {
+      callbacks_.end_span(callbacks_.user_data, span_, status_);
+      span_ = nullptr;
+    }
+  }
+
+  /// W3C traceparent of the span, or empty
+  std::string Traceparent() const {
+    if (!span_ || !callbacks_.traceparent) {
+      return std::string();
+    }
+    char buffer[128];
+    size_t length = callbacks_.traceparent(callbacks_.user_data, span_,
+                                           buffer, sizeof(buffer));
+    return std::string(buffer, length < sizeof(buffer) ? length : 0);
+  }
+
+private:
+  void Start(const AdbcCubeTracer &callbacks, const char *name,
+             void *parent) {
+    callbacks_ = callbacks;
+    span_ = callbacks.start_span(callbacks.user_data, name, parent);
+  }
+
+  AdbcCubeTracer callbacks_;
+  void *span_ = nullptr;
+  int status_ = 0;
+};
+
+} // namespace adbc::cube
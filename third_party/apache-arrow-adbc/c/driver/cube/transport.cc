@@ -0,0 +1,305 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "driver/cube/transport.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CUBE_TRANSPORT_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace adbc::cube {
+
+std::optional<CubeTransportKind> ParseTransportKind(std::string_view name) {
+  if (name == "socket") {
+    return CubeTransportKind::Socket;
+  } else if (name == "io_uring") {
+    return CubeTransportKind::IoUring;
+  }
+  return std::nullopt;
+}
+
+bool TransportAvailable(CubeTransportKind kind) {
+  switch (kind) {
+  case CubeTransportKind::Socket:
+    return true;
+  case CubeTransportKind::IoUring:
+#if defined(CUBE_TRANSPORT_IO_URING)
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+CubeTransport::~CubeTransport() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+ssize_t CubeTransport::Read(uint8_t *buffer, size_t length) {
+  return read(fd_, buffer, length);
+}
+
+ssize_t CubeTransport::ReadAvailable(uint8_t *buffer, size_t length) {
+  return recv(fd_, buffer, length, MSG_DONTWAIT);
+}
+
+ssize_t CubeTransport::Write(const struct iovec *iov, int count) {
+  struct msghdr message;
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = const_cast<struct iovec *>(iov);
+  message.msg_iovlen = count;
+  return sendmsg(fd_, &message, MSG_DONTWAIT);
+}
+
+ssize_t CubeTransport::WriteWithFd(const struct iovec *iov, int count,
+                                   int passed_fd) {
+  union {
+    struct cmsghdr header;
+    char bytes[CMSG_SPACE(sizeof(int))];
+  } control;
+  std::memset(&control, 0, sizeof(control));
+  struct msghdr message;
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = const_cast<struct iovec *>(iov);
+  message.msg_iovlen = count;
+  message.msg_control = control.bytes;
+  message.msg_controllen = sizeof(control.bytes);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+  return sendmsg(fd_, &message, MSG_DONTWAIT);
+}
+
+void CubeTransport::Shutdown() { shutdown(fd_, SHUT_RDWR); }
+
+#if defined(CUBE_TRANSPORT_IO_URING)
+
+namespace {
+
+// Blocking reads through an io_uring of its own: each Read submits one
+// receive and waits for it in a single io_uring_enter. Reads into the
+// registered read-ahead window use IORING_OP_READ_FIXED, so the kernel
+// does not map the pages on every call. Writes and non-blocking reads are
+// left to the socket calls, since they never wait.
+//
+// Talks to the kernel directly rather than through liburing, which the
+// driver cannot assume is installed.
+class UringTransport final : public CubeTransport {
+public:
+  static std::unique_ptr<CubeTransport> Make(int fd) {
+    std::unique_ptr<UringTransport> transport(new UringTransport(fd));
+    if (!transport->Setup()) {
+      // Leave the socket to the plain transport
+      transport->fd_ = -1;
+      return nullptr;
+    }
+    return transport;
+  }
+
+  ~UringTransport() override {
+    if (registered_) {
+      syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS,
+              nullptr, 0);
+    }
+    if (sqes_) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+  }
+
+  const char *name() const override { return "io_uring"; }
+
+  ssize_t Read(uint8_t *buffer, size_t length) override {
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe *sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    if (registered_ && buffer >= registered_data_ &&
+        buffer + length <= registered_data_ + registered_size_) {
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->buf_index = 0;
+    } else {
+      sqe->opcode = IORING_OP_RECV;
+    }
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+    while (true) {
+      unsigned head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        int result = cqes_[head & *cq_mask_].res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        if (result < 0) {
+          errno = -result;
+          return -1;
+        }
+        return result;
+      }
+      // Submit whatever the kernel has not taken yet; after EINTR that may
+      // be nothing, leaving only the wait
+      unsigned to_submit =
+          *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      if (syscall(__NR_io_uring_enter, ring_fd_, to_submit, 1,
+                  IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return -1;
+      }
+    }
+  }
+
+  void RegisterBuffer(uint8_t *data, size_t size) override {
+    if (data == registered_data_ && size == registered_size_) {
+      return;
+    }
+    if (registered_) {
+      syscall(__NR_io_uring_register, ring_fd_, IORING_UNREGISTER_BUFFERS,
+              nullptr, 0);
+      registered_ = false;
+    }
+    registered_data_ = data;
+    registered_size_ = size;
+    if (data) {
+      struct iovec iov;
+      iov.iov_base = data;
+      iov.iov_len = size;
+      // Fails under a low RLIMIT_MEMLOCK; reads then use IORING_OP_RECV
+      registered_ = syscall(__NR_io_uring_register, ring_fd_,
+                            IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    }
+  }
+
+private:
+  explicit UringTransport(int fd) : CubeTransport(fd) {}
+
+  bool Setup() {
+    // One read in flight at a time
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, 2, &params));
+    if (ring_fd_ < 0) {
+      return false; // Kernel too old, or io_uring disabled
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes +
+                    params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ =
+          sq_ring_size_ > cq_ring_size_ ? sq_ring_size_ : cq_ring_size_;
+    }
+    sq_ring_ = Map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_ : Map(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!cq_ring_) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe *>(
+        Map(sqes_size_, IORING_OFF_SQES));
+    if (!sqes_) {
+      return false;
+    }
+
+    auto *sq = static_cast<uint8_t *>(sq_ring_);
+    auto *cq = static_cast<uint8_t *>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void *Map(size_t size, off_t offset) {
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  int ring_fd_ = -1;
+  void *sq_ring_ = nullptr;
+  void *cq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  struct io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  struct io_uring_cqe *cqes_ = nullptr;
+
+  // Buffer given to RegisterBuffer, and whether the kernel took it
+  uint8_t *registered_data_ = nullptr;
+  size_t registered_size_ = 0;
+  bool registered_ = false;
+};
+
+} // namespace
+
+#endif
+
+std::unique_ptr<CubeTransport> CubeTransport::Make(CubeTransportKind kind,
+                                                   int fd) {
+#if defined(CUBE_TRANSPORT_IO_URING)
+  if (kind == CubeTransportKind::IoUring) {
+    if (auto transport = UringTransport::Make(fd)) {
+      return transport;
+    }
+  }
+#else
+  (void)kind;
+#endif
+  return std::unique_ptr<CubeTransport>(new CubeTransport(fd));
+}
+
+} // namespace adbc::cube
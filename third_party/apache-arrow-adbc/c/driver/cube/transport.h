@@ -0,0 +1,97 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+namespace adbc::cube {
+
+/// How NativeClient moves bytes over its connection
+enum class CubeTransportKind {
+  Socket,  // read() and sendmsg() on the socket
+  IoUring, // io_uring (Linux); reads go through a ring set up per connection
+};
+
+/// Parse a CubeTransportKind from its option value ("socket" or "io_uring")
+std::optional<CubeTransportKind> ParseTransportKind(std::string_view name);
+
+/// Whether this build can use kind at all. A kind that is built in may
+/// still be refused by the kernel, in which case Make falls back to
+/// Socket.
+bool TransportAvailable(CubeTransportKind kind);
+
+/// The byte stream under the native protocol. Owns a connected socket,
+/// closed with the transport. Calls follow POSIX: they return a count of
+/// bytes, 0 at the end of the stream, or -1 with errno set.
+///
+/// This class reads and writes with plain system calls; other kinds
+/// override the calls they do differently. fd() stays pollable for every
+/// kind.
+class CubeTransport {
+public:
+  /// Wrap the connected socket fd
+  static std::unique_ptr<CubeTransport> Make(CubeTransportKind kind, int fd);
+
+  virtual ~CubeTransport();
+
+  int fd() const { return fd_; }
+
+  /// Name of the kind in use, for diagnostics
+  virtual const char *name() const { return "socket"; }
+
+  /// Read at least one byte, waiting for it
+  virtual ssize_t Read(uint8_t *buffer, size_t length);
+
+  /// Read what can be read without waiting; -1 with EAGAIN if nothing
+  virtual ssize_t ReadAvailable(uint8_t *buffer, size_t length);
+
+  /// Write what fits without waiting; -1 with EAGAIN if nothing does
+  virtual ssize_t Write(const struct iovec *iov, int count);
+
+  /// Write like Write, passing passed_fd to the peer along with the first
+  /// byte (SCM_RIGHTS; Unix domain sockets only). -1 with EOPNOTSUPP where
+  /// the kind cannot pass descriptors.
+  virtual ssize_t WriteWithFd(const struct iovec *iov, int count,
+                              int passed_fd);
+
+  /// Whether bytes are held inside the transport, so Read returns at once
+  /// even when fd() does not poll readable
+  virtual bool HasBuffered() const { return false; }
+
+  /// The buffer most reads land in (the read-ahead window), so a kind that
+  /// can map it once does; nullptr forgets it. It must be called again
+  /// before the memory is freed or reused.
+  virtual void RegisterBuffer(uint8_t * /*data*/, size_t /*size*/) {}
+
+  /// Make a Read blocked on another thread return
+  virtual void Shutdown();
+
+protected:
+  explicit CubeTransport(int fd) : fd_(fd) {}
+
+  int fd_;
+};
+
+} // namespace adbc::cube
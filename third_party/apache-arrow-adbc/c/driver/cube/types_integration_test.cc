@@ -248,7 +248,7 @@ TEST_F(TypesIntegrationTest, FLOATType) {
   ASSERT_EQ(array_.n_children, 1);
 
   struct ArrowArray *col = array_.children[0];
-  const double *data = reinterpret_cast<const double *>(col->buffers[1]);
+  const float *data = reinterpret_cast<const float *>(col->buffers[1]);
 
   std::cout << "FLOAT test - rows: " << array_.length << ", first value: "
             << data[0] << std::endl;
@@ -310,6 +310,18 @@ TEST_F(TypesIntegrationTest, AllNumericTypes) {
   ASSERT_GT(array_.length, 0);
   ASSERT_EQ(array_.n_children, 10);
 
+  // Declared widths are kept, not widened to int64/double
+  struct ArrowSchema schema;
+  ASSERT_EQ(stream_.get_schema(&stream_, &schema), 0);
+  ASSERT_EQ(schema.n_children, 10);
+  const char *expected_formats[] = {"c", "s", "i", "l", "C",
+                                    "S", "I", "L", "f", "g"};
+  for (int i = 0; i < 10; i++) {
+    EXPECT_STREQ(schema.children[i]->format, expected_formats[i])
+        << "column " << schema.children[i]->name;
+  }
+  ArrowSchemaRelease(&schema);
+
   std::cout << "All numeric types test - rows: " << array_.length
             << ", columns: " << array_.n_children << std::endl;
 }
@@ -26,6 +26,72 @@
 extern "C" {
 #endif
 
+// The Arrow C device data and async stream interfaces, as defined by
+// arrow/c/abi.h; skipped when that header was included first
+
+#ifndef ARROW_C_DEVICE_DATA_INTERFACE
+#define ARROW_C_DEVICE_DATA_INTERFACE
+
+typedef int32_t ArrowDeviceType;
+
+#define ARROW_DEVICE_CPU 1
+#define ARROW_DEVICE_CUDA 2
+#define ARROW_DEVICE_CUDA_HOST 3
+
+struct ArrowDeviceArray {
+  struct ArrowArray array;
+  int64_t device_id;
+  ArrowDeviceType device_type;
+  void* sync_event;
+  int64_t reserved[3];
+};
+
+#endif  // ARROW_C_DEVICE_DATA_INTERFACE
+
+#ifndef ARROW_C_DEVICE_STREAM_INTERFACE
+#define ARROW_C_DEVICE_STREAM_INTERFACE
+
+struct ArrowDeviceArrayStream {
+  ArrowDeviceType device_type;
+  int (*get_schema)(struct ArrowDeviceArrayStream* self, struct ArrowSchema* out);
+  int (*get_next)(struct ArrowDeviceArrayStream* self, struct ArrowDeviceArray* out);
+  const char* (*get_last_error)(struct ArrowDeviceArrayStream* self);
+  void (*release)(struct ArrowDeviceArrayStream* self);
+  void* private_data;
+};
+
+#endif  // ARROW_C_DEVICE_STREAM_INTERFACE
+
+#ifndef ARROW_C_ASYNC_STREAM_INTERFACE
+#define ARROW_C_ASYNC_STREAM_INTERFACE
+
+struct ArrowAsyncTask {
+  int (*extract_data)(struct ArrowAsyncTask* self, struct ArrowDeviceArray* out);
+  void* private_data;
+};
+
+struct ArrowAsyncProducer {
+  ArrowDeviceType device_type;
+  void (*request)(struct ArrowAsyncProducer* self, int64_t n);
+  void (*cancel)(struct ArrowAsyncProducer* self);
+  const char* additional_metadata;
+  void* private_data;
+};
+
+struct ArrowAsyncDeviceStreamHandler {
+  int (*on_schema)(struct ArrowAsyncDeviceStreamHandler* self,
+                   struct ArrowSchema* stream_schema);
+  int (*on_next_task)(struct ArrowAsyncDeviceStreamHandler* self,
+                      struct ArrowAsyncTask* task, const char* metadata);
+  void (*on_error)(struct ArrowAsyncDeviceStreamHandler* self, int code,
+                   const char* message, const char* metadata);
+  void (*release)(struct ArrowAsyncDeviceStreamHandler* self);
+  struct ArrowAsyncProducer* producer;
+  void* private_data;
+};
+
+#endif  // ARROW_C_ASYNC_STREAM_INTERFACE
+
 /// \brief Connection option: Cube host
 /// \details The hostname or IP address of the Cube SQL API server.
 /// Default: localhost
@@ -53,6 +119,76 @@ extern "C" {
 /// \details Password for authentication (if required).
 #define ADBC_OPTION_CUBE_PASSWORD "adbc.cube.password"
 
+/// \brief Run several independent queries in one round trip
+/// \details out must have room for count streams; out[i] receives the
+/// result of queries[i]. Native servers that support it get the queries in
+/// a single frame and may run them concurrently. In PostgreSQL mode they
+/// are sent in one libpq pipeline (libpq 14 or later, otherwise
+/// ADBC_STATUS_NOT_IMPLEMENTED) and run as one implicit transaction. The
+/// streams may be read in any order (results ahead of the one read are
+/// buffered), and without pipelining they must be read before the next
+/// query on the connection, which discards what is left. Only for
+/// applications that link the Cube driver directly, not through the
+/// driver manager.
+ADBC_EXPORT
+AdbcStatusCode AdbcCubeConnectionExecuteQueries(struct AdbcConnection* connection,
+                                                const char** queries, size_t count,
+                                                struct ArrowArrayStream* out,
+                                                struct AdbcError* error);
+
+/// \brief Run a statement's query and push its result into handler
+/// \details Native mode only. handler->producer is set and on_schema
+/// called once the schema has arrived; each batch is then handed to
+/// on_next_task as soon as it is decoded, up to the number of batches
+/// asked for with handler->producer->request(n), and the end of the
+/// result is a null task. Nothing blocks on the network: callbacks run
+/// inside request(n), or inside AdbcConnectionGetOptionInt of
+/// "adbc.cube.result_ready" when an event loop finds the connection's
+/// socket readable (with pipelining, the call returns once the query is
+/// sent). Batches are CPU arrays. handler is released after the last
+/// callback; if the query cannot be started, on_error is called, handler
+/// is released and the error is returned. Only for applications that link
+/// the Cube driver directly, not through the driver manager.
+ADBC_EXPORT
+AdbcStatusCode AdbcCubeStatementExecuteQueryAsync(
+    struct AdbcStatement* statement, struct ArrowAsyncDeviceStreamHandler* handler,
+    struct AdbcError* error);
+
+/// \brief Run a statement's query once and return its result as count streams
+/// \details out must have room for count streams, each of which returns
+/// every batch of the result. Batches are decoded once and shared between
+/// the streams without copying; their buffers are freed when every stream
+/// has released its copy. Each stream may be read at its own pace from its
+/// own thread: with max_buffered_batches > 0, a stream that many batches
+/// ahead of the slowest open stream blocks until it catches up, so the
+/// streams must then be read concurrently; 0 buffers without bound.
+/// Releasing a stream stops it holding the others back. Only for
+/// applications that link the Cube driver directly, not through the
+/// driver manager.
+ADBC_EXPORT
+AdbcStatusCode AdbcCubeStatementExecuteQueryTee(struct AdbcStatement* statement,
+                                                size_t count,
+                                                int64_t max_buffered_batches,
+                                                struct ArrowArrayStream* out,
+                                                struct AdbcError* error);
+
+/// \brief Run a statement's query and return its result as a device stream
+/// \details Without an allocator registered with the "adbc.cube.allocator"
+/// database option, out is an ARROW_DEVICE_CPU stream of the usual batches.
+/// With one, out has the allocator's device type (such as
+/// ARROW_DEVICE_CUDA_HOST), and every buffer of every batch lies in memory
+/// it allocated: received buffers shared with the batch already do, and
+/// the others, such as those of messages spilled to disk or read from
+/// shared memory, are copied into it as the batch is returned. Batches
+/// carry no sync event, since they are ready when returned. rows_affected
+/// may be null. Only for applications that link the Cube driver directly,
+/// not through the driver manager.
+ADBC_EXPORT
+AdbcStatusCode AdbcCubeStatementExecuteQueryDevice(struct AdbcStatement* statement,
+                                                   struct ArrowDeviceArrayStream* out,
+                                                   int64_t* rows_affected,
+                                                   struct AdbcError* error);
+
 #ifdef __cplusplus
 }
 #endif